@@ -29,5 +29,6 @@ sipXcommserverLib_DEPS = sipXtackLib
 sipXproxy_DEPS = sipXcommserverLib 
 sipXregistry_DEPS = sipXcommserverLib
 sipXtools_DEPS = sipXtackLib sipXcommserverLib
+sipXkamailio_DEPS = sipXportLib
 
 all = $(sipx)
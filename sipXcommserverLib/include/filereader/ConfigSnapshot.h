@@ -0,0 +1,146 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _ConfigSnapshot_h_
+#define _ConfigSnapshot_h_
+
+// SYSTEM INCLUDES
+#include <string>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+// APPLICATION INCLUDES
+#include "filereader/FileWatcher.h"
+#include <os/OsDateTime.h>
+#include <os/OsLogger.h>
+#include <os/OsTime.h>
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+//: What was last read from a configuration file, read again whenever it changes.
+//
+// The file is parsed into an object of type T which is never changed once
+// published; get() returns the latest one.  When the file changes, a
+// FileWatcher reads it again on its own thread and publishes the new T by
+// swapping a shared_ptr, so the threads that call get() never stat the
+// file, never parse it and never wait while it is parsed.  A caller keeps
+// the snapshot it got for as long as it uses it, and the old T is deleted
+// when the last such caller drops it.
+//
+// The methods of T that callers use must be safe to call from several
+// threads at once, as any const method that changes nothing is.
+//
+// This replaces RefreshingFileReader for readers on the SIP path.
+template <class T>
+class ConfigSnapshot
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+public:
+
+   typedef boost::shared_ptr<const T> Ptr;
+
+   /// Parses the file into a new T, or returns NULL to keep the last T.
+   /**
+    * A parser that cannot read the file should return an empty T if a
+    * missing file means no configuration, and NULL if the file may be
+    * broken and the last T is better than none.
+    */
+   typedef boost::function<T* (const std::string& fileName)> Parser;
+
+/* ============================ CREATORS ================================== */
+
+   ConfigSnapshot(const Parser& parser,
+                  FileWatcher& watcher = FileWatcher::instance()) :
+      mParser(parser),
+      mWatcher(watcher),
+      mWatchId(-1)
+   {
+   }
+
+   /// Stops reading the file; waits for a reading in progress.
+   ~ConfigSnapshot()
+   {
+      mWatcher.unwatch(mWatchId);
+   }
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// Read fileName now, then again on the watcher thread whenever it changes.
+   /**
+    * An empty fileName is not watched, but still passed to the parser,
+    * which may then return the T for no file.
+    * @returns whether there is a snapshot once fileName was read.
+    */
+   bool setFileName(const std::string& fileName)
+   {
+      mWatcher.unwatch(mWatchId);
+      mWatchId = fileName.empty() ? -1
+         : mWatcher.watch(fileName,
+                          boost::bind(&ConfigSnapshot<T>::reload, this, _1));
+      reload(fileName);
+      return get().get() != NULL;
+   }
+
+/* ============================ ACCESSORS ================================= */
+
+   /// The snapshot last published, or NULL if there was none.
+   Ptr get() const
+   {
+      return boost::atomic_load(&mSnapshot);
+   }
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+private:
+
+   void reload(const std::string& fileName)
+   {
+      OsTime start;
+      OsDateTime::getCurTimeSinceBoot(start);
+
+      T* parsed = mParser(fileName);
+
+      OsTime end;
+      OsDateTime::getCurTimeSinceBoot(end);
+      OsTime elapsed = end - start;
+      if (parsed)
+      {
+         boost::atomic_store(&mSnapshot, Ptr(parsed));
+         Os::Logger::instance().log(FAC_KERNEL, PRI_INFO,
+                       "ConfigSnapshot::reload '%s' read in %ld.%06ld s",
+                       fileName.c_str(), elapsed.seconds(), elapsed.usecs());
+      }
+      else
+      {
+         Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                       "ConfigSnapshot::reload '%s' could not be read; "
+                       "keeping what was read before",
+                       fileName.c_str());
+      }
+   }
+
+   Parser mParser;
+   FileWatcher& mWatcher;
+   int mWatchId;
+   Ptr mSnapshot;   // only accessed with boost::atomic_load and atomic_store
+
+   ConfigSnapshot(const ConfigSnapshot&);
+   ConfigSnapshot& operator=(const ConfigSnapshot&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _ConfigSnapshot_h_
@@ -0,0 +1,102 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef _FileWatcher_h_
+#define _FileWatcher_h_
+
+// SYSTEM INCLUDES
+#include <map>
+#include <string>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+// APPLICATION INCLUDES
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+//: Calls back, on a thread of its own, when watched files change.
+//
+// The watcher uses inotify on the directory of each file, so it sees a
+// file written in place (when it is closed), replaced by a rename, created
+// or removed, without anyone polling it.  Callbacks run one at a time on
+// the watcher thread, which is where the work of reading a changed file
+// belongs: the threads that use what was read never wait for it.
+class FileWatcher
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+public:
+
+   /// Called on the watcher thread with the name of a file that changed.
+   typedef boost::function<void (const std::string& fileName)> Callback;
+
+/* ============================ CREATORS ================================== */
+
+   /// The watcher shared by the process, which is never destroyed.
+   static FileWatcher& instance();
+
+   FileWatcher();
+
+   /// Stops the watcher thread.
+   ~FileWatcher();
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// Call callback whenever fileName is written, replaced, created or removed.
+   /**
+    * @returns an id to pass to unwatch(), or -1 if the directory of
+    * fileName cannot be watched.
+    */
+   int watch(const std::string& fileName, const Callback& callback);
+
+   /// Stop calling the callback that watch() returned id for.
+   /**
+    * If the callback is running on the watcher thread, waits for it to
+    * return, unless it is the callback itself that calls unwatch().
+    */
+   void unwatch(int id);
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+private:
+
+   struct Watch
+   {
+      std::string mFileName;
+      std::string mName;      // mFileName without the directory
+      int mDirectory;         // the inotify watch of the directory
+      Callback mCallback;
+   };
+
+   /// Body of the watcher thread.
+   void run();
+
+   /// Call the callbacks of the files named in the inotify events in buffer.
+   void dispatch(const char* buffer, ssize_t length);
+
+   int mInotify;                 // the inotify descriptor
+   int mWakeup[2];               // written to stop the thread
+   boost::mutex mMutex;          // guards the members below
+   std::map<int, Watch> mWatches;
+   std::map<int, int> mDirectoryUsers; // watches of each inotify watch
+   int mNextId;
+   boost::recursive_mutex mCalling;    // held while callbacks run
+   boost::thread* mpThread;
+
+   FileWatcher(const FileWatcher&);
+   FileWatcher& operator=(const FileWatcher&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _FileWatcher_h_
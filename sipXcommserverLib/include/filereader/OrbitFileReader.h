@@ -13,7 +13,7 @@
 // SYSTEM INCLUDES
 // APPLICATION INCLUDES
 
-#include "filereader/RefreshingFileReader.h"
+#include "filereader/ConfigSnapshot.h"
 #include <utl/UtlHashMap.h>
 #include <utl/UtlContainableAtomic.h>
 
@@ -31,7 +31,9 @@ class OrbitData;
 
 //: Class construct an object that reads the orbits.xml file that describes
 //: the "parking orbits".
-class OrbitFileReader : public RefreshingFileReader
+//  The file is read again in the background whenever it changes; the
+//  lookups use the orbits last read without waiting for that.
+class OrbitFileReader
 {
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 public:
@@ -45,13 +47,18 @@ public:
 
 /* ============================ MANIPULATORS ============================== */
 
+   //! Set the file name, or clear it with NULL or "".
+   //  Reads the file, and watches it to read it again when it changes.
+   void setFileName(const UtlString* fileName);
+
 /* ============================ ACCESSORS ================================= */
 
 /* ============================ INQUIRY =================================== */
 
     // Look up a user name in the list of orbits.
-    // If found, return a pointer to the orbit data for the user.
-    OrbitData* findInOrbitList(const UtlString& user);
+    // If found, return a pointer to the orbit data for the user, which
+    // stays valid while the pointer is held, even if the file is read again.
+    boost::shared_ptr<const OrbitData> findInOrbitList(const UtlString& user);
 
     // Retrieve the "music on hold" file name.
     void getMusicOnHoldFile(UtlString& file);
@@ -68,19 +75,28 @@ private:
     OrbitFileReader& operator=(const OrbitFileReader& rOrbitFileReader);
     //:Assignment operator
 
-    // A hash map that has as keys all the call parking orbit users, and
-    // as values OrbitData objects containing the information for the orbits.
-    UtlHashMap mOrbitList;
+    // What was read from the file.
+    struct Orbits
+    {
+       // A hash map that has as keys all the call parking orbit users, and
+       // as values OrbitData objects containing the information for the orbits.
+       UtlHashMap mOrbitList;
+
+       // The file containing the "music on hold" audio.
+       UtlString mMusicOnHoldFile;
 
-    // The file containing the "music on hold" audio.
-    UtlString mMusicOnHoldFile;
+       ~Orbits()
+       {
+          mOrbitList.destroyAll();
+       }
+    };
 
-    //! (Re-)read the file and (re)initialize the object.
-    //  If there is no file name, "initialize()" will be called with
-    //  mFileName = "".
-    virtual OsStatus initialize();
+    ConfigSnapshot<Orbits> mOrbits;
 
-    OsStatus parseOrbitFile(UtlString& fileName);
+    //! Read and parse the file.
+    //  Returns the orbits found, which are none if there is no file name
+    //  or the file cannot be parsed.
+    static Orbits* parseOrbitFile(const std::string& fileName);
 
 };
 
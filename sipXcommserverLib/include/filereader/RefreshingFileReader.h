@@ -30,6 +30,9 @@
 //: contents of a file, and every time the object is consulted, it
 //: checks to see if the file has changed, and if so, re-read it to
 //: reinitialize the object.
+//  The file is re-read on the thread that consults the object, while other
+//  threads may be using it; objects used on the SIP path should be kept in
+//  a ConfigSnapshot instead, which re-reads files off that path.
 class RefreshingFileReader
 {
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
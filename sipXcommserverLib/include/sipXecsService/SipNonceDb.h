@@ -9,6 +9,7 @@
 #define _SipNonceDb_h_
 
 // SYSTEM INCLUDES
+#include <stddef.h>
 
 // APPLICATION INCLUDES
 #include "utl/UtlString.h"
@@ -26,6 +27,20 @@
 
 
 /// Create a nonce recognizable as having been generated by this cluster.
+/**
+ * Nonces are signed, so that any server of the cluster can validate a
+ * nonce created by another without sharing any state (see createNewNonce).
+ *
+ * Each SipNonceDb also remembers the nonces it has created or validated,
+ * with the call they are bound to and the nonce-counts that have been used
+ * with them.  A nonce that is presented again is validated by looking it
+ * up rather than by computing its signature again, and recordNonceCount
+ * refuses a nonce-count that has already been used, so that a nonce can be
+ * reused for the requests of a call without a request being replayable.
+ * The table is sharded by nonce so that threads authenticating different
+ * calls do not contend, and a nonce is forgotten some time after it has
+ * expired.
+ */
 class SipNonceDb
 {
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
@@ -57,11 +72,36 @@ public:
                           const UtlString& realm,
                           const long expiredTime);
 
+   /// Record that a request has been authenticated with nonce and nonceCount.
+   /**
+    * Call this once the response of the credentials has been verified.
+    * Returns FALSE if nonceCount has already been used with nonce by
+    * another request, in which case the request is a replay and must be
+    * challenged again, or if nonceCount is not a valid nonce-count.
+    *
+    * The same nonceCount with the same cseq (the value of the CSeq header)
+    * is accepted, as that is the same request again (a spiral or a
+    * retransmission).  An empty nonceCount (credentials without qop) is
+    * always accepted, as there is nothing to check.
+    */
+   UtlBoolean recordNonceCount(const UtlString& nonce,
+                               const UtlString& nonceCount,
+                               const UtlString& cseq);
+
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
 protected:
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 private:
+
+   class Shard;
+
+   /// Number of shards of the nonce table; a nonce is in the shard of its first digit.
+   static const size_t sShardCount = 16;
+
+   /// The shard that holds nonce, which must have been checked to be well formed.
+   Shard* shardOf(const UtlString& nonce);
+
    /// Generate a signature for a given set of inputs
    UtlString nonceSignature(const UtlString& callId,
                             const UtlString& fromTag,
@@ -71,6 +111,9 @@ private:
 
    SharedSecret* mpNonceSignatureSecret;
 
+   /// The table of the nonces created or validated by this SipNonceDb.
+   Shard* mShards[sShardCount];
+
    // @cond INCLUDENOCOPY
    SipNonceDb(const SipNonceDb& rSipNonceDb);
    SipNonceDb& operator=(const SipNonceDb& rhs);
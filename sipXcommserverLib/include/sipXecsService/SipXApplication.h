@@ -108,6 +108,12 @@ class SipXApplication
      */
     void waitForTerminationRequest(int seconds);
 
+    /**
+     * Start signal processing again in a process forked after init(), which
+     * has only the thread that forked it
+     */
+    void restartSignalTaskAfterFork();
+
     // Returns a reference to OsServiceOptions class
     OsServiceOptions& getConfig();
 
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef ASYNCREADER_H
+#define	ASYNCREADER_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include "sipdb/MongoDB.h"
+
+/**
+ * Runs database reads on threads of its own so the SIP threads never wait
+ * for MongoDB.
+ *
+ * A caller queues a read together with a completion callback and carries on;
+ * a reader thread takes the read from the queue, runs it (the read gets a
+ * connection from the pool and queries as usual) and then calls the callback
+ * with the outcome.  Any number of reads up to the pending limit may be
+ * outstanding at once, so a slow secondary only slows the requests that
+ * need it rather than every request behind them on the SIP thread.
+ *
+ * Each read has a deadline, by default the read-query-timeout-ms of the
+ * collection it reads (the time the server is allowed to spend on the
+ * query).  A read still queued at its deadline is not sent to the database;
+ * its callback is called with READ_EXPIRED instead.
+ *
+ * The callback runs on the reader thread, so it must not block; a redirector
+ * typically records the result and calls RedirectPlugin::resumeRedirection().
+ */
+class AsyncReader
+{
+public:
+  enum
+  {
+    DEFAULT_THREADS = 8,
+    DEFAULT_MAX_PENDING = 1024,
+    DEFAULT_TIMEOUT_MS = 32000  ///< deadline when the collection sets no read timeout
+  };
+
+  enum Status
+  {
+    READ_DONE,    ///< the read ran to completion
+    READ_FAILED,  ///< the read threw, or the reader was destroyed before it ran
+    READ_EXPIRED  ///< the deadline passed before a reader thread took the read
+  };
+
+  /// Performs the read; it may throw mongo::DBException or std::exception.
+  typedef boost::function<void()> Read;
+
+  /// Called on a reader thread once the read is over.
+  typedef boost::function<void(Status)> Done;
+
+  AsyncReader(const std::string& name,  ///< label of the metrics of this reader
+              unsigned int threads = DEFAULT_THREADS,
+              std::size_t maxPending = DEFAULT_MAX_PENDING);
+
+  /// Waits for the reads in progress; queued reads are completed with READ_FAILED.
+  ~AsyncReader();
+
+  /// Queue a read with a deadline of timeoutMs from now (0 for DEFAULT_TIMEOUT_MS).
+  /// @return false if maxPending reads are already queued; done will not be called.
+  bool read(const Read& read, const Done& done, unsigned int timeoutMs);
+
+  /// Queue a read with the read timeout of the collection db.
+  bool read(const MongoDB::BaseDB& db, const Read& read, const Done& done);
+
+  /// The number of queued reads that no reader thread has taken yet.
+  std::size_t getPending() const;
+
+  unsigned int getThreads() const { return _threads.size(); }
+
+private:
+  struct Request
+  {
+    Read read;
+    Done done;
+    Int64 queued;    // UtlMetricHistogram::now() microseconds
+    Int64 deadline;
+  };
+
+  /// Body of a reader thread.
+  void run();
+
+  /// Run one request and call its callback.
+  void complete(Request& request);
+
+  std::string _name;
+  std::size_t _maxPending;
+  std::deque<Request> _queue;
+  mutable boost::mutex _mutex;
+  boost::condition_variable _available;
+  bool _stopping;
+  std::vector<boost::thread*> _threads;
+  UtlMetricGauge* _pPending;    // sipx_mongo_async_pending of _name
+  UtlMetricCounter* _pExpired;  // sipx_mongo_async_expired_total of _name
+  UtlMetricCounter* _pRejected; // sipx_mongo_async_rejected_total of _name
+  UtlMetricHistogram* _pWait;   // sipx_mongo_async_wait_seconds of _name
+
+  AsyncReader(const AsyncReader&);
+  AsyncReader& operator=(const AsyncReader&);
+};
+
+#endif	/* ASYNCREADER_H */
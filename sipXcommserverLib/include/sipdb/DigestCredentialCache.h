@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef DIGESTCREDENTIALCACHE_H
+#define	DIGESTCREDENTIALCACHE_H
+
+#include <map>
+#include <string>
+#include <boost/thread.hpp>
+#include "sipdb/EntityDB.h"
+#include "utl/UtlString.h"
+#include "net/Url.h"
+
+class MongoOpLog;
+
+// Seconds a credential is kept while the entity oplog is watched
+#define DIGEST_CREDENTIAL_CACHE_EXPIRE 600
+
+/**
+ * Digest credentials of the users that authenticate, ready for checking.
+ *
+ * For each user name that has authenticated in a realm the cache keeps
+ * H(A1) = MD5(user:realm:password), as built by
+ * HttpMessage::buildMd5UserPasswordDigest, with the identity and the _id of
+ * the entity it was computed from.  Checking a response against it saves
+ * looking up and copying the whole entity and digesting the password for
+ * every request that is challenged.
+ *
+ * An entry is forgotten when the entity it was computed from changes, which
+ * watch() learns from the oplog of the entity collection.  Entries also
+ * expire after a lifetime, which bounds how long a change can go unnoticed;
+ * if the oplog can not be watched the lifetime is that of the EntityDB
+ * cache, so the cache is never staler than EntityDB itself.
+ *
+ * The entries are sharded by key so that lookups of different users do
+ * not contend.
+ */
+class DigestCredentialCache
+{
+public:
+  struct Credential
+  {
+    Credential() : expirationTime(0) {}
+
+    std::string oid;          // _id of the entity
+    std::string identity;     // identity of the entity
+    std::string userId;       // userid of the entity
+    std::string ha1;          // MD5(user:realm:password) in hex
+    std::string authType;
+    unsigned long expirationTime; // seconds since epoch the entry may be used until
+  };
+
+  enum { SHARDS = 16 };
+
+  DigestCredentialCache(unsigned long lifetime = DIGEST_CREDENTIAL_CACHE_EXPIRE);
+
+  ~DigestCredentialCache();
+
+  /// Get the H(A1) of user in realm, and the identity of its entity.
+  ///
+  /// user is the user name of the credentials and userBase the userid of
+  /// the entity (user without any instrument suffix).  On a miss the entity
+  /// is read from entityDb.  Returns false if there is no such user in realm.
+  bool getCredential(const EntityDB& entityDb,
+                     const UtlString& user,
+                     const UtlString& userBase,
+                     const UtlString& realm,
+                     Url& uri,
+                     UtlString& ha1,
+                     UtlString& authType);
+
+  /// Get the H(A1) of user in realm with the password of the entity of uri,
+  /// and the userid of that entity.
+  ///
+  /// As EntityDB::getCredential(const Url&, ...), for checking that the
+  /// credentials are those of the owner of an address of record.
+  bool getCredential(const EntityDB& entityDb,
+                     const Url& uri,
+                     const UtlString& user,
+                     const UtlString& realm,
+                     UtlString& userid,
+                     UtlString& ha1,
+                     UtlString& authType);
+
+  /// Forget the credentials computed from the entity with _id oid
+  void invalidate(const std::string& oid);
+
+  /// Forget all credentials
+  void clear();
+
+  /// Invalidate credentials as entities change, from now on.
+  /// Returns false, and shortens the lifetime to ENTITYDB_CACHE_EXPIRE, if
+  /// the oplog can not be read.
+  bool watch(const MongoDB::ConnectionInfo& info);
+
+  /// Suitable for MongoOpLog::registerCallback(MongoOpLog::All, ...) on the
+  /// entity namespace.
+  void onOpLogEntry(const mongo::BSONObj& entry);
+
+  unsigned long getLifetime() const
+  {
+    return _lifetime;
+  }
+
+private:
+  typedef std::map<std::string, Credential> Credentials;
+  typedef std::multimap<std::string, std::string> KeysByOid;
+
+  struct Shard
+  {
+    Shard() : generation(0) {}
+
+    boost::mutex mutex;
+    Credentials credentials;  // by makeKey()
+    KeysByOid keys;           // keys of the credentials of each entity
+    unsigned long generation; // changed by every invalidation
+  };
+
+  /// The key of the credentials of user in realm, found by identity if it is not null
+  static std::string makeKey(const UtlString& identity, const UtlString& user, const UtlString& realm);
+
+  /// Copy the entry with key to credential, or set generation to that of its shard
+  bool find(const std::string& key, Credential& credential, unsigned long& generation);
+
+  /// Add credential with key, unless its shard has changed since generation
+  void add(const std::string& key, const Credential& credential, unsigned long generation);
+
+  void makeCredential(EntityRecord& entity,
+                      const UtlString& user,
+                      const UtlString& realm,
+                      Credential& credential) const;
+
+  Shard& shardOf(const std::string& key);
+
+  /// Remove the entry at pos from shard, which must be locked
+  static void erase(Shard& shard, Credentials::iterator pos);
+
+  Shard _shards[SHARDS];
+  unsigned long _lifetime;
+  MongoOpLog* _pOpLog;
+
+  DigestCredentialCache(const DigestCredentialCache&);
+  DigestCredentialCache& operator=(const DigestCredentialCache&);
+};
+
+#endif	/* DIGESTCREDENTIALCACHE_H */
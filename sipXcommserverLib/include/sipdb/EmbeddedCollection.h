@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef EMBEDDEDCOLLECTION_H
+#define	EMBEDDEDCOLLECTION_H
+
+#include <string>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include "sipdb/MappedJournal.h"
+
+/**
+ * The embedded storage of a sipdb collection: the documents of a node kept
+ * in this process, by the natural key of each record, with hash indexes on
+ * the fields the collection is looked up by.
+ *
+ * Changes go through a MappedJournal, which persists them and shares them
+ * with the other processes of the node (the registrar writes the bindings
+ * the proxy reads), so every lookup first applies what was appended since.
+ * The documents are those the Mongo backend would store, so the records
+ * (RegBinding, Subscription, ...) are built from them as before.
+ *
+ * Used by RegDB, SubscribeDB and GatewayDestDB when the connection info asks
+ * for embedded storage, see MongoDB::ConnectionInfo::useEmbeddedStorage().
+ */
+class EmbeddedCollection : public MappedJournal::Table
+{
+public:
+  typedef std::vector<mongo::BSONObj> Documents;
+  typedef boost::function<bool(const mongo::BSONObj&)> Predicate;
+
+  /// Open the collection journaled at journalPath, indexed by indexedFields
+  EmbeddedCollection(const std::string& journalPath, const std::vector<std::string>& indexedFields);
+
+  ~EmbeddedCollection();
+
+  /// Add or replace the document with the key
+  void put(const std::string& key, const mongo::BSONObj& document);
+
+  /// Set the fields of the document with the key, as a Mongo $set does.
+  /// Without upsert, returns false if there is no such document.
+  bool update(const std::string& key, const mongo::BSONObj& fields, bool upsert);
+
+  /// Remove the document with the key, if any
+  void erase(const std::string& key);
+
+  /// Remove the document with the key if predicate holds for it
+  bool eraseIf(const std::string& key, const Predicate& predicate);
+
+  /// Remove every document predicate holds for; returns how many
+  std::size_t eraseIf(const Predicate& predicate);
+
+  /// Remove every document
+  void clear();
+
+  /// Get the document with the key
+  bool get(const std::string& key, mongo::BSONObj& document);
+
+  /// Get the documents whose indexed field has value
+  void find(const std::string& field, const std::string& value, Documents& documents);
+
+  /// Get every document predicate holds for
+  void findIf(const Predicate& predicate, Documents& documents);
+
+  /// Get every document
+  void getAll(Documents& documents);
+
+  std::size_t size();
+
+  const std::string& getJournalPath() const { return _journal.getPath(); }
+
+  //
+  // MappedJournal::Table.  Called with _mutex held.
+  //
+  virtual void apply(MappedJournal::Operation operation, const std::string& key, const mongo::BSONObj& document);
+  virtual void snapshot(MappedJournal::Records& records) const;
+
+private:
+  typedef boost::unordered_map<std::string, mongo::BSONObj> DocumentMap;
+  typedef boost::unordered_multimap<std::string, std::string> Index;   // field value -> key
+
+  void index(const std::string& key, const mongo::BSONObj& document);
+  void unindex(const std::string& key, const mongo::BSONObj& document);
+  Index* indexOf(const std::string& field);
+
+  boost::mutex _mutex;
+  DocumentMap _documents;
+  std::vector<std::string> _indexedFields;
+  std::vector<Index> _indexes;
+  MappedJournal _journal;   // constructed last: opening it applies what it holds
+};
+
+#endif	/* EMBEDDEDCOLLECTION_H */
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef EXPIRESCHEDULE_H
+#define	EXPIRESCHEDULE_H
+
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include "sipdb/MongoDB.h"
+
+/**
+ * In-memory schedule of upcoming record expirations.
+ *
+ * The schedule is fed by the writers of a collection (RegDB::updateBinding,
+ * SubscribeDB::upsert) and by oplog events.  It keeps one entry per natural
+ * key of the record (identity + contact for bindings, dialog for subscriptions)
+ * ordered by expiration time in a min-heap, so the expire threads can remove
+ * records in small batches exactly when they expire instead of sweeping the
+ * whole collection on a fixed interval.
+ *
+ * Refreshing a record simply schedules its key again.  Superseded heap items
+ * are discarded lazily when they reach the top of the heap.
+ */
+class ExpireSchedule
+{
+public:
+  struct Entry
+  {
+    Entry() : expirationTime(0), hasId(false) {}
+
+    std::string key;          // natural key of the record, see makeKey()
+    std::string identity;     // AOR identity (bindings) or resource key (subscriptions)
+    std::string uri;          // AOR uri (bindings) or subscription uri
+    std::string instrument;   // instrument of the binding, if any
+    mongo::OID id;            // _id of the record, valid if hasId is set
+    mongo::BSONObj selector;  // query matching the record when its _id is not known
+    unsigned long expirationTime; // seconds since epoch the record may be removed
+    bool hasId;
+  };
+
+  typedef std::vector<Entry> Entries;
+
+  /// Invoked (outside of the schedule lock) when a new entry becomes the
+  /// earliest expiration.  The expire thread uses it to re-arm its timer.
+  typedef boost::function<void(unsigned long)> HeadChangedCallback;
+
+  ExpireSchedule();
+
+  ~ExpireSchedule();
+
+  /// Build the natural key of a record from its owner and a discriminator
+  static std::string makeKey(const std::string& identity, const std::string& discriminator);
+
+  /// Add or replace the entry with the same key
+  void schedule(const Entry& entry);
+
+  /// Remove the entry with the given key, if any
+  void unschedule(const std::string& key);
+
+  /// Remove all entries created with makeKey(identity, ...)
+  void unscheduleIdentity(const std::string& identity);
+
+  /// Remove all entries
+  void clear();
+
+  /// Move up to maxBatch entries expiring at or before timeNow into expired.
+  /// Returns true if more expired entries are still pending.
+  bool popExpired(unsigned long timeNow, std::size_t maxBatch, Entries& expired);
+
+  /// Get the earliest pending expiration.  Returns false if the schedule is empty
+  bool getNextExpirationTime(unsigned long& expirationTime);
+
+  /// Number of scheduled entries
+  std::size_t size() const;
+
+  void setHeadChangedCallback(const HeadChangedCallback& callback);
+
+private:
+  typedef std::map<std::string, Entry> EntryMap;
+  typedef std::pair<unsigned long, std::string> HeapItem;
+  typedef std::priority_queue<HeapItem, std::vector<HeapItem>, std::greater<HeapItem> > Heap;
+
+  // drop superseded items from the top of the heap.  Must be called with _mutex held
+  void discardStale();
+
+  // rebuild the heap once superseded items dominate it.  Must be called with _mutex held
+  void compact();
+
+  mutable boost::mutex _mutex;
+  EntryMap _entries;
+  Heap _heap;
+  HeadChangedCallback _headChanged;
+};
+
+#endif	/* EXPIRESCHEDULE_H */
@@ -40,6 +40,7 @@ public:
   GatewayDestDB(const MongoDB::ConnectionInfo& info, const std::string& ns) :
     BaseDB(info, ns)
 	{
+    openEmbedded(embeddedIndexes());
 	}
 	;
 
@@ -73,7 +74,8 @@ public:
 protected:
 
 private:
-
+  static const std::vector<std::string>& embeddedIndexes();
+  static std::string recordKey(const GatewayDestRecord& record);
 };
 
 #endif	/* GatewayDestDB_H */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef MAPPEDJOURNAL_H
+#define	MAPPEDJOURNAL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "sipdb/MongoDB.h"
+
+/**
+ * Append-only journal of the changes to a table of documents, kept in a
+ * memory-mapped file.
+ *
+ * The journal is both the persistence of an EmbeddedCollection and the way
+ * the processes of a node share it: every process maps the same file, appends
+ * its own changes under an exclusive flock() and, before reading, applies
+ * the changes the others appended since it last looked (catchUp()).  Records
+ * are only counted in the header once they are completely written, so a
+ * process that dies while appending leaves nothing half done behind, and
+ * records are checksummed so that a tail the kernel did not write back before
+ * the host went down is dropped when the journal is opened again.
+ *
+ * When the file is full the appending process writes the current contents of
+ * its table to a new file, renames it over the journal and marks the old one
+ * superseded; the other processes then reload from the new file.
+ *
+ * A journal with an empty path keeps nothing: changes are only applied to the
+ * table, which is then private to the process.
+ */
+class MappedJournal
+{
+public:
+  enum Operation
+  {
+    Put = 1,     // add or replace the document with the key
+    Erase = 2,   // remove the document with the key
+    Clear = 3    // remove every document
+  };
+
+  typedef std::vector<std::pair<std::string, mongo::BSONObj> > Records;
+
+  /// The state a journal records changes to
+  class Table
+  {
+  public:
+    virtual ~Table() {}
+
+    /// Apply a change, appended by this process or another one
+    virtual void apply(Operation operation, const std::string& key, const mongo::BSONObj& document) = 0;
+
+    /// Every document, to start a compacted journal with
+    virtual void snapshot(Records& records) const = 0;
+  };
+
+  static const std::size_t DEFAULT_CAPACITY;
+
+  /// Open (or create) the journal at path and apply what it holds to table
+  MappedJournal(const std::string& path, Table& table, std::size_t capacity = DEFAULT_CAPACITY);
+
+  ~MappedJournal();
+
+  /// Apply the changes appended by other processes since the last call
+  void catchUp();
+
+  /// Append a change and apply it, along with any change it follows
+  void append(Operation operation, const std::string& key, const mongo::BSONObj& document = mongo::BSONObj());
+
+  /// Whether changes are kept in a file, rather than only applied
+  bool isOpen() const { return _pBase != NULL; }
+
+  const std::string& getPath() const { return _path; }
+
+private:
+  struct Header;
+
+  bool open();
+  void close();
+  bool reopen();
+  bool lock();
+  void unlock();
+  void compact(std::size_t needed);
+  bool replay(bool verify);
+  Header* header() const;
+
+  std::string _path;
+  Table& _table;
+  std::size_t _capacity;
+  int _fd;
+  char* _pBase;
+  uint64_t _offset;   // length of the records already applied to the table
+};
+
+#endif	/* MAPPEDJOURNAL_H */
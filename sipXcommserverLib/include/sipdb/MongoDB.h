@@ -19,6 +19,7 @@
 #include <queue>
 #include <vector>
 #include <os/OsTime.h>
+#include <utl/UtlMetrics.h>
 #include <boost/circular_buffer.hpp>
 #include <boost/thread.hpp>
 
@@ -62,6 +63,8 @@
 
 typedef boost::error_info<struct tag_errmsg, std::string> errmsg_info;
 
+class EmbeddedCollection;
+
 namespace MongoDB
 {
    //typedef boost::scoped_ptr<mongo::ScopedDbConnection> ScopedDbConnectionPtr;
@@ -169,6 +172,31 @@ public:
     return writeQueryTimeout/1000;
   }
 
+  //
+  // Whether the collections that only this node reads and writes (bindings,
+  // subscriptions, gateway destinations) are kept in the processes of the
+  // node rather than in mongo.  Set by "storage=embedded".
+  //
+  const bool useEmbeddedStorage() const
+  {
+    return _embeddedStorage;
+  }
+
+  //
+  // Where embedded collections keep their journals ("journalDirectory=").
+  // Empty if they are not journaled, and so not shared between processes.
+  //
+  const std::string& getJournalDirectory() const
+  {
+    return _journalDirectory;
+  }
+
+  void setEmbeddedStorage(bool embedded, const std::string& journalDirectory)
+  {
+    _embeddedStorage = embedded;
+    _journalDirectory = journalDirectory;
+  }
+
 
 private:
 
@@ -179,6 +207,8 @@ private:
   unsigned int _readQueryTimeoutMs;
   unsigned int _writeQueryTimeoutMs;
   std::string _rawConnectionString;
+  bool _embeddedStorage;
+  std::string _journalDirectory;
 };
 
 class UpdateTimer;
@@ -189,10 +219,7 @@ class BaseDB
 public:
 	BaseDB(const ConnectionInfo& info, const std::string& ns);
 
-	virtual ~BaseDB()
-	{
-	}
-	;
+	virtual ~BaseDB();
 
 	// This does something for each record. Efficient because it doesn't store each record into a collection
 	// then pass back the collection for you to iterate over.
@@ -240,6 +267,8 @@ public:
   
   Int64 getLastReadSpeed() const;
   
+  const unsigned int getReadQueryTimeoutMs() const { return _info.getReadQueryTimeoutMs(); }
+
   const double getReadQueryTimeout() const { double readQueryTimeout = _info.getReadQueryTimeoutMs(); return readQueryTimeout/1000; }
 
   const double getWriteQueryTimeout() const { double writeQueryTimeout = _info.getWriteQueryTimeoutMs(); return writeQueryTimeout/1000; }
@@ -252,7 +281,19 @@ public:
   mongo::Query readQueryMaxTimeMS(const mongo::BSONObj& obj) const;
   mongo::Query writeQueryMaxTimeMS(const mongo::BSONObj& obj) const;
 
+  //
+  // Whether the collection is kept in an EmbeddedCollection rather than in mongo
+  //
+  bool isEmbedded() const { return _pEmbedded != NULL; }
+
 protected:
+  //
+  // Keep the collection in an EmbeddedCollection, indexed by indexedFields,
+  // if the connection info asks for embedded storage.  Called by the
+  // constructors of the collections that support it.
+  //
+  void openEmbedded(const std::vector<std::string>& indexedFields);
+
   std::string _ns;
 	mutable ConnectionInfo _info;
   boost::circular_buffer<Int64> _updateTimerSamples;
@@ -262,6 +303,9 @@ protected:
   Int64 _lastReadSpeed;
   Int64 _lastUpdateSpeed;
   long _lastAlarmLog;
+  UtlMetricHistogram* _pReadTime;   // sipx_mongo_read_seconds of _ns
+  UtlMetricHistogram* _pUpdateTime; // sipx_mongo_update_seconds of _ns
+  EmbeddedCollection* _pEmbedded;   // the collection, if it is not in mongo
 };
 
 class UpdateTimer
@@ -273,6 +317,8 @@ public:
 protected:
   Int64 _start;
   Int64 _end;
+  Int64 _startUsec;
+  Int64 _endUsec;
   BaseDB& _db;
   friend class BaseDB;
 };
@@ -286,6 +332,8 @@ public:
 protected:
   Int64 _start;
   Int64 _end;
+  Int64 _startUsec;
+  Int64 _endUsec;
   BaseDB& _db;
   friend class BaseDB;  
 };
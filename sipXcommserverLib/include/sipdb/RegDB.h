@@ -22,6 +22,7 @@
 #include <vector>
 #include "sipdb/RegBinding.h"
 #include "sipdb/MongoDB.h"
+#include "sipdb/ExpireSchedule.h"
 #include "net/Url.h"
 
 #ifndef GRUU_PREFIX
@@ -39,20 +40,23 @@ public:
     typedef std::vector<RegBinding> Bindings;
 
  RegDB(const MongoDB::ConnectionInfo& info) :
-    BaseDB(info, NS), _local(NULL), _expireGracePeriod(0)
+    BaseDB(info, NS), _local(NULL), _expireGracePeriod(0), _pExpireSchedule(NULL)
 	{
+	  openEmbedded(embeddedIndexes());
 	}
 	;
 
  RegDB(const MongoDB::ConnectionInfo& info, RegDB* local) :
-     BaseDB(info, NS), _local(local), _expireGracePeriod(0)
+     BaseDB(info, NS), _local(local), _expireGracePeriod(0), _pExpireSchedule(NULL)
 	{
+	  openEmbedded(embeddedIndexes());
 	}
 	;
 
  RegDB(const MongoDB::ConnectionInfo& info, RegDB* local, const std::string& ns) :
-    BaseDB(info, ns), _local(local), _expireGracePeriod(0)
+    BaseDB(info, ns), _local(local), _expireGracePeriod(0), _pExpireSchedule(NULL)
 	{
+	  openEmbedded(embeddedIndexes());
 	}
 	;
 
@@ -85,6 +89,30 @@ public:
 
     void removeAllExpired();
 
+    //
+    // Remove the bindings handed out by ExpireSchedule::popExpired.  Bindings
+    // are removed by _id in a single request and only if they are still
+    // expired, so a binding refreshed meanwhile is left untouched.
+    //
+    void removeExpired(const ExpireSchedule::Entries& entries);
+
+    //
+    // Feed every binding written through this RegDB into the schedule.
+    // The schedule is not owned by RegDB.
+    //
+    void setExpireSchedule(ExpireSchedule* pExpireSchedule);
+
+    //
+    // Load the schedule with the bindings currently stored for this shard.
+    //
+    void populateExpireSchedule();
+
+    //
+    // Schedule a binding document, as stored in the collection or
+    // found in an oplog insert entry.
+    //
+    void scheduleExpiration(const mongo::BSONObj& bson);
+
     bool isOutOfSequence(
         const std::string& identity,
         const std::string& callId,
@@ -150,9 +178,13 @@ public:
 protected:
 
 private:
+    // The fields bindings are looked up by, when they are kept embedded
+    static const std::vector<std::string>& embeddedIndexes();
+
     std::string _localAddress;
     RegDB* _local;
     unsigned long _expireGracePeriod;
+    ExpireSchedule* _pExpireSchedule;
 };
 
 //
@@ -162,6 +194,8 @@ private:
 inline void RegDB::setExpireGracePeriod(unsigned long expireGracePeriod /* (seconds) */)
 {
   _expireGracePeriod = expireGracePeriod;
+  if (_local)
+    _local->setExpireGracePeriod(expireGracePeriod);
 }
 
 inline unsigned long RegDB::getExpireGracePeriod() const
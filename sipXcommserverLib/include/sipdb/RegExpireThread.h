@@ -16,21 +16,45 @@
 #ifndef REGEXPIRETHREAD_H
 #define	REGEXPIRETHREAD_H
 
+#include <set>
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
 #include "sipdb/RegDB.h"
+#include "sipdb/ExpireSchedule.h"
+#include "os/OsDateTime.h"
 #include "os/OsLogger.h"
 
 
+//
+// Removes expired registrations from RegDB.
+//
+// Every binding written through the RegDB is tracked in an ExpireSchedule.
+// The thread sleeps until the earliest binding expires and then removes
+// the expired bindings by _id in batches of at most EXPIRE_BATCH_SIZE,
+// invoking the expire handler for each of them so the reg event content
+// can be republished right away.  A full removeAllExpired() sweep only
+// runs at start up and every reconcile interval to catch bindings that
+// were not seen by this process.
+//
 class RegExpireThread
 {
 public:
+  enum
+  {
+    EXPIRE_BATCH_SIZE = 100,
+    DEFAULT_RECONCILE_INTERVAL = 3600 // seconds
+  };
+
+  typedef boost::function<void(const ExpireSchedule::Entry&)> ExpireHandler;
+
   RegExpireThread() :
     _pDb(0),
     _pThread(0),
     _seconds(60),
-    _pTimer(0),
-    _pOldTimer(0)
+    _reconcileSeconds(DEFAULT_RECONCILE_INTERVAL),
+    _nextReconcile(0),
+    _armedTime(0),
+    _timer(_timerService)
   {
   }
 
@@ -41,58 +65,170 @@ public:
     {
       _pThread->join();
       delete _pThread;
-      delete _pTimer;
-      delete _pOldTimer;
     }
+
+    if (_pDb)
+      _pDb->setExpireSchedule(0);
   }
 
+  //
+  // Start tracking bindings of pDb.  The thread wakes up at least every
+  // 'seconds' even if nothing expires.
+  //
   void run(RegDB* pDb, int seconds = 60)
   {
     if (_pThread || _pDb || !pDb)
       return;
     _seconds = seconds;
     _pDb = pDb;
+    _schedule.setHeadChangedCallback(boost::bind(&RegExpireThread::onHeadChanged, this, _1));
+    _pDb->setExpireSchedule(&_schedule);
     _pThread = new boost::thread(boost::bind(&RegExpireThread::internal_run, this));
   }
+
+  //
+  // Handler invoked for every binding removed by the schedule.
+  // Must be set before calling run().
+  //
+  void setExpireHandler(const ExpireHandler& handler)
+  {
+    _expireHandler = handler;
+  }
+
+  void setReconcileInterval(int seconds)
+  {
+    _reconcileSeconds = seconds;
+  }
+
+  //
+  // Suitable for MongoOpLog::registerCallback(MongoOpLog::Insert, ...) on
+  // the registrar namespace so bindings written by other processes are
+  // scheduled as well.
+  //
+  void onOpLogInsert(const mongo::BSONObj& entry)
+  {
+    if (_pDb && entry.hasField("o"))
+      _pDb->scheduleExpiration(entry.getObjectField("o"));
+  }
+
+  ExpireSchedule& schedule()
+  {
+    return _schedule;
+  }
+
 private:
 
   void internal_run()
   {
     OS_LOG_NOTICE(FAC_SIP, "RegExpireThread STARTED - interval=" << _seconds << " seconds");
-    _pTimer = new boost::asio::deadline_timer(_timerService, boost::posix_time::seconds(_seconds));
-    _pTimer->async_wait(boost::bind(&RegExpireThread::onTimerTick, this, boost::asio::placeholders::error));
+
+    try
+    {
+      _pDb->removeAllExpired();
+      _pDb->populateExpireSchedule();
+    }
+    catch(...)
+    {
+      //
+      // We will drop any mongo exception so it doesn't cause a crash when mongo is down.
+      // The reconcile sweep below will catch up once mongo is back.
+      //
+    }
+    _nextReconcile = OsDateTime::getSecsSinceEpoch() + _reconcileSeconds;
+
+    arm(OsDateTime::getSecsSinceEpoch());
     _timerService.run(); // <<----  This will block
     OS_LOG_NOTICE(FAC_SIP, "RegExpireThread ENDED");
   }
 
+  //
+  // Called from the writer threads when an earlier expiration was scheduled
+  //
+  void onHeadChanged(unsigned long expirationTime)
+  {
+    _timerService.post(boost::bind(&RegExpireThread::rearm, this, expirationTime));
+  }
+
+  void rearm(unsigned long expirationTime)
+  {
+    if (expirationTime < _armedTime)
+      arm(expirationTime);
+  }
+
+  void arm(unsigned long expirationTime)
+  {
+    _armedTime = expirationTime;
+    boost::system::error_code ec;
+    _timer.expires_at(boost::posix_time::from_time_t(expirationTime), ec);
+    _timer.async_wait(boost::bind(&RegExpireThread::onTimerTick, this, boost::asio::placeholders::error));
+  }
+
   void onTimerTick(const boost::system::error_code& e)
   {
+    if (e == boost::asio::error::operation_aborted)
+      return; // re-armed for an earlier expiration
+
+    unsigned long timeNow = OsDateTime::getSecsSinceEpoch();
+    ExpireSchedule::Entries expired;
+    bool more = false;
+
     try
     {
-      if (_pDb)
+      if (timeNow >= _nextReconcile)
       {
+        _nextReconcile = timeNow + _reconcileSeconds;
         _pDb->removeAllExpired();
       }
+
+      more = _schedule.popExpired(timeNow, EXPIRE_BATCH_SIZE, expired);
+      if (!expired.empty())
+        _pDb->removeExpired(expired);
     }
     catch(...)
     {
       //
-      // We will drop any mongo exception so it doesn't cause a crash when mongo is down
+      // We will drop any mongo exception so it doesn't cause a crash when mongo is down.
+      // Dropped entries are removed by the next reconcile sweep.
       //
     }
-    
-    if (!e)
+
+    notifyExpired(expired);
+
+    unsigned long nextTime = timeNow + _seconds;
+    if (more)
+      nextTime = timeNow;
+    else
+    {
+      unsigned long expirationTime;
+      if (_schedule.getNextExpirationTime(expirationTime) && expirationTime < nextTime)
+        nextTime = expirationTime;
+    }
+
+    OS_LOG_DEBUG(FAC_SIP, "RegExpireThread::onTimerTick removed " << expired.size() << " bindings, next run in " << nextTime - timeNow << " seconds");
+    arm(nextTime);
+  }
+
+  void notifyExpired(const ExpireSchedule::Entries& expired)
+  {
+    if (!_expireHandler)
+      return;
+
+    //
+    // Notify once per AOR and instrument even if several of its contacts expired
+    //
+    std::set<std::string> notified;
+    for (ExpireSchedule::Entries::const_iterator iter = expired.begin(); iter != expired.end(); iter++)
     {
-      OS_LOG_DEBUG(FAC_SIP, "RegExpireThred::onTimerTick restarting timer in " << _seconds << " seconds" )
-      delete _pOldTimer;
-      _pOldTimer = _pTimer;
-      if (_pTimer)
+      if (!notified.insert(iter->identity + "\n" + iter->instrument).second)
+        continue;
+
+      try
+      {
+        _expireHandler(*iter);
+      }
+      catch(...)
       {
-        boost::system::error_code ec;
-        _pTimer->cancel(ec);
       }
-      _pTimer = new boost::asio::deadline_timer(_timerService, boost::posix_time::seconds(_seconds));
-      _pTimer->async_wait(boost::bind(&RegExpireThread::onTimerTick, this, boost::asio::placeholders::error));
     }
   }
 
@@ -100,9 +236,12 @@ private:
   boost::thread* _pThread;
   boost::asio::io_service _timerService;
   int _seconds;
-  boost::asio::deadline_timer* _pTimer;
-  boost::asio::deadline_timer* _pOldTimer;
-
+  int _reconcileSeconds;
+  unsigned long _nextReconcile;
+  unsigned long _armedTime;
+  boost::asio::deadline_timer _timer;
+  ExpireSchedule _schedule;
+  ExpireHandler _expireHandler;
 };
 
 
@@ -17,6 +17,7 @@
 #define	SUBSCRIBEDB_H
 
 #include "sipdb/Subscription.h"
+#include "sipdb/ExpireSchedule.h"
 #include "utl/UtlString.h"
 #include "net/Url.h"
 
@@ -52,20 +53,23 @@ public:
 	static const std::string NS;
     typedef std::vector<Subscription> Subscriptions;
     SubscribeDB(const MongoDB::ConnectionInfo& info) :
-                BaseDB(info, NS), _local(NULL)
+                BaseDB(info, NS), _local(NULL), _pExpireSchedule(NULL)
 	{
+	  openEmbedded(embeddedIndexes());
 	}
 	;
 
     SubscribeDB(const MongoDB::ConnectionInfo& info, SubscribeDB* local) :
-		BaseDB(info, NS) , _local(local)
+		BaseDB(info, NS) , _local(local), _pExpireSchedule(NULL)
 	{
+	  openEmbedded(embeddedIndexes());
 	}
 	;
 
     SubscribeDB(const MongoDB::ConnectionInfo& info, SubscribeDB* local, std::string ns) :
-		BaseDB(info, ns), _local(local)
+		BaseDB(info, ns), _local(local), _pExpireSchedule(NULL)
 	{
+	  openEmbedded(embeddedIndexes());
 	}
 	;
 
@@ -179,12 +183,58 @@ public:
 
     void removeAllExpired();
 
+    //
+    // Remove the subscriptions handed out by ExpireSchedule::popExpired in
+    // a single request, skipping the ones that were refreshed meanwhile.
+    //
+    void removeExpired(const ExpireSchedule::Entries& entries);
+
+    //
+    // Get the subscriptions that removeExpired() would remove for these
+    // entries, so they can be notified before they are gone.
+    //
+    void getExpired(const ExpireSchedule::Entries& entries, Subscriptions& subscriptions);
+
+    //
+    // Feed every subscription written through this SubscribeDB into the
+    // schedule.  While a schedule is set, reads and writes no longer sweep
+    // the whole collection for expired subscriptions.
+    //
+    void setExpireSchedule(ExpireSchedule* pExpireSchedule);
+
+    //
+    // Load the schedule with the subscriptions currently stored for this shard.
+    //
+    void populateExpireSchedule();
+
     static SubscribeDB* CreateInstance();
 
 private:
     void ensureIndex(mongo::DBClientBase* client) const;
 
+    // The fields subscriptions are looked up by, when they are kept embedded
+    static const std::vector<std::string>& embeddedIndexes();
+
+    // The natural key of a subscription, which the mongo upsert selects it by
+    static std::string dialogKey(const std::string& toUri,
+        const std::string& fromUri,
+        const std::string& callId,
+        const std::string& eventTypeKey);
+
+    // The query selecting the subscriptions of the entries that expired by timeNow;
+    // empty if no entry can select one
+    mongo::BSONObj expiredQuery(const ExpireSchedule::Entries& entries, unsigned long timeNow) const;
+
+    void scheduleExpiration(const UtlString& key,
+        const UtlString& uri,
+        const UtlString& toUri,
+        const UtlString& fromUri,
+        const UtlString& callId,
+        const UtlString& eventTypeKey,
+        unsigned long expires);
+
     SubscribeDB* _local;
+    ExpireSchedule* _pExpireSchedule;
 
 };
 
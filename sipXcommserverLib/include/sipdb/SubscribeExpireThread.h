@@ -18,18 +18,43 @@
 
 #include <boost/thread.hpp>
 #include <boost/asio.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
 #include "sipdb/SubscribeDB.h"
+#include "sipdb/ExpireSchedule.h"
+#include "os/OsDateTime.h"
 
 
+//
+// Removes expired subscriptions from SubscribeDB.
+//
+// Works like RegExpireThread: subscriptions written through the SubscribeDB
+// are tracked in an ExpireSchedule and removed in small batches when they
+// expire.  If an expire handler is set, each subscription of a batch is
+// read and passed to it before the batch is removed, so the subscriber
+// can be sent a terminating NOTIFY.  A full removeAllExpired() sweep only
+// runs at start up and every reconcile interval; subscriptions it removes
+// are not passed to the handler.
+//
 class SubscribeExpireThread
 {
 public:
+  enum
+  {
+    EXPIRE_BATCH_SIZE = 100,
+    DEFAULT_RECONCILE_INTERVAL = 3600 // seconds
+  };
+
+  typedef boost::function<void(Subscription&)> ExpireHandler;
+
   SubscribeExpireThread() :
     _pDb(0),
     _pThread(0),
     _seconds(60),
-    _pTimer(0),
-    _pOldTimer(0)
+    _reconcileSeconds(DEFAULT_RECONCILE_INTERVAL),
+    _nextReconcile(0),
+    _armedTime(0),
+    _timer(_timerService)
   {
   }
 
@@ -40,9 +65,10 @@ public:
     {
       _pThread->join();
       delete _pThread;
-      delete _pTimer;
-      delete _pOldTimer;
     }
+
+    if (_pDb)
+      _pDb->setExpireSchedule(0);
   }
 
   void run(SubscribeDB* pDb, int seconds = 60)
@@ -51,38 +77,126 @@ public:
       return;
     _seconds = seconds;
     _pDb = pDb;
+    _schedule.setHeadChangedCallback(boost::bind(&SubscribeExpireThread::onHeadChanged, this, _1));
+    _pDb->setExpireSchedule(&_schedule);
     _pThread = new boost::thread(boost::bind(&SubscribeExpireThread::internal_run, this));
   }
+
+  /// Called on the expire thread with each subscription that expired, just
+  /// before it is removed.  Must be set before run().
+  void setExpireHandler(const ExpireHandler& handler)
+  {
+    _expireHandler = handler;
+  }
+
+  void setReconcileInterval(int seconds)
+  {
+    _reconcileSeconds = seconds;
+  }
+
+  ExpireSchedule& schedule()
+  {
+    return _schedule;
+  }
+
 private:
 
   void internal_run()
   {
-    _pTimer = new boost::asio::deadline_timer(_timerService, boost::posix_time::seconds(_seconds));
-    _pTimer->async_wait(boost::bind(&SubscribeExpireThread::onTimerTick, this, boost::asio::placeholders::error));
+    try
+    {
+      _pDb->removeAllExpired();
+      _pDb->populateExpireSchedule();
+    }
+    catch (...)
+    {
+    }
+    _nextReconcile = OsDateTime::getSecsSinceEpoch() + _reconcileSeconds;
+
+    arm(OsDateTime::getSecsSinceEpoch());
     _timerService.run(); // <<----  This will block
   }
 
+  void onHeadChanged(unsigned long expirationTime)
+  {
+    _timerService.post(boost::bind(&SubscribeExpireThread::rearm, this, expirationTime));
+  }
+
+  void rearm(unsigned long expirationTime)
+  {
+    if (expirationTime < _armedTime)
+      arm(expirationTime);
+  }
+
+  void arm(unsigned long expirationTime)
+  {
+    _armedTime = expirationTime;
+    boost::system::error_code ec;
+    _timer.expires_at(boost::posix_time::from_time_t(expirationTime), ec);
+    _timer.async_wait(boost::bind(&SubscribeExpireThread::onTimerTick, this, boost::asio::placeholders::error));
+  }
+
   void onTimerTick(const boost::system::error_code& e)
   {
-    if (!e && _pDb)
+    if (e == boost::asio::error::operation_aborted)
+      return;
+
+    unsigned long timeNow = OsDateTime::getSecsSinceEpoch();
+    ExpireSchedule::Entries expired;
+    bool more = false;
+
+    try
     {
-      try
+      if (timeNow >= _nextReconcile)
       {
-      _pDb->removeAllExpired();
+        _nextReconcile = timeNow + _reconcileSeconds;
+        _pDb->removeAllExpired();
       }
-      catch (...)
+
+      more = _schedule.popExpired(timeNow, EXPIRE_BATCH_SIZE, expired);
+      if (!expired.empty())
       {
+        notifyExpired(expired);
+        _pDb->removeExpired(expired);
       }
+    }
+    catch (...)
+    {
+      //
+      // Dropped entries are removed by the next reconcile sweep, without
+      // being notified.
+      //
+    }
 
-      delete _pOldTimer;
-      _pOldTimer = _pTimer;
-      if (_pTimer)
+    unsigned long nextTime = timeNow + _seconds;
+    if (more)
+      nextTime = timeNow;
+    else
+    {
+      unsigned long expirationTime;
+      if (_schedule.getNextExpirationTime(expirationTime) && expirationTime < nextTime)
+        nextTime = expirationTime;
+    }
+
+    arm(nextTime);
+  }
+
+  void notifyExpired(const ExpireSchedule::Entries& expired)
+  {
+    if (!_expireHandler)
+      return;
+
+    SubscribeDB::Subscriptions subscriptions;
+    _pDb->getExpired(expired, subscriptions);
+    for (SubscribeDB::Subscriptions::iterator iter = subscriptions.begin(); iter != subscriptions.end(); iter++)
+    {
+      try
+      {
+        _expireHandler(*iter);
+      }
+      catch (...)
       {
-        boost::system::error_code ec;
-        _pTimer->cancel(ec);
       }
-      _pTimer = new boost::asio::deadline_timer(_timerService, boost::posix_time::seconds(_seconds));
-      _pTimer->async_wait(boost::bind(&SubscribeExpireThread::onTimerTick, this, boost::asio::placeholders::error));
     }
   }
 
@@ -90,9 +204,12 @@ private:
   boost::thread* _pThread;
   boost::asio::io_service _timerService;
   int _seconds;
-  boost::asio::deadline_timer* _pTimer;
-  boost::asio::deadline_timer* _pOldTimer;
-  
+  int _reconcileSeconds;
+  unsigned long _nextReconcile;
+  unsigned long _armedTime;
+  boost::asio::deadline_timer _timer;
+  ExpireSchedule _schedule;
+  ExpireHandler _expireHandler;
 };
 
 
@@ -0,0 +1,267 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <set>
+
+// APPLICATION INCLUDES
+#include "filereader/FileWatcher.h"
+#include <os/OsLogger.h>
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+
+// The changes of a directory that may change a file in it.  A file that
+// is created is only read once it is closed after writing.
+static const uint32_t WATCHED_EVENTS =
+   IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+
+// Enough for many events, aligned as struct inotify_event must be.
+static const size_t EVENT_BUFFER_SIZE = 64 * 1024;
+
+// STATIC VARIABLE INITIALIZATIONS
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ CREATORS ================================== */
+
+FileWatcher& FileWatcher::instance()
+{
+   // Never destroyed, so objects destroyed at exit may still unwatch().
+   static FileWatcher* spInstance = new FileWatcher();
+   return *spInstance;
+}
+
+FileWatcher::FileWatcher() :
+   mInotify(inotify_init()),
+   mNextId(0),
+   mpThread(NULL)
+{
+   if (mInotify < 0)
+   {
+      Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                    "FileWatcher::FileWatcher inotify_init failed: %s",
+                    strerror(errno));
+   }
+
+   if (pipe(mWakeup) < 0)
+   {
+      mWakeup[0] = mWakeup[1] = -1;
+   }
+
+   mpThread = new boost::thread(boost::bind(&FileWatcher::run, this));
+}
+
+FileWatcher::~FileWatcher()
+{
+   if (mWakeup[1] >= 0)
+   {
+      char stop = 0;
+      if (write(mWakeup[1], &stop, 1) < 0)
+      {
+         // The thread is then left running; it uses nothing this frees.
+         Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                       "FileWatcher::~FileWatcher cannot stop the watcher thread");
+         mpThread->detach();
+      }
+      else
+      {
+         mpThread->join();
+      }
+   }
+   delete mpThread;
+
+   if (mInotify >= 0)
+   {
+      close(mInotify);
+   }
+   if (mWakeup[0] >= 0)
+   {
+      close(mWakeup[0]);
+      close(mWakeup[1]);
+   }
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+int FileWatcher::watch(const std::string& fileName, const Callback& callback)
+{
+   Watch watch;
+   watch.mFileName = fileName;
+   watch.mCallback = callback;
+
+   std::string directory;
+   std::string::size_type slash = fileName.rfind('/');
+   if (slash == std::string::npos)
+   {
+      directory = ".";
+      watch.mName = fileName;
+   }
+   else
+   {
+      directory = slash == 0 ? "/" : fileName.substr(0, slash);
+      watch.mName = fileName.substr(slash + 1);
+   }
+
+   // Watching a directory twice gives the same watch back.
+   watch.mDirectory = mInotify < 0 ? -1
+      : inotify_add_watch(mInotify, directory.c_str(), WATCHED_EVENTS);
+   if (watch.mDirectory < 0)
+   {
+      Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                    "FileWatcher::watch cannot watch directory '%s' of '%s': %s",
+                    directory.c_str(), fileName.c_str(), strerror(errno));
+      return -1;
+   }
+
+   boost::mutex::scoped_lock lock(mMutex);
+   int id = mNextId++;
+   mWatches[id] = watch;
+   mDirectoryUsers[watch.mDirectory]++;
+
+   Os::Logger::instance().log(FAC_KERNEL, PRI_DEBUG,
+                 "FileWatcher::watch '%s' as %d", fileName.c_str(), id);
+   return id;
+}
+
+void FileWatcher::unwatch(int id)
+{
+   {
+      boost::mutex::scoped_lock lock(mMutex);
+      std::map<int, Watch>::iterator watch = mWatches.find(id);
+      if (watch == mWatches.end())
+      {
+         return;
+      }
+
+      int directory = watch->second.mDirectory;
+      mWatches.erase(watch);
+      if (--mDirectoryUsers[directory] == 0)
+      {
+         mDirectoryUsers.erase(directory);
+         inotify_rm_watch(mInotify, directory);
+      }
+   }
+
+   // Wait for the callback to return if it is running on the watcher
+   // thread; it is not called again once it is out of mWatches.
+   boost::recursive_mutex::scoped_lock calling(mCalling);
+}
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+
+void FileWatcher::run()
+{
+   // The buffer read() fills must be aligned for struct inotify_event.
+   union
+   {
+      struct inotify_event mEvent;
+      char mBytes[EVENT_BUFFER_SIZE];
+   } buffer;
+
+   struct pollfd ready[2];
+   ready[0].fd = mInotify;
+   ready[0].events = POLLIN;
+   ready[1].fd = mWakeup[0];
+   ready[1].events = POLLIN;
+
+   while (true)
+   {
+      ready[0].revents = ready[1].revents = 0;
+      if (poll(ready, 2, -1) < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                       "FileWatcher::run poll failed: %s", strerror(errno));
+         break;
+      }
+
+      if (ready[1].revents)
+      {
+         break;
+      }
+
+      if (ready[0].revents & POLLIN)
+      {
+         ssize_t length = read(mInotify, buffer.mBytes, sizeof(buffer.mBytes));
+         if (length > 0)
+         {
+            dispatch(buffer.mBytes, length);
+         }
+      }
+   }
+}
+
+void FileWatcher::dispatch(const char* buffer, ssize_t length)
+{
+   // Each file is reread once for all the events read together, such as
+   // those of a file written and then renamed into place.
+   std::set<int> changed;
+   {
+      boost::mutex::scoped_lock lock(mMutex);
+
+      for (const char* next = buffer; next < buffer + length; )
+      {
+         const struct inotify_event* event = (const struct inotify_event*) next;
+         next += sizeof(struct inotify_event) + event->len;
+
+         for (std::map<int, Watch>::const_iterator watch = mWatches.begin();
+              watch != mWatches.end();
+              watch++)
+         {
+            // When events were lost, any file may have changed.
+            if (   (event->mask & IN_Q_OVERFLOW)
+                || (   event->wd == watch->second.mDirectory
+                    && event->len > 0
+                    && watch->second.mName == event->name))
+            {
+               changed.insert(watch->first);
+            }
+         }
+      }
+   }
+
+   boost::recursive_mutex::scoped_lock calling(mCalling);
+   for (std::set<int>::const_iterator id = changed.begin(); id != changed.end(); id++)
+   {
+      Watch watch;
+      {
+         boost::mutex::scoped_lock lock(mMutex);
+         std::map<int, Watch>::const_iterator found = mWatches.find(*id);
+         if (found == mWatches.end())
+         {
+            // unwatch()ed by an earlier callback
+            continue;
+         }
+         watch = found->second;
+      }
+
+      Os::Logger::instance().log(FAC_KERNEL, PRI_INFO,
+                    "FileWatcher::dispatch '%s' changed", watch.mFileName.c_str());
+      try
+      {
+         watch.mCallback(watch.mFileName);
+      }
+      catch (std::exception& e)
+      {
+         Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                       "FileWatcher::dispatch reading '%s' failed: %s",
+                       watch.mFileName.c_str(), e.what());
+      }
+   }
+}
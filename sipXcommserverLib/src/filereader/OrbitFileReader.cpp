@@ -41,7 +41,8 @@ const static UtlString valid_keycodes = "0123456789*#";
 /* ============================ CREATORS ================================== */
 
 // Constructor
-OrbitFileReader::OrbitFileReader()
+OrbitFileReader::OrbitFileReader() :
+   mOrbits(&OrbitFileReader::parseOrbitFile)
 {
 }
 
@@ -52,38 +53,55 @@ OrbitFileReader::~OrbitFileReader()
 
 /* ============================ MANIPULATORS ============================== */
 
+// Set the file name and read the file.
+void OrbitFileReader::setFileName(const UtlString* fileName)
+{
+   mOrbits.setFileName(fileName ? fileName->data() : "");
+}
+
 /* ============================ ACCESSORS ================================= */
 
 /* ============================ INQUIRY =================================== */
 
 // Return pointer to the OrbitData structure if the argument is an
 // orbit name listed in the orbits.xml file.
-OrbitData* OrbitFileReader::findInOrbitList(const UtlString& user)
+boost::shared_ptr<const OrbitData> OrbitFileReader::findInOrbitList(const UtlString& user)
 {
-   OrbitData* ret;
-
-   // Refresh mOrbitList if necessary.
-   refresh();
+   boost::shared_ptr<const OrbitData> ret;
 
-   // Check to see if 'user' is in it.  If so, return a pointer to its
-   // data.
-   ret = dynamic_cast <OrbitData*> (mOrbitList.findValue(&user));
+   // Check to see if 'user' is in the orbits last read.  If so, return a
+   // pointer to its data, which keeps those orbits from being deleted.
+   ConfigSnapshot<Orbits>::Ptr orbits = mOrbits.get();
+   if (orbits)
+   {
+      const OrbitData* data =
+         dynamic_cast <const OrbitData*> (orbits->mOrbitList.findValue(&user));
+      if (data)
+      {
+         ret = boost::shared_ptr<const OrbitData>(orbits, data);
+      }
+   }
 
    Os::Logger::instance().log(FAC_PARK, PRI_DEBUG,
                  "OrbitFileReader::findInOrbitList "
                  "user = '%s', ret = %p",
-                 user.data(), ret);
+                 user.data(), ret.get());
    return ret;
 }
 
 // Retrieve the "music on hold" file name.
 void OrbitFileReader::getMusicOnHoldFile(UtlString& file)
 {
-   // Refresh mMusicOnHoldFile if necessary.
-   refresh();
-
-   // Get the value.
-   file = mMusicOnHoldFile;
+   // Get the value from the orbits last read.
+   ConfigSnapshot<Orbits>::Ptr orbits = mOrbits.get();
+   if (orbits)
+   {
+      file = orbits->mMusicOnHoldFile;
+   }
+   else
+   {
+      file.remove(0);
+   }
 
    Os::Logger::instance().log(FAC_PARK, PRI_DEBUG,
                  "OrbitFileReader::getMusicOnHoldFile "
@@ -92,22 +110,22 @@ void OrbitFileReader::getMusicOnHoldFile(UtlString& file)
    return;
 }
 
-/* //////////////////////////// PROTECTED ///////////////////////////////// */
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
 
 // Read and parse the orbits.xml file into the data structures.
-OsStatus OrbitFileReader::initialize()
+OrbitFileReader::Orbits* OrbitFileReader::parseOrbitFile(const std::string& fileName)
 {
-   // Clear the list of the previous orbit names.
-   mOrbitList.destroyAll();
-   // Forget the music-on-hold file.
-   mMusicOnHoldFile.remove(0);
+   // Start with no orbits and no music-on-hold file.
+   Orbits* orbits = new Orbits;
 
    // Initialize Tiny XML document object.
    TiXmlDocument document;
    TiXmlNode* orbits_element;
    if (
+      // There is no file to read without a name.
+      !fileName.empty() &&
       // Load the XML into it.
-      document.LoadFile(mFileName.data()) &&
+      document.LoadFile(fileName.c_str()) &&
       // Find the top element, which should be an <orbits>.
       (orbits_element = document.FirstChild("orbits")) != NULL &&
       orbits_element->Type() == TiXmlNode::ELEMENT)
@@ -245,7 +263,7 @@ OsStatus OrbitFileReader::initialize()
          }
 
          // If no errors were found, create the values to insert into
-         // mOrbitList.
+         // orbits->mOrbitList.
          if (orbit_valid)
          {
             // Allocate the objects and assign their values.
@@ -258,11 +276,11 @@ OsStatus OrbitFileReader::initialize()
             orbit_data_heap->mCapacity = capacity;
 
             // Attempt to insert the user into the orbit list.
-            if (mOrbitList.insertKeyAndValue(extension_heap, orbit_data_heap))
+            if (orbits->mOrbitList.insertKeyAndValue(extension_heap, orbit_data_heap))
             {
                // Insertion succeeded.
                // *extension_heap and *orbit_data_heap are now owned
-               // by mOrbitList.
+               // by orbits->mOrbitList.
             }
             else
             {
@@ -272,7 +290,7 @@ OsStatus OrbitFileReader::initialize()
                              "OrbitFileReader::parseOrbitFile "
                              "Inserting extension '%s' failed -- specified as an orbit twice?",
                              extension_heap->data());
-               // mOrbitList does not own the objects, so we must delete them.
+               // orbits->mOrbitList does not own the objects, so we must delete them.
                delete extension_heap;
                delete orbit_data_heap;
             }
@@ -285,7 +303,7 @@ OsStatus OrbitFileReader::initialize()
          Os::Logger::instance().log(FAC_PARK, PRI_DEBUG,
                        "OrbitFileReader::parseOrbitFile "
                        "Valid orbits are:");
-         UtlHashMapIterator itor(mOrbitList);
+         UtlHashMapIterator itor(orbits->mOrbitList);
          while (itor())
          {
             UtlString* key = dynamic_cast<UtlString*> (itor.key());
@@ -313,24 +331,24 @@ OsStatus OrbitFileReader::initialize()
          if ((audioNode != NULL)
              && (audioNode->FirstChild() != NULL))
          {
-            mMusicOnHoldFile = (audioNode->FirstChild())->Value();
+            orbits->mMusicOnHoldFile = (audioNode->FirstChild())->Value();
          }
       }
       Os::Logger::instance().log(FAC_PARK, PRI_DEBUG,
                     "OrbitFileReader::parseOrbitFile "
                     "mMusicOnHoldFile = '%s'",
-                    mMusicOnHoldFile.data());
+                    orbits->mMusicOnHoldFile.data());
 
       // In any of these cases, attempt to do call retrieval.
-      return OS_SUCCESS;
+      return orbits;
    }
    else
    {
       // Report error parsing file.
       Os::Logger::instance().log(FAC_PARK, PRI_CRIT,
                     "OrbitFileReader::parseOrbitFile "
-                    "Orbit file '%s' could not be parsed.", mFileName.data());
+                    "Orbit file '%s' could not be parsed.", fileName.c_str());
       // No hope of doing call retrieval.
-      return OS_FAILED;
+      return orbits;
    }
 }
@@ -10,14 +10,20 @@
 
 
 // SYSTEM INCLUDES
+#include <stdlib.h>
+#include <deque>
+#include <map>
+#include <string>
 
 // APPLICATION INCLUDES
 #include "os/OsDateTime.h"
 #include "os/OsTime.h"
 #include "os/OsLogger.h"
 #include "os/OsConfigDb.h"
+#include "os/OsMutex.h"
 #include "net/NetMd5Codec.h"
 #include "os/OsLock.h"
+#include "utl/UtlMetrics.h"
 #include "sipXecsService/SipXecsService.h"
 #include "sipXecsService/SharedSecret.h"
 #include "sipXecsService/SipNonceDb.h"
@@ -27,8 +33,106 @@
 // CONSTANTS
 #define HEX_TIMESTAMP_LENGTH 8
 
+// Number of the last nonce-counts of a nonce that are remembered, with the
+// CSeq of the request that used each, so that the same request can be
+// recognized when it is presented again.
+#define RECENT_NONCE_COUNTS 4
+
+// Most nonces held by one shard of the table; beyond that the oldest are
+// forgotten even if they have not expired.
+#define MAX_SHARD_NONCES 8192
+
+// How long nonces are kept before isNonceValid is first given an expiration
+// period; then they are kept for the longest period it has been given.
+#define DEFAULT_NONCE_RETENTION (60 * 5)
+
+// STRUCTS
+
+/// A nonce that has been created or validated, and the nonce-counts used with it.
+struct IssuedNonce
+{
+   std::string callId;          ///< the call the nonce is bound to
+   std::string fromTag;
+   std::string realm;
+   unsigned long created;       ///< timestamp of the nonce
+   unsigned long highestCount;  ///< highest nonce-count used, or 0
+   unsigned long recentCounts[RECENT_NONCE_COUNTS];  ///< last nonce-counts used
+   std::string recentCSeqs[RECENT_NONCE_COUNTS];     ///< CSeq of the request that used each
+   size_t nextRecent;           ///< slot of recentCounts to overwrite next
+};
+
+/// The nonces of one shard of a SipNonceDb.
+class SipNonceDb::Shard
+{
+public:
+   Shard();
+
+   /// Lock for everything in the shard.
+   OsMutex mMutex;
+
+   typedef std::map<std::string, IssuedNonce> Nonces;
+
+   /// The nonces, indexed by their value.
+   Nonces mNonces;
+
+   /// Seconds for which nonces are kept after they are added.
+   unsigned long mRetention;
+
+   /// Add a nonce with its binding, unless it is already present.
+   void add(const UtlString& nonce,
+            const UtlString& callId,
+            const UtlString& fromTag,
+            const UtlString& realm,
+            unsigned long created,
+            unsigned long now);
+
+private:
+
+   /// Forget the nonces added more than mRetention seconds before now, and
+   /// the oldest ones if there are more than MAX_SHARD_NONCES.
+   void expire(unsigned long now);
+
+   /// The nonces in the order they were added, with the time each was added.
+   //  Nonces are only removed from mNonces through here, so the iterators
+   //  stay valid.
+   std::deque<std::pair<unsigned long, Nonces::iterator> > mAdded;
+
+   //! DISALLOWED accidental copying
+   Shard(const Shard& rShard);
+   Shard& operator=(const Shard& rhs);
+};
+
 // STATIC VARIABLE INITIALIZATIONS
 
+static UtlMetricCounter& noncesCreated()
+{
+   static UtlMetricCounter& counter =
+      UtlMetrics::instance().counter("sipx_auth_nonces_created_total",
+                                     "Nonces created for authentication challenges");
+   return counter;
+}
+
+static UtlMetricCounter& nonceValidations(bool found)
+{
+   static UtlMetricCounter& hits =
+      UtlMetrics::instance().counter("sipx_auth_nonce_validations_total",
+                                     "Nonces validated, by whether they were found in the nonce table",
+                                     "table=\"hit\"");
+   static UtlMetricCounter& misses =
+      UtlMetrics::instance().counter("sipx_auth_nonce_validations_total",
+                                     "Nonces validated, by whether they were found in the nonce table",
+                                     "table=\"miss\"");
+   return found ? hits : misses;
+}
+
+static UtlMetricCounter& nonceReplays()
+{
+   static UtlMetricCounter& counter =
+      UtlMetrics::instance().counter("sipx_auth_nonce_replays_total",
+                                     "Credentials refused because their nonce-count had been used");
+   return counter;
+}
+
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 
 /* ============================ CREATORS ================================== */
@@ -41,11 +145,20 @@ SipNonceDb::SipNonceDb()
    domainConfiguration.loadFromFile(SipXecsService::domainConfigPath());
    // get the shared secret for generating signatures
    mpNonceSignatureSecret = new SharedSecret(domainConfiguration);
+
+   for (size_t i = 0; i < sShardCount; i++)
+   {
+      mShards[i] = new Shard();
+   }
 }
 
 // Destructor
 SipNonceDb::~SipNonceDb()
 {
+   for (size_t i = 0; i < sShardCount; i++)
+   {
+      delete mShards[i];
+   }
    delete mpNonceSignatureSecret;
 }
 
@@ -100,6 +213,84 @@ void SipNonceDb::createNewNonce(const UtlString& callId,  ///< input
    sprintf(dateString, "%08x", (int)now);
    nonce = SipNonceDb::nonceSignature(callId,fromTag,realm,dateString);
    nonce.append(dateString);
+
+   // remember it, so that it need not be signed again when it is presented
+   Shard* shard = shardOf(nonce);
+   OsLock lock(shard->mMutex);
+   shard->add(nonce, callId, fromTag, realm, now, now);
+   noncesCreated().add();
+}
+
+UtlBoolean SipNonceDb::recordNonceCount(const UtlString& nonce,
+                                        const UtlString& nonceCount,
+                                        const UtlString& cseq)
+{
+   UtlBoolean accepted = TRUE;
+
+   if (!nonceCount.isNull())
+   {
+      char* end;
+      unsigned long count = strtoul(nonceCount.data(), &end, 16 /* hex */);
+      if (*end != '\0' || 0 == count || nonce.length() != (MD5_SIZE + HEX_TIMESTAMP_LENGTH))
+      {
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                       "SipNonceDb::recordNonceCount invalid nonce-count '%s' for nonce '%s'",
+                       nonceCount.data(), nonce.data());
+         accepted = FALSE;
+      }
+      else
+      {
+         Shard* shard = shardOf(nonce);
+         OsLock lock(shard->mMutex);
+
+         Shard::Nonces::iterator found = shard->mNonces.find(nonce.str());
+         if (found == shard->mNonces.end())
+         {
+            // The nonce has been forgotten since it was validated, so there
+            // is nothing to compare with.
+            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                          "SipNonceDb::recordNonceCount nonce '%s' is no longer in the table",
+                          nonce.data());
+         }
+         else
+         {
+            IssuedNonce& issued = found->second;
+
+            if (count > issued.highestCount)
+            {
+               issued.highestCount = count;
+               issued.recentCounts[issued.nextRecent] = count;
+               issued.recentCSeqs[issued.nextRecent] = cseq.data();
+               issued.nextRecent = (issued.nextRecent + 1) % RECENT_NONCE_COUNTS;
+            }
+            else
+            {
+               // An old nonce-count is only accepted from the request that used it.
+               accepted = FALSE;
+               for (size_t i = 0; i < RECENT_NONCE_COUNTS; i++)
+               {
+                  if (   issued.recentCounts[i] == count
+                      && issued.recentCSeqs[i] == cseq.data())
+                  {
+                     accepted = TRUE;
+                     break;
+                  }
+               }
+            }
+
+            if (!accepted)
+            {
+               Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
+                             "SipNonceDb::recordNonceCount nonce-count %s already used "
+                             "with nonce '%s' (highest %08lx), CSeq '%s'",
+                             nonceCount.data(), nonce.data(), issued.highestCount, cseq.data());
+               nonceReplays().add();
+            }
+         }
+      }
+   }
+
+   return accepted;
 }
 
 /* ============================ INQUIRY =================================== */
@@ -114,19 +305,32 @@ UtlBoolean SipNonceDb::isNonceValid(const UtlString& nonce,
 
    if (nonce.length() == (MD5_SIZE + HEX_TIMESTAMP_LENGTH))
    {
-      UtlString timestamp = nonce(MD5_SIZE, HEX_TIMESTAMP_LENGTH);   // get timestamp from nonce string
-      UtlString rcvdSignature = nonce(0,MD5_SIZE);                   // get signature from nonce string
+      Shard* shard = shardOf(nonce);
+      OsLock lock(shard->mMutex);
 
-      // calculate valid signature for supplied data using known secret
-      UtlString msgSignature(nonceSignature(callId, fromTag, realm, timestamp.data()));
-      if (0 == rcvdSignature.compareTo(msgSignature))
+      unsigned long now = OsDateTime::getSecsSinceEpoch();
+      if (expiredTime > 0 && (unsigned long) expiredTime > shard->mRetention)
       {
-         // check for expiration
-         char* end;
-         unsigned long nonceCreated = strtol(timestamp.data(), &end, 16 /* hex */);
-         unsigned long now = OsDateTime::getSecsSinceEpoch();
+         shard->mRetention = expiredTime;
+      }
 
-         if ( nonceCreated+expiredTime >= now )
+      Shard::Nonces::const_iterator found = shard->mNonces.find(nonce.str());
+      nonceValidations(found != shard->mNonces.end()).add();
+      if (found != shard->mNonces.end())
+      {
+         // This nonce has been signed or checked already, so it is valid
+         // for the call it was bound to then.
+         const IssuedNonce& issued = found->second;
+         if (   issued.callId != callId.data()
+             || issued.fromTag != fromTag.data()
+             || issued.realm != realm.data())
+         {
+            Os::Logger::instance().log(FAC_SIP,PRI_ERR,
+                          "SipNonceDB::isNonceValid nonce '%s' is not for call-id '%s' from tag '%s'",
+                          nonce.data(), callId.data(), fromTag.data()
+                          );
+         }
+         else if ( issued.created+expiredTime >= now )
          {
             valid = TRUE;
          }
@@ -134,20 +338,49 @@ UtlBoolean SipNonceDb::isNonceValid(const UtlString& nonce,
          {
             Os::Logger::instance().log(FAC_SIP,PRI_INFO,
                           "SipNonceDB::isNonceValid expired nonce '%s': created %ld+%ld < %ld",
-                          nonce.data(), nonceCreated, expiredTime, now
+                          nonce.data(), issued.created, expiredTime, now
                           );
          }
       }
       else
       {
-         Os::Logger::instance().log(FAC_SIP,PRI_ERR,
-                       "SipNonceDB::isNonceValid nonce signature check failed '%s'",
-                       nonce.data()
-                       );
-         Os::Logger::instance().log(FAC_SIP,PRI_DEBUG,
-                       "SipNonceDB::isNonceValid rcvd signature '%s' calculated signature '%s'",
-                       rcvdSignature.data(), msgSignature.data()
-                       );
+         UtlString timestamp = nonce(MD5_SIZE, HEX_TIMESTAMP_LENGTH);   // get timestamp from nonce string
+         UtlString rcvdSignature = nonce(0,MD5_SIZE);                   // get signature from nonce string
+
+         // calculate valid signature for supplied data using known secret
+         UtlString msgSignature(nonceSignature(callId, fromTag, realm, timestamp.data()));
+         if (0 == rcvdSignature.compareTo(msgSignature))
+         {
+            // check for expiration
+            char* end;
+            unsigned long nonceCreated = strtol(timestamp.data(), &end, 16 /* hex */);
+
+            if ( nonceCreated+expiredTime >= now )
+            {
+               valid = TRUE;
+
+               // created by another server, or forgotten; remember it from now on
+               shard->add(nonce, callId, fromTag, realm, nonceCreated, now);
+            }
+            else
+            {
+               Os::Logger::instance().log(FAC_SIP,PRI_INFO,
+                             "SipNonceDB::isNonceValid expired nonce '%s': created %ld+%ld < %ld",
+                             nonce.data(), nonceCreated, expiredTime, now
+                             );
+            }
+         }
+         else
+         {
+            Os::Logger::instance().log(FAC_SIP,PRI_ERR,
+                          "SipNonceDB::isNonceValid nonce signature check failed '%s'",
+                          nonce.data()
+                          );
+            Os::Logger::instance().log(FAC_SIP,PRI_DEBUG,
+                          "SipNonceDB::isNonceValid rcvd signature '%s' calculated signature '%s'",
+                          rcvdSignature.data(), msgSignature.data()
+                          );
+         }
       }
    }
    else
@@ -165,6 +398,63 @@ UtlBoolean SipNonceDb::isNonceValid(const UtlString& nonce,
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 
+SipNonceDb::Shard* SipNonceDb::shardOf(const UtlString& nonce)
+{
+   // The nonce starts with a hex digit of its signature, which is as good
+   // as any hash of it.
+   char digit = nonce(0);
+   size_t shardNumber = (  digit >= 'a' ? digit - 'a' + 10
+                         : digit >= 'A' ? digit - 'A' + 10
+                         : digit - '0');
+   return mShards[shardNumber % sShardCount];
+}
+
+SipNonceDb::Shard::Shard()
+   : mMutex(OsMutex::Q_FIFO),
+     mRetention(DEFAULT_NONCE_RETENTION)
+{
+}
+
+void SipNonceDb::Shard::add(const UtlString& nonce,
+                            const UtlString& callId,
+                            const UtlString& fromTag,
+                            const UtlString& realm,
+                            unsigned long created,
+                            unsigned long now)
+{
+   expire(now);
+
+   std::pair<Nonces::iterator, bool> added =
+      mNonces.insert(Nonces::value_type(nonce.str(), IssuedNonce()));
+   if (added.second)
+   {
+      IssuedNonce& issued = added.first->second;
+      issued.callId = callId.data();
+      issued.fromTag = fromTag.data();
+      issued.realm = realm.data();
+      issued.created = created;
+      issued.highestCount = 0;
+      for (size_t i = 0; i < RECENT_NONCE_COUNTS; i++)
+      {
+         issued.recentCounts[i] = 0;
+      }
+      issued.nextRecent = 0;
+
+      mAdded.push_back(std::make_pair(now, added.first));
+   }
+}
+
+void SipNonceDb::Shard::expire(unsigned long now)
+{
+   while (   !mAdded.empty()
+          && (   mAdded.front().first + mRetention < now
+              || mAdded.size() >= MAX_SHARD_NONCES))
+   {
+      mNonces.erase(mAdded.front().second);
+      mAdded.pop_front();
+   }
+}
+
 /* ============================ TESTING =================================== */
 
 /* ============================ FUNCTIONS ================================= */
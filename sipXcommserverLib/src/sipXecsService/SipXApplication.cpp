@@ -6,6 +6,7 @@
 #include "os/OsServiceOptions.h"
 
 #include <os/OsExceptionHandler.h>
+#include "sipXecsService/SipXecsService.h"
 
 #include <sipdb/MongoDB.h>
 #include <mongo/util/log.h>
@@ -107,6 +108,21 @@ void SipXApplication::shutdownSignalTaskThread()
   }
 }
 
+void SipXApplication::restartSignalTaskAfterFork()
+{
+  if (!_signalTask)
+  {
+    return;
+  }
+
+  // The task of the parent has no thread here and would wait for it
+  // forever when destroyed, so it is dropped rather than deleted.
+  boost::scoped_ptr<SignalTask>* pAbandoned = new boost::scoped_ptr<SignalTask>();
+  _signalTask.swap(*pAbandoned);
+
+  startSignalTaskThread();
+}
+
 void SipXApplication::doBlockSignals()
 {
   signalHandlerShutdownSignal = SIGRTMIN + 1;
@@ -281,9 +297,10 @@ bool SipXApplication::parse(OsServiceOptions& osServiceOptions, int argc, char**
   if (_appData._configFileFormat == SipXApplicationData::ConfigFileFormatConfigDb)
   {
     OsPath workingDirectory;
-    if (OsFileSystem::exists(SIPX_CONFDIR))
+    OsPath configurationDirectory = SipXecsService::Path(SipXecsService::ConfigurationDirType);
+    if (OsFileSystem::exists(configurationDirectory))
     {
-      workingDirectory = SIPX_CONFDIR;
+      workingDirectory = configurationDirectory;
       OsPath path(workingDirectory);
       path.getNativePath(workingDirectory);
     }
@@ -631,7 +648,8 @@ mongo::Status SipXApplication::MongoClientLogAppender::append(const mongo::logge
 
 void SipXApplication::enableMongoDriverLogging() const
 {
-  std::string mongoClientIniFilePath = SIPX_CONFDIR "/mongo-client.ini";
+  std::string mongoClientIniFilePath =
+    SipXecsService::Path(SipXecsService::ConfigurationDirType, "mongo-client.ini").data();
   OsServiceOptions mongoClientConfig(mongoClientIniFilePath);
 
   mongoClientConfig.addOptionString(0, "enable-driver-logging", "", OsServiceOptions::ConfigOption, false);
@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#include <boost/bind.hpp>
+#include <os/OsLogger.h>
+
+#include "sipdb/AsyncReader.h"
+
+AsyncReader::AsyncReader(const std::string& name, unsigned int threads, std::size_t maxPending) :
+  _name(name),
+  _maxPending(maxPending),
+  _stopping(false)
+{
+  UtlString reader = UtlMetrics::label("reader", name.c_str());
+  UtlMetrics& metrics = UtlMetrics::instance();
+  _pPending = &metrics.gauge("sipx_mongo_async_pending",
+                             "Database reads waiting for a reader thread",
+                             reader.data());
+  _pExpired = &metrics.counter("sipx_mongo_async_expired_total",
+                               "Database reads dropped at their deadline",
+                               reader.data());
+  _pRejected = &metrics.counter("sipx_mongo_async_rejected_total",
+                                "Database reads refused because the queue was full",
+                                reader.data());
+  _pWait = &metrics.histogram("sipx_mongo_async_wait_seconds",
+                              "Time database reads wait for a reader thread",
+                              reader.data());
+
+  if (threads == 0)
+  {
+    threads = 1;
+  }
+  for (unsigned int i = 0; i < threads; i++)
+  {
+    _threads.push_back(new boost::thread(boost::bind(&AsyncReader::run, this)));
+  }
+
+  OS_LOG_INFO(FAC_SIP, "AsyncReader::AsyncReader " << _name
+      << " with " << threads << " threads"
+      << ", at most " << _maxPending << " pending reads");
+}
+
+AsyncReader::~AsyncReader()
+{
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _stopping = true;
+  }
+  _available.notify_all();
+
+  for (std::size_t i = 0; i < _threads.size(); i++)
+  {
+    _threads[i]->join();
+    delete _threads[i];
+  }
+
+  // The threads do not take reads once stopping, so whatever is left has
+  // not been started; tell the callers it will not be.
+  while (!_queue.empty())
+  {
+    Request request = _queue.front();
+    _queue.pop_front();
+    _pPending->add(-1);
+    request.done(READ_FAILED);
+  }
+}
+
+bool AsyncReader::read(const Read& read, const Done& done, unsigned int timeoutMs)
+{
+  Request request;
+  request.read = read;
+  request.done = done;
+  request.queued = UtlMetricHistogram::now();
+  request.deadline = request.queued
+      + (Int64) (timeoutMs ? timeoutMs : DEFAULT_TIMEOUT_MS) * 1000;
+
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    if (_stopping || _queue.size() >= _maxPending)
+    {
+      _pRejected->add();
+      OS_LOG_WARNING(FAC_SIP, "AsyncReader::read " << _name
+          << " refused a read with " << _queue.size() << " pending");
+      return false;
+    }
+    _queue.push_back(request);
+  }
+  _pPending->add(1);
+  _available.notify_one();
+
+  return true;
+}
+
+bool AsyncReader::read(const MongoDB::BaseDB& db, const Read& read, const Done& done)
+{
+  return this->read(read, done, db.getReadQueryTimeoutMs());
+}
+
+std::size_t AsyncReader::getPending() const
+{
+  boost::lock_guard<boost::mutex> lock(_mutex);
+  return _queue.size();
+}
+
+void AsyncReader::run()
+{
+  for (;;)
+  {
+    Request request;
+    {
+      boost::unique_lock<boost::mutex> lock(_mutex);
+      while (_queue.empty() && !_stopping)
+      {
+        _available.wait(lock);
+      }
+      if (_stopping)
+      {
+        return;
+      }
+      request = _queue.front();
+      _queue.pop_front();
+    }
+    _pPending->add(-1);
+
+    complete(request);
+  }
+}
+
+void AsyncReader::complete(Request& request)
+{
+  Int64 now = UtlMetricHistogram::now();
+  Status status = READ_DONE;
+
+  if (now >= request.deadline)
+  {
+    _pExpired->add();
+    status = READ_EXPIRED;
+  }
+  else
+  {
+    _pWait->tally(now - request.queued);
+    try
+    {
+      request.read();
+    }
+    catch (mongo::DBException& e)
+    {
+      OS_LOG_ERROR(FAC_SIP, "AsyncReader::complete " << _name << " read failed: " << e.what());
+      status = READ_FAILED;
+    }
+    catch (std::exception& e)
+    {
+      OS_LOG_ERROR(FAC_SIP, "AsyncReader::complete " << _name << " read failed: " << e.what());
+      status = READ_FAILED;
+    }
+  }
+
+  request.done(status);
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#include <boost/functional/hash.hpp>
+#include "os/OsDateTime.h"
+#include "os/OsLogger.h"
+#include "net/HttpMessage.h"
+#include "utl/UtlMetrics.h"
+#include "sipdb/MongoOpLog.h"
+#include "sipdb/DigestCredentialCache.h"
+
+// Separates the identity, user and realm in a key.  It can not appear in
+// any of them, so keys of different credentials never collide.
+static const char KEY_SEPARATOR = '\n';
+
+static UtlMetricCounter& lookups(bool hit)
+{
+  static UtlMetricCounter& hits =
+    UtlMetrics::instance().counter("sipx_auth_credential_lookups_total",
+                                   "Digest credentials looked up, by whether they were cached",
+                                   "cache=\"hit\"");
+  static UtlMetricCounter& misses =
+    UtlMetrics::instance().counter("sipx_auth_credential_lookups_total",
+                                   "Digest credentials looked up, by whether they were cached",
+                                   "cache=\"miss\"");
+  return hit ? hits : misses;
+}
+
+DigestCredentialCache::DigestCredentialCache(unsigned long lifetime) :
+  _lifetime(lifetime),
+  _pOpLog(0)
+{
+}
+
+DigestCredentialCache::~DigestCredentialCache()
+{
+  delete _pOpLog;
+}
+
+std::string DigestCredentialCache::makeKey(const UtlString& identity, const UtlString& user, const UtlString& realm)
+{
+  std::string key;
+  key.reserve(identity.length() + user.length() + realm.length() + 2);
+  if (!identity.isNull())
+  {
+    key.append(identity.data(), identity.length());
+    key += KEY_SEPARATOR;
+  }
+  key.append(user.data(), user.length());
+  key += KEY_SEPARATOR;
+  key.append(realm.data(), realm.length());
+  return key;
+}
+
+DigestCredentialCache::Shard& DigestCredentialCache::shardOf(const std::string& key)
+{
+  return _shards[boost::hash_value(key) % SHARDS];
+}
+
+void DigestCredentialCache::erase(Shard& shard, Credentials::iterator pos)
+{
+  std::pair<KeysByOid::iterator, KeysByOid::iterator> range =
+    shard.keys.equal_range(pos->second.oid);
+  for (KeysByOid::iterator iter = range.first; iter != range.second; iter++)
+  {
+    if (iter->second == pos->first)
+    {
+      shard.keys.erase(iter);
+      break;
+    }
+  }
+  shard.credentials.erase(pos);
+}
+
+bool DigestCredentialCache::getCredential(const EntityDB& entityDb,
+                                          const UtlString& user,
+                                          const UtlString& userBase,
+                                          const UtlString& realm,
+                                          Url& uri,
+                                          UtlString& ha1,
+                                          UtlString& authType)
+{
+  std::string key = makeKey(UtlString(), user, realm);
+  Credential credential;
+  unsigned long generation;
+
+  if (!find(key, credential, generation))
+  {
+    EntityRecord entity;
+    if (!entityDb.findByUserId(userBase.str(), entity))
+      return false;
+
+    if (entity.realm() != realm.str())
+      return false;
+
+    makeCredential(entity, user, realm, credential);
+    add(key, credential, generation);
+  }
+
+  uri = credential.identity.c_str();
+  ha1 = credential.ha1.c_str();
+  authType = credential.authType.c_str();
+  return true;
+}
+
+bool DigestCredentialCache::getCredential(const EntityDB& entityDb,
+                                          const Url& uri,
+                                          const UtlString& user,
+                                          const UtlString& realm,
+                                          UtlString& userid,
+                                          UtlString& ha1,
+                                          UtlString& authType)
+{
+  UtlString identity;
+  uri.getIdentity(identity);
+
+  std::string key = makeKey(identity, user, realm);
+  Credential credential;
+  unsigned long generation;
+
+  if (!find(key, credential, generation))
+  {
+    EntityRecord entity;
+    if (!entityDb.findByIdentity(identity.str(), entity))
+      return false;
+
+    if (entity.realm() != realm.str())
+      return false;
+
+    makeCredential(entity, user, realm, credential);
+    add(key, credential, generation);
+  }
+
+  userid = credential.userId.c_str();
+  ha1 = credential.ha1.c_str();
+  authType = credential.authType.c_str();
+  return true;
+}
+
+void DigestCredentialCache::makeCredential(EntityRecord& entity,
+                                           const UtlString& user,
+                                           const UtlString& realm,
+                                           Credential& credential) const
+{
+  UtlString digest;
+  HttpMessage::buildMd5UserPasswordDigest(user.data(), realm.data(), entity.password().c_str(), digest);
+
+  credential.oid = entity.oid();
+  credential.identity = entity.identity();
+  credential.userId = entity.userId();
+  credential.ha1 = digest.str();
+  credential.authType = entity.authType();
+  credential.expirationTime = OsDateTime::getSecsSinceEpoch() + _lifetime;
+}
+
+bool DigestCredentialCache::find(const std::string& key, Credential& credential, unsigned long& generation)
+{
+  Shard& shard = shardOf(key);
+  boost::mutex::scoped_lock lock(shard.mutex);
+
+  Credentials::iterator found = shard.credentials.find(key);
+  if (found != shard.credentials.end())
+  {
+    if (found->second.expirationTime >= OsDateTime::getSecsSinceEpoch())
+    {
+      credential = found->second;
+      lookups(true).add();
+      return true;
+    }
+    erase(shard, found);
+  }
+
+  generation = shard.generation;
+  lookups(false).add();
+  return false;
+}
+
+void DigestCredentialCache::add(const std::string& key, const Credential& credential, unsigned long generation)
+{
+  Shard& shard = shardOf(key);
+  boost::mutex::scoped_lock lock(shard.mutex);
+
+  //
+  // Only keep what was read if no entity changed while it was being read,
+  // or the change may have been missed.
+  //
+  if (shard.generation != generation)
+    return;
+
+  Credentials::iterator found = shard.credentials.find(key);
+  if (found != shard.credentials.end())
+    erase(shard, found);
+  shard.credentials.insert(Credentials::value_type(key, credential));
+  shard.keys.insert(KeysByOid::value_type(credential.oid, key));
+}
+
+void DigestCredentialCache::invalidate(const std::string& oid)
+{
+  for (int i = 0; i < SHARDS; i++)
+  {
+    Shard& shard = _shards[i];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    shard.generation++;
+
+    std::pair<KeysByOid::iterator, KeysByOid::iterator> range = shard.keys.equal_range(oid);
+    for (KeysByOid::iterator iter = range.first; iter != range.second; iter++)
+    {
+      OS_LOG_DEBUG(FAC_ODBC, "DigestCredentialCache::invalidate - " << oid << " " << iter->second);
+      shard.credentials.erase(iter->second);
+    }
+    shard.keys.erase(range.first, range.second);
+  }
+}
+
+void DigestCredentialCache::clear()
+{
+  for (int i = 0; i < SHARDS; i++)
+  {
+    Shard& shard = _shards[i];
+    boost::mutex::scoped_lock lock(shard.mutex);
+    shard.generation++;
+    shard.credentials.clear();
+    shard.keys.clear();
+  }
+}
+
+bool DigestCredentialCache::watch(const MongoDB::ConnectionInfo& info)
+{
+  if (_pOpLog)
+    return true;
+
+  _pOpLog = new MongoOpLog(info, BSON("ns" << EntityDB::NS), 0, OsDateTime::getSecsSinceEpoch());
+  _pOpLog->registerCallback(MongoOpLog::All, boost::bind(&DigestCredentialCache::onOpLogEntry, this, _1));
+  if (!_pOpLog->run())
+  {
+    OS_LOG_WARNING(FAC_ODBC, "DigestCredentialCache::watch - unable to read the oplog of "
+      << EntityDB::NS << ", credentials are kept for " << ENTITYDB_CACHE_EXPIRE << " seconds");
+    delete _pOpLog;
+    _pOpLog = 0;
+    _lifetime = ENTITYDB_CACHE_EXPIRE;
+    clear();
+    return false;
+  }
+
+  return true;
+}
+
+void DigestCredentialCache::onOpLogEntry(const mongo::BSONObj& entry)
+{
+  //
+  // Updates name the document in "o2", inserts and deletes in "o".
+  //
+  std::string oid;
+  if (entry.hasField("o2"))
+    oid = entry.getObjectField("o2").getStringField(EntityRecord::oid_fld());
+  else if (entry.hasField("o"))
+    oid = entry.getObjectField("o").getStringField(EntityRecord::oid_fld());
+
+  if (oid.empty())
+  {
+    //
+    // Can not tell which entity changed
+    //
+    clear();
+    return;
+  }
+
+  invalidate(oid);
+}
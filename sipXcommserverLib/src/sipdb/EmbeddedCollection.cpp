@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#include <os/OsLogger.h>
+#include "sipdb/EmbeddedCollection.h"
+
+EmbeddedCollection::EmbeddedCollection(const std::string& journalPath, const std::vector<std::string>& indexedFields) :
+  _indexedFields(indexedFields),
+  _indexes(indexedFields.size()),
+  _journal(journalPath, *this)
+{
+  OS_LOG_INFO(FAC_DB, "EmbeddedCollection::EmbeddedCollection "
+      << (journalPath.empty() ? std::string("not journaled") : journalPath)
+      << " holds " << _documents.size() << " documents");
+}
+
+EmbeddedCollection::~EmbeddedCollection()
+{
+}
+
+void EmbeddedCollection::put(const std::string& key, const mongo::BSONObj& document)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.append(MappedJournal::Put, key, document);
+}
+
+bool EmbeddedCollection::update(const std::string& key, const mongo::BSONObj& fields, bool upsert)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  DocumentMap::const_iterator found = _documents.find(key);
+  if (found == _documents.end() && !upsert)
+    return false;
+
+  mongo::BSONObjBuilder builder;
+  if (found != _documents.end())
+  {
+    mongo::BSONObjIterator iter(found->second);
+    while (iter.more())
+    {
+      mongo::BSONElement element = iter.next();
+      if (!fields.hasField(element.fieldName()))
+        builder.append(element);
+    }
+  }
+  builder.appendElements(fields);
+
+  _journal.append(MappedJournal::Put, key, builder.obj());
+  return true;
+}
+
+void EmbeddedCollection::erase(const std::string& key)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  if (_documents.find(key) != _documents.end())
+    _journal.append(MappedJournal::Erase, key);
+}
+
+bool EmbeddedCollection::eraseIf(const std::string& key, const Predicate& predicate)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  DocumentMap::const_iterator found = _documents.find(key);
+  if (found == _documents.end() || !predicate(found->second))
+    return false;
+
+  _journal.append(MappedJournal::Erase, key);
+  return true;
+}
+
+std::size_t EmbeddedCollection::eraseIf(const Predicate& predicate)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  std::vector<std::string> keys;
+  for (DocumentMap::const_iterator iter = _documents.begin(); iter != _documents.end(); iter++)
+  {
+    if (predicate(iter->second))
+      keys.push_back(iter->first);
+  }
+
+  for (std::vector<std::string>::const_iterator iter = keys.begin(); iter != keys.end(); iter++)
+    _journal.append(MappedJournal::Erase, *iter);
+
+  return keys.size();
+}
+
+void EmbeddedCollection::clear()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.append(MappedJournal::Clear, std::string());
+}
+
+bool EmbeddedCollection::get(const std::string& key, mongo::BSONObj& document)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  DocumentMap::const_iterator found = _documents.find(key);
+  if (found == _documents.end())
+    return false;
+
+  document = found->second;
+  return true;
+}
+
+void EmbeddedCollection::find(const std::string& field, const std::string& value, Documents& documents)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  Index* pIndex = indexOf(field);
+  if (!pIndex)
+  {
+    for (DocumentMap::const_iterator iter = _documents.begin(); iter != _documents.end(); iter++)
+    {
+      if (value == iter->second.getStringField(field.c_str()))
+        documents.push_back(iter->second);
+    }
+    return;
+  }
+
+  std::pair<Index::const_iterator, Index::const_iterator> range = pIndex->equal_range(value);
+  for (Index::const_iterator iter = range.first; iter != range.second; iter++)
+  {
+    DocumentMap::const_iterator found = _documents.find(iter->second);
+    if (found != _documents.end())
+      documents.push_back(found->second);
+  }
+}
+
+void EmbeddedCollection::findIf(const Predicate& predicate, Documents& documents)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  for (DocumentMap::const_iterator iter = _documents.begin(); iter != _documents.end(); iter++)
+  {
+    if (predicate(iter->second))
+      documents.push_back(iter->second);
+  }
+}
+
+void EmbeddedCollection::getAll(Documents& documents)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+
+  documents.reserve(documents.size() + _documents.size());
+  for (DocumentMap::const_iterator iter = _documents.begin(); iter != _documents.end(); iter++)
+    documents.push_back(iter->second);
+}
+
+std::size_t EmbeddedCollection::size()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _journal.catchUp();
+  return _documents.size();
+}
+
+void EmbeddedCollection::apply(MappedJournal::Operation operation, const std::string& key, const mongo::BSONObj& document)
+{
+  switch (operation)
+  {
+  case MappedJournal::Put:
+  {
+    DocumentMap::iterator found = _documents.find(key);
+    if (found != _documents.end())
+    {
+      unindex(key, found->second);
+      found->second = document.getOwned();
+    }
+    else
+    {
+      _documents[key] = document.getOwned();
+    }
+    index(key, document);
+    break;
+  }
+  case MappedJournal::Erase:
+  {
+    DocumentMap::iterator found = _documents.find(key);
+    if (found != _documents.end())
+    {
+      unindex(key, found->second);
+      _documents.erase(found);
+    }
+    break;
+  }
+  case MappedJournal::Clear:
+    _documents.clear();
+    for (std::vector<Index>::iterator iter = _indexes.begin(); iter != _indexes.end(); iter++)
+      iter->clear();
+    break;
+  default:
+    OS_LOG_ERROR(FAC_DB, "EmbeddedCollection::apply unknown operation " << operation
+        << " in " << _journal.getPath());
+    break;
+  }
+}
+
+void EmbeddedCollection::snapshot(MappedJournal::Records& records) const
+{
+  records.reserve(_documents.size());
+  for (DocumentMap::const_iterator iter = _documents.begin(); iter != _documents.end(); iter++)
+    records.push_back(std::make_pair(iter->first, iter->second));
+}
+
+void EmbeddedCollection::index(const std::string& key, const mongo::BSONObj& document)
+{
+  for (std::size_t i = 0; i < _indexedFields.size(); i++)
+  {
+    if (document.hasField(_indexedFields[i].c_str()))
+      _indexes[i].insert(std::make_pair(std::string(document.getStringField(_indexedFields[i].c_str())), key));
+  }
+}
+
+void EmbeddedCollection::unindex(const std::string& key, const mongo::BSONObj& document)
+{
+  for (std::size_t i = 0; i < _indexedFields.size(); i++)
+  {
+    if (!document.hasField(_indexedFields[i].c_str()))
+      continue;
+
+    std::pair<Index::iterator, Index::iterator> range =
+        _indexes[i].equal_range(document.getStringField(_indexedFields[i].c_str()));
+    for (Index::iterator iter = range.first; iter != range.second; iter++)
+    {
+      if (iter->second == key)
+      {
+        _indexes[i].erase(iter);
+        break;
+      }
+    }
+  }
+}
+
+EmbeddedCollection::Index* EmbeddedCollection::indexOf(const std::string& field)
+{
+  for (std::size_t i = 0; i < _indexedFields.size(); i++)
+  {
+    if (_indexedFields[i] == field)
+      return &_indexes[i];
+  }
+  return NULL;
+}
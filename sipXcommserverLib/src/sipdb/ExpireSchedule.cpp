@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#include "sipdb/ExpireSchedule.h"
+
+// Separates the identity from the discriminator in a key.  It can not
+// appear in a SIP identity so a key prefix match is always exact.
+static const char KEY_SEPARATOR = '\n';
+
+// The heap is only rebuilt once it holds this many superseded items
+static const std::size_t MIN_COMPACT_SIZE = 1024;
+
+ExpireSchedule::ExpireSchedule()
+{
+}
+
+ExpireSchedule::~ExpireSchedule()
+{
+}
+
+std::string ExpireSchedule::makeKey(const std::string& identity, const std::string& discriminator)
+{
+  std::string key;
+  key.reserve(identity.size() + discriminator.size() + 1);
+  key = identity;
+  key += KEY_SEPARATOR;
+  key += discriminator;
+  return key;
+}
+
+void ExpireSchedule::schedule(const Entry& entry)
+{
+  //
+  // The callback is copied under the lock, as setHeadChangedCallback() may
+  // replace it, and called on the copy once the lock is released.
+  //
+  HeadChangedCallback headChanged;
+  {
+    boost::mutex::scoped_lock lock(_mutex);
+
+    discardStale();
+    if (_heap.empty() || entry.expirationTime < _heap.top().first)
+      headChanged = _headChanged;
+
+    _entries[entry.key] = entry;
+    _heap.push(HeapItem(entry.expirationTime, entry.key));
+    compact();
+  }
+
+  if (headChanged)
+    headChanged(entry.expirationTime);
+}
+
+void ExpireSchedule::unschedule(const std::string& key)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _entries.erase(key);
+}
+
+void ExpireSchedule::unscheduleIdentity(const std::string& identity)
+{
+  std::string prefix = identity;
+  prefix += KEY_SEPARATOR;
+
+  boost::mutex::scoped_lock lock(_mutex);
+  EntryMap::iterator iter = _entries.lower_bound(prefix);
+  while (iter != _entries.end() && iter->first.compare(0, prefix.size(), prefix) == 0)
+    _entries.erase(iter++);
+}
+
+void ExpireSchedule::clear()
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _entries.clear();
+  _heap = Heap();
+}
+
+bool ExpireSchedule::popExpired(unsigned long timeNow, std::size_t maxBatch, Entries& expired)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+
+  for (discardStale(); !_heap.empty() && _heap.top().first <= timeNow; discardStale())
+  {
+    if (expired.size() >= maxBatch)
+      return true;
+
+    EntryMap::iterator iter = _entries.find(_heap.top().second);
+    expired.push_back(iter->second);
+    _entries.erase(iter);
+    _heap.pop();
+  }
+
+  return false;
+}
+
+bool ExpireSchedule::getNextExpirationTime(unsigned long& expirationTime)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+
+  discardStale();
+  if (_heap.empty())
+    return false;
+
+  expirationTime = _heap.top().first;
+  return true;
+}
+
+std::size_t ExpireSchedule::size() const
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  return _entries.size();
+}
+
+void ExpireSchedule::setHeadChangedCallback(const HeadChangedCallback& callback)
+{
+  boost::mutex::scoped_lock lock(_mutex);
+  _headChanged = callback;
+}
+
+void ExpireSchedule::discardStale()
+{
+  while (!_heap.empty())
+  {
+    const HeapItem& top = _heap.top();
+    EntryMap::const_iterator iter = _entries.find(top.second);
+    if (iter != _entries.end() && iter->second.expirationTime == top.first)
+      break;
+    _heap.pop();
+  }
+}
+
+void ExpireSchedule::compact()
+{
+  if (_heap.size() < MIN_COMPACT_SIZE || _heap.size() < 2 * _entries.size())
+    return;
+
+  std::vector<HeapItem> items;
+  items.reserve(_entries.size());
+  for (EntryMap::const_iterator iter = _entries.begin(); iter != _entries.end(); ++iter)
+    items.push_back(HeapItem(iter->second.expirationTime, iter->first));
+
+  _heap = Heap(std::greater<HeapItem>(), items);
+}
@@ -14,16 +14,41 @@
  */
 
 #include <fstream>
+#include <boost/bind.hpp>
 #include <mongo/client/connpool.h>
 #include <os/OsDateTime.h>
 #include <os/OsLogger.h>
 #include "sipdb/GatewayDestDB.h"
 #include "sipdb/RegExpireThread.h"
+#include "sipdb/EmbeddedCollection.h"
 
 using namespace std;
 
 const string GatewayDestDB::NS("node.gatewaydest");
 
+static bool expiresBy(const mongo::BSONObj& bson, int time)
+{
+  return bson.getIntField(GatewayDestRecord::expirationTimeField()) <= time;
+}
+
+const std::vector<std::string>& GatewayDestDB::embeddedIndexes()
+{
+  static std::vector<std::string> indexes;
+  if (indexes.empty())
+    indexes.push_back(GatewayDestRecord::callIdField());
+  return indexes;
+}
+
+std::string GatewayDestDB::recordKey(const GatewayDestRecord& record)
+{
+  std::string key(record.getCallId());
+  key += '\n';
+  key += record.getToTag();
+  key += '\n';
+  key += record.getFromTag();
+  return key;
+}
+
 void GatewayDestDB::updateRecord(const GatewayDestRecord& record, bool upsert)
 {
   if (!upsert)
@@ -49,13 +74,22 @@ void GatewayDestDB::updateRecord(const GatewayDestRecord& record, bool upsert)
 			GatewayDestRecord::toTagField() << record.getToTag() <<
 			GatewayDestRecord::fromTagField() << record.getFromTag());
 
-	mongo::BSONObj update = BSON("$set" << BSON(
+	mongo::BSONObj fields = BSON(
           GatewayDestRecord::callIdField() << record.getCallId() <<
           GatewayDestRecord::toTagField() << record.getToTag() <<
           GatewayDestRecord::fromTagField() << record.getFromTag() <<
           GatewayDestRecord::identityField() << record.getIdentity() <<
           GatewayDestRecord::lineIdField() << record.getLineId() <<
-          GatewayDestRecord::expirationTimeField() << record.getExpirationTime()));
+          GatewayDestRecord::expirationTimeField() << record.getExpirationTime());
+
+  if (_pEmbedded)
+  {
+    _pEmbedded->update(recordKey(record), fields, upsert);
+    removeAllExpired();
+    return;
+  }
+
+	mongo::BSONObj update = BSON("$set" << fields);
 
   MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
   mongo::DBClientBase* client = conn->get();
@@ -76,6 +110,12 @@ void GatewayDestDB::removeRecord(const GatewayDestRecord& record)
       " toTag " << record.getToTag() <<
       " fromTag " << record.getFromTag());
 
+  if (_pEmbedded)
+  {
+    _pEmbedded->erase(recordKey(record));
+    return;
+  }
+
   mongo::BSONObj query = BSON(
       GatewayDestRecord::callIdField() << record.getCallId() <<
       GatewayDestRecord::toTagField() << record.getToTag() <<
@@ -95,6 +135,12 @@ void GatewayDestDB::removeAllRecords()
 {
   OS_LOG_DEBUG(FAC_ODBC, "GatewayDestDB::removeAllRecords ");
 
+  if (_pEmbedded)
+  {
+    _pEmbedded->clear();
+    return;
+  }
+
   mongo::BSONObj all;
   MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
   conn->get()->remove(_ns, all);
@@ -109,6 +155,12 @@ void GatewayDestDB::removeAllExpired()
   OS_LOG_DEBUG(FAC_ODBC, "GatewayDestDB::removeAllExpired - "
       " timeNow " << timeNow);
 
+  if (_pEmbedded)
+  {
+    _pEmbedded->eraseIf(boost::bind(&expiresBy, _1, timeNow));
+    return;
+  }
+
 	MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
 	mongo::DBClientBase* client = conn->get();
 
@@ -135,12 +187,23 @@ bool GatewayDestDB::getUnexpiredRecord(GatewayDestRecord& record) const
       GatewayDestRecord::fromTagField() << record.getFromTag() <<
       GatewayDestRecord::expirationTimeField() << BSON_GREATER_THAN(timeNow));
 
-  MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
+  MongoDB::ScopedDbConnectionPtr conn;
+  mongo::BSONObj recordObj;
+  if (_pEmbedded)
+  {
+    if (_pEmbedded->get(recordKey(record), recordObj) && expiresBy(recordObj, timeNow))
+      recordObj = mongo::BSONObj();
+  }
+  else
+  {
+    conn.reset(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
 
-  mongo::BSONObjBuilder builder;
-  BaseDB::nearest(builder, query);
+    mongo::BSONObjBuilder builder;
+    BaseDB::nearest(builder, query);
+
+    recordObj = conn->get()->findOne(_ns, readQueryMaxTimeMS(builder.obj()), 0, mongo::QueryOption_SlaveOk);
+  }
 
-  mongo::BSONObj recordObj = conn->get()->findOne(_ns, readQueryMaxTimeMS(builder.obj()), 0, mongo::QueryOption_SlaveOk);
   if (!recordObj.isEmpty())
   {
     OS_LOG_DEBUG(FAC_ODBC, "GatewayDestDB::getUnexpiredRecord - found record "
@@ -152,7 +215,8 @@ bool GatewayDestDB::getUnexpiredRecord(GatewayDestRecord& record) const
         " expirationTime " << record.getExpirationTime());
 
     record = recordObj;
-    conn->done();
+    if (conn)
+      conn->done();
     return true;
   }
 
@@ -162,6 +226,7 @@ bool GatewayDestDB::getUnexpiredRecord(GatewayDestRecord& record) const
       " fromTag " << record.getFromTag() <<
       " expirationTime " << timeNow);
 
-  conn->done();
+  if (conn)
+    conn->done();
   return false;
 }
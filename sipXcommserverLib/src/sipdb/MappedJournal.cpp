@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <os/OsLogger.h>
+#include "sipdb/MappedJournal.h"
+
+const std::size_t MappedJournal::DEFAULT_CAPACITY = 64 * 1024 * 1024;
+
+static const char JOURNAL_MAGIC[8] = { 'S', 'I', 'P', 'X', 'J', 'R', 'N', '1' };
+
+// Records start this far into the file
+static const std::size_t HEADER_SIZE = 64;
+
+// Records are padded to keep their headers aligned
+static const std::size_t RECORD_ALIGNMENT = 8;
+
+struct MappedJournal::Header
+{
+  char magic[8];
+  uint64_t generation;            // incremented by every compaction
+  uint64_t capacity;              // size of the file
+  volatile uint64_t length;       // bytes of complete records after the header
+  volatile uint32_t superseded;   // set once a compacted journal replaced this one
+  uint32_t reserved;
+};
+
+struct RecordHeader
+{
+  uint32_t size;           // of the whole record, padding included
+  uint32_t checksum;       // of everything after this field
+  uint32_t operation;
+  uint32_t keySize;
+  uint32_t documentSize;
+  uint32_t reserved;
+};
+
+static std::size_t recordSize(const std::string& key, const mongo::BSONObj& document)
+{
+  std::size_t size = sizeof(RecordHeader) + key.size() + (document.isEmpty() ? 0 : document.objsize());
+  return (size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+}
+
+// FNV-1a, enough to tell a torn record from a complete one
+static uint32_t checksum(const char* data, std::size_t size)
+{
+  uint32_t hash = 2166136261u;
+  for (std::size_t i = 0; i < size; i++)
+  {
+    hash ^= (unsigned char) data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void writeRecord(char* pRecord, MappedJournal::Operation operation,
+    const std::string& key, const mongo::BSONObj& document)
+{
+  RecordHeader record;
+  record.size = recordSize(key, document);
+  record.operation = operation;
+  record.keySize = key.size();
+  record.documentSize = document.isEmpty() ? 0 : document.objsize();
+  record.reserved = 0;
+
+  char* pPayload = pRecord + sizeof(RecordHeader);
+  memcpy(pPayload, key.data(), record.keySize);
+  if (record.documentSize)
+    memcpy(pPayload + record.keySize, document.objdata(), record.documentSize);
+
+  const char* pChecked = reinterpret_cast<const char*>(&record.operation);
+  std::size_t checkedHeader = sizeof(RecordHeader) - offsetof(RecordHeader, operation);
+  uint32_t hash = checksum(pChecked, checkedHeader);
+  for (std::size_t i = 0; i < record.keySize + record.documentSize; i++)
+  {
+    hash ^= (unsigned char) pPayload[i];
+    hash *= 16777619u;
+  }
+  record.checksum = hash;
+
+  memcpy(pRecord, &record, sizeof(RecordHeader));
+}
+
+MappedJournal::MappedJournal(const std::string& path, Table& table, std::size_t capacity) :
+  _path(path),
+  _table(table),
+  _capacity(capacity < HEADER_SIZE * 2 ? HEADER_SIZE * 2 : capacity),
+  _fd(-1),
+  _pBase(NULL),
+  _offset(0)
+{
+  if (!_path.empty())
+    open();
+}
+
+MappedJournal::~MappedJournal()
+{
+  close();
+}
+
+MappedJournal::Header* MappedJournal::header() const
+{
+  return reinterpret_cast<Header*>(_pBase);
+}
+
+bool MappedJournal::open()
+{
+  _fd = ::open(_path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (_fd < 0)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::open can not open " << _path << ", errno = " << errno);
+    return false;
+  }
+
+  // Recovery below may shorten the journal, which nobody may append to meanwhile
+  flock(_fd, LOCK_EX);
+
+  struct stat status;
+  bool isNew = fstat(_fd, &status) < 0 || (std::size_t) status.st_size < HEADER_SIZE;
+  std::size_t size = isNew ? _capacity : (std::size_t) status.st_size;
+  if (isNew && ftruncate(_fd, size) < 0)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::open can not size " << _path << ", errno = " << errno);
+    close();
+    return false;
+  }
+
+  void* pBase = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (pBase == MAP_FAILED)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::open can not map " << _path << ", errno = " << errno);
+    close();
+    return false;
+  }
+  _pBase = static_cast<char*>(pBase);
+  _capacity = size;
+  _offset = 0;
+
+  Header* pHeader = header();
+  if (isNew || memcmp(pHeader->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || pHeader->capacity != size)
+  {
+    if (!isNew)
+      OS_LOG_WARNING(FAC_DB, "MappedJournal::open " << _path << " is not a journal, starting it empty");
+
+    memset(pHeader, 0, HEADER_SIZE);
+    memcpy(pHeader->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    pHeader->generation = 1;
+    pHeader->capacity = size;
+  }
+  if (HEADER_SIZE + pHeader->length > size)
+    pHeader->length = size - HEADER_SIZE;
+
+  replay(true);
+  OS_LOG_INFO(FAC_DB, "MappedJournal::open " << _path << " generation " << pHeader->generation
+      << " holds " << pHeader->length << " of " << _capacity << " bytes");
+
+  flock(_fd, LOCK_UN);
+  return true;
+}
+
+void MappedJournal::close()
+{
+  if (_pBase)
+  {
+    munmap(_pBase, _capacity);
+    _pBase = NULL;
+  }
+  if (_fd >= 0)
+  {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+bool MappedJournal::reopen()
+{
+  close();
+  _table.apply(Clear, std::string(), mongo::BSONObj());
+  return open();
+}
+
+bool MappedJournal::lock()
+{
+  for (;;)
+  {
+    flock(_fd, LOCK_EX);
+    if (!header()->superseded)
+      return true;
+
+    // Compacted while we waited for the lock
+    flock(_fd, LOCK_UN);
+    if (!reopen())
+      return false;
+  }
+}
+
+void MappedJournal::unlock()
+{
+  flock(_fd, LOCK_UN);
+}
+
+bool MappedJournal::replay(bool verify)
+{
+  Header* pHeader = header();
+  uint64_t length = pHeader->length;
+  // Read the records only after the length that covers them
+  __sync_synchronize();
+
+  while (_offset < length)
+  {
+    const char* pRecord = _pBase + HEADER_SIZE + _offset;
+    RecordHeader record;
+    memcpy(&record, pRecord, sizeof(RecordHeader));
+
+    bool isValid = record.size >= sizeof(RecordHeader)
+        && _offset + record.size <= length
+        && sizeof(RecordHeader) + (uint64_t) record.keySize + record.documentSize <= record.size;
+    if (isValid && verify)
+    {
+      std::size_t checkedSize = sizeof(RecordHeader) - offsetof(RecordHeader, operation)
+          + record.keySize + record.documentSize;
+      isValid = checksum(pRecord + offsetof(RecordHeader, operation), checkedSize) == record.checksum;
+    }
+
+    if (!isValid)
+    {
+      OS_LOG_WARNING(FAC_DB, "MappedJournal::replay " << _path << " is damaged at " << _offset
+          << ", dropping the " << length - _offset << " bytes from there");
+      if (verify)
+        pHeader->length = _offset;
+      return false;
+    }
+
+    const char* pPayload = pRecord + sizeof(RecordHeader);
+    std::string key(pPayload, record.keySize);
+    mongo::BSONObj document;
+    if (record.documentSize)
+      document = mongo::BSONObj(pPayload + record.keySize).getOwned();
+
+    _table.apply(static_cast<Operation>(record.operation), key, document);
+    _offset += record.size;
+  }
+
+  return true;
+}
+
+void MappedJournal::catchUp()
+{
+  if (!_pBase)
+    return;
+
+  if (header()->superseded && !reopen())
+    return;
+
+  replay(false);
+}
+
+void MappedJournal::append(Operation operation, const std::string& key, const mongo::BSONObj& document)
+{
+  if (!_pBase || !lock())
+  {
+    _table.apply(operation, key, document);
+    return;
+  }
+
+  replay(false);
+
+  std::size_t size = recordSize(key, document);
+  if (HEADER_SIZE + header()->length + size > _capacity)
+    compact(size);
+
+  Header* pHeader = header();
+  if (HEADER_SIZE + pHeader->length + size > _capacity)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::append " << _path << " is full, the change is not kept");
+    unlock();
+    _table.apply(operation, key, document);
+    return;
+  }
+
+  writeRecord(_pBase + HEADER_SIZE + pHeader->length, operation, key, document);
+  // Publish the length only once the record it covers is written
+  __sync_synchronize();
+  pHeader->length += size;
+
+  replay(false);
+  unlock();
+}
+
+void MappedJournal::compact(std::size_t needed)
+{
+  Records records;
+  _table.snapshot(records);
+
+  uint64_t length = 0;
+  for (Records::const_iterator iter = records.begin(); iter != records.end(); iter++)
+    length += recordSize(iter->first, iter->second);
+
+  // Leave as much room again for the changes to come
+  std::size_t capacity = _capacity;
+  while (HEADER_SIZE + (length + needed) * 2 > capacity)
+    capacity *= 2;
+
+  std::string compactPath = _path + ".compact";
+  int fd = ::open(compactPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::compact can not open " << compactPath << ", errno = " << errno);
+    return;
+  }
+  flock(fd, LOCK_EX);
+
+  void* pBase = MAP_FAILED;
+  if (ftruncate(fd, capacity) == 0)
+    pBase = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (pBase == MAP_FAILED)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::compact can not map " << compactPath << ", errno = " << errno);
+    ::close(fd);
+    unlink(compactPath.c_str());
+    return;
+  }
+
+  char* pCompact = static_cast<char*>(pBase);
+  Header* pHeader = reinterpret_cast<Header*>(pCompact);
+  memset(pHeader, 0, HEADER_SIZE);
+  memcpy(pHeader->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  pHeader->generation = header()->generation + 1;
+  pHeader->capacity = capacity;
+
+  uint64_t offset = 0;
+  for (Records::const_iterator iter = records.begin(); iter != records.end(); iter++)
+  {
+    writeRecord(pCompact + HEADER_SIZE + offset, Put, iter->first, iter->second);
+    offset += recordSize(iter->first, iter->second);
+  }
+  pHeader->length = offset;
+
+  // The compacted journal must be whole on disk before it replaces the old one
+  if (msync(pCompact, HEADER_SIZE + offset, MS_SYNC) < 0 || rename(compactPath.c_str(), _path.c_str()) < 0)
+  {
+    OS_LOG_ERROR(FAC_DB, "MappedJournal::compact can not replace " << _path << ", errno = " << errno);
+    munmap(pCompact, capacity);
+    ::close(fd);
+    unlink(compactPath.c_str());
+    return;
+  }
+
+  OS_LOG_INFO(FAC_DB, "MappedJournal::compact " << _path << " from " << header()->length
+      << " to " << offset << " bytes, generation " << pHeader->generation);
+
+  // Closing the old journal releases its lock to the processes that will
+  // now find it superseded; this one holds the lock of the new journal.
+  header()->superseded = 1;
+  close();
+  _fd = fd;
+  _pBase = pCompact;
+  _capacity = capacity;
+  _offset = offset;
+}
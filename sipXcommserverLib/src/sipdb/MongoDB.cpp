@@ -1,6 +1,7 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <stdlib.h>
 #include <boost/config.hpp>
 #include <boost/program_options/detail/config_file.hpp>
 #include <boost/program_options/parsers.hpp>
@@ -10,6 +11,7 @@
 
 #include "sipdb/MongoDB.h"
 #include "sipdb/MongoMod.h"
+#include "sipdb/EmbeddedCollection.h"
 
 const int READ_TIMER_SAMPLES = 5; // Number of samples for getting the read delay
 const int UPDATE_TIMER_SAMPLES = 5; // Number of samples for getting the update delay
@@ -23,7 +25,14 @@ namespace pod = boost::program_options::detail;
 
 namespace MongoDB
 {
-  
+  // The configuration directory, which the environment may override as
+  // it may for SipXecsService::Path.
+  static std::string configFile(const char* name)
+  {
+    const char* directory = getenv("SIPX_CONFDIR");
+    return std::string(directory ? directory : SIPX_CONFDIR) + "/" + name;
+  }
+
 
   BaseDB::BaseDB(const ConnectionInfo& info, const std::string& ns) :
     _ns(ns),
@@ -32,8 +41,33 @@ namespace MongoDB
     _readTimerSamples(READ_TIMER_SAMPLES),
     _lastReadSpeed(0),
     _lastUpdateSpeed(0),
-    _lastAlarmLog(0)
+    _lastAlarmLog(0),
+    _pEmbedded(NULL)
   {  
+    UtlString collection = UtlMetrics::label("collection", ns.c_str());
+    _pReadTime = &UtlMetrics::instance().histogram("sipx_mongo_read_seconds",
+                                                   "Time taken by MongoDB reads",
+                                                   collection.data());
+    _pUpdateTime = &UtlMetrics::instance().histogram("sipx_mongo_update_seconds",
+                                                     "Time taken by MongoDB updates",
+                                                     collection.data());
+  }
+
+  BaseDB::~BaseDB()
+  {
+    delete _pEmbedded;
+  }
+
+  void BaseDB::openEmbedded(const std::vector<std::string>& indexedFields)
+  {
+    if (!_info.useEmbeddedStorage() || _pEmbedded)
+      return;
+
+    std::string journalPath;
+    if (!_info.getJournalDirectory().empty())
+      journalPath = _info.getJournalDirectory() + "/" + _ns + ".journal";
+
+    _pEmbedded = new EmbeddedCollection(journalPath, indexedFields);
   }
 
   bool ConnectionInfo::testConnection(const mongo::ConnectionString &connectionString, string& errmsg)
@@ -57,8 +91,8 @@ namespace MongoDB
 
   ConnectionInfo ConnectionInfo::globalInfo()
   {
-    const char* fname = SIPX_CONFDIR "/mongo-client.ini";
-    std::ifstream file(fname);
+    std::string fname = configFile("mongo-client.ini");
+    std::ifstream file(fname.c_str());
     if (!file.is_open())
     {
         BOOST_THROW_EXCEPTION(ConfigError() <<  errmsg_info(std::string("Missing file ")  + fname));
@@ -68,7 +102,7 @@ namespace MongoDB
 
   ConnectionInfo ConnectionInfo::localInfo()
   {
-    std::ifstream file(SIPX_CONFDIR "/mongo-local.ini");
+    std::ifstream file(configFile("mongo-local.ini").c_str());
     if (!file.is_open())
     {
       return ConnectionInfo();
@@ -82,6 +116,7 @@ namespace MongoDB
     _useReadTags = false; 
     _readQueryTimeoutMs = 0;
     _writeQueryTimeoutMs = 0;
+    _embeddedStorage = false;
   }
   
   ConnectionInfo::ConnectionInfo(const ConnectionInfo& rhs)
@@ -94,6 +129,8 @@ namespace MongoDB
     _clusterId = rhs._clusterId;
     _readQueryTimeoutMs = rhs._readQueryTimeoutMs;
     _writeQueryTimeoutMs = rhs._writeQueryTimeoutMs;
+    _embeddedStorage = rhs._embeddedStorage;
+    _journalDirectory = rhs._journalDirectory;
 	}
   
   ConnectionInfo& ConnectionInfo::operator=(const ConnectionInfo& rhs)
@@ -106,6 +143,8 @@ namespace MongoDB
     _clusterId = rhs._clusterId;
     _readQueryTimeoutMs = rhs._readQueryTimeoutMs;
     _writeQueryTimeoutMs = rhs._writeQueryTimeoutMs;
+    _embeddedStorage = rhs._embeddedStorage;
+    _journalDirectory = rhs._journalDirectory;
     return *this;
   }
   
@@ -114,7 +153,8 @@ namespace MongoDB
                  _shard(0),
                  _useReadTags(false),
                  _readQueryTimeoutMs(0),
-                 _writeQueryTimeoutMs(0)
+                 _writeQueryTimeoutMs(0),
+                 _embeddedStorage(false)
 	{
 	}
 
@@ -123,7 +163,9 @@ namespace MongoDB
       _shard(0),
       _useReadTags(false),
       _readQueryTimeoutMs(0),
-      _writeQueryTimeoutMs(0)
+      _writeQueryTimeoutMs(0),
+      _embeddedStorage(false),
+      _journalDirectory(SIPX_DBDIR)
   {
     set<string> options;
     options.insert("*");
@@ -160,6 +202,16 @@ namespace MongoDB
       {
         _writeQueryTimeoutMs = atoi(i->value[0].c_str());
       }
+
+      if (i->string_key == "storage")
+      {
+        _embeddedStorage = i->value[0] == "embedded";
+      }
+
+      if (i->string_key == "journalDirectory")
+      {
+        _journalDirectory = i->value[0];
+      }
     }
     
     OS_LOG_INFO(FAC_SIP, "ConnectionInfo::ConnectionInfo "
@@ -168,7 +220,8 @@ namespace MongoDB
         << ", clusterId: " << _clusterId
         << ", useReadTags: " << _useReadTags
         << ", readQueryTimeoutMs: " << _readQueryTimeoutMs
-        << ", writeQueryTimeoutMs: " << _writeQueryTimeoutMs);
+        << ", writeQueryTimeoutMs: " << _writeQueryTimeoutMs
+        << ", storage: " << (_embeddedStorage ? "embedded, journalDirectory: " + _journalDirectory : "mongo"));
 
     file.close();
     if (_rawConnectionString.empty())
@@ -240,6 +293,8 @@ namespace MongoDB
 
   void BaseDB::registerTimer(const UpdateTimer* pTimer)
   {
+    _pUpdateTime->tally(pTimer->_endUsec - pTimer->_startUsec);
+
     boost::lock_guard<boost::mutex> lock(_updateTimerSamplesMutex);
 
     _lastUpdateSpeed = pTimer->_end - pTimer->_start;
@@ -263,6 +318,8 @@ namespace MongoDB
 
   void BaseDB::registerTimer(const ReadTimer* pTimer)
   {
+    _pReadTime->tally(pTimer->_endUsec - pTimer->_startUsec);
+
     boost::lock_guard<boost::mutex> lock(_readTimerSamplesMutex);
     
 
@@ -348,11 +405,13 @@ namespace MongoDB
 
   UpdateTimer::UpdateTimer(BaseDB& db) :
     _end(0),
+    _endUsec(0),
     _db(db)
   {
     struct timeval sTimeVal;
     gettimeofday( &sTimeVal, NULL );
     _start = (Int64)( sTimeVal.tv_sec * 1000 + ( sTimeVal.tv_usec / 1000 ) );
+    _startUsec = UtlMetricHistogram::now();
   }
   
   UpdateTimer::~UpdateTimer()
@@ -360,16 +419,19 @@ namespace MongoDB
     struct timeval sTimeVal;
     gettimeofday( &sTimeVal, NULL );
     _end = (Int64)( sTimeVal.tv_sec * 1000 + ( sTimeVal.tv_usec / 1000 ) );
+    _endUsec = UtlMetricHistogram::now();
     _db.registerTimer(this);
   }
 
   ReadTimer::ReadTimer(BaseDB& db) :
     _end(0),
+    _endUsec(0),
     _db(db)
   {
     struct timeval sTimeVal;
     gettimeofday( &sTimeVal, NULL );
     _start = (Int64)( sTimeVal.tv_sec * 1000 + ( sTimeVal.tv_usec / 1000 ) );
+    _startUsec = UtlMetricHistogram::now();
   }
 
   ReadTimer::~ReadTimer()
@@ -377,6 +439,7 @@ namespace MongoDB
     struct timeval sTimeVal;
     gettimeofday( &sTimeVal, NULL );
     _end = (Int64)( sTimeVal.tv_sec * 1000 + ( sTimeVal.tv_usec / 1000 ) );
+    _endUsec = UtlMetricHistogram::now();
     _db.registerTimer(this);
   }
 
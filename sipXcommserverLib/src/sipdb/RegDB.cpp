@@ -14,6 +14,7 @@
  */
 
 #include <fstream>
+#include <boost/bind.hpp>
 #include <mongo/client/dbclient.h>
 #include <mongo/client/connpool.h>
 #include <os/OsDateTime.h>
@@ -21,6 +22,7 @@
 #include "sipdb/RegDB.h"
 #include "sipdb/RegExpireThread.h"
 #include "sipdb/MongoMod.h"
+#include "sipdb/EmbeddedCollection.h"
 
 using namespace std;
 
@@ -28,6 +30,32 @@ const string RegDB::NS("node.registrar");
 
 extern mongo::DBConnectionPool pool;
 
+//
+// Predicates on embedded binding documents
+//
+static bool expiresBy(const mongo::BSONObj& bson, long long time)
+{
+  return bson.getField(RegBinding::expirationTime_fld()).numberLong() <= time;
+}
+
+static bool expiresAfter(const mongo::BSONObj& bson, long long time)
+{
+  return bson.getField(RegBinding::expirationTime_fld()).numberLong() > time;
+}
+
+const std::vector<std::string>& RegDB::embeddedIndexes()
+{
+  static std::vector<std::string> indexes;
+  if (indexes.empty())
+  {
+    indexes.push_back(RegBinding::identity_fld());
+    indexes.push_back(RegBinding::gruu_fld());
+    indexes.push_back(RegBinding::binding_fld());
+    indexes.push_back(RegBinding::instrument_fld());
+  }
+  return indexes;
+}
+
 RegDB* RegDB::CreateInstance() {
    RegDB* lRegDb = NULL;
 
@@ -92,8 +120,10 @@ void RegDB::updateBinding(RegBinding& binding)
                         "shardId" << getShardId());
 
   bool isExpired = binding.getExpirationTime() <= 0;
+	mongo::OID oid = mongo::OID::gen();
 	mongo::BSONObj update;
     update = BSON(
+          "_id" << oid <<
           "timestamp" << static_cast<long long>(binding.getTimestamp()) <<
           "localAddress" << binding.getLocalAddress() <<
           "identity" << binding.getIdentity() <<
@@ -111,6 +141,12 @@ void RegDB::updateBinding(RegBinding& binding)
           "instrument" << binding.getInstrument() <<
           "expired" << isExpired );
 
+  if (_pEmbedded)
+  {
+    _pEmbedded->put(ExpireSchedule::makeKey(binding.getIdentity(), binding.getContact()), update);
+  }
+  else
+  {
     MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
     mongo::DBClientBase* client = conn->get();
 
@@ -127,6 +163,20 @@ void RegDB::updateBinding(RegBinding& binding)
         }
 
 	conn->done();
+  }
+
+  if (_pExpireSchedule)
+  {
+    ExpireSchedule::Entry entry;
+    entry.key = ExpireSchedule::makeKey(binding.getIdentity(), binding.getContact());
+    entry.identity = binding.getIdentity();
+    entry.uri = binding.getUri();
+    entry.instrument = binding.getInstrument();
+    entry.id = oid;
+    entry.hasId = true;
+    entry.expirationTime = (isExpired ? 0 : binding.getExpirationTime()) + _expireGracePeriod;
+    _pExpireSchedule->schedule(entry);
+  }
 }
 
 void RegDB::expireOldBindings(const string& identity, const string& callId, unsigned int cseq,
@@ -138,6 +188,20 @@ void RegDB::expireOldBindings(const string& identity, const string& callId, unsi
 	}
   
   MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->find(RegBinding::identity_fld(), identity, documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+    {
+      RegBinding binding(*iter);
+      if (binding.getCallId() == callId && binding.getCseq() < cseq)
+        _pEmbedded->erase(ExpireSchedule::makeKey(identity, binding.getContact()));
+    }
+    return;
+  }
+
 	mongo::BSONObj query = BSON(
 			"identity" << identity <<
 			"callId"<< callId <<
@@ -163,6 +227,16 @@ void RegDB::expireAllBindings(const string& identity, const string& callId, unsi
 	}
   
   MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->find(RegBinding::identity_fld(), identity, documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      _pEmbedded->erase(ExpireSchedule::makeKey(identity, iter->getStringField(RegBinding::contact_fld())));
+  }
+  else
+  {
 	mongo::BSONObj query = BSON(
                         "shardId" << getShardId() <<
 			"identity" << identity);
@@ -175,6 +249,10 @@ void RegDB::expireAllBindings(const string& identity, const string& callId, unsi
 	client->ensureIndex("node.registrar", BSON( "expirationTime" << 1 ));
 
 	conn->done();
+  }
+
+  if (_pExpireSchedule)
+    _pExpireSchedule->unscheduleIdentity(identity);
 }
 
 void RegDB::removeAllExpired()
@@ -192,6 +270,13 @@ void RegDB::removeAllExpired()
   OS_LOG_INFO(FAC_SIP, "RegDB::removeAllExpired INVOKED for shard == " << getShardId() << " and expireTime <= " << timeNow << " gracePeriod: " << _expireGracePeriod << " sec");
 
   MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    _pEmbedded->eraseIf(boost::bind(&expiresBy, _1, (long long)timeNow));
+    return;
+  }
+
   mongo::BSONObj query = BSON(
             "shardId" << getShardId() <<
             "expirationTime" << BSON_LESS_THAN_EQUAL((long long)timeNow));
@@ -206,6 +291,139 @@ void RegDB::removeAllExpired()
   conn->done();
 }
 
+void RegDB::removeExpired(const ExpireSchedule::Entries& entries)
+{
+  if (_local != NULL)
+  {
+    _local->removeExpired(entries);
+    return;
+  }
+
+  if (_pEmbedded)
+  {
+    MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
+    long long timeNow = OsDateTime::getSecsSinceEpoch() - _expireGracePeriod;
+    for (ExpireSchedule::Entries::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+      _pEmbedded->eraseIf(iter->key, boost::bind(&expiresBy, _1, timeNow));
+    return;
+  }
+
+  mongo::BSONArrayBuilder ids;
+  for (ExpireSchedule::Entries::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+  {
+    if (iter->hasId)
+      ids.append(iter->id);
+  }
+
+  if (ids.arrSize() == 0)
+    return;
+
+  unsigned long timeNow = OsDateTime::getSecsSinceEpoch() - _expireGracePeriod;
+
+  OS_LOG_DEBUG(FAC_SIP, "RegDB::removeExpired removing " << ids.arrSize() << " bindings for shard == " << getShardId() << " and expireTime <= " << timeNow);
+
+  MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
+  mongo::BSONObj query = BSON(
+            "_id" << BSON("$in" << ids.arr()) <<
+            "shardId" << getShardId() <<
+            "expirationTime" << BSON_LESS_THAN_EQUAL((long long)timeNow));
+
+  MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
+  conn->get()->remove(_ns, query);
+  conn->done();
+}
+
+void RegDB::setExpireSchedule(ExpireSchedule* pExpireSchedule)
+{
+  _pExpireSchedule = pExpireSchedule;
+  if (_local)
+    _local->setExpireSchedule(pExpireSchedule);
+}
+
+void RegDB::populateExpireSchedule()
+{
+  if (_local != NULL)
+  {
+    _local->populateExpireSchedule();
+    return;
+  }
+
+  if (!_pExpireSchedule)
+    return;
+
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->getAll(documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      scheduleExpiration(*iter);
+
+    OS_LOG_INFO(FAC_SIP, "RegDB::populateExpireSchedule scheduled " << _pExpireSchedule->size() << " embedded bindings");
+    return;
+  }
+
+  mongo::BSONObj query = BSON("shardId" << getShardId());
+  mongo::BSONObj fields = BSON(
+            "_id" << 1 <<
+            "identity" << 1 <<
+            "contact" << 1 <<
+            "uri" << 1 <<
+            "instrument" << 1 <<
+            "expirationTime" << 1);
+
+  MongoDB::ReadTimer readTimer(const_cast<RegDB&>(*this));
+
+  mongo::BSONObjBuilder builder;
+  BaseDB::primaryPreferred(builder, query);
+
+  MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
+  auto_ptr<mongo::DBClientCursor> pCursor = conn->get()->query(_ns, readQueryMaxTimeMS(builder.obj()), 0, 0, &fields, mongo::QueryOption_SlaveOk);
+  if (!pCursor.get())
+  {
+   throw mongo::DBException("mongo query returned null cursor", 0);
+  }
+
+  while (pCursor->more())
+  {
+    scheduleExpiration(pCursor->next());
+  }
+  conn->done();
+
+  OS_LOG_INFO(FAC_SIP, "RegDB::populateExpireSchedule scheduled " << _pExpireSchedule->size() << " bindings for shard == " << getShardId());
+}
+
+void RegDB::scheduleExpiration(const mongo::BSONObj& bson)
+{
+  if (_local != NULL)
+  {
+    _local->scheduleExpiration(bson);
+    return;
+  }
+
+  if (!_pExpireSchedule)
+    return;
+
+  if (bson.hasField(RegBinding::shardId_fld()) && bson.getIntField(RegBinding::shardId_fld()) != getShardId())
+    return;
+
+  mongo::BSONElement oid;
+  if (!bson.getObjectID(oid) || oid.type() != mongo::jstOID)
+    return;
+
+  ExpireSchedule::Entry entry;
+  entry.identity = bson.getStringField(RegBinding::identity_fld());
+  entry.key = ExpireSchedule::makeKey(entry.identity, bson.getStringField(RegBinding::contact_fld()));
+  entry.uri = bson.getStringField(RegBinding::uri_fld());
+  entry.instrument = bson.getStringField(RegBinding::instrument_fld());
+  entry.id = oid.OID();
+  entry.hasId = true;
+
+  long long expirationTime = bson.getField(RegBinding::expirationTime_fld()).numberLong();
+  entry.expirationTime = (expirationTime > 0 ? expirationTime : 0) + _expireGracePeriod;
+
+  _pExpireSchedule->schedule(entry);
+}
+
 bool RegDB::isOutOfSequence(const string& identity, const string& callId, unsigned int cseq) const
 {
     // Remove this method altogether?!?!? -- Conversation between douglas and joegen on 6/18/13
@@ -237,7 +455,15 @@ bool RegDB::isRegisteredBinding(const Url& curl, bool preferPrimary)
 	} 
 
   MongoDB::ReadTimer readTimer(const_cast<RegDB&>(*this));
-  
+
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->find(RegBinding::binding_fld(), binding.str(), documents);
+    isRegistered = !documents.empty();
+  }
+  else
+  {
 	mongo::BSONObjBuilder builder;
 	if (!preferPrimary)
 	  BaseDB::nearest(builder, query.obj());
@@ -254,6 +480,7 @@ bool RegDB::isRegisteredBinding(const Url& curl, bool preferPrimary)
 
 	isRegistered = pCursor->more();
 	conn->done();
+  }
   
   OS_LOG_INFO(FAC_SIP, "RegDB::isRegisteredBinding returning " << (isRegistered ? "TRUE" : "FALSE") << " for binding " <<  binding.str());
    
@@ -318,6 +545,23 @@ bool RegDB::getUnexpiredContactsUser(const string& identity, unsigned long timeN
   
    MongoDB::ReadTimer readTimer(const_cast<RegDB&>(*this));
 
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    if (isGruu)
+      _pEmbedded->find(RegBinding::gruu_fld(), identity + ";" + SIP_GRUU_URI_PARAM, documents);
+    else
+      _pEmbedded->find(RegBinding::identity_fld(), identity, documents);
+
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+    {
+      RegBinding binding(*iter);
+      if (binding.getExpirationTime() > timeNow)
+        push_or_replace_binding(bindings, binding);
+    }
+    return bindings.size() > 0;
+  }
+
 	if (isGruu) {
 		string searchString(identity);
 		searchString += ";";
@@ -391,6 +635,19 @@ bool RegDB::getUnexpiredContactsUserContaining(const string& matchIdentity, unsi
 	} 
 
   MongoDB::ReadTimer readTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->findIf(boost::bind(&expiresAfter, _1, (long long)timeNow), documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+    {
+      RegBinding binding(*iter);
+      if (binding.getContact().find(matchIdentity) != string::npos)
+        push_or_replace_binding(bindings, binding);
+    }
+    return bindings.size() > 0;
+  }
    
 	mongo::BSONObjBuilder builder;
 	if (!preferPrimary)
@@ -465,6 +722,23 @@ bool RegDB::getUnexpiredContactsUserInstrument(const string& identity, const str
 	} 
 
   MongoDB::ReadTimer readTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    bool found = false;
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->find(RegBinding::identity_fld(), identity, documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+    {
+      RegBinding binding(*iter);
+      if (binding.getInstrument() == instrument && binding.getExpirationTime() > timeNow)
+      {
+        push_or_replace_binding(bindings, binding);
+        found = true;
+      }
+    }
+    return found;
+  }
    
 	mongo::BSONObjBuilder builder;
 	if (!preferPrimary)
@@ -508,6 +782,23 @@ bool RegDB::getUnexpiredContactsInstrument(const string& instrument, unsigned lo
 	} 
 
   MongoDB::ReadTimer readTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    bool found = false;
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->find(RegBinding::instrument_fld(), instrument, documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+    {
+      RegBinding binding(*iter);
+      if (binding.getExpirationTime() > timeNow)
+      {
+        push_or_replace_binding(bindings, binding);
+        found = true;
+      }
+    }
+    return found;
+  }
 	
   mongo::BSONObjBuilder builder;
 	if (!preferPrimary)
@@ -544,6 +835,13 @@ void RegDB::cleanAndPersist(int currentExpireTime)
 	}
   
    MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    _pEmbedded->eraseIf(boost::bind(&expiresBy, _1, (long long)currentExpireTime - 1));
+    return;
+  }
+
     mongo::BSONObj query = BSON(
         "expirationTime" << BSON_LESS_THAN(currentExpireTime));
     MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
@@ -560,8 +858,17 @@ void RegDB::clearAllBindings()
   
   MongoDB::UpdateTimer updateTimer(const_cast<RegDB&>(*this));
   
-  mongo::BSONObj all;
-  MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
-  conn->get()->remove(_ns, all);
-  conn->done();
+  if (_pEmbedded)
+  {
+    _pEmbedded->clear();
+  }
+  else
+  {
+    mongo::BSONObj all;
+    MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
+    conn->get()->remove(_ns, all);
+    conn->done();
+  }
+  if (_pExpireSchedule)
+    _pExpireSchedule->clear();
 }
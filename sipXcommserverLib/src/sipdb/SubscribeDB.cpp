@@ -15,11 +15,13 @@
 
 #include <string>
 #include <vector>
+#include <boost/bind.hpp>
 #include <mongo/client/dbclient.h>
 #include <mongo/client/connpool.h>
 #include "sipdb/SubscribeDB.h"
 #include "sipdb/SubscribeExpireThread.h"
 #include "sipdb/MongoMod.h"
+#include "sipdb/EmbeddedCollection.h"
 #include "os/OsDateTime.h"
 #include "os/OsLogger.h"
 
@@ -27,6 +29,80 @@ using namespace std;
 
 const string SubscribeDB::NS("node.subscription");
 
+//
+// Predicates on embedded subscription documents
+//
+static bool expiresBy(const mongo::BSONObj& bson, long long time)
+{
+  return bson.getField(Subscription::expires_fld()).numberLong() <= time;
+}
+
+static bool expiresAfter(const mongo::BSONObj& bson, long long time)
+{
+  return bson.getField(Subscription::expires_fld()).numberLong() > time;
+}
+
+static bool componentExpiresBefore(const mongo::BSONObj& bson, const std::string& component, long long time)
+{
+  return component == bson.getStringField(Subscription::component_fld())
+      && bson.getField(Subscription::expires_fld()).numberLong() < time;
+}
+
+// A copy of bson with field set to value
+static mongo::BSONObj withField(const mongo::BSONObj& bson, const char* field, const std::string& value)
+{
+  mongo::BSONObjBuilder builder;
+  mongo::BSONObjIterator iter(bson);
+  while (iter.more())
+  {
+    mongo::BSONElement element = iter.next();
+    if (strcmp(element.fieldName(), field) != 0)
+      builder.append(element);
+  }
+  builder.append(field, value);
+  return builder.obj();
+}
+
+const std::vector<std::string>& SubscribeDB::embeddedIndexes()
+{
+  static std::vector<std::string> indexes;
+  if (indexes.empty())
+  {
+    indexes.push_back(Subscription::toUri_fld());
+    indexes.push_back(Subscription::callId_fld());
+    indexes.push_back(Subscription::key_fld());
+    indexes.push_back(Subscription::uri_fld());
+  }
+  return indexes;
+}
+
+std::string SubscribeDB::dialogKey(const std::string& toUri,
+    const std::string& fromUri,
+    const std::string& callId,
+    const std::string& eventTypeKey)
+{
+  std::string dialog(toUri);
+  dialog += '\n';
+  dialog += fromUri;
+  dialog += '\n';
+  dialog += callId;
+  dialog += '\n';
+  dialog += eventTypeKey;
+  return dialog;
+}
+
+static std::string dialogKeyOf(const mongo::BSONObj& bson)
+{
+  std::string dialog(bson.getStringField(Subscription::toUri_fld()));
+  dialog += '\n';
+  dialog += bson.getStringField(Subscription::fromUri_fld());
+  dialog += '\n';
+  dialog += bson.getStringField(Subscription::callId_fld());
+  dialog += '\n';
+  dialog += bson.getStringField(Subscription::eventTypeKey_fld());
+  return dialog;
+}
+
 SubscribeDB* SubscribeDB::CreateInstance() {
    SubscribeDB* ldb = NULL;
 
@@ -50,6 +126,16 @@ void SubscribeDB::getAll(Subscriptions& subscriptions, bool preferPrimary)
     query.append(Subscription::shardId_fld(), BSON("$ne" << getShardId()));
   }
 
+  if (_pEmbedded)
+  {
+    MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->getAll(documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      subscriptions.push_back(Subscription(*iter));
+    return;
+  }
+
   MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
   MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
   
@@ -150,18 +236,54 @@ void SubscribeDB::upsert (
     objBuilder.append(Subscription::accept_fld(), accept.str());
     objBuilder.append(Subscription::version_fld(),version);
 
-    mongo::BSONObjBuilder opBuilder;
-    opBuilder.append("$set", objBuilder.obj());
+    if (_pEmbedded)
+    {
+      _pEmbedded->update(dialogKey(toUri.str(), fromUri.str(), callId.str(), eventTypeKey.str()), objBuilder.obj(), true);
+    }
+    else
+    {
+      mongo::BSONObjBuilder opBuilder;
+      opBuilder.append("$set", objBuilder.obj());
+
+      mongo::BSONObj update = opBuilder.obj();
 
-    mongo::BSONObj update = opBuilder.obj();
+      MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
+      mongo::DBClientBase* client = conn->get();
+      client->update(_ns, query, update, true, false);
+      ensureIndex(client);
+      conn->done();
+    }
 
-    MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
-    mongo::DBClientBase* client = conn->get();
-    client->update(_ns, query, update, true, false);
-    ensureIndex(client);
-    conn->done();
+    if (_pExpireSchedule)
+      scheduleExpiration(key, uri, toUri, fromUri, callId, eventTypeKey, expires);
+    else
+      removeAllExpired();
+}
+
+void SubscribeDB::scheduleExpiration(
+    const UtlString& key,
+    const UtlString& uri,
+    const UtlString& toUri,
+    const UtlString& fromUri,
+    const UtlString& callId,
+    const UtlString& eventTypeKey,
+    unsigned long expires)
+{
+    ExpireSchedule::Entry entry;
+    entry.identity = key.str();
+    entry.uri = uri.str();
+
+    entry.key = ExpireSchedule::makeKey(entry.identity,
+        dialogKey(toUri.str(), fromUri.str(), callId.str(), eventTypeKey.str()));
 
-    removeAllExpired();
+    entry.selector = BSON(
+        Subscription::toUri_fld() << toUri.str() <<
+        Subscription::fromUri_fld() << fromUri.str() <<
+        Subscription::callId_fld() << callId.str() <<
+        Subscription::eventTypeKey_fld() << eventTypeKey.str());
+    entry.expirationTime = expires;
+
+    _pExpireSchedule->schedule(entry);
 }
 
 void SubscribeDB::ensureIndex(mongo::DBClientBase* client) const {
@@ -185,6 +307,19 @@ void SubscribeDB::remove (
   }
   
   MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->find(Subscription::toUri_fld(), to.str(), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Subscription row(*iter);
+        if (row.fromUri() == from.str() && row.callId() == callid.str() && (int) row.subscribeCseq() < subscribeCseq)
+          _pEmbedded->erase(dialogKeyOf(*iter));
+      }
+      return;
+    }
   
     mongo::BSONObj query = BSON(
         Subscription::toUri_fld() << to.str() <<
@@ -209,6 +344,19 @@ void SubscribeDB::removeError (
   }
   
   MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->find(Subscription::toUri_fld(), to.str(), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Subscription row(*iter);
+        if (row.fromUri() == from.str() && row.callId() == callid.str())
+          _pEmbedded->erase(dialogKeyOf(*iter));
+      }
+      return;
+    }
   
     mongo::BSONObj query = BSON(
         Subscription::toUri_fld() << to.str() <<
@@ -245,6 +393,19 @@ bool SubscribeDB::subscriptionExists (
   } 
 
   MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+
+  if (_pEmbedded)
+  {
+    EmbeddedCollection::Documents documents;
+    _pEmbedded->find(Subscription::toUri_fld(), toUri.str(), documents);
+    for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+    {
+      Subscription row(*iter);
+      if (row.fromUri() == fromUri.str() && row.callId() == callId.str() && row.expires() >= timeNow)
+        return true;
+    }
+    return false;
+  }
   
   mongo::BSONObjBuilder builder;
   if (preferPrimary)
@@ -280,6 +441,12 @@ void SubscribeDB::removeExpired( const UtlString& component, const unsigned long
     }
     
     MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      _pEmbedded->eraseIf(boost::bind(&componentExpiresBefore, _1, component.str(), (long long)timeNow));
+      return;
+    }
     
     mongo::BSONObj query = BSON(
         Subscription::component_fld() << component.str() <<
@@ -297,7 +464,8 @@ void SubscribeDB::getUnexpiredSubscriptions (
     Subscriptions& subscriptions,
     bool preferPrimary)
 {
-    removeAllExpired();    
+    if (!_pExpireSchedule)
+      removeAllExpired();
     //query="key=",key,"and eventtypekey=",eventTypeKey;
     if (_local) {
       preferPrimary = false;
@@ -306,10 +474,25 @@ void SubscribeDB::getUnexpiredSubscriptions (
     }
     
     MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->find(Subscription::key_fld(), key.str(), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Subscription row(*iter);
+        if (row.eventTypeKey() == eventTypeKey.str() && row.expires() >= timeNow)
+          subscriptions.push_back(row);
+      }
+      return;
+    }
+
     mongo::BSONObjBuilder query;
     query.append(Subscription::key_fld(), key.str());
     query.append(Subscription::eventTypeKey_fld(), eventTypeKey.str());
     query.append(Subscription::shardId_fld(), getShardId());
+    query.append(Subscription::expires_fld(), BSON_GREATER_THAN_EQUAL((long long)timeNow));
 
     mongo::BSONObjBuilder builder;
     if (preferPrimary)
@@ -337,7 +520,8 @@ void SubscribeDB::getUnexpiredContactsFieldsContaining(
     std::vector<string>& matchingContactFields,
     bool preferPrimary ) const
 {
-    const_cast<SubscribeDB*>(this)->removeAllExpired();
+    if (!_pExpireSchedule)
+      const_cast<SubscribeDB*>(this)->removeAllExpired();
 
     mongo::BSONObjBuilder query;
     query.append(Subscription::expires_fld(), BSON_GREATER_THAN((long long)timeNow));
@@ -349,6 +533,19 @@ void SubscribeDB::getUnexpiredContactsFieldsContaining(
     } 
 
     MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->findIf(boost::bind(&expiresAfter, _1, (long long)timeNow), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        string contact = iter->getStringField(Subscription::contact_fld());
+        if (contact.find(substringToMatch.str()) != string::npos)
+          matchingContactFields.push_back(contact);
+      }
+      return;
+    }
     
     mongo::BSONObjBuilder builder;
     if (preferPrimary)
@@ -401,6 +598,25 @@ void SubscribeDB::updateNotifyUnexpiredSubscription(
     }
     
     MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->find(Subscription::toUri_fld(), to.str(), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Subscription row(*iter);
+        if (row.callId() == callid.str() && row.eventTypeKey() == eventTypeKey.str() && row.id() == id.str())
+        {
+          _pEmbedded->update(dialogKeyOf(*iter), BSON(
+              Subscription::notifyCseq_fld() << updatedNotifyCseq <<
+              Subscription::version_fld() << version), false);
+          // As the mongo update does, only the first one
+          break;
+        }
+      }
+      return;
+    }
     
     mongo::BSONObj query = BSON(
         Subscription::toUri_fld() << to.str() <<
@@ -481,6 +697,33 @@ void SubscribeDB::updateToTag(
     }
     
     MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->find(Subscription::callId_fld(), callid.str(), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Url from_uri(iter->getStringField(Subscription::fromUri_fld()), FALSE);
+        UtlString seen_tag;
+        if (!from_uri.getFieldParameter("tag", seen_tag) || seen_tag.compareTo(fromtag) != 0)
+          continue;
+
+        Url to_uri(iter->getStringField(Subscription::toUri_fld()), FALSE);
+        UtlString dummy;
+        if (to_uri.getFieldParameter("tag", dummy))
+          continue;
+
+        to_uri.setFieldParameter("tag", totag);
+        to_uri.toString(dummy); // un-parse as name-addr
+
+        // The To URI is part of the key, so the subscription moves
+        mongo::BSONObj updated = withField(*iter, Subscription::toUri_fld(), dummy.data());
+        _pEmbedded->erase(dialogKeyOf(*iter));
+        _pEmbedded->put(dialogKeyOf(updated), updated);
+      }
+      return;
+    }
     
     mongo::BSONObj query = BSON(Subscription::callId_fld() << callid.str());
     MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
@@ -555,23 +798,34 @@ bool SubscribeDB::findFromAndTo(
     }
 
     MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
-    
-    mongo::BSONObjBuilder builder;
-    if (preferPrimary)
-      BaseDB::primaryPreferred(builder, query.obj());
-    else
-      BaseDB::nearest(builder, query.obj());
 
-    MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
-    auto_ptr<mongo::DBClientCursor> pCursor = conn->get()->query(_ns, readQueryMaxTimeMS(builder.obj()), 0, 0, 0, mongo::QueryOption_SlaveOk);
-    if (!pCursor.get())
+    EmbeddedCollection::Documents documents;
+    MongoDB::ScopedDbConnectionPtr conn;
+    auto_ptr<mongo::DBClientCursor> pCursor;
+    if (_pEmbedded)
     {
-     throw mongo::DBException("mongo query returned null cursor", 0);
+      _pEmbedded->find(Subscription::callId_fld(), callid.str(), documents);
+    }
+    else
+    {
+      mongo::BSONObjBuilder builder;
+      if (preferPrimary)
+        BaseDB::primaryPreferred(builder, query.obj());
+      else
+        BaseDB::nearest(builder, query.obj());
+
+      conn.reset(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
+      pCursor = conn->get()->query(_ns, readQueryMaxTimeMS(builder.obj()), 0, 0, 0, mongo::QueryOption_SlaveOk);
+      if (!pCursor.get())
+      {
+       throw mongo::DBException("mongo query returned null cursor", 0);
+      }
     }
 
-    while (pCursor->more())
+    EmbeddedCollection::Documents::const_iterator document = documents.begin();
+    while (pCursor.get() ? pCursor->more() : document != documents.end())
     {
-        Subscription row = pCursor->next();
+        Subscription row = pCursor.get() ? pCursor->next() : *document++;
         UtlBoolean r;
         UtlString seen_tag;
 
@@ -592,12 +846,14 @@ bool SubscribeDB::findFromAndTo(
               // We have found a match.  Record the full URIs.
               from = row.fromUri().c_str();
               to = row.toUri().c_str();
-              conn->done();
+              if (conn)
+                conn->done();
               return true;
            }
         }
     }
-    conn->done();
+    if (conn)
+      conn->done();
     return false;
 }
 
@@ -613,6 +869,19 @@ int SubscribeDB::getMaxVersion(const UtlString& uri, bool preferPrimary) const
     }
 
     MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->find(Subscription::uri_fld(), uri.str(), documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Subscription row(*iter);
+        if (value < row.version())
+          value = row.version();
+      }
+      return value;
+    }
     
     mongo::BSONObjBuilder builder;
     if (preferPrimary)
@@ -648,6 +917,12 @@ void SubscribeDB::removeAllExpired()
     OS_LOG_INFO(FAC_SIP, "SubscribeDB::removeAllExpired INVOKED for shard == " << getShardId() << " and expireTime <= " << timeNow);
 
     MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      _pEmbedded->eraseIf(boost::bind(&expiresBy, _1, (long long)timeNow));
+      return;
+    }
     
     mongo::BSONObj query = BSON(
       Subscription::shardId_fld() << getShardId() <<
@@ -658,3 +933,161 @@ void SubscribeDB::removeAllExpired()
     conn->done();
 }
 
+void SubscribeDB::removeExpired(const ExpireSchedule::Entries& entries)
+{
+    if (_local) {
+      _local->removeExpired(entries);
+      return;
+    }
+
+    if (_pEmbedded)
+    {
+      MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+      long long timeNow = OsDateTime::getSecsSinceEpoch();
+      for (ExpireSchedule::Entries::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+      {
+        // The schedule key is the resource key followed by the dialog key
+        if (iter->key.size() > iter->identity.size())
+          _pEmbedded->eraseIf(iter->key.substr(iter->identity.size() + 1), boost::bind(&expiresBy, _1, timeNow));
+      }
+      return;
+    }
+
+    unsigned long timeNow = OsDateTime::getSecsSinceEpoch();
+    mongo::BSONObj query = expiredQuery(entries, timeNow);
+    if (query.isEmpty())
+      return;
+
+    OS_LOG_DEBUG(FAC_SIP, "SubscribeDB::removeExpired removing " << entries.size() << " subscriptions for shard == " << getShardId() << " and expireTime <= " << timeNow);
+
+    MongoDB::UpdateTimer updateTimer(const_cast<SubscribeDB&>(*this));
+
+    MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getWriteQueryTimeout()));
+    conn->get()->remove(_ns, query);
+    conn->done();
+}
+
+void SubscribeDB::getExpired(const ExpireSchedule::Entries& entries, Subscriptions& subscriptions)
+{
+    if (_local) {
+      _local->getExpired(entries, subscriptions);
+      return;
+    }
+
+    long long timeNow = OsDateTime::getSecsSinceEpoch();
+
+    MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+
+    if (_pEmbedded)
+    {
+      for (ExpireSchedule::Entries::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+      {
+        // The schedule key is the resource key followed by the dialog key
+        mongo::BSONObj document;
+        if (iter->key.size() > iter->identity.size() &&
+            _pEmbedded->get(iter->key.substr(iter->identity.size() + 1), document) &&
+            expiresBy(document, timeNow))
+          subscriptions.push_back(Subscription(document));
+      }
+      return;
+    }
+
+    mongo::BSONObj query = expiredQuery(entries, timeNow);
+    if (query.isEmpty())
+      return;
+
+    // The subscriptions are about to be removed, so they are read where
+    // they are written.
+    mongo::BSONObjBuilder builder;
+    BaseDB::primaryPreferred(builder, query);
+
+    MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
+    auto_ptr<mongo::DBClientCursor> pCursor = conn->get()->query(_ns, readQueryMaxTimeMS(builder.obj()), 0, 0, 0, mongo::QueryOption_SlaveOk);
+    if (!pCursor.get())
+    {
+     throw mongo::DBException("mongo query returned null cursor", 0);
+    }
+
+    while (pCursor->more())
+    {
+        subscriptions.push_back(Subscription(pCursor->next()));
+    }
+    conn->done();
+}
+
+mongo::BSONObj SubscribeDB::expiredQuery(const ExpireSchedule::Entries& entries, unsigned long timeNow) const
+{
+    mongo::BSONArrayBuilder selectors;
+    for (ExpireSchedule::Entries::const_iterator iter = entries.begin(); iter != entries.end(); iter++)
+    {
+      if (iter->hasId)
+        selectors.append(BSON(Subscription::oid_fld() << iter->id));
+      else if (!iter->selector.isEmpty())
+        selectors.append(iter->selector);
+    }
+
+    if (selectors.arrSize() == 0)
+      return mongo::BSONObj();
+
+    return BSON(
+      "$or" << selectors.arr() <<
+      Subscription::shardId_fld() << getShardId() <<
+      Subscription::expires_fld() << BSON_LESS_THAN_EQUAL((long long)timeNow));
+}
+
+void SubscribeDB::setExpireSchedule(ExpireSchedule* pExpireSchedule)
+{
+    _pExpireSchedule = pExpireSchedule;
+    if (_local)
+      _local->setExpireSchedule(pExpireSchedule);
+}
+
+void SubscribeDB::populateExpireSchedule()
+{
+    if (_local) {
+      _local->populateExpireSchedule();
+      return;
+    }
+
+    if (!_pExpireSchedule)
+      return;
+
+    if (_pEmbedded)
+    {
+      EmbeddedCollection::Documents documents;
+      _pEmbedded->getAll(documents);
+      for (EmbeddedCollection::Documents::const_iterator iter = documents.begin(); iter != documents.end(); iter++)
+      {
+        Subscription row(*iter);
+        scheduleExpiration(row.key().c_str(), row.uri().c_str(), row.toUri().c_str(), row.fromUri().c_str(),
+            row.callId().c_str(), row.eventTypeKey().c_str(), row.expires());
+      }
+
+      OS_LOG_INFO(FAC_SIP, "SubscribeDB::populateExpireSchedule scheduled " << _pExpireSchedule->size() << " embedded subscriptions");
+      return;
+    }
+
+    mongo::BSONObj query = BSON(Subscription::shardId_fld() << getShardId());
+
+    MongoDB::ReadTimer readTimer(const_cast<SubscribeDB&>(*this));
+
+    mongo::BSONObjBuilder builder;
+    BaseDB::primaryPreferred(builder, query);
+
+    MongoDB::ScopedDbConnectionPtr conn(mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString(), getReadQueryTimeout()));
+    auto_ptr<mongo::DBClientCursor> pCursor = conn->get()->query(_ns, readQueryMaxTimeMS(builder.obj()), 0, 0, 0, mongo::QueryOption_SlaveOk);
+    if (!pCursor.get())
+    {
+     throw mongo::DBException("mongo query returned null cursor", 0);
+    }
+
+    while (pCursor->more())
+    {
+      Subscription row(pCursor->next());
+      scheduleExpiration(row.key().c_str(), row.uri().c_str(), row.toUri().c_str(), row.fromUri().c_str(),
+          row.callId().c_str(), row.eventTypeKey().c_str(), row.expires());
+    }
+    conn->done();
+
+    OS_LOG_INFO(FAC_SIP, "SubscribeDB::populateExpireSchedule scheduled " << _pExpireSchedule->size() << " subscriptions for shard == " << getShardId());
+}
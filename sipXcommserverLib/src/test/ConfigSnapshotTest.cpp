@@ -0,0 +1,374 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+#include <boost/thread.hpp>
+
+#include "filereader/ConfigSnapshot.h"
+#include "digitmaps/MappingRulesUrlMapping.h"
+#include "net/Url.h"
+#include "os/OsDateTime.h"
+#include "os/OsTask.h"
+#include "sipdb/ResultSet.h"
+
+#include "sipxunit/FileTestContext.h"
+
+// How long to wait for a file change to be read, in milliseconds.
+#define RELOAD_TIMEOUT 10000
+
+// The size of the mapping rules file read while it is being used.
+#define BIG_MAPPING_RULES (5 * 1024 * 1024)
+
+static long long usecsSinceBoot()
+{
+   OsTime now;
+   OsDateTime::getCurTimeSinceBoot(now);
+   return now.seconds() * 1000000LL + now.usecs();
+}
+
+// Parser for the snapshots of plain files: what they contain, unless
+// that is "broken".
+static UtlString* readContent(const std::string& fileName)
+{
+   std::ifstream file(fileName.c_str());
+   if (!file)
+   {
+      return NULL;
+   }
+   std::stringstream content;
+   content << file.rdbuf();
+   if (content.str() == "broken")
+   {
+      return NULL;
+   }
+   return new UtlString(content.str().c_str());
+}
+
+static MappingRulesUrlMapping* readMappingRules(const std::string& fileName)
+{
+   MappingRulesUrlMapping* map = new MappingRulesUrlMapping;
+   if (map->loadMappings(fileName.c_str()) != OS_SUCCESS)
+   {
+      delete map;
+      map = NULL;
+   }
+   return map;
+}
+
+// Looks up sip:100@example.com in the mapping rules until stopped,
+// and keeps the longest time a lookup took.
+class LookUp
+{
+public:
+   LookUp(const ConfigSnapshot<MappingRulesUrlMapping>& map) :
+      mMap(map),
+      mStop(false),
+      mLookUps(0),
+      mFailures(0),
+      mMaxUsecs(0)
+   {
+   }
+
+   void operator()()
+   {
+      Url target("sip:100@example.com");
+      while (!mStop)
+      {
+         ResultSet contacts;
+         ResultSet permissions;
+         UtlString callTag;
+
+         long long start = usecsSinceBoot();
+         ConfigSnapshot<MappingRulesUrlMapping>::Ptr map = mMap.get();
+         map->getContactList(target, contacts, permissions, callTag);
+         long long usecs = usecsSinceBoot() - start;
+
+         mLookUps++;
+         if (contacts.getSize() != 1)
+         {
+            mFailures++;
+         }
+         if (usecs > mMaxUsecs)
+         {
+            mMaxUsecs = usecs;
+         }
+      }
+   }
+
+   const ConfigSnapshot<MappingRulesUrlMapping>& mMap;
+   volatile bool mStop;
+   long mLookUps;
+   long mFailures;
+   long long mMaxUsecs;
+};
+
+/**
+ * Unit tests for ConfigSnapshot, which reads a file again when it changes.
+ */
+class ConfigSnapshotTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(ConfigSnapshotTest);
+   CPPUNIT_TEST(testInitialRead);
+   CPPUNIT_TEST(testRewritten);
+   CPPUNIT_TEST(testRenamedIntoPlace);
+   CPPUNIT_TEST(testBrokenKeepsLast);
+   CPPUNIT_TEST(testSnapshotOutlivesReload);
+   CPPUNIT_TEST(testLookUpWhileReloading);
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   void setUp()
+   {
+      mFileTestContext = new FileTestContext(TEST_DATA_DIR "/snapshot",
+                                             TEST_WORK_DIR "/snapshot");
+   }
+
+   void tearDown()
+   {
+      delete mFileTestContext;
+   }
+
+   std::string workingFile(const char* name)
+   {
+      UtlString path;
+      mFileTestContext->workingFilePath(name, path);
+      return path.data();
+   }
+
+   static void writeFile(const std::string& fileName, const std::string& content)
+   {
+      std::ofstream file(fileName.c_str(), std::ios::trunc);
+      file << content;
+   }
+
+   // Wait for the snapshot to be other than before.
+   template <class T>
+   static typename ConfigSnapshot<T>::Ptr
+   waitForReload(const ConfigSnapshot<T>& snapshot,
+                 const typename ConfigSnapshot<T>::Ptr& before)
+   {
+      typename ConfigSnapshot<T>::Ptr after;
+      for (int waited = 0; waited < RELOAD_TIMEOUT; waited += 10)
+      {
+         after = snapshot.get();
+         if (after != before)
+         {
+            break;
+         }
+         OsTask::delay(10);
+      }
+      return after;
+   }
+
+   void testInitialRead()
+   {
+      std::string fileName(workingFile("initial"));
+      writeFile(fileName, "one");
+
+      ConfigSnapshot<UtlString> snapshot(&readContent);
+      CPPUNIT_ASSERT(!snapshot.get());
+      CPPUNIT_ASSERT(snapshot.setFileName(fileName));
+      ASSERT_STR_EQUAL("one", snapshot.get()->data());
+
+      ConfigSnapshot<UtlString> missing(&readContent);
+      CPPUNIT_ASSERT(!missing.setFileName(workingFile("missing")));
+      CPPUNIT_ASSERT(!missing.get());
+   }
+
+   void testRewritten()
+   {
+      std::string fileName(workingFile("rewritten"));
+      writeFile(fileName, "one");
+
+      ConfigSnapshot<UtlString> snapshot(&readContent);
+      snapshot.setFileName(fileName);
+      ConfigSnapshot<UtlString>::Ptr before = snapshot.get();
+
+      writeFile(fileName, "two");
+      ConfigSnapshot<UtlString>::Ptr after = waitForReload(snapshot, before);
+      CPPUNIT_ASSERT(after != before);
+      ASSERT_STR_EQUAL("two", after->data());
+   }
+
+   void testRenamedIntoPlace()
+   {
+      std::string fileName(workingFile("renamed"));
+      std::string newFileName(workingFile("renamed.new"));
+      writeFile(fileName, "one");
+
+      ConfigSnapshot<UtlString> snapshot(&readContent);
+      snapshot.setFileName(fileName);
+      ConfigSnapshot<UtlString>::Ptr before = snapshot.get();
+
+      writeFile(newFileName, "two");
+      CPPUNIT_ASSERT_EQUAL(0, rename(newFileName.c_str(), fileName.c_str()));
+      ConfigSnapshot<UtlString>::Ptr after = waitForReload(snapshot, before);
+      CPPUNIT_ASSERT(after != before);
+      ASSERT_STR_EQUAL("two", after->data());
+   }
+
+   void testBrokenKeepsLast()
+   {
+      std::string fileName(workingFile("broken"));
+      writeFile(fileName, "one");
+
+      ConfigSnapshot<UtlString> snapshot(&readContent);
+      snapshot.setFileName(fileName);
+      ConfigSnapshot<UtlString>::Ptr before = snapshot.get();
+
+      // The broken file is read and ignored before the fixed one is read.
+      writeFile(fileName, "broken");
+      writeFile(fileName, "three");
+      ConfigSnapshot<UtlString>::Ptr after = waitForReload(snapshot, before);
+      ASSERT_STR_EQUAL("three", after->data());
+
+      writeFile(fileName, "broken");
+      OsTask::delay(500);
+      CPPUNIT_ASSERT(snapshot.get() == after);
+   }
+
+   void testSnapshotOutlivesReload()
+   {
+      std::string fileName(workingFile("outlives"));
+      writeFile(fileName, "one");
+
+      ConfigSnapshot<UtlString> snapshot(&readContent);
+      snapshot.setFileName(fileName);
+      ConfigSnapshot<UtlString>::Ptr held = snapshot.get();
+
+      writeFile(fileName, "two");
+      waitForReload(snapshot, held);
+      ASSERT_STR_EQUAL("one", held->data());
+      ASSERT_STR_EQUAL("two", snapshot.get()->data());
+   }
+
+   // Write mapping rules of about BIG_MAPPING_RULES bytes, in which
+   // sip:100@example.com matches the first rule.
+   static void writeBigMappingRules(const std::string& fileName, int version)
+   {
+      std::string rules;
+      rules.reserve(BIG_MAPPING_RULES + 4096);
+      rules +=
+         "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+         "<mappings>\n"
+         "  <hostMatch>\n"
+         "    <hostPattern>example.com</hostPattern>\n"
+         "    <userMatch>\n"
+         "      <userPattern>100</userPattern>\n"
+         "      <permissionMatch>\n"
+         "        <transform>\n"
+         "          <url>sip:100@target.example.com</url>\n"
+         "        </transform>\n"
+         "      </permissionMatch>\n"
+         "    </userMatch>\n"
+         "  </hostMatch>\n";
+
+      char rule[512];
+      for (int i = 0; rules.size() < BIG_MAPPING_RULES; i++)
+      {
+         snprintf(rule, sizeof(rule),
+                  "  <hostMatch>\n"
+                  "    <hostPattern>host%d.version%d.example.com</hostPattern>\n"
+                  "    <userMatch>\n"
+                  "      <userPattern>user%d</userPattern>\n"
+                  "      <permissionMatch>\n"
+                  "        <transform>\n"
+                  "          <url>sip:user%d@target%d.example.com</url>\n"
+                  "        </transform>\n"
+                  "      </permissionMatch>\n"
+                  "    </userMatch>\n"
+                  "  </hostMatch>\n",
+                  i, version, i, i, i);
+         rules += rule;
+      }
+      rules += "</mappings>\n";
+
+      // Replace the file as the configuration server does.
+      std::string newFileName(fileName + ".new");
+      writeFile(newFileName, rules);
+      rename(newFileName.c_str(), fileName.c_str());
+   }
+
+   // Lookups do not wait while the big mapping rules file is read again.
+   void testLookUpWhileReloading()
+   {
+      const int READERS = 2;
+      const int RELOADS = 4;
+      std::string fileName(workingFile("mappingrules.xml"));
+      writeBigMappingRules(fileName, 0);
+
+      // What it takes to read the file.
+      long long start = usecsSinceBoot();
+      delete readMappingRules(fileName);
+      long long parseUsecs = usecsSinceBoot() - start;
+
+      ConfigSnapshot<MappingRulesUrlMapping> map(&readMappingRules);
+      CPPUNIT_ASSERT(map.setFileName(fileName));
+
+      LookUp* lookUps[READERS];
+      boost::thread* threads[READERS];
+      for (int i = 0; i < READERS; i++)
+      {
+         lookUps[i] = new LookUp(map);
+         threads[i] = new boost::thread(boost::ref(*lookUps[i]));
+      }
+
+      int reloads = 0;
+      for (int version = 1; version <= RELOADS; version++)
+      {
+         ConfigSnapshot<MappingRulesUrlMapping>::Ptr before = map.get();
+         writeBigMappingRules(fileName, version);
+         if (waitForReload(map, before) != before)
+         {
+            reloads++;
+         }
+      }
+
+      long lookUpCount = 0;
+      long failures = 0;
+      long long maxUsecs = 0;
+      for (int i = 0; i < READERS; i++)
+      {
+         lookUps[i]->mStop = true;
+         threads[i]->join();
+         lookUpCount += lookUps[i]->mLookUps;
+         failures += lookUps[i]->mFailures;
+         if (lookUps[i]->mMaxUsecs > maxUsecs)
+         {
+            maxUsecs = lookUps[i]->mMaxUsecs;
+         }
+         delete threads[i];
+         delete lookUps[i];
+      }
+
+      printf("\nConfigSnapshotTest::testLookUpWhileReloading: "
+             "reading %d bytes takes %lld us; "
+             "%ld lookups during %d reloads took at most %lld us\n",
+             BIG_MAPPING_RULES, parseUsecs, lookUpCount, reloads, maxUsecs);
+
+      CPPUNIT_ASSERT_EQUAL(RELOADS, reloads);
+      CPPUNIT_ASSERT(lookUpCount > 0);
+      CPPUNIT_ASSERT_EQUAL(0L, failures);
+      // A lookup that waited for a reload would take as long as reading.
+      CPPUNIT_ASSERT(maxUsecs < parseUsecs / 2);
+   }
+
+private:
+
+   FileTestContext* mFileTestContext;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ConfigSnapshotTest);
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+// SYSTEM INCLUDES
+
+// APPLICATION INCLUDES
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <mongo/util/net/hostandport.h>
+#include <mongo/client/connpool.h>
+
+#include "net/HttpMessage.h"
+#include "utl/UtlMetrics.h"
+#include "sipdb/EntityDB.h"
+#include "sipdb/DigestCredentialCache.h"
+
+// DEFINES
+// CONSTANTS
+static const char* gCredentialTestNs = "test.DigestCredentialCacheTest";
+static const char* gOid = "entity-201";
+static const char* gUserId = "201";
+static const char* gIdentity = "201@example.com";
+static const char* gRealm = "example.com";
+static const char* gPassword = "secret";
+
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+class DigestCredentialCacheTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(DigestCredentialCacheTest);
+
+   CPPUNIT_TEST(testHit);
+   CPPUNIT_TEST(testMiss);
+   CPPUNIT_TEST(testInvalidateOnUpdate);
+   CPPUNIT_TEST(testInvalidateOnDelete);
+   CPPUNIT_TEST(testUserBase);
+   CPPUNIT_TEST(testByIdentity);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   DigestCredentialCacheTest() :
+      _info(MongoDB::ConnectionInfo(mongo::ConnectionString(mongo::HostAndPort("localhost"))))
+      {
+      }
+
+   void setUp()
+      {
+         MongoDB::ScopedDbConnectionPtr conn(
+            mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString()));
+         conn->get()->remove(gCredentialTestNs, mongo::Query());
+         conn->get()->insert(gCredentialTestNs,
+                             BSON(EntityRecord::oid_fld() << gOid <<
+                                  EntityRecord::userId_fld() << gUserId <<
+                                  EntityRecord::identity_fld() << gIdentity <<
+                                  EntityRecord::realm_fld() << gRealm <<
+                                  EntityRecord::password_fld() << gPassword <<
+                                  EntityRecord::authType_fld() << ""));
+         conn->done();
+      }
+
+   void tearDown()
+      {
+         MongoDB::ScopedDbConnectionPtr conn(
+            mongoMod::ScopedDbConnection::getScopedDbConnection(_info.getConnectionString().toString()));
+         conn->get()->remove(gCredentialTestNs, mongo::Query());
+         conn->done();
+      }
+
+   static UtlMetricCounter& lookups(bool hit)
+      {
+         return UtlMetrics::instance().counter("sipx_auth_credential_lookups_total",
+                                               "Digest credentials looked up, by whether they were cached",
+                                               hit ? "cache=\"hit\"" : "cache=\"miss\"");
+      }
+
+   static UtlString digest(const char* user)
+      {
+         UtlString ha1;
+         HttpMessage::buildMd5UserPasswordDigest(user, gRealm, gPassword, ha1);
+         return ha1;
+      }
+
+   // Look up the credentials of user, and count the hits and misses.
+   bool lookUp(DigestCredentialCache& cache,
+               const EntityDB& entityDb,
+               const char* user,
+               const char* userBase,
+               UtlString& ha1,
+               int& hits,
+               int& misses)
+      {
+         Int64 hitsBefore = lookups(true).getValue();
+         Int64 missesBefore = lookups(false).getValue();
+
+         Url uri;
+         UtlString authType;
+         bool found = cache.getCredential(entityDb, user, userBase, gRealm, uri, ha1, authType);
+
+         hits = (int) (lookups(true).getValue() - hitsBefore);
+         misses = (int) (lookups(false).getValue() - missesBefore);
+         return found;
+      }
+
+   void testHit()
+      {
+         EntityDB entityDb(_info, gCredentialTestNs);
+         DigestCredentialCache cache;
+         UtlString ha1;
+         int hits;
+         int misses;
+
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, hits);
+         CPPUNIT_ASSERT_EQUAL(0, misses);
+         ASSERT_STR_EQUAL(digest(gUserId).data(), ha1.data());
+      }
+
+   void testMiss()
+      {
+         EntityDB entityDb(_info, gCredentialTestNs);
+         DigestCredentialCache cache;
+         UtlString ha1;
+         int hits;
+         int misses;
+
+         // The first lookup reads the entity and digests its password.
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(0, hits);
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+         ASSERT_STR_EQUAL(digest(gUserId).data(), ha1.data());
+
+         // Users EntityDB does not have, or has in another realm, are not found.
+         CPPUNIT_ASSERT(!lookUp(cache, entityDb, "202", "202", ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+
+         Url uri;
+         UtlString authType;
+         CPPUNIT_ASSERT(!cache.getCredential(entityDb, gUserId, gUserId, "example.org",
+                                             uri, ha1, authType));
+      }
+
+   void testInvalidateOnUpdate()
+      {
+         EntityDB entityDb(_info, gCredentialTestNs);
+         DigestCredentialCache cache;
+         UtlString ha1;
+         int hits;
+         int misses;
+
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+
+         // An update of another entity leaves the credentials cached.
+         cache.onOpLogEntry(BSON("op" << "u" << "ns" << EntityDB::NS <<
+                                 "o2" << BSON(EntityRecord::oid_fld() << "entity-202") <<
+                                 "o" << BSON("$set" << BSON(EntityRecord::password_fld() << "other"))));
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, hits);
+
+         // An update of the entity they were computed from drops them.
+         cache.onOpLogEntry(BSON("op" << "u" << "ns" << EntityDB::NS <<
+                                 "o2" << BSON(EntityRecord::oid_fld() << gOid) <<
+                                 "o" << BSON("$set" << BSON(EntityRecord::password_fld() << "changed"))));
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(0, hits);
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+      }
+
+   void testInvalidateOnDelete()
+      {
+         EntityDB entityDb(_info, gCredentialTestNs);
+         DigestCredentialCache cache;
+         UtlString ha1;
+         int hits;
+         int misses;
+
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, "201~~in~phone", gUserId, ha1, hits, misses));
+
+         // A delete names the entity in "o", and drops all that was computed from it.
+         cache.onOpLogEntry(BSON("op" << "d" << "ns" << EntityDB::NS <<
+                                 "o" << BSON(EntityRecord::oid_fld() << gOid)));
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, "201~~in~phone", gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+
+         // An entry that does not name the entity drops everything.
+         cache.onOpLogEntry(BSON("op" << "n" << "ns" << EntityDB::NS));
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+      }
+
+   void testUserBase()
+      {
+         EntityDB entityDb(_info, gCredentialTestNs);
+         DigestCredentialCache cache;
+         UtlString ha1;
+         int hits;
+         int misses;
+
+         // An instrument user name is looked up by the userid of its entity,
+         // and its credentials are digested with its own name.
+         const char* instrument = "201~~in~phone";
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, instrument, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+         ASSERT_STR_EQUAL(digest(instrument).data(), ha1.data());
+
+         Url uri;
+         UtlString authType;
+         CPPUNIT_ASSERT(cache.getCredential(entityDb, instrument, gUserId, gRealm, uri, ha1, authType));
+         UtlString identity;
+         uri.getIdentity(identity);
+         ASSERT_STR_EQUAL(gIdentity, identity.data());
+
+         // It is cached apart from the plain user name.
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, gUserId, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, misses);
+         ASSERT_STR_EQUAL(digest(gUserId).data(), ha1.data());
+
+         CPPUNIT_ASSERT(lookUp(cache, entityDb, instrument, gUserId, ha1, hits, misses));
+         CPPUNIT_ASSERT_EQUAL(1, hits);
+         ASSERT_STR_EQUAL(digest(instrument).data(), ha1.data());
+      }
+
+   void testByIdentity()
+      {
+         EntityDB entityDb(_info, gCredentialTestNs);
+         DigestCredentialCache cache;
+         Url uri("sip:201@example.com");
+         UtlString userid;
+         UtlString ha1;
+         UtlString authType;
+
+         Int64 hitsBefore = lookups(true).getValue();
+         CPPUNIT_ASSERT(cache.getCredential(entityDb, uri, gUserId, gRealm, userid, ha1, authType));
+         ASSERT_STR_EQUAL(gUserId, userid.data());
+         ASSERT_STR_EQUAL(digest(gUserId).data(), ha1.data());
+
+         CPPUNIT_ASSERT(cache.getCredential(entityDb, uri, gUserId, gRealm, userid, ha1, authType));
+         CPPUNIT_ASSERT_EQUAL((Int64) 1, lookups(true).getValue() - hitsBefore);
+
+         // An address of record that no entity has is not found.
+         CPPUNIT_ASSERT(!cache.getCredential(entityDb, Url("sip:202@example.com"), "202", gRealm,
+                                             userid, ha1, authType));
+      }
+
+private:
+   const MongoDB::ConnectionInfo _info;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(DigestCredentialCacheTest);
@@ -0,0 +1,116 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+
+// APPLICATION INCLUDES
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include "sipXecsService/SipXecsService.h"
+#include "sipXecsService/SipNonceDb.h"
+
+// DEFINES
+// CONSTANTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+class SipNonceDbTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipNonceDbTest);
+
+   CPPUNIT_TEST(testValidate);
+   CPPUNIT_TEST(testValidateOtherServer);
+   CPPUNIT_TEST(testNonceCount);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   void setUp()
+      {
+         setenv(SipXecsService::ConfigurationDirType, TEST_DATA_DIR "/sharedsecret", true );
+      }
+
+   void tearDown()
+      {
+         unsetenv(SipXecsService::ConfigurationDirType);
+      }
+
+   void testValidate()
+      {
+         SipNonceDb nonceDb;
+         UtlString nonce;
+         nonceDb.createNewNonce("call-1", "tag-1", "example.com", nonce);
+
+         CPPUNIT_ASSERT(nonceDb.isNonceValid(nonce, "call-1", "tag-1", "example.com", 300));
+         // validated again, from the table
+         CPPUNIT_ASSERT(nonceDb.isNonceValid(nonce, "call-1", "tag-1", "example.com", 300));
+
+         // bound to the call
+         CPPUNIT_ASSERT(!nonceDb.isNonceValid(nonce, "call-2", "tag-1", "example.com", 300));
+         CPPUNIT_ASSERT(!nonceDb.isNonceValid(nonce, "call-1", "tag-2", "example.com", 300));
+         CPPUNIT_ASSERT(!nonceDb.isNonceValid(nonce, "call-1", "tag-1", "example.org", 300));
+
+         // expired
+         CPPUNIT_ASSERT(!nonceDb.isNonceValid(nonce, "call-1", "tag-1", "example.com", -1));
+
+         // malformed
+         CPPUNIT_ASSERT(!nonceDb.isNonceValid("abc", "call-1", "tag-1", "example.com", 300));
+      }
+
+   // A nonce created by another server of the cluster is checked by its signature.
+   void testValidateOtherServer()
+      {
+         SipNonceDb creator;
+         SipNonceDb validator;
+         UtlString nonce;
+         creator.createNewNonce("call-1", "tag-1", "example.com", nonce);
+
+         CPPUNIT_ASSERT(!validator.isNonceValid(nonce, "call-2", "tag-1", "example.com", 300));
+         CPPUNIT_ASSERT(validator.isNonceValid(nonce, "call-1", "tag-1", "example.com", 300));
+         CPPUNIT_ASSERT(validator.isNonceValid(nonce, "call-1", "tag-1", "example.com", 300));
+         CPPUNIT_ASSERT(!validator.isNonceValid(nonce, "call-2", "tag-1", "example.com", 300));
+
+         // a forged signature is refused
+         UtlString forged(nonce);
+         forged.replaceAt(0, forged(0) == '0' ? '1' : '0');
+         CPPUNIT_ASSERT(!validator.isNonceValid(forged, "call-1", "tag-1", "example.com", 300));
+      }
+
+   void testNonceCount()
+      {
+         SipNonceDb nonceDb;
+         UtlString nonce;
+         nonceDb.createNewNonce("call-1", "tag-1", "example.com", nonce);
+         CPPUNIT_ASSERT(nonceDb.isNonceValid(nonce, "call-1", "tag-1", "example.com", 300));
+
+         CPPUNIT_ASSERT(nonceDb.recordNonceCount(nonce, "00000001", "1 INVITE"));
+         // the same request again, e.g. spiraling
+         CPPUNIT_ASSERT(nonceDb.recordNonceCount(nonce, "00000001", "1 INVITE"));
+         // another request with a used nonce-count is a replay
+         CPPUNIT_ASSERT(!nonceDb.recordNonceCount(nonce, "00000001", "2 BYE"));
+
+         CPPUNIT_ASSERT(nonceDb.recordNonceCount(nonce, "00000003", "2 BYE"));
+         CPPUNIT_ASSERT(!nonceDb.recordNonceCount(nonce, "00000002", "3 BYE"));
+         CPPUNIT_ASSERT(nonceDb.recordNonceCount(nonce, "00000003", "2 BYE"));
+
+         // without qop there is no nonce-count to check
+         CPPUNIT_ASSERT(nonceDb.recordNonceCount(nonce, "", "4 INFO"));
+
+         CPPUNIT_ASSERT(!nonceDb.recordNonceCount(nonce, "0000000g", "5 INFO"));
+         CPPUNIT_ASSERT(!nonceDb.recordNonceCount(nonce, "00000000", "5 INFO"));
+
+         // counts are kept for each nonce
+         UtlString otherNonce;
+         nonceDb.createNewNonce("call-2", "tag-1", "example.com", otherNonce);
+         CPPUNIT_ASSERT(nonceDb.recordNonceCount(otherNonce, "00000001", "1 REGISTER"));
+      }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipNonceDbTest);
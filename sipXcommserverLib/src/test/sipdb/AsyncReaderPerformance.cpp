@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+// Rate at which one SIP thread finishes requests that each need a database
+// read, as the latency of the database rises.
+//
+// The database is a mock whose reads sleep for the given latency.  The SIP
+// thread takes REQUESTS requests (1000 by default) from its queue, like the
+// redirect server does, and for each one either
+//
+//    blocking  does the read itself, as SipRedirectorRegDB did, or
+//    async     queues it on an AsyncReader with THREADS threads (64 by
+//              default) and finishes the request when the resume message
+//              comes back on its queue, as SipRedirectorRegDB now does.
+//
+//    AsyncReaderPerformance [requests] [threads]
+//
+// For async it shows both the rate at which the SIP thread takes requests,
+// which is what every other request on that thread sees and stays flat, and
+// the rate at which the requests finish, which falls once the latency is
+// more than THREADS times the time the SIP thread needs per request, as the
+// readers are then all busy.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <sipdb/AsyncReader.h>
+
+#define DEFAULT_REQUESTS 1000
+#define DEFAULT_THREADS  64
+
+static const int latenciesMs[] = { 0, 1, 2, 5, 10, 20, 50 };
+
+// The queue of the SIP thread: new requests are positive, resumes negative.
+class Inbox
+{
+public:
+  void post(int message)
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _messages.push_back(message);
+    _posted.notify_one();
+  }
+
+  int take()
+  {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    while (_messages.empty())
+    {
+      _posted.wait(lock);
+    }
+    int message = _messages.front();
+    _messages.pop_front();
+    return message;
+  }
+
+private:
+  boost::mutex _mutex;
+  boost::condition_variable _posted;
+  std::deque<int> _messages;
+};
+
+static void slowRead(int latencyMs)
+{
+  if (latencyMs > 0)
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(latencyMs));
+  }
+}
+
+static void resume(Inbox* inbox, int request, AsyncReader::Status)
+{
+  inbox->post(-request);
+}
+
+static double seconds(const boost::posix_time::ptime& start)
+{
+  return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+static double runBlocking(int requests, int latencyMs)
+{
+  Inbox inbox;
+  for (int r = 1; r <= requests; r++)
+  {
+    inbox.post(r);
+  }
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  for (int finished = 0; finished < requests; finished++)
+  {
+    inbox.take();
+    slowRead(latencyMs);
+  }
+  return seconds(start);
+}
+
+static double runAsync(int requests, int latencyMs, unsigned int threads, double& taken)
+{
+  AsyncReader reader("performance", threads, requests);
+  Inbox inbox;
+  for (int r = 1; r <= requests; r++)
+  {
+    inbox.post(r);
+  }
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  int finished = 0;
+  while (finished < requests)
+  {
+    int message = inbox.take();
+    if (message > 0)
+    {
+      reader.read(boost::bind(slowRead, latencyMs),
+                  boost::bind(resume, &inbox, message, _1),
+                  0);
+      if (message == requests)
+      {
+        taken = seconds(start);
+      }
+    }
+    else
+    {
+      finished++;
+    }
+  }
+  return seconds(start);
+}
+
+int main(int argc, char* argv[])
+{
+  int requests = argc > 1 ? atoi(argv[1]) : DEFAULT_REQUESTS;
+  unsigned int threads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+
+  printf("%d requests, %u reader threads\n", requests, threads);
+  printf("%10s %16s %16s %16s\n", "latency", "blocking req/s", "async taken/s", "async done/s");
+  for (size_t i = 0; i < sizeof(latenciesMs) / sizeof(latenciesMs[0]); i++)
+  {
+    int latencyMs = latenciesMs[i];
+
+    // blocking at 50 ms takes a minute for 1000 requests; fewer show the same
+    int blockingRequests = latencyMs >= 10 ? requests / 10 : requests;
+    double blocking = runBlocking(blockingRequests, latencyMs);
+    double taken = 0;
+    double async = runAsync(requests, latencyMs, threads, taken);
+
+    printf("%8d ms %16.0f %16.0f %16.0f\n", latencyMs,
+           blocking > 0 ? blockingRequests / blocking : 0.0,
+           taken > 0 ? requests / taken : 0.0,
+           async > 0 ? requests / async : 0.0);
+  }
+
+  return 0;
+}
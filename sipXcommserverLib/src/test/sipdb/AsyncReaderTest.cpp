@@ -0,0 +1,203 @@
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <sipxunit/TestUtilities.h>
+#include <sipdb/AsyncReader.h>
+#include <boost/bind.hpp>
+#include <map>
+#include <stdexcept>
+
+
+using namespace std;
+
+// Collects the outcome of reads, and holds reads back until it is opened.
+class Outcomes
+{
+public:
+  Outcomes() : _open(false), _started(0)
+  {
+  }
+
+  void done(int read, AsyncReader::Status status)
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _status[read] = status;
+    _changed.notify_all();
+  }
+
+  // A read that waits until open() is called
+  void gate()
+  {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    _started++;
+    _changed.notify_all();
+    while (!_open)
+    {
+      _changed.wait(lock);
+    }
+  }
+
+  void open()
+  {
+    boost::lock_guard<boost::mutex> lock(_mutex);
+    _open = true;
+    _changed.notify_all();
+  }
+
+  void openLater()
+  {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    open();
+  }
+
+  // Wait until n gates have been entered
+  bool waitStarted(int n)
+  {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds(5);
+    while (_started < n)
+    {
+      if (!_changed.timed_wait(lock, timeout))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Wait for the outcome of a read, -1 if it does not come
+  int wait(int read)
+  {
+    boost::unique_lock<boost::mutex> lock(_mutex);
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::seconds(5);
+    while (_status.find(read) == _status.end())
+    {
+      if (!_changed.timed_wait(lock, timeout))
+      {
+        return -1;
+      }
+    }
+    return _status[read];
+  }
+
+private:
+  boost::mutex _mutex;
+  boost::condition_variable _changed;
+  std::map<int, AsyncReader::Status> _status;
+  bool _open;
+  int _started;
+};
+
+static void setFlag(bool* flag)
+{
+  *flag = true;
+}
+
+static void fail()
+{
+  throw std::runtime_error("test failure");
+}
+
+class AsyncReaderTest: public CppUnit::TestCase
+{
+  CPPUNIT_TEST_SUITE(AsyncReaderTest);
+  CPPUNIT_TEST(testRead);
+  CPPUNIT_TEST(testReadFailed);
+  CPPUNIT_TEST(testReadExpired);
+  CPPUNIT_TEST(testQueueFull);
+  CPPUNIT_TEST(testDestroyPending);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void testRead()
+  {
+    AsyncReader reader("test");
+    Outcomes outcomes;
+    bool wasRead = false;
+
+    CPPUNIT_ASSERT(reader.read(boost::bind(setFlag, &wasRead),
+                               boost::bind(&Outcomes::done, &outcomes, 1, _1),
+                               1000));
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_DONE, outcomes.wait(1));
+    CPPUNIT_ASSERT(wasRead);
+    CPPUNIT_ASSERT_EQUAL((unsigned int) AsyncReader::DEFAULT_THREADS, reader.getThreads());
+  }
+
+  void testReadFailed()
+  {
+    AsyncReader reader("test");
+    Outcomes outcomes;
+
+    CPPUNIT_ASSERT(reader.read(fail, boost::bind(&Outcomes::done, &outcomes, 1, _1), 1000));
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_FAILED, outcomes.wait(1));
+  }
+
+  void testReadExpired()
+  {
+    AsyncReader reader("test", 1);
+    Outcomes outcomes;
+    bool wasRead = false;
+
+    // the only reader thread is busy until the second read has expired
+    CPPUNIT_ASSERT(reader.read(boost::bind(&Outcomes::gate, &outcomes),
+                               boost::bind(&Outcomes::done, &outcomes, 1, _1),
+                               1000));
+    CPPUNIT_ASSERT(outcomes.waitStarted(1));
+    CPPUNIT_ASSERT(reader.read(boost::bind(setFlag, &wasRead),
+                               boost::bind(&Outcomes::done, &outcomes, 2, _1),
+                               10));
+    boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+    outcomes.open();
+
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_DONE, outcomes.wait(1));
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_EXPIRED, outcomes.wait(2));
+    CPPUNIT_ASSERT(!wasRead);
+  }
+
+  void testQueueFull()
+  {
+    AsyncReader reader("test", 1, 1);
+    Outcomes outcomes;
+
+    CPPUNIT_ASSERT(reader.read(boost::bind(&Outcomes::gate, &outcomes),
+                               boost::bind(&Outcomes::done, &outcomes, 1, _1),
+                               5000));
+    CPPUNIT_ASSERT(outcomes.waitStarted(1));
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, reader.getPending());
+
+    CPPUNIT_ASSERT(reader.read(boost::bind(&Outcomes::gate, &outcomes),
+                               boost::bind(&Outcomes::done, &outcomes, 2, _1),
+                               5000));
+    CPPUNIT_ASSERT_EQUAL((size_t) 1, reader.getPending());
+    CPPUNIT_ASSERT(!reader.read(boost::bind(&Outcomes::gate, &outcomes),
+                                boost::bind(&Outcomes::done, &outcomes, 3, _1),
+                                5000));
+
+    outcomes.open();
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_DONE, outcomes.wait(1));
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_DONE, outcomes.wait(2));
+  }
+
+  void testDestroyPending()
+  {
+    Outcomes outcomes;
+    boost::thread opener;
+    {
+      AsyncReader reader("test", 1);
+      CPPUNIT_ASSERT(reader.read(boost::bind(&Outcomes::gate, &outcomes),
+                                 boost::bind(&Outcomes::done, &outcomes, 1, _1),
+                                 5000));
+      CPPUNIT_ASSERT(outcomes.waitStarted(1));
+      CPPUNIT_ASSERT(reader.read(boost::bind(&Outcomes::gate, &outcomes),
+                                 boost::bind(&Outcomes::done, &outcomes, 2, _1),
+                                 5000));
+
+      // let the first read finish once the reader is being destroyed
+      boost::thread(boost::bind(&Outcomes::openLater, &outcomes)).swap(opener);
+    }
+    opener.join();
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_DONE, outcomes.wait(1));
+    CPPUNIT_ASSERT_EQUAL((int) AsyncReader::READ_FAILED, outcomes.wait(2));
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(AsyncReaderTest);
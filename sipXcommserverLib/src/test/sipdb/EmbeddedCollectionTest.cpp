@@ -0,0 +1,220 @@
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <sipxunit/TestUtilities.h>
+#include <sipdb/EmbeddedCollection.h>
+#include <boost/bind.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+
+class EmbeddedCollectionTest: public CppUnit::TestCase
+{
+  CPPUNIT_TEST_SUITE(EmbeddedCollectionTest);
+  CPPUNIT_TEST(testPutFindErase);
+  CPPUNIT_TEST(testUpdate);
+  CPPUNIT_TEST(testEraseIf);
+  CPPUNIT_TEST(testJournal_Reopen);
+  CPPUNIT_TEST(testJournal_Shared);
+  CPPUNIT_TEST(testJournal_Compact);
+  CPPUNIT_TEST(testJournal_DamagedTail);
+  CPPUNIT_TEST_SUITE_END();
+
+  string _directory;
+  vector<string> _indexes;
+
+public:
+  void setUp()
+  {
+    char directory[] = "/tmp/EmbeddedCollectionTest.XXXXXX";
+    CPPUNIT_ASSERT(mkdtemp(directory));
+    _directory = directory;
+
+    _indexes.clear();
+    _indexes.push_back("identity");
+  }
+
+  void tearDown()
+  {
+    unlink(journal().c_str());
+    unlink((journal() + ".compact").c_str());
+    rmdir(_directory.c_str());
+  }
+
+  string journal() const
+  {
+    return _directory + "/node.test.journal";
+  }
+
+  static mongo::BSONObj binding(const char* identity, const char* contact, int expires)
+  {
+    return BSON("identity" << identity << "contact" << contact << "expirationTime" << expires);
+  }
+
+  static bool expiresBy(const mongo::BSONObj& bson, int time)
+  {
+    return bson.getIntField("expirationTime") <= time;
+  }
+
+  void testPutFindErase()
+  {
+    EmbeddedCollection collection("", _indexes);
+    collection.put("alice\nhost1", binding("alice", "sip:alice@host1", 100));
+    collection.put("alice\nhost2", binding("alice", "sip:alice@host2", 200));
+    collection.put("bob\nhost1", binding("bob", "sip:bob@host1", 300));
+
+    EmbeddedCollection::Documents documents;
+    collection.find("identity", "alice", documents);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, documents.size());
+
+    // not indexed, so scanned
+    documents.clear();
+    collection.find("contact", "sip:bob@host1", documents);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, documents.size());
+
+    collection.erase("alice\nhost1");
+    documents.clear();
+    collection.find("identity", "alice", documents);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, documents.size());
+    CPPUNIT_ASSERT_EQUAL(string("sip:alice@host2"), string(documents[0].getStringField("contact")));
+
+    // replacing a document moves it in the index
+    collection.put("alice\nhost2", binding("carol", "sip:alice@host2", 200));
+    documents.clear();
+    collection.find("identity", "alice", documents);
+    CPPUNIT_ASSERT(documents.empty());
+    collection.find("identity", "carol", documents);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, documents.size());
+
+    collection.clear();
+    CPPUNIT_ASSERT_EQUAL((size_t)0, collection.size());
+  }
+
+  void testUpdate()
+  {
+    EmbeddedCollection collection("", _indexes);
+    CPPUNIT_ASSERT(!collection.update("alice\nhost1", BSON("expirationTime" << 100), false));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, collection.size());
+
+    CPPUNIT_ASSERT(collection.update("alice\nhost1", binding("alice", "sip:alice@host1", 100), true));
+    CPPUNIT_ASSERT(collection.update("alice\nhost1", BSON("expirationTime" << 500), false));
+
+    mongo::BSONObj document;
+    CPPUNIT_ASSERT(collection.get("alice\nhost1", document));
+    CPPUNIT_ASSERT_EQUAL(500, document.getIntField("expirationTime"));
+    CPPUNIT_ASSERT_EQUAL(string("sip:alice@host1"), string(document.getStringField("contact")));
+  }
+
+  void testEraseIf()
+  {
+    EmbeddedCollection collection("", _indexes);
+    collection.put("alice\nhost1", binding("alice", "sip:alice@host1", 100));
+    collection.put("alice\nhost2", binding("alice", "sip:alice@host2", 200));
+    collection.put("bob\nhost1", binding("bob", "sip:bob@host1", 300));
+
+    CPPUNIT_ASSERT(!collection.eraseIf("bob\nhost1", boost::bind(&expiresBy, _1, 250)));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, collection.eraseIf(boost::bind(&expiresBy, _1, 250)));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, collection.size());
+    CPPUNIT_ASSERT(collection.eraseIf("bob\nhost1", boost::bind(&expiresBy, _1, 300)));
+    CPPUNIT_ASSERT_EQUAL((size_t)0, collection.size());
+  }
+
+  void testJournal_Reopen()
+  {
+    {
+      EmbeddedCollection collection(journal(), _indexes);
+      collection.put("alice\nhost1", binding("alice", "sip:alice@host1", 100));
+      collection.put("alice\nhost2", binding("alice", "sip:alice@host2", 200));
+      collection.erase("alice\nhost1");
+    }
+
+    EmbeddedCollection collection(journal(), _indexes);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, collection.size());
+
+    EmbeddedCollection::Documents documents;
+    collection.find("identity", "alice", documents);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, documents.size());
+    CPPUNIT_ASSERT_EQUAL(200, documents[0].getIntField("expirationTime"));
+  }
+
+  void testJournal_Shared()
+  {
+    // as the registrar and the proxy do, from two processes
+    EmbeddedCollection writer(journal(), _indexes);
+    EmbeddedCollection reader(journal(), _indexes);
+
+    writer.put("alice\nhost1", binding("alice", "sip:alice@host1", 100));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, reader.size());
+
+    reader.erase("alice\nhost1");
+    CPPUNIT_ASSERT_EQUAL((size_t)0, writer.size());
+  }
+
+  void testJournal_Compact()
+  {
+    EmbeddedCollection reader(journal(), _indexes);
+    {
+      EmbeddedCollection writer(journal(), _indexes);
+
+      // refreshing the same binding fills the default journal several times over
+      char contact[64];
+      for (int i = 0; i < 200000; i++)
+      {
+        snprintf(contact, sizeof(contact), "sip:alice@host%d", i % 10);
+        writer.put(string("alice\n") + contact,
+                   BSON("identity" << "alice" << "contact" << contact << "expirationTime" << i
+                        << "padding" << string(300, 'x')));
+      }
+      CPPUNIT_ASSERT_EQUAL((size_t)10, writer.size());
+    }
+
+    CPPUNIT_ASSERT_EQUAL((size_t)10, reader.size());
+
+    struct stat status;
+    CPPUNIT_ASSERT_EQUAL(0, stat(journal().c_str(), &status));
+    CPPUNIT_ASSERT((size_t)status.st_size <= MappedJournal::DEFAULT_CAPACITY);
+
+    EmbeddedCollection reopened(journal(), _indexes);
+    CPPUNIT_ASSERT_EQUAL((size_t)10, reopened.size());
+  }
+
+  void testJournal_DamagedTail()
+  {
+    {
+      EmbeddedCollection collection(journal(), _indexes);
+      collection.put("alice\nhost1", binding("alice", "sip:alice@host1", 100));
+      collection.put("alice\nhost2", binding("alice", "sip:alice@host2", 200));
+    }
+
+    // flip a byte of the last record, as a write the host did not finish
+    mongo::BSONObj last = binding("alice", "sip:alice@host2", 200);
+    int fd = open(journal().c_str(), O_RDWR);
+    CPPUNIT_ASSERT(fd >= 0);
+    char buffer[4096];
+    ssize_t length = pread(fd, buffer, sizeof(buffer), 0);
+    CPPUNIT_ASSERT(length > 0);
+    char* found = (char*) memmem(buffer, length, last.objdata(), last.objsize());
+    CPPUNIT_ASSERT(found);
+    found[last.objsize() - 2] ^= 0xff;
+    CPPUNIT_ASSERT_EQUAL((ssize_t)1, pwrite(fd, found + last.objsize() - 2, 1, found + last.objsize() - 2 - buffer));
+    close(fd);
+
+    EmbeddedCollection collection(journal(), _indexes);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, collection.size());
+
+    mongo::BSONObj document;
+    CPPUNIT_ASSERT(collection.get("alice\nhost1", document));
+
+    // and appends after it are kept
+    collection.put("bob\nhost1", binding("bob", "sip:bob@host1", 300));
+    EmbeddedCollection reopened(journal(), _indexes);
+    CPPUNIT_ASSERT_EQUAL((size_t)2, reopened.size());
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EmbeddedCollectionTest);
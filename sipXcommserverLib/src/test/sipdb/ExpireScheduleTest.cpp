@@ -0,0 +1,137 @@
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <sipxunit/TestUtilities.h>
+#include <sipdb/ExpireSchedule.h>
+#include <boost/bind.hpp>
+
+
+using namespace std;
+
+class ExpireScheduleTest: public CppUnit::TestCase
+{
+  CPPUNIT_TEST_SUITE(ExpireScheduleTest);
+  CPPUNIT_TEST(testPopExpired_Order);
+  CPPUNIT_TEST(testPopExpired_Batch);
+  CPPUNIT_TEST(testSchedule_Refresh);
+  CPPUNIT_TEST(testUnscheduleIdentity);
+  CPPUNIT_TEST(testHeadChangedCallback);
+  CPPUNIT_TEST_SUITE_END();
+
+  unsigned long _lastHead;
+  int _headChanges;
+
+public:
+  void setUp()
+  {
+    _lastHead = 0;
+    _headChanges = 0;
+  }
+
+  void onHeadChanged(unsigned long expirationTime)
+  {
+    _lastHead = expirationTime;
+    _headChanges++;
+  }
+
+  static ExpireSchedule::Entry entry(const char* identity, const char* contact, unsigned long expirationTime)
+  {
+    ExpireSchedule::Entry e;
+    e.key = ExpireSchedule::makeKey(identity, contact);
+    e.identity = identity;
+    e.expirationTime = expirationTime;
+    return e;
+  }
+
+  void testPopExpired_Order()
+  {
+    ExpireSchedule schedule;
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host1", 300));
+    schedule.schedule(entry("bob@atlanta.com", "sip:bob@host1", 100));
+    schedule.schedule(entry("carol@atlanta.com", "sip:carol@host1", 200));
+
+    unsigned long next = 0;
+    CPPUNIT_ASSERT(schedule.getNextExpirationTime(next));
+    CPPUNIT_ASSERT_EQUAL(100UL, next);
+
+    ExpireSchedule::Entries expired;
+    CPPUNIT_ASSERT(!schedule.popExpired(250, 10, expired));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, expired.size());
+    CPPUNIT_ASSERT_EQUAL(string("bob@atlanta.com"), expired[0].identity);
+    CPPUNIT_ASSERT_EQUAL(string("carol@atlanta.com"), expired[1].identity);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, schedule.size());
+  }
+
+  void testPopExpired_Batch()
+  {
+    ExpireSchedule schedule;
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host1", 100));
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host2", 100));
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host3", 100));
+
+    ExpireSchedule::Entries expired;
+    CPPUNIT_ASSERT(schedule.popExpired(100, 2, expired));
+    CPPUNIT_ASSERT_EQUAL((size_t)2, expired.size());
+
+    expired.clear();
+    CPPUNIT_ASSERT(!schedule.popExpired(100, 2, expired));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, expired.size());
+    CPPUNIT_ASSERT_EQUAL((size_t)0, schedule.size());
+  }
+
+  void testSchedule_Refresh()
+  {
+    ExpireSchedule schedule;
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host1", 100));
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host1", 500));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, schedule.size());
+
+    // the superseded expiration must not fire
+    ExpireSchedule::Entries expired;
+    CPPUNIT_ASSERT(!schedule.popExpired(200, 10, expired));
+    CPPUNIT_ASSERT(expired.empty());
+
+    unsigned long next = 0;
+    CPPUNIT_ASSERT(schedule.getNextExpirationTime(next));
+    CPPUNIT_ASSERT_EQUAL(500UL, next);
+
+    CPPUNIT_ASSERT(!schedule.popExpired(500, 10, expired));
+    CPPUNIT_ASSERT_EQUAL((size_t)1, expired.size());
+    CPPUNIT_ASSERT(!schedule.getNextExpirationTime(next));
+  }
+
+  void testUnscheduleIdentity()
+  {
+    ExpireSchedule schedule;
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host1", 100));
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host2", 100));
+    schedule.schedule(entry("alice@atlanta.com.au", "sip:alice@host3", 100));
+
+    schedule.unscheduleIdentity("alice@atlanta.com");
+    CPPUNIT_ASSERT_EQUAL((size_t)1, schedule.size());
+
+    ExpireSchedule::Entries expired;
+    schedule.popExpired(100, 10, expired);
+    CPPUNIT_ASSERT_EQUAL((size_t)1, expired.size());
+    CPPUNIT_ASSERT_EQUAL(string("alice@atlanta.com.au"), expired[0].identity);
+  }
+
+  void testHeadChangedCallback()
+  {
+    ExpireSchedule schedule;
+    schedule.setHeadChangedCallback(boost::bind(&ExpireScheduleTest::onHeadChanged, this, _1));
+
+    schedule.schedule(entry("alice@atlanta.com", "sip:alice@host1", 300));
+    CPPUNIT_ASSERT_EQUAL(1, _headChanges);
+    CPPUNIT_ASSERT_EQUAL(300UL, _lastHead);
+
+    // a later expiration does not move the head
+    schedule.schedule(entry("bob@atlanta.com", "sip:bob@host1", 400));
+    CPPUNIT_ASSERT_EQUAL(1, _headChanges);
+
+    schedule.schedule(entry("carol@atlanta.com", "sip:carol@host1", 200));
+    CPPUNIT_ASSERT_EQUAL(2, _headChanges);
+    CPPUNIT_ASSERT_EQUAL(200UL, _lastHead);
+  }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ExpireScheduleTest);
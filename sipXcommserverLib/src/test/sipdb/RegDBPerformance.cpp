@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2012 eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+// Latency of binding updates and lookups through RegDB, for each storage.
+//
+// USERS users (1000 by default) register CONTACTS contacts each (2 by
+// default), then every user refreshes its contacts and every user is looked
+// up as the proxy does when routing a call to it.  The bindings are written
+// to
+//
+//    embedded  the embedded storage, journaled in a temporary directory, and
+//    mongo     the mongod at MONGO (e.g. localhost:27017), if one is given,
+//              in the test.RegDBPerformance collection.
+//
+//    RegDBPerformance [users] [contacts] [mongo]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <os/OsDateTime.h>
+#include <sipdb/RegDB.h>
+
+#define DEFAULT_USERS    1000
+#define DEFAULT_CONTACTS 2
+
+static double seconds(const boost::posix_time::ptime& start)
+{
+  return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+}
+
+static std::string identity(int user)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "user%d@example.com", user);
+  return buffer;
+}
+
+static void updateAll(RegDB& db, int users, int contacts, unsigned int cseq, unsigned long expirationTime)
+{
+  char contact[128];
+  for (int user = 0; user < users; user++)
+  {
+    for (int c = 0; c < contacts; c++)
+    {
+      snprintf(contact, sizeof(contact), "<sip:user%d@10.1.%d.%d:5060>", user, c, user % 250);
+
+      RegBinding binding;
+      binding.setIdentity(identity(user));
+      binding.setUri("sip:" + identity(user));
+      binding.setContact(contact);
+      binding.setBinding(contact);
+      binding.setCallId(identity(user) + "-call");
+      binding.setCseq(cseq);
+      binding.setQvalue("1.0");
+      binding.setExpirationTime(expirationTime);
+      binding.setInstrument("");
+      db.updateBinding(binding);
+    }
+  }
+}
+
+static void run(const char* name, RegDB& db, int users, int contacts)
+{
+  unsigned long timeNow = OsDateTime::getSecsSinceEpoch();
+  int updates = users * contacts;
+
+  db.clearAllBindings();
+
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  updateAll(db, users, contacts, 1, timeNow + 3600);
+  double registered = seconds(start);
+
+  start = boost::posix_time::microsec_clock::universal_time();
+  updateAll(db, users, contacts, 2, timeNow + 3600);
+  double refreshed = seconds(start);
+
+  start = boost::posix_time::microsec_clock::universal_time();
+  size_t found = 0;
+  for (int user = 0; user < users; user++)
+  {
+    RegDB::Bindings bindings;
+    db.getUnexpiredContactsUser(identity(user), timeNow, bindings);
+    found += bindings.size();
+  }
+  double lookedUp = seconds(start);
+
+  printf("%10s %14.1f %14.1f %14.1f %10zu\n", name,
+         registered * 1e6 / updates,
+         refreshed * 1e6 / updates,
+         lookedUp * 1e6 / users,
+         found);
+
+  db.clearAllBindings();
+}
+
+int main(int argc, char* argv[])
+{
+  int users = argc > 1 ? atoi(argv[1]) : DEFAULT_USERS;
+  int contacts = argc > 2 ? atoi(argv[2]) : DEFAULT_CONTACTS;
+  const char* mongo = argc > 3 ? argv[3] : NULL;
+
+  printf("%d users, %d contacts each\n", users, contacts);
+  printf("%10s %14s %14s %14s %10s\n", "storage", "register us", "refresh us", "lookup us", "found");
+
+  char directory[] = "/tmp/RegDBPerformance.XXXXXX";
+  if (!mkdtemp(directory))
+  {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  {
+    MongoDB::ConnectionInfo info;
+    info.setEmbeddedStorage(true, directory);
+    RegDB db(info, NULL, "test.RegDBPerformance");
+    run("embedded", db, users, contacts);
+  }
+  unlink((std::string(directory) + "/test.RegDBPerformance.journal").c_str());
+  rmdir(directory);
+
+  if (mongo)
+  {
+    std::string errmsg;
+    mongo::ConnectionString connectionString = mongo::ConnectionString::parse(mongo, errmsg);
+    if (!connectionString.isValid())
+    {
+      fprintf(stderr, "%s: %s\n", mongo, errmsg.c_str());
+      return 1;
+    }
+
+    MongoDB::ConnectionInfo info(connectionString);
+    RegDB db(info, NULL, "test.RegDBPerformance");
+    run("mongo", db, users, contacts);
+  }
+
+  return 0;
+}
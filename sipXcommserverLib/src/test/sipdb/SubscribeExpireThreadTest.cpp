@@ -9,6 +9,8 @@
 #include <mongo/client/connpool.h>
 
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 #include "MongoDbVerifier.h"
 
@@ -88,6 +90,7 @@ class SubscribeExpireThreadTest: public CppUnit::TestCase
 {
   CPPUNIT_TEST_SUITE(SubscribeExpireThreadTest);
   CPPUNIT_TEST(testSubscribeExpireThread_Run);
+  CPPUNIT_TEST(testSubscribeExpireThread_Handler);
   CPPUNIT_TEST_SUITE_END();
 
   SubscribeDB* _db;
@@ -95,6 +98,10 @@ class SubscribeExpireThreadTest: public CppUnit::TestCase
   int _timeNow;
   const std::string _databaseName;
   int MAX_SECONDS_TO_WAIT;
+
+  boost::mutex _expiredMutex;
+  SubscribeDB::Subscriptions _expired;
+  std::vector<std::size_t> _storedWhenExpired;
 public:
   SubscribeExpireThreadTest() : _info(MongoDB::ConnectionInfo(mongo::ConnectionString(mongo::HostAndPort(gLocalHostAddr)))),
                                 _databaseName(gDatabaseName)
@@ -192,6 +199,51 @@ public:
     // TEST: Check that the number of entries in test.RegExpireThreadTest database is one
     CPPUNIT_ASSERT(subscriptions.size() == 1);
   }
+
+  void onExpired(Subscription& subscription)
+  {
+    SubscribeDB::Subscriptions stored;
+    _db->getAll(stored);
+
+    boost::mutex::scoped_lock lock(_expiredMutex);
+    _expired.push_back(subscription);
+    _storedWhenExpired.push_back(stored.size());
+  }
+
+  std::size_t expiredCount()
+  {
+    boost::mutex::scoped_lock lock(_expiredMutex);
+    return _expired.size();
+  }
+
+  void testSubscribeExpireThread_Handler()
+  {
+    upsertSubscriptionTestData(0);
+
+    // create a new Subscription entry that will expire in 2 seconds
+    upsertSubscriptionTestData(1);
+
+    SubscribeExpireThread subscribeExpireThread;
+    subscribeExpireThread.setExpireHandler(boost::bind(&SubscribeExpireThreadTest::onExpired, this, _1));
+    subscribeExpireThread.run(_db, 2);
+
+    int seconds = 0;
+    while (expiredCount() == 0 && seconds < MAX_SECONDS_TO_WAIT)
+    {
+      sleep(1);
+      seconds++;
+    }
+
+    // TEST: The handler got the whole subscription that expired, while it was still stored
+    boost::mutex::scoped_lock lock(_expiredMutex);
+    CPPUNIT_ASSERT_EQUAL((std::size_t) 1, _expired.size());
+    Subscription& expired = _expired[0];
+    ASSERT_STR_EQUAL(subscriptionTestData[1].pCallId, expired.callId().c_str());
+    ASSERT_STR_EQUAL(subscriptionTestData[1].pContact, expired.contact().c_str());
+    ASSERT_STR_EQUAL(subscriptionTestData[1].pRecordRoute, expired.recordRoute().c_str());
+    CPPUNIT_ASSERT_EQUAL((int) subscriptionTestData[1].notifyCseq, (int) expired.notifyCseq());
+    CPPUNIT_ASSERT_EQUAL((std::size_t) 2, _storedWhenExpired[0]);
+  }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(SubscribeExpireThreadTest);
@@ -18,10 +18,10 @@
 #define DIALOGCOLLATOR_H_
 
 #include "DialogEventCollator/DialogInfo.h"
+#include "DialogEventCollator/DialogStore.h"
 
 #include <boost/noncopyable.hpp>
 #include <boost/unordered_map.hpp>
-#include <OSS/Persistent/RedisClient.h>
 #include <vector>
 #include <map>
 
@@ -39,7 +39,8 @@ public:
   DialogCollator();
   ~DialogCollator();
 
-  bool connect(const std::string& password = "", int db = 0);
+  bool connect(const std::string& password = "", int db = 0
+      , const std::string& host = "127.0.0.1", int port = 6379);
   void disconnect();
 
   bool collateLocalPayloads(const std::string & user, const std::string & domain
@@ -66,16 +67,31 @@ public:
   
   void flushDialog(const std::string & user, const std::string & domain);
 
+  /**
+   * Write the dialog states changed since the last commit to Redis in
+   * a single pipeline and drop the cached remote state.
+   */
+  bool commitDialogs();
+
 private:
+  typedef boost::unordered_map<std::string, DialogInfo> RemoteDialogs;
+
   std::string generateKey(const std::string & user, const std::string & domain, const Dialog & dialog);
-  
-  bool setDialogInfo(const std::string & key, const DialogInfo & dialogInfo);
-  bool getDialogInfo(const std::string & key, DialogInfo & dialogInfo);
-  bool getAllDialogInfo(const std::string & user, const std::string & domain, std::vector<json::Object> & dialogInfos);
+  std::string generateIndexKey(const std::string & user, const std::string & domain);
+
+  bool loadDialogs(const std::string & user, const std::string & domain);
+  bool setDialogInfo(const std::string & user, const std::string & domain, const DialogInfo & dialogInfo);
+  bool getDialogInfo(const std::string & user, const std::string & domain, const Dialog & dialog, DialogInfo & dialogInfo);
   bool getAllDialogInfo(const std::string & user, const std::string & domain, CollatedDialogs & dialogInfos);
-    
+
 private:
-    OSS::RedisClient _redisClient;
+  DialogStore _store;
+
+  // Remote state of the user being collated, read once per pass
+  std::string _indexKey;
+  RemoteDialogs _remoteDialogs;
+  DialogStore::Fields _modifiedDialogs;
+  std::vector<std::string> _expiredDialogs;
 };
 
 } } } // SIPX::Kamailio::Plugin
@@ -21,6 +21,7 @@
 #include "OSS/JSON/writer.h"
 #include "OSS/JSON/elements.h"
 
+#include <ctime>
 #include <string>
 #include <list>
 
@@ -78,6 +79,14 @@ bool maskDialogInfoXMLVersion(std::string & xml);
 bool mergeDialogInfoXMLDialog(std::string & xml, const DialogInfo & rdialogInfo);
 bool updateDialogInfoXMLState(std::string & xml, const std::string & state);
 
+/**
+ * Compact binary form of a DialogInfo as stored in Redis: a format byte,
+ * the time of the last update and every string field prefixed by its
+ * varint encoded length.  Decoding rejects truncated or unknown records.
+ */
+void encodeDialogInfo(const DialogInfo & dialogInfo, std::time_t updated, std::string & buffer);
+bool decodeDialogInfo(const std::string & buffer, DialogInfo & dialogInfo, std::time_t & updated);
+
 } } } // SIPX::Kamailio::Plugin
 
 
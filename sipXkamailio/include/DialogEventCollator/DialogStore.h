@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015 SIPfoundry, Inc. All rights reserved.
+ *
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef _DIALOGSTORE_H_
+#define _DIALOGSTORE_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+#include <string>
+#include <vector>
+
+struct redisContext;
+struct redisReply;
+
+namespace SIPX {
+namespace Kamailio {
+namespace Plugin {
+
+/**
+ * Minimal Redis access for the dialog collator.
+ *
+ * Dialogs of a user are kept as the fields of a single hash, so reading
+ * them all is one HGETALL instead of a KEYS scan over the whole keyspace.
+ * Writes are queued with append() and sent in one pipeline by flush().
+ */
+class DialogStore : boost::noncopyable
+{
+public:
+  typedef std::vector<std::string> Command;
+  typedef boost::unordered_map<std::string, std::string> Fields;
+
+public:
+  DialogStore();
+  ~DialogStore();
+
+  bool connect(const std::string& host, int port, const std::string& password = "", int db = 0);
+  void disconnect();
+  bool isConnected() const { return _context != 0; }
+
+  /// HGETALL key
+  bool getAll(const std::string& key, Fields& fields);
+
+  /// DEL key
+  bool remove(const std::string& key);
+
+  /// Queue a command for the next flush()
+  void append(const Command& command);
+
+  /// Number of queued commands
+  std::size_t pending() const { return _pipeline.size(); }
+
+  /// Send all queued commands in one write and read back their replies.
+  /// Returns false if any of them failed.
+  bool flush();
+
+private:
+  bool reconnect();
+  redisReply* execute(const Command& command);
+  bool appendCommand(const Command& command);
+
+  redisContext* _context;
+  std::string _host;
+  int _port;
+  std::string _password;
+  int _db;
+  std::vector<Command> _pipeline;
+};
+
+} } } // SIPX::Kamailio::Plugin
+
+#endif  /* _DIALOGSTORE_H_ */
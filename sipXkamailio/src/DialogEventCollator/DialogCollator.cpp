@@ -17,6 +17,8 @@
 #include "DialogEventCollator/DialogCollator.h"
 #include <boost/unordered_map.hpp>
 #include <OSS/UTL/Logger.h>
+#include <ctime>
+#include <sstream>
 #include <vector>
 #include <map>
 
@@ -30,6 +32,12 @@
  */
 #define ENABLE_MOH_FILTER = 1
 
+/*
+ * Dialog states are kept for an hour after their last update, both per
+ * dialog (tracked in the stored record) and for the whole user hash.
+ */
+#define DIALOG_EXPIRES_SEC 3600
+
 namespace SIPX {
 namespace Kamailio {
 namespace Plugin {
@@ -44,16 +52,16 @@ DialogCollator::~DialogCollator()
      
 }
 
-bool DialogCollator::connect(const std::string& password, int db)
+bool DialogCollator::connect(const std::string& password, int db, const std::string& host, int port)
 {
   OSS_LOG_INFO("[DialogCollator] Connecting to Redis Server.");
-  return _redisClient.connect(password, db);
+  return _store.connect(host, port, password, db);
 }
 
 void DialogCollator::disconnect()
 {
   OSS_LOG_INFO("[DialogCollator] Disconnecting to Redis Server.");
-  _redisClient.disconnect();
+  _store.disconnect();
 }
 
 /*
@@ -143,13 +151,13 @@ bool DialogCollator::collateRemotePayloads(const std::string & user, const std::
       DialogInfo currentDialogInfo;
 
       std::string key = generateKey(user, domain, iter->dialog);
-      if(getDialogInfo(key, currentDialogInfo))
+      if(getDialogInfo(user, domain, iter->dialog, currentDialogInfo))
       {
         if(compareDialogByState(iter->dialog, currentDialogInfo.dialog) >= 0)
         {
             OSS_LOG_INFO("[DialogCollator] Collate: Update remote state: " 
                     << key << ": " << currentDialogInfo.dialog.state << "->" << iter->dialog.state);
-            setDialogInfo(key, *iter);
+            setDialogInfo(user, domain, *iter);
         } else {
             OSS_LOG_INFO("[DialogCollator] Collate: Ignore remote state: " 
                     << key << ": " << currentDialogInfo.dialog.state << "<-" << iter->dialog.state);
@@ -159,7 +167,7 @@ bool DialogCollator::collateRemotePayloads(const std::string & user, const std::
       {
         OSS_LOG_INFO("[DialogCollator] Collate: New remote state: " 
                 << key << ": ->" << iter->dialog.state);
-        setDialogInfo(key, *iter);
+        setDialogInfo(user, domain, *iter);
       }
 
       result = true;
@@ -241,8 +249,7 @@ bool DialogCollator::aggregateRemotePayloads(const std::string & user, const std
             iter->dialog.state = "terminated";
             if(updateDialogInfoXMLState(iter->rawPayload, iter->dialog.state))
             {
-                std::string key = generateKey(user, domain, iter->dialog);
-                setDialogInfo(key, *iter);                        
+                setDialogInfo(user, domain, *iter);
             }
             aggregateDialogs[iter->dialog.id] = *iter;
         }
@@ -282,8 +289,7 @@ void DialogCollator::finalizeAggregatePayloads(const std::string & user, const s
             activeDialog->dialog.state = "terminated";
             if(updateDialogInfoXMLState(activeDialog->rawPayload, activeDialog->dialog.state))
             {
-                std::string key = generateKey(user, domain, activeDialog->dialog);
-                setDialogInfo(key, *activeDialog);
+                setDialogInfo(user, domain, *activeDialog);
             }
 
             OSS_LOG_INFO("[DialogCollator] Aggregate: New active dialog: " 
@@ -300,8 +306,7 @@ void DialogCollator::finalizeAggregatePayloads(const std::string & user, const s
         currentDialog.dialog.state = "terminated";
         if(updateDialogInfoXMLState(currentDialog.rawPayload, currentDialog.dialog.state))
         {
-            std::string key = generateKey(user, domain, currentDialog.dialog);
-            setDialogInfo(key, currentDialog);
+            setDialogInfo(user, domain, currentDialog);
         }
       }
     } else
@@ -340,6 +345,7 @@ std::string DialogCollator::generateDialogPayload(const AggregatedDialogs & aggr
 
 std::string DialogCollator::collateAndAggregatePayloads(const std::string & user, const std::string & domain, const std::vector<std::string> & payloads)
 {
+  std::string payload;
   CollatedDialogs collatedDialogs;
   if(collateLocalPayloads(user, domain, payloads, collatedDialogs))
   {
@@ -350,21 +356,84 @@ std::string DialogCollator::collateAndAggregatePayloads(const std::string & user
       if(!aggregateDialogs.empty() && aggregateRemotePayloads(user, domain, aggregateDialogs))
       {
         finalizeAggregatePayloads(user, domain, aggregateDialogs);
-        return generateDialogPayload(aggregateDialogs);
+        payload = generateDialogPayload(aggregateDialogs);
       }
     }
   }
 
-  return "";
+  commitDialogs();
+  return payload;
 }
 
 void DialogCollator::flushDialog(const std::string & user, const std::string & domain)
 {
-  std::ostringstream strm;
-  strm << user << "@" << domain;
+  std::string indexKey = generateIndexKey(user, domain);
+  if(indexKey == _indexKey)
+  {
+    _indexKey.clear();
+    _remoteDialogs.clear();
+    _modifiedDialogs.clear();
+    _expiredDialogs.clear();
+  }
+
+  _store.remove(indexKey);
+}
+
+bool DialogCollator::commitDialogs()
+{
+  bool result = true;
+  if(!_indexKey.empty() && (!_modifiedDialogs.empty() || !_expiredDialogs.empty()))
+  {
+    if(!_expiredDialogs.empty())
+    {
+      DialogStore::Command hdel;
+      hdel.reserve(_expiredDialogs.size() + 2);
+      hdel.push_back("HDEL");
+      hdel.push_back(_indexKey);
+      hdel.insert(hdel.end(), _expiredDialogs.begin(), _expiredDialogs.end());
+      _store.append(hdel);
+    }
+
+    if(!_modifiedDialogs.empty())
+    {
+      DialogStore::Command hmset;
+      hmset.reserve(_modifiedDialogs.size() * 2 + 2);
+      hmset.push_back("HMSET");
+      hmset.push_back(_indexKey);
+      for(DialogStore::Fields::const_iterator iter = _modifiedDialogs.begin()
+          ; iter != _modifiedDialogs.end()
+          ; ++iter)
+      {
+        hmset.push_back(iter->first);
+        hmset.push_back(iter->second);
+      }
+      _store.append(hmset);
+
+      std::ostringstream expires;
+      expires << DIALOG_EXPIRES_SEC;
+      DialogStore::Command expire;
+      expire.push_back("EXPIRE");
+      expire.push_back(_indexKey);
+      expire.push_back(expires.str());
+      _store.append(expire);
+    }
+
+    OSS_LOG_DEBUG("[DialogCollator] Commit: " << _indexKey << ": "
+        << _modifiedDialogs.size() << " updated, " << _expiredDialogs.size() << " expired");
 
-  std::string key = strm.str();
-  _redisClient.del(key + ":*:dialog");
+    result = _store.flush();
+    if(!result)
+    {
+      OSS_LOG_ERROR("[DialogCollator] Commit: Unable to store dialog state: " << _indexKey);
+    }
+  }
+
+  // Other processes may update the state before the next pass, never reuse it
+  _indexKey.clear();
+  _remoteDialogs.clear();
+  _modifiedDialogs.clear();
+  _expiredDialogs.clear();
+  return result;
 }
 
 std::string DialogCollator::generateKey(const std::string & user, const std::string & domain, const Dialog & dialog)
@@ -374,53 +443,111 @@ std::string DialogCollator::generateKey(const std::string & user, const std::str
   return strm.str();
 }
 
-bool DialogCollator::setDialogInfo(const std::string & key, const DialogInfo & dialogInfo)
+std::string DialogCollator::generateIndexKey(const std::string & user, const std::string & domain)
 {
-  json::Object object;
-  dialogInfo.toJsonObject(object);
-  return _redisClient.set(key + ":dialog", object, 3600);
+  std::ostringstream strm;
+  strm << user << "@" << domain << ":dialogs";
+  return strm.str();
 }
 
-bool DialogCollator::getDialogInfo(const std::string & key, DialogInfo & dialogInfo)
+/*
+ * Read every dialog of the user with a single HGETALL. The result is kept
+ * until commitDialogs() so the rest of the pass does not go back to Redis.
+ */
+bool DialogCollator::loadDialogs(const std::string & user, const std::string & domain)
 {
-  json::Object object;
-  if(_redisClient.get(key + ":dialog", object)) {
-    dialogInfo.fromJsonObject(object);
+  std::string indexKey = generateIndexKey(user, domain);
+  if(indexKey == _indexKey)
+  {
     return true;
   }
-      
-  return false;
+
+  if(!_indexKey.empty())
+  {
+    // Switching users without a commit, do not lose the pending writes
+    commitDialogs();
+  }
+
+  DialogStore::Fields fields;
+  if(!_store.getAll(indexKey, fields))
+  {
+    return false;
+  }
+
+  _indexKey = indexKey;
+  std::time_t now = std::time(0);
+  for(DialogStore::Fields::const_iterator iter = fields.begin()
+      ; iter != fields.end()
+      ; ++iter)
+  {
+    DialogInfo dialogInfo;
+    std::time_t updated;
+    if(!decodeDialogInfo(iter->second, dialogInfo, updated))
+    {
+      OSS_LOG_WARNING("[DialogCollator] Load: Dropping unreadable state: " << indexKey << ": " << iter->first);
+      _expiredDialogs.push_back(iter->first);
+    } else if(now - updated > DIALOG_EXPIRES_SEC)
+    {
+      OSS_LOG_DEBUG("[DialogCollator] Load: Dropping expired state: " << indexKey << ": " << iter->first);
+      _expiredDialogs.push_back(iter->first);
+    } else
+    {
+      _remoteDialogs[iter->first] = dialogInfo;
+    }
+  }
+
+  return true;
 }
 
-bool DialogCollator::getAllDialogInfo(const std::string & user, const std::string & domain, std::vector<json::Object> & dialogInfos)
+bool DialogCollator::setDialogInfo(const std::string & user, const std::string & domain, const DialogInfo & dialogInfo)
 {
-  std::ostringstream strm;
-  strm << user << "@" << domain << ":*:dialog";
-  return _redisClient.getAll(dialogInfos, strm.str());
+  if(!loadDialogs(user, domain))
+  {
+    return false;
+  }
+
+  std::string field = dialogInfo.dialog.generateKey();
+  _remoteDialogs[field] = dialogInfo;
+  encodeDialogInfo(dialogInfo, std::time(0), _modifiedDialogs[field]);
+  return true;
 }
 
-bool DialogCollator::getAllDialogInfo(const std::string & user, const std::string & domain, CollatedDialogs & dialogInfos)
+bool DialogCollator::getDialogInfo(const std::string & user, const std::string & domain, const Dialog & dialog, DialogInfo & dialogInfo)
 {
-  std::vector<json::Object> objects;
-  if(getAllDialogInfo(user, domain, objects) && !objects.empty())
+  if(!loadDialogs(user, domain))
   {
-    for(std::vector<json::Object>::const_iterator iter = objects.begin()
-            ; iter != objects.end()
-            ; ++iter)
-    {
-      DialogInfo dialogInfo;
-      dialogInfo.fromJsonObject(*iter);
-      if(dialogInfo.valid())
-      {
-        dialogInfos.push_back(dialogInfo);
-      }
-    }
+    return false;
+  }
 
+  RemoteDialogs::const_iterator iter = _remoteDialogs.find(dialog.generateKey());
+  if(iter != _remoteDialogs.end())
+  {
+    dialogInfo = iter->second;
     return true;
   }
 
   return false;
 }
 
+bool DialogCollator::getAllDialogInfo(const std::string & user, const std::string & domain, CollatedDialogs & dialogInfos)
+{
+  if(!loadDialogs(user, domain) || _remoteDialogs.empty())
+  {
+    return false;
+  }
+
+  for(RemoteDialogs::const_iterator iter = _remoteDialogs.begin()
+      ; iter != _remoteDialogs.end()
+      ; ++iter)
+  {
+    if(iter->second.valid())
+    {
+      dialogInfos.push_back(iter->second);
+    }
+  }
+
+  return true;
+}
+
 } } } // Namespace SIPX::Kamailio::Plugin
 
@@ -18,8 +18,9 @@
 
 #include <OSS/UTL/Logger.h>
 #include <boost/lexical_cast.hpp>
-#include "xmlparser/tinystr.h"
-#include "xmlparser/tinyxml.h"
+#include "xmlparser/XmlPullParser.h"
+#include <cstdio>
+#include <cstring>
 
 namespace SIPX {
 namespace Kamailio {
@@ -134,167 +135,623 @@ void Dialog::fromJsonObject(const json::Object& object)
   }
 }
 
+//
+// Local Helpers
+//
+
+namespace {
+
+typedef XmlPullParser::Slice Slice;
+
+// Get the decoded value of an attribute of the current element
+bool getAttribute(const XmlPullParser& parser, const char* name, std::string& value)
+{
+  Slice slice;
+  if (!parser.getAttribute(name, slice))
+    return false;
+
+  value.clear();
+  slice.decodeTo(value);
+  return true;
+}
+
+// Encode a string the way TiXmlBase::PutString does
+void putString(const char* data, std::size_t length, std::string& out)
+{
+  std::size_t i = 0;
+  while (i < length)
+  {
+    unsigned char c = (unsigned char) data[i];
+    if (c == '&' && i + 2 < length && data[i + 1] == '#' && data[i + 2] == 'x')
+    {
+      // Hexadecimal character reference, passed through unchanged
+      while (i < length - 1)
+      {
+        out.append(data + i, 1);
+        ++i;
+        if (data[i] == ';')
+          break;
+      }
+      continue;
+    }
+
+    switch (c)
+    {
+    case '&': out.append("&amp;"); break;
+    case '<': out.append("&lt;"); break;
+    case '>': out.append("&gt;"); break;
+    case '"': out.append("&quot;"); break;
+    case '\'': out.append("&apos;"); break;
+    default:
+      if (c < 32)
+      {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "&#x%02X;", (unsigned) c);
+        out.append(buf);
+      }
+      else
+      {
+        out.append(data + i, 1);
+      }
+      break;
+    }
+    ++i;
+  }
+}
+
+//
+// Serializes parser events exactly like streaming a TiXmlDocument did:
+// no formatting, whitespace condensed, whitespace-only text dropped and
+// childless elements written as <name />.  Collated payloads are compared
+// and stored in redis, so the output must not change.
+//
+class CompactWriter
+{
+public:
+  explicit CompactWriter(std::string& out) : _out(out), _pendingTag(false) {}
+
+  // Write the current event of the parser
+  void write(const XmlPullParser& parser)
+  {
+    switch (parser.getEvent())
+    {
+    case XmlPullParser::START_ELEMENT:
+      startElement(parser);
+      break;
+    case XmlPullParser::END_ELEMENT:
+      endElement(parser.getName());
+      break;
+    case XmlPullParser::TEXT:
+      text(parser);
+      break;
+    case XmlPullParser::COMMENT:
+      closePendingTag();
+      _out.append("<!--");
+      parser.getText().appendTo(_out);
+      _out.append("-->");
+      break;
+    case XmlPullParser::PROCESSING_INSTRUCTION:
+      processingInstruction(parser);
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Write the start tag of the current element, optionally setting one attribute
+  void startElement(const XmlPullParser& parser, const char* name = 0, const char* value = 0)
+  {
+    closePendingTag();
+    _out.append("<");
+    parser.getName().appendTo(_out);
+
+    bool replaced = false;
+    for (std::size_t i = 0; i < parser.getAttributeCount(); i++)
+    {
+      const Slice& attributeName = parser.getAttributeName(i);
+      if (name && !replaced && attributeName.equals(name))
+      {
+        putAttribute(attributeName, value);
+        replaced = true;
+      }
+      else
+      {
+        _value.clear();
+        parser.getAttributeValue(i).decodeTo(_value);
+        putAttribute(attributeName, _value.c_str());
+      }
+    }
+
+    if (name && !replaced)
+      putAttribute(Slice(name, strlen(name)), value);
+
+    _pendingTag = true;
+  }
+
+  void endElement(const Slice& name)
+  {
+    if (_pendingTag)
+    {
+      _out.append(" />");
+      _pendingTag = false;
+      return;
+    }
+
+    _out.append("</");
+    name.appendTo(_out);
+    _out.append(">");
+  }
+
+  void text(const XmlPullParser& parser)
+  {
+    _value.clear();
+    if (parser.isCData())
+      parser.getText().appendTo(_value);
+    else
+      parser.getText().decodeTo(_value, true);
+
+    if (!_value.empty())
+      text(_value);
+  }
+
+  // Write character data, even if empty, as the only content of the pending element
+  void text(const std::string& value)
+  {
+    closePendingTag();
+    putString(value.data(), value.size(), _out);
+  }
+
+  // Copy the element the parser is positioned on, including its children.
+  bool copyElement(XmlPullParser& parser)
+  {
+    std::size_t depth = parser.getDepth();
+    write(parser);
+    for (XmlPullParser::Event event = parser.next(); ; event = parser.next())
+    {
+      if (event == XmlPullParser::ERROR || event == XmlPullParser::END_DOCUMENT)
+        return false;
+
+      write(parser);
+      if (event == XmlPullParser::END_ELEMENT && parser.getDepth() == depth)
+        return true;
+    }
+  }
+
+private:
+  void closePendingTag()
+  {
+    if (_pendingTag)
+    {
+      _out.append(">");
+      _pendingTag = false;
+    }
+  }
+
+  void putAttribute(const Slice& name, const char* value)
+  {
+    // TinyXML switches to single quotes when the value holds a double quote
+    char quote = strchr(value, '"') ? '\'' : '"';
+    _out.append(" ");
+    name.appendTo(_out);
+    _out.append("=");
+    _out.append(1, quote);
+    putString(value, strlen(value), _out);
+    _out.append(1, quote);
+  }
+
+  void processingInstruction(const XmlPullParser& parser)
+  {
+    if (!parser.getName().equals("xml"))
+    {
+      _out.append("<?");
+      parser.getName().appendTo(_out);
+      if (!parser.getText().empty())
+      {
+        _out.append(" ");
+        parser.getText().appendTo(_out);
+      }
+      _out.append("?>");
+      return;
+    }
+
+    // TiXmlDeclaration writes the known attributes only, in this order
+    static const char* attributes[] = { "version", "encoding", "standalone" };
+    _out.append("<?xml ");
+    for (std::size_t i = 0; i < sizeof(attributes) / sizeof(attributes[0]); i++)
+    {
+      if (getAttribute(parser, attributes[i], _value) && !_value.empty())
+      {
+        _out.append(attributes[i]);
+        _out.append("=\"");
+        putString(_value.data(), _value.size(), _out);
+        _out.append("\" ");
+      }
+    }
+    _out.append("?>");
+  }
+
+  std::string& _out;
+  bool _pendingTag;
+  std::string _value;
+};
+
+bool isRootElement(const XmlPullParser& parser, XmlPullParser::Event event)
+{
+  return event == XmlPullParser::START_ELEMENT && parser.getDepth() == 1
+      && parser.getName().equals("dialog-info");
+}
+
+} // namespace
+
 //
 // Global Methods
 //
 
 bool parseDialogInfoXML(const std::string & xml, DialogInfo & dialogInfo) 
 {
-  TiXmlDocument doc;
-  doc.Parse(xml.c_str(), 0, TIXML_ENCODING_UTF8);
-  if (!doc.Error()) 
+  XmlPullParser parser(xml.data(), xml.size());
+
+  XmlPullParser::Event event;
+  do
+  {
+    event = parser.next();
+  } while (event == XmlPullParser::PROCESSING_INSTRUCTION || event == XmlPullParser::COMMENT);
+
+  //entity, state and version is mandatory
+  std::string entity, state, version;
+  if (!isRootElement(parser, event)
+      || !getAttribute(parser, "entity", entity)
+      || !getAttribute(parser, "state", state)
+      || !getAttribute(parser, "version", version))
+  {
+    return false;
+  }
+
+  // Only the first dialog is of interest
+  Dialog dialog = dialogInfo.dialog;
+  bool dialogFound = false;
+
+  for (event = parser.next(); event != XmlPullParser::END_DOCUMENT; event = parser.next())
   {
-    TiXmlElement * dialogInfoElement = doc.FirstChildElement("dialog-info");
-    if (dialogInfoElement != NULL) 
+    if (event == XmlPullParser::ERROR)
+      return false;
+
+    if (event != XmlPullParser::START_ELEMENT || parser.getDepth() != 2 || dialogFound)
+      continue;
+
+    if (!parser.getName().equals("dialog"))
     {
-      const char * entity = dialogInfoElement->Attribute("entity");
-      const char * state = dialogInfoElement->Attribute("state");
-      const char * version = dialogInfoElement->Attribute("version");
-
-      //entity, state and version is mandatory
-      if (entity != NULL && state != NULL && version != NULL) 
-      {   
-        //Store Dialog Info
-        dialogInfo.entity = entity;
-        dialogInfo.state = state;
-        dialogInfo.version = version;
-        dialogInfo.rawPayload = xml;
-
-        TiXmlElement* dialogElement = dialogInfoElement->FirstChildElement("dialog");
-        const char * id = dialogElement ? dialogElement->Attribute("id") : NULL;
-        if (id != NULL) 
-        {
-          const char * callId = dialogElement->Attribute("call-id");
-          const char * localTag = dialogElement->Attribute("local-tag");
-          const char * remoteTag = dialogElement->Attribute("remote-tag");
-          const char * direction = dialogElement->Attribute("direction");
-          
-          
-          dialogInfo.dialog.id = id;
-          dialogInfo.dialog.callId = callId ? callId : std::string();
-          dialogInfo.dialog.localTag = localTag ? localTag : std::string();
-          dialogInfo.dialog.remoteTag = remoteTag ? remoteTag : std::string();
-          dialogInfo.dialog.direction = direction ? direction : std::string();
-
-          /* Get State */
-          TiXmlElement * stateElement = dialogElement->FirstChildElement("state");
-          if (stateElement) 
-          {
-            TiXmlNode * stateNode = stateElement->FirstChild();
-            const char * state = stateNode ? stateNode->Value() : NULL;
-            dialogInfo.dialog.state = state ? state : std::string();                            
-          }
+      parser.skipElement();
+      continue;
+    }
 
-          /* Get Local Target */
-          TiXmlElement * localElement = dialogElement->FirstChildElement("local");
-          if(localElement)
-          {
-            TiXmlElement * targetElement = localElement->FirstChildElement("target");   
-            const char * localUri = targetElement ? targetElement->Attribute("uri") : NULL;
-            dialogInfo.dialog.localTarget = localUri ? localUri : std::string();
-          }
+    dialogFound = true;
+    if (!getAttribute(parser, "id", dialog.id))
+    {
+      parser.skipElement();
+      continue;
+    }
 
-          /* Get Remote Target */
-          TiXmlElement * remoteElement = dialogElement->FirstChildElement("remote");
-          if(remoteElement)
+    if (!getAttribute(parser, "call-id", dialog.callId))
+      dialog.callId.clear();
+    if (!getAttribute(parser, "local-tag", dialog.localTag))
+      dialog.localTag.clear();
+    if (!getAttribute(parser, "remote-tag", dialog.remoteTag))
+      dialog.remoteTag.clear();
+    if (!getAttribute(parser, "direction", dialog.direction))
+      dialog.direction.clear();
+
+    bool stateFound = false, localFound = false, remoteFound = false;
+    for (event = parser.next(); event != XmlPullParser::END_ELEMENT; event = parser.next())
+    {
+      if (event == XmlPullParser::ERROR || event == XmlPullParser::END_DOCUMENT)
+        return false;
+
+      if (event != XmlPullParser::START_ELEMENT)
+        continue;
+
+      const Slice& name = parser.getName();
+      if (name.equals("state") && !stateFound)
+      {
+        /* Get State */
+        stateFound = true;
+        dialog.state.clear();
+        if (!parser.readText(dialog.state))
+          return false;
+      }
+      else if ((name.equals("local") && !localFound) || (name.equals("remote") && !remoteFound))
+      {
+        /* Get Local or Remote Target */
+        bool local = name.equals("local");
+        std::string& target = local ? dialog.localTarget : dialog.remoteTarget;
+        localFound = localFound || local;
+        remoteFound = remoteFound || !local;
+        target.clear();
+
+        bool targetFound = false;
+        for (event = parser.next(); event != XmlPullParser::END_ELEMENT; event = parser.next())
+        {
+          if (event == XmlPullParser::ERROR || event == XmlPullParser::END_DOCUMENT)
+            return false;
+
+          if (event == XmlPullParser::START_ELEMENT)
           {
-            TiXmlElement * targetElement = remoteElement->FirstChildElement("target");   
-            const char * remoteUri = targetElement ? targetElement->Attribute("uri") : NULL;
-            dialogInfo.dialog.remoteTarget = remoteUri ? remoteUri : std::string();
+            if (!targetFound && parser.getName().equals("target"))
+            {
+              targetFound = true;
+              getAttribute(parser, "uri", target);
+            }
+            parser.skipElement();
           }
         }
-        
-        return true;
+      }
+      else
+      {
+        parser.skipElement();
       }
     }
   }
-  
-  return false;
+
+  //Store Dialog Info
+  dialogInfo.entity = entity;
+  dialogInfo.state = state;
+  dialogInfo.version = version;
+  dialogInfo.rawPayload = xml;
+  dialogInfo.dialog = dialog;
+  return true;
 }
 
 bool maskDialogInfoXMLVersion(std::string & xml)
 {
-  TiXmlDocument doc;
-  doc.Parse(xml.c_str(), 0, TIXML_ENCODING_UTF8);
-  if (!doc.Error()) 
+  std::string masked;
+  masked.reserve(xml.size());
+  CompactWriter writer(masked);
+  bool found = false;
+
+  XmlPullParser parser(xml.data(), xml.size());
+  for (XmlPullParser::Event event = parser.next(); event != XmlPullParser::END_DOCUMENT; event = parser.next())
   {
-    TiXmlElement * dialogInfoElement = doc.FirstChildElement("dialog-info");
-    if (dialogInfoElement != NULL) 
+    if (event == XmlPullParser::ERROR)
+      return false;
+
+    if (isRootElement(parser, event))
     {
-      dialogInfoElement->SetAttribute("version", "00000000000");
-      TiXmlOutStream strm;
-      strm << doc;
-      xml = strm.c_str();
-      return true;
+      writer.startElement(parser, "version", "00000000000");
+      found = true;
+    }
+    else
+    {
+      writer.write(parser);
     }
   }
-  
-  return false;
+
+  if (found)
+    xml.swap(masked);
+
+  return found;
 }
 
 bool updateDialogInfoXMLState(std::string & xml, const std::string & state)
 {
-  TiXmlDocument doc;
-  doc.Parse(xml.c_str(), 0, TIXML_ENCODING_UTF8);
-  if (!doc.Error()) 
+  std::string updated;
+  updated.reserve(xml.size() + state.size());
+  CompactWriter writer(updated);
+  bool rootFound = false, inFirstDialog = false, dialogFound = false, stateFound = false;
+
+  XmlPullParser parser(xml.data(), xml.size());
+  for (XmlPullParser::Event event = parser.next(); event != XmlPullParser::END_DOCUMENT; event = parser.next())
   {
-    TiXmlElement * dialogInfoElement = doc.FirstChildElement("dialog-info");
-    if (dialogInfoElement) 
-    {
-      TiXmlElement* dialogElement = dialogInfoElement->FirstChildElement("dialog");
-      TiXmlElement* stateElement = dialogElement ? dialogElement->FirstChildElement("state") : NULL;
-      if(stateElement)
-      {
-        stateElement->Clear();
-        stateElement->LinkEndChild(new TiXmlText(state.c_str()));
+    if (event == XmlPullParser::ERROR)
+      return false;
 
-        TiXmlOutStream strm;
-        strm << doc;
-        xml = strm.c_str();
-        return true;
-      }
+    if (isRootElement(parser, event))
+    {
+      rootFound = true;
+    }
+    else if (event == XmlPullParser::START_ELEMENT && rootFound && parser.getDepth() == 2
+        && !dialogFound && parser.getName().equals("dialog"))
+    {
+      dialogFound = inFirstDialog = true;
+    }
+    else if (event == XmlPullParser::END_ELEMENT && parser.getDepth() == 2)
+    {
+      inFirstDialog = false;
+    }
+    else if (event == XmlPullParser::START_ELEMENT && inFirstDialog && parser.getDepth() == 3
+        && !stateFound && parser.getName().equals("state"))
+    {
+      // Replace the content of the state element
+      stateFound = true;
+      writer.startElement(parser);
+      writer.text(state);
+      if (!parser.skipElement())
+        return false;
     }
+
+    writer.write(parser);
   }
 
-  return false;
+  if (stateFound)
+    xml.swap(updated);
+
+  return stateFound;
 }
 
 bool mergeDialogInfoXMLDialog(std::string & xml, const DialogInfo & rdialogInfo)
 {
-  TiXmlDocument rdoc;
-  rdoc.Parse(rdialogInfo.rawPayload.c_str(), 0, TIXML_ENCODING_UTF8);
-  if (!rdoc.Error()) 
+  // Locate the first dialog element of the remote payload
+  const std::string& rxml = rdialogInfo.rawPayload;
+  std::size_t dialogBegin = std::string::npos, dialogEnd = 0;
+  bool rootFound = false;
+
+  XmlPullParser rparser(rxml.data(), rxml.size());
+  for (XmlPullParser::Event event = rparser.next(); event != XmlPullParser::END_DOCUMENT; event = rparser.next())
   {
-    TiXmlElement * rdialogInfoElement = rdoc.FirstChildElement("dialog-info");
-    TiXmlElement * rdialogElement = rdialogInfoElement ? rdialogInfoElement->FirstChildElement("dialog") : NULL;
-    if(rdialogElement)
+    if (event == XmlPullParser::ERROR)
+      return false;
+
+    if (isRootElement(rparser, event))
     {
-      if(xml.empty())
-      {
-        xml = rdialogInfo.rawPayload;
-        return true;
-      }
+      rootFound = true;
+    }
+    else if (event == XmlPullParser::START_ELEMENT && rootFound && rparser.getDepth() == 2
+        && dialogBegin == std::string::npos && rparser.getName().equals("dialog"))
+    {
+      dialogBegin = rparser.getTokenOffset();
+      if (!rparser.skipElement())
+        return false;
+      dialogEnd = rparser.getOffset();
+    }
+  }
 
-      TiXmlDocument ldoc;
-      ldoc.Parse(xml.c_str(), 0, TIXML_ENCODING_UTF8);
-      if (!ldoc.Error()) 
-      {
-        TiXmlElement * ldialogInfoElement = ldoc.FirstChildElement("dialog-info");
-        if (ldialogInfoElement) 
-        {
-          ldialogInfoElement->LinkEndChild(rdialogElement->Clone());
-          TiXmlOutStream strm;
-          strm << ldoc;
-          xml = strm.c_str();
-          return true;
-        }
-      }
+  if (dialogBegin == std::string::npos)
+    return false;
+
+  if(xml.empty())
+  {
+    xml = rxml;
+    return true;
+  }
+
+  // Copy the local payload, appending the remote dialog to its root element
+  std::string merged;
+  merged.reserve(xml.size() + dialogEnd - dialogBegin);
+  CompactWriter writer(merged);
+  rootFound = false;
+
+  XmlPullParser lparser(xml.data(), xml.size());
+  for (XmlPullParser::Event event = lparser.next(); event != XmlPullParser::END_DOCUMENT; event = lparser.next())
+  {
+    if (event == XmlPullParser::ERROR)
+      return false;
+
+    if (isRootElement(lparser, event))
+    {
+      rootFound = true;
+    }
+    else if (event == XmlPullParser::END_ELEMENT && rootFound && lparser.getDepth() == 1)
+    {
+      XmlPullParser dialogParser(rxml.data() + dialogBegin, dialogEnd - dialogBegin);
+      dialogParser.next();
+      if (!writer.copyElement(dialogParser))
+        return false;
     }
+
+    writer.write(lparser);
   }
 
+  if (!rootFound)
+    return false;
+
+  xml.swap(merged);
+  return true;
+}
+
+namespace {
+
+const unsigned char DIALOG_RECORD_FORMAT = 1;
+
+void putVarint(std::string & buffer, unsigned long long value)
+{
+  while (value >= 0x80)
+  {
+    buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<char>(value));
+}
+
+bool getVarint(const char *& cursor, const char * end, unsigned long long & value)
+{
+  value = 0;
+  for (unsigned shift = 0; cursor < end && shift < 64; shift += 7)
+  {
+    unsigned char byte = static_cast<unsigned char>(*cursor++);
+    value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
   return false;
 }
 
+void putField(std::string & buffer, const std::string & field)
+{
+  putVarint(buffer, field.size());
+  buffer.append(field);
+}
+
+bool getField(const char *& cursor, const char * end, std::string & field)
+{
+  unsigned long long length;
+  if (!getVarint(cursor, end, length) || length > static_cast<unsigned long long>(end - cursor))
+    return false;
+
+  field.assign(cursor, static_cast<std::size_t>(length));
+  cursor += length;
+  return true;
+}
+
+} // namespace
+
+void encodeDialogInfo(const DialogInfo & dialogInfo, std::time_t updated, std::string & buffer)
+{
+  const Dialog & dialog = dialogInfo.dialog;
+
+  buffer.clear();
+  buffer.reserve(dialogInfo.rawPayload.size() + 256);
+  buffer.push_back(static_cast<char>(DIALOG_RECORD_FORMAT));
+  putVarint(buffer, updated > 0 ? static_cast<unsigned long long>(updated) : 0);
+
+  putField(buffer, dialogInfo.entity);
+  putField(buffer, dialogInfo.state);
+  putField(buffer, dialogInfo.version);
+  putField(buffer, dialog.id);
+  putField(buffer, dialog.callId);
+  putField(buffer, dialog.localTag);
+  putField(buffer, dialog.remoteTag);
+  putField(buffer, dialog.direction);
+  putField(buffer, dialog.state);
+  putField(buffer, dialog.remoteTarget);
+  putField(buffer, dialog.localTarget);
+  putField(buffer, dialogInfo.rawPayload);
+}
+
+bool decodeDialogInfo(const std::string & buffer, DialogInfo & dialogInfo, std::time_t & updated)
+{
+  const char * cursor = buffer.data();
+  const char * end = cursor + buffer.size();
+
+  if (cursor == end || static_cast<unsigned char>(*cursor++) != DIALOG_RECORD_FORMAT)
+    return false;
+
+  unsigned long long timestamp;
+  if (!getVarint(cursor, end, timestamp))
+    return false;
+  updated = static_cast<std::time_t>(timestamp);
+
+  DialogInfo decoded;
+  Dialog & dialog = decoded.dialog;
+  if (!getField(cursor, end, decoded.entity)
+      || !getField(cursor, end, decoded.state)
+      || !getField(cursor, end, decoded.version)
+      || !getField(cursor, end, dialog.id)
+      || !getField(cursor, end, dialog.callId)
+      || !getField(cursor, end, dialog.localTag)
+      || !getField(cursor, end, dialog.remoteTag)
+      || !getField(cursor, end, dialog.direction)
+      || !getField(cursor, end, dialog.state)
+      || !getField(cursor, end, dialog.remoteTarget)
+      || !getField(cursor, end, dialog.localTarget)
+      || !getField(cursor, end, decoded.rawPayload)
+      || cursor != end)
+  {
+    return false;
+  }
+
+  dialogInfo = decoded;
+  return true;
+}
+
 int compareDialogByState(const Dialog & ldialog, const Dialog & rdialog)
 {
     return getPriorityByState(ldialog.state) - getPriorityByState(rdialog.state);
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2015 SIPfoundry, Inc. All rights reserved.
+ *
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#include "DialogEventCollator/DialogStore.h"
+#include <OSS/UTL/Logger.h>
+#include <hiredis/hiredis.h>
+#include <sys/time.h>
+#include <sstream>
+
+#define REDIS_CONNECT_TIMEOUT_SEC 2
+
+namespace SIPX {
+namespace Kamailio {
+namespace Plugin {
+
+namespace {
+
+struct CommandArgs
+{
+  std::vector<const char*> argv;
+  std::vector<std::size_t> argvlen;
+
+  explicit CommandArgs(const DialogStore::Command& command)
+  {
+    argv.reserve(command.size());
+    argvlen.reserve(command.size());
+    for(DialogStore::Command::const_iterator iter = command.begin()
+        ; iter != command.end()
+        ; ++iter)
+    {
+      argv.push_back(iter->data());
+      argvlen.push_back(iter->size());
+    }
+  }
+};
+
+bool isError(const redisReply* reply)
+{
+  return !reply || reply->type == REDIS_REPLY_ERROR;
+}
+
+} // namespace
+
+DialogStore::DialogStore() :
+  _context(0),
+  _port(0),
+  _db(0)
+{
+}
+
+DialogStore::~DialogStore()
+{
+  disconnect();
+}
+
+bool DialogStore::connect(const std::string& host, int port, const std::string& password, int db)
+{
+  _host = host;
+  _port = port;
+  _password = password;
+  _db = db;
+  return reconnect();
+}
+
+void DialogStore::disconnect()
+{
+  if(_context)
+  {
+    redisFree(_context);
+    _context = 0;
+  }
+  _pipeline.clear();
+}
+
+bool DialogStore::reconnect()
+{
+  if(_context)
+  {
+    redisFree(_context);
+    _context = 0;
+  }
+
+  struct timeval timeout = { REDIS_CONNECT_TIMEOUT_SEC, 0 };
+  redisContext* context = redisConnectWithTimeout(_host.c_str(), _port, timeout);
+  if(!context || context->err)
+  {
+    OSS_LOG_ERROR("[DialogStore] Unable to connect to Redis at " << _host << ":" << _port
+        << ": " << (context ? context->errstr : "out of memory"));
+    if(context)
+    {
+      redisFree(context);
+    }
+    return false;
+  }
+  _context = context;
+
+  if(!_password.empty())
+  {
+    Command auth;
+    auth.push_back("AUTH");
+    auth.push_back(_password);
+    redisReply* reply = execute(auth);
+    bool failed = isError(reply);
+    if(reply)
+    {
+      freeReplyObject(reply);
+    }
+    if(failed)
+    {
+      OSS_LOG_ERROR("[DialogStore] Redis authentication failed");
+      disconnect();
+      return false;
+    }
+  }
+
+  if(_db != 0)
+  {
+    std::ostringstream db;
+    db << _db;
+    Command select;
+    select.push_back("SELECT");
+    select.push_back(db.str());
+    redisReply* reply = execute(select);
+    bool failed = isError(reply);
+    if(reply)
+    {
+      freeReplyObject(reply);
+    }
+    if(failed)
+    {
+      OSS_LOG_ERROR("[DialogStore] Unable to select Redis database " << _db);
+      disconnect();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+redisReply* DialogStore::execute(const Command& command)
+{
+  if(!_context)
+  {
+    return 0;
+  }
+
+  CommandArgs args(command);
+  redisReply* reply = static_cast<redisReply*>(
+      redisCommandArgv(_context, args.argv.size(), &args.argv[0], &args.argvlen[0]));
+  if(!reply)
+  {
+    OSS_LOG_ERROR("[DialogStore] " << command[0] << " failed: " << _context->errstr);
+    // The context can not be reused after an I/O or protocol error
+    redisFree(_context);
+    _context = 0;
+  }
+  return reply;
+}
+
+bool DialogStore::appendCommand(const Command& command)
+{
+  CommandArgs args(command);
+  return redisAppendCommandArgv(_context, args.argv.size(), &args.argv[0], &args.argvlen[0]) == REDIS_OK;
+}
+
+bool DialogStore::getAll(const std::string& key, Fields& fields)
+{
+  if(!_context && !reconnect())
+  {
+    return false;
+  }
+
+  Command command;
+  command.push_back("HGETALL");
+  command.push_back(key);
+
+  redisReply* reply = execute(command);
+  if(isError(reply) || reply->type != REDIS_REPLY_ARRAY)
+  {
+    if(reply)
+    {
+      OSS_LOG_ERROR("[DialogStore] HGETALL " << key << " failed: "
+          << (reply->type == REDIS_REPLY_ERROR ? reply->str : "unexpected reply"));
+      freeReplyObject(reply);
+    }
+    return false;
+  }
+
+  for(std::size_t i = 0; i + 1 < reply->elements; i += 2)
+  {
+    const redisReply* field = reply->element[i];
+    const redisReply* value = reply->element[i + 1];
+    fields[std::string(field->str, field->len)].assign(value->str, value->len);
+  }
+  freeReplyObject(reply);
+  return true;
+}
+
+bool DialogStore::remove(const std::string& key)
+{
+  if(!_context && !reconnect())
+  {
+    return false;
+  }
+
+  Command command;
+  command.push_back("DEL");
+  command.push_back(key);
+
+  redisReply* reply = execute(command);
+  bool result = !isError(reply);
+  if(reply)
+  {
+    freeReplyObject(reply);
+  }
+  return result;
+}
+
+void DialogStore::append(const Command& command)
+{
+  if(!command.empty())
+  {
+    _pipeline.push_back(command);
+  }
+}
+
+bool DialogStore::flush()
+{
+  if(_pipeline.empty())
+  {
+    return true;
+  }
+
+  std::vector<Command> pipeline;
+  pipeline.swap(_pipeline);
+
+  if(!_context && !reconnect())
+  {
+    return false;
+  }
+
+  for(std::vector<Command>::const_iterator iter = pipeline.begin()
+      ; iter != pipeline.end()
+      ; ++iter)
+  {
+    if(!appendCommand(*iter))
+    {
+      OSS_LOG_ERROR("[DialogStore] Unable to queue " << (*iter)[0] << ": " << _context->errstr);
+      disconnect();
+      return false;
+    }
+  }
+
+  // The first redisGetReply() writes the whole pipeline, the rest only read
+  bool result = true;
+  for(std::vector<Command>::const_iterator iter = pipeline.begin()
+      ; iter != pipeline.end()
+      ; ++iter)
+  {
+    void* reply = 0;
+    if(redisGetReply(_context, &reply) != REDIS_OK)
+    {
+      OSS_LOG_ERROR("[DialogStore] Pipeline failed at " << (*iter)[0] << ": " << _context->errstr);
+      disconnect();
+      return false;
+    }
+
+    redisReply* redis = static_cast<redisReply*>(reply);
+    if(isError(redis))
+    {
+      OSS_LOG_ERROR("[DialogStore] " << (*iter)[0] << " " << (iter->size() > 1 ? (*iter)[1] : "")
+          << " failed: " << (redis ? redis->str : ""));
+      result = false;
+    }
+    if(redis)
+    {
+      freeReplyObject(redis);
+    }
+  }
+
+  return result;
+}
+
+} } } // Namespace SIPX::Kamailio::Plugin
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) 2015 SIPfoundry, Inc. All rights reserved.
+ *
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+/*
+ * Dialog collator Redis access under a populated keyspace.
+ *
+ * Fills a scratch Redis database with dialogs for many users, both in the
+ * old one key per dialog layout read through a KEYS glob and in the per user
+ * hash used by DialogCollator, then measures reading the dialogs of one user
+ * both ways and a full collateAndAggregatePayloads pass.
+ *
+ * Run it against a throw away redis-server, the selected database is flushed:
+ *
+ *    redis-server --port 6380 --save "" &
+ *    dialog_event_collator_benchmark [host] [port] [db] [keys] [passes]
+ */
+
+#include "DialogEventCollator/DialogCollator.h"
+#include "DialogEventCollator/DialogStore.h"
+
+#include <hiredis/hiredis.h>
+#include <sys/time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace SIPX::Kamailio::Plugin;
+
+#define DIALOGS_PER_USER 10
+#define BATCH_SIZE 1000
+
+static double now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static std::string userName(int index)
+{
+  std::ostringstream strm;
+  strm << (10000 + index);
+  return strm.str();
+}
+
+static std::string dialogPayload(const std::string & user, const std::string & domain
+    , int index, const char* state)
+{
+  std::ostringstream strm;
+  strm << "<?xml version=\"1.0\"?>"
+       << "<dialog-info xmlns=\"urn:ietf:params:xml:ns:dialog-info\" version=\"0\" state=\"full\" entity=\"sip:"
+       << user << "@" << domain << "\">"
+       << "<dialog id=\"call-" << user << "-" << index << "\" call-id=\"call-" << user << "-" << index
+       << "\" local-tag=\"local-" << index << "\" remote-tag=\"remote-" << index << "\" direction=\"recipient\">"
+       << "<state>" << state << "</state>"
+       << "<remote><identity>sip:5002@" << domain << "</identity><target uri=\"sip:5002@192.168.0.154\"/></remote>"
+       << "<local><identity>sip:" << user << "@" << domain << "</identity><target uri=\"sip:" << user << "@" << domain << "\"/></local>"
+       << "</dialog></dialog-info>";
+  return strm.str();
+}
+
+static redisReply* command(redisContext* context, const std::vector<std::string> & args)
+{
+  std::vector<const char*> argv;
+  std::vector<size_t> argvlen;
+  for(std::vector<std::string>::const_iterator iter = args.begin(); iter != args.end(); ++iter)
+  {
+    argv.push_back(iter->data());
+    argvlen.push_back(iter->size());
+  }
+  return static_cast<redisReply*>(redisCommandArgv(context, argv.size(), &argv[0], &argvlen[0]));
+}
+
+/*
+ * What the collator used to do for every BLF event: match the keys of the
+ * user with a glob over the whole keyspace, then fetch them one by one.
+ */
+static size_t readLegacy(redisContext* context, const std::string & user, const std::string & domain)
+{
+  std::vector<std::string> args;
+  args.push_back("KEYS");
+  args.push_back(user + "@" + domain + ":*:dialog");
+  redisReply* keys = command(context, args);
+  size_t bytes = 0;
+  for(size_t i = 0; keys && i < keys->elements; i++)
+  {
+    args.clear();
+    args.push_back("GET");
+    args.push_back(std::string(keys->element[i]->str, keys->element[i]->len));
+    redisReply* value = command(context, args);
+    if(value)
+    {
+      bytes += value->len;
+      freeReplyObject(value);
+    }
+  }
+  if(keys)
+  {
+    freeReplyObject(keys);
+  }
+  return bytes;
+}
+
+int main(int argc, char** argv)
+{
+  std::string host = argc > 1 ? argv[1] : "127.0.0.1";
+  int port = argc > 2 ? atoi(argv[2]) : 6380;
+  int db = argc > 3 ? atoi(argv[3]) : 15;
+  int keys = argc > 4 ? atoi(argv[4]) : 100000;
+  int passes = argc > 5 ? atoi(argv[5]) : 1000;
+  const std::string domain = "bench.collator.inc";
+
+  if(keys < DIALOGS_PER_USER || passes <= 0)
+  {
+    fprintf(stderr, "usage: %s [host] [port] [db] [keys] [passes]\n", argv[0]);
+    return 1;
+  }
+
+  DialogStore store;
+  if(!store.connect(host, port, "", db))
+  {
+    fprintf(stderr, "unable to connect to redis at %s:%d\n", host.c_str(), port);
+    return 1;
+  }
+
+  struct timeval timeout = { 2, 0 };
+  redisContext* legacy = redisConnectWithTimeout(host.c_str(), port, timeout);
+  if(!legacy || legacy->err)
+  {
+    fprintf(stderr, "unable to connect to redis at %s:%d\n", host.c_str(), port);
+    return 1;
+  }
+  std::vector<std::string> args;
+  std::ostringstream dbName;
+  dbName << db;
+  args.push_back("SELECT");
+  args.push_back(dbName.str());
+  freeReplyObject(command(legacy, args));
+  args.clear();
+  args.push_back("FLUSHDB");
+  freeReplyObject(command(legacy, args));
+
+  //
+  // Populate both layouts, keys dialogs each
+  //
+  int users = keys / DIALOGS_PER_USER;
+  double start = now();
+  for(int u = 0; u < users; u++)
+  {
+    std::string user = userName(u);
+    DialogStore::Command hmset;
+    hmset.push_back("HMSET");
+    hmset.push_back(user + "@" + domain + ":dialogs");
+    for(int d = 0; d < DIALOGS_PER_USER; d++)
+    {
+      DialogInfo dialogInfo;
+      parseDialogInfoXML(dialogPayload(user, domain, d, "terminated"), dialogInfo);
+
+      std::string record;
+      encodeDialogInfo(dialogInfo, std::time(0), record);
+      hmset.push_back(dialogInfo.dialog.generateKey());
+      hmset.push_back(record);
+
+      // The legacy value size matters little for the scan, reuse the record
+      DialogStore::Command set;
+      set.push_back("SET");
+      set.push_back(user + "@" + domain + ":" + dialogInfo.dialog.generateKey() + ":dialog");
+      set.push_back(record);
+      store.append(set);
+    }
+    store.append(hmset);
+
+    if(store.pending() >= BATCH_SIZE)
+    {
+      store.flush();
+    }
+  }
+  store.flush();
+  printf("%d users, %d dialogs, populated in %.3f s\n", users, users * DIALOGS_PER_USER, now() - start);
+
+  //
+  // Read all dialogs of a user
+  //
+  size_t bytes = 0;
+  start = now();
+  for(int n = 0; n < passes; n++)
+  {
+    bytes += readLegacy(legacy, userName(n % users), domain);
+  }
+  double elapsed = now() - start;
+  printf("%-24s %8.3f s %10.0f reads/s\n", "KEYS glob + GET", elapsed, passes / elapsed);
+
+  start = now();
+  for(int n = 0; n < passes; n++)
+  {
+    DialogStore::Fields fields;
+    store.getAll(userName(n % users) + "@" + domain + ":dialogs", fields);
+    bytes += fields.size();
+  }
+  elapsed = now() - start;
+  printf("%-24s %8.3f s %10.0f reads/s\n", "HGETALL", elapsed, passes / elapsed);
+
+  //
+  // Complete collation passes, one read and one pipelined write each
+  //
+  DialogCollator collator;
+  if(!collator.connect("", db, host, port))
+  {
+    fprintf(stderr, "unable to connect to redis at %s:%d\n", host.c_str(), port);
+    return 1;
+  }
+
+  start = now();
+  for(int n = 0; n < passes; n++)
+  {
+    std::string user = userName(n % users);
+    std::vector<std::string> payloads;
+    payloads.push_back(dialogPayload(user, domain, DIALOGS_PER_USER + n, "early"));
+    payloads.push_back(dialogPayload(user, domain, DIALOGS_PER_USER + n, "confirmed"));
+    bytes += collator.collateAndAggregatePayloads(user, domain, payloads).size();
+  }
+  elapsed = now() - start;
+  printf("%-24s %8.3f s %10.0f passes/s\n", "collateAndAggregate", elapsed, passes / elapsed);
+
+  args.clear();
+  args.push_back("FLUSHDB");
+  freeReplyObject(command(legacy, args));
+  redisFree(legacy);
+  collator.disconnect();
+
+  return bytes > 0 ? 0 : 1;
+}
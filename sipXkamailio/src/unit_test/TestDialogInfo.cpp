@@ -38,4 +38,42 @@ TEST(DialogInfoTest, test_parse_dialog_xml)
     ASSERT_STREQ("2FC6CE3C-E3F38EF3", dialogInfo.dialog.remoteTag.c_str());
     ASSERT_STREQ("initiator", dialogInfo.dialog.direction.c_str());
     ASSERT_STREQ("early", dialogInfo.dialog.state.c_str());
-}
\ No newline at end of file
+}
+
+TEST(DialogInfoTest, test_encode_dialog_info)
+{
+    DialogInfo dialogInfo;
+    dialogInfo.rawPayload = "<?xml version=\"1.0\"?><dialog-info version=\"63\"/>";
+    dialogInfo.entity = "sip:5000@test.domain.com";
+    dialogInfo.state = "full";
+    dialogInfo.version = "63";
+    dialogInfo.dialog.id = "26bfed15-b490e778-5d4d2d53@192.168.0.111";
+    dialogInfo.dialog.callId = "26bfed15-b490e778-5d4d2d53@192.168.0.111";
+    dialogInfo.dialog.localTag = "CFA9E939-97CA593C";
+    dialogInfo.dialog.remoteTag = "2FC6CE3C-E3F38EF3";
+    dialogInfo.dialog.direction = "initiator";
+    dialogInfo.dialog.state = "early";
+    dialogInfo.dialog.remoteTarget = "sip:5001@192.168.0.109";
+    dialogInfo.dialog.localTarget = std::string(300, 'x'); // multi byte length prefix
+
+    std::string record;
+    encodeDialogInfo(dialogInfo, 1450000000, record);
+
+    DialogInfo decoded;
+    std::time_t updated = 0;
+    ASSERT_TRUE(decodeDialogInfo(record, decoded, updated));
+    ASSERT_EQ(1450000000, updated);
+    ASSERT_TRUE(decoded == dialogInfo);
+    ASSERT_EQ(dialogInfo.rawPayload, decoded.rawPayload);
+    ASSERT_EQ(dialogInfo.version, decoded.version);
+    ASSERT_EQ(dialogInfo.dialog.direction, decoded.dialog.direction);
+    ASSERT_EQ(dialogInfo.dialog.state, decoded.dialog.state);
+    ASSERT_EQ(dialogInfo.dialog.remoteTarget, decoded.dialog.remoteTarget);
+    ASSERT_EQ(dialogInfo.dialog.localTarget, decoded.dialog.localTarget);
+
+    // Truncated, padded and foreign records are rejected
+    ASSERT_FALSE(decodeDialogInfo(record.substr(0, record.size() - 1), decoded, updated));
+    ASSERT_FALSE(decodeDialogInfo(record + "x", decoded, updated));
+    ASSERT_FALSE(decodeDialogInfo("", decoded, updated));
+    ASSERT_FALSE(decodeDialogInfo("{\"entity\":\"sip:5000@test.domain.com\"}", decoded, updated));
+}
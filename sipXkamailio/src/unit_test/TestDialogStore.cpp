@@ -0,0 +1,198 @@
+#include "gtest/gtest.h"
+#include <OSS/OSS.h>
+#include <OSS/UTL/Logger.h>
+
+#include <ctime>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "DialogEventCollator/DialogCollator.h"
+#include "DialogEventCollator/DialogStore.h"
+
+using namespace SIPX::Kamailio::Plugin;
+
+//
+// These tests use the local Redis server, as the collator tests do
+//
+static const char* REDIS_HOST = "127.0.0.1";
+static const int REDIS_PORT = 6379;
+
+static const std::string TEST_USER = "5001";
+static const std::string TEST_DOMAIN = "test.dialogstore.inc";
+static const std::string TEST_KEY = TEST_USER + "@" + TEST_DOMAIN + ":dialogs";
+
+static DialogStore::Command command(const char* name, const std::string & key)
+{
+  DialogStore::Command command;
+  command.push_back(name);
+  command.push_back(key);
+  return command;
+}
+
+static DialogStore::Command hset(const std::string & key, const std::string & field, const std::string & value)
+{
+  DialogStore::Command hset = command("HSET", key);
+  hset.push_back(field);
+  hset.push_back(value);
+  return hset;
+}
+
+static DialogInfo dialogInfo(const std::string & id, const char* state)
+{
+  std::ostringstream strm;
+  strm << "<?xml version=\"1.0\"?>"
+       << "<dialog-info xmlns=\"urn:ietf:params:xml:ns:dialog-info\" version=\"0\" state=\"full\" entity=\"sip:"
+       << TEST_USER << "@" << TEST_DOMAIN << "\">"
+       << "<dialog id=\"" << id << "\" call-id=\"" << id
+       << "\" local-tag=\"local-" << id << "\" remote-tag=\"remote-" << id << "\" direction=\"recipient\">"
+       << "<state>" << state << "</state>"
+       << "<remote><identity>sip:5002@" << TEST_DOMAIN << "</identity><target uri=\"sip:5002@192.168.0.154\"/></remote>"
+       << "<local><identity>sip:" << TEST_USER << "@" << TEST_DOMAIN << "</identity><target uri=\"sip:"
+       << TEST_USER << "@" << TEST_DOMAIN << "\"/></local>"
+       << "</dialog></dialog-info>";
+
+  DialogInfo dialogInfo;
+  parseDialogInfoXML(strm.str(), dialogInfo);
+  return dialogInfo;
+}
+
+TEST(DialogStoreTest, test_put_get_remove)
+{
+  DialogStore store;
+  ASSERT_TRUE(store.connect(REDIS_HOST, REDIS_PORT));
+  ASSERT_TRUE(store.isConnected());
+  ASSERT_TRUE(store.remove(TEST_KEY));
+
+  DialogStore::Fields fields;
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_TRUE(fields.empty());
+
+  // Values are binary records, embedded NULs must survive the round trip
+  std::string record("a\0b", 3);
+  store.append(hset(TEST_KEY, "dialog-1", record));
+  store.append(hset(TEST_KEY, "dialog-2", "two"));
+  ASSERT_TRUE(store.flush());
+
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_EQ(2U, fields.size());
+  ASSERT_EQ(record, fields["dialog-1"]);
+  ASSERT_EQ(std::string("two"), fields["dialog-2"]);
+
+  ASSERT_TRUE(store.remove(TEST_KEY));
+  fields.clear();
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_TRUE(fields.empty());
+}
+
+TEST(DialogStoreTest, test_pipelined_writes)
+{
+  DialogStore store;
+  ASSERT_TRUE(store.connect(REDIS_HOST, REDIS_PORT));
+  ASSERT_TRUE(store.remove(TEST_KEY));
+
+  DialogStore::Command hdel = command("HDEL", TEST_KEY);
+  hdel.push_back("dialog-1");
+
+  DialogStore::Command expire = command("EXPIRE", TEST_KEY);
+  expire.push_back("3600");
+
+  store.append(hset(TEST_KEY, "dialog-1", "one"));
+  store.append(hset(TEST_KEY, "dialog-2", "two"));
+  store.append(hdel);
+  store.append(expire);
+  store.append(DialogStore::Command()); // empty commands are not queued
+  ASSERT_EQ(4U, store.pending());
+
+  // Nothing is sent before the flush
+  DialogStore::Fields fields;
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_TRUE(fields.empty());
+
+  // The commands run in order, so the HDEL undoes the first HSET
+  ASSERT_TRUE(store.flush());
+  ASSERT_EQ(0U, store.pending());
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_EQ(1U, fields.size());
+  ASSERT_EQ(std::string("two"), fields["dialog-2"]);
+
+  // A failing command fails the flush but not the commands around it
+  const std::string stringKey = TEST_USER + "@" + TEST_DOMAIN + ":string";
+  DialogStore::Command set = command("SET", stringKey);
+  set.push_back("value");
+  store.append(set);
+  store.append(hset(stringKey, "dialog-1", "one")); // WRONGTYPE
+  store.append(hset(TEST_KEY, "dialog-3", "three"));
+  ASSERT_FALSE(store.flush());
+  ASSERT_EQ(0U, store.pending());
+  ASSERT_TRUE(store.isConnected());
+
+  fields.clear();
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_EQ(2U, fields.size());
+  ASSERT_EQ(std::string("three"), fields["dialog-3"]);
+
+  ASSERT_TRUE(store.remove(stringKey));
+  ASSERT_TRUE(store.remove(TEST_KEY));
+}
+
+TEST(DialogStoreTest, test_connect_failure)
+{
+  DialogStore store;
+  ASSERT_FALSE(store.connect(REDIS_HOST, 1));
+  ASSERT_FALSE(store.isConnected());
+
+  // Queued writes are dropped rather than kept for a later flush
+  store.append(hset(TEST_KEY, "dialog-1", "one"));
+  ASSERT_FALSE(store.flush());
+  ASSERT_EQ(0U, store.pending());
+
+  DialogStore::Fields fields;
+  ASSERT_FALSE(store.getAll(TEST_KEY, fields));
+  ASSERT_FALSE(store.remove(TEST_KEY));
+}
+
+TEST(DialogStoreTest, test_drop_expired_dialog)
+{
+  DialogStore store;
+  ASSERT_TRUE(store.connect(REDIS_HOST, REDIS_PORT));
+  ASSERT_TRUE(store.remove(TEST_KEY));
+
+  // One dialog last updated two hours ago, one a minute ago
+  std::time_t now = std::time(0);
+  DialogInfo expired = dialogInfo("expired", "confirmed");
+  DialogInfo recent = dialogInfo("recent", "early");
+  ASSERT_TRUE(expired.valid());
+  ASSERT_TRUE(recent.valid());
+
+  std::string record;
+  encodeDialogInfo(expired, now - 2 * 3600, record);
+  store.append(hset(TEST_KEY, expired.dialog.generateKey(), record));
+  encodeDialogInfo(recent, now - 60, record);
+  store.append(hset(TEST_KEY, recent.dialog.generateKey(), record));
+  store.append(hset(TEST_KEY, "unreadable", "{\"entity\":\"sip:5001@test.dialogstore.inc\"}"));
+  ASSERT_TRUE(store.flush());
+
+  DialogCollator collator;
+  ASSERT_TRUE(collator.connect());
+
+  DialogInfo active = dialogInfo("active", "confirmed");
+  std::vector<std::string> payloads;
+  payloads.push_back(active.rawPayload);
+  std::string payload = collator.collateAndAggregatePayloads(TEST_USER, TEST_DOMAIN, payloads);
+  ASSERT_FALSE(payload.empty());
+
+  // The pass drops the expired and unreadable states and keeps the rest
+  DialogStore::Fields fields;
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_EQ(2U, fields.size());
+  ASSERT_TRUE(fields.find(expired.dialog.generateKey()) == fields.end());
+  ASSERT_TRUE(fields.find("unreadable") == fields.end());
+  ASSERT_TRUE(fields.find(recent.dialog.generateKey()) != fields.end());
+  ASSERT_TRUE(fields.find(active.dialog.generateKey()) != fields.end());
+
+  collator.flushDialog(TEST_USER, TEST_DOMAIN);
+  fields.clear();
+  ASSERT_TRUE(store.getAll(TEST_KEY, fields));
+  ASSERT_TRUE(fields.empty());
+}
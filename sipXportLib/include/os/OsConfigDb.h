@@ -13,6 +13,8 @@
 #define _OsConfigDb_h_
 
 // SYSTEM INCLUDES
+#include <vector>
+
 // APPLICATION INCLUDES
 #include "os/OsDefs.h"
 #include "os/OsRWMutex.h"
@@ -57,6 +59,8 @@ class DbEntry : public UtlContainable
     UtlString value;
 };
 
+typedef std::vector<DbEntry*> DbEntryVector;
+
 
 /**
  * Configuration database containing key/value pairs with ability to
@@ -283,8 +287,8 @@ public:
     /** reader/writer lock for synchronization */
     mutable OsRWMutex mRWMutex;
 
-    /** sorted storage of key/values */
-    UtlSortedList mDb;
+    /** key/values, sorted by key so lookups are binary searches */
+    DbEntryVector mDb;
 
     /** ID, used to distiguish which files should be encrypted */
     UtlString mIdentityLabel;
@@ -314,7 +318,28 @@ public:
     /**
      * Parse "key : value" and add to dictionary.
      */
-    void insertEntry(const char* line);
+    void insertEntry(const char* line,
+                     bool deferSort = false /**< append the entry without keeping
+                                             *   mDb sorted; the caller must call
+                                             *   sortEntries() once done */
+                     );
+
+    /**
+     * Sort entries appended with deferSort and drop duplicate keys, keeping
+     * the value that was added last.  The write lock must be held.
+     */
+    void sortEntries();
+
+    /**
+     * Index of the first entry whose key is not less than rKey
+     * (mDb.size() if there is none).
+     */
+    size_t lowerBound(const UtlString& rKey) const;
+
+    /**
+     * Index of the entry for rKey, or UTL_NOT_FOUND.
+     */
+    ssize_t findEntry(const UtlString& rKey) const;
 
     /**
      * Helper method for inserting a key/value pair into the dictionary
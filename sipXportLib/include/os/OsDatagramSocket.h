@@ -83,6 +83,14 @@ public:
    //! param: port - port on the remote host to send the datgram(s)
    //! returns: the number of bytes actually written to the socket
 
+   int write(const char* header, int headerLength,
+             const char* body, int bodyLength,
+             const char* ipAddress, int port);
+   //: Blocking write of one datagram made of two buffers
+   // Like write(buffer, bufferLength, ipAddress, port) of the two buffers
+   // joined, but without copying them together.
+   //! returns: the number of bytes actually written to the socket
+
    virtual int read(char* buffer, int bufferLength);
 
 /* ============================ ACCESSORS ================================= */
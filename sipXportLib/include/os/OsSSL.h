@@ -16,6 +16,7 @@
 #include "os/OsBSem.h"
 #include "os/OsMutex.h"
 #include "os/OsLogger.h"
+#include "utl/UtlHashMap.h"
 #include "openssl/ssl.h"
 
 // DEFINES
@@ -32,6 +33,12 @@ class UtlSList;
 /// Wrapper for the OpenSSL SSL_CTX context structure.
 /// This class is responsible for all global policy initialization and
 /// enforcement.
+///
+/// Sessions are cached on both sides so reconnecting peers can skip the
+/// full handshake: server sessions live in the OpenSSL session cache and
+/// in RFC 5077 session tickets (whose keys are rotated periodically),
+/// client sessions are kept per peer address and offered again by
+/// resumeClientSession().
 class OsSSL
 {
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
@@ -83,6 +90,18 @@ class OsSSL
    /// Release an SSL session handle
    void releaseConnection(SSL*& connection);
 
+   /// Offer the session last negotiated with the peer of connection for resumption.
+   void resumeClientSession(SSL* connection /**< client connection, with the
+                                             *   connected socket already set */
+                            );
+   /**<
+    * Call before SSL_connect.  If the peer no longer accepts the session
+    * the handshake silently falls back to a full one.
+    */
+
+   /// Forget all cached sessions and session ticket keys, forcing full handshakes.
+   void flushSessions();
+
    /// Get the validated names for the connection peer.
    static bool peerIdentity( SSL*       connection ///< SSL context from connection to be described
                             ,UtlSList*  altNames   /**< UtlStrings for verfied subjectAltNames
@@ -125,6 +144,7 @@ class OsSSL
                         );
 
    /// Set OpenSSL callbacks for locking and thread id
+   /// (only needed before OpenSSL 1.1.0, which does its own locking)
    void OpenSSL_thread_setup();
 
    /// Cleanup OpenSSL callbacks
@@ -149,6 +169,52 @@ class OsSSL
 
    SSL_CTX* mCTX;
 
+   /// Key used to protect session tickets
+   struct TicketKey
+   {
+      unsigned char name[16];
+      unsigned char aesKey[32];
+      unsigned char hmacKey[32];
+      long created;              ///< 0 if the slot is unused
+   };
+
+   enum
+   {
+      TICKET_KEYS = 2            ///< current key, then the previous one
+   };
+
+   OsMutex   mSessionLock;                ///< protects mTicketKeys and mClientSessions
+   TicketKey mTicketKeys[TICKET_KEYS];
+   UtlHashMap mClientSessions;            ///< UtlString peer address -> UtlVoidPtr SSL_SESSION*
+
+   /// Enable the session cache and session tickets on mCTX
+   void initSessionCache();
+
+   /// Replace the current ticket key if it is too old (or missing).
+   void rotateTicketKeys(long now);
+
+   /// Pick the ticket key to encrypt a new ticket (encrypt) or find the one named.
+   /// @returns 0 if not found, 1 if found, 2 if found but the ticket should be renewed
+   int findTicketKey(unsigned char* name, bool encrypt, TicketKey& key);
+
+   /// Remember the session negotiated by a client connection.
+   bool saveClientSession(SSL* connection, SSL_SESSION* session);
+
+   /// Free every cached client session; the caller holds mSessionLock.
+   void clearClientSessions();
+
+   /// Callback for SSL_CTX_sess_set_new_cb
+   static int newSessionCallback(SSL* connection, SSL_SESSION* session);
+
+   /// Callback for the session ticket encryption keys
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   static int ticketKeyCallback(SSL* connection, unsigned char* keyName, unsigned char* iv,
+                                EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* hmacCtx, int encrypt);
+#else
+   static int ticketKeyCallback(SSL* connection, unsigned char* keyName, unsigned char* iv,
+                                EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx, int encrypt);
+#endif
+
    /// Certificate chain validation hook called by openssl
    static int verifyCallback(int valid,            ///< validity so far from openssl
                              X509_STORE_CTX* store ///< certificate information db
@@ -158,7 +224,9 @@ class OsSSL
     * @note See 'man SSL_CTX_set_verify'
     */
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
    static OsMutex* spOpenSSL_locks[CRYPTO_NUM_LOCKS];
+#endif
 
    /// Disable copy constructor
    OsSSL(const OsSSL& rOsSSL);
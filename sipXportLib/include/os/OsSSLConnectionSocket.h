@@ -118,6 +118,9 @@ public:
    /// Is this connection encrypted using TLS/SSL?
    virtual bool isEncrypted() const;
 
+   /// Was the TLS session resumed rather than fully negotiated?
+   bool isSessionReused() const;
+
    /// Get any authenticated peer host names.
    virtual bool peerIdentity( UtlSList* altNames /**< UtlStrings for verfied subjectAltNames
                                                   *   are added to this - caller must free them.
@@ -87,6 +87,14 @@ public:
    //:Return the local port number
    // Returns the port to which this socket is bound on this host.
 
+   int getSocketDescriptor() const;
+   //:Return the listening socket descriptor
+   // For servers that wait on the socket with poll or epoll rather than
+   // blocking in accept().
+
+   const UtlString& getLocalIp() const;
+   //:Return the address the socket is bound to, if one was given
+
 /* ============================ INQUIRY =================================== */
    virtual UtlBoolean isOk() const;
    //: Server socket is in ready to accept incoming conection requests.
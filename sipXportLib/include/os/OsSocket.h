@@ -257,6 +257,12 @@ public:
    static void setDefaultBindAddress(const unsigned long bind_address);
    //set the default ipaddress the phone should bind to
 
+   static void setReusePort(UtlBoolean reusePort);
+   //: Set SO_REUSEPORT on the sockets created from now on that bind
+   //: a given port, so that several processes can serve the port
+
+   static UtlBoolean getReusePort();
+
    bool lock(bool force = false);
    //: Locks this object for further write calls
    // Note: If force is 'false', the object will be actually locked only if it was
@@ -425,6 +431,9 @@ private:
    static unsigned long m_DefaultBindAddress;
         //default ip address the phone should bind to. May be IPADDR_ANY
 
+   static UtlBoolean m_ReusePort;
+        //whether sockets binding a given port set SO_REUSEPORT
+
         static UtlString m_DomainName;
         //domain name for host machine
 
@@ -143,6 +143,12 @@ public:
     return true;
   }
 
+  std::size_t size()
+  {
+    mutex_lock lock(_mutex);
+    return _queue.size();
+  }
+
   void clear()
   {
     std::queue<T> empty;
@@ -0,0 +1,139 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _UtlByteScan_h_
+#define _UtlByteScan_h_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// APPLICATION INCLUDES
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/**
+ * Byte scanning kernels for message framing and tokenizing.
+ *
+ * Finding line breaks, the blank line that ends the headers of an HTTP or
+ * SIP message, the next delimiter of a token and folding the case of
+ * header names are done here rather than a byte at a time by their
+ * callers.  Each kernel has a scalar version and, on x86, SSE4.2 and AVX2
+ * versions that look at 16 or 32 bytes per step.  The fastest version the
+ * processor supports is chosen when the library is loaded; all versions
+ * give the same results, and setKernel() selects another one for testing
+ * and benchmarking.
+ *
+ * The kernels never read outside the bytes they are given, so they may be
+ * used on buffers that are not NUL terminated.
+ */
+class UtlByteScan
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   enum Kernel
+   {
+      SCALAR,
+      SSE42,
+      AVX2
+   };
+
+   /// A set of bytes to search for, such as the delimiters of a tokenizer.
+   class ByteSet
+   {
+     public:
+
+      /// The set of the bytes of the NUL terminated string bytes.
+      ByteSet(const char* bytes);
+
+      /// Add byte to the set; it may be NUL.
+      void add(char byte);
+
+      bool contains(char byte) const
+      {
+         unsigned char u = byte;
+         return (mBits[u >> 5] >> (u & 31)) & 1;
+      }
+
+     private:
+
+      friend class UtlByteScan;
+
+      uint32_t mBits[8];   ///< bit map of the set
+      char mBytes[16];     ///< the bytes of the set, while there are at most 16
+      int mCount;          ///< number of bytes in the set
+   };
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// Upper case the ASCII letters of the n bytes at p, as toupper() in the C locale.
+   static void toUpper(char* p, size_t n);
+
+   /// Lower case the ASCII letters of the n bytes at p, as tolower() in the C locale.
+   static void toLower(char* p, size_t n);
+
+/* ============================ ACCESSORS ================================= */
+
+   /// Index of the first CR or LF of the n bytes at p, or n if there is none.
+   static size_t findLineBreak(const char* p, size_t n);
+
+   /// Index of the first of the n bytes at p that is in set, or n if there is none.
+   static size_t findAnyOf(const char* p, size_t n, const ByteSet& set);
+
+   /// Find the blank line that ends the headers of a message.
+   static ssize_t findBlankLine(const char* p,  ///< message bytes
+                                size_t n,       ///< number of message bytes
+                                size_t& lineStart
+                                ///< in: the start of a line to scan from;
+                                ///< out: where to scan from when more bytes are added
+                                );
+   /**<
+    * Lines end with CR LF, LF or a lone CR; a CR that is the last of the n
+    * bytes is not taken to end a line until the byte after it is known.
+    * @returns the index following the line break of the first empty line at
+    * or after lineStart, or -1 if there is none yet.  In that case lineStart
+    * is moved to the start of the last line that may still turn out to be
+    * empty, so that scanning can resume there when the message grows
+    * without rescanning the lines before it.
+    */
+
+   /// The kernel in use.
+   static Kernel kernel();
+
+   /// The fastest kernel this processor supports.
+   static Kernel supportedKernel();
+
+   /// Use kernel, or the fastest supported one below it; returns the kernel now in use.
+   static Kernel setKernel(Kernel kernel);
+
+   /// The name of kernel, for logging and benchmarks.
+   static const char* kernelName(Kernel kernel);
+
+/* ============================ INQUIRY =================================== */
+
+   /// Whether the n bytes at a and at b differ only in the case of ASCII letters.
+   static bool equalsIgnoreCase(const char* a, const char* b, size_t n);
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   static Kernel sKernel;
+
+   // Not instantiated
+   UtlByteScan();
+};
+
+#endif    // _UtlByteScan_h_
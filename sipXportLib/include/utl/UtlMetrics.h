@@ -0,0 +1,330 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _UtlMetrics_h_
+#define _UtlMetrics_h_
+
+// SYSTEM INCLUDES
+#include <map>
+#include <string>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+// APPLICATION INCLUDES
+#include "utl/UtlDefs.h"
+#include "utl/UtlString.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/**
+ * Counters, gauges and latency histograms of the UtlMetrics registry.
+ *
+ * Recording a value is wait-free: each thread is given one of SHARDS
+ * cache line sized shards (round robin, the first time it records) and
+ * adds to it with a single atomic instruction, so threads on different
+ * shards never write the same cache line.  Reading sums the shards; it
+ * takes no lock and may miss additions made while it runs.
+ */
+class UtlMetric
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   enum
+   {
+      SHARDS = 8,
+      CACHE_LINE = 64
+   };
+
+   enum Type
+   {
+      COUNTER,
+      GAUGE,
+      HISTOGRAM
+   };
+
+   virtual ~UtlMetric() {}
+
+   /// The kind of metric, for the "# TYPE" line of the export.
+   virtual Type getType() const = 0;
+
+   /// Append the samples of this metric in Prometheus text format.
+   virtual void exportText(UtlString& out,
+                           const char* name,
+                           const char* labels  ///< "" or 'a="x",b="y"'
+                           ) const = 0;
+
+/* //////////////////////////// PROTECTED ///////////////////////////////// */
+  protected:
+
+   /// The shard of the calling thread.
+   static unsigned int shard();
+
+   /// Append '<name><suffix>{<labels>} <value>\n'.
+   static void appendSample(UtlString& out, const char* name, const char* suffix,
+                            const char* labels, const char* value);
+};
+
+/// A count that only goes up, such as requests handled.
+class UtlMetricCounter : public UtlMetric
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   UtlMetricCounter();
+
+   /// Add to the count.
+   void add(Int64 n = 1)
+   {
+      __sync_fetch_and_add(&mShards[shard()].value, n);
+   }
+
+   /// The sum over all threads.
+   Int64 getValue() const;
+
+   virtual Type getType() const { return COUNTER; }
+
+   virtual void exportText(UtlString& out, const char* name, const char* labels) const;
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   struct Shard
+   {
+      volatile Int64 value;
+   } __attribute__((aligned(CACHE_LINE)));
+
+   Shard mShards[SHARDS];
+};
+
+/// A value that goes up and down, such as the number of transactions.
+class UtlMetricGauge : public UtlMetric
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   UtlMetricGauge();
+
+   /// Add to (or, with a negative n, subtract from) the value.
+   void add(Int64 n)
+   {
+      __sync_fetch_and_add(&mShards[shard()].value, n);
+   }
+
+   /// Set the value; additions made at the same time by other threads may be lost.
+   void set(Int64 value);
+
+   /// The sum over all threads.
+   Int64 getValue() const;
+
+   virtual Type getType() const { return GAUGE; }
+
+   virtual void exportText(UtlString& out, const char* name, const char* labels) const;
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   struct Shard
+   {
+      volatile Int64 value;
+   } __attribute__((aligned(CACHE_LINE)));
+
+   Shard mShards[SHARDS];
+};
+
+/// Distribution of integer values, usually latencies in microseconds.
+/**
+ * Like UtlHistogram it tallies integer values into bins, but the bins are
+ * log-linear rather than all the same size, so one histogram covers values
+ * from 0 to 2^41 with a relative error of at most 25%:
+ *
+ * Bins 0 to 3 count the values 0 to 3 (negative values are counted in bin 0).
+ * Above that every power of two is split into SUB_BINS bins of equal size,
+ * so 4-7 has bins of size 1, 8-15 of size 2, 16-31 of size 4, and so on.
+ * Bin BINS-1 counts values too large for the others.
+ *
+ * The export multiplies values by the scale given when the histogram was
+ * registered, so latencies measured in microseconds are shown in seconds
+ * as Prometheus expects.
+ */
+class UtlMetricHistogram : public UtlMetric
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   enum
+   {
+      SUB_BINS = 4,
+      MAX_EXPONENT = 40,   ///< values up to 2^(MAX_EXPONENT + 1) - 1 get a bin of their own
+      BINS = SUB_BINS + (MAX_EXPONENT - 1) * SUB_BINS + 1
+   };
+
+   UtlMetricHistogram(double scale = 1.0);
+
+   /// Record a value.
+   void tally(Int64 value)
+   {
+      Shard& s = mShards[shard()];
+      __sync_fetch_and_add(&s.bins[binOf(value)], 1);
+      __sync_fetch_and_add(&s.sum, value);
+   }
+
+   /// The bin a value is counted in.
+   static unsigned int binOf(Int64 value);
+
+   /// The largest value counted in a bin (for the last bin, the largest Int64).
+   static Int64 upperBound(unsigned int bin);
+
+   /// Get the count in a bin, summed over all threads.
+   UInt64 operator[](unsigned int bin) const;
+
+   /// Get the total count.
+   UInt64 getCount() const;
+
+   /// Get the sum of the recorded values.
+   Int64 getSum() const;
+
+   /// Microseconds from a monotonic clock, for measuring latencies.
+   static Int64 now();
+
+   virtual Type getType() const { return HISTOGRAM; }
+
+   virtual void exportText(UtlString& out, const char* name, const char* labels) const;
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   struct Shard
+   {
+      volatile UInt64 bins[BINS];
+      volatile Int64 sum;
+   } __attribute__((aligned(CACHE_LINE)));
+
+   double mScale;
+   Shard mShards[SHARDS];
+};
+
+/// Tallies the microseconds from its construction to its destruction.
+class UtlMetricTimer
+{
+  public:
+
+   UtlMetricTimer(UtlMetricHistogram& histogram)
+      : mHistogram(histogram),
+        mStart(UtlMetricHistogram::now())
+   {
+   }
+
+   ~UtlMetricTimer()
+   {
+      mHistogram.tally(UtlMetricHistogram::now() - mStart);
+   }
+
+  private:
+
+   UtlMetricHistogram& mHistogram;
+   Int64 mStart;
+
+   UtlMetricTimer(const UtlMetricTimer&);
+   UtlMetricTimer& operator=(const UtlMetricTimer&);
+};
+
+/// The process-wide registry of metrics.
+/**
+ * A metric is registered once, by name and labels, and lives until the
+ * process exits; registering the same name and labels again returns the
+ * same metric, so the reference can be kept wherever it is recorded:
+ *
+ * @code
+ * static UtlMetricCounter& requests =
+ *    UtlMetrics::instance().counter("sipx_requests_total", "Requests handled");
+ * requests.add();
+ * @endcode
+ *
+ * Registering takes a lock; recording does not.  exportText() writes every
+ * metric in the Prometheus text exposition format (version 0.0.4).
+ */
+class UtlMetrics
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   /// The MIME type of exportText().
+   static const char* CONTENT_TYPE;
+
+/* ============================ CREATORS ================================== */
+
+   static UtlMetrics& instance();
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// Get or register a counter.
+   UtlMetricCounter& counter(const char* name,
+                             const char* help,
+                             const char* labels = ""  ///< 'a="x",b="y"', see label()
+                             );
+
+   /// Get or register a gauge.
+   UtlMetricGauge& gauge(const char* name,
+                         const char* help,
+                         const char* labels = ""
+                         );
+
+   /// Get or register a histogram.
+   UtlMetricHistogram& histogram(const char* name,
+                                 const char* help,
+                                 const char* labels = "",
+                                 double scale = 1e-6  ///< exported value of 1 recorded unit
+                                 );
+
+/* ============================ ACCESSORS ================================= */
+
+   /// Append all metrics in Prometheus text format.
+   void exportText(UtlString& out) const;
+
+   /// Format a label as name="value", escaping the value.
+   static UtlString label(const char* name, const char* value);
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   typedef boost::mutex mutex_critic_sec;
+   typedef boost::lock_guard<mutex_critic_sec> mutex_critic_sec_lock;
+
+   struct Family
+   {
+      std::string help;
+      UtlMetric::Type type;
+      std::map<std::string, UtlMetric*> metrics;  ///< by labels
+   };
+
+   typedef std::map<std::string, Family> Families;
+
+   mutable mutex_critic_sec mLock;
+   Families mFamilies;   ///< by name
+
+   UtlMetrics();
+
+   /// Find a registered metric, or register the one made by create.
+   UtlMetric* find(const char* name, const char* help, const char* labels,
+                   UtlMetric::Type type, UtlMetric* (*create)(double), double scale);
+
+   UtlMetrics(const UtlMetrics&);
+   UtlMetrics& operator=(const UtlMetrics&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _UtlMetrics_h_
@@ -19,6 +19,7 @@
 #include <utl/UtlDefs.h>
 #include <os/OsDefs.h>
 #include <utl/UtlString.h>
+#include <utl/UtlByteScan.h>
 
 // DEFINES
 // MACROS
@@ -78,9 +79,10 @@ class UtlTokenizer
     */
    UtlTokenizer& operator=(const UtlTokenizer& rhs);
 
-   int nextDelim(const char *tokens, const int start, const int len, const char *delim);
+   int nextDelim(const char *tokens, const int start, const int len,
+                 const UtlByteScan::ByteSet& delim);
 
-   UtlBoolean isDelim(const char c, const char *delim);
+   UtlBoolean isDelim(const char c, const UtlByteScan::ByteSet& delim);
 };
 
 /* ============================ INLINE METHODS ============================ */
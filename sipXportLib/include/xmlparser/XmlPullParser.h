@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef _XmlPullParser_h_
+#define _XmlPullParser_h_
+
+// SYSTEM INCLUDES
+#include <cstddef>
+#include <cstring>
+
+/**
+ * Non-validating, zero-copy XML pull parser.
+ *
+ * The parser walks a caller owned buffer and reports one token per call
+ * to next().  Names, attribute values and text are returned as Slices
+ * pointing into the buffer, still entity encoded; decode them on demand
+ * with Slice::decodeTo().  Open element names and the attributes of the
+ * current element are kept in fixed size arrays, so parsing a document
+ * does no heap allocation at all.
+ *
+ * It is meant for the small event bodies exchanged in NOTIFY and PUBLISH
+ * requests (RFC 4235 dialog-info, RFC 3680 reginfo) where building a DOM
+ * costs much more than the document is worth:
+ *
+ *    XmlPullParser parser(body, length);
+ *    while (parser.next() == XmlPullParser::START_ELEMENT)
+ *    {
+ *       if (parser.getName().equals("dialog")) ...
+ *    }
+ *
+ * Whitespace around the root element, DOCTYPE declarations and the
+ * internal subset are skipped.  Namespaces are not resolved; use
+ * getLocalName() to ignore the prefix.
+ *
+ * This file has no dependencies outside of the standard library so it
+ * can be shared with components that do not link sipXportLib.
+ */
+class XmlPullParser
+{
+public:
+
+   enum Event
+   {
+      START_ELEMENT,          ///< <name attr="value"> or <name/>
+      END_ELEMENT,            ///< </name>, also reported after an empty element
+      TEXT,                   ///< character data, including CDATA sections
+      PROCESSING_INSTRUCTION, ///< <?target content?>, including the XML declaration
+      COMMENT,                ///< <!-- text -->
+      END_DOCUMENT,           ///< end of the buffer after a complete root element
+      ERROR                   ///< malformed input, see getError()
+   };
+
+   enum
+   {
+      MAX_DEPTH = 32,         ///< maximum element nesting
+      MAX_ATTRIBUTES = 32     ///< maximum number of attributes of an element
+   };
+
+   /// A non-owning view of part of the parsed buffer.
+   struct Slice
+   {
+      const char* data;
+      size_t length;
+
+      Slice() : data(""), length(0) {}
+      Slice(const char* d, size_t l) : data(d), length(l) {}
+
+      bool empty() const { return length == 0; }
+
+      /// Compare against a NUL terminated string
+      bool equals(const char* s) const
+      {
+         return strncmp(data, s, length) == 0 && s[length] == '\0';
+      }
+
+      /// True if the slice only holds XML whitespace
+      bool isBlank() const;
+
+      /// Append the raw (still encoded) bytes to value
+      template <class String> void appendTo(String& value) const
+      {
+         value.append(data, length);
+      }
+
+      /// Append the entity decoded bytes to value.
+      /// If condense is set, leading and trailing whitespace is dropped and
+      /// inner runs of whitespace are collapsed into a single space.
+      template <class String> void decodeTo(String& value, bool condense = false) const;
+   };
+
+   /// Parse length bytes of buffer, which must outlive the parser
+   XmlPullParser(const char* buffer, size_t length);
+
+   /// Advance to the next token and return its type.
+   /// After END_DOCUMENT or ERROR every call returns the same event again.
+   Event next();
+
+   /// Type of the current token
+   Event getEvent() const { return mEvent; }
+
+   /// Qualified name of the current element or processing instruction target
+   const Slice& getName() const { return mName; }
+
+   /// Name of the current element without its namespace prefix
+   Slice getLocalName() const;
+
+   /// Raw content of the current TEXT, COMMENT or PROCESSING_INSTRUCTION
+   const Slice& getText() const { return mText; }
+
+   /// True if the current TEXT token came from a CDATA section (never encoded)
+   bool isCData() const { return mCData; }
+
+   /// True if the current START_ELEMENT is an empty element tag
+   bool isEmptyElement() const { return mEmpty; }
+
+   /// Number of open elements, counting the current START_ELEMENT or END_ELEMENT.
+   /// TEXT and COMMENT tokens report the depth of their parent.
+   size_t getDepth() const { return mDepth; }
+
+   /// Attributes of the current START_ELEMENT (and of the XML declaration)
+   size_t getAttributeCount() const { return mAttributeCount; }
+   const Slice& getAttributeName(size_t index) const { return mAttributes[index].name; }
+   const Slice& getAttributeValue(size_t index) const { return mAttributes[index].value; }
+
+   /// Look up an attribute of the current element by its qualified name.
+   /// Returns false if the attribute is not present.
+   bool getAttribute(const char* name, Slice& value) const;
+
+   /// Skip the rest of the current START_ELEMENT, leaving the parser on its END_ELEMENT.
+   /// Returns false if the document ended or was malformed first.
+   bool skipElement();
+
+   /// Append the decoded, whitespace condensed text children of the current
+   /// START_ELEMENT to value (child elements are skipped), leaving the parser
+   /// on its END_ELEMENT.  Returns false if the document was malformed.
+   template <class String> bool readText(String& value);
+
+   /// Offset of the first byte of the current token in the buffer
+   size_t getTokenOffset() const { return mTokenStart - mBuffer; }
+
+   /// Offset just past the current token in the buffer
+   size_t getOffset() const { return mPosition - mBuffer; }
+
+   /// Description of the error when getEvent() returns ERROR
+   const char* getError() const { return mError; }
+
+   /// True if c is XML whitespace
+   static bool isSpace(char c)
+   {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+   }
+
+private:
+
+   struct Attribute
+   {
+      Slice name;
+      Slice value;
+   };
+
+   Event fail(const char* error);
+   Event parseStartTag();
+   Event parseEndTag();
+   Event parseMarkup();
+   Event parseProcessingInstruction();
+   bool parseAttributes(const char*& cursor, const char* end);
+   bool parseName(const char*& cursor, const char* end, Slice& name);
+
+   // Decode the entity at data, appending it to value, and return its length.
+   // Unknown entities are copied through unchanged.
+   template <class String>
+   static size_t decodeEntity(const char* data, size_t length, String& value);
+
+   const char* mBuffer;
+   const char* mEnd;
+   const char* mPosition;
+   const char* mTokenStart;
+
+   Event mEvent;
+   Slice mName;
+   Slice mText;
+   bool mCData;
+   bool mEmpty;
+   bool mPopPending;
+   bool mRootClosed;
+   const char* mError;
+
+   size_t mDepth;
+   Slice mOpenElements[MAX_DEPTH];
+
+   size_t mAttributeCount;
+   Attribute mAttributes[MAX_ATTRIBUTES];
+
+   // Disabled: the slices point into the buffer of the original
+   XmlPullParser(const XmlPullParser&);
+   XmlPullParser& operator=(const XmlPullParser&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+template <class String>
+void XmlPullParser::Slice::decodeTo(String& value, bool condense) const
+{
+   const char* p = data;
+   const char* end = data + length;
+   bool pendingSpace = false;
+   bool written = false;
+
+   while (p < end)
+   {
+      if (condense && isSpace(*p))
+      {
+         pendingSpace = written;
+         ++p;
+         continue;
+      }
+
+      if (pendingSpace)
+      {
+         value.append(" ", 1);
+         pendingSpace = false;
+      }
+
+      // copy the run of plain characters in one go
+      const char* run = p;
+      while (p < end && *p != '&' && !(condense && isSpace(*p)))
+      {
+         ++p;
+      }
+      if (p > run)
+      {
+         value.append(run, p - run);
+      }
+      if (p < end && *p == '&')
+      {
+         p += decodeEntity(p, end - p, value);
+      }
+      written = true;
+   }
+}
+
+template <class String>
+size_t XmlPullParser::decodeEntity(const char* data, size_t length, String& value)
+{
+   const char* semicolon = static_cast<const char*>(memchr(data, ';', length));
+   size_t entityLength = semicolon ? (semicolon - data) + 1 : 0;
+
+   if (entityLength > 2 && data[1] == '#')
+   {
+      unsigned long code = 0;
+      bool hex = (data[2] == 'x' || data[2] == 'X');
+      const char* digits = data + (hex ? 3 : 2);
+      // at least one digit, e.g. not "&#;" or "&#x;"
+      bool valid = digits < semicolon;
+      for (const char* p = digits; p < semicolon && valid; ++p)
+      {
+         char c = *p;
+         if (c >= '0' && c <= '9')
+         {
+            code = code * (hex ? 16 : 10) + (c - '0');
+         }
+         else if (hex && c >= 'a' && c <= 'f')
+         {
+            code = code * 16 + (c - 'a' + 10);
+         }
+         else if (hex && c >= 'A' && c <= 'F')
+         {
+            code = code * 16 + (c - 'A' + 10);
+         }
+         else
+         {
+            valid = false;
+         }
+
+         // stop before a long run of digits can wrap code
+         if (code > 0x10FFFF)
+         {
+            valid = false;
+         }
+      }
+
+      if (valid)
+      {
+         // Values below 0x100 are emitted as a single byte, which is how
+         // XmlEscape encodes 8 bit strings; larger ones as UTF-8.
+         char utf8[4];
+         size_t n;
+         if (code < 0x100)
+         {
+            utf8[0] = (char) code;
+            n = 1;
+         }
+         else if (code < 0x800)
+         {
+            utf8[0] = (char) (0xC0 | (code >> 6));
+            utf8[1] = (char) (0x80 | (code & 0x3F));
+            n = 2;
+         }
+         else if (code < 0x10000)
+         {
+            utf8[0] = (char) (0xE0 | (code >> 12));
+            utf8[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+            utf8[2] = (char) (0x80 | (code & 0x3F));
+            n = 3;
+         }
+         else
+         {
+            utf8[0] = (char) (0xF0 | (code >> 18));
+            utf8[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+            utf8[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+            utf8[3] = (char) (0x80 | (code & 0x3F));
+            n = 4;
+         }
+         value.append(utf8, n);
+         return entityLength;
+      }
+   }
+   else if (entityLength > 0)
+   {
+      static const struct { const char* entity; size_t length; char c; } entities[] =
+      {
+         { "&amp;",  5, '&' },
+         { "&lt;",   4, '<' },
+         { "&gt;",   4, '>' },
+         { "&quot;", 6, '"' },
+         { "&apos;", 6, '\'' }
+      };
+      for (size_t i = 0; i < sizeof(entities) / sizeof(entities[0]); i++)
+      {
+         if (entityLength == entities[i].length
+             && memcmp(data, entities[i].entity, entityLength) == 0)
+         {
+            value.append(&entities[i].c, 1);
+            return entityLength;
+         }
+      }
+   }
+
+   // not a predefined entity (e.g. a substitution placeholder); keep the '&'
+   value.append(data, 1);
+   return 1;
+}
+
+template <class String>
+bool XmlPullParser::readText(String& value)
+{
+   if (mEvent != START_ELEMENT)
+   {
+      return false;
+   }
+
+   size_t depth = mDepth;
+   bool written = false;
+   for (Event event = next(); ; event = next())
+   {
+      switch (event)
+      {
+      case TEXT:
+         if (mDepth == depth && !mText.isBlank())
+         {
+            if (written)
+            {
+               value.append(" ", 1);
+            }
+            if (mCData)
+            {
+               mText.appendTo(value);
+            }
+            else
+            {
+               mText.decodeTo(value, true);
+            }
+            written = true;
+         }
+         break;
+
+      case END_ELEMENT:
+         if (mDepth == depth)
+         {
+            return true;
+         }
+         break;
+
+      case END_DOCUMENT:
+      case ERROR:
+         return false;
+
+      default:
+         break;
+      }
+   }
+}
+
+#endif // _XmlPullParser_h_
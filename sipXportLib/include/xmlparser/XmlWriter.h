@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+#ifndef _XmlWriter_h_
+#define _XmlWriter_h_
+
+// SYSTEM INCLUDES
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+/**
+ * Append-only XML writer, the output side of XmlPullParser.
+ *
+ * Markup is appended straight to the caller's string (UtlString or
+ * std::string, anything with append(const char*, size_t)) so building a
+ * body needs no temporaries; reserve the expected size up front and the
+ * whole document is written with a single allocation.
+ *
+ * The writer does no formatting of its own: the caller decides where line
+ * breaks go, which keeps existing bodies byte for byte identical.
+ *
+ *    XmlWriter<UtlString> writer(body);
+ *    writer.startTag("target").attribute("uri", uri).closeTag().raw("\n");
+ *
+ * Escaping matches XmlEscape() in utl/XmlContent.h.
+ */
+template <class String>
+class XmlWriter
+{
+public:
+
+   explicit XmlWriter(String& output) : mOutput(output) {}
+
+   /// Append markup as is
+   XmlWriter& raw(const char* markup)
+   {
+      mOutput.append(markup, strlen(markup));
+      return *this;
+   }
+
+   XmlWriter& raw(const char* markup, size_t length)
+   {
+      mOutput.append(markup, length);
+      return *this;
+   }
+
+   /// Open a start tag: "<name".  Follow with attribute() calls and closeTag() or emptyTag().
+   XmlWriter& startTag(const char* name)
+   {
+      mOutput.append("<", 1);
+      return raw(name);
+   }
+
+   /// Append ' name="value"' with value escaped
+   XmlWriter& attribute(const char* name, const char* value)
+   {
+      return attribute(name, value, strlen(value));
+   }
+
+   XmlWriter& attribute(const char* name, const char* value, size_t length)
+   {
+      mOutput.append(" ", 1);
+      raw(name);
+      mOutput.append("=\"", 2);
+      escape(mOutput, value, length);
+      mOutput.append("\"", 1);
+      return *this;
+   }
+
+   /// Finish a start tag: ">"
+   XmlWriter& closeTag()
+   {
+      mOutput.append(">", 1);
+      return *this;
+   }
+
+   /// Finish an empty element tag: "/>"
+   XmlWriter& emptyTag()
+   {
+      mOutput.append("/>", 2);
+      return *this;
+   }
+
+   /// Append an end tag: "</name>"
+   XmlWriter& endTag(const char* name)
+   {
+      mOutput.append("</", 2);
+      raw(name);
+      mOutput.append(">", 1);
+      return *this;
+   }
+
+   /// Append escaped character data
+   XmlWriter& text(const char* value)
+   {
+      escape(mOutput, value, strlen(value));
+      return *this;
+   }
+
+   XmlWriter& text(const char* value, size_t length)
+   {
+      escape(mOutput, value, length);
+      return *this;
+   }
+
+   /// Append "<name>value</name>" with value escaped
+   XmlWriter& element(const char* name, const char* value, size_t length)
+   {
+      startTag(name).closeTag();
+      text(value, length);
+      return endTag(name);
+   }
+
+   XmlWriter& element(const char* name, const char* value)
+   {
+      return element(name, value, strlen(value));
+   }
+
+   String& getOutput() { return mOutput; }
+
+   /// Append value to output, escaping the XML special characters and
+   /// the control characters that may not appear in XML as numeric entities.
+   static void escape(String& output, const char* value, size_t length)
+   {
+      const char* end = value + length;
+      const char* run = value;
+
+      for (const char* p = value; p < end; ++p)
+      {
+         unsigned char c = (unsigned char) *p;
+         const char* entity;
+         size_t entityLength;
+         char numeric[8];
+
+         switch (c)
+         {
+         case '"':  entity = "&quot;"; entityLength = 6; break;
+         case '&':  entity = "&amp;";  entityLength = 5; break;
+         case '\'': entity = "&apos;"; entityLength = 6; break;
+         case '<':  entity = "&lt;";   entityLength = 4; break;
+         case '>':  entity = "&gt;";   entityLength = 4; break;
+         default:
+            if (c >= 0x20 || c == '\t' || c == '\n' || c == '\r')
+            {
+               continue;
+            }
+            entityLength = snprintf(numeric, sizeof(numeric), "&#x%02x;", c);
+            entity = numeric;
+            break;
+         }
+
+         if (p > run)
+         {
+            output.append(run, p - run);
+         }
+         output.append(entity, entityLength);
+         run = p + 1;
+      }
+
+      if (end > run)
+      {
+         output.append(run, end - run);
+      }
+   }
+
+private:
+
+   String& mOutput;
+
+   XmlWriter(const XmlWriter&);
+   XmlWriter& operator=(const XmlWriter&);
+};
+
+#endif // _XmlWriter_h_
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <algorithm>
 
 // APPLICATION INCLUDES
 #include "os/OsConfigDb.h"
@@ -24,7 +25,6 @@
 #include "os/OsFS.h"
 #include "os/OsLogger.h"
 #include "os/OsConfigEncryption.h"
-#include "utl/UtlSortedListIterator.h"
 #include "utl/UtlSList.h"
 #include "utl/UtlSListIterator.h"
 
@@ -38,6 +38,20 @@
 static OsConfigEncryption *gEncryption = NULL;
 const UtlContainableType DbEntry::TYPE = "DbEntry";
 
+// Orders mDb by key, the same order DbEntry::compareTo gives
+struct DbEntryKeyLess
+{
+   bool operator()(const DbEntry* a, const DbEntry* b) const
+   {
+      return a->key.compareTo(b->key) < 0;
+   }
+
+   bool operator()(const DbEntry* a, const UtlString& key) const
+   {
+      return a->key.compareTo(key) < 0;
+   }
+};
+
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 
 /* ============================ CREATORS ================================== */
@@ -54,7 +68,11 @@ OsConfigDb::OsConfigDb()
 OsConfigDb::~OsConfigDb()
 {
     OsWriteLock lock(mRWMutex);    // take lock for writing
-    mDb.destroyAll();
+    for (DbEntryVector::iterator it = mDb.begin(); it != mDb.end(); ++it)
+    {
+        delete *it;
+    }
+    mDb.clear();
 }
 
 /* ============================ MANIPULATORS ============================== */
@@ -92,9 +110,9 @@ OsStatus OsConfigDb::loadFromFile(const char *filename)
 
 void OsConfigDb::dump()
 {
-    for (unsigned int i = 0; i < mDb.entries(); i++)
+    for (size_t i = 0; i < mDb.size(); i++)
     {
-        DbEntry *e = (DbEntry *)mDb.at(i);
+        DbEntry *e = mDb[i];
         osPrintf(DB_LINE_FORMAT, e->key.data(), e->value.data());
     }
 }
@@ -129,7 +147,7 @@ OsStatus OsConfigDb::loadFromFile(FILE* fp)
 #  undef OK
 #  endif
 
-void OsConfigDb::insertEntry(const char* fileLine)
+void OsConfigDb::insertEntry(const char* fileLine, bool deferSort)
 {
    /* Format of a config line is:
     *     whitespace name whitespace : whitespace value whitespace EOL
@@ -206,7 +224,14 @@ void OsConfigDb::insertEntry(const char* fileLine)
             }
 
             // Insert the entry.
-            insertEntry(name, value);
+            if (deferSort)
+            {
+               mDb.push_back(new DbEntry(name, value));
+            }
+            else
+            {
+               insertEntry(name, value);
+            }
          }
          else
          {
@@ -277,18 +302,15 @@ OsStatus OsConfigDb::storeToFile(const char *filename)
 OsStatus OsConfigDb::remove(const UtlString& rKey)
 {
    OsWriteLock lock(mRWMutex);
-   DbEntry    lookupPair(rKey);
-   DbEntry*   pEntryToRemove;
-   ssize_t i = mDb.index(&lookupPair);
+   ssize_t i = findEntry(rKey);
    if (i == UTL_NOT_FOUND)
    {
       return OS_NOT_FOUND;
    }
    else
    {
-      pEntryToRemove = (DbEntry *)mDb.at(i);
-      mDb.removeAt(i);
-      delete pEntryToRemove;
+      delete mDb[i];
+      mDb.erase(mDb.begin() + i);
 
       return OS_SUCCESS;
    }
@@ -298,21 +320,24 @@ OsStatus OsConfigDb::remove(const UtlString& rKey)
 OsStatus OsConfigDb::removeByPrefix(const UtlString& rPrefix)
 {
    OsWriteLock lock(mRWMutex);
-   DbEntry* pEntry ;
 
-   UtlSortedListIterator itor(mDb) ;
-   while ((pEntry = (DbEntry*) itor()))
+   // The prefix matches regardless of case, so matching keys need not be
+   // adjacent: compact the kept entries in a single pass.
+   DbEntryVector::iterator kept = mDb.begin();
+   for (DbEntryVector::iterator it = mDb.begin(); it != mDb.end(); ++it)
    {
-       if (pEntry->key.length() >= rPrefix.length())
+       DbEntry* pEntry = *it;
+       if (pEntry->key.length() >= rPrefix.length()
+           && strncasecmp(pEntry->key.data(), rPrefix.data(), rPrefix.length()) == 0)
        {
-           UtlString keyPrefix = pEntry->key ;
-           keyPrefix.remove(rPrefix.length()) ;
-           if (keyPrefix.compareTo(rPrefix, UtlString::ignoreCase) == 0)
-           {
-               remove(pEntry->key) ;
-           }
+           delete pEntry;
+       }
+       else
+       {
+           *kept++ = pEntry;
        }
    }
+   mDb.erase(kept, mDb.end());
 
    return OS_SUCCESS ;
 }
@@ -393,10 +418,7 @@ OsConfigEncryption *OsConfigDb::getStaticEncryption()
 OsStatus OsConfigDb::get(const UtlString& rKey, UtlString& rValue) const
 {
    OsReadLock lock(mRWMutex);
-   DbEntry   lookupPair(rKey);
-   ssize_t        i;
-   DbEntry*  pEntry;
-   i = mDb.index(&lookupPair);
+   ssize_t i = findEntry(rKey);
    if (i == UTL_NOT_FOUND)
    {
       rValue = "";     // entry not found
@@ -404,8 +426,7 @@ OsStatus OsConfigDb::get(const UtlString& rKey, UtlString& rValue) const
    }
    else
    {
-      pEntry = (DbEntry *)mDb.at(i);
-      rValue = pEntry->value;
+      rValue = mDb[i]->value;
    }
 
    return OS_SUCCESS;
@@ -416,25 +437,14 @@ OsStatus OsConfigDb::get(const UtlString& rKey, UtlString& rValue) const
 OsStatus OsConfigDb::getSubHash(const UtlString& rHashSubKey,
                                 OsConfigDb& rSubDb) const
 {
-   UtlSortedListIterator itor(mDb);
-
-   DbEntry* entry;
-   // Skip the initial entries in the list that do not match.
-   while ((entry = dynamic_cast <DbEntry*> (itor())))
-   {
-      if (strncmp(entry->key.data(), rHashSubKey.data(),
-                  rHashSubKey.length()) >= 0)
-      {
-         break;
-      }
-   }
-
-   // Process the entries in the list that do match.
-   for (; entry &&
-           strncmp(entry->key.data(), rHashSubKey.data(),
-                   rHashSubKey.length()) == 0;
-        entry = dynamic_cast <DbEntry*> (itor()))
+   // Keys with the prefix sort together, starting at the prefix itself.
+   for (size_t i = lowerBound(rHashSubKey);
+        i < mDb.size()
+           && strncmp(mDb[i]->key.data(), rHashSubKey.data(),
+                      rHashSubKey.length()) == 0;
+        i++)
    {
+      DbEntry* entry = mDb[i];
       // Construct and add the entry to the subhash.
       // Make temporary UtlString, because that's what insertEntry demands
       // as an argument.
@@ -522,8 +532,7 @@ OsStatus OsConfigDb::getNext(const UtlString& rKey,
 {
    OsReadLock lock(mRWMutex);
    UtlBoolean  foundMatch;
-   int        nextIdx = 0;
-   DbEntry   lookupPair(rKey);
+   size_t     nextIdx = 0;
    ssize_t        idx;
    DbEntry*  pEntry;
 
@@ -535,7 +544,7 @@ OsStatus OsConfigDb::getNext(const UtlString& rKey,
    }
    else
    {
-      idx = mDb.index(&lookupPair);
+      idx = findEntry(rKey);
       if (idx != UTL_NOT_FOUND)
       {
          foundMatch = TRUE;
@@ -543,9 +552,9 @@ OsStatus OsConfigDb::getNext(const UtlString& rKey,
       }
    }
 
-   if (foundMatch && (nextIdx < numEntries()))
+   if (foundMatch && (nextIdx < mDb.size()))
    {
-      pEntry     = (DbEntry *)mDb.at(nextIdx);
+      pEntry     = mDb[nextIdx];
       rNextKey   = pEntry->key;
       rNextValue = pEntry->value;
 
@@ -680,7 +689,7 @@ UtlBoolean OsConfigDb::isEmpty(void) const
 {
    OsReadLock lock(mRWMutex);
 
-   return (mDb.entries() == 0);
+   return mDb.empty();
 }
 
 // Return the number of entries in the config database
@@ -688,7 +697,7 @@ int OsConfigDb::numEntries(void) const
 {
    OsReadLock lock(mRWMutex);
 
-   return mDb.entries();
+   return mDb.size();
 }
 
 void OsConfigDb::storeToBuffer(char *buff) const
@@ -697,14 +706,12 @@ void OsConfigDb::storeToBuffer(char *buff) const
     int n = numEntries();
     for (int i = 0; i < n; i++)
     {
-        DbEntry *pEntry = (DbEntry *)mDb.at(i);
+        DbEntry *pEntry = mDb[i];
         removeChars(&pEntry->key, '\r');
         removeChars(&pEntry->value, '\n');
 
-        sprintf(p, DB_LINE_FORMAT, (char *)pEntry->key.data(),
-                (char *)pEntry->value.data());
-
-        p = buff + strlen(buff);
+        p += sprintf(p, DB_LINE_FORMAT, (char *)pEntry->key.data(),
+                     (char *)pEntry->value.data());
     }
 }
 
@@ -715,7 +722,7 @@ int OsConfigDb::calculateBufferSize() const
     size_t size = n * strlen(DB_LINE_FORMAT);
     for (int i = 0; i < n; i++)
     {
-        DbEntry *pEntry = (DbEntry *)mDb.at(i);
+        DbEntry *pEntry = mDb[i];
         size += pEntry->key.length() + pEntry->value.length();
     }
     return (int)size;
@@ -795,7 +802,7 @@ OsStatus OsConfigDb::storeToFile(FILE* fp)
    cnt = numEntries();
    for (i=0; i < cnt; i++)
    {
-      pEntry = (DbEntry *)mDb.at(i);
+      pEntry = mDb[i];
 
       //remove any  \n or \r at the ends of the lines
       ssize_t remove_char_loc = 0;
@@ -896,7 +903,7 @@ OsStatus OsConfigDb::loadFromUnencryptedFile(FILE* fp)
       {
         if (!fileLine.empty())
         {
-          insertEntry(fileLine.c_str());
+          insertEntry(fileLine.c_str(), true);
           fileLine = "";
         }
       }
@@ -905,6 +912,7 @@ OsStatus OsConfigDb::loadFromUnencryptedFile(FILE* fp)
         fileLine.push_back(c);
       }
    }
+   sortEntries();
 
    return retval;
 }
@@ -990,13 +998,14 @@ OsStatus OsConfigDb::loadFromUnencryptedBuffer(const char *buf)
 
          if (strlen(configLine) == 0) continue;
 
-         insertEntry(configLine);
+         insertEntry(configLine, true);
       }
       else
       {
          break;         // end of buffer reached.
       }
    }
+   sortEntries();
 
    return retval;
 }
@@ -1009,25 +1018,52 @@ OsStatus OsConfigDb::loadFromUnencryptedBuffer(const char *buf)
 void OsConfigDb::insertEntry(const UtlString& rKey,
                              const UtlString& rNewValue)
 {
-   DbEntry  tempEntry(rKey, rNewValue);
-   DbEntry* pOldEntry;
-   ssize_t       i;
-   i = mDb.index(&tempEntry);
-   if (i != UTL_NOT_FOUND)
+   size_t i = lowerBound(rKey);
+   if (i < mDb.size() && mDb[i]->key.compareTo(rKey) == 0)
    {                             // we already have an entry with this key
-          pOldEntry = (DbEntry *)mDb.at(i);        //  just change its value
-      // osPrintf("OsConfigDb::iNVP(%X,%s) - FOUND %s replaces %s\n",
-                  // this, rKey.data(), pOldEntry->value.data(), rNewValue.data());
-      pOldEntry->value = rNewValue;
+      mDb[i]->value = rNewValue;  //  just change its value
    }
    else
    {
-      DbEntry* pNewEntry = new DbEntry(rKey, rNewValue);
+      // appending keys in order (as getSubHash does) moves nothing
+      mDb.insert(mDb.begin() + i, new DbEntry(rKey, rNewValue));
+   }
+}
+
+void OsConfigDb::sortEntries()
+{
+   // stable, so of several entries for one key the last added ends up last
+   std::stable_sort(mDb.begin(), mDb.end(), DbEntryKeyLess());
+
+   DbEntryVector::iterator kept = mDb.begin();
+   for (DbEntryVector::iterator it = mDb.begin(); it != mDb.end(); ++it)
+   {
+      DbEntryVector::iterator next = it + 1;
+      if (next != mDb.end() && (*next)->key.compareTo((*it)->key) == 0)
+      {
+         delete *it;             // superseded by a later value
+      }
+      else
+      {
+         *kept++ = *it;
+      }
+   }
+   mDb.erase(kept, mDb.end());
+}
 
-      // osPrintf("OsConfigDb::iNVP(%X,%s) - ADDING (%s)\n",
-                  // this, rKey.data(), rNewValue.data());
-      mDb.insert(pNewEntry);
+size_t OsConfigDb::lowerBound(const UtlString& rKey) const
+{
+   return std::lower_bound(mDb.begin(), mDb.end(), rKey, DbEntryKeyLess()) - mDb.begin();
+}
+
+ssize_t OsConfigDb::findEntry(const UtlString& rKey) const
+{
+   size_t i = lowerBound(rKey);
+   if (i < mDb.size() && mDb[i]->key.compareTo(rKey) == 0)
+   {
+      return i;
    }
+   return UTL_NOT_FOUND;
 }
 
 //----------------DbEntry ------------------------
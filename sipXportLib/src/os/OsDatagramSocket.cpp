@@ -30,6 +30,7 @@
 #elif defined(__pingtel_on_posix__)
 #   include <sys/types.h>
 #   include <sys/socket.h>
+#   include <sys/uio.h>
 #   include <netdb.h>
 #   include <netinet/in.h>
 #   include <arpa/inet.h>
@@ -136,6 +137,20 @@ OsDatagramSocket::OsDatagramSocket(int remoteHostPortNum,
     }
 #endif
 
+#ifdef SO_REUSEPORT
+    // Share a given port with the other processes serving it
+    if (OsSocket::getReusePort() && portIsValid(localHostPort))
+    {
+        int reusePort = 1;
+        if (setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEPORT, &reusePort, sizeof(reusePort)) != 0)
+        {
+            Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                    "OsDatagramSocket::_ socket %d failed to set SO_REUSEPORT (errno=%d)",
+                    socketDescriptor, OsSocketGetERRNO());
+        }
+    }
+#endif
+
     // Bind to the socket
     memset(&localAddr, 0, sizeof(localAddr));
     localAddr.sin_family = AF_INET;
@@ -398,6 +413,61 @@ int OsDatagramSocket::write(const char* buffer, int bufferLength,
     return(bytesSent);
 }
 
+int OsDatagramSocket::write(const char* header, int headerLength,
+                            const char* body, int bodyLength,
+                            const char* ipAddress, int port)
+{
+#if defined(__pingtel_on_posix__)
+    int bytesSent = 0;
+
+    struct sockaddr_in toSockAddress;
+    toSockAddress.sin_family = AF_INET;
+    toSockAddress.sin_port = htons(port);
+
+    if(ipAddress == NULL || !strcmp(ipAddress, "0.0.0.0") ||
+        strlen(ipAddress) == 0 ||
+        (toSockAddress.sin_addr.s_addr = inet_addr(ipAddress)) ==
+            OS_INVALID_INET_ADDRESS)
+    {
+        osPrintf("OsDatagramSocket::write invalid IP address: \"%s\"\n",
+            ipAddress);
+    }
+    else
+    {
+        struct iovec parts[2];
+        parts[0].iov_base = const_cast<char*>(header);
+        parts[0].iov_len = headerLength;
+        parts[1].iov_base = const_cast<char*>(body);
+        parts[1].iov_len = bodyLength;
+
+        struct msghdr datagram;
+        memset(&datagram, 0, sizeof(datagram));
+        datagram.msg_name = &toSockAddress;
+        datagram.msg_namelen = sizeof(toSockAddress);
+        datagram.msg_iov = parts;
+        datagram.msg_iovlen = bodyLength > 0 ? 2 : 1;
+
+        bytesSent = sendmsg(socketDescriptor, &datagram, 0);
+
+        if(bytesSent != headerLength + bodyLength)
+        {
+           Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                         "OsDatagramSocket::write(6) %d ipAddress = '%s', "
+                         "port = %d, bytesSent = %d, "
+                         "bufferLength = %d, errno = %d '%s'",
+                         socketDescriptor, ipAddress, port,
+                         bytesSent, headerLength + bodyLength, errno, strerror(errno));
+           mNumRecentWriteErrors++;
+        }
+    }
+    return(bytesSent);
+#else
+    UtlString buffer(header, headerLength);
+    buffer.append(body, bodyLength);
+    return write(buffer.data(), buffer.length(), ipAddress, port);
+#endif
+}
+
 UtlBoolean OsDatagramSocket::getToSockaddr()
 {
     const char* ipAddress = mRemoteIpAddress.data();
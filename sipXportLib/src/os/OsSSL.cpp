@@ -12,13 +12,27 @@
 #include <openssl/rand.h>
 #include <openssl/x509v3.h>
 #include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
 
 // APPLICATION INCLUDES
 #include "os/OsSSL.h"
 #include "os/OsLock.h"
 #include "os/OsLogger.h"
+#include "os/OsDateTime.h"
 #include "utl/UtlString.h"
 #include "utl/UtlSList.h"
+#include "utl/UtlVoidPtr.h"
+#include "utl/UtlHashMapIterator.h"
 
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
@@ -30,8 +44,42 @@ static UtlString defaultAuthorityPath         = SIPX_CONFDIR "/ssl/authorities";
 static UtlString defaultCAFile                = SIPX_CONFDIR "/ssl/ca.crt";
 static bool isCertificateAuthorityEnabled        = false;
 
+// Server side session cache
+#define SESSION_CACHE_SIZE        20480
+#define SESSION_TIMEOUT_SECS      3600
+// Session ticket keys are replaced this often; tickets made with the
+// previous key are still accepted (and renewed) for another period.
+#define TICKET_KEY_LIFETIME_SECS  (12 * 3600)
+// Client sessions kept, one per peer address
+#define MAX_CLIENT_SESSIONS       1024
+
+static const unsigned char SESSION_ID_CONTEXT[] = "sipXportLib";
+
 bool OsSSL::sInitialized = false;
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
 OsMutex* OsSSL::spOpenSSL_locks[];
+#endif
+
+// Build the key identifying the peer of a connected SSL handle ("address:port")
+static bool peerAddress(SSL* connection, UtlString& address)
+{
+   struct sockaddr_in peer;
+   socklen_t length = sizeof(peer);
+   int fd = SSL_get_fd(connection);
+
+   if (fd < 0
+       || getpeername(fd, (struct sockaddr*) &peer, &length) != 0
+       || peer.sin_family != AF_INET)
+   {
+      return false;
+   }
+
+   char port[8];
+   snprintf(port, sizeof(port), ":%d", ntohs(peer.sin_port));
+   address = inet_ntoa(peer.sin_addr);
+   address.append(port);
+   return true;
+}
 
 
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
@@ -45,8 +93,11 @@ OsSSL::OsSSL(const char* authorityPath,
              const char* publicCertificateFile,
              const char* privateKeyPath,
              const char* certificateAuthority
-             )
+             ) :
+   mSessionLock(OsMutex::Q_FIFO)
 {
+   memset(mTicketKeys, 0, sizeof(mTicketKeys));
+
    if (!sInitialized)
    {
       // Initialize random number generator before using SSL
@@ -140,9 +191,7 @@ OsSSL::OsSSL(const char* authorityPath,
                                      verifyCallback
                                      );
 
-                  // disable server connection caching
-                  // TODO: Investigate turning this on...
-                  SSL_CTX_set_session_cache_mode(mCTX, SSL_SESS_CACHE_OFF);
+                  initSessionCache();
                }
                else
                {
@@ -201,6 +250,11 @@ OsSSL::~OsSSL()
    // they must be freed when threads are terminated in order to avoid memory leaks.
    ERR_remove_state(0);
 
+   {
+      OsLock lock(mSessionLock);
+      clearClientSessions();
+   }
+
    if (mCTX)
    {
       Os::Logger::instance().log(FAC_KERNEL, PRI_DEBUG, "OsSSL::~ SSL_CTX free %p", mCTX);
@@ -237,6 +291,7 @@ void OsSSL::enableCertificateAuthority(bool enable)
 }
 void OsSSL::OpenSSL_thread_setup()
 {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
    if (sInitialized)
    {
       return;
@@ -252,16 +307,19 @@ void OsSSL::OpenSSL_thread_setup()
 
    // set ID callback for linux, where getpid() returns the same for multiple threads
    CRYPTO_set_id_callback(OpenSSL_id_function);
+#endif
 }
 
 void OsSSL::OpenSSL_thread_cleanup()
 {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
    CRYPTO_set_locking_callback(NULL);
    for (int i=0 ; i<CRYPTO_NUM_LOCKS ; i++)
    {
       delete spOpenSSL_locks[i];
       spOpenSSL_locks[i] = NULL;
    }
+#endif
 }
 
 /// callback for OpenSSL CRYPTO_set_id_callback
@@ -278,6 +336,7 @@ unsigned long OsSSL::OpenSSL_id_function(void)
 /// callback for OpenSSL CRYPTO_set_locking_callback
 void OsSSL::OpenSSL_locking_function(int mode, int n, const char *file, int line)
 {
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
    if (mode & CRYPTO_LOCK)
    {
       spOpenSSL_locks[n]->acquire();
@@ -286,6 +345,7 @@ void OsSSL::OpenSSL_locking_function(int mode, int n, const char *file, int line
    {
       spOpenSSL_locks[n]->release();
    }
+#endif
 }
 
 /* ============================ ACCESSORS ================================= */
@@ -346,6 +406,37 @@ void OsSSL::releaseConnection(SSL*& connection)
    }
 }
 
+void OsSSL::resumeClientSession(SSL* connection)
+{
+   UtlString peer;
+   if (connection && peerAddress(connection, peer))
+   {
+      OsLock lock(mSessionLock);
+
+      UtlVoidPtr* cached = dynamic_cast<UtlVoidPtr*>(mClientSessions.findValue(&peer));
+      if (cached)
+      {
+         // SSL_set_session takes its own reference
+         SSL_set_session(connection, (SSL_SESSION*) cached->getValue());
+         Os::Logger::instance().log(FAC_KERNEL, PRI_DEBUG,
+                       "OsSSL::resumeClientSession %p offering cached session for %s",
+                       connection, peer.data());
+      }
+   }
+}
+
+void OsSSL::flushSessions()
+{
+   OsLock lock(mSessionLock);
+
+   clearClientSessions();
+   memset(mTicketKeys, 0, sizeof(mTicketKeys));
+   if (mCTX)
+   {
+      SSL_CTX_flush_sessions(mCTX, LONG_MAX);
+   }
+}
+
 void OsSSL::logConnectParams(const OsSysLogFacility facility, ///< callers facility
                              const OsSysLogPriority priority, ///< log priority
                              const char* callerMsg,  ///< Identifies circumstances of connection
@@ -415,12 +506,14 @@ void OsSSL::logConnectParams(const OsSysLogFacility facility, ///< callers facil
       Os::Logger::instance().log(FAC_KERNEL, PRI_DEBUG,
                     "%s SSL Connection:\n"
                     "   status:  %s\n"
+                    "   session: %s\n"
                     "   peer:    '%s'\n"
                     "   alt names: %s\n"
                     "   cipher:  '%s'\n"
                     "   issuer:  '%s'",
                     callerMsg,
                     validity == X509_V_OK ? "Verified" : "NOT VERIFIED",
+                    SSL_session_reused(connection) ? "resumed" : "new",
                     subjectStr ? subjectStr : "",
                     altNames.isNull() ? "" : altNames.data(),
                     cipher     ? cipher     : "",
@@ -618,6 +711,188 @@ OsSSL* OsSharedSSL::get()
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 
+void OsSSL::initSessionCache()
+{
+   // Resumed sessions must come from a context with the same verification policy
+   SSL_CTX_set_session_id_context(mCTX, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+
+   SSL_CTX_set_app_data(mCTX, this);
+   SSL_CTX_set_session_cache_mode(mCTX, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_CLIENT);
+   SSL_CTX_sess_set_cache_size(mCTX, SESSION_CACHE_SIZE);
+   SSL_CTX_set_timeout(mCTX, SESSION_TIMEOUT_SECS);
+   SSL_CTX_sess_set_new_cb(mCTX, newSessionCallback);
+
+   // Stateless resumption, with keys that are ours to rotate
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   SSL_CTX_set_tlsext_ticket_key_evp_cb(mCTX, ticketKeyCallback);
+#else
+   SSL_CTX_set_tlsext_ticket_key_cb(mCTX, ticketKeyCallback);
+#endif
+}
+
+void OsSSL::rotateTicketKeys(long now)
+{
+   if (mTicketKeys[0].created != 0
+       && now - mTicketKeys[0].created < TICKET_KEY_LIFETIME_SECS)
+   {
+      return;
+   }
+
+   TicketKey key;
+   if (   RAND_bytes(key.name, sizeof(key.name)) <= 0
+       || RAND_bytes(key.aesKey, sizeof(key.aesKey)) <= 0
+       || RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) <= 0)
+   {
+      Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                    "OsSSL::rotateTicketKeys unable to generate a session ticket key");
+      return;
+   }
+   key.created = now;
+
+   memmove(&mTicketKeys[1], &mTicketKeys[0], sizeof(TicketKey) * (TICKET_KEYS - 1));
+   mTicketKeys[0] = key;
+
+   Os::Logger::instance().log(FAC_KERNEL, PRI_INFO,
+                 "OsSSL::rotateTicketKeys %p new session ticket key", this);
+}
+
+int OsSSL::findTicketKey(unsigned char* name, bool encrypt, TicketKey& key)
+{
+   OsLock lock(mSessionLock);
+
+   OsTime now;
+   OsDateTime::getCurTimeSinceBoot(now);
+   rotateTicketKeys(now.seconds());
+
+   if (encrypt)
+   {
+      if (mTicketKeys[0].created == 0)
+      {
+         return 0;
+      }
+      key = mTicketKeys[0];
+      memcpy(name, key.name, sizeof(key.name));
+      return 1;
+   }
+
+   for (int i = 0; i < TICKET_KEYS; i++)
+   {
+      if (mTicketKeys[i].created != 0
+          && memcmp(name, mTicketKeys[i].name, sizeof(mTicketKeys[i].name)) == 0)
+      {
+         key = mTicketKeys[i];
+         return i == 0 ? 1 : 2;
+      }
+   }
+   return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int OsSSL::ticketKeyCallback(SSL* connection, unsigned char* keyName, unsigned char* iv,
+                             EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* hmacCtx, int encrypt)
+#else
+int OsSSL::ticketKeyCallback(SSL* connection, unsigned char* keyName, unsigned char* iv,
+                             EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* hmacCtx, int encrypt)
+#endif
+{
+   OsSSL* ssl = (OsSSL*) SSL_CTX_get_app_data(SSL_get_SSL_CTX(connection));
+   TicketKey key;
+
+   int result = ssl ? ssl->findTicketKey(keyName, encrypt, key) : 0;
+   if (result == 0)
+   {
+      // no key: issue no ticket, or do a full handshake
+      return 0;
+   }
+
+   if (encrypt)
+   {
+      if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) <= 0
+          || !EVP_EncryptInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, key.aesKey, iv))
+      {
+         return -1;
+      }
+   }
+   else if (!EVP_DecryptInit_ex(cipherCtx, EVP_aes_256_cbc(), NULL, key.aesKey, iv))
+   {
+      return -1;
+   }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+   OSSL_PARAM params[3];
+   params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmacKey, sizeof(key.hmacKey));
+   params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*) "SHA256", 0);
+   params[2] = OSSL_PARAM_construct_end();
+   if (!EVP_MAC_CTX_set_params(hmacCtx, params))
+#else
+   if (!HMAC_Init_ex(hmacCtx, key.hmacKey, sizeof(key.hmacKey), EVP_sha256(), NULL))
+#endif
+   {
+      return -1;
+   }
+
+   return result;
+}
+
+int OsSSL::newSessionCallback(SSL* connection, SSL_SESSION* session)
+{
+   // Server sessions are kept by the OpenSSL session cache
+   if (SSL_is_server(connection))
+   {
+      return 0;
+   }
+
+   OsSSL* ssl = (OsSSL*) SSL_CTX_get_app_data(SSL_get_SSL_CTX(connection));
+   return ssl && ssl->saveClientSession(connection, session) ? 1 : 0;
+}
+
+bool OsSSL::saveClientSession(SSL* connection, SSL_SESSION* session)
+{
+   UtlString peer;
+   if (!peerAddress(connection, peer))
+   {
+      return false;
+   }
+
+   OsLock lock(mSessionLock);
+
+   UtlContainable* value = NULL;
+   UtlContainable* key = mClientSessions.removeKeyAndValue(&peer, value);
+   if (key)
+   {
+      SSL_SESSION_free((SSL_SESSION*) static_cast<UtlVoidPtr*>(value)->getValue());
+      delete key;
+      delete value;
+   }
+   else if (mClientSessions.entries() >= MAX_CLIENT_SESSIONS)
+   {
+      // Make room by dropping an arbitrary peer; it just does a full handshake next time
+      UtlHashMapIterator sessions(mClientSessions);
+      UtlContainable* victim = sessions();
+      if (victim)
+      {
+         UtlContainable* victimKey = mClientSessions.removeKeyAndValue(victim, value);
+         SSL_SESSION_free((SSL_SESSION*) static_cast<UtlVoidPtr*>(value)->getValue());
+         delete victimKey;
+         delete value;
+      }
+   }
+
+   // The reference passed by OpenSSL is ours now
+   mClientSessions.insertKeyAndValue(new UtlString(peer), new UtlVoidPtr(session));
+   return true;
+}
+
+void OsSSL::clearClientSessions()
+{
+   UtlHashMapIterator sessions(mClientSessions);
+   while (sessions())
+   {
+      SSL_SESSION_free((SSL_SESSION*) static_cast<UtlVoidPtr*>(sessions.value())->getValue());
+   }
+   mClientSessions.destroyAll();
+}
+
 OsBSem* OsSharedSSL::spSslLock   = new OsBSem(OsBSem::Q_PRIORITY, OsBSem::FULL);
 OsSSL*  OsSharedSSL::spSharedSSL = NULL;
 
@@ -269,6 +269,12 @@ bool OsSSLConnectionSocket::isEncrypted() const
 }
 
 
+/// Was the TLS session resumed rather than fully negotiated?
+bool OsSSLConnectionSocket::isSessionReused() const
+{
+   return mSSL && SSL_session_reused(mSSL);
+}
+
 /// Get any authenticated peer host names.
 bool OsSSLConnectionSocket::peerIdentity( UtlSList* altNames
                                          ,UtlString* commonName
@@ -339,12 +345,16 @@ void OsSSLConnectionSocket::SSLInitSocket(int socket, long timeoutInSecs)
        int err = -1;
 
        // TODO: eventually this should allow for other SSL contexts...
-       mSSL = OsSharedSSL::get()->getServerConnection();
+       OsSSL* sslContext = OsSharedSSL::get();
+       mSSL = sslContext->getClientConnection();
 
        if (mSSL && (socketDescriptor > OS_INVALID_SOCKET_DESCRIPTOR))
        {
           SSL_set_fd (mSSL, socketDescriptor);
 
+          // skip the full handshake if this peer still knows our last session
+          sslContext->resumeClientSession(mSSL);
+
           err = SSL_connect(mSSL);
           if (err > 0)
           {
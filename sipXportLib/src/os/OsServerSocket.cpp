@@ -98,6 +98,12 @@ OsServerSocket::OsServerSocket(int connectionQueueSize,
    if(setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR, (char *)&one, sizeof(one)))
       Os::Logger::instance().log(FAC_KERNEL, PRI_ERR, "OsServerSocket: setsockopt(SO_REUSEADDR) failed!");
 #endif
+#ifdef SO_REUSEPORT
+   // Share a given port with the other processes serving it
+   if (OsSocket::getReusePort() && portIsValid(serverPort) &&
+       setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEPORT, (char *)&one, sizeof(one)))
+      Os::Logger::instance().log(FAC_KERNEL, PRI_ERR, "OsServerSocket: setsockopt(SO_REUSEPORT) failed!");
+#endif
 /*
     Don't know why we don't want to route...we do support subnets, do we not?
     setsockopt(socketDescriptor, SOL_SOCKET, SO_DONTROUTE, (char *)&one, sizeof(one)) ;
@@ -304,6 +310,16 @@ int OsServerSocket::getLocalHostPort() const
    return(localHostPort);
 }
 
+int OsServerSocket::getSocketDescriptor() const
+{
+   return(socketDescriptor);
+}
+
+const UtlString& OsServerSocket::getLocalIp() const
+{
+   return(mLocalIp);
+}
+
 /* ============================ INQUIRY =================================== */
 
 UtlBoolean OsServerSocket::isOk() const
@@ -84,6 +84,7 @@ UtlString  OsSocket::m_DomainName = "";
 // this should be htonl(INADDR_ANY) but count on it being 0...
 // seems that g++ won't compile it with optimization enabled for some reason.
 unsigned long OsSocket::m_DefaultBindAddress = INADDR_ANY;
+UtlBoolean OsSocket::m_ReusePort = FALSE;
 
 OsBSem OsSocket::mInitializeSem(OsBSem::Q_PRIORITY, OsBSem::FULL);
 
@@ -852,6 +853,18 @@ void OsSocket::setDefaultBindAddress(const unsigned long bind_address)
     mInitializeSem.release();
 }
 
+void OsSocket::setReusePort(UtlBoolean reusePort)
+{
+    mInitializeSem.acquire();
+    m_ReusePort = reusePort;
+    mInitializeSem.release();
+}
+
+UtlBoolean OsSocket::getReusePort()
+{
+    return m_ReusePort;
+}
+
 bool OsSocket::lock(bool force)
 {
   bool lock = (force || (OsSocket::SAFE_WRITE & mFlags));
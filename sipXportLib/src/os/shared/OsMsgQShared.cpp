@@ -17,9 +17,29 @@
 #include "os/shared/OsMsgQShared.h"
 #include "os/OsDateTime.h"
 #include "os/OsLogger.h"
+#include "utl/UtlMetrics.h"
 
 static OsMsgQShared::QueuePreference gQueuePreference = OsMsgQShared::QUEUE_LIMITED;
 
+// Messages waiting in all queues, and the depth of each queue as messages are sent.
+static UtlMetricGauge& queuedMessages()
+{
+   static UtlMetricGauge& gauge =
+      UtlMetrics::instance().gauge("sipx_msgq_messages",
+                                   "Messages waiting in all message queues");
+   return gauge;
+}
+
+static UtlMetricHistogram& queueDepth()
+{
+   static UtlMetricHistogram& histogram =
+      UtlMetrics::instance().histogram("sipx_msgq_depth",
+                                       "Messages in the queue a message is sent to, "
+                                       "including that message",
+                                       "", 1.0);
+   return histogram;
+}
+
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 
 /* ============================ CREATORS ================================== */
@@ -206,7 +226,13 @@ OsStatus OsMsgQShared::doSendCore(OsMsg* pMsg,
 
 
    int count = numMsgs();
-   
+
+   if (ret == OS_SUCCESS)
+   {
+      queuedMessages().add(1);
+      queueDepth().tally(count);
+   }
+
    if (_reportFull && 2 * count > mMaxMsgs)
    {
      OS_LOG_WARNING(FAC_KERNEL,
@@ -238,6 +264,11 @@ OsStatus OsMsgQShared::doReceive(OsMsg*& rpMsg, const OsTime& rTimeout)
     ret = OS_SUCCESS;
   }
 
+  if (ret == OS_SUCCESS)
+  {
+     queuedMessages().add(-1);
+  }
+
    system_tap_queue_dequeue(mName.data(), 0, _queue.size());
 
    return ret;
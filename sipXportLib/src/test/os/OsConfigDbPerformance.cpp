@@ -0,0 +1,144 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Start up cost of a large OsConfigDb.
+//
+// A configuration of KEYS keys (10000 by default) is generated in the
+// order a hand written file would have it, grouped by prefix but not
+// sorted, then timed through what a service does at start up: load it,
+// get() every key, pull a getSubHash() and a loadList() for each prefix,
+// walk it with getNext() and write it out with storeToBuffer().
+//
+//    OsConfigDbPerformance [keys]
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include "os/OsConfigDb.h"
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+#include "utl/UtlSList.h"
+
+// CONSTANTS
+#define DEFAULT_KEYS 10000
+#define KEYS_PER_PREFIX 100
+
+// Keeps the compiler from optimizing the lookups away
+size_t externalForSideEffects;
+
+static OsTime start;
+
+static void startTimer()
+{
+   OsDateTime::getCurTimeSinceBoot(start);
+}
+
+static void report(const char* what, int operations)
+{
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+
+   printf("%-14s %8d ops %10.3f ms %12.0f ops/s\n",
+          what, operations, seconds * 1000.0,
+          seconds > 0 ? operations / seconds : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+   int keys = argc > 1 ? atoi(argv[1]) : DEFAULT_KEYS;
+   int prefixes = (keys + KEYS_PER_PREFIX - 1) / KEYS_PER_PREFIX;
+
+   // SIPX_PROXY_HOOK_LIBRARY.0042 style keys, each prefix also carrying a
+   // COUNT so it can be read back as a list; prefixes and items are
+   // scrambled so the input is not already in key order.
+   std::string config;
+   std::vector<std::string> names;
+   char line[128];
+   for (int p = 0; p < prefixes; p++)
+   {
+      int prefix = (p * 7919) % prefixes;
+      snprintf(line, sizeof(line), "SIPX_PROXY_PLUGIN_%04d.COUNT : %d\n", prefix, KEYS_PER_PREFIX);
+      config.append(line);
+
+      for (int i = 0; i < KEYS_PER_PREFIX && (int) names.size() < keys; i++)
+      {
+         int item = (i * 37) % KEYS_PER_PREFIX + 1;
+         snprintf(line, sizeof(line), "SIPX_PROXY_PLUGIN_%04d.%d", prefix, item);
+         names.push_back(line);
+         config.append(line);
+         snprintf(line, sizeof(line), " : value of item %d in group %d\n", item, prefix);
+         config.append(line);
+      }
+   }
+
+   printf("%d keys in %d groups, %lu bytes\n", (int) names.size(), prefixes,
+          (unsigned long) config.size());
+
+   OsConfigDb db;
+   startTimer();
+   db.loadFromBuffer(config.c_str());
+   report("load", db.numEntries());
+
+   UtlString value;
+   startTimer();
+   for (size_t i = 0; i < names.size(); i++)
+   {
+      db.get(names[i].c_str(), value);
+      externalForSideEffects += value.length();
+   }
+   report("get", names.size());
+
+   startTimer();
+   for (int p = 0; p < prefixes; p++)
+   {
+      OsConfigDb subDb;
+      snprintf(line, sizeof(line), "SIPX_PROXY_PLUGIN_%04d.", p);
+      db.getSubHash(line, subDb);
+      externalForSideEffects += subDb.numEntries();
+   }
+   report("getSubHash", prefixes);
+
+   startTimer();
+   for (int p = 0; p < prefixes; p++)
+   {
+      UtlSList list;
+      snprintf(line, sizeof(line), "SIPX_PROXY_PLUGIN_%04d", p);
+      externalForSideEffects += db.loadList(line, list);
+      list.destroyAll();
+   }
+   report("loadList", prefixes);
+
+   startTimer();
+   UtlString key;
+   UtlString nextKey;
+   int walked = 0;
+   while (db.getNext(key, nextKey, value) == OS_SUCCESS)
+   {
+      key = nextKey;
+      walked++;
+   }
+   report("getNext", walked);
+
+   startTimer();
+   char* buffer = new char[db.calculateBufferSize()];
+   buffer[0] = '\0';
+   db.storeToBuffer(buffer);
+   externalForSideEffects += strlen(buffer);
+   delete [] buffer;
+   report("storeToBuffer", db.numEntries());
+
+   return 0;
+}
@@ -26,6 +26,7 @@ class OsConfigDbTest : public CppUnit::TestCase
     CPPUNIT_TEST(testManipulators);
     CPPUNIT_TEST(testAccessors);
     CPPUNIT_TEST(testLineMaxBug);
+    CPPUNIT_TEST(testLoadOrder);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -275,6 +276,53 @@ public:
         CPPUNIT_ASSERT(CONFIG_HOSTS_ == CONFIG_HOSTS);
       }
     }
+
+    void testLoadOrder()
+    {
+      OsConfigDb config;
+      config.set("B.EXISTING", "old");
+      config.set("Z", "kept");
+
+      // unsorted, with keys repeated: the last value of a key wins,
+      // also over an entry that was there before the load
+      CPPUNIT_ASSERT(config.loadFromBuffer("C : 3\n"
+                                           "A.2 : first\n"
+                                           "B.EXISTING : new\n"
+                                           "A.1 : 1\n"
+                                           "A.2 : second\n"
+                                           "B : 2\n") == OS_SUCCESS);
+      CPPUNIT_ASSERT_EQUAL(6, config.numEntries());
+
+      UtlString value;
+      CPPUNIT_ASSERT(config.get("A.2", value) == OS_SUCCESS);
+      ASSERT_STR_EQUAL("second", value.data());
+      CPPUNIT_ASSERT(config.get("B.EXISTING", value) == OS_SUCCESS);
+      ASSERT_STR_EQUAL("new", value.data());
+      CPPUNIT_ASSERT(config.get("A", value) == OS_NOT_FOUND);
+
+      // getNext walks the keys in order
+      const char* expected[] = { "A.1", "A.2", "B", "B.EXISTING", "C", "Z" };
+      UtlString key;
+      UtlString nextKey;
+      for (unsigned int i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+      {
+         CPPUNIT_ASSERT(config.getNext(key, nextKey, value) == OS_SUCCESS);
+         ASSERT_STR_EQUAL(expected[i], nextKey.data());
+         key = nextKey;
+      }
+      CPPUNIT_ASSERT(config.getNext(key, nextKey, value) == OS_NO_MORE_DATA);
+
+      OsConfigDb subDb;
+      config.getSubHash("A.", subDb);
+      CPPUNIT_ASSERT_EQUAL(2, subDb.numEntries());
+      CPPUNIT_ASSERT(subDb.get("1", value) == OS_SUCCESS);
+      ASSERT_STR_EQUAL("1", value.data());
+
+      CPPUNIT_ASSERT(config.removeByPrefix("b") == OS_SUCCESS);
+      CPPUNIT_ASSERT_EQUAL(4, config.numEntries());
+      CPPUNIT_ASSERT(config.get("B", value) == OS_NOT_FOUND);
+      CPPUNIT_ASSERT(config.get("C", value) == OS_SUCCESS);
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(OsConfigDbTest);
@@ -0,0 +1,184 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// TLS handshake rate over loopback, full handshakes versus resumptions.
+//
+// A server thread accepts connections on 127.0.0.1 and completes the
+// handshake with OsSSL::getServerConnection; the main thread connects
+// CONNECTIONS times with OsSSL::getClientConnection, first without
+// offering a session and then through OsSSL::resumeClientSession.  The
+// rate of each pass and the number of connections actually resumed are
+// printed.  Both sides use one OsSSL, as OsSharedSSL does, so the key
+// pair given must verify against a CA in the authority directory:
+//
+//    OsSSLHandshakePerformance authority-dir certificate key [connections]
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/err.h>
+
+// APPLICATION INCLUDES
+#include "os/OsSSL.h"
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+
+// CONSTANTS
+#define DEFAULT_CONNECTIONS 1000
+
+static OsSSL* sslContext;
+static int    listenSocket;
+static int    connections;
+
+// Accept connections and complete the server side of each handshake
+static void* serverThread(void*)
+{
+   for (int i = 0; i < 2 * connections; i++)
+   {
+      int socket = accept(listenSocket, NULL, NULL);
+      if (socket < 0)
+      {
+         perror("accept");
+         break;
+      }
+
+      SSL* connection = sslContext->getServerConnection();
+      SSL_set_fd(connection, socket);
+      if (SSL_accept(connection) > 0)
+      {
+         // lets the client read any TLS 1.3 session tickets sent after the handshake
+         char ack = 'x';
+         SSL_write(connection, &ack, 1);
+         SSL_shutdown(connection);
+      }
+      else
+      {
+         ERR_print_errors_fp(stderr);
+      }
+      sslContext->releaseConnection(connection);
+      close(socket);
+   }
+
+   return NULL;
+}
+
+// Connect once; returns -1 on failure, else whether the session was resumed
+static int clientHandshake(const struct sockaddr_in& server, bool resume)
+{
+   int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+   int noDelay = 1;
+   setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+   if (connect(socket, (const struct sockaddr*) &server, sizeof(server)) != 0)
+   {
+      perror("connect");
+      close(socket);
+      return -1;
+   }
+
+   int result = -1;
+   SSL* connection = sslContext->getClientConnection();
+   SSL_set_fd(connection, socket);
+   if (resume)
+   {
+      sslContext->resumeClientSession(connection);
+   }
+
+   char ack;
+   if (SSL_connect(connection) > 0 && SSL_read(connection, &ack, 1) == 1)
+   {
+      result = SSL_session_reused(connection) ? 1 : 0;
+      SSL_shutdown(connection);
+   }
+   else
+   {
+      ERR_print_errors_fp(stderr);
+   }
+   sslContext->releaseConnection(connection);
+   close(socket);
+
+   return result;
+}
+
+static bool runPass(const char* name, const struct sockaddr_in& server, bool resume)
+{
+   int resumed = 0;
+   OsTime start;
+   OsDateTime::getCurTimeSinceBoot(start);
+
+   for (int i = 0; i < connections; i++)
+   {
+      int result = clientHandshake(server, resume);
+      if (result < 0)
+      {
+         fprintf(stderr, "%s handshake %d failed\n", name, i);
+         return false;
+      }
+      resumed += result;
+   }
+
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+
+   printf("%-8s %6d handshakes %6d resumed %8.3f s %10.1f handshakes/s\n",
+          name, connections, resumed, seconds, seconds > 0 ? connections / seconds : 0.0);
+   return true;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 4)
+   {
+      fprintf(stderr, "usage: %s authority-dir certificate key [connections]\n", argv[0]);
+      return 1;
+   }
+   connections = argc > 4 ? atoi(argv[4]) : DEFAULT_CONNECTIONS;
+
+   sslContext = new OsSSL(argv[1], argv[2], argv[3]);
+
+   listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+   int reuse = 1;
+   setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+   struct sockaddr_in server;
+   socklen_t length = sizeof(server);
+   memset(&server, 0, sizeof(server));
+   server.sin_family = AF_INET;
+   server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   server.sin_port = 0;
+   if (   bind(listenSocket, (struct sockaddr*) &server, sizeof(server)) != 0
+       || listen(listenSocket, 128) != 0
+       || getsockname(listenSocket, (struct sockaddr*) &server, &length) != 0)
+   {
+      perror("listen");
+      return 1;
+   }
+
+   pthread_t server_thread;
+   pthread_create(&server_thread, NULL, serverThread, NULL);
+
+   // The full pass leaves a session behind for the resumption pass to offer
+   bool ok = runPass("full", server, false) && runPass("resumed", server, true);
+
+   if (ok)
+   {
+      pthread_join(server_thread, NULL);
+   }
+   close(listenSocket);
+   delete sslContext;
+
+   return ok ? 0 : 1;
+}
@@ -0,0 +1,432 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Throughput of the UtlByteScan kernels against the byte at a time loops
+// they replaced in HttpMessage and NameValueTokenizer.
+//
+// A stream of SIP messages, as read from a TCP connection, is framed (the
+// blank line ending the headers is found, the header lines split and
+// their names upper cased, and the body skipped by its Content-Length)
+// and its header values are split into tokens, ITERATIONS times over.  The
+// rate is printed for the old loops and for each kernel the processor
+// supports.  An optional file argument replaces the built in messages with
+// captured traffic, for example a TCP stream saved as raw bytes from
+// Wireshark's "Follow TCP Stream":
+//
+//    UtlByteScanPerformance [iterations] [stream-file]
+
+// SYSTEM INCLUDES
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+// APPLICATION INCLUDES
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "utl/UtlByteScan.h"
+
+// CONSTANTS
+#define DEFAULT_ITERATIONS 200
+// The built in messages are repeated up to this size, so that the stream
+// is larger than the caches, as a busy proxy's connections are.
+#define DEFAULT_STREAM_SIZE (8 * 1024 * 1024)
+
+// Messages as seen by sipXproxy on a TCP connection from a phone.
+static const char* corpus[] =
+{
+   "INVITE sip:201@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/TCP 10.1.1.130:5060;branch=z9hG4bK-d87543-5b5c2e6e9a1f7f0c-1--d87543-;rport\r\n"
+   "Max-Forwards: 70\r\n"
+   "Contact: <sip:200@10.1.1.130:5060;transport=tcp>\r\n"
+   "To: <sip:201@example.com>\r\n"
+   "From: \"Alice\"<sip:200@example.com>;tag=0b3e0b6f\r\n"
+   "Call-ID: ZTU0ODYzYmQ1YjkxNDZiZjVlMTI4YjA0ZjM0ZjU4NmM.\r\n"
+   "CSeq: 1 INVITE\r\n"
+   "Allow: INVITE, ACK, CANCEL, OPTIONS, BYE, REFER, NOTIFY, MESSAGE, SUBSCRIBE, INFO\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Supported: replaces, norefersub, extended-refer, timer, X-cisco-serviceuri\r\n"
+   "User-Agent: PolycomVVX-VVX_410-UA/5.9.5.0614\r\n"
+   "Accept-Language: en\r\n"
+   "Content-Length: 211\r\n"
+   "\r\n"
+   "v=0\r\n"
+   "o=- 1625062118 1625062118 IN IP4 10.1.1.130\r\n"
+   "s=Polycom IP Phone\r\n"
+   "c=IN IP4 10.1.1.130\r\n"
+   "t=0 0\r\n"
+   "a=sendrecv\r\n"
+   "m=audio 2222 RTP/AVP 9 0 8 18 101\r\n"
+   "a=rtpmap:9 G722/8000\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n"
+   "a=rtpmap:8 PCMA/8000\r\n"
+   "a=rtpmap:101 telephone-event/8000\r\n",
+
+   "SIP/2.0 407 Proxy Authentication Required\r\n"
+   "Via: SIP/2.0/TCP 10.1.1.130:5060;branch=z9hG4bK-d87543-5b5c2e6e9a1f7f0c-1--d87543-;rport=5060\r\n"
+   "To: <sip:201@example.com>;tag=24f1a3b8\r\n"
+   "From: \"Alice\"<sip:200@example.com>;tag=0b3e0b6f\r\n"
+   "Call-ID: ZTU0ODYzYmQ1YjkxNDZiZjVlMTI4YjA0ZjM0ZjU4NmM.\r\n"
+   "CSeq: 1 INVITE\r\n"
+   "Proxy-Authenticate: Digest realm=\"example.com\", nonce=\"4d7a1c1b8d9c9b0c6a8f4f2a1e3b5d7c1625062118\", opaque=\"change4\", algorithm=MD5\r\n"
+   "Server: sipXecs/21.04 sipXecs/sipxproxy (Linux)\r\n"
+   "Date: Wed, 30 Jun 2021 14:08:38 GMT\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n",
+
+   "ACK sip:201@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/TCP 10.1.1.130:5060;branch=z9hG4bK-d87543-5b5c2e6e9a1f7f0c-1--d87543-;rport\r\n"
+   "Max-Forwards: 70\r\n"
+   "To: <sip:201@example.com>;tag=24f1a3b8\r\n"
+   "From: \"Alice\"<sip:200@example.com>;tag=0b3e0b6f\r\n"
+   "Call-ID: ZTU0ODYzYmQ1YjkxNDZiZjVlMTI4YjA0ZjM0ZjU4NmM.\r\n"
+   "CSeq: 1 ACK\r\n"
+   "l: 0\r\n"
+   "\r\n",
+
+   "NOTIFY sip:200@10.1.1.130:5060;transport=tcp SIP/2.0\r\n"
+   "Record-Route: <sip:10.1.1.10:5060;transport=tcp;lr;sipXecs-CallDest=INT>\r\n"
+   "Via: SIP/2.0/TCP 10.1.1.10:5060;branch=z9hG4bK-XX-0f1d2c3b4a59687766554433\r\n"
+   "Via: SIP/2.0/TCP 10.1.1.10:5140;branch=z9hG4bK-1a2b3c4d5e6f;rport=5140\r\n"
+   "From: <sip:~~rl~C~200@example.com>;tag=8a5e3c1d\r\n"
+   "To: <sip:200@example.com>;tag=3e4d5c6b\r\n"
+   "Call-ID: 7c3a4e5f-6a7b8c9d@10.1.1.10\r\n"
+   "CSeq: 12 NOTIFY\r\n"
+   "Event: dialog\r\n"
+   "Subscription-State: active;expires=3590\r\n"
+   "Contact: <sip:~~rl~C~200@10.1.1.10:5140;transport=tcp>\r\n"
+   "Content-Type: application/dialog-info+xml\r\n"
+   "Content-Length: 280\r\n"
+   "\r\n"
+   "<?xml version=\"1.0\"?>\n"
+   "<dialog-info xmlns=\"urn:ietf:params:xml:ns:dialog-info\" version=\"11\" state=\"partial\" entity=\"sip:201@example.com\">\n"
+   "<dialog id=\"1\" call-id=\"ZTU0ODYzYmQ1YjkxNDZiZjVlMTI4YjA0ZjM0ZjU4NmM.\" direction=\"recipient\">\n"
+   "<state>confirmed</state>\n"
+   "</dialog>\n"
+   "</dialog-info>\n",
+};
+
+// Keeps the compiler from optimizing the scanning away
+size_t externalForSideEffects;
+
+/* ============================ BEFORE THE KERNELS ======================== */
+
+// NameValueTokenizer::findNextLineTerminator as it was.
+static ssize_t oldFindNextLineTerminator(const char* text, ssize_t length,
+                                         ssize_t* nextLineIndex)
+{
+   ssize_t byteIndex = 0;
+   ssize_t terminatorIndex = -1;
+   *nextLineIndex = -1;
+
+   while (byteIndex < length)
+   {
+      if (text[byteIndex] == '\n' || text[byteIndex] == '\r')
+      {
+         terminatorIndex = byteIndex;
+         if (byteIndex < length - 1 && text[byteIndex + 1] == '\n' &&
+             text[byteIndex] == '\r')
+         {
+            *nextLineIndex = terminatorIndex + 2;
+         }
+         else
+         {
+            *nextLineIndex = terminatorIndex + 1;
+         }
+         break;
+      }
+      byteIndex++;
+   }
+
+   return terminatorIndex;
+}
+
+// HttpMessage::findHeaderEnd as it was.
+static ssize_t oldFindHeaderEnd(const char* headerBytes, ssize_t messageLength)
+{
+   ssize_t lineLength = 0;
+   ssize_t nextLineIndex = 0;
+   ssize_t bytesConsumed = 0;
+   while (messageLength - bytesConsumed > 0 &&
+          (lineLength = oldFindNextLineTerminator(&headerBytes[bytesConsumed],
+                                                  messageLength - bytesConsumed,
+                                                  &nextLineIndex)))
+   {
+      if (nextLineIndex > 0)
+      {
+         bytesConsumed += nextLineIndex;
+      }
+      else
+      {
+         bytesConsumed += lineLength < 0 ? messageLength - bytesConsumed : lineLength;
+      }
+   }
+
+   if (nextLineIndex == 1 && (headerBytes[bytesConsumed] == '\n' ||
+                              headerBytes[bytesConsumed] == '\r'))
+   {
+      bytesConsumed++;
+   }
+   else if (nextLineIndex == 2 && (headerBytes[bytesConsumed] == '\n' ||
+                                   headerBytes[bytesConsumed] == '\r') &&
+            (headerBytes[bytesConsumed + 1] == '\n' ||
+             headerBytes[bytesConsumed + 1] == '\r'))
+   {
+      bytesConsumed += 2;
+   }
+   else
+   {
+      bytesConsumed = -1;
+   }
+
+   return bytesConsumed;
+}
+
+// NameValueTokenizer::getSubField's separator test for 3 or more separators as it was.
+static size_t oldFindAnyOf(const char* p, size_t n, const char* separators)
+{
+   size_t i = 0;
+   while (i < n && !strchr(separators, p[i]))
+   {
+      i++;
+   }
+   return i;
+}
+
+/* ============================ THE PASSES ================================ */
+
+// Where the next message starts, after a body of contentLength bytes.
+static size_t skipBody(size_t headerEnd, size_t contentLength, size_t available)
+{
+   size_t end = headerEnd + contentLength;
+   return end < available ? end : available;
+}
+
+// Frame the stream as HttpMessage::read and parseHeaders did.
+static size_t frameOld(const char* stream, size_t length)
+{
+   size_t messages = 0;
+   size_t at = 0;
+   char name[256];
+   while (at < length)
+   {
+      ssize_t headerEnd = oldFindHeaderEnd(stream + at, length - at);
+      if (headerEnd <= 0)
+      {
+         break;
+      }
+
+      size_t contentLength = 0;
+      ssize_t line = 0;
+      ssize_t next;
+      while (line < headerEnd)
+      {
+         ssize_t lineLength = oldFindNextLineTerminator(stream + at + line, headerEnd - line, &next);
+         if (lineLength <= 0)
+         {
+            break;
+         }
+         ssize_t nameEnd = 0;
+         while (nameEnd < lineLength && stream[at + line + nameEnd] != ':')
+         {
+            nameEnd++;
+         }
+         if (nameEnd < lineLength && nameEnd < (ssize_t) sizeof(name))
+         {
+            for (ssize_t i = 0; i < nameEnd; i++)
+            {
+               name[i] = toupper(stream[at + line + i]);
+            }
+            if ((nameEnd == 14 && memcmp(name, "CONTENT-LENGTH", 14) == 0) ||
+                (nameEnd == 1 && name[0] == 'L'))
+            {
+               contentLength = atoi(stream + at + line + nameEnd + 1);
+            }
+         }
+         line += next;
+      }
+
+      at = skipBody(at + headerEnd, contentLength, length);
+      messages++;
+   }
+   return messages;
+}
+
+// Frame the stream with the kernels, as HttpMessage now does.
+static size_t frameKernel(const char* stream, size_t length)
+{
+   size_t messages = 0;
+   size_t at = 0;
+   char name[256];
+   while (at < length)
+   {
+      size_t lineStart = 0;
+      ssize_t headerEnd = UtlByteScan::findBlankLine(stream + at, length - at, lineStart);
+      if (headerEnd <= 0)
+      {
+         break;
+      }
+
+      size_t contentLength = 0;
+      size_t line = 0;
+      while (line < (size_t) headerEnd)
+      {
+         const char* p = stream + at + line;
+         size_t lineLength = UtlByteScan::findLineBreak(p, headerEnd - line);
+         if (lineLength == 0 || lineLength == headerEnd - line)
+         {
+            break;
+         }
+         const char* colon = (const char*) memchr(p, ':', lineLength);
+         size_t nameEnd = colon ? colon - p : lineLength;
+         if (nameEnd < lineLength && nameEnd < sizeof(name))
+         {
+            memcpy(name, p, nameEnd);
+            UtlByteScan::toUpper(name, nameEnd);
+            if ((nameEnd == 14 && memcmp(name, "CONTENT-LENGTH", 14) == 0) ||
+                (nameEnd == 1 && name[0] == 'L'))
+            {
+               contentLength = atoi(p + nameEnd + 1);
+            }
+         }
+         line += lineLength + (p[lineLength] == '\r' && p[lineLength + 1] == '\n' ? 2 : 1);
+      }
+
+      at = skipBody(at + headerEnd, contentLength, length);
+      messages++;
+   }
+   return messages;
+}
+
+static const char* TOKEN_SEPARATORS = " ,;=";
+
+// Split every line of the stream into tokens, as getSubField did.
+static size_t tokenizeOld(const char* stream, size_t length)
+{
+   size_t tokens = 0;
+   for (size_t at = 0; at < length; at++)
+   {
+      at += oldFindAnyOf(stream + at, length - at, TOKEN_SEPARATORS);
+      tokens++;
+   }
+   return tokens;
+}
+
+// Split every line of the stream into tokens with the kernels.
+static size_t tokenizeKernel(const char* stream, size_t length)
+{
+   static const UtlByteScan::ByteSet separators(TOKEN_SEPARATORS);
+   size_t tokens = 0;
+   for (size_t at = 0; at < length; at++)
+   {
+      at += UtlByteScan::findAnyOf(stream + at, length - at, separators);
+      tokens++;
+   }
+   return tokens;
+}
+
+/* ============================ MEASUREMENT =============================== */
+
+static double measure(const char* pass,
+                      const char* version,
+                      size_t (*scan)(const char*, size_t),
+                      const std::string& stream,
+                      int iterations,
+                      double baseline)
+{
+   size_t results = 0;
+   OsTime start, end;
+
+   OsDateTime::getCurTime(start);
+   for (int n = 0; n < iterations; n++)
+   {
+      results += scan(stream.data(), stream.size());
+   }
+   OsDateTime::getCurTime(end);
+   externalForSideEffects += results;
+
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+   if (seconds <= 0)
+   {
+      seconds = 0.000001;
+   }
+   double rate = (double) stream.size() * iterations / seconds / 1e9;
+   printf("%-10s %-8s %10zu %8.3f s %8.3f GB/s",
+          pass, version, results / iterations, seconds, rate);
+   if (baseline > 0)
+   {
+      printf(" %6.2fx", rate / baseline);
+   }
+   printf("\n");
+
+   return rate;
+}
+
+static void measurePass(const char* pass,
+                        size_t (*old)(const char*, size_t),
+                        size_t (*kernel)(const char*, size_t),
+                        const std::string& stream,
+                        int iterations)
+{
+   double baseline = measure(pass, "old", old, stream, iterations, 0);
+   for (int k = UtlByteScan::SCALAR; k <= UtlByteScan::supportedKernel(); k++)
+   {
+      UtlByteScan::setKernel((UtlByteScan::Kernel) k);
+      measure(pass, UtlByteScan::kernelName((UtlByteScan::Kernel) k), kernel,
+              stream, iterations, baseline);
+   }
+   UtlByteScan::setKernel(UtlByteScan::supportedKernel());
+}
+
+int main(int argc, char* argv[])
+{
+   int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+   std::string stream;
+   if (argc > 2)
+   {
+      std::ifstream file(argv[2], std::ios::in | std::ios::binary);
+      if (!file)
+      {
+         fprintf(stderr, "cannot open stream file '%s'\n", argv[2]);
+         return 1;
+      }
+      std::ostringstream content;
+      content << file.rdbuf();
+      stream = content.str();
+   }
+   else
+   {
+      while (stream.size() < DEFAULT_STREAM_SIZE)
+      {
+         for (size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++)
+         {
+            stream.append(corpus[i]);
+         }
+      }
+   }
+
+   if (stream.empty() || iterations <= 0)
+   {
+      fprintf(stderr, "usage: %s [iterations] [stream-file]\n", argv[0]);
+      return 1;
+   }
+
+   printf("%zu bytes, %d iterations, processor supports %s\n",
+          stream.size(), iterations,
+          UtlByteScan::kernelName(UtlByteScan::supportedKernel()));
+   printf("%-10s %-8s %10s %10s %13s\n", "pass", "version", "results", "time", "rate");
+   measurePass("frame", frameOld, frameKernel, stream, iterations);
+   measurePass("tokenize", tokenizeOld, tokenizeKernel, stream, iterations);
+
+   return 0;
+}
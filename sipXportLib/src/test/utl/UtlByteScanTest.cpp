@@ -0,0 +1,190 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utl/UtlByteScan.h>
+#include <sipxunit/TestUtilities.h>
+
+// Bytes the random texts are made of: letters of both cases, the
+// neighbours of the letter ranges, delimiters, line breaks, NUL and bytes
+// above 0x7f.
+static const char TEXT_BYTES[] = "aZmz:;, \t\r\n@[`{\0\x80\xff";
+
+class UtlByteScanTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(UtlByteScanTest);
+   CPPUNIT_TEST(testFindLineBreak);
+   CPPUNIT_TEST(testFindAnyOf);
+   CPPUNIT_TEST(testCase);
+   CPPUNIT_TEST(testFindBlankLine);
+   CPPUNIT_TEST(testKernelsAgree);
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   void tearDown()
+   {
+      UtlByteScan::setKernel(UtlByteScan::AVX2);
+   }
+
+   void testFindLineBreak()
+   {
+      // Line breaks on both sides of the 16 and 32 byte steps.
+      char text[100];
+      for (size_t at = 0; at < sizeof(text); at++)
+      {
+         memset(text, 'x', sizeof(text));
+         text[at] = at % 2 ? '\r' : '\n';
+         CPPUNIT_ASSERT_EQUAL(at, UtlByteScan::findLineBreak(text, sizeof(text)));
+         CPPUNIT_ASSERT_EQUAL(at, UtlByteScan::findLineBreak(text, at));
+      }
+      CPPUNIT_ASSERT_EQUAL((size_t) 0, UtlByteScan::findLineBreak(text, 0));
+   }
+
+   void testFindAnyOf()
+   {
+      UtlByteScan::ByteSet small(";,");
+      UtlByteScan::ByteSet large("!\"#$%&'()*+,-./:;<=>?@[]");
+      UtlByteScan::ByteSet withNul("=");
+      withNul.add('\0');
+
+      char text[100];
+      memset(text, 'x', sizeof(text));
+      CPPUNIT_ASSERT_EQUAL(sizeof(text), UtlByteScan::findAnyOf(text, sizeof(text), small));
+
+      text[70] = ']';
+      text[40] = ',';
+      text[20] = '\0';
+      CPPUNIT_ASSERT_EQUAL((size_t) 40, UtlByteScan::findAnyOf(text, sizeof(text), small));
+      CPPUNIT_ASSERT_EQUAL((size_t) 40, UtlByteScan::findAnyOf(text, sizeof(text), large));
+      CPPUNIT_ASSERT_EQUAL((size_t) 20, UtlByteScan::findAnyOf(text, sizeof(text), withNul));
+      CPPUNIT_ASSERT_EQUAL((size_t) 29, UtlByteScan::findAnyOf(text + 41, 59, large));
+
+      CPPUNIT_ASSERT(small.contains(';'));
+      CPPUNIT_ASSERT(!small.contains('\0'));
+      CPPUNIT_ASSERT(withNul.contains('\0'));
+   }
+
+   void testCase()
+   {
+      char text[] = "Content-Length: 42; Via: SIP/2.0/TCP [::1] `{@}`\xe9";
+      UtlByteScan::toUpper(text, strlen(text));
+      ASSERT_STR_EQUAL("CONTENT-LENGTH: 42; VIA: SIP/2.0/TCP [::1] `{@}`\xe9", text);
+      UtlByteScan::toLower(text, strlen(text));
+      ASSERT_STR_EQUAL("content-length: 42; via: sip/2.0/tcp [::1] `{@}`\xe9", text);
+
+      const char* name = "X-Sipx-Authidentity-Long-Header-Name";
+      CPPUNIT_ASSERT(UtlByteScan::equalsIgnoreCase(name, "X-SIPX-AUTHIDENTITY-LONG-HEADER-NAME", strlen(name)));
+      CPPUNIT_ASSERT(UtlByteScan::equalsIgnoreCase(name, "x-sipx-authidentity-long-header-name", strlen(name)));
+      CPPUNIT_ASSERT(!UtlByteScan::equalsIgnoreCase(name, "X-SIPX-AUTHIDENTITY-LONG-HEADER-NAMF", strlen(name)));
+      // '@' and '`', '[' and '{' differ only in the case bit but are not letters.
+      CPPUNIT_ASSERT(!UtlByteScan::equalsIgnoreCase("a@", "a`", 2));
+      CPPUNIT_ASSERT(!UtlByteScan::equalsIgnoreCase("[", "{", 1));
+   }
+
+   void testFindBlankLine()
+   {
+      struct
+      {
+         const char* text;
+         ssize_t end;
+      } cases[] =
+        {
+           { "INVITE sip:a@b SIP/2.0\r\nVia: x\r\n\r\nbody", 34 },
+           { "INVITE sip:a@b SIP/2.0\nVia: x\n\nbody", 31 },
+           { "INVITE sip:a@b SIP/2.0\rVia: x\r\rbody", 31 },
+           { "\r\nbody", 2 },
+           { "A: b\r\nC: d\r\n", -1 },
+           { "A: b\r\nC: d\r\n\r", -1 },
+           { "A: b\r\nC: d\r\n\rbody", 13 },
+           { "A: b", -1 },
+        };
+
+      for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+      {
+         size_t lineStart = 0;
+         CPPUNIT_ASSERT_EQUAL(cases[i].end,
+                              UtlByteScan::findBlankLine(cases[i].text, strlen(cases[i].text),
+                                                         lineStart));
+      }
+
+      // Resuming as the message arrives a byte at a time.
+      const char* message = "SIP/2.0 200 OK\r\nCSeq: 1 INVITE\r\nContent-Length: 0\r\n\r\n";
+      size_t lineStart = 0;
+      ssize_t end = -1;
+      size_t length;
+      for (length = 1; end < 0 && length <= strlen(message); length++)
+      {
+         end = UtlByteScan::findBlankLine(message, length, lineStart);
+      }
+      CPPUNIT_ASSERT_EQUAL((ssize_t) strlen(message), end);
+      CPPUNIT_ASSERT_EQUAL((size_t) 51, lineStart);
+   }
+
+   // Every kernel this processor supports gives the same results as the
+   // scalar one, on texts of all lengths around the vector widths.
+   void testKernelsAgree()
+   {
+      UtlByteScan::ByteSet sets[] =
+         {
+            UtlByteScan::ByteSet(";"),
+            UtlByteScan::ByteSet(", \t"),
+            UtlByteScan::ByteSet(":;,@[`{aZ"),
+            UtlByteScan::ByteSet("abcdefghijklmnopqrstuvwxyz:"),
+         };
+      sets[1].add('\0');
+
+      srand(1);
+      for (int iteration = 0; iteration < 20000; iteration++)
+      {
+         char text[100];
+         char other[100];
+         size_t length = rand() % sizeof(text);
+         for (size_t i = 0; i < length; i++)
+         {
+            text[i] = TEXT_BYTES[rand() % (sizeof(TEXT_BYTES) - 1)];
+            other[i] = rand() % 4 ? text[i] : text[i] ^ 0x20;
+         }
+         const UtlByteScan::ByteSet& set = sets[iteration % 4];
+
+         UtlByteScan::setKernel(UtlByteScan::SCALAR);
+         size_t lineBreak = UtlByteScan::findLineBreak(text, length);
+         size_t any = UtlByteScan::findAnyOf(text, length, set);
+         bool equal = UtlByteScan::equalsIgnoreCase(text, other, length);
+         char upper[sizeof(text)];
+         memcpy(upper, text, length);
+         UtlByteScan::toUpper(upper, length);
+         char lower[sizeof(text)];
+         memcpy(lower, text, length);
+         UtlByteScan::toLower(lower, length);
+
+         for (int kernel = UtlByteScan::SSE42;
+              kernel <= UtlByteScan::supportedKernel();
+              kernel++)
+         {
+            UtlByteScan::setKernel((UtlByteScan::Kernel) kernel);
+            CPPUNIT_ASSERT_EQUAL(lineBreak, UtlByteScan::findLineBreak(text, length));
+            CPPUNIT_ASSERT_EQUAL(any, UtlByteScan::findAnyOf(text, length, set));
+            CPPUNIT_ASSERT_EQUAL(equal, UtlByteScan::equalsIgnoreCase(text, other, length));
+            char converted[sizeof(text)];
+            memcpy(converted, text, length);
+            UtlByteScan::toUpper(converted, length);
+            CPPUNIT_ASSERT(memcmp(upper, converted, length) == 0);
+            memcpy(converted, text, length);
+            UtlByteScan::toLower(converted, length);
+            CPPUNIT_ASSERT(memcmp(lower, converted, length) == 0);
+         }
+      }
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(UtlByteScanTest);
@@ -0,0 +1,142 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <limits.h>
+
+#include <utl/UtlMetrics.h>
+#include <utl/UtlString.h>
+
+/**
+ * Unit tests for UtlMetrics and the metrics it registers.
+ *
+ * The registry is shared by the whole process, so every test uses names
+ * of its own.
+ */
+class UtlMetricsTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(UtlMetricsTest);
+   CPPUNIT_TEST(testCounter);
+   CPPUNIT_TEST(testGauge);
+   CPPUNIT_TEST(testBins);
+   CPPUNIT_TEST(testHistogram);
+   CPPUNIT_TEST(testRegisterTwice);
+   CPPUNIT_TEST(testLabel);
+   CPPUNIT_TEST(testExportText);
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   void testCounter()
+   {
+      UtlMetricCounter& counter =
+         UtlMetrics::instance().counter("test_counter_total", "Counter test");
+      CPPUNIT_ASSERT_EQUAL((Int64) 0, counter.getValue());
+      counter.add();
+      counter.add(41);
+      CPPUNIT_ASSERT_EQUAL((Int64) 42, counter.getValue());
+   }
+
+   void testGauge()
+   {
+      UtlMetricGauge& gauge = UtlMetrics::instance().gauge("test_gauge", "Gauge test");
+      gauge.add(5);
+      gauge.add(-2);
+      CPPUNIT_ASSERT_EQUAL((Int64) 3, gauge.getValue());
+      gauge.set(10);
+      CPPUNIT_ASSERT_EQUAL((Int64) 10, gauge.getValue());
+   }
+
+   void testBins()
+   {
+      CPPUNIT_ASSERT_EQUAL(0U, UtlMetricHistogram::binOf(-1));
+      CPPUNIT_ASSERT_EQUAL(0U, UtlMetricHistogram::binOf(0));
+      CPPUNIT_ASSERT_EQUAL(3U, UtlMetricHistogram::binOf(3));
+      CPPUNIT_ASSERT_EQUAL(4U, UtlMetricHistogram::binOf(4));
+      CPPUNIT_ASSERT_EQUAL(7U, UtlMetricHistogram::binOf(7));
+      CPPUNIT_ASSERT_EQUAL(8U, UtlMetricHistogram::binOf(8));
+      CPPUNIT_ASSERT_EQUAL(8U, UtlMetricHistogram::binOf(9));
+      CPPUNIT_ASSERT_EQUAL(11U, UtlMetricHistogram::binOf(15));
+      CPPUNIT_ASSERT_EQUAL(12U, UtlMetricHistogram::binOf(16));
+      CPPUNIT_ASSERT_EQUAL((unsigned int) UtlMetricHistogram::BINS - 1,
+                           UtlMetricHistogram::binOf(LLONG_MAX));
+
+      // every value is in the bin whose bounds enclose it
+      for (Int64 value = 1; value < (1LL << 41); value = value * 3 + 1)
+      {
+         unsigned int bin = UtlMetricHistogram::binOf(value);
+         CPPUNIT_ASSERT(value <= UtlMetricHistogram::upperBound(bin));
+         CPPUNIT_ASSERT(value > UtlMetricHistogram::upperBound(bin - 1));
+      }
+   }
+
+   void testHistogram()
+   {
+      UtlMetricHistogram& histogram =
+         UtlMetrics::instance().histogram("test_histogram_seconds", "Histogram test");
+      histogram.tally(1);
+      histogram.tally(1);
+      histogram.tally(100);
+      CPPUNIT_ASSERT_EQUAL((UInt64) 3, histogram.getCount());
+      CPPUNIT_ASSERT_EQUAL((Int64) 102, histogram.getSum());
+      CPPUNIT_ASSERT_EQUAL((UInt64) 2, histogram[1]);
+      CPPUNIT_ASSERT_EQUAL((UInt64) 1, histogram[UtlMetricHistogram::binOf(100)]);
+   }
+
+   void testRegisterTwice()
+   {
+      UtlMetrics& metrics = UtlMetrics::instance();
+      UtlMetricCounter& a = metrics.counter("test_twice_total", "Twice", "a=\"1\"");
+      UtlMetricCounter& b = metrics.counter("test_twice_total", "Twice", "a=\"2\"");
+      CPPUNIT_ASSERT(&a == &metrics.counter("test_twice_total", "Twice", "a=\"1\""));
+      CPPUNIT_ASSERT(&a != &b);
+
+      // the same name with another type does not replace the counter
+      UtlMetricGauge& gauge = metrics.gauge("test_twice_total", "Twice", "a=\"1\"");
+      gauge.add(1);
+      CPPUNIT_ASSERT_EQUAL((Int64) 0, a.getValue());
+   }
+
+   void testLabel()
+   {
+      ASSERT_STR_EQUAL("plugin=\"a\\\"b\\\\c\\nd\"",
+                       UtlMetrics::label("plugin", "a\"b\\c\nd").data());
+   }
+
+   void testExportText()
+   {
+      UtlMetrics& metrics = UtlMetrics::instance();
+      metrics.counter("test_export_total", "Export\ntest", "x=\"1\"").add(7);
+      UtlMetricHistogram& histogram =
+         metrics.histogram("test_export_seconds", "Export test", "x=\"1\"");
+      histogram.tally(2);
+      histogram.tally(5);
+
+      UtlString text;
+      metrics.exportText(text);
+
+      CPPUNIT_ASSERT(text.index("# HELP test_export_total Export\\ntest\n"
+                                "# TYPE test_export_total counter\n"
+                                "test_export_total{x=\"1\"} 7\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(text.index("# TYPE test_export_seconds histogram\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"0\"} 0\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"1e-06\"} 0\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"2e-06\"} 1\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"3e-06\"} 1\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"4e-06\"} 1\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"5e-06\"} 2\n"
+                                "test_export_seconds_bucket{x=\"1\",le=\"+Inf\"} 2\n"
+                                "test_export_seconds_sum{x=\"1\"} 7e-06\n"
+                                "test_export_seconds_count{x=\"1\"} 2\n") != UTL_NOT_FOUND);
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(UtlMetricsTest);
@@ -0,0 +1,250 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Throughput of the TinyXML DOM versus XmlPullParser on event bodies.
+//
+// Each body of the corpus below is parsed ITERATIONS times, reading every
+// attribute and text node, and the resulting rate is printed per parser.
+// An optional directory argument replaces the built in corpus with the
+// *.xml files it contains, so bodies captured from a live system (for
+// example extracted from a siptrace) can be measured as well:
+//
+//    XmlPullParserPerformance [iterations] [corpus-directory]
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+// APPLICATION INCLUDES
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+#include "xmlparser/tinyxml.h"
+#include "xmlparser/XmlPullParser.h"
+
+// CONSTANTS
+#define DEFAULT_ITERATIONS 20000
+
+// Bodies as sent in dialog-info (RFC 4235) and reginfo (RFC 3680) NOTIFYs
+static const char* corpus[] =
+{
+   // dialog-info from a Polycom phone, one early dialog
+   "<?xml version=\"1.0\"?>\n"
+   "<dialog-info xmlns=\"urn:ietf:params:xml:ns:dialog-info\" version=\"63\" state=\"full\" entity=\"sip:5000@example.com\">\n"
+   "  <dialog id=\"26bfed15-b490e778-5d4d2d53@192.168.0.111\" call-id=\"26bfed15-b490e778-5d4d2d53@192.168.0.111\" local-tag=\"CFA9E939-97CA593C\" remote-tag=\"2FC6CE3C-E3F38EF3\" direction=\"initiator\">\n"
+   "    <state>early</state>\n"
+   "    <remote>\n"
+   "      <identity display=\"Bob &amp; Carol\">sip:5001@example.com;user=phone</identity>\n"
+   "      <target uri=\"sip:5001@192.168.0.109\"/>\n"
+   "    </remote>\n"
+   "    <local>\n"
+   "      <identity>sip:5000@example.com</identity>\n"
+   "      <target uri=\"sip:5000@192.168.0.111\"/>\n"
+   "    </local>\n"
+   "  </dialog>\n"
+   "</dialog-info>\n",
+
+   // dialog-info as generated by SipDialogEvent, shared line appearance parameters
+   "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+   "<dialog-info xmlns=\"urn:ietf:params:xml:ns:dialog-info\" version=\"4\" state=\"partial\" entity=\"sip:222@example.com\">\n"
+   "<dialog id=\"ida648720b\" call-id=\"62c3a00e-2f2662f8-53cfd2f7@10.1.20.231\" local-tag=\"B7691142-47C44851\" remote-tag=\"1900354342\" direction=\"initiator\">\n"
+   "<state event=\"rejected\" code=\"486\">terminated</state>\n"
+   "<duration>37</duration>\n"
+   "<local>\n"
+   "<identity display=\"Line 1\">sip:222@example.com</identity>\n"
+   "<target uri=\"sip:222@example.com\">\n"
+   "<param pname=\"+sip.rendering\" pval=\"yes\"/>\n"
+   "<param pname=\"x-line-id\" pval=\"0\"/>\n"
+   "</target>\n"
+   "</local>\n"
+   "<remote>\n"
+   "<identity>sip:100@example.com</identity>\n"
+   "<target uri=\"sip:10.1.1.26:5100\">\n"
+   "</target>\n"
+   "</remote>\n"
+   "</dialog>\n"
+   "<dialog id=\"ida648720c\" call-id=\"62c3a00e-2f2662f8-53cfd2f8@10.1.20.231\" local-tag=\"B7691142-47C44852\" remote-tag=\"1900354343\" direction=\"recipient\">\n"
+   "<state>confirmed</state>\n"
+   "<local>\n"
+   "<identity>sip:222@example.com</identity>\n"
+   "</local>\n"
+   "<remote>\n"
+   "<identity>sip:101@example.com</identity>\n"
+   "</remote>\n"
+   "</dialog>\n"
+   "</dialog-info>\n",
+
+   // reginfo as generated by RegisterEventServer, three contacts
+   "<?xml version=\"1.0\"?>\r\n"
+   "<reginfo xmlns=\"urn:ietf:params:xml:ns:reginfo\" xmlns:gr=\"urn:ietf:params:xml:ns:gruuinfo\" xmlns:in=\"http://www.sipfoundry.org/sipX/schema/xml/reg-instrument-00-00\" version=\"12\" state=\"full\">\r\n"
+   "  <registration aor=\"sip:alice@example.com\" id=\"sip:alice@example.com\" state=\"active\">\r\n"
+   "    <contact id=\"sip:alice@example.com@@&lt;sip:alice@10.1.1.10:5060;transport=udp&gt;\" state=\"active\" event=\"registered\" q=\"1\" callid=\"a84b4c76e66710@10.1.1.10\" cseq=\"314\">\r\n"
+   "      <uri>sip:alice@10.1.1.10:5060;transport=udp</uri>\r\n"
+   "      <display-name>Alice</display-name>\r\n"
+   "      <unknown-param name=\"+sip.instance\">&lt;urn:uuid:00000000-0000-1000-8000-000A95A0E128&gt;</unknown-param>\r\n"
+   "      <gr:pub-gruu uri=\"sip:~~gr~b55a2ad8e8e4@example.com\"/>\r\n"
+   "      <in:instrument>0004f2a0e128</in:instrument>\r\n"
+   "    </contact>\r\n"
+   "    <contact id=\"sip:alice@example.com@@&lt;sip:alice@10.1.1.11:5060&gt;\" state=\"active\" event=\"registered\" q=\"0.8\" callid=\"b84b4c76e66711@10.1.1.11\" cseq=\"12\">\r\n"
+   "      <uri>sip:alice@10.1.1.11:5060</uri>\r\n"
+   "      <unknown-param name=\"path\">&lt;sip:10.1.1.1;lr&gt;</unknown-param>\r\n"
+   "    </contact>\r\n"
+   "    <contact id=\"sip:alice@example.com@@&lt;sip:alice@10.1.1.12:5060&gt;\" state=\"terminated\" event=\"expired\" q=\"1\" callid=\"c84b4c76e66712@10.1.1.12\" cseq=\"7\">\r\n"
+   "      <uri>sip:alice@10.1.1.12:5060</uri>\r\n"
+   "    </contact>\r\n"
+   "  </registration>\r\n"
+   "</reginfo>\r\n"
+};
+
+// Keeps the compiler from optimizing the parsing away
+size_t externalForSideEffects;
+
+static void walkDom(const TiXmlNode* node)
+{
+   for (const TiXmlNode* child = node->FirstChild(); child; child = child->NextSibling())
+   {
+      const TiXmlElement* element = child->ToElement();
+      if (element)
+      {
+         for (const TiXmlAttribute* attribute = element->FirstAttribute();
+              attribute;
+              attribute = attribute->Next())
+         {
+            externalForSideEffects += strlen(attribute->Value());
+         }
+         walkDom(element);
+      }
+      else if (child->ToText())
+      {
+         externalForSideEffects += strlen(child->Value());
+      }
+   }
+}
+
+static void parseTinyXml(const std::string& body)
+{
+   TiXmlDocument doc;
+   doc.Parse(body.c_str());
+   walkDom(&doc);
+}
+
+static void parsePull(const std::string& body)
+{
+   UtlString value;
+   XmlPullParser parser(body.data(), body.size());
+   for (XmlPullParser::Event event = parser.next();
+        event != XmlPullParser::END_DOCUMENT && event != XmlPullParser::ERROR;
+        event = parser.next())
+   {
+      if (event == XmlPullParser::START_ELEMENT)
+      {
+         for (size_t i = 0; i < parser.getAttributeCount(); i++)
+         {
+            value.remove(0);
+            parser.getAttributeValue(i).decodeTo(value);
+            externalForSideEffects += value.length();
+         }
+      }
+      else if (event == XmlPullParser::TEXT)
+      {
+         value.remove(0);
+         parser.getText().decodeTo(value, true);
+         externalForSideEffects += value.length();
+      }
+   }
+}
+
+static void loadCorpus(const char* directory, std::vector<std::string>& bodies)
+{
+   DIR* dir = opendir(directory);
+   if (!dir)
+   {
+      fprintf(stderr, "cannot open corpus directory '%s'\n", directory);
+      exit(1);
+   }
+
+   struct dirent* entry;
+   while ((entry = readdir(dir)))
+   {
+      size_t length = strlen(entry->d_name);
+      if (length > 4 && strcmp(entry->d_name + length - 4, ".xml") == 0)
+      {
+         std::string path(directory);
+         path.append("/").append(entry->d_name);
+         std::ifstream file(path.c_str());
+         std::ostringstream content;
+         content << file.rdbuf();
+         bodies.push_back(content.str());
+      }
+   }
+   closedir(dir);
+}
+
+static void measure(const char* name,
+                    void (*parse)(const std::string&),
+                    const std::vector<std::string>& bodies,
+                    int iterations)
+{
+   size_t bytes = 0;
+   OsTime start, end;
+
+   OsDateTime::getCurTime(start);
+   for (int n = 0; n < iterations; n++)
+   {
+      for (size_t i = 0; i < bodies.size(); i++)
+      {
+         parse(bodies[i]);
+         bytes += bodies[i].size();
+      }
+   }
+   OsDateTime::getCurTime(end);
+
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+   if (seconds <= 0)
+   {
+      seconds = 0.000001;
+   }
+   printf("%-16s %8.3f s %10.0f bodies/s %8.2f MB/s\n",
+          name, seconds,
+          (iterations * bodies.size()) / seconds,
+          bytes / seconds / (1024 * 1024));
+}
+
+int main(int argc, char* argv[])
+{
+   int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+
+   std::vector<std::string> bodies;
+   if (argc > 2)
+   {
+      loadCorpus(argv[2], bodies);
+   }
+   else
+   {
+      bodies.assign(corpus, corpus + sizeof(corpus) / sizeof(corpus[0]));
+   }
+
+   if (bodies.empty() || iterations <= 0)
+   {
+      fprintf(stderr, "usage: %s [iterations] [corpus-directory]\n", argv[0]);
+      return 1;
+   }
+
+   printf("%zu bodies, %d iterations\n", bodies.size(), iterations);
+   measure("TiXmlDocument", parseTinyXml, bodies, iterations);
+   measure("XmlPullParser", parsePull, bodies, iterations);
+
+   return 0;
+}
@@ -0,0 +1,233 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <string.h>
+
+#include "utl/UtlString.h"
+#include "utl/XmlContent.h"
+#include "xmlparser/XmlPullParser.h"
+#include "xmlparser/XmlWriter.h"
+#include <sipxunit/TestUtilities.h>
+
+using namespace std ;
+
+class XmlPullParserTest : public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(XmlPullParserTest);
+    CPPUNIT_TEST(testEvents);
+    CPPUNIT_TEST(testAttributes);
+    CPPUNIT_TEST(testCharacterReferences);
+    CPPUNIT_TEST(testReadText);
+    CPPUNIT_TEST(testSkipElement);
+    CPPUNIT_TEST(testMalformed);
+    CPPUNIT_TEST(testWriter);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   static UtlString decoded(const XmlPullParser::Slice& slice)
+      {
+         UtlString value;
+         slice.decodeTo(value);
+         return value;
+      }
+
+   static XmlPullParser::Event parseAll(const char* document)
+      {
+         XmlPullParser parser(document, strlen(document));
+         XmlPullParser::Event event;
+         while ((event = parser.next()) != XmlPullParser::END_DOCUMENT
+                && event != XmlPullParser::ERROR)
+         {
+         }
+         return event;
+      }
+
+   void testEvents()
+      {
+         const char* document =
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<!-- comment -->\n"
+            "<reginfo xmlns=\"urn:ietf:params:xml:ns:reginfo\">"
+            "<registration/>"
+            "text<![CDATA[<raw>]]>"
+            "</reginfo>\n";
+
+         XmlPullParser parser(document, strlen(document));
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::PROCESSING_INSTRUCTION, parser.next());
+         CPPUNIT_ASSERT(parser.getName().equals("xml"));
+         CPPUNIT_ASSERT_EQUAL((size_t)2, parser.getAttributeCount());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::COMMENT, parser.next());
+         ASSERT_STR_EQUAL(" comment ", decoded(parser.getText()).data());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+         CPPUNIT_ASSERT(parser.getName().equals("reginfo"));
+         CPPUNIT_ASSERT_EQUAL((size_t)1, parser.getDepth());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+         CPPUNIT_ASSERT(parser.getName().equals("registration"));
+         CPPUNIT_ASSERT(parser.isEmptyElement());
+         CPPUNIT_ASSERT_EQUAL((size_t)2, parser.getDepth());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_ELEMENT, parser.next());
+         CPPUNIT_ASSERT(parser.getName().equals("registration"));
+         CPPUNIT_ASSERT_EQUAL((size_t)2, parser.getDepth());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::TEXT, parser.next());
+         ASSERT_STR_EQUAL("text", decoded(parser.getText()).data());
+         CPPUNIT_ASSERT(!parser.isCData());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::TEXT, parser.next());
+         ASSERT_STR_EQUAL("<raw>", decoded(parser.getText()).data());
+         CPPUNIT_ASSERT(parser.isCData());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_ELEMENT, parser.next());
+         CPPUNIT_ASSERT(parser.getName().equals("reginfo"));
+         CPPUNIT_ASSERT_EQUAL((size_t)1, parser.getDepth());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_DOCUMENT, parser.next());
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_DOCUMENT, parser.next());
+      }
+
+   void testAttributes()
+      {
+         const char* document =
+            "<gr:pub-gruu uri='sip:a&amp;b@example.com' q = \"&lt;&#x41;&#66;&gt;\" v=\"&version;\"/>";
+
+         XmlPullParser parser(document, strlen(document));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+         CPPUNIT_ASSERT(parser.getName().equals("gr:pub-gruu"));
+         CPPUNIT_ASSERT(parser.getLocalName().equals("pub-gruu"));
+
+         XmlPullParser::Slice value;
+         CPPUNIT_ASSERT(parser.getAttribute("uri", value));
+         ASSERT_STR_EQUAL("sip:a&b@example.com", decoded(value).data());
+
+         CPPUNIT_ASSERT(parser.getAttribute("q", value));
+         ASSERT_STR_EQUAL("<AB>", decoded(value).data());
+
+         // unknown entities, like the version placeholder, are kept as is
+         CPPUNIT_ASSERT(parser.getAttribute("v", value));
+         ASSERT_STR_EQUAL("&version;", decoded(value).data());
+
+         CPPUNIT_ASSERT(!parser.getAttribute("missing", value));
+      }
+
+   void testCharacterReferences()
+      {
+         const char* document =
+            "<e max=\"&#x10FFFF;\" empty=\"&#;\" emptyHex=\"&#x;\""
+            " over=\"&#x110000;\" wrap=\"&#x10000000000000041;\" long=\"&#18446744073709551681;\"/>";
+
+         XmlPullParser parser(document, strlen(document));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+
+         XmlPullParser::Slice value;
+         CPPUNIT_ASSERT(parser.getAttribute("max", value));
+         ASSERT_STR_EQUAL("\xF4\x8F\xBF\xBF", decoded(value).data());
+
+         // references without digits, or beyond Unicode, are kept as is
+         CPPUNIT_ASSERT(parser.getAttribute("empty", value));
+         ASSERT_STR_EQUAL("&#;", decoded(value).data());
+         CPPUNIT_ASSERT(parser.getAttribute("emptyHex", value));
+         ASSERT_STR_EQUAL("&#x;", decoded(value).data());
+         CPPUNIT_ASSERT(parser.getAttribute("over", value));
+         ASSERT_STR_EQUAL("&#x110000;", decoded(value).data());
+
+         // digits enough to wrap the code back to 'A' do not decode to it
+         CPPUNIT_ASSERT(parser.getAttribute("wrap", value));
+         ASSERT_STR_EQUAL("&#x10000000000000041;", decoded(value).data());
+         CPPUNIT_ASSERT(parser.getAttribute("long", value));
+         ASSERT_STR_EQUAL("&#18446744073709551681;", decoded(value).data());
+      }
+
+   void testReadText()
+      {
+         const char* document =
+            "<identity display=\"x\">\n  sip:alice@example.com;\n user=phone &amp; <b>skipped</b>\n</identity>";
+
+         XmlPullParser parser(document, strlen(document));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+
+         UtlString text;
+         CPPUNIT_ASSERT(parser.readText(text));
+         ASSERT_STR_EQUAL("sip:alice@example.com; user=phone &", text.data());
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_ELEMENT, parser.getEvent());
+         CPPUNIT_ASSERT(parser.getName().equals("identity"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_DOCUMENT, parser.next());
+      }
+
+   void testSkipElement()
+      {
+         const char* document =
+            "<dialog-info><dialog id=\"1\"><state>early</state><local/></dialog><dialog id=\"2\"/></dialog-info>";
+
+         XmlPullParser parser(document, strlen(document));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+
+         size_t begin = parser.getTokenOffset();
+         CPPUNIT_ASSERT(parser.skipElement());
+         CPPUNIT_ASSERT(parser.getName().equals("dialog"));
+         ASSERT_STR_EQUAL("<dialog id=\"1\"><state>early</state><local/></dialog>",
+                          UtlString(document + begin, parser.getOffset() - begin).data());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::START_ELEMENT, parser.next());
+         XmlPullParser::Slice id;
+         CPPUNIT_ASSERT(parser.getAttribute("id", id));
+         ASSERT_STR_EQUAL("2", decoded(id).data());
+         CPPUNIT_ASSERT(parser.skipElement());
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_ELEMENT, parser.next());
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_DOCUMENT, parser.next());
+      }
+
+   void testMalformed()
+      {
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll(""));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("<a>"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("<a><b></a>"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("<a/><b/>"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("text<a/>"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("<a x=1/>"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("<a x=\"1\"y=\"2\"/>"));
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::ERROR, parseAll("<a><!-- open</a>"));
+
+         CPPUNIT_ASSERT_EQUAL(XmlPullParser::END_DOCUMENT, parseAll("<!DOCTYPE a [ <!ENTITY e \"x\"> ]>\n<a/>\n"));
+      }
+
+   void testWriter()
+      {
+         const char* value = "<>&'\"\x01 plain";
+
+         // escaping must match XmlEscape()
+         UtlString expected;
+         XmlEscape(expected, value);
+
+         UtlString escaped;
+         XmlWriter<UtlString>::escape(escaped, value, strlen(value));
+         ASSERT_STR_EQUAL(expected.data(), escaped.data());
+
+         UtlString body;
+         XmlWriter<UtlString> writer(body);
+         writer.startTag("target").attribute("uri", "sip:a&b@example.com").closeTag()
+            .startTag("param").attribute("pname", "x").emptyTag()
+            .element("identity", "a<b")
+            .endTag("target");
+         ASSERT_STR_EQUAL("<target uri=\"sip:a&amp;b@example.com\"><param pname=\"x\"/>"
+                          "<identity>a&lt;b</identity></target>",
+                          body.data());
+      }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(XmlPullParserTest);
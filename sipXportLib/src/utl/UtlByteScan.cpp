@@ -0,0 +1,630 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define UTL_BYTESCAN_X86
+#  include <immintrin.h>
+#endif
+
+// APPLICATION INCLUDES
+#include "utl/UtlByteScan.h"
+
+// DEFINES
+// The SSE4.2 and AVX2 kernels are compiled for those instruction sets
+// whatever the flags of the rest of the library, and only called once the
+// processor is known to support them.
+#define SSE42_KERNEL __attribute__((target("sse4.2")))
+#define AVX2_KERNEL __attribute__((target("avx2")))
+
+// CONSTANTS
+static const char CR = '\r';
+static const char LF = '\n';
+
+// STATIC VARIABLE INITIALIZATIONS
+
+/* ============================ SCALAR KERNELS ============================ */
+
+static size_t findLineBreakScalar(const char* p, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+   {
+      if (p[i] == CR || p[i] == LF)
+      {
+         return i;
+      }
+   }
+   return n;
+}
+
+static size_t findAnyOfScalar(const char* p, size_t n, const UtlByteScan::ByteSet& set)
+{
+   for (size_t i = 0; i < n; i++)
+   {
+      if (set.contains(p[i]))
+      {
+         return i;
+      }
+   }
+   return n;
+}
+
+static void toUpperScalar(char* p, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+   {
+      if ((unsigned char) (p[i] - 'a') < 26)
+      {
+         p[i] -= 'a' - 'A';
+      }
+   }
+}
+
+static void toLowerScalar(char* p, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+   {
+      if ((unsigned char) (p[i] - 'A') < 26)
+      {
+         p[i] += 'a' - 'A';
+      }
+   }
+}
+
+static bool equalsIgnoreCaseScalar(const char* a, const char* b, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+   {
+      if (a[i] != b[i])
+      {
+         // Only letters may differ, and only by case.
+         char lower = a[i] | 0x20;
+         if (lower != (b[i] | 0x20) || (unsigned char) (lower - 'a') >= 26)
+         {
+            return false;
+         }
+      }
+   }
+   return true;
+}
+
+#ifdef UTL_BYTESCAN_X86
+
+/* ============================ SSE4.2 KERNELS ============================ */
+
+// The vector kernels step over the bytes a vector at a time, the last step
+// overlapping the one before it rather than leaving a tail for a byte at a
+// time loop: the bytes looked at twice held no match the first time, and
+// case conversion gives the same result when done twice.  Inputs shorter
+// than a vector go to the next narrower kernel.  The SSE4.2 kernels are
+// inline so that the AVX2 ones, which hand them short inputs, get them
+// compiled with the same (VEX) encoding.
+
+SSE42_KERNEL
+static inline size_t findLineBreakSse42(const char* p, size_t n)
+{
+   if (n < 16)
+   {
+      return findLineBreakScalar(p, n);
+   }
+
+   const __m128i cr = _mm_set1_epi8(CR);
+   const __m128i lf = _mm_set1_epi8(LF);
+   for (size_t i = 0; ; i += 16)
+   {
+      if (i + 16 > n)
+      {
+         i = n - 16;
+      }
+      __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+      unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                                     _mm_cmpeq_epi8(v, lf)));
+      if (mask)
+      {
+         return i + __builtin_ctz(mask);
+      }
+      if (i + 16 == n)
+      {
+         return n;
+      }
+   }
+}
+
+SSE42_KERNEL
+static inline size_t findAnyOfSse42(const char* p, size_t n, const UtlByteScan::ByteSet& set,
+                                    int count, const char* bytes)
+{
+   if (n < 16 || count > 16)
+   {
+      return findAnyOfScalar(p, n, set);
+   }
+
+   // PCMPESTRI compares each byte of the text against up to 16 set bytes.
+   const __m128i s = _mm_loadu_si128((const __m128i*) bytes);
+   for (size_t i = 0; ; i += 16)
+   {
+      if (i + 16 > n)
+      {
+         i = n - 16;
+      }
+      __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+      int index = _mm_cmpestri(s, count, v, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+      if (index < 16)
+      {
+         return i + index;
+      }
+      if (i + 16 == n)
+      {
+         return n;
+      }
+   }
+}
+
+// Mask of the bytes of v from first to last, as signed bytes; ASCII
+// letters are positive, so bytes above 0x7f never match.
+SSE42_KERNEL
+static inline __m128i rangeSse42(__m128i v, char first, char last)
+{
+   return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(first - 1)),
+                        _mm_cmplt_epi8(v, _mm_set1_epi8(last + 1)));
+}
+
+SSE42_KERNEL
+static inline void toUpperSse42(char* p, size_t n)
+{
+   if (n < 16)
+   {
+      toUpperScalar(p, n);
+      return;
+   }
+
+   const __m128i caseBit = _mm_set1_epi8(0x20);
+   for (size_t i = 0; ; i += 16)
+   {
+      if (i + 16 > n)
+      {
+         i = n - 16;
+      }
+      __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+      v = _mm_sub_epi8(v, _mm_and_si128(rangeSse42(v, 'a', 'z'), caseBit));
+      _mm_storeu_si128((__m128i*) (p + i), v);
+      if (i + 16 == n)
+      {
+         return;
+      }
+   }
+}
+
+SSE42_KERNEL
+static inline void toLowerSse42(char* p, size_t n)
+{
+   if (n < 16)
+   {
+      toLowerScalar(p, n);
+      return;
+   }
+
+   const __m128i caseBit = _mm_set1_epi8(0x20);
+   for (size_t i = 0; ; i += 16)
+   {
+      if (i + 16 > n)
+      {
+         i = n - 16;
+      }
+      __m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+      v = _mm_add_epi8(v, _mm_and_si128(rangeSse42(v, 'A', 'Z'), caseBit));
+      _mm_storeu_si128((__m128i*) (p + i), v);
+      if (i + 16 == n)
+      {
+         return;
+      }
+   }
+}
+
+SSE42_KERNEL
+static inline bool equalsIgnoreCaseSse42(const char* a, const char* b, size_t n)
+{
+   if (n < 16)
+   {
+      return equalsIgnoreCaseScalar(a, b, n);
+   }
+
+   const __m128i caseBit = _mm_set1_epi8(0x20);
+   for (size_t i = 0; ; i += 16)
+   {
+      if (i + 16 > n)
+      {
+         i = n - 16;
+      }
+      __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+      __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+      va = _mm_add_epi8(va, _mm_and_si128(rangeSse42(va, 'A', 'Z'), caseBit));
+      vb = _mm_add_epi8(vb, _mm_and_si128(rangeSse42(vb, 'A', 'Z'), caseBit));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+      {
+         return false;
+      }
+      if (i + 16 == n)
+      {
+         return true;
+      }
+   }
+}
+
+/* ============================ AVX2 KERNELS ============================== */
+
+AVX2_KERNEL
+static size_t findLineBreakAvx2(const char* p, size_t n)
+{
+   if (n < 32)
+   {
+      return findLineBreakSse42(p, n);
+   }
+
+   const __m256i cr = _mm256_set1_epi8(CR);
+   const __m256i lf = _mm256_set1_epi8(LF);
+   for (size_t i = 0; ; i += 32)
+   {
+      if (i + 32 > n)
+      {
+         i = n - 32;
+      }
+      __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+      unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr),
+                                                           _mm256_cmpeq_epi8(v, lf)));
+      if (mask)
+      {
+         return i + __builtin_ctz(mask);
+      }
+      if (i + 32 == n)
+      {
+         return n;
+      }
+   }
+}
+
+AVX2_KERNEL
+static size_t findAnyOfAvx2(const char* p, size_t n, const UtlByteScan::ByteSet& set,
+                            int count, const char* bytes)
+{
+   // A compare per byte of the set beats PCMPESTRI for the small sets
+   // tokenizers use; larger sets are left to it.
+   if (n < 32 || count > 4 || count == 0)
+   {
+      return findAnyOfSse42(p, n, set, count, bytes);
+   }
+
+   // Unused compares repeat the first byte of the set.
+   const __m256i s0 = _mm256_set1_epi8(bytes[0]);
+   const __m256i s1 = _mm256_set1_epi8(bytes[count > 1 ? 1 : 0]);
+   const __m256i s2 = _mm256_set1_epi8(bytes[count > 2 ? 2 : 0]);
+   const __m256i s3 = _mm256_set1_epi8(bytes[count > 3 ? 3 : 0]);
+   for (size_t i = 0; ; i += 32)
+   {
+      if (i + 32 > n)
+      {
+         i = n - 32;
+      }
+      __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+      __m256i match = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, s0),
+                                                      _mm256_cmpeq_epi8(v, s1)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, s2),
+                                                      _mm256_cmpeq_epi8(v, s3)));
+      unsigned mask = _mm256_movemask_epi8(match);
+      if (mask)
+      {
+         return i + __builtin_ctz(mask);
+      }
+      if (i + 32 == n)
+      {
+         return n;
+      }
+   }
+}
+
+AVX2_KERNEL
+static inline __m256i rangeAvx2(__m256i v, char first, char last)
+{
+   return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(first - 1)),
+                           _mm256_cmpgt_epi8(_mm256_set1_epi8(last + 1), v));
+}
+
+AVX2_KERNEL
+static void toUpperAvx2(char* p, size_t n)
+{
+   if (n < 32)
+   {
+      toUpperSse42(p, n);
+      return;
+   }
+
+   const __m256i caseBit = _mm256_set1_epi8(0x20);
+   for (size_t i = 0; ; i += 32)
+   {
+      if (i + 32 > n)
+      {
+         i = n - 32;
+      }
+      __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+      v = _mm256_sub_epi8(v, _mm256_and_si256(rangeAvx2(v, 'a', 'z'), caseBit));
+      _mm256_storeu_si256((__m256i*) (p + i), v);
+      if (i + 32 == n)
+      {
+         return;
+      }
+   }
+}
+
+AVX2_KERNEL
+static void toLowerAvx2(char* p, size_t n)
+{
+   if (n < 32)
+   {
+      toLowerSse42(p, n);
+      return;
+   }
+
+   const __m256i caseBit = _mm256_set1_epi8(0x20);
+   for (size_t i = 0; ; i += 32)
+   {
+      if (i + 32 > n)
+      {
+         i = n - 32;
+      }
+      __m256i v = _mm256_loadu_si256((const __m256i*) (p + i));
+      v = _mm256_add_epi8(v, _mm256_and_si256(rangeAvx2(v, 'A', 'Z'), caseBit));
+      _mm256_storeu_si256((__m256i*) (p + i), v);
+      if (i + 32 == n)
+      {
+         return;
+      }
+   }
+}
+
+AVX2_KERNEL
+static bool equalsIgnoreCaseAvx2(const char* a, const char* b, size_t n)
+{
+   if (n < 32)
+   {
+      return equalsIgnoreCaseSse42(a, b, n);
+   }
+
+   const __m256i caseBit = _mm256_set1_epi8(0x20);
+   for (size_t i = 0; ; i += 32)
+   {
+      if (i + 32 > n)
+      {
+         i = n - 32;
+      }
+      __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+      __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+      va = _mm256_add_epi8(va, _mm256_and_si256(rangeAvx2(va, 'A', 'Z'), caseBit));
+      vb = _mm256_add_epi8(vb, _mm256_and_si256(rangeAvx2(vb, 'A', 'Z'), caseBit));
+      if ((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != 0xffffffffU)
+      {
+         return false;
+      }
+      if (i + 32 == n)
+      {
+         return true;
+      }
+   }
+}
+
+#endif // UTL_BYTESCAN_X86
+
+/* ============================ KERNEL SELECTION ========================== */
+
+static UtlByteScan::Kernel detectKernel()
+{
+#ifdef UTL_BYTESCAN_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2"))
+   {
+      return UtlByteScan::AVX2;
+   }
+   if (__builtin_cpu_supports("sse4.2"))
+   {
+      return UtlByteScan::SSE42;
+   }
+#endif
+   return UtlByteScan::SCALAR;
+}
+
+// Until this is initialized (by static initializers of other modules that
+// run first) it is zero, which selects the scalar kernels.
+UtlByteScan::Kernel UtlByteScan::sKernel = detectKernel();
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+UtlByteScan::ByteSet::ByteSet(const char* bytes) :
+   mCount(0)
+{
+   memset(mBits, 0, sizeof(mBits));
+   memset(mBytes, 0, sizeof(mBytes));
+   for (; *bytes; bytes++)
+   {
+      add(*bytes);
+   }
+}
+
+void UtlByteScan::ByteSet::add(char byte)
+{
+   if (!contains(byte))
+   {
+      unsigned char u = byte;
+      mBits[u >> 5] |= 1U << (u & 31);
+      if (mCount < (int) sizeof(mBytes))
+      {
+         mBytes[mCount] = byte;
+      }
+      mCount++;
+   }
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+void UtlByteScan::toUpper(char* p, size_t n)
+{
+#ifdef UTL_BYTESCAN_X86
+   switch (sKernel)
+   {
+   case AVX2:
+      toUpperAvx2(p, n);
+      return;
+   case SSE42:
+      toUpperSse42(p, n);
+      return;
+   default:
+      break;
+   }
+#endif
+   toUpperScalar(p, n);
+}
+
+void UtlByteScan::toLower(char* p, size_t n)
+{
+#ifdef UTL_BYTESCAN_X86
+   switch (sKernel)
+   {
+   case AVX2:
+      toLowerAvx2(p, n);
+      return;
+   case SSE42:
+      toLowerSse42(p, n);
+      return;
+   default:
+      break;
+   }
+#endif
+   toLowerScalar(p, n);
+}
+
+/* ============================ ACCESSORS ================================= */
+
+size_t UtlByteScan::findLineBreak(const char* p, size_t n)
+{
+#ifdef UTL_BYTESCAN_X86
+   switch (sKernel)
+   {
+   case AVX2:
+      return findLineBreakAvx2(p, n);
+   case SSE42:
+      return findLineBreakSse42(p, n);
+   default:
+      break;
+   }
+#endif
+   return findLineBreakScalar(p, n);
+}
+
+size_t UtlByteScan::findAnyOf(const char* p, size_t n, const ByteSet& set)
+{
+#ifdef UTL_BYTESCAN_X86
+   switch (sKernel)
+   {
+   case AVX2:
+      return findAnyOfAvx2(p, n, set, set.mCount, set.mBytes);
+   case SSE42:
+      return findAnyOfSse42(p, n, set, set.mCount, set.mBytes);
+   default:
+      break;
+   }
+#endif
+   return findAnyOfScalar(p, n, set);
+}
+
+ssize_t UtlByteScan::findBlankLine(const char* p, size_t n, size_t& lineStart)
+{
+   size_t line = lineStart;
+   while (line < n)
+   {
+      if (p[line] == LF)
+      {
+         // An empty line: the headers end after its line break.
+         return line + 1;
+      }
+      if (p[line] == CR)
+      {
+         if (line + 1 == n)
+         {
+            // Wait for the byte after the CR, to know whether the line
+            // break is CR LF or a lone CR.
+            break;
+         }
+         return line + (p[line + 1] == LF ? 2 : 1);
+      }
+
+      size_t lineBreak = line + findLineBreak(p + line, n - line);
+      if (lineBreak + 1 >= n)
+      {
+         // The line is not yet ended, or ends with the last byte, which
+         // if a CR may still turn out to be followed by LF.
+         break;
+      }
+      line = lineBreak + 1;
+      if (p[lineBreak] == CR && p[line] == LF)
+      {
+         line++;
+      }
+   }
+
+   lineStart = line;
+   return -1;
+}
+
+UtlByteScan::Kernel UtlByteScan::kernel()
+{
+   return sKernel;
+}
+
+UtlByteScan::Kernel UtlByteScan::supportedKernel()
+{
+   return detectKernel();
+}
+
+UtlByteScan::Kernel UtlByteScan::setKernel(Kernel kernel)
+{
+   Kernel supported = detectKernel();
+   sKernel = kernel < supported ? kernel : supported;
+   return sKernel;
+}
+
+const char* UtlByteScan::kernelName(Kernel kernel)
+{
+   switch (kernel)
+   {
+   case AVX2:
+      return "avx2";
+   case SSE42:
+      return "sse4.2";
+   default:
+      return "scalar";
+   }
+}
+
+/* ============================ INQUIRY =================================== */
+
+bool UtlByteScan::equalsIgnoreCase(const char* a, const char* b, size_t n)
+{
+#ifdef UTL_BYTESCAN_X86
+   switch (sKernel)
+   {
+   case AVX2:
+      return equalsIgnoreCaseAvx2(a, b, n);
+   case SSE42:
+      return equalsIgnoreCaseSse42(a, b, n);
+   default:
+      break;
+   }
+#endif
+   return equalsIgnoreCaseScalar(a, b, n);
+}
@@ -0,0 +1,406 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// APPLICATION INCLUDES
+#include "utl/UtlMetrics.h"
+#include "os/OsLogger.h"
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+const char* UtlMetrics::CONTENT_TYPE = "text/plain; version=0.0.4";
+
+// STATIC VARIABLE INITIALIZATIONS
+static volatile unsigned int sNextShard = 0;
+static __thread int sThreadShard = -1;
+
+/* //////////////////////////// UtlMetric ///////////////////////////////// */
+
+unsigned int UtlMetric::shard()
+{
+   if (sThreadShard < 0)
+   {
+      sThreadShard = __sync_fetch_and_add(&sNextShard, 1) % SHARDS;
+   }
+   return sThreadShard;
+}
+
+void UtlMetric::appendSample(UtlString& out, const char* name, const char* suffix,
+                             const char* labels, const char* value)
+{
+   out.append(name);
+   out.append(suffix);
+   if (*labels)
+   {
+      out.append('{');
+      out.append(labels);
+      out.append('}');
+   }
+   out.append(' ');
+   out.append(value);
+   out.append('\n');
+}
+
+static void formatInt(char* buffer, size_t size, Int64 value)
+{
+   snprintf(buffer, size, "%" FORMAT_INTLL "d", value);
+}
+
+static void formatDouble(char* buffer, size_t size, double value)
+{
+   snprintf(buffer, size, "%.9g", value);
+}
+
+/* //////////////////////////// UtlMetricCounter ////////////////////////// */
+
+UtlMetricCounter::UtlMetricCounter()
+{
+   for (int i = 0; i < SHARDS; i++)
+   {
+      mShards[i].value = 0;
+   }
+}
+
+Int64 UtlMetricCounter::getValue() const
+{
+   Int64 value = 0;
+   for (int i = 0; i < SHARDS; i++)
+   {
+      value += mShards[i].value;
+   }
+   return value;
+}
+
+void UtlMetricCounter::exportText(UtlString& out, const char* name, const char* labels) const
+{
+   char value[32];
+   formatInt(value, sizeof(value), getValue());
+   appendSample(out, name, "", labels, value);
+}
+
+/* //////////////////////////// UtlMetricGauge //////////////////////////// */
+
+UtlMetricGauge::UtlMetricGauge()
+{
+   for (int i = 0; i < SHARDS; i++)
+   {
+      mShards[i].value = 0;
+   }
+}
+
+void UtlMetricGauge::set(Int64 value)
+{
+   add(value - getValue());
+}
+
+Int64 UtlMetricGauge::getValue() const
+{
+   Int64 value = 0;
+   for (int i = 0; i < SHARDS; i++)
+   {
+      value += mShards[i].value;
+   }
+   return value;
+}
+
+void UtlMetricGauge::exportText(UtlString& out, const char* name, const char* labels) const
+{
+   char value[32];
+   formatInt(value, sizeof(value), getValue());
+   appendSample(out, name, "", labels, value);
+}
+
+/* //////////////////////////// UtlMetricHistogram //////////////////////// */
+
+UtlMetricHistogram::UtlMetricHistogram(double scale)
+   : mScale(scale)
+{
+   for (int i = 0; i < SHARDS; i++)
+   {
+      for (int b = 0; b < BINS; b++)
+      {
+         mShards[i].bins[b] = 0;
+      }
+      mShards[i].sum = 0;
+   }
+}
+
+// SUB_BINS is 4, so the top 2 bits after the leading one pick the sub bin.
+unsigned int UtlMetricHistogram::binOf(Int64 value)
+{
+   if (value < SUB_BINS)
+   {
+      return value < 0 ? 0 : (unsigned int) value;
+   }
+
+   int exponent = 63 - __builtin_clzll((UInt64) value);
+   if (exponent > MAX_EXPONENT)
+   {
+      return BINS - 1;
+   }
+   return SUB_BINS + (exponent - 2) * SUB_BINS + ((value >> (exponent - 2)) - SUB_BINS);
+}
+
+Int64 UtlMetricHistogram::upperBound(unsigned int bin)
+{
+   if (bin < SUB_BINS)
+   {
+      return bin;
+   }
+   if (bin >= BINS - 1)
+   {
+      return LLONG_MAX;
+   }
+
+   unsigned int exponent = 2 + (bin - SUB_BINS) / SUB_BINS;
+   Int64 subBin = SUB_BINS + (bin - SUB_BINS) % SUB_BINS;
+   return ((subBin + 1) << (exponent - 2)) - 1;
+}
+
+UInt64 UtlMetricHistogram::operator[](unsigned int bin) const
+{
+   UInt64 count = 0;
+   if (bin < BINS)
+   {
+      for (int i = 0; i < SHARDS; i++)
+      {
+         count += mShards[i].bins[bin];
+      }
+   }
+   return count;
+}
+
+UInt64 UtlMetricHistogram::getCount() const
+{
+   UInt64 count = 0;
+   for (int b = 0; b < BINS; b++)
+   {
+      count += (*this)[b];
+   }
+   return count;
+}
+
+Int64 UtlMetricHistogram::getSum() const
+{
+   Int64 sum = 0;
+   for (int i = 0; i < SHARDS; i++)
+   {
+      sum += mShards[i].sum;
+   }
+   return sum;
+}
+
+Int64 UtlMetricHistogram::now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (Int64) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Buckets are written up to the last bin that has a count, so a histogram
+// of small values does not export all BINS buckets.
+void UtlMetricHistogram::exportText(UtlString& out, const char* name, const char* labels) const
+{
+   UInt64 counts[BINS];
+   UInt64 count = 0;
+   int last = -1;
+   for (int b = 0; b < BINS; b++)
+   {
+      counts[b] = (*this)[b];
+      count += counts[b];
+      if (counts[b] != 0 && b < BINS - 1)
+      {
+         last = b;
+      }
+   }
+
+   UtlString bucketLabels(labels);
+   if (!bucketLabels.isNull())
+   {
+      bucketLabels.append(',');
+   }
+   size_t prefix = bucketLabels.length();
+
+   char value[32];
+   UInt64 cumulative = 0;
+   for (int b = 0; b <= last; b++)
+   {
+      cumulative += counts[b];
+      bucketLabels.remove(prefix);
+      bucketLabels.append("le=\"");
+      formatDouble(value, sizeof(value), upperBound(b) * mScale);
+      bucketLabels.append(value);
+      bucketLabels.append('"');
+      formatInt(value, sizeof(value), cumulative);
+      appendSample(out, name, "_bucket", bucketLabels.data(), value);
+   }
+
+   bucketLabels.remove(prefix);
+   bucketLabels.append("le=\"+Inf\"");
+   formatInt(value, sizeof(value), count);
+   appendSample(out, name, "_bucket", bucketLabels.data(), value);
+
+   formatDouble(value, sizeof(value), getSum() * mScale);
+   appendSample(out, name, "_sum", labels, value);
+   formatInt(value, sizeof(value), count);
+   appendSample(out, name, "_count", labels, value);
+}
+
+/* //////////////////////////// UtlMetrics //////////////////////////////// */
+
+static UtlMetric* createCounter(double)
+{
+   return new UtlMetricCounter();
+}
+
+static UtlMetric* createGauge(double)
+{
+   return new UtlMetricGauge();
+}
+
+static UtlMetric* createHistogram(double scale)
+{
+   return new UtlMetricHistogram(scale);
+}
+
+UtlMetrics::UtlMetrics()
+{
+}
+
+UtlMetrics& UtlMetrics::instance()
+{
+   static UtlMetrics metrics;
+   return metrics;
+}
+
+UtlMetricCounter& UtlMetrics::counter(const char* name, const char* help, const char* labels)
+{
+   return *static_cast<UtlMetricCounter*>(find(name, help, labels, UtlMetric::COUNTER,
+                                               createCounter, 1.0));
+}
+
+UtlMetricGauge& UtlMetrics::gauge(const char* name, const char* help, const char* labels)
+{
+   return *static_cast<UtlMetricGauge*>(find(name, help, labels, UtlMetric::GAUGE,
+                                             createGauge, 1.0));
+}
+
+UtlMetricHistogram& UtlMetrics::histogram(const char* name, const char* help,
+                                          const char* labels, double scale)
+{
+   return *static_cast<UtlMetricHistogram*>(find(name, help, labels, UtlMetric::HISTOGRAM,
+                                                 createHistogram, scale));
+}
+
+UtlMetric* UtlMetrics::find(const char* name, const char* help, const char* labels,
+                            UtlMetric::Type type, UtlMetric* (*create)(double), double scale)
+{
+   mutex_critic_sec_lock lock(mLock);
+
+   Families::iterator family = mFamilies.find(name);
+   if (family == mFamilies.end())
+   {
+      family = mFamilies.insert(Families::value_type(name, Family())).first;
+      family->second.help = help;
+      family->second.type = type;
+   }
+   else if (family->second.type != type)
+   {
+      // Two metrics of different types with one name cannot be exported;
+      // give the caller one to record into that is not.
+      Os::Logger::instance().log(FAC_KERNEL, PRI_ERR,
+                                 "UtlMetrics::find metric '%s' already registered "
+                                 "with another type", name);
+      return create(scale);
+   }
+
+   std::map<std::string, UtlMetric*>::iterator metric = family->second.metrics.find(labels);
+   if (metric == family->second.metrics.end())
+   {
+      metric = family->second.metrics.insert(
+         std::map<std::string, UtlMetric*>::value_type(labels, create(scale))).first;
+   }
+   return metric->second;
+}
+
+void UtlMetrics::exportText(UtlString& out) const
+{
+   static const char* typeNames[] = { "counter", "gauge", "histogram" };
+
+   mutex_critic_sec_lock lock(mLock);
+
+   for (Families::const_iterator family = mFamilies.begin();
+        family != mFamilies.end();
+        family++)
+   {
+      out.append("# HELP ");
+      out.append(family->first.c_str());
+      out.append(' ');
+      // HELP text escapes only backslash and newline
+      for (const char* c = family->second.help.c_str(); *c; c++)
+      {
+         switch (*c)
+         {
+         case '\\':
+            out.append("\\\\");
+            break;
+         case '\n':
+            out.append("\\n");
+            break;
+         default:
+            out.append(*c);
+            break;
+         }
+      }
+      out.append("\n# TYPE ");
+      out.append(family->first.c_str());
+      out.append(' ');
+      out.append(typeNames[family->second.type]);
+      out.append('\n');
+
+      for (std::map<std::string, UtlMetric*>::const_iterator metric =
+              family->second.metrics.begin();
+           metric != family->second.metrics.end();
+           metric++)
+      {
+         metric->second->exportText(out, family->first.c_str(), metric->first.c_str());
+      }
+   }
+}
+
+UtlString UtlMetrics::label(const char* name, const char* value)
+{
+   UtlString label(name);
+   label.append("=\"");
+   for (const char* c = value; *c; c++)
+   {
+      switch (*c)
+      {
+      case '\\':
+         label.append("\\\\");
+         break;
+      case '"':
+         label.append("\\\"");
+         break;
+      case '\n':
+         label.append("\\n");
+         break;
+      default:
+         label.append(*c);
+         break;
+      }
+   }
+   label.append('"');
+   return label;
+}
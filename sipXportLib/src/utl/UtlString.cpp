@@ -19,6 +19,7 @@
 #include "utl/UtlString.h"
 #include "os/OsDefs.h"
 #include "utl/UtlRegex.h"
+#include "utl/UtlByteScan.h"
 #include <os/OsLogger.h>
 
 // EXTERNAL FUNCTIONS
@@ -613,35 +614,23 @@ UtlString UtlString::strip(StripType type , char toBeStriped)
 
 
 // Convert the string to all lower case characters.
-// use tolower(char*) of Standard C++ Library.
+// Same as tolower() in the C locale, which is the only one used.
 void UtlString::toLower()
 {
     if(mpData)
     {
-        char* charPtr;
-
-        for(size_t i = 0; i < mSize; i++)
-        {
-            charPtr = &mpData[i];
-            *charPtr = tolower(*charPtr);
-        }
+        UtlByteScan::toLower(mpData, mSize);
     }
 }
 
 
 // Convert the string to all upper case characters.
-// use toUpper(char*) of Standard C++ Library
+// Same as toupper() in the C locale, which is the only one used.
 void UtlString::toUpper()
 {
     if(mpData)
     {
-        char* charPtr;
-
-        for(size_t i = 0; i < mSize; i++) //waring point
-        {
-            charPtr = &mpData[i];
-            *charPtr = toupper(*charPtr);
-        }
+        UtlByteScan::toUpper(mpData, mSize);
     }
 }
 
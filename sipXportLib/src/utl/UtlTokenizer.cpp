@@ -65,14 +65,15 @@ UtlBoolean UtlTokenizer::next(UtlString &token, const char *delim)
 {
     int len = strlen(m_tokens);
     UtlBoolean done = FALSE;
+    UtlByteScan::ByteSet delimiters(delim);
 
     token.remove(0) ;
     for (int i = m_tokenPosition; i < len && !done; i++)
     {
         // token starts at first non-delimiter
-        if (!isDelim(m_tokens[i], delim))
+        if (!isDelim(m_tokens[i], delimiters))
         {
-            int end = nextDelim(m_tokens, i, len, delim);
+            int end = nextDelim(m_tokens, i, len, delimiters);
             token.append(m_tokens + i, end - i);
             m_tokenPosition = end;
             done = TRUE;
@@ -82,24 +83,15 @@ UtlBoolean UtlTokenizer::next(UtlString &token, const char *delim)
     return !token.isNull() ;
 }
 
-int UtlTokenizer::nextDelim(const char *tokens, const int start, const int len, const char *delim)
+int UtlTokenizer::nextDelim(const char *tokens, const int start, const int len,
+                            const UtlByteScan::ByteSet& delim)
 {
-    int end = start;
-    for (; end < len && !isDelim(tokens[end], delim); end++);
-
-    return end;
+    return start + UtlByteScan::findAnyOf(tokens + start, len - start, delim);
 }
 
-UtlBoolean UtlTokenizer::isDelim(const char c, const char *delim)
+UtlBoolean UtlTokenizer::isDelim(const char c, const UtlByteScan::ByteSet& delim)
 {
-    UtlBoolean match = FALSE;
-    int delimLen = strlen(delim);
-    for (int i = 0; i < delimLen && !match; i++)
-    {
-        match = (delim[i] == c);
-    }
-
-    return match;
+    return delim.contains(c);
 }
 
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
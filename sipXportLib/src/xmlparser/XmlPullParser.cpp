@@ -0,0 +1,468 @@
+/*
+ * Copyright (c) eZuce, Inc. All rights reserved.
+ * Contributed to SIPfoundry under a Contributor Agreement
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 2.1 of the License, or (at your option)
+ * any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ */
+
+// SYSTEM INCLUDES
+#include <cstring>
+
+// APPLICATION INCLUDES
+#include "xmlparser/XmlPullParser.h"
+
+// Find the first occurrence of the NUL terminated pattern in [begin, end)
+static const char* findPattern(const char* begin, const char* end, const char* pattern)
+{
+   size_t patternLength = strlen(pattern);
+   while (begin + patternLength <= end)
+   {
+      const char* first = static_cast<const char*>(memchr(begin, pattern[0], end - begin));
+      if (!first || first + patternLength > end)
+      {
+         return NULL;
+      }
+      if (memcmp(first, pattern, patternLength) == 0)
+      {
+         return first;
+      }
+      begin = first + 1;
+   }
+   return NULL;
+}
+
+static bool isNameTerminator(char c)
+{
+   return XmlPullParser::isSpace(c) || c == '/' || c == '>' || c == '=' || c == '?';
+}
+
+bool XmlPullParser::Slice::isBlank() const
+{
+   for (size_t i = 0; i < length; i++)
+   {
+      if (!isSpace(data[i]))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+XmlPullParser::XmlPullParser(const char* buffer, size_t length) :
+   mBuffer(buffer),
+   mEnd(buffer + length),
+   mPosition(buffer),
+   mTokenStart(buffer),
+   mEvent(END_DOCUMENT),
+   mCData(false),
+   mEmpty(false),
+   mPopPending(false),
+   mRootClosed(false),
+   mError(NULL),
+   mDepth(0),
+   mAttributeCount(0)
+{
+   // Skip a UTF-8 byte order mark
+   if (length >= 3 && memcmp(buffer, "\xEF\xBB\xBF", 3) == 0)
+   {
+      mPosition += 3;
+   }
+}
+
+XmlPullParser::Event XmlPullParser::next()
+{
+   if (mEvent == ERROR || (mEvent == END_DOCUMENT && mRootClosed))
+   {
+      return mEvent;
+   }
+
+   // Report the end of an empty element right after its start
+   if (mEvent == START_ELEMENT && mEmpty)
+   {
+      mEmpty = false;
+      mAttributeCount = 0;
+      mPopPending = true;
+      mTokenStart = mPosition;
+      return mEvent = END_ELEMENT;
+   }
+
+   if (mPopPending)
+   {
+      mPopPending = false;
+      if (--mDepth == 0)
+      {
+         mRootClosed = true;
+      }
+   }
+
+   mAttributeCount = 0;
+   mCData = false;
+   mName = Slice();
+   mText = Slice();
+
+   for (;;)
+   {
+      mTokenStart = mPosition;
+
+      if (mPosition >= mEnd)
+      {
+         if (mDepth > 0 || !mRootClosed)
+         {
+            return fail(mDepth > 0 ? "unexpected end of document" : "no root element");
+         }
+         mText = Slice();
+         return mEvent = END_DOCUMENT;
+      }
+
+      if (*mPosition != '<')
+      {
+         const char* lt = static_cast<const char*>(memchr(mPosition, '<', mEnd - mPosition));
+         const char* end = lt ? lt : mEnd;
+         mText = Slice(mPosition, end - mPosition);
+         mPosition = end;
+
+         if (mDepth == 0)
+         {
+            // only whitespace may appear outside of the root element
+            if (!mText.isBlank())
+            {
+               return fail("text outside of the root element");
+            }
+            continue;
+         }
+         return mEvent = TEXT;
+      }
+
+      if (mPosition + 1 >= mEnd)
+      {
+         return fail("unexpected end of document");
+      }
+
+      switch (mPosition[1])
+      {
+      case '/':
+         return parseEndTag();
+
+      case '?':
+         return parseProcessingInstruction();
+
+      case '!':
+      {
+         Event event = parseMarkup();
+         if (event == END_DOCUMENT)
+         {
+            // a declaration that is not reported, look for the next token
+            continue;
+         }
+         return event;
+      }
+
+      default:
+         return parseStartTag();
+      }
+   }
+}
+
+XmlPullParser::Slice XmlPullParser::getLocalName() const
+{
+   const char* colon = static_cast<const char*>(memchr(mName.data, ':', mName.length));
+   if (!colon)
+   {
+      return mName;
+   }
+   return Slice(colon + 1, mName.length - (colon + 1 - mName.data));
+}
+
+bool XmlPullParser::getAttribute(const char* name, Slice& value) const
+{
+   for (size_t i = 0; i < mAttributeCount; i++)
+   {
+      if (mAttributes[i].name.equals(name))
+      {
+         value = mAttributes[i].value;
+         return true;
+      }
+   }
+   return false;
+}
+
+bool XmlPullParser::skipElement()
+{
+   if (mEvent != START_ELEMENT)
+   {
+      return false;
+   }
+
+   size_t depth = mDepth;
+   for (Event event = next(); ; event = next())
+   {
+      if (event == END_ELEMENT && mDepth == depth)
+      {
+         return true;
+      }
+      if (event == END_DOCUMENT || event == ERROR)
+      {
+         return false;
+      }
+   }
+}
+
+XmlPullParser::Event XmlPullParser::fail(const char* error)
+{
+   mError = error;
+   mAttributeCount = 0;
+   return mEvent = ERROR;
+}
+
+bool XmlPullParser::parseName(const char*& cursor, const char* end, Slice& name)
+{
+   const char* start = cursor;
+   while (cursor < end && !isNameTerminator(*cursor))
+   {
+      ++cursor;
+   }
+   name = Slice(start, cursor - start);
+   return !name.empty();
+}
+
+bool XmlPullParser::parseAttributes(const char*& cursor, const char* end)
+{
+   for (;;)
+   {
+      while (cursor < end && isSpace(*cursor))
+      {
+         ++cursor;
+      }
+      if (cursor >= end || *cursor == '/' || *cursor == '>' || *cursor == '?')
+      {
+         return true;
+      }
+
+      if (mAttributeCount >= MAX_ATTRIBUTES)
+      {
+         mError = "too many attributes";
+         return false;
+      }
+
+      Attribute& attribute = mAttributes[mAttributeCount];
+      if (!parseName(cursor, end, attribute.name))
+      {
+         mError = "malformed attribute name";
+         return false;
+      }
+
+      while (cursor < end && isSpace(*cursor))
+      {
+         ++cursor;
+      }
+      if (cursor >= end || *cursor != '=')
+      {
+         mError = "attribute without value";
+         return false;
+      }
+      ++cursor;
+      while (cursor < end && isSpace(*cursor))
+      {
+         ++cursor;
+      }
+      if (cursor >= end || (*cursor != '"' && *cursor != '\''))
+      {
+         mError = "unquoted attribute value";
+         return false;
+      }
+
+      char quote = *cursor++;
+      const char* close = static_cast<const char*>(memchr(cursor, quote, end - cursor));
+      if (!close)
+      {
+         mError = "unterminated attribute value";
+         return false;
+      }
+      attribute.value = Slice(cursor, close - cursor);
+      cursor = close + 1;
+      mAttributeCount++;
+
+      if (cursor < end && !isSpace(*cursor) && *cursor != '/' && *cursor != '>' && *cursor != '?')
+      {
+         mError = "missing whitespace between attributes";
+         return false;
+      }
+   }
+}
+
+XmlPullParser::Event XmlPullParser::parseStartTag()
+{
+   if (mRootClosed)
+   {
+      return fail("more than one root element");
+   }
+   if (mDepth >= MAX_DEPTH)
+   {
+      return fail("elements nested too deeply");
+   }
+
+   const char* cursor = mPosition + 1;
+   if (!parseName(cursor, mEnd, mName))
+   {
+      return fail("malformed element name");
+   }
+   if (!parseAttributes(cursor, mEnd))
+   {
+      return fail(mError);
+   }
+
+   if (cursor < mEnd && *cursor == '/')
+   {
+      ++cursor;
+      mEmpty = true;
+   }
+   else
+   {
+      mEmpty = false;
+   }
+   if (cursor >= mEnd || *cursor != '>')
+   {
+      return fail("unterminated start tag");
+   }
+
+   mPosition = cursor + 1;
+   mOpenElements[mDepth++] = mName;
+   return mEvent = START_ELEMENT;
+}
+
+XmlPullParser::Event XmlPullParser::parseEndTag()
+{
+   const char* cursor = mPosition + 2;
+   if (!parseName(cursor, mEnd, mName))
+   {
+      return fail("malformed end tag");
+   }
+   while (cursor < mEnd && isSpace(*cursor))
+   {
+      ++cursor;
+   }
+   if (cursor >= mEnd || *cursor != '>')
+   {
+      return fail("unterminated end tag");
+   }
+   if (mDepth == 0)
+   {
+      return fail("end tag without start tag");
+   }
+
+   const Slice& open = mOpenElements[mDepth - 1];
+   if (open.length != mName.length || memcmp(open.data, mName.data, mName.length) != 0)
+   {
+      return fail("mismatched end tag");
+   }
+
+   mPosition = cursor + 1;
+   mPopPending = true;
+   return mEvent = END_ELEMENT;
+}
+
+XmlPullParser::Event XmlPullParser::parseProcessingInstruction()
+{
+   const char* close = findPattern(mPosition + 2, mEnd, "?>");
+   if (!close)
+   {
+      return fail("unterminated processing instruction");
+   }
+
+   const char* cursor = mPosition + 2;
+   if (!parseName(cursor, close, mName))
+   {
+      return fail("malformed processing instruction");
+   }
+
+   const char* content = cursor;
+   while (content < close && isSpace(*content))
+   {
+      ++content;
+   }
+   mText = Slice(content, close - content);
+
+   // The XML declaration carries pseudo-attributes (version, encoding, standalone)
+   if (mName.equals("xml"))
+   {
+      if (!parseAttributes(cursor, close) || cursor != close)
+      {
+         return fail("malformed XML declaration");
+      }
+   }
+
+   mPosition = close + 2;
+   return mEvent = PROCESSING_INSTRUCTION;
+}
+
+XmlPullParser::Event XmlPullParser::parseMarkup()
+{
+   static const char COMMENT_START[] = "<!--";
+   static const char CDATA_START[] = "<![CDATA[";
+   size_t available = mEnd - mPosition;
+
+   if (available >= sizeof(COMMENT_START) - 1
+       && memcmp(mPosition, COMMENT_START, sizeof(COMMENT_START) - 1) == 0)
+   {
+      const char* content = mPosition + sizeof(COMMENT_START) - 1;
+      const char* close = findPattern(content, mEnd, "-->");
+      if (!close)
+      {
+         return fail("unterminated comment");
+      }
+      mText = Slice(content, close - content);
+      mPosition = close + 3;
+      return mEvent = COMMENT;
+   }
+
+   if (available >= sizeof(CDATA_START) - 1
+       && memcmp(mPosition, CDATA_START, sizeof(CDATA_START) - 1) == 0)
+   {
+      if (mDepth == 0)
+      {
+         return fail("CDATA outside of the root element");
+      }
+      const char* content = mPosition + sizeof(CDATA_START) - 1;
+      const char* close = findPattern(content, mEnd, "]]>");
+      if (!close)
+      {
+         return fail("unterminated CDATA section");
+      }
+      mText = Slice(content, close - content);
+      mCData = true;
+      mPosition = close + 3;
+      return mEvent = TEXT;
+   }
+
+   // <!DOCTYPE ...> and friends: skip, including any internal subset
+   if (mDepth > 0)
+   {
+      return fail("declaration inside an element");
+   }
+   int brackets = 0;
+   for (const char* cursor = mPosition + 2; cursor < mEnd; ++cursor)
+   {
+      if (*cursor == '[')
+      {
+         brackets++;
+      }
+      else if (*cursor == ']')
+      {
+         brackets--;
+      }
+      else if (*cursor == '>' && brackets <= 0)
+      {
+         mPosition = cursor + 1;
+         return END_DOCUMENT;
+      }
+   }
+   return fail("unterminated declaration");
+}
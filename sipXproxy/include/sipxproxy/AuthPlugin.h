@@ -208,6 +208,18 @@ class AuthPlugin : public Plugin
    
    /// Boolean indicator that returns true if the plugin wants to process final responses
    virtual bool willModifyFinalResponse() const;
+
+   /// Boolean indicator that returns true if the plugin must see in-dialog requests
+   /// of dialogs that are already authorized
+   virtual bool willProcessAuthorizedDialogRequest() const;
+   /**<
+    * An in-dialog request whose signed RouteState records that the dialog
+    * was authorized is passed to authorizeAndModify with a priorResult of
+    * ALLOW.  A plugin that neither modifies nor denies such requests (for
+    * example, one that only makes the authorization decision for a new
+    * dialog) should return false, and SipRouter will not call it for them.
+    * The default is true, so a plugin is called unless it says otherwise.
+    */
   
   protected:
 
@@ -261,4 +273,9 @@ inline bool AuthPlugin::willModifyFinalResponse() const
   return false;
 }
 
+inline bool AuthPlugin::willProcessAuthorizedDialogRequest() const
+{
+  return true;
+}
+
 #endif // _AUTHPLUGIN_H_
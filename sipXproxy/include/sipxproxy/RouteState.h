@@ -9,6 +9,7 @@
 #define _ROUTESTATE_H_
 
 // SYSTEM INCLUDES
+#include <string>
 #include <vector>
 
 // APPLICATION INCLUDES
@@ -81,12 +82,23 @@ class RouteStateTest;
  *        information recorded in that existing header so that in-dialog requests only
  *        traverse this proxy once.
  *
+ * Every request in a dialog carries the same state token, so the values of a
+ * token whose signature has been checked are remembered (by call-id and token,
+ * both of which the signature covers) for up to MAX_VERIFIED_STATES tokens;
+ * later requests in the dialog do not check the signature or decode the values
+ * again.  Changing the secret forgets them.
+ *
  * @nosubgrouping
  */
 class RouteState
 {
   public:
 
+   enum
+   {
+      MAX_VERIFIED_STATES = 4096 ///< tokens remembered before they are all forgotten
+   };
+
    // ================================================================
    /** @name                  Decoding Operations
     *
@@ -262,6 +274,12 @@ class RouteState
    /// Check the signature and parse the name/value pairs from a state token
    bool decode(const UtlString& stateToken);
    /**< @returns true iff the token was correctly signed and successfully parsed */
+
+   /// Get the values of a token decode has verified before, if it is remembered.
+   bool getVerified(const std::string& key);
+
+   /// Remember the values of a token decode has verified.
+   void addVerified(const std::string& key);
    
   private:
    static const char* UrlParameterName;
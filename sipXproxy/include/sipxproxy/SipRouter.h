@@ -18,10 +18,12 @@
 #include <os/OsTime.h>
 #include <sipXecsService/SipNonceDb.h>
 #include <utl/PluginHooks.h>
+#include <utl/UtlMetrics.h>
 #include <sipxproxy/AuthPlugin.h>
 #include <net/SipBidirectionalProcessorPlugin.h>
 #include <sipdb/RegDB.h>
 #include "sipdb/EntityDB.h"
+#include "sipdb/DigestCredentialCache.h"
 #include "sipdb/SubscribeDB.h"
 #include <Poco/Semaphore.h>
 #include <boost/thread.hpp>
@@ -61,6 +63,9 @@ class SipOutputProcessor;
  *    -# Invoke AuthPlugin::authorizeAndModify on the message for each configured AuthPlugin,
  *       stopping if any returns AuthPlugin::UNAUTHORIZED
  *       - An AuthPlugin may modify the message and/or the RouteState
+ *       - For an in-dialog request whose RouteState shows that the dialog is already
+ *         authorized, only the plugins for which AuthPlugin::willProcessAuthorizedDialogRequest
+ *         returns true are invoked.
  *    -# If all AuthPlugin objects return AuthPlugin::ALLOW_REQUEST, then proxyMessage
  *       returns true; if not, it sends a response before returning false:
  *       - '403 Forbidden' if there was valid user authentication in the message.
@@ -86,6 +91,15 @@ class SipRouter : public OsServerTask
   typedef std::vector<AuthPlugin*> TrustedRequestModifiers;
   typedef std::vector<AuthPlugin*> FinalResponseModifiers;
 
+  /// A configured AuthPlugin, as proxyMessage calls it.
+  struct AuthPluginEntry
+  {
+     AuthPlugin*         plugin;
+     UtlString           name;
+     UtlMetricHistogram* time;  ///< sipx_proxy_plugin_seconds for this plugin
+  };
+  typedef std::vector<AuthPluginEntry> AuthPlugins;
+
   class DispatchTimer
   {
   public:
@@ -287,6 +301,7 @@ class SipRouter : public OsServerTask
    UtlString     mRealm;                 ///< realm for challenges - common to replicatants
    SipNonceDb    mNonceDb;               ///< generator for nonce values
    long          mNonceExpiration;       ///< nonce lifetime in seconds
+   DigestCredentialCache mCredentialCache; ///< H(A1) of the users that authenticate
    UtlString     mDomainName;            ///< for determining authority for addresses
    UtlString     mDomainAliases;         ///< for determining authority for addresses
    UtlString     mRouteHostPort;         ///< for writing Record-Route headers
@@ -340,6 +355,11 @@ class SipRouter : public OsServerTask
    TrustedRequestModifiers _trustedRequestModifiers;
    FinalResponseModifiers _finalResponseModifiers;
    UtlBoolean _suppressAlertIndicatorForTransfers;
+   UtlMetricHistogram& _dispatchTime;              ///< sipx_proxy_dispatch_seconds
+   UtlMetricHistogram& _authTime;                  ///< sipx_proxy_auth_seconds
+   AuthPlugins _authPlugins;             ///< all of mAuthPlugins, in the order they are called
+   AuthPlugins _authorizedDialogPlugins; /**< those that willProcessAuthorizedDialogRequest,
+                                          *   called for in-dialog requests of authorized dialogs */
 };
 
 /* ============================ INLINE METHODS ============================ */
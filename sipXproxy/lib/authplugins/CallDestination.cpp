@@ -48,6 +48,12 @@ CallDestination::announceAssociatedSipRouter( SipRouter* pSipRouter )
    mpSipRouter = pSipRouter;
 }
 
+bool
+CallDestination::willProcessAuthorizedDialogRequest() const
+{
+   return false;
+}
+
 AuthPlugin::AuthResult
 CallDestination::authorizeAndModify(const UtlString& id,    /**< The authenticated identity of the
                                                               *   request originator, if any (the null
@@ -68,6 +68,9 @@ class CallDestination : public AuthPlugin
     */
 
    virtual void announceAssociatedSipRouter( SipRouter* sipRouter );
+
+   /// In-dialog requests carry no Record-Route to move the destination into.
+   virtual bool willProcessAuthorizedDialogRequest() const;
    
   protected:
   private:
@@ -164,6 +164,11 @@ void CallerAlertInfo::announceAssociatedSipRouter( SipRouter* sipRouter )
    mpSipRouter = sipRouter;
 }
 
+bool CallerAlertInfo::willProcessAuthorizedDialogRequest() const
+{
+   return false;
+}
+
 /// destructor
 CallerAlertInfo::~CallerAlertInfo()
 {
@@ -77,6 +77,9 @@ class CallerAlertInfo : public AuthPlugin
    ///< See class description.
 
    virtual void announceAssociatedSipRouter( SipRouter* sipRouter );
+
+   /// Alert-Info only matters in the INVITE that creates the dialog.
+   virtual bool willProcessAuthorizedDialogRequest() const;
    
   protected:
 
@@ -400,3 +400,8 @@ void EnforceAuthRules::announceAssociatedSipRouter(SipRouter* sipRouter)
 {
     mpSipRouter = sipRouter;
 }
+
+bool EnforceAuthRules::willProcessAuthorizedDialogRequest() const
+{
+    return false;
+}
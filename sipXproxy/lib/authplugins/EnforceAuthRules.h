@@ -86,6 +86,9 @@ class EnforceAuthRules : public AuthPlugin
     * examples in PluginHooks::readConfig).
     */
 
+   /// The rules are not evaluated once the dialog is authorized.
+   virtual bool willProcessAuthorizedDialogRequest() const;
+
   protected:
    friend class EnforceAuthRulesTest;
    
@@ -54,6 +54,12 @@ SubscriptionAuth::announceAssociatedSipRouter( SipRouter* sipRouter )
    mpSipRouter = sipRouter;
 }
 
+bool
+SubscriptionAuth::willProcessAuthorizedDialogRequest() const
+{
+   return false;
+}
+
 /// Read (or re-read) the authorization rules.
 void
 SubscriptionAuth::readConfig( OsConfigDb& configDb /**< a subhash of the individual configuration
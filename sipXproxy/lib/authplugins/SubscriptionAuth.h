@@ -79,6 +79,9 @@ class SubscriptionAuth : public AuthPlugin
 
    virtual void announceAssociatedSipRouter( SipRouter* sipRouter );
 
+   /// Only challenges requests that no earlier plugin has authorized.
+   virtual bool willProcessAuthorizedDialogRequest() const;
+
   protected:
    friend class SubscriptionAuthTest;
 
@@ -10,13 +10,17 @@
 // SYSTEM INCLUDES
 #include <assert.h>
 #include <stdlib.h>
+#include <arpa/inet.h>
+#include <string>
+#include <vector>
+#include <boost/unordered_map.hpp>
 
 // APPLICATION INCLUDES
 #include "os/OsLogger.h"
+#include "utl/UtlRegex.h"
 #include "utl/UtlString.h"
 #include "net/Url.h"
 #include "net/SipMessage.h"
-#include "digitmaps/Patterns.h"
 
 #include "ForwardRules.h"
 
@@ -24,23 +28,734 @@
 // EXTERNAL VARIABLES
 // CONSTANTS
 
+// Function to get a boolean configuration setting based on the Y/N value of
+// a configuration parameter.  Snarfed from 
+// sipXregistry/lib/redirect_plugins/SipRedirectorJoin.cpp, 
+// probably both should be reconciled into a lib one day
+static bool getYN(const char* boolText,
+                        bool defaultValue)
+{
+   // Start with the default value.
+   bool value = defaultValue;
+   if (boolText)
+   {
+      // Examine the first character.
+      switch (boolText[0])
+      {
+      case 'y':
+      case 'Y':
+      case 'T':
+      case 't':
+      case '1':
+         // If the value starts with Y or 1, set the result to TRUE.
+         value = true;
+         break;
+      case 'n':
+      case 'N':
+      case 'F':
+      case 'f':
+      case '0':
+         // If the value starts with N or 0, set the result to FALSE.
+         value = false;
+         break;
+      default:
+         // Ignore all other values.
+         break;
+      }
+   }
+   return value;
+}
+
+/// The routes of forwardingrules.xml, compiled for getRoute
+class ForwardRules::RouteTable
+{
+public:
+
+   /// Compile the routes element of xmlDoc; hasRoutes() is false if there is none.
+   RouteTable(TiXmlDocument& xmlDoc);
+
+   ~RouteTable();
+
+   bool hasRoutes() const
+   {
+      return mHasRoutes;
+   }
+
+   OsStatus getRoute(const Url& requestUri,
+                     const SipMessage& request,
+                     UtlString& routeToString,
+                     UtlString& mappingType,
+                     bool& authRequired,
+                     UtlString& ruriParams);
+
+private:
+
+   /// The first routeTo child of a route, methodMatch or fieldMatch element
+   struct RouteTo
+   {
+      bool      valid;         ///< there is one, and it routes somewhere or requires authentication
+      UtlString route;
+      bool      authRequired;
+      UtlString ruriParams;
+
+      RouteTo() : valid(false), authRequired(false) {}
+   };
+
+   struct FieldMatch
+   {
+      bool      hasFieldName;  ///< no fieldName attribute matches any request
+      UtlString fieldName;
+      bool      hasPatterns;   ///< there are fieldPattern elements, even ones that did not compile
+      std::vector<RegEx*> patterns;
+      RouteTo   routeTo;
+   };
+
+   struct MethodMatch
+   {
+      std::vector<UtlString> methods;
+      std::vector<FieldMatch*> fieldMatches;
+      RouteTo   routeTo;
+   };
+
+   struct Subnet
+   {
+      in_addr_t network;
+      in_addr_t mask;
+   };
+
+   struct Route
+   {
+      UtlString mappingType;
+      std::vector<Subnet> subnets;
+      bool      anyDomain;     ///< there is a routeDnsWildcard of "*"
+      std::vector<RegEx*> domains;
+      std::vector<MethodMatch*> methodMatches;
+      RouteTo   routeTo;
+   };
+
+   /// What getRoute returns for a request
+   struct Result
+   {
+      OsStatus  status;
+      UtlString routeTo;
+      UtlString mappingType;
+      bool      authRequired;
+      UtlString ruriParams;
+   };
+
+   typedef boost::unordered_map<std::string, std::vector<size_t> > HostRoutes;
+   typedef boost::unordered_map<std::string, Result> ResultCache;
+
+   bool mHasRoutes;
+   std::vector<Route*> mRoutes;       ///< in the order of the file
+   HostRoutes mHostRoutes;            ///< "host:port" of routeFrom -> index of its routes
+   std::vector<size_t> mPatternRoutes;///< index of routes with subnet or domain patterns
+   mutex_critic_sec mCacheMutex;      ///< protects mCache
+   ResultCache mCache;                ///< results that depend only on host, port and method
+
+   static void compileRouteTo(TiXmlElement* element, RouteTo& routeTo);
+   static bool compileSubnet(const UtlString& cidr, Subnet& subnet);
+   static RegEx* compileDomain(const UtlString& wildcard, bool& anyDomain);
+   static void setResult(const RouteTo& routeTo, Result& result);
+
+   /// Does a route's routeIPv4subnet or routeDnsWildcard match the host?
+   bool matchesPattern(const Route& route, const UtlString& host) const;
+
+   /// Find the routeTo a request takes in a route whose host matched.
+   bool evaluateRoute(const Route& route,
+                      const UtlString& method,
+                      const SipMessage& request,
+                      Result& result,
+                      bool& usedFields) const;
+
+   bool evaluateFields(const MethodMatch& methodMatch,
+                       const SipMessage& request,
+                       Result& result,
+                       bool& usedFields) const;
+
+   void evaluate(const UtlString& host,
+                 int port,
+                 const UtlString& method,
+                 const SipMessage& request,
+                 Result& result,
+                 bool& usedFields) const;
+};
+
+/// Make the key of mHostRoutes from a host and a port that is not SIP_PORT
+static std::string hostKey(const UtlString& host, int port)
+{
+   UtlString key(host);
+   key.toLower();
+   key.append(':');
+   key.appendNumber(port);
+   return std::string(key.data(), key.length());
+}
+
+ForwardRules::RouteTable::RouteTable(TiXmlDocument& xmlDoc) :
+   mHasRoutes(false)
+{
+   TiXmlNode* routesNode = xmlDoc.FirstChild(XML_TAG_ROUTES);
+   if (!routesNode)
+   {
+      return;
+   }
+   mHasRoutes = true;
+
+   TiXmlElement* routesElement = routesNode->ToElement();
+   for (TiXmlNode* routeNode = routesElement->FirstChild(XML_TAG_ROUTEMATCH);
+        routeNode;
+        routeNode = routeNode->NextSibling(XML_TAG_ROUTEMATCH))
+   {
+      if (routeNode->Type() != TiXmlNode::ELEMENT)
+      {
+         continue;
+      }
+      TiXmlElement* routeElement = routeNode->ToElement();
+      size_t index = mRoutes.size();
+      Route* route = new Route;
+      mRoutes.push_back(route);
+
+      const char* mappingTypePtr = routeElement->Attribute(XML_ATT_MAPPINGTYPE);
+      route->mappingType = mappingTypePtr ? mappingTypePtr : "";
+      route->anyDomain = false;
+
+      // routeFrom, routeIPv4subnet and routeDnsWildcard elements
+      for (TiXmlElement* patternElement = routeElement->FirstChildElement();
+           patternElement;
+           patternElement = patternElement->NextSiblingElement())
+      {
+         const char* name = patternElement->Value();
+         TiXmlNode* patternText = patternElement->FirstChild();
+         if (   !(   strcmp(name, XML_TAG_ROUTEFROM) == 0
+                  || strcmp(name, XML_TAG_ROUTEIPV4SUBNET) == 0
+                  || strcmp(name, XML_TAG_ROUTEDNSWILDCARD) == 0)
+             || !patternText
+             || patternText->Type() != TiXmlNode::TEXT)
+         {
+            continue;
+         }
+         UtlString pattern(patternText->Value());
+
+         if (strcmp(name, XML_TAG_ROUTEFROM) == 0)
+         {
+            Url xmlUrl(pattern.data());
+            UtlString xmlHost;
+            xmlUrl.getHostAddress(xmlHost);
+            int xmlPort = xmlUrl.getHostPort();
+            if (xmlPort == SIP_PORT)
+            {
+               xmlPort = PORT_NONE;
+            }
+
+            std::vector<size_t>& routes = mHostRoutes[hostKey(xmlHost, xmlPort)];
+            if (routes.empty() || routes.back() != index)
+            {
+               routes.push_back(index);
+            }
+         }
+         else if (strcmp(name, XML_TAG_ROUTEIPV4SUBNET) == 0)
+         {
+            Subnet subnet;
+            if (compileSubnet(pattern, subnet))
+            {
+               route->subnets.push_back(subnet);
+            }
+         }
+         else
+         {
+            RegEx* domain = compileDomain(pattern, route->anyDomain);
+            if (domain)
+            {
+               route->domains.push_back(domain);
+            }
+         }
+      }
+      if (!route->subnets.empty() || !route->domains.empty() || route->anyDomain)
+      {
+         mPatternRoutes.push_back(index);
+      }
+
+      for (TiXmlNode* methodMatchNode = routeElement->FirstChild(XML_TAG_METHODMATCH);
+           methodMatchNode;
+           methodMatchNode = methodMatchNode->NextSibling(XML_TAG_METHODMATCH))
+      {
+         if (methodMatchNode->Type() != TiXmlNode::ELEMENT)
+         {
+            continue;
+         }
+         TiXmlElement* methodMatchElement = methodMatchNode->ToElement();
+         MethodMatch* methodMatch = new MethodMatch;
+         route->methodMatches.push_back(methodMatch);
+
+         for (TiXmlNode* methodPatternNode = methodMatchElement->FirstChild(XML_TAG_METHODPATTERN);
+              methodPatternNode;
+              methodPatternNode = methodPatternNode->NextSibling(XML_TAG_METHODPATTERN))
+         {
+            TiXmlNode* methodText = methodPatternNode->FirstChild();
+            if (   methodPatternNode->Type() == TiXmlNode::ELEMENT
+                && methodText
+                && methodText->Type() == TiXmlNode::TEXT)
+            {
+               methodMatch->methods.push_back(UtlString(methodText->Value()));
+            }
+         }
+
+         for (TiXmlNode* fieldMatchNode = methodMatchElement->FirstChild(XML_TAG_FIELDMATCH);
+              fieldMatchNode;
+              fieldMatchNode = fieldMatchNode->NextSibling(XML_TAG_FIELDMATCH))
+         {
+            if (fieldMatchNode->Type() != TiXmlNode::ELEMENT)
+            {
+               continue;
+            }
+            TiXmlElement* fieldMatchElement = fieldMatchNode->ToElement();
+            FieldMatch* fieldMatch = new FieldMatch;
+            methodMatch->fieldMatches.push_back(fieldMatch);
+
+            const char* fieldName = fieldMatchElement->Attribute(XML_ATT_FIELDNAME);
+            fieldMatch->hasFieldName = fieldName != NULL;
+            fieldMatch->fieldName = fieldName ? fieldName : "";
+            fieldMatch->hasPatterns = false;
+
+            for (TiXmlNode* fieldPatternNode = fieldMatchElement->FirstChild(XML_TAG_FIELDPATTERN);
+                 fieldPatternNode;
+                 fieldPatternNode = fieldPatternNode->NextSibling(XML_TAG_FIELDPATTERN))
+            {
+               fieldMatch->hasPatterns = true;
+
+               TiXmlNode* fieldPatternText = fieldPatternNode->FirstChild();
+               if (fieldPatternText)
+               {
+                  try
+                  {
+                     fieldMatch->patterns.push_back(new RegEx(fieldPatternText->Value(),
+                                                              PCRE_ANCHORED));
+                  }
+                  catch(const char * ErrorMsg)
+                  {
+                     Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                   "Illegal regular expression <fieldPattern>%s</fieldPattern>"
+                                   " in forwardingrules.xml: %s",
+                                   fieldPatternText->Value() ,ErrorMsg
+                                   );
+                  }
+               }
+            }
+
+            compileRouteTo(fieldMatchElement, fieldMatch->routeTo);
+         }
+
+         compileRouteTo(methodMatchElement, methodMatch->routeTo);
+      }
+
+      compileRouteTo(routeElement, route->routeTo);
+   }
+
+   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                              "ForwardRules::RouteTable compiled %d routes, %d routeFrom hosts",
+                              (int) mRoutes.size(), (int) mHostRoutes.size());
+}
+
+ForwardRules::RouteTable::~RouteTable()
+{
+   for (size_t r = 0; r < mRoutes.size(); r++)
+   {
+      Route* route = mRoutes[r];
+      for (size_t m = 0; m < route->methodMatches.size(); m++)
+      {
+         MethodMatch* methodMatch = route->methodMatches[m];
+         for (size_t f = 0; f < methodMatch->fieldMatches.size(); f++)
+         {
+            FieldMatch* fieldMatch = methodMatch->fieldMatches[f];
+            for (size_t p = 0; p < fieldMatch->patterns.size(); p++)
+            {
+               delete fieldMatch->patterns[p];
+            }
+            delete fieldMatch;
+         }
+         delete methodMatch;
+      }
+      for (size_t d = 0; d < route->domains.size(); d++)
+      {
+         delete route->domains[d];
+      }
+      delete route;
+   }
+}
+
+OsStatus ForwardRules::RouteTable::getRoute(const Url& requestUri,
+                                            const SipMessage& request,
+                                            UtlString& routeToString,
+                                            UtlString& mappingType,
+                                            bool& authRequired,
+                                            UtlString& ruriParams)
+{
+   UtlString host;
+   requestUri.getHostAddress(host);
+   int port = requestUri.getHostPort();
+   if (port == SIP_PORT)
+   {
+      port = PORT_NONE;
+   }
+   UtlString method;
+   request.getRequestMethod(&method);
+
+   // methods are compared ignoring case, so they share a cache entry
+   UtlString upperMethod(method);
+   upperMethod.toUpper();
+   std::string cacheKey(hostKey(host, port));
+   cacheKey.append(" ");
+   cacheKey.append(upperMethod.data(), upperMethod.length());
+
+   Result result;
+   bool cached = false;
+   {
+      mutex_critic_sec_lock lock(mCacheMutex);
+      ResultCache::const_iterator entry = mCache.find(cacheKey);
+      if (entry != mCache.end())
+      {
+         result = entry->second;
+         cached = true;
+      }
+   }
+
+   if (!cached)
+   {
+      bool usedFields = false;
+      evaluate(host, port, method, request, result, usedFields);
+
+      if (!usedFields)
+      {
+         mutex_critic_sec_lock lock(mCacheMutex);
+         if (mCache.size() >= MAX_CACHED_ROUTES)
+         {
+            mCache.clear();
+         }
+         mCache[cacheKey] = result;
+      }
+   }
+
+   if (result.status == OS_SUCCESS)
+   {
+      routeToString = result.routeTo;
+      mappingType = result.mappingType;
+      authRequired = result.authRequired;
+      ruriParams = result.ruriParams;
+   }
+   else
+   {
+      routeToString.remove(0);
+      mappingType.remove(0);
+   }
+
+   return result.status;
+}
+
+void ForwardRules::RouteTable::compileRouteTo(TiXmlElement* element, RouteTo& routeTo)
+{
+   TiXmlNode* routeToNode = element->FirstChild(XML_TAG_ROUTETO);
+   if (!routeToNode || routeToNode->Type() != TiXmlNode::ELEMENT)
+   {
+      return;
+   }
+   TiXmlElement* routeToElement = routeToNode->ToElement();
+
+   //set the authRequired attribute
+   routeTo.authRequired = getYN(routeToElement->Attribute(XML_ATT_AUTHREQUIRED), false);
+
+   const char* ruriParamsPtr = routeToElement->Attribute(XML_ATT_RURIPARAMS);
+   routeTo.ruriParams = ruriParamsPtr ? ruriParamsPtr : "";
+
+   TiXmlNode* routeToText = routeToElement->FirstChild();
+   if (routeToText && routeToText->Type() == TiXmlNode::TEXT)
+   {
+      routeTo.route = routeToText->Value();
+   }
+   // TinyXML compresses white space, so an all white space element becomes
+   // zero length, but just in case, let's strip it ourselves.
+   routeTo.route.strip(UtlString::both);
+
+   // The route can be empty, as long as authRequired is set.
+   // This means just route to the authProxy.
+   routeTo.valid = routeTo.route.length() > 0 || routeTo.authRequired;
+}
+
+// "cidr" is a subnet in CIDR notation (x.y.z.q/size), as Patterns::IPv4subnet takes it
+bool ForwardRules::RouteTable::compileSubnet(const UtlString& cidr, Subnet& subnet)
+{
+   ssize_t slash = cidr.index('/');
+   if (slash == UTL_NOT_FOUND)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
+                                 "ForwardRules - routeIPv4subnet not in CIDR (dotted quad/Size) format.  (pattern=%s)",
+                                 cidr.data());
+      return false;
+   }
+
+   // Add 0's for missing elements, to allow patterns like "192.168/16"
+   UtlString xmlNet(cidr(0, slash));
+   int dots = 0;
+   for (size_t i = 0; i < xmlNet.length(); i++)
+   {
+      if (xmlNet(i) == '.')
+      {
+         dots++;
+      }
+   }
+   for (; dots < 3; dots++)
+   {
+      xmlNet.append(".0");
+   }
+
+   struct in_addr in_network;
+   if (inet_pton(AF_INET, xmlNet.data(), &in_network) <= 0)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
+                                 "ForwardRules - routeIPv4subnet not valid IPv4.  (pattern=%s, IPv4=%s)",
+                                 cidr.data(), xmlNet.data());
+      return false;
+   }
+
+   int mask_size = atoi(cidr.data() + slash + 1);
+   if (mask_size <= 0 || mask_size > 32)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
+                                 "ForwardRules - routeIPv4subnet mask size is not 1->32.  (pattern=%s)",
+                                 cidr.data());
+      return false;
+   }
+
+   // all the subnet bits are 1, all the addr bits are 0, in network order
+   subnet.mask = htonl(((unsigned)~0) << (32 - mask_size));
+   subnet.network = in_network.s_addr;
+   return true;
+}
+
+// "wildcard" is a wildcard DNS (*.pingtel.com), as Patterns::DnsWildcard takes it
+RegEx* ForwardRules::RouteTable::compileDomain(const UtlString& wildcard, bool& anyDomain)
+{
+   if (wildcard == "*")
+   {
+      // Pattern of '*' matches everything
+      anyDomain = true;
+      return NULL;
+   }
+
+   if (wildcard.index("*.") != 0)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
+                                 "ForwardRules - routeDnsWildcard must start with '*.'.  (wildcard=%s)",
+                                 wildcard.data());
+      return NULL;
+   }
+
+   // *.pingtel.com becomes ^(.+\.)*\Qpingtel.com\E(\.?)$
+   // (zero or more subdomains) 'pingtel.com' (optional .)
+   UtlString exp("^(.+\\.)*\\Q");
+   exp.append(wildcard(2, UtlString::UTLSTRING_TO_END));
+   exp.append("\\E(\\.?)$");
+
+   try
+   {
+      return new RegEx(exp, PCRE_CASELESS);
+   }
+   catch(const char * ErrorMsg)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                 "Illegal <routeDnsWildcard>%s</routeDnsWildcard>"
+                                 " in forwardingrules.xml: %s",
+                                 wildcard.data(), ErrorMsg);
+      return NULL;
+   }
+}
+
+void ForwardRules::RouteTable::setResult(const RouteTo& routeTo, Result& result)
+{
+   result.status = OS_SUCCESS;
+   result.routeTo = routeTo.route;
+   result.authRequired = routeTo.authRequired;
+   result.ruriParams = routeTo.ruriParams;
+}
+
+bool ForwardRules::RouteTable::matchesPattern(const Route& route, const UtlString& host) const
+{
+   if (route.anyDomain)
+   {
+      return true;
+   }
+
+   struct in_addr in_address;
+   if (!route.subnets.empty() && inet_pton(AF_INET, host.data(), &in_address) > 0)
+   {
+      for (size_t i = 0; i < route.subnets.size(); i++)
+      {
+         if ((route.subnets[i].mask & in_address.s_addr) == route.subnets[i].network)
+         {
+            return true;
+         }
+      }
+   }
+
+   for (size_t i = 0; i < route.domains.size(); i++)
+   {
+      RegEx domain(*route.domains[i]);
+      if (domain.Search(host.data()))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool ForwardRules::RouteTable::evaluateRoute(const Route& route,
+                                             const UtlString& method,
+                                             const SipMessage& request,
+                                             Result& result,
+                                             bool& usedFields) const
+{
+   for (size_t m = 0; m < route.methodMatches.size(); m++)
+   {
+      const MethodMatch& methodMatch = *route.methodMatches[m];
+
+      bool methodMatches = false;
+      for (size_t i = 0; !methodMatches && i < methodMatch.methods.size(); i++)
+      {
+         methodMatches = methodMatch.methods[i].compareTo(method, UtlString::ignoreCase) == 0;
+      }
+
+      if (methodMatches)
+      {
+         if (evaluateFields(methodMatch, request, result, usedFields))
+         {
+            return true;
+         }
+
+         // None of the fields matched; the routeTo of the methodMatch
+         // is the default.
+         if (methodMatch.routeTo.valid)
+         {
+            setResult(methodMatch.routeTo, result);
+            return true;
+         }
+      }
+   }
+
+   // No methodMatch gave a route, use the default routeTo of the route.
+   if (route.routeTo.valid)
+   {
+      setResult(route.routeTo, result);
+      return true;
+   }
+
+   return false;
+}
+
+bool ForwardRules::RouteTable::evaluateFields(const MethodMatch& methodMatch,
+                                              const SipMessage& request,
+                                              Result& result,
+                                              bool& usedFields) const
+{
+   for (size_t f = 0; f < methodMatch.fieldMatches.size(); f++)
+   {
+      const FieldMatch& fieldMatch = *methodMatch.fieldMatches[f];
+
+      bool matches;
+      if (!fieldMatch.hasFieldName)
+      {
+         // no fieldName means no field pattern is required
+         matches = true;
+      }
+      else if (fieldMatch.fieldName.isNull())
+      {
+         matches = false;
+      }
+      else
+      {
+         usedFields = true;
+         const char* fieldValue = request.getHeaderValue(0, fieldMatch.fieldName.data());
+
+         matches = fieldValue && !fieldMatch.hasPatterns;
+         for (size_t p = 0; fieldValue && !matches && p < fieldMatch.patterns.size(); p++)
+         {
+            RegEx fieldPattern(*fieldMatch.patterns[p]);
+            matches = fieldPattern.Search(fieldValue);
+         }
+      }
+
+      if (matches && fieldMatch.routeTo.valid)
+      {
+         setResult(fieldMatch.routeTo, result);
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void ForwardRules::RouteTable::evaluate(const UtlString& host,
+                                        int port,
+                                        const UtlString& method,
+                                        const SipMessage& request,
+                                        Result& result,
+                                        bool& usedFields) const
+{
+   static const std::vector<size_t> noRoutes;
+
+   result.status = OS_FAILED;
+
+   HostRoutes::const_iterator hostRoutes = mHostRoutes.find(hostKey(host, port));
+   const std::vector<size_t>& fromRoutes =
+      hostRoutes != mHostRoutes.end() ? hostRoutes->second : noRoutes;
+
+   // Try the routes that match, in file order, until one gives a routeTo
+   size_t f = 0;
+   size_t p = 0;
+   while (f < fromRoutes.size() || p < mPatternRoutes.size())
+   {
+      size_t index;
+      bool matches;
+      if (p >= mPatternRoutes.size()
+          || (f < fromRoutes.size() && fromRoutes[f] <= mPatternRoutes[p]))
+      {
+         index = fromRoutes[f++];
+         matches = true;
+         if (p < mPatternRoutes.size() && mPatternRoutes[p] == index)
+         {
+            p++;
+         }
+      }
+      else
+      {
+         index = mPatternRoutes[p++];
+         matches = matchesPattern(*mRoutes[index], host);
+      }
+
+      if (matches)
+      {
+         const Route& route = *mRoutes[index];
+         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                                    "ForwardRules::getRoute - %s matches route %d '%s'",
+                                    host.data(), (int) index, route.mappingType.data());
+
+         if (evaluateRoute(route, method, request, result, usedFields))
+         {
+            result.mappingType = route.mappingType;
+            return;
+         }
+      }
+   }
+}
+
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 // Constructor
 ForwardRules::ForwardRules()
-   : mDoc(NULL),
-   mPatterns(NULL)
 {
 }
 
 // Destructor
 ForwardRules::~ForwardRules()
 {
-	if (mDoc)
-	{
-		delete mDoc;
-	}
-
-   delete mPatterns;
 }
 /* ============================ MANIPULATORS ============================== */
 OsStatus ForwardRules::loadMappings(const UtlString configFileName,
@@ -50,23 +765,23 @@ OsStatus ForwardRules::loadMappings(const UtlString configFileName,
 {
    OsStatus currentStatus = OS_SUCCESS;
 
-   // Remove any old mappings first
-   if(mDoc) delete mDoc;
-
-   // Destroy patterns, and start clean
-   if (mPatterns) delete mPatterns ;
-   mPatterns = new Patterns() ;
-
-   mDoc = new TiXmlDocument( configFileName.data() );
-   if( !mDoc->LoadFile() )
+   TiXmlDocument xmlDoc( configFileName.data() );
+   if( !xmlDoc.LoadFile() )
    {
-      UtlString parseError = mDoc->ErrorDesc();
+      UtlString parseError = xmlDoc.ErrorDesc();
 
       Os::Logger::instance().log( FAC_SIP, PRI_ERR, "ERROR parsing forwardingrules '%s': %s"
                     ,configFileName.data(), parseError.data());
 
+      // Remove any old mappings
+      TiXmlDocument emptyDoc;
+      compile(emptyDoc);
+
       return OS_NOT_FOUND;
    }
+
+   // Replaces the old mappings, and the results remembered from them
+   compile(xmlDoc);
    
    if(!voicemail.isNull())
       mVoicemail.append(voicemail);
@@ -86,20 +801,16 @@ void ForwardRules::buildDefaultRules(const char* domain,
                                      const char* fqhn,
                                      int localPort)
 {
-    if(mDoc) delete mDoc;
-
-    // Destroy patterns, and start clean
-    if (mPatterns) delete mPatterns ;
-    mPatterns = new Patterns() ;
-
-    mDoc = new TiXmlDocument();
+    TiXmlDocument xmlDoc;
     buildDefaultRules(domain,
                       hostname,
                       ipAddress,
                       fqhn,
                       localPort,
-                      *mDoc);
-    mDoc->Print();
+                      xmlDoc);
+    xmlDoc.Print();
+
+    compile(xmlDoc);
 }
 
 void ForwardRules::buildDefaultRules(const char* domain,
@@ -237,6 +948,7 @@ void ForwardRules::buildDefaultRules(const char* domain,
 
 }
 
+
 /* ============================ CREATORS ================================== */
 OsStatus ForwardRules::getRoute(const Url& requestUri,
                                 const SipMessage& request,
@@ -246,495 +958,33 @@ OsStatus ForwardRules::getRoute(const Url& requestUri,
                                 UtlString& ruriParams)
 
 {
-    OsStatus currentStatus = OS_FAILED;
+    // Hold on to the table, in case the rules are reloaded meanwhile
+    boost::shared_ptr<RouteTable> routeTable;
+    {
+        mutex_critic_sec_lock lock(mRouteTableMutex);
+        routeTable = mpRouteTable;
+    }
 
-    // Get the "routes" element.
-    TiXmlNode* prevRouteNode = mDoc->FirstChild( XML_TAG_ROUTES);
-    if (!prevRouteNode)
+    if (!routeTable || !routeTable->hasRoutes())
     {
-        Os::Logger::instance().log(FAC_SIP, PRI_ERR, "UrlMapping::loadMappings - No child Node for Mappings");
+        Os::Logger::instance().log(FAC_SIP, PRI_ERR, "ForwardRules::getRoute - No child Node for Mappings");
         return OS_FILE_READ_FAILED;
     }
 
-    currentStatus = parseRouteMatchContainer(requestUri,
-                                            request,
-                                            routeToString,
-                                            mappingType,
-                                            authRequired,
-                                            ruriParams,
-                                            prevRouteNode);
-
-    return currentStatus;
-
-}
-OsStatus ForwardRules::parseRouteMatchContainer(const Url& requestUri,
-                                              const SipMessage& request,
-                                              UtlString& routeToString,
-                                              UtlString& mappingType,
-                                              bool& authRequired,
-                                              UtlString& ruriParams,
-                                              TiXmlNode* routesNode,
-                                              TiXmlNode* previousRouteMatchNode)
-{
-   UtlString testHost;
-   requestUri.getHostAddress(testHost);
-   int testPort = requestUri.getHostPort();
-   if(testPort == SIP_PORT)
-   {
-      testPort = PORT_NONE;
-   }
-   
-   UtlBoolean routeMatchFound = false;
-   OsStatus methodMatchFound = OS_FAILED;
-   
-  	TiXmlElement* routesElement = routesNode->ToElement();
-
-   TiXmlNode* routeMatchNode = previousRouteMatchNode;
-   // Iterate through routes container children looking for 
-   // route tags
-   while ( (routeMatchNode = routesElement->IterateChildren(routeMatchNode)) 
-      && methodMatchFound != OS_SUCCESS)
-   {
-      // Skip non-elements
-      if(routeMatchNode && routeMatchNode->Type() != TiXmlNode::ELEMENT)
-      {
-         continue;
-      }
-
-      // Skip non-route elements
-      TiXmlElement* routeMatchElement = routeMatchNode->ToElement();
-      UtlString tagValue =  routeMatchElement->Value();
-      if(tagValue.compareTo(XML_TAG_ROUTEMATCH) != 0 )
-      {
-         continue;
-      }
-
-      mappingType.remove(0);
-      routeToString.remove(0);
-      const char* mappingTypePtr = 
-          routeMatchElement->Attribute(XML_ATT_MAPPINGTYPE);
-
-      //get the mapping Type attribute
-      mappingType.append(mappingTypePtr ? mappingTypePtr : "");
-
-      // Iterate through the route container's children looking
-      // for routeFrom, routeIPv4subnet, or routeDnsWildcard elements
-      TiXmlNode* routeFromPatternNode = NULL;
-      for( routeFromPatternNode = routeMatchElement->FirstChildElement();
-         routeFromPatternNode;
-         routeFromPatternNode = routeFromPatternNode->NextSiblingElement() )
-      {
-         // Skip elements that aren't of the "domainMatches" family 
-         enum {ret_from, ret_ip, ret_dns} routeElementType ;
-
-         const char *name = routeFromPatternNode->Value() ;
-         if (strcmp(name, XML_TAG_ROUTEFROM) == 0)
-         {
-            routeElementType = ret_from;
-         }
-         else if (strcmp(name, XML_TAG_ROUTEIPV4SUBNET) == 0)
-         {
-            routeElementType = ret_ip;
-         }
-         else if (strcmp(name, XML_TAG_ROUTEDNSWILDCARD) == 0)
-         {
-            routeElementType = ret_dns;
-         }
-         else
-         {
-            continue ;
-         }
-
-
-         //found "domainMatches" pattern tag
-         TiXmlElement* routeFromPatternElement = routeFromPatternNode->ToElement();
-         //get the text value from it
-         TiXmlNode* routeFromPatternText = routeFromPatternElement->FirstChild();
-         if(routeFromPatternText && routeFromPatternText->Type() == TiXmlNode::TEXT)
-         {
-            TiXmlText* Xmlpattern = routeFromPatternText->ToText();
-            if (Xmlpattern)
-            {
-               UtlString pattern = Xmlpattern->Value();
-
-               switch(routeElementType)
-               {
-                  case ret_from: // a routeFrom element matches host and port
-                  {
-                     Url xmlUrl(pattern.data());
-                     UtlString xmlHost;
-                     xmlUrl.getHostAddress(xmlHost);
-                     int xmlPort = xmlUrl.getHostPort();
-
-                     // See if the host and port of the routeFrom elelment
-                     // match that of the URI
-                     if( (xmlHost.compareTo(testHost, UtlString::ignoreCase) == 0) &&
-                        ((xmlPort == SIP_PORT && testPort == PORT_NONE) ||
-                         xmlPort == testPort) )
-                     {
-                        routeMatchFound = true;
-                        Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, "ForwardRules::parseRouteMatchContainer - routeFrom %s matches %s", testHost.data(), pattern.data());
-                     }
-                  }
-                  break ;
-
-                  case ret_ip: // a routeIPv4subnet matches if the subnet does
-                  {
-                     // "pattern" is a subnet in CIDR notation (x.y.z.q/size)
-                     // "testHost is supposed to be an IPv4 dotted quad
-
-                     routeMatchFound = mPatterns->
-                                          IPv4subnet(testHost, pattern);
-                  }
-                  break ;
-
-                  case ret_dns: // a routeDnsWildcard matches if the domain name does
-                  {
-                     // "pattern" is a wildcard DNS (*.pingtel.com)
-                     // "testHost is a FQDN
-                     routeMatchFound = mPatterns->
-                                          DnsWildcard(testHost, pattern);
-  
-                  }
-                  break ;
-               }
-
-               if (routeMatchFound)
-               {
-                  previousRouteMatchNode = routeMatchNode;
-                  // Find a match to the request method and recurse
-                  // to find child element field(s) matches  and
-                  // get the routeTo value
-                  methodMatchFound = parseMethodMatchContainer(request,
-                     routeToString,
-                     authRequired,
-                     ruriParams,
-                     routeMatchNode);
-
-                  if( methodMatchFound == OS_SUCCESS)
-                     break;
-               }
-            }
-         }
-      }
-   }
-   return methodMatchFound;
-}
-
-OsStatus ForwardRules::parseMethodMatchContainer(const SipMessage& request,
-                                                 UtlString& routeToString,
-                                                 bool& authRequired,
-                                                 UtlString& ruriParams,
-                                                 TiXmlNode* routeMatchNode,
-                                                 TiXmlNode* previousMethodMatchNode)
-{
- 
-   OsStatus fieldMatchFound = OS_FAILED;
-   UtlString method;
-   request.getRequestMethod(&method);
-
-   TiXmlNode* methodMatchNode = previousMethodMatchNode;
-   TiXmlElement* routeMatchElement = routeMatchNode->ToElement();
-
-   // Iterate through the children of the routeFrom container
-   // looking for methodMatch elements
-   while ( (methodMatchNode = routeMatchElement->IterateChildren( methodMatchNode)) 
-      && (fieldMatchFound != OS_SUCCESS) ) 
-   {
-       // Skip non-elements
-      if(methodMatchNode && methodMatchNode->Type() != TiXmlNode::ELEMENT)
-      {
-         continue;
-      }
-
-      // Skip non-methodMatch elements
-      UtlString tagValue = methodMatchNode->Value();
-      if(tagValue.compareTo(XML_TAG_METHODMATCH) != 0 )
-      {
-         continue;
-      }
-
-      //found methodPattern tag
-      TiXmlElement* methodMatchElement = methodMatchNode->ToElement();
-      TiXmlNode* methodPatternNode = NULL;
-      // Iteratore through the children of the methodMatch element
-      // looking for the first methodPattern element that matches
-      for( methodPatternNode = methodMatchElement->FirstChild( XML_TAG_METHODPATTERN);
-         methodPatternNode;
-         methodPatternNode = methodPatternNode->NextSibling(XML_TAG_METHODPATTERN ) )
-      {
-         // Skip non-elements
-         if(methodPatternNode && methodPatternNode->Type() != TiXmlNode::ELEMENT)
-         {
-            continue;
-         }
-
-         TiXmlElement* methodPatternElement = methodPatternNode->ToElement();
-
-         // Get the value contained in the methodPattern element
-         TiXmlNode* methodPatternText = methodPatternElement->FirstChild();
-         if(methodPatternText && methodPatternText->Type() == TiXmlNode::TEXT)
-         {
-            TiXmlText* XmlMethod = methodPatternText->ToText();
-            if (XmlMethod)
-            {
-                // If the method of the request matches the method in
-                // the methodMatch element
-               UtlString methodString = XmlMethod->Value();
-               if (methodString.compareTo(method, UtlString::ignoreCase) == 0 )
-               {
-                  // Found a matching method, see if there is a fieldMatch
-                  // with a fieldName attribute that matches the fields
-                  // in the message
-                  fieldMatchFound = parseFieldMatchContainer(request,
-                     routeToString,
-                     authRequired,
-                     ruriParams,
-                     methodMatchNode);
-
-                  if(fieldMatchFound == OS_SUCCESS)
-                  {
-                     break;
-                  }
-
-                  // None of the fields matched, see if the methodMatch
-                  // element has an immediate child routeTo element.
-                  // This is the "default" if none of the fieldMatches
-                  // matched.
-                  else
-                  {
-                      fieldMatchFound = getRouteTo(routeToString, 
-                          authRequired,
-                          ruriParams,
-                          methodMatchElement);
-                      if(fieldMatchFound == OS_SUCCESS)
-                      {
-                          break;
-                      }
-                  }
-               }
-            }
-         }
-      }
-   }
-
-   if(fieldMatchFound == OS_FAILED)
-   {
-      // if none of the method match were successfull or if no methodMatch node present
-      // get the default routeTo for this routeNode.
-      fieldMatchFound = getRouteTo(routeToString, authRequired, ruriParams,
-            routeMatchNode);
-   }
-   return fieldMatchFound;
+    return routeTable->getRoute(requestUri,
+                                request,
+                                routeToString,
+                                mappingType,
+                                authRequired,
+                                ruriParams);
 }
 
-OsStatus ForwardRules::parseFieldMatchContainer(const SipMessage& request,
-                                                UtlString& routeToString,
-                                                bool& authRequired,
-                                                UtlString& ruriParams,
-                                                TiXmlNode* methodMatchNode,
-                                                TiXmlNode* previousFieldMatchNode)
-{
-  
-   OsStatus getRouteFound = OS_FAILED;
-   UtlBoolean fieldPatternFound = false;
-
-   TiXmlNode* fieldMatchNode = previousFieldMatchNode;
-
-   while ( (fieldMatchNode = methodMatchNode->IterateChildren( fieldMatchNode))
-      && (getRouteFound != OS_SUCCESS)   ) 
-   {
-
-      UtlBoolean fieldNameMatches = false;
-      UtlBoolean noFieldPatternRequired = false;
-
-      if(fieldMatchNode && fieldMatchNode->Type() != TiXmlNode::ELEMENT)
-      {
-         continue;
-      }
-
-      UtlString tagValue = fieldMatchNode->Value();
-      if(tagValue.compareTo(XML_TAG_FIELDMATCH) != 0 )
-      {
-         continue;
-      }
-
-      TiXmlElement* fieldMatchElement  = fieldMatchNode->ToElement();
-      TiXmlNode* fieldPatternNode = NULL;
-      UtlBoolean fieldPatternPresent = false;
-      UtlString fieldName;
-      const char* fieldValuePtr = NULL;
-
-      //check for fieldName parameter , if present check if it matches
-      if(fieldMatchElement->Attribute(XML_ATT_FIELDNAME))
-      {
-         UtlString fieldNameXml = fieldMatchElement->Attribute(XML_ATT_FIELDNAME);
-         // If field name is specified, 
-         // check if it exists in the message
-         if(!fieldNameXml.isNull())
-         {
-             fieldValuePtr = 
-                 request.getHeaderValue(0, fieldNameXml.data());
-
-             if(fieldValuePtr)
-             {
-                fieldNameMatches = true;
-             }
-         }
-      }
-      else
-      {
-         noFieldPatternRequired = true;
-      }
-
-      if(fieldNameMatches && !noFieldPatternRequired)
-      {
-         //get the user text value from it
-         for( fieldPatternNode = fieldMatchElement->FirstChild( XML_TAG_FIELDPATTERN);
-            fieldPatternNode;
-            fieldPatternNode = fieldPatternNode->NextSibling(XML_TAG_FIELDPATTERN ) )
-         {
-            fieldPatternPresent = true;
-            TiXmlElement* fieldPatternElement = fieldPatternNode->ToElement();
-
-            TiXmlNode* fieldPatternText = fieldPatternElement->FirstChild();
-            if(fieldPatternText)
-            {
-               try
-               {
-                  RegEx fieldPatternXml(fieldPatternText->Value(),PCRE_ANCHORED);
-
-                  if (fieldPatternXml.Search(fieldValuePtr))
-                  {
-                     fieldPatternFound = true;
-                  }
-               }
-               catch(const char * ErrorMsg)
-               {
-                  Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                                "Illegal regular expression <fieldPattern>%s</fieldPattern>"
-                                " in forwardingrules.xml: %s",
-                                fieldPatternText->Value() ,ErrorMsg
-                                );
-               }
-            }
-         }
-      }
-      if( (fieldNameMatches && (fieldPatternFound || !fieldPatternPresent))
-          || noFieldPatternRequired )
-      {
-            //get the routeTo field
-         getRouteFound = getRouteTo(routeToString, authRequired, ruriParams,
-            fieldMatchNode);
-      }
+/* //////////////////////////// PROTECTED ///////////////////////////////// */
 
-   }
-   return getRouteFound;
-}
-
-// Function to get a boolean configuration setting based on the Y/N value of
-// a configuration parameter.  Snarfed from 
-// sipXregistry/lib/redirect_plugins/SipRedirectorJoin.cpp, 
-// probably both should be reconciled into a lib one day
-static bool getYN(const char* boolText,
-                        bool defaultValue)
+void ForwardRules::compile(TiXmlDocument& xmlDoc)
 {
-   // Start with the default value.
-   bool value = defaultValue;
-   if (boolText)
-   {
-      // Examine the first character.
-      switch (boolText[0])
-      {
-      case 'y':
-      case 'Y':
-      case 'T':
-      case 't':
-      case '1':
-         // If the value starts with Y or 1, set the result to TRUE.
-         value = true;
-         break;
-      case 'n':
-      case 'N':
-      case 'F':
-      case 'f':
-      case '0':
-         // If the value starts with N or 0, set the result to FALSE.
-         value = false;
-         break;
-      default:
-         // Ignore all other values.
-         break;
-      }
-   }
-   return value;
-}
-
-OsStatus ForwardRules::getRouteTo(UtlString& RouteToString,
-                                 bool& authRequired,
-                                 UtlString& ruriParams,
-                                  TiXmlNode* nodeWithRouteToChild)
-{
-   
-   OsStatus currentStatus = OS_FAILED;
-   nodeWithRouteToChild->ToElement();
-   TiXmlNode* routeToNode = NULL;
-   TiXmlNode* routeToText = NULL;
+    boost::shared_ptr<RouteTable> routeTable(new RouteTable(xmlDoc));
 
-   //get the user text value from it
-   routeToNode = nodeWithRouteToChild->FirstChild(XML_TAG_ROUTETO);
-   if(routeToNode)
-   {
-      if(routeToNode && routeToNode->Type() != TiXmlNode::ELEMENT)
-      {
-         return currentStatus;
-      }
-
-      TiXmlElement* routeToElement = routeToNode->ToElement();
-
-      const char* authRequiredPtr = 
-         routeToElement->Attribute(XML_ATT_AUTHREQUIRED);
-
-      //set the authRequired attribute
-      authRequired=getYN(authRequiredPtr, false) ; //defaults to false
-
-      // set the ruriParams attribute
-      ruriParams.remove(0);
-      const char* ruriParamsPtr = routeToElement->Attribute(XML_ATT_RURIPARAMS);
-      if (ruriParamsPtr)
-      {
-        ruriParams.append(ruriParamsPtr);
-      }
-
-      RouteToString.remove(0);
-      routeToText = routeToElement->FirstChild();
-      if(routeToText && routeToText->Type() == TiXmlNode::TEXT)
-      {
-         TiXmlText* routeTo = routeToText->ToText();
-         if (routeTo)
-         {
-            RouteToString.append(routeTo->Value());
-         }
-      }
-      // TinyXML compresses white space, so an all white space element becomes
-      // zero length, but just in case, let's strip it ourselves.
-      RouteToString.strip(UtlString::both);
-      if (RouteToString.length() > 0)
-      {
-         // The route is not empty.  Declare success
-         currentStatus = OS_SUCCESS;
-      }
-      else if (authRequired)
-      {
-         // The Route can be empty, as long as authRequired is set.
-         // This means just route to the authProxy.
-         currentStatus = OS_SUCCESS;
-      }
-      else
-      {
-         // Empty or missing route, and no authRequired...that's not allowed.
-         currentStatus = OS_FAILED;
-      }
-   }
-   return currentStatus;
+    mutex_critic_sec_lock lock(mRouteTableMutex);
+    mpRouteTable = routeTable;
 }
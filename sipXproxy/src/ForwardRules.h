@@ -11,7 +11,8 @@
 #define _ForwardRules_h_
 
 // SYSTEM INCLUDES
-//#include <...>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
 // APPLICATION INCLUDES
 #include "utl/UtlString.h"
@@ -48,11 +49,29 @@ class SipMessage;
 // TYPEDEFS
 // FORWARD DECLARATIONS
 
+/// Routes out of dialog requests by the rules in forwardingrules.xml
+/**
+ * The rules are compiled when they are loaded: routeFrom hosts go into a
+ * hash table keyed by host and port, routeIPv4subnet and routeDnsWildcard
+ * patterns are parsed, and fieldPattern regular expressions are compiled
+ * once.  getRoute() then only looks at the routes that can match the
+ * request URI, in the order they appear in the file.
+ *
+ * A result that depends only on the host, port and method of the request
+ * (no fieldMatch with a fieldName was looked at) is remembered, for up to
+ * MAX_CACHED_ROUTES host, port and method combinations.  Loading the rules
+ * again starts with no remembered results.
+ */
 class ForwardRules 
 {
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 public:
-	
+
+   enum
+   {
+      MAX_CACHED_ROUTES = 4096 ///< results remembered before the cache is cleared
+   };
+
 /* ============================ CREATORS ================================== */
 
    ForwardRules();
@@ -91,40 +110,19 @@ public:
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
 protected:
 
-   TiXmlDocument *mDoc;
-   Patterns *mPatterns ;
+   class RouteTable;
+
+   typedef boost::mutex mutex_critic_sec;
+   typedef boost::lock_guard<mutex_critic_sec> mutex_critic_sec_lock;
+
+   boost::shared_ptr<RouteTable> mpRouteTable;  ///< NULL until rules are loaded
+   mutex_critic_sec mRouteTableMutex;           ///< protects mpRouteTable
    UtlString mVoicemail;
    UtlString mLocalhost;
    UtlString mMediaServer;
 
-   OsStatus parseRouteMatchContainer(const Url& requestUri,
-      const SipMessage& request,
-      UtlString& RouteToString,
-      UtlString& mappingType,
-      bool& authRequired,
-      UtlString& ruriParams,
-      TiXmlNode* routesNode,
-      TiXmlNode* previousRouteMatchNode = NULL);
-   
-   OsStatus parseMethodMatchContainer(const SipMessage& request,
-      UtlString& RouteToString,
-      bool& authRequired,
-      UtlString& ruriParams,
-      TiXmlNode* routeMatchNode,
-      TiXmlNode* previousMethodMatchNode = NULL);
-
-   OsStatus parseFieldMatchContainer(const SipMessage& request,
-      UtlString& RouteToString,
-      bool& authRequired,
-      UtlString& ruriParams,
-      TiXmlNode* methodMatchNode,
-      TiXmlNode* previousFieldMatchNode = NULL);
-
-   OsStatus getRouteTo(UtlString& RouteToString,
-      bool& authRequired,
-      UtlString& ruriParams,
-      TiXmlNode* fieldMatchNode);
-
+   /// Compile the rules in xmlDoc and use them from now on.
+   void compile(TiXmlDocument& xmlDoc);
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 private:
@@ -6,6 +6,10 @@
 //////////////////////////////////////////////////////////////////////////////
 
 // SYSTEM INCLUDES
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/unordered_map.hpp>
+
 #include "os/OsLogger.h"
 #include "utl/UtlRegex.h"
 #include "utl/UtlSortedListIterator.h"
@@ -66,6 +70,13 @@ const char* RouteState::UrlParameterName = "sipXecs-rs";
 // STATIC VARIABLES
 UtlString   RouteState::mSignatureSecret;
 
+// The values of the state tokens decode has verified, by "<call-id> <token>"
+typedef std::vector<std::pair<UtlString, UtlString> > VerifiedValues;
+typedef boost::unordered_map<std::string, VerifiedValues> VerifiedStates;
+
+static boost::mutex   sVerifiedStatesMutex; ///< protects sVerifiedStates
+static VerifiedStates sVerifiedStates;
+
 class RouteParameterName : public UtlString
 {
 private:
@@ -372,6 +383,15 @@ bool RouteState::decode(const UtlString& stateToken)
    bool decodedOk = false; // true iff the token was correctly signed and successfully parsed
 
    mValues.destroyAll();
+
+   // Every request in the dialog carries this token; the signature binds it to the call-id.
+   std::string verifiedKey(mCallId.data(), mCallId.length());
+   verifiedKey.append(" ");
+   verifiedKey.append(stateToken.data(), stateToken.length());
+   if (getVerified(verifiedKey))
+   {
+      return true;
+   }
    
    RegEx stateAndSignature(StateAndSignature);
 
@@ -486,10 +506,53 @@ bool RouteState::decode(const UtlString& stateToken)
                     "RouteState::decode invalid state token '%s'", stateToken.data()
                     );
    }
+
+   if (decodedOk)
+   {
+      addVerified(verifiedKey);
+   }
    
    return decodedOk;
 }
 
+bool RouteState::getVerified(const std::string& key)
+{
+   boost::lock_guard<boost::mutex> lock(sVerifiedStatesMutex);
+
+   VerifiedStates::const_iterator state = sVerifiedStates.find(key);
+   if (state == sVerifiedStates.end())
+   {
+      return false;
+   }
+
+   for (VerifiedValues::const_iterator value = state->second.begin();
+        value != state->second.end();
+        value++)
+   {
+      mValues.insert(new NameValuePair(value->first, value->second));
+   }
+   return true;
+}
+
+void RouteState::addVerified(const std::string& key)
+{
+   VerifiedValues values;
+   UtlSortedListIterator nvpairList(mValues);
+   NameValuePair* nvpair;
+   while ((nvpair = dynamic_cast<NameValuePair*>(nvpairList())))
+   {
+      values.push_back(std::make_pair(UtlString(*nvpair), UtlString(nvpair->getValue())));
+   }
+
+   boost::lock_guard<boost::mutex> lock(sVerifiedStatesMutex);
+
+   if (sVerifiedStates.size() >= MAX_VERIFIED_STATES)
+   {
+      sVerifiedStates.clear();
+   }
+   sVerifiedStates[key] = values;
+}
+
 
 
 /// Extract value of a parameter saved in the route state.
@@ -721,6 +784,10 @@ void RouteState::setSecret(const char* secret /**< a null terminated string used
    }
    mSignatureSecret.remove(0);
    mSignatureSecret.append(secret);   
+
+   // tokens verified with the old secret may no longer be valid
+   boost::lock_guard<boost::mutex> lock(sVerifiedStatesMutex);
+   sVerifiedStates.clear();
 }
    
 /// destructor
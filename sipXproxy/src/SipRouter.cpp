@@ -131,6 +131,10 @@ SipRouter::SipRouter(SipUserAgent& sipUserAgent,
    ,_isDispatchYielding(false)
    ,_trustSbcRegisteredCalls(FALSE)
    ,_suppressAlertIndicatorForTransfers(FALSE)
+   ,_dispatchTime(UtlMetrics::instance().histogram("sipx_proxy_dispatch_seconds",
+                                                   "Time taken to decide what to do with a request"))
+   ,_authTime(UtlMetrics::instance().histogram("sipx_proxy_auth_seconds",
+                                               "Time taken to check the credentials of a request"))
 {
    // Get Via info to use as defaults for route & realm
    UtlString dnsName;
@@ -238,6 +242,9 @@ SipRouter::SipRouter(SipUserAgent& sipUserAgent,
 
    mpEntityDb = SipRouter::getEntityDBInstance();
    mpRegDb = SipRouter::getRegDBInstance();
+
+   // forget cached credentials as soon as the users they are for change
+   mCredentialCache.watch(MongoDB::ConnectionInfo::globalInfo());
    
    mpSipUserAgent->setPreDispatchEvaluator(boost::bind(&SipRouter::preDispatch, this, _1));
    
@@ -352,9 +359,27 @@ void SipRouter::readConfig(OsConfigDb& configDb, const Url& defaultUri)
    PluginIterator authPlugins(mAuthPlugins);
    AuthPlugin* authPlugin;
    UtlString authPluginName;
+   _authPlugins.clear();
+   _authorizedDialogPlugins.clear();
    while ((authPlugin = dynamic_cast<AuthPlugin*>(authPlugins.next(&authPluginName))))
    {
       authPlugin->announceAssociatedSipRouter( this );
+
+      AuthPluginEntry entry;
+      entry.plugin = authPlugin;
+      entry.name = authPluginName;
+      entry.time = &UtlMetrics::instance().histogram("sipx_proxy_plugin_seconds",
+                                                     "Time taken by each authorization plugin",
+                                                     UtlMetrics::label("plugin", authPluginName.data()).data());
+      _authPlugins.push_back(entry);
+
+      //
+      // Check if this plugin needs to see requests in dialogs that are already authorized
+      //
+      if (authPlugin->willProcessAuthorizedDialogRequest())
+      {
+        _authorizedDialogPlugins.push_back(entry);
+      }
       
       //
       // Check if this plugin wants to modify trusted requests
@@ -504,13 +529,9 @@ bool SipRouter::preDispatch(SipMessage* pMsg)
   static int consecutiveYields = 0;
   static int currentYieldTime = 1;
   
-  bool preProcess = false;
-  UtlString method;
-  if (!pMsg->isResponse())
-  {
-    pMsg->getRequestMethod(&method); // only process INVITE, SUBSCRIBE and REGISTER
-    preProcess = method.compareTo( SIP_INVITE_METHOD ) == 0 || method.compareTo( SIP_REGISTER_METHOD ) == 0 || method.compareTo( SIP_SUBSCRIBE_METHOD ) == 0;
-  }
+  // only process INVITE, SUBSCRIBE and REGISTER; a response has no method
+  SipTokens::Method methodId = pMsg->getMethodId();
+  bool preProcess = methodId == SipTokens::METHOD_INVITE || methodId == SipTokens::METHOD_REGISTER || methodId == SipTokens::METHOD_SUBSCRIBE;
   
   if (!preProcess)
     return true;
@@ -555,7 +576,7 @@ bool SipRouter::preDispatch(SipMessage* pMsg)
            
       OS_LOG_CRITICAL(FAC_SIP,
         "SipRouter::preDispatch - " <<
-        "Discarding SIP Request " << method.data() <<
+        "Discarding SIP Request " << SipTokens::methodName(methodId) <<
         " due to slow processing capacity. " <<
         " Last Dispatch Speed: " << getLastDispatchSpeed() << " ms"
         " Average Dispatch Speed: " << getAverageDispatchSpeed() << " ms"
@@ -575,7 +596,7 @@ bool SipRouter::preDispatch(SipMessage* pMsg)
         //
         OS_LOG_EMERGENCY(FAC_SIP,
         "ALARM_PROXY_POOR_CAPACITY " <<
-        "Discarding SIP Request " << method.data() <<
+        "Discarding SIP Request " << SipTokens::methodName(methodId) <<
         " due to slow processing capacity. " <<
         " Last Dispatch Speed: " << getLastDispatchSpeed() << " ms"
         " Average Dispatch Speed: " << getAverageDispatchSpeed() << " ms"
@@ -822,11 +843,13 @@ void SipRouter::handleRequest(SipMessage* pSipRequest)
   SipMessage sipResponse;
   if (timedDispatch)
   {
+    UtlMetricTimer metricTimer(_dispatchTime);
     DispatchTimer timer(*this);
     action = proxyMessage(*pSipRequest, sipResponse);
   }
   else
   {
+    UtlMetricTimer metricTimer(_dispatchTime);
     action = proxyMessage(*pSipRequest, sipResponse);
   }
   
@@ -1264,6 +1287,8 @@ SipRouter::ProxyAction SipRouter::proxyMessage(SipMessage& sipRequest, SipMessag
            UtlString callId;
            sipRequest.getCallIdField(&callId);  // for logging
 
+           bool dialogIsAuthorized = false;     // in-dialog request of an authorized dialog?
+
            // If the RouteState is not mutable, check whether or not the dialog has already
            // been authorized by interogating the RouteState
            if( !routeState.isMutable() )
@@ -1272,6 +1297,7 @@ SipRouter::ProxyAction SipRouter::proxyMessage(SipMessage& sipRequest, SipMessag
               {
                  // the dialog has already been authorized, allow request
                  authStatus = AuthPlugin::ALLOW;
+                 dialogIsAuthorized = true;
               }
            }
 
@@ -1312,22 +1338,37 @@ SipRouter::ProxyAction SipRouter::proxyMessage(SipMessage& sipRequest, SipMessag
               authDecision = AuthPlugin::ALLOW;
            }
 
-           // call each plugin
-           PluginIterator authPlugins(mAuthPlugins);
-           AuthPlugin* authPlugin;
-           UtlString authPluginName;
+           // call each plugin; in a dialog that is already authorized, only
+           // those that modify or police its requests need to see them
+           const AuthPlugins& authPlugins =
+              dialogIsAuthorized ? _authorizedDialogPlugins : _authPlugins;
+           if (dialogIsAuthorized)
+           {
+              Os::Logger::instance().log(FAC_AUTH, PRI_DEBUG,
+                            "SipProxy::proxyMessage dialog is authorized; "
+                            "calling %zu of %zu plugins for %s",
+                            authPlugins.size(), _authPlugins.size(), callId.data()
+                            );
+           }
+
            AuthPlugin::AuthResult pluginResult;
-           while ((authPlugin = dynamic_cast<AuthPlugin*>(authPlugins.next(&authPluginName))))
+           for (AuthPlugins::const_iterator authPlugin = authPlugins.begin();
+                authPlugin != authPlugins.end();
+                authPlugin++)
            {
-              pluginResult = authPlugin->authorizeAndModify(authUser,
-                                                            normalizedRequestUri,
-                                                            routeState,
-                                                            method,
-                                                            authStatus,
-                                                            sipRequest,
-                                                            bMessageWillSpiral,
-                                                            rejectReason
-                                                            );
+              const UtlString& authPluginName = authPlugin->name;
+
+              Int64 pluginStart = UtlMetricHistogram::now();
+              pluginResult = authPlugin->plugin->authorizeAndModify(authUser,
+                                                                    normalizedRequestUri,
+                                                                    routeState,
+                                                                    method,
+                                                                    authStatus,
+                                                                    sipRequest,
+                                                                    bMessageWillSpiral,
+                                                                    rejectReason
+                                                                    );
+              authPlugin->time->tally(UtlMetricHistogram::now() - pluginStart);
 
               Os::Logger::instance().log(FAC_AUTH, PRI_DEBUG,
                             "SipProxy::proxyMessage plugin %s returned %s for %s",
@@ -1912,6 +1953,7 @@ bool SipRouter::isAuthenticated(const SipMessage& sipRequest,
    OsTime time;
    OsDateTime::getCurTimeSinceBoot(time);
    long nonceExpires = mNonceExpiration;
+   UtlMetricTimer authTimer(_authTime);
 
    authUser.remove(0);
     
@@ -1979,14 +2021,16 @@ bool SipRouter::isAuthenticated(const SipMessage& sipRequest,
       {    
           Url userUrl;
           UtlString authTypeDB;
-          UtlString passTokenDB;
+          UtlString userPasswordDigest;
 
           // then get the credentials for this user and realm
-          if(getCredential(requestUserBase,
-                                                        mRealm,
-                                                        userUrl,
-                                                        passTokenDB,
-                                                        authTypeDB))
+          if (mCredentialCache.getCredential(*mpEntityDb,
+                                             requestUser,
+                                             requestUserBase,
+                                             mRealm,
+                                             userUrl,
+                                             userPasswordDigest,
+                                             authTypeDB))
           {
 #ifdef TEST_PRINT
              // THIS SHOULD NOT BE LOGGED IN PRODUCTION
@@ -1994,20 +2038,29 @@ bool SipRouter::isAuthenticated(const SipMessage& sipRequest,
              Os::Logger::instance().log(FAC_AUTH, PRI_DEBUG,
                            "SipRouter::isAuthenticated "
                            "found credential "
-                           "user: \"%s\" passToken: \"%s\"",
-                           requestUser.data(), passTokenDB.data());
+                           "user: \"%s\" H(A1): \"%s\"",
+                           requestUser.data(), userPasswordDigest.data());
 #endif
-             authenticated = sipRequest.verifyMd5Authorization(requestUser.data(),
-                                                               passTokenDB.data(),
+             authenticated = sipRequest.verifyMd5Authorization(userPasswordDigest.data(),
                                                                requestNonce.data(),
-                                                               requestRealm.data(),
                                                                requestCNonce.data(),
                                                                requestNonceCount.data(),
                                                                requestQop.data(),
                                                                requestUri.data(),
                                                                HttpMessage::PROXY );
 
-             if ( authenticated )
+             // the credentials are good, but only once for each nonce-count
+             if (   authenticated
+                 && !mNonceDb.recordNonceCount(requestNonce, requestNonceCount,
+                                               sipRequest.getHeaderValue(0, SIP_CSEQ_FIELD)))
+             {
+                authenticated = FALSE;
+                Os::Logger::instance().log(FAC_AUTH, PRI_WARNING,
+                              "SipRouter::isAuthenticated() "
+                              "replayed nonce-count '%s' for user '%s' call-id '%s'",
+                              requestNonceCount.data(), requestUser.data(), callId.data());
+             }
+             else if ( authenticated )
              {
                 userUrl.getIdentity(authUser);
                 Os::Logger::instance().log(FAC_AUTH, PRI_DEBUG,
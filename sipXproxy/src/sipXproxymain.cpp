@@ -24,8 +24,12 @@
 #include <os/OsLoggerHelper.h>
 #include <os/UnixSignals.h>
 #include <os/OsMsgQ.h>
+#include <os/OsServerSocket.h>
+#include <net/HttpMetricsService.h>
+#include <net/HttpServer.h>
 #include <net/SipMessage.h>
 #include <net/SipUserAgent.h>
+#include <net/SipWorkerGroup.h>
 #include <net/NameValueTokenizer.h>
 #include <xmlparser/tinyxml.h>
 #include <sipXecsService/SipXecsService.h>
@@ -184,6 +188,33 @@ int proxy()
     osPrintf("SIPX_PROXY_DEFAULT_EXPIRES : %d\n", defaultExpires);
     Os::Logger::instance().log(FAC_SIP, PRI_INFO, "SIPX_PROXY_DEFAULT_SERIAL_EXPIRES : %d", defaultSerialExpires);
     osPrintf("SIPX_PROXY_DEFAULT_SERIAL_EXPIRES : %d\n", defaultSerialExpires);
+
+    // Run as several worker processes sharing the SIP ports, if configured.
+    // They are forked here, before anything below starts a thread; a
+    // transaction is held in the shared table as long as the proxy may
+    // still see messages of it.
+    int workers = 1;
+    osServiceOptions.getOption("SIPX_PROXY_WORKERS", workers, 1);
+    if (workers < 1 || workers > SipWorkerGroup::MAX_WORKERS)
+    {
+       workers = 1;
+    }
+    Os::Logger::instance().log(FAC_SIP, PRI_INFO, "SIPX_PROXY_WORKERS : %d", workers);
+
+    SipWorkerGroup* pWorkerGroup = NULL;
+    unsigned int worker = 0;
+    if (workers > 1)
+    {
+       pWorkerGroup = new SipWorkerGroup(workers, defaultExpires + 32);
+       OsSocket::setReusePort(TRUE);
+       worker = pWorkerGroup->fork();
+       if (worker > 0)
+       {
+          SipXApplication::instance().restartSignalTaskAfterFork();
+          Os::Logger::instance().log(FAC_SIP, PRI_NOTICE,
+                                     "SipXproxymain::proxy worker %u started", worker);
+       }
+    }
       
     UtlString hostAliases;
     osServiceOptions.getOption("SIPX_PROXY_HOST_ALIASES", hostAliases);
@@ -540,6 +571,10 @@ int proxy()
     pSipUserAgent->setMaxSrvRecords(maxNumSrvRecords);
     pSipUserAgent->setUserAgentHeaderProperty("sipXecs/sipXproxy");
     pSipUserAgent->setMaxForwards(maxForwards);
+    if (pWorkerGroup)
+    {
+       pWorkerGroup->start(*pSipUserAgent);
+    }
     pSipUserAgent->setDefaultExpiresSeconds(defaultExpires);
     pSipUserAgent->setDefaultSerialExpiresSeconds(defaultSerialExpires);
     pSipUserAgent->setMaxTcpSocketIdleTime(staleTcpTimeout);
@@ -616,6 +651,27 @@ int proxy()
     // Start the router running
     pRouter->start();
 
+    // Serve the metrics for scraping, if a port is configured
+    OsServerSocket* pMetricsSocket = NULL;
+    HttpServer* pMetricsServer = NULL;
+    HttpMetricsService* pMetricsService = NULL;
+    int metricsPort = PORT_NONE;
+    osServiceOptions.getOption("SIPX_PROXY_METRICS_PORT", metricsPort, PORT_NONE);
+    if (metricsPort > 0)
+    {
+       // Each worker serves its own metrics, on the next port up.
+       metricsPort += worker;
+       Os::Logger::instance().log(FAC_SIP, PRI_INFO, "SIPX_PROXY_METRICS_PORT : %d", metricsPort);
+       pMetricsSocket = new OsServerSocket(50, metricsPort, bindIp);
+       pMetricsServer = new HttpServer(pMetricsSocket,
+                                       NULL, // no valid ip address list
+                                       true  // use persistent http connections
+                                       );
+       pMetricsService = new HttpMetricsService();
+       pMetricsServer->addHttpService("/metrics", pMetricsService);
+       pMetricsServer->start();
+    }
+
     // Do not exit, let the proxy do its stuff
     if (!gShutdownFlag)
     {
@@ -625,6 +681,11 @@ int proxy()
       }
     }
 
+    if (pWorkerGroup)
+    {
+       pWorkerGroup->stopWorkers();
+    }
+
     if (EXIT_ON_TERMINATION)
     {
       //
@@ -636,14 +697,28 @@ int proxy()
       _exit(0);
     }
  
+    if (pMetricsServer)
+    {
+       pMetricsServer->requestShutdown();
+       delete pMetricsServer;
+       delete pMetricsService;
+       delete pMetricsSocket;
+    }
+
     // This is a server task so gracefully shutdown the
     // router task by deleting it.
     delete pRouter ;
 
     // Stop the SipUserAgent.
     pSipUserAgent->shutdown();
+    // Stop steering its messages before it goes.
+    if (pWorkerGroup)
+    {
+       pWorkerGroup->stop();
+    }
     // And delete it, too.
     delete pSipUserAgent ;
+    delete pWorkerGroup;
 
     // flush and close the call state event log
     if (enableCallStateLogObserver || enableCallStateDbObserver)
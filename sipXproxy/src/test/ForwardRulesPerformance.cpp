@@ -0,0 +1,139 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Rate of ForwardRules::getRoute on the rules ForwardRulesTest uses.
+//
+// The requests of ForwardRulesTest are routed round robin ROUNDS times
+// (100000 by default), so routes that depend on a header are mixed with
+// ones that are remembered by host, port and method.  Loading the rules
+// is timed too, as it is done on every reload.
+//
+//    ForwardRulesPerformance [rounds] [rules-file]
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+
+// APPLICATION INCLUDES
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "net/Url.h"
+#include "net/SipMessage.h"
+#include "ForwardRules.h"
+
+// CONSTANTS
+#define DEFAULT_ROUNDS 100000
+#define LOADS 1000
+
+struct Request
+{
+   const char* uri;
+   const char* message;
+};
+
+static const Request requests[] =
+{
+   { "sip:sipuaconfig.SIPXCHANGE_DOMAIN_NAME",
+     "UNKNOWN sip:sipuaconfig.SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n\r\n" },
+   { "sip:SIPXCHANGE_DOMAIN_NAME",
+     "REGISTER sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n\r\n" },
+   { "sip:SIPXCHANGE_DOMAIN_NAME",
+     "INVITE sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n\r\n" },
+   { "sip:SIPXCHANGE_DOMAIN_NAME",
+     "SUBSCRIBE sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\nEvent: sip-config\r\n\r\n" },
+   { "sip:SIPXCHANGE_DOMAIN_NAME",
+     "SUBSCRIBE sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\nEvent: message-summary\r\n\r\n" },
+   { "sip:SIPXCHANGE_DOMAIN_NAME",
+     "UNKNOWN sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n\r\n" },
+   { "sip:10.1.1.1:4242",
+     "INVITE sip:10.1.1.1:4242 SIP/2.0\r\n\r\n" },
+   { "sip:user@puppy.dog.woof.NeT",
+     "INVITE sip:user@puppy.dog.woof.NeT SIP/2.0\r\n\r\n" },
+   { "sip:RURIPARAM.TEST",
+     "SUBSCRIBE sip:RURIPARAM.TEST SIP/2.0\r\nEvent: message-summary\r\n\r\n" },
+   { "sip:AUTHPROXY.GOOD",
+     "INVITE sip:AUTHPROXY.GOOD SIP/2.0\r\n\r\n" },
+   { "sip:OTHER_DOMAIN_NAME",
+     "INVITE sip:OTHER_DOMAIN_NAME SIP/2.0\r\n\r\n" },
+};
+
+#define REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+static OsTime start;
+
+static void startTimer()
+{
+   OsDateTime::getCurTimeSinceBoot(start);
+}
+
+static void report(const char* what, int operations)
+{
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+
+   printf("%-10s %9d ops %10.3f ms %12.0f ops/s\n",
+          what, operations, seconds * 1000.0,
+          seconds > 0 ? operations / seconds : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+   int rounds = argc > 1 ? atoi(argv[1]) : DEFAULT_ROUNDS;
+   UtlString rulesFile(argc > 2 ? argv[2] : TEST_DATA_DIR "/rulesdata/simple.xml");
+
+   ForwardRules rules;
+   startTimer();
+   for (int i = 0; i < LOADS; i++)
+   {
+      if (rules.loadMappings(rulesFile) != OS_SUCCESS)
+      {
+         fprintf(stderr, "could not load %s\n", rulesFile.data());
+         return 1;
+      }
+   }
+   report("load", LOADS);
+
+   Url* uris[REQUESTS];
+   SipMessage* messages[REQUESTS];
+   for (size_t r = 0; r < REQUESTS; r++)
+   {
+      uris[r] = new Url(requests[r].uri);
+      messages[r] = new SipMessage(requests[r].message);
+   }
+
+   UtlString routeTo;
+   UtlString mappingType;
+   bool authRequired;
+   UtlString ruriParams;
+   int routed = 0;
+
+   startTimer();
+   for (int i = 0; i < rounds; i++)
+   {
+      for (size_t r = 0; r < REQUESTS; r++)
+      {
+         if (rules.getRoute(*uris[r], *messages[r],
+                            routeTo, mappingType, authRequired, ruriParams) == OS_SUCCESS)
+         {
+            routed++;
+         }
+      }
+   }
+   report("getRoute", rounds * REQUESTS);
+   printf("%d of %d routed\n", routed, (int) (rounds * REQUESTS));
+
+   for (size_t r = 0; r < REQUESTS; r++)
+   {
+      delete uris[r];
+      delete messages[r];
+   }
+
+   return 0;
+}
@@ -33,6 +33,7 @@ class ForwardRulesTest : public CppUnit::TestCase
       CPPUNIT_TEST(testSimpleMapForeignDNS);
       CPPUNIT_TEST(testRuriParam);
       CPPUNIT_TEST(testSimpleMapAuthProxy);
+      CPPUNIT_TEST(testRepeatedRoutes);
       CPPUNIT_TEST_SUITE_END();
 
 
@@ -423,6 +424,109 @@ class ForwardRulesTest : public CppUnit::TestCase
                         == OS_FAILED
                         );
       }
+
+      // The same rules asked again, after results have been remembered
+      void testRepeatedRoutes()
+      {
+         ForwardRules theRules;
+         UtlString     theRoute;
+         UtlString     mappingType;
+         bool          authRequired;
+         UtlString     ruriParams;
+         UtlString     rulesFile(TEST_DATA_DIR "/rulesdata/simple.xml");
+
+         CPPUNIT_ASSERT( theRules.loadMappings(rulesFile, MS, VM, LH )
+                        == OS_SUCCESS
+                        );
+
+         for (int i = 0; i < 2; i++)
+         {
+            CPPUNIT_ASSERT( theRules.getRoute(Url("sip:SIPXCHANGE_DOMAIN_NAME"),
+                                              SipMessage("REGISTER sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n"
+                                                         "\r\n"
+                                                         ),
+                                              theRoute,
+                                              mappingType,
+                                              authRequired,
+                                              ruriParams
+                                              )
+                           == OS_SUCCESS
+                           );
+            ASSERT_STR_EQUAL("REGISTRAR_SERVER_DEFAULT", theRoute.data());
+            ASSERT_STR_EQUAL("local", mappingType.data());
+
+            // same host in other case, with the default port
+            CPPUNIT_ASSERT( theRules.getRoute(Url("sip:sipxchange_domain_name:5060"),
+                                              SipMessage("REGISTER sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n"
+                                                         "\r\n"
+                                                         ),
+                                              theRoute,
+                                              mappingType,
+                                              authRequired,
+                                              ruriParams
+                                              )
+                           == OS_SUCCESS
+                           );
+            ASSERT_STR_EQUAL("REGISTRAR_SERVER_DEFAULT", theRoute.data());
+
+            // the route of a SUBSCRIBE depends on its Event header
+            CPPUNIT_ASSERT( theRules.getRoute(Url("sip:SIPXCHANGE_DOMAIN_NAME"),
+                                              SipMessage("SUBSCRIBE sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n"
+                                                         "Event: sip-config\r\n"
+                                                         "\r\n"
+                                                         ),
+                                              theRoute,
+                                              mappingType,
+                                              authRequired,
+                                              ruriParams
+                                              )
+                           == OS_SUCCESS
+                           );
+            ASSERT_STR_EQUAL("CONFIG_SERVER_SUBSCRIBE", theRoute.data());
+
+            CPPUNIT_ASSERT( theRules.getRoute(Url("sip:SIPXCHANGE_DOMAIN_NAME"),
+                                              SipMessage("SUBSCRIBE sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n"
+                                                         "Event: message-summary\r\n"
+                                                         "\r\n"
+                                                         ),
+                                              theRoute,
+                                              mappingType,
+                                              authRequired,
+                                              ruriParams
+                                              )
+                           == OS_SUCCESS
+                           );
+            ASSERT_STR_EQUAL("STATUS_SERVER_EVENT", theRoute.data());
+
+            CPPUNIT_ASSERT( theRules.getRoute(Url("sip:OTHER_DOMAIN_NAME"),
+                                              SipMessage("REGISTER sip:OTHER_DOMAIN_NAME SIP/2.0\r\n"
+                                                         "\r\n"
+                                                         ),
+                                              theRoute,
+                                              mappingType,
+                                              authRequired,
+                                              ruriParams
+                                              )
+                           != OS_SUCCESS
+                           );
+         }
+
+         // Rules that fail to load replace the old ones, and what was remembered
+         CPPUNIT_ASSERT( theRules.loadMappings(TEST_DATA_DIR "/rulesdata/missing.xml", MS, VM, LH )
+                        != OS_SUCCESS
+                        );
+         CPPUNIT_ASSERT( theRules.getRoute(Url("sip:SIPXCHANGE_DOMAIN_NAME"),
+                                           SipMessage("REGISTER sip:SIPXCHANGE_DOMAIN_NAME SIP/2.0\r\n"
+                                                      "\r\n"
+                                                      ),
+                                           theRoute,
+                                           mappingType,
+                                           authRequired,
+                                           ruriParams
+                                           )
+                        != OS_SUCCESS
+                        );
+      }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(ForwardRulesTest);
@@ -37,6 +37,7 @@ class RouteStateTest : public CppUnit::TestCase
    CPPUNIT_TEST(testSetUnsetUnMutable);
    CPPUNIT_TEST(testNameValidity);
    CPPUNIT_TEST(testTokenEncodeDecode);
+   CPPUNIT_TEST(testVerifiedTokenDecode);
    CPPUNIT_TEST(testRoutedRequestState);
    CPPUNIT_TEST(testAppendToExistingRecordRoute);
    CPPUNIT_TEST(testSpiraledState);
@@ -415,6 +416,78 @@ public:
          ASSERT_STR_EQUAL(Value2, readValue.data());
       }
 
+   void testVerifiedTokenDecode()
+      {
+         UtlSList removedHeaders;
+         UtlString myRouteName("myhost.example.com");
+
+         const char* mutableMessage =
+            "INVITE sip:user@somewhere.com SIP/2.0\r\n"
+            "Via: SIP/2.0/TCP 10.1.1.3:33855\r\n"
+            "To: sip:user@somewhere.com\r\n"
+            "From: Caller <sip:caller@example.org>; tag=30543f3483e1cb11ecb40866edd3295b\r\n"
+            "Call-Id: 5d8a3e7b1c9f4a2e8b6d0c3f7a1e9b42\r\n"
+            "Cseq: 1 INVITE\r\n"
+            "Max-Forwards: 20\r\n"
+            "Contact: caller@127.0.0.1\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n";
+         SipMessage mutableSipMessage(mutableMessage, strlen(mutableMessage));
+         RouteState mutableRouteState(mutableSipMessage, removedHeaders, myRouteName);
+
+         UtlString writeValue(Value1);
+         mutableRouteState.setParameter("plugin","param1",writeValue);
+         UtlString signedToken;
+         mutableRouteState.encode(signedToken);
+
+         const char* indialogMessage =
+            "BYE sip:user@somewhere.com SIP/2.0\r\n"
+            "Via: SIP/2.0/TCP 10.1.1.3:33855\r\n"
+            "To: sip:user@somewhere.com; tag=MAKES_THIS_UNMUTABLE\r\n"
+            "From: Caller <sip:caller@example.org>; tag=30543f3483e1cb11ecb40866edd3295b\r\n"
+            "Call-Id: 5d8a3e7b1c9f4a2e8b6d0c3f7a1e9b42\r\n"
+            "Cseq: 2 BYE\r\n"
+            "Max-Forwards: 20\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n";
+         SipMessage indialogSipMessage(indialogMessage, strlen(indialogMessage));
+
+         // the second decode of the token finds the values remembered by the first
+         for (int request = 0; request < 2; request++)
+         {
+            RouteState indialogRouteState(indialogSipMessage, removedHeaders, myRouteName);
+            CPPUNIT_ASSERT(indialogRouteState.decode(signedToken));
+
+            UtlString readValue;
+            CPPUNIT_ASSERT(indialogRouteState.getParameter("plugin","param1",readValue));
+            ASSERT_STR_EQUAL(Value1, readValue.data());
+            CPPUNIT_ASSERT_EQUAL((size_t) 1, indialogRouteState.mValues.entries());
+         }
+
+         // the token is signed for its call-id only
+         const char* otherCallMessage =
+            "BYE sip:user@somewhere.com SIP/2.0\r\n"
+            "Via: SIP/2.0/TCP 10.1.1.3:33855\r\n"
+            "To: sip:user@somewhere.com; tag=MAKES_THIS_UNMUTABLE\r\n"
+            "From: Caller <sip:caller@example.org>; tag=30543f3483e1cb11ecb40866edd3295b\r\n"
+            "Call-Id: 0b7e2f9c4d1a8e3b6c5f0a9d2e7b4c18\r\n"
+            "Cseq: 2 BYE\r\n"
+            "Max-Forwards: 20\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n";
+         SipMessage otherCallSipMessage(otherCallMessage, strlen(otherCallMessage));
+         RouteState otherCallRouteState(otherCallSipMessage, removedHeaders, myRouteName);
+         CPPUNIT_ASSERT(!otherCallRouteState.decode(signedToken));
+         CPPUNIT_ASSERT(otherCallRouteState.mValues.isEmpty());
+
+         // changing the secret forgets the tokens verified with the old one
+         UtlString oldSecret(RouteState::mSignatureSecret);
+         RouteState::setSecret("a new secret");
+         RouteState newSecretRouteState(indialogSipMessage, removedHeaders, myRouteName);
+         CPPUNIT_ASSERT(!newSecretRouteState.decode(signedToken));
+         RouteState::setSecret(oldSecret.data());
+      }
+
    void testRoutedRequestState()
       {
          UtlSList removedHeaders;
@@ -0,0 +1,188 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Rate of SipRouter::proxyMessage on in-dialog requests of an authorized dialog.
+//
+// A re-INVITE, an INFO and a BYE, each with the signed RouteState of an
+// authorized dialog in its Route header, are proxied REQUESTS times each
+// (100000 by default) by a SipRouter configured with the authorization
+// plugins built in lib/authplugins.  Each request is copied from a parsed
+// template before it is proxied, since proxyMessage modifies it; the copy
+// is timed on its own so it can be subtracted.
+//
+//    SipRouterPerformance [requests]
+//
+// To compare with the full plugin chain and no remembered RouteState
+// signatures, build and run this program against the previous revision.
+// Like SipRouterTest, it needs the MongoDB that the SipRouter connects to.
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// APPLICATION INCLUDES
+#include "os/OsConfigDb.h"
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "net/SipMessage.h"
+#include "net/SipUserAgent.h"
+#include "net/SipXauthIdentity.h"
+#include "sipXecsService/SipXecsService.h"
+#include "sipxunit/FileTestContext.h"
+#include "ForwardRules.h"
+#include <sipxproxy/RouteState.h>
+#include <sipxproxy/SipRouter.h>
+
+// CONSTANTS
+#define DEFAULT_REQUESTS 100000
+#define SIP_PORT 5060
+#define PLUGIN_DIR "../../lib/authplugins/authplugins/.libs/"
+
+static const char* SipRouterConfiguration =
+   "SIPX_PROXY_HOSTPORT : 10.10.10.1:5060\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.100-linter : " PLUGIN_DIR "libRequestLinter.so\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.150-calldestination : " PLUGIN_DIR "libCallDestination.so\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.200-callerid : " PLUGIN_DIR "libCallerAlias.so\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.205-authrules : " PLUGIN_DIR "libEnforceAuthRules.so\r\n"
+   "SIPX_PROXY.205-authrules.IDENTITY_VALIDITY_SECONDS : 300\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.210-subscription : " PLUGIN_DIR "libSubscriptionAuth.so\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.300-transfer : " PLUGIN_DIR "libTransferControl.so\r\n"
+   "SIPX_PROXY_HOOK_LIBRARY.400-alertinfo : " PLUGIN_DIR "libCallerAlertInfo.so\r\n"
+   "\r\n";
+
+// The RouteState of SipRouterTest::testProxyMessageWithRouteStateWithAuthentication_InDialog,
+// signed with the secret "GuessThat!" for its call-id; it records that the dialog is authorized.
+#define DIALOG_HEADERS                                                  \
+   "Route: <sip:10.10.10.1:5060;lr;sipXecs-rs=%2Aauth%7EY2FsbGVyQGV4YW1wbGUub3Jn.%2Afrom%7EMzA1NDNmMzQ4M2UxY2IxMWVjYjQwODY2ZWRkMzI5NWI%60%21dd68e849b4c9054d40b9eebfc52129a5>\r\n" \
+   "Via: SIP/2.0/TCP 10.1.1.3:33855;branch=z9hG4bK-perf\r\n"               \
+   "To: Callee <sip:user@somewhere.com>;tag=1234\r\n"                   \
+   "From: Caller <sip:caller@example.org>;tag=30543f3483e1cb11ecb40866edd3295b\r\n" \
+   "Call-Id: f88dfabce84b6a2787ef024a7dbe8749\r\n"                     \
+   "Max-Forwards: 20\r\n"
+
+struct Request
+{
+   const char* name;
+   const char* message;
+};
+
+static const Request requests[] =
+{
+   { "re-INVITE",
+     "INVITE sip:user@somewhere.com SIP/2.0\r\n"
+     DIALOG_HEADERS
+     "Cseq: 2 INVITE\r\n"
+     "Contact: <sip:caller@10.1.1.3:33855;transport=tcp>\r\n"
+     "Content-Length: 0\r\n"
+     "\r\n" },
+   { "INFO",
+     "INFO sip:user@somewhere.com SIP/2.0\r\n"
+     DIALOG_HEADERS
+     "Cseq: 3 INFO\r\n"
+     "Content-Type: application/dtmf-relay\r\n"
+     "Content-Length: 24\r\n"
+     "\r\n"
+     "Signal=5\r\nDuration=160\r\n" },
+   { "BYE",
+     "BYE sip:user@somewhere.com SIP/2.0\r\n"
+     DIALOG_HEADERS
+     "Cseq: 4 BYE\r\n"
+     "Content-Length: 0\r\n"
+     "\r\n" },
+};
+
+#define REQUESTS (sizeof(requests) / sizeof(requests[0]))
+
+static OsTime start;
+
+static void startTimer()
+{
+   OsDateTime::getCurTimeSinceBoot(start);
+}
+
+static double stopTimer()
+{
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   return elapsed.seconds() + elapsed.usecs() / 1000000.0;
+}
+
+static void report(const char* what, int operations, double seconds)
+{
+   printf("%-10s %9d ops %10.3f ms %12.0f ops/s\n",
+          what, operations, seconds * 1000.0,
+          seconds > 0 ? operations / seconds : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+   int count = argc > 1 ? atoi(argv[1]) : DEFAULT_REQUESTS;
+
+   // use the SipRouterTest configuration rather than any installed one
+   FileTestContext testContext(TEST_DATA_DIR "/siproutertestdata",
+                               TEST_WORK_DIR "/siproutertestdata");
+   testContext.setSipxDir(SipXecsService::ConfigurationDirType);
+   testContext.setSipxDir(SipXecsService::DatabaseDirType);
+   testContext.inputFile("credential.xml");
+   testContext.inputFile("domain-config");
+
+   SipUserAgent userAgent(SIP_PORT, SIP_PORT, -1, "127.0.0.2");
+
+   UtlString rulesFile;
+   testContext.inputFilePath("routing.xml", rulesFile);
+   ForwardRules forwardingRules;
+   if (forwardingRules.loadMappings(rulesFile, "Mediaserver", "Voicemail", "localhost") != OS_SUCCESS)
+   {
+      fprintf(stderr, "could not load %s\n", rulesFile.data());
+      return 1;
+   }
+
+   OsConfigDb configDb;
+   configDb.loadFromBuffer(SipRouterConfiguration);
+   SipRouter router(userAgent, forwardingRules, configDb);
+
+   // the secret the Route headers were signed with
+   RouteState::setSecret("GuessThat!");
+   SipXauthIdentity::setSecret("GuessThat!");
+
+   for (size_t r = 0; r < REQUESTS; r++)
+   {
+      SipMessage request(requests[r].message, strlen(requests[r].message));
+
+      startTimer();
+      for (int i = 0; i < count; i++)
+      {
+         SipMessage copy(request);
+      }
+      double copySeconds = stopTimer();
+
+      int proxied = 0;
+      startTimer();
+      for (int i = 0; i < count; i++)
+      {
+         SipMessage copy(request);
+         SipMessage response;
+         if (router.proxyMessage(copy, response) == SipRouter::SendRequest)
+         {
+            proxied++;
+         }
+      }
+      double proxySeconds = stopTimer();
+
+      report(requests[r].name, count, proxySeconds);
+      report("  copy", count, copySeconds);
+      if (proxied != count)
+      {
+         printf("  %d of %d proxied\n", proxied, count);
+      }
+   }
+
+   return 0;
+}
@@ -73,6 +73,7 @@ class SipRouterTest : public CppUnit::TestCase
    CPPUNIT_TEST(testAdditionOfRouteState_AuthenticatedIdentity);
    CPPUNIT_TEST(testProxyMessageWithRouteStateWithAuthentication_DialogForming);
    CPPUNIT_TEST(testProxyMessageWithRouteStateWithAuthentication_InDialog);
+   CPPUNIT_TEST(testAuthorizedDialogPlugins);
    CPPUNIT_TEST(testProxyMessageRouteState_DeniedByPlugin);
    CPPUNIT_TEST(testAddNatMappingInfoToContactsToNatedMessage);
    CPPUNIT_TEST(testAddNatMappingInfoToContactsToNonNatedMessage);
@@ -1484,6 +1485,29 @@ public:
       CPPUNIT_ASSERT( !testMsg.getRouteUri(0, &route) );
    }
 
+   void testAuthorizedDialogPlugins()
+   {
+      // in-dialog requests of authorized dialogs go to the plugins that ask
+      // for them (the dummy does), in the order of all the plugins
+      size_t authorizedDialogPlugin = 0;
+      for (size_t plugin = 0; plugin < mSipRouter->_authPlugins.size(); plugin++)
+      {
+         const SipRouter::AuthPluginEntry& entry = mSipRouter->_authPlugins[plugin];
+         if (entry.plugin->willProcessAuthorizedDialogRequest())
+         {
+            CPPUNIT_ASSERT(authorizedDialogPlugin < mSipRouter->_authorizedDialogPlugins.size());
+            CPPUNIT_ASSERT(mSipRouter->_authorizedDialogPlugins[authorizedDialogPlugin].plugin
+                           == entry.plugin);
+            authorizedDialogPlugin++;
+         }
+      }
+      CPPUNIT_ASSERT_EQUAL(authorizedDialogPlugin, mSipRouter->_authorizedDialogPlugins.size());
+
+      CPPUNIT_ASSERT(!mSipRouter->_authorizedDialogPlugins.empty());
+      CPPUNIT_ASSERT(mSipRouter->_authorizedDialogPlugins[0].plugin == mpDummyAuthPlugin);
+      ASSERT_STR_EQUAL("200-dummy", mSipRouter->_authorizedDialogPlugins[0].name.data());
+   }
+
    void testProxyMessageRouteState_DeniedByPlugin()
    {
       RouteState::setSecret("GuessThat!");
@@ -16,6 +16,7 @@
 
 // APPLICATION INCLUDES
 #include "net/SipMessage.h"
+#include "sipdb/Subscription.h"
 
 // DEFINES
 // MACROS
@@ -52,6 +53,12 @@ public:
         const SipMessage& subscribe,
         SipMessage& notify );
 
+    /// Send a bodiless NOTIFY ending a subscription that has expired.
+    /** The record must still hold the stored contact, route and NOTIFY CSeq;
+     *  the caller removes it afterwards.
+     */
+    void sendTerminatingNotify(Subscription& record);
+
     SipUserAgent* getUserAgent();
 
     void setSubscribeServer(SubscribeServerThread* pSubscriveServer);
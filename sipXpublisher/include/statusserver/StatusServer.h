@@ -148,6 +148,9 @@ private:
     void startSubscribeServerThread();
     void sendToSubscribeServerThread(OsMsg& eventMessage);
 
+    /// Called by the expire thread for each subscription it is about to remove.
+    void onSubscriptionExpired(Subscription& subscription);
+
 };
 
 /* ============================ INLINE METHODS ============================ */
@@ -124,6 +124,30 @@ SendTheNotify( SipMessage& notify,
             sipUserAgent->send( notifyRequest );
 }
 
+void
+Notifier::sendTerminatingNotify(Subscription& record)
+{
+    UtlString uri        = record.uri().c_str();
+    UtlString callid     = record.callId().c_str();
+    UtlString contact    = record.contact().c_str();
+    UtlString eventtype  = record.eventType().c_str();
+    UtlString id         = record.id().c_str();
+    UtlString to         = record.toUri().c_str();
+    UtlString from       = record.fromUri().c_str();
+    UtlString recordroute= record.recordRoute().c_str();
+    int notifycseq       = record.notifyCseq() + 1;
+
+    UtlString subscriptionState(SIP_SUBSCRIPTION_TERMINATED ";reason=timeout");
+
+    Os::Logger::instance().log( FAC_SIP, PRI_INFO, "Notifier::sendTerminatingNotify: "
+                  " '%s' subscription '%s' for '%s' expired",
+                  eventtype.data(), callid.data(), uri.data() );
+
+    SipMessage notify;
+    SendTheNotify(notify, mpSipUserAgent, uri, contact, to, from, callid, notifycseq,
+                  eventtype, id, subscriptionState, recordroute);
+}
+
 void
 Notifier::sendNotifyForeachSubscription (
     const char* key,
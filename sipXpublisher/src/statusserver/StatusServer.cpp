@@ -10,6 +10,7 @@
 // SYSTEM INCLUDES
 #include <assert.h>
 #include <stdlib.h>
+#include <boost/bind.hpp>
 
 // APPLICATION INCLUDES
 #include "os/OsFS.h"
@@ -128,6 +129,7 @@ StatusServer::StatusServer(
     //
     // Run the subscription garbage collector
     //
+    _expireThread.setExpireHandler(boost::bind(&StatusServer::onSubscriptionExpired, this, _1));
     _expireThread.run(mSubscribeDb);
 
     mIsCredentialDB = useCredentialDB;
@@ -689,6 +691,20 @@ StatusServer::sendToSubscribeServerThread(OsMsg& eventMessage)
     }
 }
 
+void
+StatusServer::onSubscriptionExpired(Subscription& subscription)
+{
+    // Called from the expire thread before the record is removed, so the
+    // stored contact, route and NOTIFY CSeq are still there to end the
+    // dialog with.
+    if (subscription.component() != SUBSCRIPTION_COMPONENT_STATUS)
+    {
+        return;
+    }
+
+    mNotifier->sendTerminatingNotify(subscription);
+}
+
 void
 StatusServer::parseList (
     const UtlString& keyPrefix,
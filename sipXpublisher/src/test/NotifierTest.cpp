@@ -0,0 +1,145 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+// APPLICATION INCLUDES
+#include "net/SipUserAgent.h"
+#include "net/SipMessage.h"
+#include "sipdb/Subscription.h"
+#include "statusserver/Notifier.h"
+
+// DEFINES
+#define UA_PORT 15070
+
+// CONSTANTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+// Keeps what the Notifier sends instead of putting it on the wire.
+class RecordingUserAgent : public SipUserAgent
+{
+public:
+   RecordingUserAgent() :
+      SipUserAgent(PORT_NONE, UA_PORT, PORT_NONE, "127.0.0.1", NULL, "127.0.0.1"),
+      mSent(0)
+   {
+   }
+
+   virtual UtlBoolean send(SipMessage& message,
+                           OsMsgQ* responseListener = NULL,
+                           void* responseListenerData = NULL)
+   {
+      mLastSent = message;
+      mSent++;
+      return TRUE;
+   }
+
+   SipMessage mLastSent;
+   int mSent;
+};
+
+class NotifierTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(NotifierTest);
+   CPPUNIT_TEST(testTerminatingNotify);
+   CPPUNIT_TEST(testTerminatingNotifyNoRoute);
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   Subscription expiredSubscription(const char* recordRoute)
+   {
+      return Subscription("status",
+                          "sip:111@example.com",
+                          "callid-expired",
+                          "sip:111@10.1.1.10:5060",
+                          1000,
+                          3,
+                          "message-summary",
+                          "message-summary",
+                          "",
+                          "<sip:111@example.com>;tag=totag",
+                          "<sip:111@example.com>;tag=fromtag",
+                          "sip:111@example.com",
+                          recordRoute,
+                          41,
+                          "application/simple-message-summary",
+                          0);
+   }
+
+   void testTerminatingNotify()
+   {
+      RecordingUserAgent userAgent;
+      Notifier notifier(&userAgent);
+
+      Subscription record = expiredSubscription("<sip:10.1.1.20;lr>");
+      notifier.sendTerminatingNotify(record);
+
+      CPPUNIT_ASSERT_EQUAL(1, userAgent.mSent);
+      const SipMessage& notify = userAgent.mLastSent;
+
+      UtlString method;
+      notify.getRequestMethod(&method);
+      ASSERT_STR_EQUAL(SIP_NOTIFY_METHOD, method.data());
+
+      ASSERT_STR_EQUAL("terminated;reason=timeout",
+                       notify.getHeaderValue(0, SIP_SUBSCRIPTION_STATE_FIELD));
+
+      int cseq;
+      UtlString cseqMethod;
+      CPPUNIT_ASSERT(notify.getCSeqField(&cseq, &cseqMethod));
+      CPPUNIT_ASSERT_EQUAL(42, cseq);
+
+      UtlString callId;
+      notify.getCallIdField(&callId);
+      ASSERT_STR_EQUAL("callid-expired", callId.data());
+
+      // The NOTIFY goes back along the dialog, so its From is the
+      // subscription's To.
+      UtlString from;
+      notify.getFromField(&from);
+      ASSERT_STR_EQUAL("<sip:111@example.com>;tag=totag", from.data());
+
+      UtlString requestUri;
+      notify.getRequestUri(&requestUri);
+      ASSERT_STR_EQUAL("sip:111@10.1.1.10:5060", requestUri.data());
+
+      UtlString route;
+      CPPUNIT_ASSERT(notify.getRouteField(&route));
+      ASSERT_STR_EQUAL("<sip:10.1.1.20;lr>", route.data());
+
+      userAgent.shutdown(TRUE);
+   }
+
+   void testTerminatingNotifyNoRoute()
+   {
+      RecordingUserAgent userAgent;
+      Notifier notifier(&userAgent);
+
+      Subscription record = expiredSubscription("");
+      notifier.sendTerminatingNotify(record);
+
+      CPPUNIT_ASSERT_EQUAL(1, userAgent.mSent);
+      const SipMessage& notify = userAgent.mLastSent;
+
+      UtlString requestUri;
+      notify.getRequestUri(&requestUri);
+      ASSERT_STR_EQUAL("sip:111@10.1.1.10:5060", requestUri.data());
+
+      UtlString route;
+      CPPUNIT_ASSERT(!notify.getRouteField(&route));
+
+      userAgent.shutdown(TRUE);
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(NotifierTest);
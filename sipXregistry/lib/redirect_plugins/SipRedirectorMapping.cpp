@@ -36,7 +36,7 @@ extern "C" RedirectPlugin* getRedirectPlugin(const UtlString& instanceName)
 // Constructor
 SipRedirectorMapping::SipRedirectorMapping(const UtlString& instanceName) :
    RedirectPlugin(instanceName),
-   mMappingRulesLoaded(OS_FAILED)
+   mMap(boost::bind(&SipRedirectorMapping::loadMappings, this, _1))
 {
    mLogName.append("[");
    mLogName.append(instanceName);
@@ -66,12 +66,27 @@ SipRedirectorMapping::initialize(OsConfigDb& configDb,
                  "%s::SipRedirectorMapping Loading mapping rules from '%s'",
                  mLogName.data(), mFileName.data());
 
-   mMappingRulesLoaded = mMap.loadMappings(mFileName,
-                                           mMediaServer,
-                                           mVoicemailServer,
-                                           localDomainHost);
+   mLocalDomainHost = localDomainHost;
 
-   return mMappingRulesLoaded ? OS_SUCCESS : OS_FAILED;
+   return mMap.setFileName(mFileName.data()) ? OS_SUCCESS : OS_FAILED;
+}
+
+MappingRulesUrlMapping*
+SipRedirectorMapping::loadMappings(const std::string& fileName)
+{
+   MappingRulesUrlMapping* map = new MappingRulesUrlMapping;
+   if (map->loadMappings(fileName.c_str(),
+                         mMediaServer,
+                         mVoicemailServer,
+                         mLocalDomainHost) != OS_SUCCESS)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                    "%s::loadMappings cannot load mapping rules from '%s'",
+                    mLogName.data(), fileName.c_str());
+      delete map;
+      map = NULL;
+   }
+   return map;
 }
 
 // Finalize
@@ -103,9 +118,10 @@ SipRedirectorMapping::lookUp(
    // permission must match
    UtlBoolean permissionFound = TRUE;
 
-   if (mMappingRulesLoaded == OS_SUCCESS)
+   ConfigSnapshot<MappingRulesUrlMapping>::Ptr map = mMap.get();
+   if (map)
    {
-      mMap.getContactList(
+      map->getContactList(
          requestUri,
          urlMappingRegistrations,
          urlMappingPermissions,
@@ -16,6 +16,7 @@
 // APPLICATION INCLUDES
 #include "registry/RedirectPlugin.h"
 #include "digitmaps/MappingRulesUrlMapping.h"
+#include "filereader/ConfigSnapshot.h"
 
 // DEFINES
 // MACROS
@@ -32,6 +33,9 @@
  *
  * Currently, we instantiate two objects within the class, one for
  * mappingrules.xml and one for fallbackrules.xml.
+ *
+ * The file is read again whenever it changes, on the FileWatcher thread;
+ * lookUp() uses the rules last read.
  */
 
 class SipRedirectorMapping : public RedirectPlugin
@@ -81,14 +85,14 @@ class SipRedirectorMapping : public RedirectPlugin
    UtlString mLogName;
 
    /**
-    * Set to OS_SUCCESS once the file of mapping rules is loaded into memory.
+    * Parse the mapping rules in fileName, or return NULL if they cannot be.
     */
-   OsStatus mMappingRulesLoaded;
+   MappingRulesUrlMapping* loadMappings(const std::string& fileName);
 
    /**
-    * The mapping rules parsed from the file.
+    * The mapping rules last parsed from the file, once it was loaded.
     */
-   MappingRulesUrlMapping mMap;
+   ConfigSnapshot<MappingRulesUrlMapping> mMap;
 
    /**
     * SIP URI to access the Media Server.
@@ -104,6 +108,11 @@ class SipRedirectorMapping : public RedirectPlugin
     * Full name of file containing the mapping rules.
     */
    UtlString mFileName;
+
+   /**
+    * The local domain host, to substitute for {localhost}.
+    */
+   UtlString mLocalDomainHost;
 };
 
 #endif // SIPREDIRECTORMAPPING_H
@@ -9,7 +9,7 @@
 #include "SipRedirectorRegDB.h"
 
 // SYSTEM INCLUDES
-
+#include <boost/bind.hpp>
 
 // APPLICATION INCLUDES
 #include <utl/UtlRegex.h>
@@ -33,6 +33,10 @@
 // TYPEDEFS
 // FORWARD DECLARATIONS
 
+// STATIC VARIABLE INITIALIZATIONS
+const UtlContainableType SipRedirectorPrivateStorageRegDB::TYPE =
+    "SipRedirectorPrivateStorageRegDB";
+
 // Static factory function.
 extern "C" RedirectPlugin* getRedirectPlugin(const UtlString& instanceName)
 {
@@ -41,7 +45,8 @@ extern "C" RedirectPlugin* getRedirectPlugin(const UtlString& instanceName)
 
 // Constructor
 SipRedirectorRegDB::SipRedirectorRegDB(const UtlString& instanceName) :
-   RedirectPlugin(instanceName)
+   RedirectPlugin(instanceName),
+   mpReader(NULL)
 {
    mLogName.append("[");
    mLogName.append(instanceName);
@@ -59,6 +64,20 @@ SipRedirectorRegDB::initialize(OsConfigDb& configDb,
                                int redirectorNo,
                                const UtlString& localDomainHost)
 {
+   int threads;
+   if (configDb.get("DB_READ_THREADS", threads) != OS_SUCCESS || threads < 0)
+   {
+      threads = AsyncReader::DEFAULT_THREADS;
+   }
+
+   if (threads > 0)
+   {
+      mpReader = new AsyncReader(mInstanceName.str(), threads);
+   }
+   Os::Logger::instance().log(FAC_SIP, PRI_INFO,
+                 "%s::initialize %d database reader threads",
+                 mLogName.data(), threads);
+
    return OS_SUCCESS;
 }
 
@@ -66,6 +85,53 @@ SipRedirectorRegDB::initialize(OsConfigDb& configDb,
 void
 SipRedirectorRegDB::finalize()
 {
+   // Waits for the reads in progress; their requests are resumed (or
+   // ignored, if they have been canceled) by the redirect server.
+   delete mpReader;
+   mpReader = NULL;
+}
+
+void SipRedirectorRegDB::read(ReadsPtr reads)
+{
+   SipRegistrar* registrar = SipRegistrar::getInstance(NULL);
+   RegDB* regDb = registrar->getRegDB();
+
+   switch (reads->kind)
+   {
+   case Reads::USER_INSTRUMENT:
+      regDb->getUnexpiredContactsUserInstrument(reads->identity, reads->instrument,
+                                                reads->expireTime, reads->registrations);
+      break;
+   case Reads::INSTRUMENT:
+      regDb->getUnexpiredContactsInstrument(reads->instrument, reads->expireTime,
+                                            reads->registrations);
+      break;
+   case Reads::USER:
+      regDb->getUnexpiredContactsUser(reads->identity, reads->expireTime,
+                                      reads->registrations);
+      break;
+   }
+
+   if (reads->readEntity)
+   {
+      EntityRecord entity;
+      reads->foundEntity = registrar->getEntityDB()->findByIdentity(reads->identity, entity);
+      if (reads->foundEntity)
+      {
+         reads->callForwardTime = entity.callForwardTime();
+      }
+   }
+}
+
+void SipRedirectorRegDB::readDone(ReadsPtr reads,
+                                  RequestSeqNo requestSeqNo,
+                                  int redirectorNo,
+                                  AsyncReader::Status status)
+{
+   // The redirect server only calls lookUp for the request again after
+   // it has taken the resume message, so the status is seen in full.
+   reads->status = status;
+   resumeRedirection(requestSeqNo, redirectorNo);
 }
 
 RedirectPlugin::LookUpStatus
@@ -105,12 +171,16 @@ SipRedirectorRegDB::lookUp(
                     temp.data());
    }
 
-   RegDB::Bindings registrations;
+   ReadsPtr reads(new Reads);
+   reads->expireTime = adjustedTime;
+   reads->readEntity = false;
+   reads->foundEntity = false;
+   reads->callForwardTime = 0;
+   reads->status = AsyncReader::READ_DONE;
 
    // Give the ~~in~ URIs separate processing.
    UtlString user;
    requestUriCopy.getUserId(user);
-   RegDB* regDb = SipRegistrar::getInstance(NULL)->getRegDB();
    if (user.index(URI_IN_PREFIX) == 0)
    {
       // This is a ~~in~ URI.
@@ -126,18 +196,15 @@ SipRedirectorRegDB::lookUp(
                   s - (sizeof (URI_IN_PREFIX) - 1));
          requestUriCopy.setUserId(u);
 
-         //regDB->
-         //   getUnexpiredContactsUserInstrument(requestUriCopy, instrumentp, timeNow, registrations);
-         UtlString identity;
-         requestUriCopy.getIdentity(identity);
-         regDb->getUnexpiredContactsUserInstrument(identity.str(), instrumentp, adjustedTime, registrations);
+         reads->kind = Reads::USER_INSTRUMENT;
+         reads->instrument = instrumentp;
       }
       else
       {
          // This is a ~~in~[instrument] URI.
-         const char* instrumentp = user.data() + sizeof (URI_IN_PREFIX) - 1;
-         regDb->getUnexpiredContactsInstrument(instrumentp, adjustedTime, registrations);
-      }         
+         reads->kind = Reads::INSTRUMENT;
+         reads->instrument = user.data() + sizeof (URI_IN_PREFIX) - 1;
+      }
    }
    else
    {
@@ -146,55 +213,84 @@ SipRedirectorRegDB::lookUp(
       // database.  The requestUri identity is matched against the
       // "identity" column of the database, which is the identity part of
       // the "uri" column which is stored in registration.xml.
-
-     
-      UtlString identity;
-     requestUriCopy.getIdentity(identity);
-     regDb->getUnexpiredContactsUser(identity.str(), adjustedTime, registrations);
-
+      reads->kind = Reads::USER;
    }
 
-   int numUnexpiredContacts = registrations.size();
-
-   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                 "%s::lookUp got %d unexpired contacts",
-                 mLogName.data(), numUnexpiredContacts);
+   UtlString identity;
+   requestUriCopy.getIdentity(identity);
+   reads->identity = identity.str();
 
    // Check for a per-user call forward timer.
    // Don't set timer if we're not going to forward to voicemail.
-   std::ostringstream userCfwdTimer;
-   bool foundUserCfwdTimer = false;
-
+   UtlString expiresParam;
    if (method.compareTo(SIP_INVITE_METHOD) == 0)
    {
       UtlString userforwardParam;
       requestUriCopy.getUrlParameter("sipx-userforward", userforwardParam);
-      
-      UtlString expiresParam;
+
       requestUriCopy.getUrlParameter("sipx-expires", expiresParam);
 
-      if ((!userforwardParam.isNull()) && (userforwardParam.compareTo("false", UtlString::ignoreCase) ) == 0)
-      {
-          // This is not a call scenerio controlled by this users "forward to voicemail" timer
-      }
-      else
+      // "false" is not a call scenerio controlled by this users "forward to voicemail" timer
+      reads->readEntity =
+         userforwardParam.isNull() || userforwardParam.compareTo("false", UtlString::ignoreCase) != 0;
+   }
+
+   if (mpReader)
+   {
+      if (!privateStorage)
       {
-          UtlString identity;
-          requestUriCopy.getIdentity(identity);
-          EntityRecord entity;
-
-          EntityDB* entityDb = SipRegistrar::getInstance(NULL)->getEntityDB();
-          foundUserCfwdTimer = entityDb->findByIdentity(identity.str(), entity);
-          if (foundUserCfwdTimer)
-            userCfwdTimer << entity.callForwardTime();
+         if (!mpReader->read(*SipRegistrar::getInstance(NULL)->getRegDB(),
+                             boost::bind(&SipRedirectorRegDB::read, reads),
+                             boost::bind(&SipRedirectorRegDB::readDone, reads,
+                                         requestSeqNo, redirectorNo, _1)))
+         {
+            errorDescriptor.setStatusLineData(SIP_SERVICE_UNAVAILABLE_CODE,
+                                              "Registry - Database Busy");
+            return RedirectPlugin::ERROR;
+         }
+         privateStorage = new SipRedirectorPrivateStorageRegDB(reads);
+         return RedirectPlugin::SEARCH_PENDING;
       }
-      
-      if (userCfwdTimer.str().empty() && !expiresParam.isNull())
+
+      // Resumed: use what the reader found.
+      reads = static_cast<SipRedirectorPrivateStorageRegDB*>(privateStorage)->mReads;
+      if (reads->status != AsyncReader::READ_DONE)
       {
-        userCfwdTimer << expiresParam.data();
-        foundUserCfwdTimer = true;
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                       "%s::lookUp database read %s for '%s'",
+                       mLogName.data(),
+                       reads->status == AsyncReader::READ_EXPIRED ? "expired" : "failed",
+                       requestString.data());
+         errorDescriptor.setStatusLineData(SIP_SERVICE_UNAVAILABLE_CODE,
+                                           reads->status == AsyncReader::READ_EXPIRED
+                                           ? "Registry - Database Timeout"
+                                           : "Registry - Mongo DB Exception");
+         return RedirectPlugin::ERROR;
       }
    }
+   else
+   {
+      read(reads);
+   }
+
+   const RegDB::Bindings& registrations = reads->registrations;
+   int numUnexpiredContacts = registrations.size();
+
+   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                 "%s::lookUp got %d unexpired contacts",
+                 mLogName.data(), numUnexpiredContacts);
+
+   std::ostringstream userCfwdTimer;
+   bool foundUserCfwdTimer = reads->foundEntity;
+   if (foundUserCfwdTimer)
+   {
+      userCfwdTimer << reads->callForwardTime;
+   }
+   else if (!expiresParam.isNull())
+   {
+      userCfwdTimer << expiresParam.data();
+      foundUserCfwdTimer = true;
+   }
 
    UtlString callGroupUser;
    bool hasCallGroupParam = requestUriCopy.getUrlParameter("callgroup", callGroupUser);
@@ -271,3 +367,18 @@ const UtlString& SipRedirectorRegDB::name( void ) const
 {
    return mLogName;
 }
+
+SipRedirectorPrivateStorageRegDB::SipRedirectorPrivateStorageRegDB(
+   SipRedirectorRegDB::ReadsPtr reads) :
+   mReads(reads)
+{
+}
+
+SipRedirectorPrivateStorageRegDB::~SipRedirectorPrivateStorageRegDB()
+{
+}
+
+UtlContainableType SipRedirectorPrivateStorageRegDB::getContainableType() const
+{
+   return SipRedirectorPrivateStorageRegDB::TYPE;
+}
@@ -11,10 +11,13 @@
 #define SIPREDIRECTORREGDB_H
 
 // SYSTEM INCLUDES
-//#include <...>
+#include <string>
+#include <boost/shared_ptr.hpp>
 
 // APPLICATION INCLUDES
 #include "registry/RedirectPlugin.h"
+#include "sipdb/AsyncReader.h"
+#include "sipdb/RegDB.h"
 
 // DEFINES
 // MACROS
@@ -28,6 +31,14 @@
 /**
  * SipRedirectorRegDB is singleton class whose object adds contacts that are
  * listed in the registration database.
+ *
+ * The registration and entity reads of a request are done by an AsyncReader
+ * with DB_READ_THREADS threads (AsyncReader::DEFAULT_THREADS if not set):
+ * lookUp() queues them and returns SEARCH_PENDING, and the request is
+ * resumed once they are done, so the redirect server goes on with other
+ * requests while the database answers.  A read that fails or is not done
+ * by the read-query-timeout-ms of the registrations collection is answered
+ * 503.  With DB_READ_THREADS set to 0 the reads are done in lookUp().
  */
 
 class SipRedirectorRegDB : public RedirectPlugin
@@ -57,11 +68,64 @@ class SipRedirectorRegDB : public RedirectPlugin
 
    virtual const UtlString& name( void ) const;
 
+   /// The database reads of one request and what they found.
+   struct Reads
+   {
+      enum Kind
+      {
+         USER,              ///< the bindings of identity
+         USER_INSTRUMENT,   ///< the bindings of identity with instrument
+         INSTRUMENT         ///< the bindings with instrument
+      };
+
+      Kind kind;
+      std::string identity;
+      std::string instrument;
+      unsigned long expireTime;   ///< bindings must expire after this
+      bool readEntity;            ///< read the call forward timer of identity
+
+      RegDB::Bindings registrations;
+      bool foundEntity;
+      int callForwardTime;
+      AsyncReader::Status status;
+   };
+
+   typedef boost::shared_ptr<Reads> ReadsPtr;
+
   protected:
 
+   /// Do the reads; runs on a reader thread unless DB_READ_THREADS is 0.
+   static void read(ReadsPtr reads);
+
+   /// Record the outcome of the reads and resume the request.
+   static void readDone(ReadsPtr reads,
+                        RequestSeqNo requestSeqNo,
+                        int redirectorNo,
+                        AsyncReader::Status status);
+
    // String to use in place of class name in log messages:
    // "[instance] class".
    UtlString mLogName;
+
+   // Reader of the registrations, or NULL to read in lookUp.
+   AsyncReader* mpReader;
+};
+
+/// Holds the reads of a suspended request until it is resumed.
+class SipRedirectorPrivateStorageRegDB : public SipRedirectorPrivateStorage
+{
+  public:
+
+   SipRedirectorPrivateStorageRegDB(SipRedirectorRegDB::ReadsPtr reads);
+
+   virtual ~SipRedirectorPrivateStorageRegDB();
+
+   virtual UtlContainableType getContainableType() const;
+
+   static const UtlContainableType TYPE;    /**< Class type used for runtime checking */
+
+   /// Shared with the reader, which may still hold it if the request was canceled.
+   SipRedirectorRegDB::ReadsPtr mReads;
 };
 
 #endif // SIPREDIRECTORREGDB_H
@@ -0,0 +1,168 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <exception>
+
+// APPLICATION INCLUDES
+
+#include "RegEventQueue.h"
+#include <os/OsLogger.h>
+#include <boost/bind.hpp>
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+
+// Constructor
+RegEventQueue::RegEventQueue(int coalesceMs, const Publish& publish) :
+   mCoalesceMs(coalesceMs),
+   mPublish(publish),
+   mStopping(false),
+   mpPublisher(NULL),
+   mpCoalesced(&UtlMetrics::instance().counter("sipx_regevent_coalesced_total",
+                                               "Reg event changes published together with a later change to the AOR"))
+{
+   if (mCoalesceMs > 0)
+   {
+      mpPublisher = new boost::thread(boost::bind(&RegEventQueue::run, this));
+   }
+}
+
+// Destructor
+RegEventQueue::~RegEventQueue()
+{
+   if (mpPublisher)
+   {
+      {
+         boost::lock_guard<boost::mutex> lock(mPendingMutex);
+         mStopping = true;
+      }
+      mPendingChanged.notify_all();
+      mpPublisher->join();
+      delete mpPublisher;
+   }
+}
+
+// Queue the changes to an AOR, or publish them if there is no window.
+void RegEventQueue::queue(const UtlString& aorString,
+                          const Url& aorUri,
+                          const UtlString& instrument,
+                          const RegDB::Bindings* bindings)
+{
+   if (!mpPublisher)
+   {
+      PendingContent pending;
+      pending.aorString = aorString;
+      pending.aorUri = aorUri;
+      if (!instrument.isNull())
+      {
+         pending.instruments.insert(instrument.str());
+      }
+      pending.haveBindings = bindings != NULL;
+      if (bindings)
+      {
+         pending.bindings = *bindings;
+      }
+      mPublish(pending);
+      return;
+   }
+
+   bool first;
+   {
+      boost::lock_guard<boost::mutex> lock(mPendingMutex);
+      first = mPending.empty();
+      if (first)
+      {
+         mFirstQueued = boost::get_system_time();
+      }
+
+      std::pair<PendingMap::iterator, bool> entry =
+         mPending.insert(PendingMap::value_type(aorString.str(), PendingContent()));
+      PendingContent& pending = entry.first->second;
+      if (entry.second)
+      {
+         pending.aorString = aorString;
+         pending.aorUri = aorUri;
+      }
+      else
+      {
+         mpCoalesced->add();
+      }
+      if (!instrument.isNull())
+      {
+         pending.instruments.insert(instrument.str());
+      }
+
+      // The latest change decides: bindings passed in supersede earlier
+      // ones, and a change without bindings means they must be read.
+      pending.haveBindings = bindings != NULL;
+      if (bindings)
+      {
+         pending.bindings = *bindings;
+      }
+      else
+      {
+         pending.bindings.clear();
+      }
+   }
+
+   if (first)
+   {
+      mPendingChanged.notify_one();
+   }
+}
+
+// Body of the thread that publishes the pending changes.
+void RegEventQueue::run()
+{
+   for (;;)
+   {
+      PendingMap pending;
+      {
+         boost::unique_lock<boost::mutex> lock(mPendingMutex);
+         while (mPending.empty() && !mStopping)
+         {
+            mPendingChanged.wait(lock);
+         }
+
+         // Let the window of the oldest change run out, collecting more.
+         boost::system_time flushAt = mFirstQueued + boost::posix_time::milliseconds(mCoalesceMs);
+         while (!mStopping && boost::get_system_time() < flushAt)
+         {
+            mPendingChanged.timed_wait(lock, flushAt);
+         }
+         if (mStopping)
+         {
+            return;
+         }
+         pending.swap(mPending);
+      }
+
+      for (PendingMap::const_iterator iter = pending.begin(); iter != pending.end(); iter++)
+      {
+         try
+         {
+            mPublish(iter->second);
+         }
+         catch (std::exception& e)
+         {
+            Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                          "RegEventQueue::run failed to publish '%s': %s",
+                          iter->second.aorString.data(), e.what());
+         }
+      }
+   }
+}
@@ -0,0 +1,130 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _RegEventQueue_h_
+#define _RegEventQueue_h_
+
+// SYSTEM INCLUDES
+// APPLICATION INCLUDES
+#include <utl/UtlString.h>
+#include <utl/UtlMetrics.h>
+#include <net/Url.h>
+#include <sipdb/RegDB.h>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <map>
+#include <set>
+#include <string>
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+
+/**
+ * The changes to the bindings of AORs that RegisterEventServer is to
+ * publish, collected per AOR for a coalescing window.
+ *
+ * A thread hands each AOR that changed to the publish function once the
+ * window of the oldest change has passed, with the latest bindings passed
+ * in for it and all the instruments its changes named.  With a window of
+ * 0 every change is published at once, on the thread that queues it.
+ */
+
+class RegEventQueue
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   //! The changes to one AOR that are waiting to be published.
+   struct PendingContent
+   {
+      UtlString aorString;
+      Url aorUri;
+      /// The instruments whose views are to be published as well.
+      std::set<std::string> instruments;
+      /// Whether bindings holds the bindings of the AOR, or they are to be read.
+      bool haveBindings;
+      RegDB::Bindings bindings;
+   };
+
+   //! Publishes the views of an AOR.
+   typedef boost::function<void (const PendingContent&)> Publish;
+
+   RegEventQueue(/** Time for which changes to an AOR are collected
+                  *  before they are published; 0 to publish at once. */
+                 int coalesceMs,
+                 /// Called for each AOR to publish.
+                 const Publish& publish);
+
+   //! Stop publishing; changes still pending are dropped.
+   ~RegEventQueue();
+
+   //! Queue the changes to an AOR, or publish them if there is no window.
+   void queue(/// AOR as a string
+              const UtlString& aorString,
+              /// AOR as a Uri
+              const Url& aorUri,
+              /// instrument tag value, or null
+              const UtlString& instrument,
+              /// All bindings of the AOR, or NULL if they are to be read
+              const RegDB::Bindings* bindings);
+
+   //! Coalescing window in milliseconds.
+   int getCoalesceMs() const;
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   //! Pending changes by AOR.
+   typedef std::map<std::string, PendingContent> PendingMap;
+
+   //! Body of the thread that publishes the pending changes.
+   void run();
+
+   //! Coalescing window in milliseconds.
+   int mCoalesceMs;
+   //! Called for each AOR to publish.
+   Publish mPublish;
+   //! Protects mPending and mStopping.
+   boost::mutex mPendingMutex;
+   //! Signals new pending changes and stopping.
+   boost::condition_variable mPendingChanged;
+   //! Changes not yet published.
+   PendingMap mPending;
+   //! When the oldest change in mPending was queued.
+   boost::system_time mFirstQueued;
+   //! Set when the publisher thread is to exit.
+   bool mStopping;
+   //! Publishes mPending; NULL if mCoalesceMs is 0.
+   boost::thread* mpPublisher;
+   //! sipx_regevent_coalesced_total
+   UtlMetricCounter* mpCoalesced;
+
+   //! Disabled copy constructor
+   RegEventQueue(const RegEventQueue& rRegEventQueue);
+
+   //! Disabled assignment operator
+   RegEventQueue& operator=(const RegEventQueue& rhs);
+
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+inline int RegEventQueue::getCoalesceMs() const
+{
+   return mCoalesceMs;
+}
+
+#endif  // _RegEventQueue_h_
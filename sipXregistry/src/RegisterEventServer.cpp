@@ -16,6 +16,7 @@
 #include "RegisterEventServer.h"
 #include <os/OsLogger.h>
 #include <utl/XmlContent.h>
+#include <xmlparser/XmlWriter.h>
 #include <sipdb/ResultSet.h>
 #include <net/SipRegEvent.h>
 #include <registry/SipRegistrar.h>
@@ -29,6 +30,9 @@
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
 // CONSTANTS
+// Typical rendered sizes, used to size the body buffer in generateContent()
+#define REGINFO_SIZE_ESTIMATE 512
+#define CONTACT_SIZE_ESTIMATE 512
 // STRUCTS
 // TYPEDEFS
 // FORWARD DECLARATIONS
@@ -174,7 +178,9 @@ RegisterEventServer::RegisterEventServer(const UtlString& domainName,
                                          int tcpPort,
                                          int udpPort,
                                          int tlsPort,
-                                         const UtlString& bindIp) :
+                                         const UtlString& bindIp,
+                                         int coalesceMs,
+                                         int notifyCoalesceMs) :
    mDomainName(domainName),
    mEventType(REG_EVENT_TYPE),
    mUserAgent(
@@ -201,7 +207,8 @@ RegisterEventServer::RegisterEventServer(const UtlString& domainName,
    mSubscriptionMgr(SUBSCRIPTION_COMPONENT_REG, mDomainName, *SipRegistrar::getInstance(NULL)->getSubscribeDB()),
    mSubscribeServer(SipSubscribeServer::terminationReasonSilent,
                     mUserAgent, mEventPublisher, mSubscriptionMgr,
-                    mPolicyHolder)
+                    mPolicyHolder),
+   mpQueue(NULL)
 {
    Os::Logger::instance().log(FAC_RLS, PRI_DEBUG,
                  "RegisterEventServer:: mDomainName = '%s', tcpPort = %d, udpPort = %d, tlsPort = %d",
@@ -227,6 +234,12 @@ RegisterEventServer::RegisterEventServer(const UtlString& domainName,
    mUserAgent.setUserAgentHeaderProperty("sipXecs/reg-event");
    mUserAgent.start();
 
+   // Hold the NOTIFYs of further changes to a resource for the window.
+   if (notifyCoalesceMs > 0)
+   {
+      mEventPublisher.setCoalescingWindow(notifyCoalesceMs);
+   }
+
    // Arrange to generate default content for reg events.
    mEventPublisher.publishDefault(mEventType.data(), mEventType.data(),
                                   new RegEventDefaultConstructor(this));
@@ -238,6 +251,12 @@ RegisterEventServer::RegisterEventServer(const UtlString& domainName,
    mSubscribeServer.enableEventType(mEventType, NULL, NULL, NULL,
          SipSubscribeServer::standardVersionCallback, TRUE);
    mSubscribeServer.start();
+
+   mpQueue = new RegEventQueue(coalesceMs,
+                               boost::bind(&RegisterEventServer::publishContent, this, _1));
+   Os::Logger::instance().log(FAC_RLS, PRI_INFO,
+                 "RegisterEventServer:: coalescing changes for %d ms, NOTIFYs for %d ms",
+                 coalesceMs, notifyCoalesceMs);
 }
 
 // Destructor
@@ -247,6 +266,14 @@ RegisterEventServer::~RegisterEventServer()
                  "RegisterEventServer::~ this = %p",
                  this);
 
+   // Stop publishing; changes still pending are dropped, as the
+   // subscriptions are about to be terminated.
+   delete mpQueue;
+
+   // Send the NOTIFYs the content publisher still holds while the
+   // subscribe server is there to send them.
+   mEventPublisher.setCoalescingWindow(0);
+
    // Stop the subscribe server.
    mSubscribeServer.requestShutdown();
 
@@ -268,42 +295,93 @@ void RegisterEventServer::generateAndPublishContent(const UtlString& aorString,
                  "RegisterEventServer::generateAndPublishContent aorString = '%s', instrument = '%s'",
                  aorString.data(), instrument.data());
 
+   mpQueue->queue(aorString, aorUri, instrument, NULL);
+}
+
+// Generate and publish content for reg events for an AOR/instrument from its bindings.
+void RegisterEventServer::generateAndPublishContent(const UtlString& aorString,
+                                                    const Url& aorUri,
+                                                    const UtlString& instrument,
+                                                    const RegDB::Bindings& bindings)
+{
+   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                 "RegisterEventServer::generateAndPublishContent aorString = '%s', instrument = '%s', %d bindings",
+                 aorString.data(), instrument.data(), (int) bindings.size());
+
+   mpQueue->queue(aorString, aorUri, instrument, &bindings);
+}
+
+// Publish the views of an AOR.
+void RegisterEventServer::publishContent(const RegEventQueue::PendingContent& pending)
+{
+   // Use an expiraton time of 0 to get all the registrations for the
+   // AOR, including the ones that have expired but not been purged.
+   RegDB::Bindings readBindings;
+   if (!pending.haveBindings)
+   {
+      UtlString identity;
+      pending.aorUri.getIdentity(identity);
+      SipRegistrar::getInstance(NULL)->getRegDB()->getUnexpiredContactsUser(identity.str(), 0, readBindings);
+   }
+   const RegDB::Bindings& bindings = pending.haveBindings ? pending.bindings : readBindings;
+
+   // Each <contact> is rendered once, for the AOR and all user/instrument views.
+   unsigned long now = OsDateTime::getSecsSinceEpoch();
+   ContactElements contacts;
+   renderContacts(bindings, now, contacts);
+
    HttpBody* body;
 
    // Publish content for the AOR.
-   generateContentUser(aorString.data(), aorString, aorUri, body);
-   mEventPublisher.publish(aorString, mEventType.data(), mEventType.data(),
+   generateContent(pending.aorString.data(), bindings, contacts, now, body);
+   mEventPublisher.publish(pending.aorString, mEventType.data(), mEventType.data(),
                            1, &body,
                            TRUE, FALSE);
 
-   if (!instrument.isNull())
+   UtlString user;
+   pending.aorUri.getUserId(user);
+   for (std::set<std::string>::const_iterator instrument = pending.instruments.begin();
+        instrument != pending.instruments.end();
+        instrument++)
    {
       // Publish content for ~~in~[instrument]@[domain].
+      // The instrument may be registered under other AORs too, so
+      // its bindings have to be read.
 
       UtlString instrumentEntity;
       instrumentEntity.append("sip:" URI_IN_PREFIX);
-      instrumentEntity.append(instrument);
+      instrumentEntity.append(instrument->c_str());
       instrumentEntity.append("@");
       instrumentEntity.append(*getDomainName());
 
-      generateContentInstrument(instrumentEntity.data(), instrument, body);
+      generateContentInstrument(instrumentEntity.data(), instrument->c_str(), body);
       mEventPublisher.publish(instrumentEntity, mEventType.data(), mEventType.data(),
                               1, &body,
                               TRUE, FALSE);
-      
-      // Publish content for ~~in~[user]&[instrument]@[domain].
+
+      // Publish content for ~~in~[user]&[instrument]@[domain],
+      // the bindings of the AOR with the instrument.
 
       UtlString userInstrumentEntity;
       userInstrumentEntity.append("sip:" URI_IN_PREFIX);
-      UtlString user;
-      aorUri.getUserId(user);
       userInstrumentEntity.append(user);
       userInstrumentEntity.append("&");
-      userInstrumentEntity.append(instrument);
+      userInstrumentEntity.append(instrument->c_str());
       userInstrumentEntity.append("@");
       userInstrumentEntity.append(*getDomainName());
 
-      generateContentUserInstrument(aorString.data(), aorString, aorUri, instrument, body);
+      RegDB::Bindings instrumentBindings;
+      ContactElements instrumentContacts;
+      for (size_t i = 0; i < bindings.size(); i++)
+      {
+         if (bindings[i].getInstrument() == *instrument)
+         {
+            instrumentBindings.push_back(bindings[i]);
+            instrumentContacts.push_back(contacts[i]);
+         }
+      }
+
+      generateContent(pending.aorString.data(), instrumentBindings, instrumentContacts, now, body);
       mEventPublisher.publish(userInstrumentEntity, mEventType.data(), mEventType.data(),
                               1, &body,
                               TRUE, FALSE);
@@ -377,61 +455,35 @@ void RegisterEventServer::generateContent(const char* entityString,
                                           HttpBody*& body)
 {
    unsigned long now = OsDateTime::getSecsSinceEpoch();
+   ContactElements contacts;
+   renderContacts(bindings, now, contacts);
+   generateContent(entityString, bindings, contacts, now, body);
+}
 
-   // Construct the body, an empty notice for the user.
-   UtlString content;
-   content.append("<?xml version=\"1.0\"?>\r\n"
-                  "<reginfo xmlns=\"urn:ietf:params:xml:ns:reginfo\" "
-                  "xmlns:gr=\"urn:ietf:params:xml:ns:gruuinfo\" "
-                  "xmlns:in=\"http://www.sipfoundry.org/sipX/schema/xml/reg-instrument-00-00\" "
-                  "version=\"" VERSION_PLACEHOLDER "\" "
-                  "state=\"full\">\r\n");
-   content.append("  <registration aor=\"");
-   XmlEscape(content, entityString);
-   content.append("\" id=\"");
-   XmlEscape(content, entityString);
-   // If there are no unexpired contacts, the state is "init", otherwise
-   // "active".
-   UtlBoolean found = FALSE;
-   for (RegDB::Bindings::const_iterator iter = bindings.begin(); iter != bindings.end(); iter++)
-   {
-      if (iter->getExpirationTime()  >= now)
-      {
-         found = TRUE;
-         break;
-      }
-   }
-
-   content.append("\" state=\"");
-   content.append(found ? "active" : "init");
-   content.append("\">\r\n");
+// Render the <contact> elements of bindings, less the entity that starts their id.
+void RegisterEventServer::renderContacts(const RegDB::Bindings& bindings,
+                                         unsigned long now,
+                                         ContactElements& contacts)
+{
+   contacts.clear();
+   contacts.resize(bindings.size());
 
    // Iterate through the result set, generating <contact> elements
    // for each contact.
-   for (RegDB::Bindings::const_iterator iter = bindings.begin(); iter != bindings.end(); iter++)
+   for (size_t i = 0; i < bindings.size(); i++)
    {
-      //assert(rowp);
-      //UtlString* callid =  dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gCallidKey));
-      //UtlString* contact_string = dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gContactKey));
-      //
-      //UtlString* q = dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gQvalueKey));
-      //int cseq = (dynamic_cast <UtlInt*>(rowp->findValue(&RegistrationDB::gCseqKey)))->getValue();
-      //unsigned long expired = (dynamic_cast <UtlInt*> (rowp->findValue(&RegistrationDB::gExpiresKey)))->getValue();
-      //UtlString* pathVector = dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gPathKey));
-      //UtlString* gruu = dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gGruuKey));
-      //UtlString* instanceId = dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gInstanceIdKey));
-      //UtlString* instrument = dynamic_cast <UtlString*> (rowp->findValue(&RegistrationDB::gInstrumentKey));
+      const RegBinding* iter = &bindings[i];
+      UtlString& content = contacts[i];
+      content.capacity(CONTACT_SIZE_ESTIMATE);
+      XmlWriter<UtlString> writer(content);
 
-
-
-      content.append("    <contact id=\"");
       // We key the registrations table on identity and contact URI, so
       // for the id of the <content> element, we use the concatenation of
       // AOR and contact.  We could hash these together and take 64 bits
       // if we wanted the id's to be smaller and opaque.
-      XmlEscape(content, entityString);
+      // The id is completed by generateContent(), which prepends the AOR.
       content.append("@@");
-      XmlEscape(content, iter->getContact().c_str());
+      writer.text(iter->getContact().data(), iter->getContact().size());
       // If the contact has expired, it should be terminated/expired.
       // If it has not, it should be active/registered.
       content.append(iter->getExpirationTime() < now ?
@@ -439,14 +491,14 @@ void RegisterEventServer::generateContent(const char* entityString,
                      "\" state=\"active\" event=\"registered\" q=\"");
       if (!iter->getQvalue().empty())
       {
-         XmlEscape(content, iter->getQvalue().c_str());
+         writer.text(iter->getQvalue().data(), iter->getQvalue().size());
       }
       else
       {
          content.append("1");
       }
       content.append("\" callid=\"");
-      XmlEscape(content, iter->getCallId().c_str());
+      writer.text(iter->getCallId().data(), iter->getCallId().size());
       content.append("\" cseq=\"");
       content.appendNumber((int)iter->getCseq());
       content.append("\">\r\n");
@@ -455,7 +507,7 @@ void RegisterEventServer::generateContent(const char* entityString,
       UtlString contact_addrspec;
       contact_nameaddr.getUri(contact_addrspec);
       content.append("      <uri>");
-      XmlEscape(content, contact_addrspec);
+      writer.text(contact_addrspec.data(), contact_addrspec.length());
       content.append("</uri>\r\n");
 
       UtlString display_name;
@@ -463,7 +515,7 @@ void RegisterEventServer::generateContent(const char* entityString,
       if (!display_name.isNull())
       {
          content.append("      <display-name>");
-         XmlEscape(content, display_name);
+         writer.text(display_name.data(), display_name.length());
          content.append("</display-name>\r\n");
       }
 
@@ -472,13 +524,13 @@ void RegisterEventServer::generateContent(const char* entityString,
       if (!iter->getPath().empty())
       {
          content.append("      <unknown-param name=\"path\">");
-         XmlEscape(content, iter->getPath().c_str());
+         writer.text(iter->getPath().data(), iter->getPath().size());
          content.append("</unknown-param>\r\n");
       }
       if (!iter->getInstanceId().empty())
       {
          content.append("      <unknown-param name=\"+sip.instance\">");
-         XmlEscape(content, iter->getInstanceId().c_str());
+         writer.text(iter->getInstanceId().data(), iter->getInstanceId().size());
          content.append("</unknown-param>\r\n");
       }
       if (!iter->getGruu().empty())
@@ -489,24 +541,79 @@ void RegisterEventServer::generateContent(const char* entityString,
          // of the registration DB would contain the full GRUU URI already.
          UtlString tmp("sip:");
          tmp.append(iter->getGruu().c_str());
-         XmlEscape(content, tmp);
+         writer.text(tmp.data(), tmp.length());
          content.append("\"/>\r\n");
       }
 
       if(!iter->getInstrument().empty())
       {
          content.append("      <in:instrument>");
-         XmlEscape(content, iter->getInstrument().c_str());
+         writer.text(iter->getInstrument().data(), iter->getInstrument().size());
          content.append("</in:instrument>\r\n");
       }
 
       content.append("    </contact>\r\n");
    }
+}
+
+// Generate (but not publish) content for reg events from rendered <contact> elements.
+void RegisterEventServer::generateContent(const char* entityString,
+                                          const RegDB::Bindings& bindings,
+                                          const ContactElements& contacts,
+                                          unsigned long now,
+                                          HttpBody*& body)
+{
+   // The entity is escaped once and put at the start of every contact id.
+   UtlString entity;
+   XmlWriter<UtlString> entityWriter(entity);
+   entityWriter.text(entityString);
+
+   size_t size = REGINFO_SIZE_ESTIMATE;
+   for (ContactElements::const_iterator iter = contacts.begin(); iter != contacts.end(); iter++)
+   {
+      size += entity.length() + iter->length() + sizeof("    <contact id=\"");
+   }
+
+   // Construct the body, an empty notice for the user.
+   UtlString content;
+   content.capacity(size);
+   content.append("<?xml version=\"1.0\"?>\r\n"
+                  "<reginfo xmlns=\"urn:ietf:params:xml:ns:reginfo\" "
+                  "xmlns:gr=\"urn:ietf:params:xml:ns:gruuinfo\" "
+                  "xmlns:in=\"http://www.sipfoundry.org/sipX/schema/xml/reg-instrument-00-00\" "
+                  "version=\"" VERSION_PLACEHOLDER "\" "
+                  "state=\"full\">\r\n");
+   content.append("  <registration aor=\"");
+   content.append(entity);
+   content.append("\" id=\"");
+   content.append(entity);
+   // If there are no unexpired contacts, the state is "init", otherwise
+   // "active".
+   UtlBoolean found = FALSE;
+   for (RegDB::Bindings::const_iterator iter = bindings.begin(); iter != bindings.end(); iter++)
+   {
+      if (iter->getExpirationTime()  >= now)
+      {
+         found = TRUE;
+         break;
+      }
+   }
+
+   content.append("\" state=\"");
+   content.append(found ? "active" : "init");
+   content.append("\">\r\n");
+
+   for (ContactElements::const_iterator iter = contacts.begin(); iter != contacts.end(); iter++)
+   {
+      content.append("    <contact id=\"");
+      content.append(entity);
+      content.append(*iter);
+   }
 
    content.append("  </registration>\r\n");
    content.append("</reginfo>\r\n");
 
    // Build an HttpBody -- returned in 'body'.
-   body = new HttpBody(content, strlen(content),
+   body = new HttpBody(content, content.length(),
                        REG_EVENT_CONTENT_TYPE);
 }
@@ -15,6 +15,7 @@
 #include <utl/UtlContainableAtomic.h>
 #include <utl/UtlString.h>
 #include <utl/UtlSList.h>
+#include <utl/UtlMetrics.h>
 #include <net/SipPublishContentMgr.h>
 #include <net/SipSubscribeClient.h>
 #include <net/SipSubscribeServer.h>
@@ -25,6 +26,8 @@
 #include <persist/SipPersistentSubscriptionMgr.h>
 #include <os/OsBSem.h>
 #include <sipdb/RegDB.h>
+#include "RegEventQueue.h"
+#include <vector>
 
 // DEFINES
 // MACROS
@@ -39,6 +42,15 @@
 /**
  * A RegisterEventServer contains the machinery for servicing
  * subscriptions to registration events, as described in RFC 3680.
+ *
+ * Changes to the bindings of an AOR are not published at once but
+ * collected for up to the coalescing window, so an AOR whose bindings
+ * change several times within the window (a phone registering each of its
+ * contacts, or a mass re-registration after an outage) is published once,
+ * from the latest bindings.  The registrar passes in the bindings it read
+ * back after its write, and the AOR and user/instrument views are both
+ * derived from them; each <contact> element is rendered once and shared
+ * by the views.
  */
 
 class RegisterEventServer
@@ -46,6 +58,11 @@ class RegisterEventServer
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
   public:
 
+   enum
+   {
+      DEFAULT_COALESCE_MS = 100 ///< default coalescing window
+   };
+
    //! Construct a resource list.
    RegisterEventServer(/** The host-part of the canonical form of the resource list
                         *  URIs, which is the sipX domain. */
@@ -57,13 +74,22 @@ class RegisterEventServer
                        /// The TLS port to listen on.
                        int tlsPort,
                        // Local IP address to bind on
-                       const UtlString& bindIp);
+                       const UtlString& bindIp,
+                       /** Time for which changes to an AOR are collected
+                        *  before they are published; 0 to publish at once. */
+                       int coalesceMs = DEFAULT_COALESCE_MS,
+                       /** Coalescing window of the content publisher, for
+                        *  which the NOTIFYs of changes to a resource are
+                        *  held (see SipPublishContentMgr::setCoalescingWindow);
+                        *  0 to notify at once. */
+                       int notifyCoalesceMs = 0);
 
    virtual ~RegisterEventServer();
 
    //! Generate and publish content for reg events for an AOR/instrument.
    //  Note that content will be published under the AOR, and if
    //  instrument is non-empty, under the appropriate ~~in~ URIs.
+   //  The bindings of the AOR are read from the registration DB.
    void generateAndPublishContent(/// AOR as a string
                                   const UtlString& aorString,
                                   /// AOR as a Uri
@@ -71,6 +97,18 @@ class RegisterEventServer
                                   /// instrument tag value
                                   const UtlString& instrument);
 
+   //! Generate and publish content for reg events for an AOR/instrument
+   //  from the bindings of the AOR as the registrar has just written them.
+   void generateAndPublishContent(/// AOR as a string
+                                  const UtlString& aorString,
+                                  /// AOR as a Uri
+                                  const Url& aorUri,
+                                  /// instrument tag value
+                                  const UtlString& instrument,
+                                  /// All bindings of the AOR, including
+                                  /// the ones just expired
+                                  const RegDB::Bindings& bindings);
+
    //! Generate (but not publish) content for reg events for an AOR.
    void generateContentUser(/// The entity URI string to incorporate into the body.
                             const char* entity,
@@ -109,6 +147,29 @@ class RegisterEventServer
                         /// Returned pointer to HttpBody to publish.
                         HttpBody*& body);
 
+   //! The <contact> elements of bindings, each less the entity that starts its id.
+   typedef std::vector<UtlString> ContactElements;
+
+   //! Render the <contact> elements of bindings, for generateContent().
+   static void renderContacts(/// The registrations to render
+                              const RegDB::Bindings& bindings,
+                              /// The current time, which tells expired bindings
+                              unsigned long now,
+                              /// Returned elements, one for each binding
+                              ContactElements& contacts);
+
+   //! Generate content from bindings whose <contact> elements are already rendered.
+   static void generateContent(/// The entity URI string to incorporate into the body.
+                               const char* entityString,
+                               /// The registrations to show
+                               const RegDB::Bindings& bindings,
+                               /// The elements renderContacts() made of bindings
+                               const ContactElements& contacts,
+                               /// The time passed to renderContacts()
+                               unsigned long now,
+                               /// Returned pointer to HttpBody to publish.
+                               HttpBody*& body);
+
    //! Get the SIP domain name for the resources.
    const UtlString* getDomainName();
 
@@ -118,6 +179,9 @@ class RegisterEventServer
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
   private:
 
+   //! Publish the views of an AOR.
+   void publishContent(const RegEventQueue::PendingContent& pending);
+
    //! SIP domain name.
    UtlString mDomainName;
    //! The local host-part.
@@ -146,6 +210,9 @@ class RegisterEventServer
    //! The SIP Subscribe Server.
    SipSubscribeServer mSubscribeServer;
 
+   //! Changes to be published; created once the subscribe server is running.
+   RegEventQueue* mpQueue;
+
    //! Disabled copy constructor
    RegisterEventServer(const RegisterEventServer& rRegisterEventServer);
 
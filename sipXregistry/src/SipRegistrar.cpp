@@ -618,11 +618,30 @@ SipRegistrar::startEventServer()
       port = REGISTRAR_DEFAULT_REG_EVENT_PORT;
    }
 
+   // Changes to an AOR within this many milliseconds are published together.
+   int coalesceMs;
+   if (mConfigDb->get("SIP_REGISTRAR_REG_EVENT_COALESCE_MS", coalesceMs) != OS_SUCCESS
+       || coalesceMs < 0)
+   {
+      coalesceMs = RegisterEventServer::DEFAULT_COALESCE_MS;
+   }
+
+   // NOTIFYs of changes to a resource within this many milliseconds are
+   // sent as one; off by default, as the changes are already coalesced above.
+   int notifyCoalesceMs;
+   if (mConfigDb->get("SIP_REGISTRAR_REG_EVENT_NOTIFY_COALESCE_MS", notifyCoalesceMs) != OS_SUCCESS
+       || notifyCoalesceMs < 0)
+   {
+      notifyCoalesceMs = 0;
+   }
+
    mRegisterEventServer = new RegisterEventServer(defaultDomain(),
                                                   port,
                                                   port,
                                                   PORT_NONE,
-                                                  mBindIp);
+                                                  mBindIp,
+                                                  coalesceMs,
+                                                  notifyCoalesceMs);
 }
 
 void
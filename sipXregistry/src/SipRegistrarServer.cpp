@@ -95,7 +95,9 @@ SipRegistrarServer::SipRegistrarServer(SipRegistrar& registrar) :
     mSipUserAgent(NULL),
     mSendExpiresInResponse(TRUE),
     mSendAllContactsInResponse(FALSE),
-    mNonceExpiration(5*60)
+    mNonceExpiration(5*60),
+    mAuthTime(UtlMetrics::instance().histogram("sipx_registrar_auth_seconds",
+                                               "Time taken to check the credentials of a REGISTER"))
 {
 }
 
@@ -205,6 +207,11 @@ SipRegistrarServer::initialize(
     UtlString authenticateScheme;
     pOsConfigDb->get("SIP_REGISTRAR_AUTHENTICATE_SCHEME", authenticateScheme);
     mUseCredentialDB = (authenticateScheme.compareTo("NONE" , UtlString::ignoreCase) != 0);
+    if (mUseCredentialDB)
+    {
+       // forget cached credentials as soon as the users they are for change
+       mCredentialCache.watch(MongoDB::ConnectionInfo::globalInfo());
+    }
 
 
     UtlString hostAliases;
@@ -292,9 +299,22 @@ SipRegistrarServer::initialize(
       SipRegistrar::getInstance(NULL)->getRegDB()->setExpireGracePeriod(gracePeriod * 60);
     }
 
+    _expireThread.setExpireHandler(boost::bind(&SipRegistrarServer::onBindingExpired, this, _1));
     _expireThread.run(SipRegistrar::getInstance(NULL)->getRegDB());
 }
 
+void SipRegistrarServer::onBindingExpired(const ExpireSchedule::Entry& entry)
+{
+    RegisterEventServer* s = mRegistrar.getRegisterEventServer();
+    if (s && !entry.uri.empty())
+    {
+       Url toUrl(entry.uri.c_str());
+       UtlString aorString;
+       toUrl.getUri(aorString);
+       s->generateAndPublishContent(aorString, toUrl, entry.instrument.c_str());
+    }
+}
+
 
 
 
@@ -746,21 +766,10 @@ SipRegistrarServer::applyRegisterToDirectory( const Url& toUrl
                 }
 
                 // Only if this was a good registration:
-                // update reg event content, persist the xml, and do registration hooks
+                // do registration hooks; handleRegister updates the reg event
+                // content once it has read back the bindings
                 if ( REGISTER_SUCCESS == returnStatus )
                 {
-                    // Now that we have revised the bindings for
-                    // toUrl, update the reg event content for it.
-                    RegisterEventServer* s = mRegistrar.getRegisterEventServer();
-                    if (s)
-                    {
-                       // Use getUri to extract the AOR as a string, because
-                       // registerToStr is only the identity part.
-                       UtlString aorString;
-                       toUrl.getUri(aorString);
-                       s->generateAndPublishContent(aorString, toUrl, instrument);
-                    }
-
                     // give each RegisterPlugin a chance to do its thing
                     PluginIterator plugins(*mpSipRegisterPlugins);
                     RegisterPlugin* plugin;
@@ -842,6 +851,62 @@ void SipRegistrarServer::mergeNewBindings(const RegDB::Bindings& unexpiredRegs,
   }
 }
 
+void SipRegistrarServer::regEventBindings(const SipMessage& registerMessage,
+                                          const RegDB::Bindings& unexpiredRegs,
+                                          const std::vector<RegBinding::Ptr>& newBindings,
+                                          RegDB::Bindings& result)
+{
+  UtlString callId;
+  registerMessage.getCallIdField(&callId);
+  int cseq = 0;
+  registerMessage.getCSeqField(&cseq, NULL);
+  UtlString firstContact;
+  bool removeAll = registerMessage.getContactEntry(0, &firstContact) && firstContact.compareTo("*") == 0;
+
+  result.clear();
+  for (RegDB::Bindings::const_iterator regIter = unexpiredRegs.begin(); regIter != unexpiredRegs.end(); regIter++)
+  {
+    const RegBinding& binding = *regIter;
+
+    if (removeAll)
+    {
+      // Contact: * expired every binding
+      result.push_back(binding);
+      result.back().setExpirationTime(0);
+      continue;
+    }
+
+    // expireOldBindings removed the bindings of earlier requests of this
+    // session that the message does not carry on
+    if (binding.getCallId() == callId.str() && binding.getCseq() < (unsigned int) cseq)
+    {
+      continue;
+    }
+
+    // the bindings of this message are added below, as written
+    bool found = false;
+    for (std::vector<RegBinding::Ptr>::const_iterator iter = newBindings.begin(); iter != newBindings.end(); iter++)
+    {
+      if ((*iter)->getContact() == binding.getContact() && (*iter)->getCallId() == binding.getCallId())
+      {
+        found = true;
+        break;
+      }
+    }
+    if (found)
+    {
+      continue;
+    }
+
+    result.push_back(binding);
+  }
+
+  for (std::vector<RegBinding::Ptr>::const_iterator iter = newBindings.begin(); iter != newBindings.end(); iter++)
+  {
+    result.push_back(*(iter->get()));
+  }
+}
+
 void SipRegistrarServer::handleRegister(SipMessage* pMsg)
 {
   const SipMessage& message = *pMsg;
@@ -952,6 +1017,22 @@ void SipRegistrarServer::handleRegister(SipMessage* pMsg)
                   else
                     validateUnregisteredBindings(message, unexpiredRegs, registrations);
                            
+                  // Now that we have revised the bindings for
+                  // toUri, update the reg event content for it from
+                  // the bindings just read rather than reading them again.
+                  RegisterEventServer* regEventServer = mRegistrar.getRegisterEventServer();
+                  if (regEventServer && applyStatus == REGISTER_SUCCESS)
+                  {
+                     RegDB::Bindings regEventRegs;
+                     regEventBindings(message, unexpiredRegs, newBindings, regEventRegs);
+
+                     // Use getUri to extract the AOR as a string, because
+                     // identity_ is only the identity part.
+                     UtlString aorString;
+                     toUri.getUri(aorString);
+                     regEventServer->generateAndPublishContent(aorString, toUri, instrument, regEventRegs);
+                  }
+
                   if (!isUnregister && applyStatus == REGISTER_SUCCESS && registrations.empty())
                   {
                     //
@@ -1374,6 +1455,8 @@ SipRegistrarServer::isAuthorized(const Url& toUri,
     }
     else
     {
+        UtlMetricTimer authTimer(mAuthTime);
+
         // Realm and auth type should be default for server.
         // check if we requested authentication and this is the req with
         // authorization,validate the authorization
@@ -1456,44 +1539,56 @@ SipRegistrarServer::isAuthorized(const Url& toUri,
                 UtlString reqUri;
                 message.getRequestUri(&reqUri);
                 UtlString authTypeDB;
-                UtlString passTokenDB;
-                Url discardUriFromDB;
+                UtlString userPasswordDigest;
 
                 // then get the credentials for this user & realm
 
-                if (SipRegistrar::getInstance(NULL)->getEntityDB()->getCredential( toUri
+                if (mCredentialCache.getCredential(*SipRegistrar::getInstance(NULL)->getEntityDB()
+                                   ,toUri
+                                   ,requestUser
                                    ,requestRealm
                                    ,requestUserBase
-                                   ,passTokenDB
+                                   ,userPasswordDigest
                                    ,authTypeDB
                                    ))
                 {
                   // only DIGEST is used, so the authTypeDB above is ignored
-                  if ((isAuthorized = message.verifyMd5Authorization(requestUser.data(),
-                                                                     passTokenDB.data(),
+                  if ((isAuthorized = message.verifyMd5Authorization(userPasswordDigest.data(),
                                                                      requestNonce,
-                                                                     requestRealm.data(),
                                                                      requestCnonce.data(),
                                                                      requestNonceCount.data(),
                                                                      requestQop.data(),
-                                                                     uriParam)
+                                                                     uriParam,
+                                                                     HttpMessage::SERVER)
                        ))
                     {
-                      Os::Logger::instance().log(FAC_AUTH, PRI_DEBUG,
-                                    "SipRegistrarServer::isAuthorized "
-                                    "response auth hash matches");
+                      // the credentials are good, but only once for each nonce-count
+                      if (mNonceDb.recordNonceCount(requestNonce, requestNonceCount,
+                                                    message.getHeaderValue(0, SIP_CSEQ_FIELD)))
+                      {
+                         Os::Logger::instance().log(FAC_AUTH, PRI_DEBUG,
+                                       "SipRegistrarServer::isAuthorized "
+                                       "response auth hash matches");
+                      }
+                      else
+                      {
+                         isAuthorized = FALSE;
+                         Os::Logger::instance().log(FAC_AUTH, PRI_WARNING,
+                                       "SipRegistrarServer::isAuthorized "
+                                       "replayed nonce-count '%s' for '%s', callId='%s'",
+                                       requestNonceCount.data(), identity.data(), callId.data());
+                      }
                     }
                   else
                     {
                       Os::Logger::instance().log(FAC_AUTH, PRI_ERR,
                                     "Response auth hash does not match (bad password?)"
                                     " toUri='%s' requestUser='%s' requestNonce='%s' uriParam='%s'"
-                                    " passTokenDB='%s' authTypeDB='%s'",
+                                    " authTypeDB='%s'",
                                     toUri.toString().data(),
                                     requestUser.data(),
                                     requestNonce.data(),
                                     uriParam.data(),
-                                    passTokenDB.data(),
                                     authTypeDB.data());
                     }
                 }
@@ -20,6 +20,8 @@
 #include "sipXecsService/SipNonceDb.h"
 #include "utl/PluginHooks.h"
 #include "sipdb/RegExpireThread.h"
+#include "sipdb/DigestCredentialCache.h"
+#include "utl/UtlMetrics.h"
 // DEFINES
 // MACROS
 // EXTERNAL FUNCTIONS
@@ -73,6 +75,8 @@ public:
     };
 
 protected:
+    friend class RegEventBindingsTest;
+
     struct RegistrationExpiryIntervals
     {
        int mMinExpiresTime;   // Minimum registration expiry value in seconds
@@ -92,6 +96,8 @@ protected:
 
     SipNonceDb mNonceDb;
     long mNonceExpiration;
+    DigestCredentialCache mCredentialCache; ///< H(A1) of the users that register
+    UtlMetricHistogram& mAuthTime;          ///< sipx_registrar_auth_seconds
 
     PluginHooks* mpSipRegisterPlugins;
 
@@ -127,6 +133,16 @@ protected:
       const RegDB::Bindings& unexpiredBindings, 
       RegDB::Bindings& mergedResult);
 
+    /// The bindings of the AOR as registerMessage left them, for the reg event server
+    static void regEventBindings(
+      const SipMessage& registerMessage,
+      const RegDB::Bindings& unexpiredRegs,  ///< as read after the write, maybe from a lagging secondary
+      const std::vector<RegBinding::Ptr>& newBindings,
+      RegDB::Bindings& result);
+
+    /// Republish the reg event content of a binding removed by the expire thread
+    void onBindingExpired(const ExpireSchedule::Entry& entry);
+
     // Process a single REGISTER request
     UtlBoolean handleMessage( OsMsg& eventMessage );
 
@@ -0,0 +1,168 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+#include <string>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include "net/SipMessage.h"
+#include "sipdb/RegBinding.h"
+#include "sipdb/RegDB.h"
+#include "SipRegistrarServer.h"
+
+using namespace std;
+
+// DEFINES
+// CONSTANTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/**
+ * Unit tests for SipRegistrarServer::regEventBindings, which works out the
+ * bindings a REGISTER left an AOR with from a read that may lag its write.
+ */
+class RegEventBindingsTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(RegEventBindingsTest);
+   CPPUNIT_TEST(testRemoveAll);
+   CPPUNIT_TEST(testEarlierCseqOfSession);
+   CPPUNIT_TEST(testReplacedByContactAndCallId);
+   CPPUNIT_TEST(testUnregister);
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   // A REGISTER of sip:user@example.com with one Contact.
+   SipMessage* registerMessage(const char* callId, int cseq, const char* contact)
+   {
+      UtlString message(
+         "REGISTER sip:example.com SIP/2.0\r\n"
+         "Via: SIP/2.0/UDP 10.0.0.1:5060;branch=z9hG4bK-reg\r\n"
+         "To: <sip:user@example.com>\r\n"
+         "From: <sip:user@example.com>;tag=1\r\n"
+         "Call-Id: ");
+      message.append(callId);
+      message.append("\r\nCseq: ");
+      message.appendNumber(cseq);
+      message.append(" REGISTER\r\nContact: ");
+      message.append(contact);
+      message.append("\r\nContent-Length: 0\r\n\r\n");
+      return new SipMessage(message.data(), message.length());
+   }
+
+   RegBinding binding(const char* contact, const char* callId,
+                      unsigned int cseq, unsigned long expirationTime)
+   {
+      RegBinding binding;
+      binding.setIdentity("user@example.com");
+      binding.setUri("sip:user@example.com");
+      binding.setContact(contact);
+      binding.setCallId(callId);
+      binding.setCseq(cseq);
+      binding.setExpirationTime(expirationTime);
+      return binding;
+   }
+
+   RegBinding::Ptr newBinding(const char* contact, const char* callId,
+                              unsigned int cseq, unsigned long expirationTime)
+   {
+      return RegBinding::Ptr(new RegBinding(binding(contact, callId, cseq, expirationTime)));
+   }
+
+   // Contact: * expires every binding of the AOR, whatever its session.
+   void testRemoveAll()
+   {
+      RegDB::Bindings unexpired;
+      unexpired.push_back(binding("<sip:a@10.0.0.1>", "call-1", 1, 1000));
+      unexpired.push_back(binding("<sip:b@10.0.0.2>", "call-2", 3, 2000));
+      vector<RegBinding::Ptr> newBindings;
+
+      SipMessage* message = registerMessage("call-3", 1, "*");
+      RegDB::Bindings result;
+      SipRegistrarServer::regEventBindings(*message, unexpired, newBindings, result);
+      delete message;
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, result.size());
+      ASSERT_STR_EQUAL("<sip:a@10.0.0.1>", result[0].getContact().c_str());
+      CPPUNIT_ASSERT_EQUAL(0UL, result[0].getExpirationTime());
+      ASSERT_STR_EQUAL("<sip:b@10.0.0.2>", result[1].getContact().c_str());
+      CPPUNIT_ASSERT_EQUAL(0UL, result[1].getExpirationTime());
+   }
+
+   // The bindings of an earlier request of the same session that this one
+   // does not carry on were expired by expireOldBindings; other sessions stay.
+   void testEarlierCseqOfSession()
+   {
+      RegDB::Bindings unexpired;
+      unexpired.push_back(binding("<sip:a@10.0.0.1>", "call-1", 1, 1000));
+      unexpired.push_back(binding("<sip:c@10.0.0.3>", "call-2", 1, 1000));
+      vector<RegBinding::Ptr> newBindings;
+      newBindings.push_back(newBinding("<sip:b@10.0.0.2>", "call-1", 2, 3000));
+
+      SipMessage* message = registerMessage("call-1", 2, "<sip:b@10.0.0.2>");
+      RegDB::Bindings result;
+      SipRegistrarServer::regEventBindings(*message, unexpired, newBindings, result);
+      delete message;
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, result.size());
+      ASSERT_STR_EQUAL("<sip:c@10.0.0.3>", result[0].getContact().c_str());
+      ASSERT_STR_EQUAL("call-2", result[0].getCallId().c_str());
+      ASSERT_STR_EQUAL("<sip:b@10.0.0.2>", result[1].getContact().c_str());
+      CPPUNIT_ASSERT_EQUAL(3000UL, result[1].getExpirationTime());
+   }
+
+   // A binding the request rewrites, by contact and Call-ID, appears once,
+   // as written; the same contact of another session is left as it is.
+   void testReplacedByContactAndCallId()
+   {
+      RegDB::Bindings unexpired;
+      unexpired.push_back(binding("<sip:a@10.0.0.1>", "call-2", 5, 1000));
+      unexpired.push_back(binding("<sip:a@10.0.0.1>", "call-1", 2, 1000));
+      vector<RegBinding::Ptr> newBindings;
+      newBindings.push_back(newBinding("<sip:a@10.0.0.1>", "call-1", 2, 2000));
+
+      SipMessage* message = registerMessage("call-1", 2, "<sip:a@10.0.0.1>");
+      RegDB::Bindings result;
+      SipRegistrarServer::regEventBindings(*message, unexpired, newBindings, result);
+      delete message;
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, result.size());
+      ASSERT_STR_EQUAL("call-2", result[0].getCallId().c_str());
+      CPPUNIT_ASSERT_EQUAL(1000UL, result[0].getExpirationTime());
+      ASSERT_STR_EQUAL("call-1", result[1].getCallId().c_str());
+      CPPUNIT_ASSERT_EQUAL(2000UL, result[1].getExpirationTime());
+   }
+
+   // A contact unregistered with expires=0 is shown expired, even if the
+   // read still has it unexpired.
+   void testUnregister()
+   {
+      RegDB::Bindings unexpired;
+      unexpired.push_back(binding("<sip:a@10.0.0.1>", "call-1", 3, 1000));
+      unexpired.push_back(binding("<sip:b@10.0.0.2>", "call-2", 1, 1000));
+      vector<RegBinding::Ptr> newBindings;
+      newBindings.push_back(newBinding("<sip:a@10.0.0.1>", "call-1", 3, 0));
+
+      SipMessage* message = registerMessage("call-1", 3, "<sip:a@10.0.0.1>;expires=0");
+      RegDB::Bindings result;
+      SipRegistrarServer::regEventBindings(*message, unexpired, newBindings, result);
+      delete message;
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, result.size());
+      ASSERT_STR_EQUAL("<sip:b@10.0.0.2>", result[0].getContact().c_str());
+      CPPUNIT_ASSERT_EQUAL(1000UL, result[0].getExpirationTime());
+      ASSERT_STR_EQUAL("<sip:a@10.0.0.1>", result[1].getContact().c_str());
+      CPPUNIT_ASSERT_EQUAL(0UL, result[1].getExpirationTime());
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RegEventBindingsTest);
@@ -0,0 +1,193 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// APPLICATION INCLUDES
+#include "net/Url.h"
+#include "os/OsTask.h"
+#include "sipdb/RegBinding.h"
+#include "RegEventQueue.h"
+
+using namespace std;
+
+// DEFINES
+#define COALESCE_MS  100
+#define WAIT_MS      2000
+#define SETTLE_MS    (3 * COALESCE_MS)
+
+// CONSTANTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+// Records what a RegEventQueue publishes.
+class PublishRecorder
+{
+public:
+   void publish(const RegEventQueue::PendingContent& pending)
+   {
+      boost::lock_guard<boost::mutex> lock(mMutex);
+      mPublished.push_back(pending);
+   }
+
+   size_t count()
+   {
+      boost::lock_guard<boost::mutex> lock(mMutex);
+      return mPublished.size();
+   }
+
+   // Wait up to WAIT_MS for n publishes, then SETTLE_MS for any more.
+   size_t waitFor(size_t n)
+   {
+      for (int waited = 0; count() < n && waited < WAIT_MS; waited += 10)
+      {
+         OsTask::delay(10);
+      }
+      OsTask::delay(SETTLE_MS);
+      return count();
+   }
+
+   // The publish of aor, which must be there.
+   RegEventQueue::PendingContent published(const char* aor)
+   {
+      boost::lock_guard<boost::mutex> lock(mMutex);
+      for (size_t i = 0; i < mPublished.size(); i++)
+      {
+         if (mPublished[i].aorString.compareTo(aor) == 0)
+         {
+            return mPublished[i];
+         }
+      }
+      CPPUNIT_FAIL("AOR not published");
+      return RegEventQueue::PendingContent();
+   }
+
+private:
+   boost::mutex mMutex;
+   vector<RegEventQueue::PendingContent> mPublished;
+};
+
+/**
+ * Unit tests for RegEventQueue, which coalesces the reg event changes of an AOR.
+ */
+class RegEventQueueTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(RegEventQueueTest);
+   CPPUNIT_TEST(testCoalesced);
+   CPPUNIT_TEST(testLatestNeedsRead);
+   CPPUNIT_TEST(testNextWindow);
+   CPPUNIT_TEST(testNoWindow);
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   // count bindings of the AOR, the last with contact.
+   RegDB::Bindings bindings(int count, const char* contact)
+   {
+      RegDB::Bindings bindings;
+      for (int i = 0; i < count; i++)
+      {
+         RegBinding binding;
+         binding.setContact(i == count - 1 ? contact : "<sip:other@10.0.0.9>");
+         bindings.push_back(binding);
+      }
+      return bindings;
+   }
+
+   void queue(RegEventQueue& queue, const char* aor, const char* instrument,
+              const RegDB::Bindings* bindings)
+   {
+      queue.queue(aor, Url(aor), instrument, bindings);
+   }
+
+   // Several changes to an AOR within the window are published once, from
+   // the latest bindings, with the instruments of all of them.
+   void testCoalesced()
+   {
+      PublishRecorder recorder;
+      RegEventQueue eventQueue(COALESCE_MS,
+                               boost::bind(&PublishRecorder::publish, &recorder, _1));
+
+      RegDB::Bindings first = bindings(1, "<sip:first@10.0.0.1>");
+      RegDB::Bindings second = bindings(2, "<sip:second@10.0.0.2>");
+      RegDB::Bindings latest = bindings(3, "<sip:latest@10.0.0.3>");
+      queue(eventQueue, "sip:a@example.com", "i1", &first);
+      queue(eventQueue, "sip:b@example.com", "", NULL);
+      queue(eventQueue, "sip:a@example.com", "i2", &second);
+      queue(eventQueue, "sip:a@example.com", "", &latest);
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, recorder.waitFor(2));
+
+      RegEventQueue::PendingContent a = recorder.published("sip:a@example.com");
+      CPPUNIT_ASSERT(a.haveBindings);
+      CPPUNIT_ASSERT_EQUAL((size_t) 3, a.bindings.size());
+      ASSERT_STR_EQUAL("<sip:latest@10.0.0.3>", a.bindings[2].getContact().c_str());
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, a.instruments.size());
+      CPPUNIT_ASSERT(a.instruments.count("i1"));
+      CPPUNIT_ASSERT(a.instruments.count("i2"));
+
+      RegEventQueue::PendingContent b = recorder.published("sip:b@example.com");
+      CPPUNIT_ASSERT(!b.haveBindings);
+      CPPUNIT_ASSERT(b.instruments.empty());
+   }
+
+   // A latest change without bindings has them read when it is published.
+   void testLatestNeedsRead()
+   {
+      PublishRecorder recorder;
+      RegEventQueue eventQueue(COALESCE_MS,
+                               boost::bind(&PublishRecorder::publish, &recorder, _1));
+
+      RegDB::Bindings first = bindings(1, "<sip:first@10.0.0.1>");
+      queue(eventQueue, "sip:a@example.com", "", &first);
+      queue(eventQueue, "sip:a@example.com", "", NULL);
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, recorder.waitFor(1));
+      RegEventQueue::PendingContent a = recorder.published("sip:a@example.com");
+      CPPUNIT_ASSERT(!a.haveBindings);
+      CPPUNIT_ASSERT(a.bindings.empty());
+   }
+
+   // A change after a publish waits for a window of its own.
+   void testNextWindow()
+   {
+      PublishRecorder recorder;
+      RegEventQueue eventQueue(COALESCE_MS,
+                               boost::bind(&PublishRecorder::publish, &recorder, _1));
+
+      RegDB::Bindings first = bindings(1, "<sip:first@10.0.0.1>");
+      queue(eventQueue, "sip:a@example.com", "", &first);
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, recorder.waitFor(1));
+
+      queue(eventQueue, "sip:a@example.com", "", &first);
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, recorder.count());
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, recorder.waitFor(2));
+   }
+
+   // With no window every change is published at once, by the caller.
+   void testNoWindow()
+   {
+      PublishRecorder recorder;
+      RegEventQueue eventQueue(0,
+                               boost::bind(&PublishRecorder::publish, &recorder, _1));
+
+      RegDB::Bindings first = bindings(1, "<sip:first@10.0.0.1>");
+      queue(eventQueue, "sip:a@example.com", "i1", &first);
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, recorder.count());
+      queue(eventQueue, "sip:a@example.com", "", &first);
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, recorder.count());
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(RegEventQueueTest);
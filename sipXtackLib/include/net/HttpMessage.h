@@ -17,12 +17,16 @@
 
 #include <net/HttpBody.h>
 #include <net/NameValuePair.h>
+#include <net/SipTokens.h>
 #include <os/OsSocket.h>
 #include <os/OsTimeLog.h>
 #include <os/OsMsgQ.h>
 #include <utl/UtlHashMap.h>
 #include <string>
 #include <map>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/thread.hpp>
 
 // DEFINES
@@ -179,6 +183,10 @@ typedef UtlBoolean (*GetDataCallbackProc)(char* pData,
  * The final part of the HttpMessage is the body.  The body is
  * optional and may not be present.  The accessors for the body
  * (single or multipart) is getBody() and setBody()
+ * \par
+ * Copying a message does not copy its headers or body.  The copies
+ * share them, and a copy gets headers of its own only when it is first
+ * changed, so messages can be copied from task to task cheaply.
  */
 class HttpMessage : public UtlContainableAtomic
 {
@@ -389,6 +397,15 @@ public:
      */
     static ssize_t findHeaderEnd(const char* messageBytes, ssize_t messageLength);
 
+    //! As above, resuming the search at lineStart as the message is read
+    /*! lineStart must be the start of a line; it is 0 for a new message.
+     *  If the end is not yet found, lineStart is moved past the lines
+     *  already known not to be blank, for the next call once more of the
+     *  message has been appended.
+     */
+    static ssize_t findHeaderEnd(const char* messageBytes, ssize_t messageLength,
+                                 ssize_t& lineStart);
+
     //@}
 /* ============================ ACCESSORS ================================= */
 
@@ -582,8 +599,8 @@ public:
 
     /**
      * Attach the body section of the message. The body is NOT copied.
-     * This message instance destructor will call delete on the body
-     * pointer.
+     * The body is deleted when neither this message nor any copy of it
+     * still has it, so it must not be changed once attached.
      */
     void setBody(HttpBody* newBody);
     //@}
@@ -594,6 +611,25 @@ public:
      * \param length - the length of bytes
      */
     void getBytes(UtlString* bytes, ssize_t* length, bool includeBody = true) const;
+    //! Get the first line and headers, and the body, that getBytes() joins
+    /*! The header bytes end with the empty line.  They are those kept by
+     * serializeHeaders() if still current, and are never changed, even
+     * if the message is, so a transport can write both parts with one
+     * gathering write instead of copying them together.
+     * \param body - gets the body bytes, if includeBody
+     * \param bodyLength - the length of body
+     */
+    boost::shared_ptr<const UtlString> getHeaderBytes(UtlString* body, ssize_t* bodyLength,
+                                                      bool includeBody = true) const;
+    //! Keep the first line and headers serialized until the message changes
+    /*! getBytes() and getHeaderBytes() reuse the serialization while it is
+     * current, and only serialize the headers that changed since it was
+     * kept; until then they serialize into their own buffers, as a const
+     * message is not written.  Call it on the thread that owns the
+     * message, before the message or copies of it are handed to others.
+     * A wrong Content-Length header is corrected.
+     */
+    void serializeHeaders();
     //! Get a malloc'ed string containing the text of the message.
     /*! Must be free'd by the caller.  Suitable for use in a debugger.
      */
@@ -752,13 +788,20 @@ public:
                                       const char* thisMessageUri = NULL,
                                       enum HttpEndpointEnum authEntity = SERVER) const;
 
+    /// Verify the credentials of this message against the digest of the user's password.
+    /** userPasswordDigest is the value built by buildMd5UserPasswordDigest,
+     *  so that a server that keeps it does not digest the password again
+     *  for every request.  Checks every Authorization (or, for PROXY,
+     *  Proxy-Authorization) header, as the password form does.
+     */
     UtlBoolean verifyMd5Authorization(const char* userPasswordDigest,
                                       const char* nonce,
                                       const char* cnonce,
                                       const char* nonceCount,
                                       const char* qop,
                                       const char* thisMessageMethod = NULL,
-                                      const char* thisMessageUri = NULL) const;
+                                      const char* thisMessageUri = NULL,
+                                      enum HttpEndpointEnum authEntity = SERVER) const;
 
     //@}
 
@@ -825,13 +868,105 @@ public:
 
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
 protected:
-   UtlDList mNameValues;
+   /// The header fields, which copies of the message may share.
+   const UtlDList& nameValues() const;
+
+   /// The header fields, to change them.
+   /*! Copies them first if another message shares them, and marks the
+    *  serialized headers stale.
+    */
+   UtlDList& changeNameValues();
+
    UtlString mFirstHeaderLine;
-   UtlBoolean mHeaderCacheClean;
+   SipTokens::Method mRequestMethod; ///< the interned method of mFirstHeaderLine
+   UtlBoolean mHeaderCacheClean; ///< mpHeaderBytes is what the headers serialize to
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 private:
-   HttpBody* body;
+   /// Where a header line is in Headers::bytes.
+   struct HeaderLine
+   {
+      size_t offset;
+      size_t length;
+   };
+
+   /// The first line and headers as serializeHeaders() last kept them.
+   /*! With where each header line is, so the next serialization copies
+    *  the lines of the headers that did not change rather than formatting
+    *  them again.  Never changed once made, so copies of the message and
+    *  callers of getHeaderBytes() share it.
+    */
+   struct HeaderBytes
+   {
+      UtlString bytes;
+      std::vector<HeaderLine> lines;
+      ssize_t bodyLength; ///< the Content-Length bytes has
+
+      HeaderBytes();
+   };
+
+   /// The header fields, which copies of a message share until one changes them.
+   /*! Only a message with Headers of its own may change them, so those
+    *  shared are never written.  Copies of a message are used on other
+    *  threads, so the count of the messages holding the Headers is only
+    *  changed and read with atomic operations, which are full barriers.
+    */
+   struct Headers
+   {
+      UtlDList nameValues;
+
+      Headers();
+      Headers(const Headers& rHeaders);
+      ~Headers();
+
+      /// Whether one message alone holds the headers.
+      /*! If so, every message that held them before has let them go,
+       *  and whatever it read of them was read before this returns.
+       */
+      bool isUnshared();
+
+      friend void intrusive_ptr_add_ref(Headers* pHeaders)
+      {
+         __sync_add_and_fetch(&pHeaders->mReferences, 1);
+      }
+
+      friend void intrusive_ptr_release(Headers* pHeaders)
+      {
+         if (__sync_sub_and_fetch(&pHeaders->mReferences, 1) == 0)
+         {
+            delete pHeaders;
+         }
+      }
+
+   private:
+      int mReferences; ///< messages holding the headers
+
+      Headers& operator=(const Headers&);
+   };
+
+   boost::intrusive_ptr<Headers> mpHeaders;
+   boost::shared_ptr<const HeaderBytes> mpHeaderBytes; ///< NULL until serializeHeaders()
+
+   /// Whether mpHeaderBytes is what the headers serialize to with a body of bodyLength.
+   bool isHeaderBytesCurrent(ssize_t bodyLength) const;
+
+   /// Append the first line and headers, serialized, to bytes.
+   /*! Lines of mpHeaderBytes are copied for the headers they still match.
+    *  \param lines - if not NULL, gets where each header line is in bytes
+    */
+   void formatHeaders(ssize_t bodyLength,
+                      UtlString& bytes,
+                      std::vector<HeaderLine>* lines) const;
+
+   /// Set mRequestMethod from the first token of mFirstHeaderLine, which has changed.
+   void internRequestMethod();
+
+   /// Whether line of bytes is what a header serializes to.
+   static bool isHeaderLine(const UtlString& bytes, const HeaderLine& line,
+                            const char* name, size_t nameLength,
+                            const char* value, size_t valueLength);
+
+   boost::shared_ptr<HttpBody> body; ///< shared with the copies of the message
    bool mUseChunkedEncoding;
 
    // Note that these "transport parameters" are copied by the
@@ -874,6 +1009,11 @@ private:
 
 /* ============================ INLINE METHODS ============================ */
 
+inline const UtlDList& HttpMessage::nameValues() const
+{
+  return mpHeaders->nameValues;
+}
+
 inline bool HttpMessage::ignoreLastRead() const
 {
   return _ignoreLastRead;
@@ -0,0 +1,64 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _HttpMetricsService_h_
+#define _HttpMetricsService_h_
+
+// SYSTEM INCLUDES
+
+// APPLICATION INCLUDES
+#include "net/HttpService.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// Answers GET with the metrics of UtlMetrics in Prometheus text format.
+/**
+ * Add it to an HttpServer at the path to be scraped:
+ *
+ * @code
+ * httpServer->addHttpService("/metrics", new HttpMetricsService());
+ * @endcode
+ */
+class HttpMetricsService : public HttpService
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+public:
+
+/* ============================ CREATORS ================================== */
+
+   HttpMetricsService();
+
+   virtual ~HttpMetricsService();
+
+/* ============================ MANIPULATORS ============================== */
+
+   virtual void processRequest(const HttpRequestContext& requestContext,
+                               const HttpMessage& request,
+                               HttpMessage*& response
+                               );
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+private:
+
+   /// Disabled copy constructor
+   HttpMetricsService(const HttpMetricsService&);
+
+   /// Disabled assignment operator
+   HttpMetricsService& operator=(const HttpMetricsService&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _HttpMetricsService_h_
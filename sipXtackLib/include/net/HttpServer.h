@@ -41,13 +41,31 @@ class HttpConnection;
 
 /// Implement an HTTP server interface.
 /**
- * This class listens on the accept socket passed to the constructor, accepting new
- * connections and creating an HttpConnection object for each.  If the constructor
- * specified that connections should be persistent, the HttpServer maintains the list
- * of open connections and enforces the MAX_PERSISTENT_HTTP_CONNECTIONS limit.
+ * On a plain TCP socket, the task runs an epoll event loop that accepts
+ * connections, reads and writes them without blocking, and passes each
+ * complete request to a bounded pool of handler threads:
  *
- * Actual HTTP requests are parsed from the HttpConnection by HttpMessage::read,
- * and then the HttpConnection object passes them to HttpServer::processRequest.
+ * - If the constructor specified that connections should be persistent,
+ *   HTTP/1.1 connections are kept open unless the client asks for
+ *   "Connection: close" (HTTP/1.0 ones only if it asks for "keep-alive"),
+ *   and requests pipelined on a connection are answered in order.
+ *   DEFAULT_HANDLER_THREADS threads process requests, so services must be
+ *   thread safe, as they had to be when each connection had its own thread.
+ *   Otherwise each connection is closed after its response, and a single
+ *   handler thread processes requests one at a time as before.
+ *
+ * - At most MAX_CONNECTIONS connections are kept open and at most
+ *   MAX_QUEUED_REQUESTS requests wait for a handler; beyond that the
+ *   server answers 503.  A request longer than MAX_REQUEST_BYTES is answered
+ *   413 without reading the rest of it.  Connections idle for
+ *   IDLE_CONNECTION_SECS are closed.
+ *
+ * On a TLS socket (OsSSLServerSocket), connections are accepted one at a time and
+ * an HttpConnection task is created for each.  If the constructor specified that
+ * connections should be persistent, the HttpServer maintains the list of open
+ * connections and enforces the MAX_PERSISTENT_HTTP_CONNECTIONS limit; the
+ * HttpConnection reads requests with HttpMessage::read and passes them to
+ * HttpServer::processRequest.
  *
  * Prior to attempting to process the request itself, the HttpServer:
  *
@@ -105,6 +123,21 @@ public:
     /// OsServerTask main loop implementation.
     virtual int run(void* runArg);
 
+    /// Threads that process requests on a persistent-connection server.
+    static const int DEFAULT_HANDLER_THREADS;
+
+    /// Requests that may wait for a handler thread before the server answers 503.
+    static const int MAX_QUEUED_REQUESTS;
+
+    /// Connections the event loop keeps open before the server answers 503.
+    static const int MAX_CONNECTIONS;
+
+    /// Bytes of headers and body of a request beyond which the server answers 413.
+    static const size_t MAX_REQUEST_BYTES;
+
+    /// Seconds without a request after which the event loop closes a connection.
+    static const int IDLE_CONNECTION_SECS;
+
     /// Translate URI prefixes.
     static UtlBoolean mapUri(UtlHashMap& uriMaps,  ///< database of prefix translations.
                              const char* uri,      ///< normalized input request uri path
@@ -234,6 +267,13 @@ private:
 
     void loadValidIpAddrList();
 
+    /// Accept connections one at a time and give each an HttpConnection task.
+    void runConnectionTasks();
+
+    /// Connections, parsing and handler threads of the epoll event loop.
+    class EventLoop;
+    friend class EventLoop;
+
    static const int MAX_PERSISTENT_HTTP_CONNECTIONS;
 
    OsStatus        httpStatus;
@@ -247,6 +287,10 @@ private:
    UtlBoolean      mbPersistentConnection;
    int             mHttpConnections;
    UtlSList*       mpHttpConnectionList;
+   int             mWakeFd;              ///< eventfd that wakes the event loop to shut down
+   int             mMaxConnections;      ///< MAX_CONNECTIONS, unless a test lowers it
+   int             mMaxQueuedRequests;   ///< MAX_QUEUED_REQUESTS, unless a test lowers it
+   size_t          mMaxRequestBytes;     ///< MAX_REQUEST_BYTES, unless a test lowers it
 
    // @cond INCLUDENOCOPY
    // There is no copy constructor.
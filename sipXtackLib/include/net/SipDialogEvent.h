@@ -144,6 +144,9 @@ class Dialog : public UtlContainable
    /// Render the XML for the dialog into the provided UtlString.
    void getBytes(UtlString& b, ssize_t& l);
 
+   /// Append the XML for the dialog to the provided UtlString.
+   void appendBytes(UtlString& b);
+
    void getDialog(UtlString& dialogId,
                   UtlString& callId,
                   UtlString& localTag,
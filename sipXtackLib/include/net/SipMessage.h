@@ -1038,6 +1038,13 @@ public:
 
     UtlBoolean getCSeqField(int* sequenceNum, UtlString* sequenceMethod) const;
 
+    /// The method of a request, as recorded when its first line was set.
+    /**
+     * METHOD_UNKNOWN for a response, or for a request with an extension
+     * method, whose name only getRequestMethod() gives.
+     */
+    SipTokens::Method getMethodId() const;
+
     UtlBoolean getRequireExtension(int extensionIndex, UtlString* extension) const;
 
     UtlBoolean getProxyRequireExtension(int extensionIndex, UtlString* extension) const;
@@ -1258,6 +1265,18 @@ public:
                                       const char* uri = NULL,
                                       enum HttpEndpointEnum authEntity = SERVER) const;
 
+    /// Verify the credentials against the digest of the user's password.
+    /** userPasswordDigest is as built by HttpMessage::buildMd5UserPasswordDigest,
+     *  so that a server that keeps it need not digest the password again.
+     */
+    UtlBoolean verifyMd5Authorization(const char* userPasswordDigest,
+                                      const char* nonce,
+                                      const char* cnonce,
+                                      const char* nonceCount,
+                                      const char* qop,
+                                      const char* uri,
+                                      enum HttpEndpointEnum authEntity) const;
+
     HttpMessage::AuthQopValues verifyQopConsistency(const char* cnonce,
                                                     const char* nonceCount,
                                                     const UtlString* qop,
@@ -1394,6 +1413,12 @@ private:
 
     static SdpBody* convertToSdpBody(const HttpBody* httpBody);
 
+    /// The method and URI the credentials of this message are computed over.
+    //  uri is the uri parameter of the credentials, if known.
+    void getAuthorizationMethodAndUri(const char* uri,
+                                      UtlString& uriString,
+                                      UtlString& method) const;
+
     SipTransaction* mpSipTransaction;
 
     UtlString mInterfaceIp;
@@ -1403,31 +1428,6 @@ private:
     UtlString m_dnsProtocol ;
     UtlString m_dnsAddress ;
     UtlString m_dnsPort ;
-
-    // Class for the singleton object that carries the field properties
-    class SipMessageFieldProps
-       {
-         private:
-          friend class SipMessage;
-
-          SipMessageFieldProps();
-          ~SipMessageFieldProps();
-
-          UtlHashBag mShortFieldNames;
-          UtlHashBag mLongFieldNames;
-          // Headers that may not be referenced in a URI header parameter.
-          UtlHashBag mDisallowedUrlHeaders;
-          // Headers that do not take a list of values.
-          UtlHashBag mUniqueUrlHeaders;
-
-          void initNames();
-          void initDisallowedUrlHeaders();
-          void initUniqueUrlHeaders();
-       };
-
-    // Singleton object to carry the field properties.
-    static SipMessageFieldProps sSipMessageFieldProps;
-
 };
 
 /* ============================ INLINE METHODS ============================ */
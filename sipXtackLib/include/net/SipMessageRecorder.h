@@ -0,0 +1,172 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+//////
+
+#ifndef _SipMessageRecorder_h_
+#define _SipMessageRecorder_h_
+
+// SYSTEM INCLUDES
+#include <pthread.h>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include "os/OsMutex.h"
+#include "os/OsSocket.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// Flight recorder for the SIP messages a SipUserAgent sends and receives.
+/**
+ * Each thread that records gets a ring of fixed size slots of its own, so
+ * recording a message copies its bytes into memory that no other thread
+ * writes: no lock is taken and nothing is allocated once the thread has
+ * its ring.  A slot keeps the raw message (truncated to the slot size)
+ * with the time, direction, transport and local and remote address; when
+ * the ring is full the oldest slot is reused.
+ *
+ * Readers do not stop the writers either.  Every slot carries a sequence
+ * number that is odd while the slot is being written; a reader copies the
+ * slot and keeps the copy only if the sequence number is the same after.
+ *
+ * The recorded messages can be exported on demand as pcapng (with IPv4 and
+ * UDP or TCP headers made up from the recorded addresses), as the siptrace
+ * XML that syslog2siptrace makes from the OUTGOING and INCOMING log, or as
+ * text in the format of that log.
+ */
+class SipMessageRecorder
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   enum Direction
+   {
+      INCOMING,
+      OUTGOING
+   };
+
+   enum
+   {
+      DEFAULT_SLOTS      = 256,   ///< messages kept per thread
+      DEFAULT_SLOT_BYTES = 4096,  ///< longer messages are truncated
+      MIN_SLOTS          = 16
+   };
+
+   /// A recorded message, as copied out of the recorder
+   struct Message
+   {
+      OsTime    time;
+      Direction direction;
+      bool      failed;           ///< an outgoing message that could not be sent
+      OsSocket::IpProtocolSocketType transport; ///< UNKNOWN for a note without addresses
+      UtlString localAddress;
+      int       localPort;
+      UtlString remoteAddress;
+      int       remotePort;
+      size_t    length;           ///< length of the message on the wire
+      UtlString bytes;            ///< the recorded bytes, at most one slot
+   };
+
+/* ============================ CREATORS ================================== */
+
+   /// Construct a recorder; it does not record until start() is called.
+   SipMessageRecorder(size_t slots = DEFAULT_SLOTS,          ///< messages kept per thread
+                      size_t slotBytes = DEFAULT_SLOT_BYTES  ///< bytes kept per message
+                      );
+
+   ~SipMessageRecorder();
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// Start recording.
+   void start();
+
+   /// Stop recording; what was recorded is kept.
+   void stop();
+
+   /// Forget everything recorded so far.
+   void clear();
+
+   /// Set the size of the rings given to threads that start recording from now on.
+   void setCapacity(size_t slots, size_t slotBytes = DEFAULT_SLOT_BYTES);
+
+   /// Record a message sent or received, if recording.
+   void record(Direction direction,
+               OsSocket::IpProtocolSocketType transport,
+               const char* localAddress,
+               int localPort,
+               const char* remoteAddress,
+               int remotePort,
+               const char* bytes,
+               size_t length,
+               bool failed = false  ///< the message could not be sent
+               );
+
+   /// Record a line of text that is not a message (only exportText shows it).
+   void recordNote(const char* text, size_t length);
+
+/* ============================ ACCESSORS ================================= */
+
+   /// Copy out the recorded messages, oldest first; the caller deletes them.
+   void getMessages(std::vector<Message*>& messages) const;
+
+   /// Export the recorded messages as a pcapng capture file.
+   void exportPcapng(UtlString& data) const;
+
+   /// Export the recorded messages as siptrace XML.
+   void exportSipTrace(UtlString& data,
+                       const char* hostName  ///< names this end in source/destination
+                       ) const;
+
+   /// Export the recorded messages as text, in the OUTGOING/INCOMING log format.
+   void exportText(UtlString& data) const;
+
+/* ============================ INQUIRY =================================== */
+
+   /// Is the recorder recording?
+   bool isRecording() const
+   {
+      return mRecording;
+   }
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   struct Ring;
+
+   volatile bool        mRecording;
+   size_t               mSlots;
+   size_t               mSlotBytes;
+   pthread_key_t        mRingKey;       ///< the Ring of the calling thread
+   mutable OsMutex      mRingsLock;     ///< protects mRings, mSlots and mSlotBytes
+   std::vector<Ring*>   mRings;
+
+   /// Get the ring of the calling thread, giving it one if it has none.
+   Ring* threadRing();
+
+   /// Called when a thread exits, to let another thread reuse its ring.
+   static void releaseRing(void* ring);
+
+   /// Disable copy constructor
+   SipMessageRecorder(const SipMessageRecorder&);
+
+   /// Disable assignment operator
+   SipMessageRecorder& operator=(const SipMessageRecorder&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _SipMessageRecorder_h_
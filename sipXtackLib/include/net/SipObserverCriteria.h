@@ -17,6 +17,7 @@
 
 // APPLICATION INCLUDES
 #include <os/OsMsgQ.h>
+#include <net/SipTokens.h>
 
 
 // DEFINES
@@ -63,8 +64,12 @@ public:
     *  The return pointer is valid only while this object exists.
     */
    const char* getSipMethod();
+   /// The interned SIP method; METHOD_UNKNOWN for none or an extension method.
+   SipTokens::Method getSipMethodId();
    void* getObserverData();
    void getEventName(UtlString& eventName);
+   /// The interned event package; EVENT_UNKNOWN for none or one not well known.
+   SipTokens::EventPackage getEventPackage();
    SipSession* getSession();
 
 /* ============================ INQUIRY =================================== */
@@ -87,6 +92,8 @@ private:
    UtlBoolean mWantsOutGoing;
    OsMsgQ* mpMessageObserverQueue;
    UtlString mEventName;
+   SipTokens::Method mSipMethodId;
+   SipTokens::EventPackage mEventPackage;
    SipSession* mpSession ;
 
    SipObserverCriteria& operator=(const SipObserverCriteria& rhs);
@@ -9,6 +9,7 @@
 #define _SipPublishContentMgr_h_
 
 // SYSTEM INCLUDES
+#include <boost/thread.hpp>
 
 // APPLICATION INCLUDES
 
@@ -17,6 +18,7 @@
 #include <utl/UtlDefs.h>
 #include <utl/UtlHashMap.h>
 #include <utl/UtlHashBag.h>
+#include <utl/UtlSList.h>
 #include <utl/UtlContainableAtomic.h>
 
 // DEFINES
@@ -29,6 +31,8 @@
 class HttpBody;
 class UtlString;
 class SipPublishContentMgrDefaultConstructor;
+class UtlMetricCounter;
+class UtlMetricHistogram;
 
 // TYPEDEFS
 
@@ -127,6 +131,18 @@ class SipPublishContentMgrDefaultConstructor;
  *  true, and only partial content updates will cause callbacks.
  *  Note that only one callback can be registered per eventType.
  *
+ * \par Coalescing Content Changes
+ *  By default the callback is called from publish() itself.  If a
+ *  coalescing window is set with setCoalescingWindow, the callback for a
+ *  resourceId/eventTypeKey is instead called once the window after the
+ *  first publish() to it has passed, on a thread of the
+ *  SipPublishContentMgr, and any further publish() calls to it within the
+ *  window are folded into that one callback.  Since the callback reads the
+ *  content when it is called, subscribers are sent only the latest content.
+ *  Callbacks for a resourceId/eventTypeKey stay in publish() order, and an
+ *  unpublish() drops a callback still waiting for its window, as its own
+ *  callback presents the latest content.
+ *
  * \par Content Types
  *  It is expected that the set of content types available for a given
  *  resourceId/eventTypeKey will not change over time, with the exception
@@ -442,6 +458,19 @@ public:
                                           SipPublisherContentChangeCallback& callbackFunction,
                                           void*& applicationData);
 
+    /** Set the window within which content changes to a resourceId/eventTypeKey
+     *  are folded into one callback.
+     *  \param windowMs - milliseconds from the first publish() to the
+     *         callback; 0 (the default) calls the callback from publish().
+     *         Setting 0 delivers the callbacks still waiting at once.
+     */
+    void setCoalescingWindow(int windowMs);
+
+    /// Deliver the callbacks whose coalescing window has passed, or all if force.
+    //  Called by the coalescing thread; returns the microseconds until the
+    //  next one is due, or -1 if none is waiting.
+    Int64 deliverCoalesced(UtlBoolean force = FALSE);
+
 /* ============================ ACCESSORS ================================= */
 
     /// Get debugging information.
@@ -450,6 +479,16 @@ public:
                   int& numResourceSpecificContent,
                   int& numCallbacksRegistered);
 
+    /// Get the effect of coalescing content changes.
+    void getCoalescingStats(/// callbacks called after their window
+                            int& numCallbacksDelivered,
+                            /// publish() calls folded into another's callback
+                            int& numPublishesCoalesced,
+                            /// mean microseconds from first publish() to callback
+                            Int64& meanDelayUs,
+                            /// longest microseconds from first publish() to callback
+                            Int64& maxDelayUs);
+
 /* ============================ INQUIRY =================================== */
 
 
@@ -476,6 +515,16 @@ private:
     /// unlock for use
     void unlock();
 
+    /// Call the observer of eventType for a change to resourceId/eventTypeKey.
+    //  Called with the lock held.
+    void contentChanged(const char* resourceId,
+                        const char* eventTypeKey,
+                        const char* eventType,
+                        const char* reason);
+
+    /// Body of the thread that delivers coalesced callbacks.
+    void runCoalescer();
+
     /// The lock itself
     OsMutex mPublishMgrMutex;
 
@@ -498,6 +547,32 @@ private:
     // Members are PublishCallbackContainer's, which index as strings
     // "eventType".
     UtlHashBag mEventContentCallbacks;
+
+    /// Coalescing window in microseconds, 0 if not coalescing.
+    Int64 mCoalescingWindowUs;
+    /// Protects the members below, and is taken inside the lock.
+    boost::mutex mPendingMutex;
+    /// Signals a first pending callback, a change of window, and stopping.
+    boost::condition_variable mPendingChanged;
+    // Callbacks waiting for their window, as PendingCallback's which index
+    // as strings "resourceId\001eventTypeKey".
+    UtlHashBag mPendingCallbacks;
+    /// The same PendingCallback's, in the order they fall due.
+    UtlSList mPendingOrder;
+    /// Set when the coalescing thread is to exit.
+    bool mStopping;
+    /// Delivers the pending callbacks; NULL until a window is first set.
+    boost::thread* mpCoalescer;
+
+    // Statistics of the coalescing.
+    int mNumCallbacksDelivered;
+    int mNumPublishesCoalesced;
+    Int64 mTotalDelayUs;
+    Int64 mMaxDelayUs;
+    /// sipx_publish_coalesced_total
+    UtlMetricCounter& mCoalescedMetric;
+    /// sipx_publish_coalescing_delay_seconds
+    UtlMetricHistogram& mDelayMetric;
 };
 
 /**
@@ -26,6 +26,7 @@
 // APPLICATION INCLUDES
 #include "os/OsDefs.h"
 #include "os/OsMutex.h"
+#include "os/OsCSem.h"
 #include "os/OsSocket.h"
 #include "os/OsServerTask.h"
 #include "os/OsMsg.h"
@@ -151,9 +152,11 @@ public:
     */
 
    /// Get an option value.
+   //  It is read atomically rather than under sMutex, so that lookups
+   //  running at once do not wait for each other.
    static inline int getOption(OptionCode option)
       {
-         return options[option];
+         return __sync_fetch_and_add(&options[option], 0);
       }
 
    /// Set an option value.
@@ -232,7 +235,7 @@ public:
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
 protected:
 
-   /// Mutex to keep the routines thread-safe.
+   /// Mutex to keep changes to the settings atomic.
    static OsMutex sMutex;
 
    /// The array of option values.
@@ -340,11 +343,19 @@ public:
       LAST_LookupType = A_RECORD
    };
 
+   /// Number of sets of lookup threads, and so of name lookups run at once
+   enum { LOOKUP_POOL_SIZE = 8 };
+
    /// Destructor for SipSrvLookupThread
    virtual ~SipSrvLookupThread(void);
 
-   /// Get the SRV lookup threads, initializing them if needed
-   static SipSrvLookupThread** getLookupThreads();
+   /// Take a free set of lookup threads, waiting if all are in use
+   //  The set is initialized if needed, and must be handed back with
+   //  releaseLookupThreads().
+   static SipSrvLookupThread** acquireLookupThreads();
+
+   /// Hand back a set of lookup threads taken by acquireLookupThreads()
+   static void releaseLookupThreads(SipSrvLookupThread** lookupThreads);
 
    /// Implementation of OsServerTask's pure virtual method
    UtlBoolean handleMessage(OsMsg& rMsg);
@@ -361,19 +372,25 @@ private:
    /// Private constructor for SipSrvLookupThread
    SipSrvLookupThread(LookupTypes lookupType);
    /**<
-    * Use getLookupThreads() for initializing and accessing the class members. The class
-    * is restricted to 4 members by the getLookupThreads() function, and their pointers
-    * are stored in "mLookupThreads"
+    * Use acquireLookupThreads() for initializing and accessing the class members.
+    * There are LOOKUP_POOL_SIZE sets of 4 members, and their pointers are stored
+    * in "mLookupThreads"
     */
 
    /// Class attribute indicating what type of query this class member is responsible for
    LookupTypes mLookupType;
 
-   /// Array holding pointers to the four individual lookup threads
-   static SipSrvLookupThread* mLookupThreads[LAST_LookupType+1];
+   /// Arrays holding pointers to the four individual lookup threads of each set
+   static SipSrvLookupThread* mLookupThreads[LOOKUP_POOL_SIZE][LAST_LookupType+1];
+
+   /// Attribute indicating whether each set has been initialized or not
+   static UtlBoolean mHaveThreadsBeenInitialized[LOOKUP_POOL_SIZE];
+
+   /// Attribute indicating whether each set is taken by a lookup
+   static UtlBoolean mLookupThreadsInUse[LOOKUP_POOL_SIZE];
 
-   /// Attribute indicating whether the lookup threads have been initialized or not
-   static UtlBoolean mHaveThreadsBeenInitialized;
+   /// Count of the sets not taken by a lookup
+   static OsCSem sFreeLookupThreads;
 
    /// Events used to signal the completion of a query
    OsEvent* mQueryCompleted;
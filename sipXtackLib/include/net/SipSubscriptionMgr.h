@@ -19,6 +19,7 @@
 #include <utl/UtlDefs.h>
 #include <utl/UtlHashMap.h>
 #include <utl/UtlHashBag.h>
+#include <utl/UtlSList.h>
 #include <net/SipDialogMgr.h>
 #include <net/SipSubscribeServerEventHandler.h>
 #include <net/SipSubscribeServer.h>
@@ -33,6 +34,7 @@
 class SipMessage;
 class UtlString;
 class SipDialogMgr;
+class SubscriptionServerState;
 
 // TYPEDEFS
 
@@ -341,14 +343,34 @@ private:
     //! Assignment operator NOT ALLOWED
     SipSubscriptionMgr& operator=(const SipSubscriptionMgr& rhs);
 
-    //! lock for single thread use
-    void lock();
+    /// Subscriptions to the resources whose IDs hash to one shard.
+    class Shard;
 
-    //! unlock for use
-    void unlock();
+    /// Number of shards; subscriptions are spread over them by resourceId.
+    static const size_t sShardCount = 64;
+
+    /// The number of the shard holding the subscriptions to resourceId.
+    static size_t shardOf(const UtlString& resourceId);
+
+    /// Find the subscription with dialog handle, and lock its shard.
+    /** Returns the locked shard and sets state, or returns NULL (with no
+     *  shard locked) if there is no such subscription.
+     */
+    Shard* lockDialog(const UtlString& dialogHandle,
+                      SubscriptionServerState*& state);
+
+    /// Record that the subscription with dialogHandle is in shard shardNumber.
+    //  Called with that shard locked.
+    void indexDialog(const UtlString& dialogHandle, size_t shardNumber);
+
+    /// Forget the shards of the subscriptions with the handles in dialogHandles.
+    //  Called with their shard locked.
+    void unindexDialogs(const UtlSList& dialogHandles);
+
+    /// Delete the dialogs with the handles in dialogHandles, and empty it.
+    void deleteDialogs(UtlSList& dialogHandles);
 
     int mEstablishedDialogCount;
-    OsMutex mSubscriptionMgrMutex;
     SipDialogMgr mDialogMgr;
     int mMinExpiration;
     int mDefaultExpiration;
@@ -356,15 +378,21 @@ private:
     /// Queue to which to send resend messages.
     OsMsgQ* mpResendMsgQ;
 
-    // Container for the SubscriptionServerState's, which are indexed
-    // by dialog handles.
-    UtlHashBag mSubscriptionStatesByDialogHandle;
-
-    // Index to subscription states in mSubscriptionStatesByDialogHandle,
-    // indexed by the resourceId and eventTypeKey.
-    // Members are SubscriptionServerStateIndex's, which are indexed by
-    // resourceId concatenated with eventTypeKey.
-    UtlHashBag mSubscriptionStateResourceIndex;
+    /// The shards.
+    //  Each shard holds the SubscriptionServerState's of its resources,
+    //  indexed by dialog handle and by resourceId and eventTypeKey, and the
+    //  wheel that expires them, all under the shard's own lock, so that
+    //  subscriptions to different resources do not contend.
+    Shard* mShards[sShardCount];
+
+    /// Lock for mShardOfDialog.
+    //  Only held to look a handle up; never held while taking a shard lock.
+    OsMutex mShardIndexMutex;
+
+    /// The shard of each subscription, as UtlInt's indexed by dialog handle.
+    //  Requests within a dialog only carry its handle, which does not tell
+    //  which resource it subscribes to.
+    UtlHashMap mShardOfDialog;
 };
 
 /* ============================ INLINE METHODS ============================ */
@@ -0,0 +1,193 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+//////
+
+#ifndef _SipTokens_h_
+#define _SipTokens_h_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+
+// APPLICATION INCLUDES
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// Interned identifiers of the well-known SIP methods, header names and event packages.
+/**
+ * Each well-known token has a small integer identifier, so that code that
+ * checks which method a request has, which header a name refers to or
+ * which event package a subscription is for can compare integers rather
+ * than strings, and can index arrays by the identifier.  Tokens that are
+ * not well known are *_UNKNOWN, and must still be compared as strings.
+ *
+ * The tables are static data: a name is looked up by hashing its length
+ * and a few of its bytes into a slot table that was computed so that no
+ * two well-known names of a kind share a slot, and then comparing the name
+ * with the one in that slot.  There is nothing to initialize, so lookups
+ * may be made from static constructors.
+ *
+ * Methods are compared case-sensitively, as RFC 3261 requires.  Header
+ * names and event packages are compared ignoring case, and the one letter
+ * compact form of a header name has the identifier of its long form.
+ */
+class SipTokens
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   // Keep each of these in alphabetical order by name: the slot tables in
+   // SipTokens.cpp are computed from the order.
+
+   enum Method
+   {
+      METHOD_UNKNOWN = 0,
+      METHOD_ACK,
+      METHOD_BYE,
+      METHOD_CANCEL,
+      METHOD_INFO,
+      METHOD_INVITE,
+      METHOD_MESSAGE,
+      METHOD_NOTIFY,
+      METHOD_OPTIONS,
+      METHOD_PRACK,
+      METHOD_PUBLISH,
+      METHOD_REFER,
+      METHOD_REGISTER,
+      METHOD_SUBSCRIBE,
+      METHOD_UPDATE,
+      METHOD_COUNT
+   };
+
+   enum Header
+   {
+      HEADER_UNKNOWN = 0,
+      HEADER_ACCEPT,
+      HEADER_ACCEPT_ENCODING,
+      HEADER_ACCEPT_LANGUAGE,
+      HEADER_ALLOW,
+      HEADER_ALLOW_EVENTS,
+      HEADER_AUTHORIZATION,
+      HEADER_CALL_ID,
+      HEADER_CONTACT,
+      HEADER_CONTENT_DISPOSITION,
+      HEADER_CONTENT_ENCODING,
+      HEADER_CONTENT_LENGTH,
+      HEADER_CONTENT_TYPE,
+      HEADER_CSEQ,
+      HEADER_DATE,
+      HEADER_DIVERSION,
+      HEADER_EVENT,
+      HEADER_EXPIRES,
+      HEADER_FROM,
+      HEADER_MAX_FORWARDS,
+      HEADER_MIN_EXPIRES,
+      HEADER_PATH,
+      HEADER_PROXY_AUTHENTICATE,
+      HEADER_PROXY_AUTHORIZATION,
+      HEADER_PROXY_REQUIRE,
+      HEADER_RACK,
+      HEADER_REASON,
+      HEADER_RECORD_ROUTE,
+      HEADER_REFER_TO,
+      HEADER_REFERRED_BY,
+      HEADER_REPLACES,
+      HEADER_REQUIRE,
+      HEADER_RETRY_AFTER,
+      HEADER_ROUTE,
+      HEADER_RSEQ,
+      HEADER_SERVER,
+      HEADER_SESSION_EXPIRES,
+      HEADER_SIP_ETAG,
+      HEADER_SIP_IF_MATCH,
+      HEADER_SUBJECT,
+      HEADER_SUBSCRIPTION_STATE,
+      HEADER_SUPPORTED,
+      HEADER_TO,
+      HEADER_UNSUPPORTED,
+      HEADER_USER_AGENT,
+      HEADER_VIA,
+      HEADER_WARNING,
+      HEADER_WWW_AUTHENTICATE,
+      HEADER_COUNT
+   };
+
+   enum EventPackage
+   {
+      EVENT_UNKNOWN = 0,
+      EVENT_AS_FEATURE_EVENT,
+      EVENT_CHECK_SYNC,
+      EVENT_CONFERENCE,
+      EVENT_DIALOG,
+      EVENT_LINE_SEIZE,
+      EVENT_MESSAGE_SUMMARY,
+      EVENT_PRESENCE,
+      EVENT_PRESENCE_WINFO,
+      EVENT_REFER,
+      EVENT_REG,
+      EVENT_SIMPLE_MESSAGE_SUMMARY,
+      EVENT_SIP_CONFIG,
+      EVENT_UA_PROFILE,
+      EVENT_COUNT
+   };
+
+/* ============================ ACCESSORS ================================= */
+
+   /// The method named by the length bytes at name.
+   static Method method(const char* name, size_t length);
+
+   /// The method named by the NUL terminated name.
+   static Method method(const char* name);
+
+   /// The name of method, or "" for METHOD_UNKNOWN.
+   static const char* methodName(Method method);
+
+   /// The header named by the length bytes at name, in its long or compact form.
+   static Header header(const char* name, size_t length);
+
+   /// The header named by the NUL terminated name, in its long or compact form.
+   static Header header(const char* name);
+
+   /// The upper case long name of header, as HttpMessage keeps header names.
+   static const char* headerName(Header header);
+
+   /// The upper case compact name of header, or NULL if it has none.
+   static const char* headerCompactName(Header header);
+
+   /// The event package named by the length bytes at name, without parameters.
+   static EventPackage eventPackage(const char* name, size_t length);
+
+   /// The event package named by the NUL terminated name, without parameters.
+   static EventPackage eventPackage(const char* name);
+
+   /// The name of package, or "" for EVENT_UNKNOWN.
+   static const char* eventPackageName(EventPackage package);
+
+/* ============================ INQUIRY =================================== */
+
+   /// Whether header may not be set by a header parameter of a URI.
+   static bool isUrlHeaderDisallowed(Header header);
+
+   /// Whether header may appear only once, so a URI header parameter replaces it.
+   static bool isUrlHeaderUnique(Header header);
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   // Not instantiated
+   SipTokens();
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _SipTokens_h_
@@ -13,7 +13,7 @@
 #define _SipTransaction_h_
 
 // SYSTEM INCLUDES
-//#include <...>
+#include <vector>
 
 // APPLICATION INCLUDES
 
@@ -380,6 +380,12 @@ protected:
                               SipMessage* pRequest = 0);
     //: Starts search on any immediate DNS SRV children of the highest unpursued Q value
 
+    UtlBoolean startForkedChildren(SipUserAgent& userAgent,
+                                   SipTransactionList& transactionList,
+                                   int responseCode);
+    //: Sends the requests of the immediate children of the highest unpursued Q value
+    //! returns: TRUE if any of them was sent
+
     /// Copy unique realms from any proxy challenges in the response into realmList
     void getChallengeRealms(const SipMessage& response, UtlSList& realmList);
     ///< This is for use only within findBestResponse, to filter duplicate realms
@@ -410,6 +416,64 @@ protected:
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 private:
+    friend class SipTransactionTest;
+
+    /// The DNS lookups of the children a transaction forks together.
+    //  A child that needs a lookup while it is started defers it here; when
+    //  all the children have prepared their requests, start() looks up the
+    //  destinations and resumes the children one after another.  The lookups
+    //  of distinct host names run at once, so the last child waits for the
+    //  slowest of them rather than for all of them in turn.
+    class ForkBatch
+    {
+    public:
+       ForkBatch();
+
+       ~ForkBatch();
+
+       /// Defer the lookup of the destinations of child.
+       void defer(SipTransaction* child,
+                  const UtlString& scheme,
+                  OsSocket::IpProtocolSocketType msgSizeProtocol);
+
+       /// TRUE if child is the last child that deferred its lookup.
+       UtlBoolean isDeferred(const SipTransaction* child) const;
+
+       UtlBoolean isEmpty() const;
+
+       /// Look up the destinations and resume the children.
+       //  Returns TRUE if the request of any child was sent.
+       UtlBoolean start(SipUserAgent& userAgent,
+                        SipTransactionList& transactionList);
+
+    private:
+       friend class SipTransactionTest;
+
+       struct Lookup
+       {
+          SipTransaction* child;
+          UtlString scheme;
+          OsSocket::IpProtocolSocketType msgSizeProtocol;
+          server_t* destinations;
+          size_t sameAs;        ///< the first lookup that gives the same destinations
+       };
+
+       /// TRUE if lookups a and b give the same destinations.
+       static bool isSameLookup(const Lookup& a, const Lookup& b);
+
+       /// Do the lookups in names at once, on up to LOOKUP_POOL_SIZE threads.
+       void lookUpNames(const std::vector<size_t>& names);
+
+       /// Do lookups in names until none is left; run by each lookup thread.
+       void lookUpNextNames(const std::vector<size_t>& names);
+
+       /// A copy of a list of destinations, which the caller must delete[].
+       static server_t* copyDestinations(server_t* destinations);
+
+       std::vector<Lookup> mLookups;
+       size_t mNextName;        ///< the next of the names for lookUpNextNames
+    };
+
     SipTransaction(const SipTransaction& rSipTransaction);
     //:Copy constructor (disabled)
     SipTransaction& operator=(const SipTransaction& rhs);
@@ -431,6 +495,23 @@ private:
                           int& port,
                           OsSocket::IpProtocolSocketType& toProtocol);
 
+    /// Look up the DNS destinations of mSendToAddress, falling back to sip: if sips: finds none
+    server_t* lookUpDnsDestinations(const UtlString& scheme,
+                                    OsSocket::IpProtocolSocketType msgSizeProtocol);
+
+    /// Set the timers of this DNS parent and create a DNS SRV child for each of mpDnsDestinations
+    void createDnsSrvChildren(SipUserAgent& userAgent,
+                              SipTransactionList& transactionList);
+
+    /// Send the request of the first DNS SRV child that is not being pursued
+    UtlBoolean pursueDnsSrvChildren(SipUserAgent& userAgent,
+                                    SipTransactionList& transactionList);
+
+    /// Start this DNS parent, whose lookup was deferred to a ForkBatch, with destinations
+    UtlBoolean resumeDnsSrvChildren(SipUserAgent& userAgent,
+                                    SipTransactionList& transactionList,
+                                    server_t* destinations);
+
     void prepareRequestForSend(SipMessage& request,
                                SipUserAgent& userAgent,
                                UtlBoolean& addressRequiresDnsSrvLookup,
@@ -459,6 +540,7 @@ private:
     OsSocket::IpProtocolSocketType mSendToProtocol;
 
     server_t* mpDnsDestinations;        ///< list obtained from DNS server, can contain 0 valid destinations
+    ForkBatch* mpForkBatch;             ///< where to defer the DNS lookup while the parent starts a fork
     SipMessage* mpRequest;
     SipMessage* mpLastProvisionalResponse;
     SipMessage* mpLastFinalResponse;
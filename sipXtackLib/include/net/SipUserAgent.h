@@ -13,10 +13,11 @@
 #define _SipUserAgent_h_
 
 // SYSTEM INCLUDES
-//#include <...>
+#include <vector>
 
 // APPLICATION INCLUDES
 #include <utl/UtlHashBag.h>
+#include <utl/UtlSList.h>
 #include <utl/UtlBlockingQueue.h>
 #include <os/OsServerTask.h>
 #include <net/SipUserAgentBase.h>
@@ -68,6 +69,7 @@ class SipSession;
 class SipTcpServer;
 class SipTlsServer;
 class SipLineMgr;
+class SipObserverCriteria;
 
 //! Transaction and Transport manager for SIP stack
 /*! Note SipUserAgent is perhaps not the best name for this class.
@@ -178,10 +180,18 @@ public:
       SipTransaction* ptr;
     };
 
+    /// Transactions to cancel together, e.g. the other branches of a fork
+    /// when one of them is answered.
+    struct CancelBatch
+    {
+      std::vector<TransactionInfo> transactions;
+      Int64 queuedTime; ///< UtlMetricHistogram::now() when the batch was queued
+    };
+
     typedef boost::function<bool(SipMessage&,const UtlString&,int)> Preprocessor;
     typedef boost::function<bool(SipMessage*)> DispatchEvaluator;
     typedef boost::function<void(SipTransaction*, const SipMessage&, SipMessage&)> FinalResponseHandler;
-    typedef UtlBlockingQueue<TransactionInfo*> MessageCancelQueue;
+    typedef UtlBlockingQueue<CancelBatch*> MessageCancelQueue;
     
     enum EventSubTypes
     {
@@ -563,16 +573,37 @@ public:
     //! Print diagnostics
     void printStatus();
 
-    void startMessageLog(int newMaximumLogSize = 0);
+    /// Start recording the messages sent and received.
+    void startMessageLog(int newMaximumLogSize = 0 /**< bytes kept per recording
+                                                    *   thread; 0 keeps the size,
+                                                    *   -1 sets the default */
+                         );
 
     void stopMessageLog();
 
     void clearMessageLog();
 
+    /// Record a line of text in the message log (shown only by getMessageLog).
     virtual void logMessage(const char* message, int messageLength);
 
+    /// Keep a message sent or received in the message log, if it is started.
+    virtual void recordMessage(SipMessageRecorder::Direction direction,
+                               OsSocket::IpProtocolSocketType transport,
+                               const char* localAddress,
+                               int localPort,
+                               const char* remoteAddress,
+                               int remotePort,
+                               const char* bytes,
+                               size_t length,
+                               bool failed = false
+                               );
+
+    /// Get the message log as text, in the format of the OUTGOING/INCOMING log.
     void getMessageLog(UtlString& logData);
 
+    /// The recorder behind the message log, to export it as pcapng or siptrace XML.
+    const SipMessageRecorder& getMessageRecorder() const;
+
     int getSipStateTransactionTimeout();
 
     // Manipulate mDefaultExpiresSeconds, the default time to let a transaction live.
@@ -729,12 +760,22 @@ public:
     
     Preprocessor& preprocessor();
 
+    /// Set the evaluator that may take a message read from the network
+    /// away from this user agent, e.g. to pass it to another process.
+    /// It returns true if it took (and deleted) the message.
+    void setSteering(const DispatchEvaluator& steering);
+
+    DispatchEvaluator& steering();
+
     const SipTransactionList& getSipTransactions() const;
     
     void onFinalResponse(SipTransaction* pTransaction, const SipMessage& request, SipMessage& finalResponse);
     
     void enqueueCancelMessage(SipTransaction* pTransaction);
 
+    /// Cancel the transactions of pBatch on the cancel thread, which deletes pBatch.
+    void enqueueCancelMessages(CancelBatch* pBatch);
+
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
 protected:
 
@@ -823,9 +864,12 @@ private:
     UtlString mUserAgentHeaderProperties;
     UtlHashBag mMyHostAliases;
     UtlHashBag mMessageObservers;
+    /// The observers of each well-known method, which mMessageObservers owns.
+    /*! Observers of no method or of an extension method are found in
+     *  mMessageObservers by the method name.
+     */
+    UtlSList mMethodObservers[SipTokens::METHOD_COUNT];
     UtlSortedList mOutputProcessors;
-    OsRWMutex mMessageLogRMutex;
-    OsRWMutex mMessageLogWMutex;
     OsRWMutex mOutputProcessorMutex;
     UtlSortedList mSipInputProcessors;
     OsRWMutex mSipInputProcessorMutex;
@@ -869,8 +913,7 @@ private:
     OsConfigDb* mpAuthorizationUserIds;
     OsConfigDb* mpAuthorizationPasswords;
     SipLineMgr* mpLineMgr;
-    int mMaxMessageLogSize;
-    UtlString mMessageLog;
+    SipMessageRecorder mMessageRecorder;
     /** TRUE when this SipUserAgent is functioning as a UA,
      *  FALSE when it is functioning as a proxy.
      */
@@ -893,7 +936,13 @@ private:
     OptionsRequestHandlePref mHandleOptionsRequests;
 
     void queueMessageToInterestedObservers(SipMessageEvent& event,
-                                           const UtlString& method);
+                                           const UtlString& method,
+                                           SipTokens::Method methodId);
+    void queueMessageToObserver(SipMessageEvent& event,
+                                SipObserverCriteria* observerCriteria,
+                                SipTokens::Method methodId,
+                                const UtlString& messageEventName,
+                                SipTokens::EventPackage messageEventPackage);
     void queueMessageToObservers(SipMessage* message,
                                  int messageType);
 
@@ -911,8 +960,10 @@ private:
     DispatchEvaluator _preDispatch;
     FinalResponseHandler _finalResponseHandler;
     Preprocessor _preprocessor;
+    DispatchEvaluator _steering;
     MessageCancelQueue _cancelQueue;
     boost::thread* _pCancelQueueThread;
+    CancelBatch* _pCancelFollowUps; ///< cancels that the cancel thread queues while it processes a batch
 
     //! Disabled copy constructor
     SipUserAgent(const SipUserAgent& rSipUserAgent);
@@ -921,6 +972,7 @@ private:
     SipUserAgent& operator=(const SipUserAgent& rhs);
 
     friend class SipTransactionList;
+    friend class SipTransactionTest;
 };
 
 /* ============================ INLINE METHODS ============================ */
@@ -970,5 +1022,15 @@ inline SipUserAgent::Preprocessor& SipUserAgent::preprocessor()
   return _preprocessor;
 }
 
+inline void SipUserAgent::setSteering(const DispatchEvaluator& steering)
+{
+  _steering = steering;
+}
+
+inline SipUserAgent::DispatchEvaluator& SipUserAgent::steering()
+{
+  return _steering;
+}
+
 
 #endif  // _SipUserAgent_h_
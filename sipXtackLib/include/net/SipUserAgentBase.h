@@ -23,6 +23,7 @@
 #include <net/SipMessage.h>
 #include <net/SipMessageEvent.h>
 #include <net/SipContactDb.h>
+#include <net/SipMessageRecorder.h>
 
 // DEFINES
 // MACROS
@@ -107,6 +108,18 @@ public:
 
     virtual void logMessage(const char* message, int messageLength) = 0;
 
+    /// Keep a message sent or received in the message recorder, if there is one.
+    virtual void recordMessage(SipMessageRecorder::Direction direction,
+                               OsSocket::IpProtocolSocketType transport,
+                               const char* localAddress,
+                               int localPort,
+                               const char* remoteAddress,
+                               int remotePort,
+                               const char* bytes,
+                               size_t length,
+                               bool failed = false
+                               );
+
     virtual void getContactUri(UtlString* contactUri) ;
     
     void setDomain(const std::string& domain);
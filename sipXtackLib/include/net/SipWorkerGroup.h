@@ -0,0 +1,168 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+//////
+
+#ifndef _SipWorkerGroup_h_
+#define _SipWorkerGroup_h_
+
+// SYSTEM INCLUDES
+#include <sys/types.h>
+#include <stdint.h>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include "utl/UtlMetrics.h"
+#include "utl/UtlString.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+class SipMessage;
+class SipUserAgent;
+namespace boost { class thread; }
+
+/// Runs a SIP server as several worker processes that share its ports.
+/**
+ * The workers are forked from one process before it starts any threads of
+ * its own, and each binds the SIP ports with SO_REUSEPORT (see
+ * OsSocket::setReusePort()), so the kernel spreads the TCP connections and
+ * the UDP datagrams over them by source address.  Nothing else is shared:
+ * each worker has its own user agent, transactions, caches and logger.
+ *
+ * The messages of one transaction need not come from one source, though:
+ * a CANCEL may come from another port than its INVITE, and the responses
+ * come from the next hop.  So each worker records the transactions of the
+ * requests it takes in a table in memory shared by the workers, keyed by
+ * Call-ID and CSeq number, and steers every message it reads: a message
+ * of a transaction that another worker has recorded is relayed to that
+ * worker over a local datagram socket, together with its source address,
+ * and dispatched there as if that worker had read it.  Everything else is
+ * dispatched where it was read.
+ *
+ * Requests that came over TCP or TLS are never relayed, as only the worker
+ * holding the connection can answer on it; that worker records them as
+ * its own instead.  A transaction that no worker recorded, or whose record
+ * has expired or did not fit in the table, is handled where it is read,
+ * like in a single process.
+ */
+class SipWorkerGroup
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+  public:
+
+   enum
+   {
+      MAX_WORKERS = 64,
+      DEFAULT_TABLE_SLOTS = 1 << 20,  ///< 16 bytes each
+      DEFAULT_CLAIM_SECONDS = 212,    ///< Timer C and a transaction linger
+      PROBES = 8                      ///< slots searched for a transaction
+   };
+
+   /// Set up the shared table and the relay sockets of workers workers.
+   /**
+    * This process is worker 0 until fork() is called.
+    */
+   SipWorkerGroup(unsigned int workers,
+                  unsigned int claimSeconds = DEFAULT_CLAIM_SECONDS,
+                  unsigned int tableSlots = DEFAULT_TABLE_SLOTS);
+
+   ~SipWorkerGroup();
+
+   /// Fork the other workers.
+   /**
+    * Call this before any thread but the calling one is started, as the
+    * children have only the calling thread.  A child is sent SIGTERM when
+    * its parent exits.
+    * @return the worker this process is: 0 in the parent.
+    */
+   unsigned int fork();
+
+   /// Send SIGTERM to the workers forked by this process.
+   void stopWorkers();
+
+   /// Steer the messages userAgent reads, and dispatch the ones relayed to this worker.
+   void start(SipUserAgent& userAgent);
+
+   /// Stop dispatching relayed messages.
+   void stop();
+
+   /// Steering for SipUserAgent::setSteering().
+   /**
+    * @return true if message was relayed to another worker and deleted.
+    */
+   bool steer(SipMessage* message);
+
+   /// Record that worker owns the transaction of message.
+   /**
+    * @return false if the table has no room for it near its hash.
+    */
+   bool claim(const SipMessage& message, unsigned int worker);
+
+   /// The worker that recorded the transaction of message, or -1.
+   int getOwner(const SipMessage& message) const;
+
+   /// Take a message relayed to this worker, waiting up to timeoutMs.
+   /**
+    * @return NULL if none came; the caller owns the message.
+    */
+   SipMessage* receive(int timeoutMs);
+
+   unsigned int getWorker() const { return mWorker; }
+
+   unsigned int getWorkers() const { return mWorkers; }
+
+   /// Act as another worker, for a group whose workers are not forked.
+   void setWorker(unsigned int worker);
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+  private:
+
+   struct Slot
+   {
+      volatile uint64_t key;       ///< 0 if never used
+      volatile uint32_t worker;
+      volatile uint32_t expires;   ///< seconds since the epoch
+   };
+
+   /// The table key of the transaction of message; never 0.
+   static uint64_t keyOf(const SipMessage& message);
+
+   /// Pass message to worker; false if its socket does not take it.
+   bool relay(const SipMessage& message, unsigned int worker);
+
+   /// Body of the thread that dispatches relayed messages.
+   void run();
+
+   unsigned int mWorkers;
+   unsigned int mWorker;
+   unsigned int mClaimSeconds;
+   uint64_t mSlotMask;
+   Slot* mpSlots;                  ///< shared by all workers
+   size_t mTableBytes;
+   std::vector<int> mReceiveFds;   ///< socket each worker reads relayed messages on
+   std::vector<int> mSendFds;      ///< socket other workers write them to
+   std::vector<pid_t> mChildren;
+   SipUserAgent* mpUserAgent;
+   boost::thread* mpRelayThread;
+   volatile bool mStopping;
+   UtlMetricCounter* mpRelayed;       ///< sipx_worker_relayed_total
+   UtlMetricCounter* mpClaimFailures; ///< sipx_worker_claim_failures_total
+
+   //! Disabled copy constructor
+   SipWorkerGroup(const SipWorkerGroup&);
+
+   //! Disabled assignment operator
+   SipWorkerGroup& operator=(const SipWorkerGroup&);
+};
+
+#endif  // _SipWorkerGroup_h_
@@ -13,6 +13,7 @@
 // SYSTEM INCLUDES
 // APPLICATION INCLUDES
 #include <xmlparser/tinyxml.h>
+#include <xmlparser/XmlPullParser.h>
 #include <net/HttpBody.h>
 #include <utl/UtlHashMap.h>
 
@@ -157,6 +158,33 @@ class XmlRpcBody : public HttpBody
                               );
    ///< @returns NULL and sets errorTxt if there was a parse error
 
+   /// Parse a value in a streamed XML-RPC request
+   static
+      UtlContainable* parseValue(XmlPullParser& parser, ///< on the <value> start tag
+                                 int nestDepth,         ///< current level of recursion
+                                 UtlString& errorTxt    ///< explanation of parse error if any
+                                 );
+   /**<
+    * Leaves the parser on the matching </value>.
+    * @returns NULL and sets errorTxt if there was a parse error
+    */
+
+   /// Parse an array in a streamed XML-RPC request
+   static
+      UtlSList* parseArray(XmlPullParser& parser, ///< on the <array> start tag
+                           int nestDepth,         ///< current level of recursion
+                           UtlString& errorTxt    ///< explanation of parse error if any
+                           );
+   ///< @returns NULL and sets errorTxt if there was a parse error
+
+   /// Parse a struct in a streamed XML-RPC request
+   static
+      UtlHashMap* parseStruct(XmlPullParser& parser, ///< on the <struct> start tag
+                              int nestDepth,         ///< current level of recursion
+                              UtlString& errorTxt    ///< explanation of parse error if any
+                              );
+   ///< @returns NULL and sets errorTxt if there was a parse error
+
    /// Delete the value and any memory it contains
    static
       void deallocateValue(UtlContainable*& value);
@@ -112,7 +112,43 @@ int SipLogCommand::execute(int argc, char* argv[])
 
         }
 
-        if(argc != 2)
+        else if(argc == 3)
+        {
+            UtlString logOperations(argv[1]);
+            UtlString data;
+            if(logOperations.compareTo("pcap") == 0)
+            {
+                mSipUserAgent->getMessageRecorder().exportPcapng(data);
+            }
+            else if(logOperations.compareTo("siptrace") == 0)
+            {
+                mSipUserAgent->getMessageRecorder().exportSipTrace(data, "siptest");
+            }
+            else
+            {
+                argc = 1;
+            }
+
+            if(argc == 3)
+            {
+                FILE* file = fopen(argv[2], "w");
+                if(file && fwrite(data.data(), 1, data.length(), file) == data.length())
+                {
+                    commandStatus = CommandProcessor::COMMAND_SUCCESS;
+                    osPrintf("SIP log written to %s\n", argv[2]);
+                }
+                else
+                {
+                    osPrintf("could not write %s\n", argv[2]);
+                }
+                if(file)
+                {
+                    fclose(file);
+                }
+            }
+        }
+
+        if(argc != 2 && argc != 3)
         {
                 UtlString usage;
                 getUsage(argv[0], &usage);
@@ -130,7 +166,7 @@ int SipLogCommand::execute(int argc, char* argv[])
 void SipLogCommand::getUsage(const char* commandName, UtlString* usage) const
 {
         Command::getUsage(commandName, usage);
-        usage->append(" stop|start|dump|clear\n");
+        usage->append(" stop|start|dump|clear\n\tpcap|siptrace <file>\n");
 }
 
 /* ============================ ACCESSORS ================================= */
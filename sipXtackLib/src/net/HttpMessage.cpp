@@ -34,6 +34,7 @@
 #include <os/OsUtil.h>
 #include <os/OsConnectionSocket.h>
 #include <utl/UtlVoidPtr.h>
+#include <utl/UtlByteScan.h>
 #ifdef HAVE_SSL
 #include <os/OsSSLConnectionSocket.h>
 #endif /* HAVE_SSL */
@@ -76,8 +77,9 @@ int HttpMessage::smHttpMessageCount = 0;
 
 // Constructor
 HttpMessage::HttpMessage(const char* messageBytes, ssize_t byteCount)
-   : mHeaderCacheClean(FALSE)
-   , body(NULL)
+   : mRequestMethod(SipTokens::METHOD_UNKNOWN)
+   , mHeaderCacheClean(FALSE)
+   , mpHeaders(new Headers)
    , mUseChunkedEncoding(false)
    , transportTimeStamp(0)
    , lastResendInterval(0)
@@ -100,8 +102,9 @@ HttpMessage::HttpMessage(const char* messageBytes, ssize_t byteCount)
 }
 
 HttpMessage::HttpMessage(OsSocket* inSocket, ssize_t bufferSize)
-   : mHeaderCacheClean(FALSE)
-   , body(NULL)
+   : mRequestMethod(SipTokens::METHOD_UNKNOWN)
+   , mHeaderCacheClean(FALSE)
+   , mpHeaders(new Headers)
    , mUseChunkedEncoding(false)
    , transportTimeStamp(0)
    , lastResendInterval(0)
@@ -133,14 +136,14 @@ HttpMessage::HttpMessage(const HttpMessage& rHttpMessage) :
 
    smHttpMessageCount++;
 
+    // The copy shares the headers and body until either message changes them.
     mHeaderCacheClean = rHttpMessage.mHeaderCacheClean;
+    mpHeaders = rHttpMessage.mpHeaders;
+    mpHeaderBytes = rHttpMessage.mpHeaderBytes;
     mFirstHeaderLine = rHttpMessage.mFirstHeaderLine;
+    mRequestMethod = rHttpMessage.mRequestMethod;
     mUseChunkedEncoding = rHttpMessage.mUseChunkedEncoding;
-    body = NULL;
-    if(rHttpMessage.body)
-    {
-        body = rHttpMessage.body->copy();
-    }
+    body = rHttpMessage.body;
     //nameValues = new UtlHashBag(100);
     transportTimeStamp = rHttpMessage.transportTimeStamp;
     lastResendInterval = rHttpMessage.lastResendInterval;
@@ -151,8 +154,6 @@ HttpMessage::HttpMessage(const HttpMessage& rHttpMessage) :
     mpResponseListenerQueue = rHttpMessage.mpResponseListenerQueue;
     mResponseListenerData = rHttpMessage.mResponseListenerData;
 
-    rHttpMessage.mNameValues.copyTo<NameValuePair>( mNameValues );
-
 #ifdef HTTP_TIMELOG
     mTimeLog = rHttpMessage.mTimeLog;
 #endif
@@ -166,22 +167,8 @@ HttpMessage::~HttpMessage()
 {
   system_tap_sip_msg_destroyed((intptr_t)this);
     smHttpMessageCount--;
-    NameValuePair* headerField = NULL;
 
     mHeaderCacheClean = FALSE;
-
-    // For each name value:
-    while((headerField = (NameValuePair*) mNameValues.get()))
-    {
-        delete headerField;
-        headerField = NULL;
-    }
-
-    if(body)
-    {
-            delete body;
-            body = 0;
-    }
 }
 
 UtlContainableType HttpMessage::getContainableType(void) const
@@ -201,27 +188,13 @@ HttpMessage::operator=(const HttpMessage& rHttpMessage)
    else
    {
        smHttpMessageCount--;
+       // Share the headers and body, dropping those of this message
        mHeaderCacheClean = rHttpMessage.mHeaderCacheClean;
+       mpHeaders = rHttpMessage.mpHeaders;
+       mpHeaderBytes = rHttpMessage.mpHeaderBytes;
        mFirstHeaderLine = rHttpMessage.mFirstHeaderLine;
-           //nameValues.destroyAll();
-       // Get rid of any headers which exist in this message
-       NameValuePair* headerField = NULL;
-       while((headerField = (NameValuePair*) mNameValues.get()))
-       {
-           delete headerField;
-           headerField = NULL;
-       }
-
-       if(body)
-       {
-           delete body;
-           body = NULL;
-       }
-
-       if(rHttpMessage.body)
-       {
-           body = rHttpMessage.body->copy();
-       }
+       mRequestMethod = rHttpMessage.mRequestMethod;
+       body = rHttpMessage.body;
 
       //use copy constructor to copy values
        smHttpMessageCount++;
@@ -234,14 +207,6 @@ HttpMessage::operator=(const HttpMessage& rHttpMessage)
        mpResponseListenerQueue = rHttpMessage.mpResponseListenerQueue;
        mResponseListenerData = rHttpMessage.mResponseListenerData;
 
-       NameValuePair* copiedHeader = NULL;
-       UtlDListIterator iterator((UtlDList&)rHttpMessage.mNameValues);
-       while((headerField = (NameValuePair*) iterator()))
-       {
-           copiedHeader = new NameValuePair(*headerField);
-           mNameValues.append(copiedHeader);
-       }
-
 #ifdef HTTP_TIMELOG
        mTimeLog = rHttpMessage.mTimeLog;
 #endif
@@ -302,6 +267,7 @@ ssize_t HttpMessage::parseFirstLine(const char* messageBytesPtr, ssize_t byteCou
                         bytesConsumed = byteCount;
       }
    }
+   internRequestMethod();
 
    return(bytesConsumed);
 }
@@ -321,8 +287,8 @@ void HttpMessage::parseMessage(const char* messageBytes, ssize_t byteCount)
       {
          byteCount = 0;
          mFirstHeaderLine = OsUtil::NULL_OS_STRING;
-         if(body) delete body;
-         body = NULL;
+         mRequestMethod = SipTokens::METHOD_UNKNOWN;
+         body.reset();
       }
    }
 
@@ -336,18 +302,13 @@ void HttpMessage::parseMessage(const char* messageBytes, ssize_t byteCount)
 
       // Parse the headers out and add them to the list
       bytesConsumed += parseHeaders(messageBytes + bytesConsumed, byteCount - bytesConsumed,
-                                    mNameValues);
+                                    changeNameValues());
 
       // Create the body if there is stuff left
       if(byteCount > bytesConsumed)
       {
          messageBytesPtr = messageBytes + bytesConsumed;
 
-         if(body)
-         {
-            delete body;
-         }
-
          // Construct the body from the remaining bytes
          parseBody(messageBytesPtr, byteCount - bytesConsumed);
 
@@ -379,59 +340,34 @@ void HttpMessage::parseBody(const char* messageBytesPtr, ssize_t bodyLength)
         contentEncodingString = getHeaderValue(0, "E");
     }
 
-    body = HttpBody::createBody(messageBytesPtr,
-                                bodyLength,
-                                contentType,
-                                contentEncodingString);
+    body.reset(HttpBody::createBody(messageBytesPtr,
+                                    bodyLength,
+                                    contentType,
+                                    contentEncodingString));
 }
 
 ssize_t HttpMessage::findHeaderEnd(const char* headerBytes, ssize_t messageLength)
 {
-    ssize_t lineLength = 0;
-    ssize_t nextLineIndex = 0;
-    ssize_t bytesConsumed = 0;
-    while(messageLength - bytesConsumed > 0 &&
-          (lineLength =
-            NameValueTokenizer::findNextLineTerminator(&headerBytes[bytesConsumed],
-                messageLength - bytesConsumed, &nextLineIndex)))
-    {
-            if(nextLineIndex > 0)
-            {
-                    bytesConsumed += nextLineIndex;
-            }
-            else
-            {
-            if(lineLength < 0)
-            {
-                bytesConsumed += messageLength - bytesConsumed;
-            }
-            else
-            {
-                    bytesConsumed += lineLength;
-            }
-            }
-    }
+    ssize_t lineStart = 0;
+    return findHeaderEnd(headerBytes, messageLength, lineStart);
+}
 
-    // If we found a blank line:
-    if(nextLineIndex == 1 && (headerBytes[bytesConsumed] == NEWLINE ||
-        headerBytes[bytesConsumed] == CARRIAGE_RETURN))
-    {
-        bytesConsumed++;
-    }
-    else if(nextLineIndex == 2 && (headerBytes[bytesConsumed] == NEWLINE ||
-        headerBytes[bytesConsumed] == CARRIAGE_RETURN) &&
-        ((headerBytes[bytesConsumed + 1] == NEWLINE ||
-        headerBytes[bytesConsumed + 1] == CARRIAGE_RETURN)))
+ssize_t HttpMessage::findHeaderEnd(const char* headerBytes, ssize_t messageLength,
+                                   ssize_t& lineStart)
+{
+    ssize_t headerEnd = HTTP_NOT_FOUND;
+    if(messageLength > 0)
     {
-        bytesConsumed += 2;
+        size_t scanned = lineStart;
+        headerEnd = UtlByteScan::findBlankLine(headerBytes, messageLength, scanned);
+        lineStart = scanned;
+        if(headerEnd < 0)
+        {
+            headerEnd = HTTP_NOT_FOUND;
+        }
     }
 
-    // If we did not find a terminator, there is no explicit end to the
-    // headers
-    else
-        bytesConsumed = HTTP_NOT_FOUND;
-
-    return(bytesConsumed);
+    return(headerEnd);
 }
 
 ssize_t HttpMessage::parseHeaders(const char* headerBytes, ssize_t messageLength,
@@ -620,7 +556,7 @@ OsStatus HttpMessage::get/*[5]*/(Url& httpUrl,
       {
          mHeaderCacheClean = FALSE;
          ssize_t iHeaderLength = parseFirstLine(buffer.data(), iRead) ;
-         parseHeaders(&buffer.data()[iHeaderLength], iRead-iHeaderLength, mNameValues) ;
+         parseHeaders(&buffer.data()[iHeaderLength], iRead-iHeaderLength, changeNameValues()) ;
 
          ssize_t iContentLength = getContentLength() ;
          if (iContentLength > 0)
@@ -989,12 +925,8 @@ int HttpMessage::get/*[4]*/(Url& httpUrl,
 
                 // Clear out the data in the previous response
                 mHeaderCacheClean = FALSE;
-                mNameValues.destroyAll();
-                if(body)
-                {
-                   delete body;
-                   body = NULL;
-                }
+                mpHeaders = new Headers;
+                body.reset();
 
                 // Wait for the response
                 if(   bytesSent > 0
@@ -1152,12 +1084,12 @@ int HttpMessage::read(OsSocket* inSocket, ssize_t bufferSize,
    mHeaderCacheClean = FALSE;
    // Remember to empty the list of parsed header values, as we will use it
    // to parse the headers on the HTTP response we are going to read.
-   mNameValues.destroyAll();
+   mpHeaders = new Headers;
    
    //
    // HEY YOU! 
    //
-   // If you are not me (Joegen) and you are reading this note, destorying mNameValues contents above
+   // If you are not me (Joegen) and you are reading this note, destorying the headers above
    // is not enough.  "body" member (yes not mBody) will also leak!  So we must check it for nullity here
    // and delete it if it's non-NULL.  Reason why I did not do it yet is because I am not sure whether
    // external code actually deletes is explicitly when trying to recycle and HttpMessage.  If you have
@@ -1167,8 +1099,7 @@ int HttpMessage::read(OsSocket* inSocket, ssize_t bufferSize,
    #if 1
    if (body)
    {
-       delete body;
-       body = 0;
+       body.reset();
    }
    #else
    if (body)
@@ -1234,6 +1165,9 @@ int HttpMessage::read(OsSocket* inSocket, ssize_t bufferSize,
       // The byte offset of the end of the header.  -1 means the end
       // has not yet been seen.
       ssize_t headerEnd = HTTP_NOT_FOUND;
+      // Where to resume looking for the end of the header when more
+      // bytes arrive; the lines before it are not blank.
+      ssize_t headerScanned = 0;
 
       // The length of the content.  -1 means the end is not yet known.
       int contentLength = -1;
@@ -1338,7 +1272,7 @@ int HttpMessage::read(OsSocket* inSocket, ssize_t bufferSize,
             // If we have not yet found the end of the headers
             if (headerEnd < 0)
             {
-               headerEnd = findHeaderEnd(allBytes->data(), bytesTotal);
+               headerEnd = findHeaderEnd(allBytes->data(), bytesTotal, headerScanned);
 
                // UDP and Multicast UDP you can only do one read
                // The fragmentation is handled at the socket layer
@@ -1357,7 +1291,7 @@ int HttpMessage::read(OsSocket* inSocket, ssize_t bufferSize,
                   // Parse all of the headers
                   parseHeaders(&(allBytes->data()[endOfFirstLine]),
                                headerEnd - endOfFirstLine,
-                               mNameValues);
+                               changeNameValues());
 
                   // Get the content length
                   {
@@ -1692,6 +1626,7 @@ UtlBoolean HttpMessage::writeHeaders(OsSocket* outSocket) const
 /// Mark this message as using chunked encoding to delimit the body @see writeHeaders
 void HttpMessage::useChunkedBody(bool useChunked)
 {
+   mHeaderCacheClean = FALSE;
    mUseChunkedEncoding = useChunked;
    if (mUseChunkedEncoding)
    {
@@ -1701,7 +1636,7 @@ void HttpMessage::useChunkedBody(bool useChunked)
                        "HttpMessage::useChunkedBody "
                        "used on a message that has a body - existing body deleted");
          assert(body);
-         delete body;
+         body.reset();
       }
       removeHeader(HTTP_CONTENT_LENGTH_FIELD, 0);
       setHeaderValue(HTTP_TRANSFER_ENCODING_FIELD, "chunked");
@@ -2001,6 +1936,7 @@ void HttpMessage::setFirstHeaderLine(const char* newHeaderLine)
     {
         mFirstHeaderLine.remove(0);
     }
+    internRequestMethod();
 }
 
 void HttpMessage::setFirstHeaderLine(const char* subfield0, const char* subfield1,
@@ -2130,26 +2066,24 @@ int HttpMessage::getCountHeaderFields(const char* name) const
                 UtlString nameString(name);
                 nameString.toUpper();
                 UtlString nameCollectable(nameString);
-                fieldCount = mNameValues.occurrencesOf(&nameCollectable);
+                fieldCount = nameValues().occurrencesOf(&nameCollectable);
         }
         else
         {
-                fieldCount = mNameValues.entries();
+                fieldCount = nameValues().entries();
         }
         return(fieldCount);
 }
 
 NameValuePair* HttpMessage::getHeaderField(int index, const char* name) const
 {
-   	  UtlDListIterator iterator((UtlDList&)mNameValues);
+   	  UtlDListIterator iterator((UtlDList&)nameValues());
         NameValuePair* headerField = NULL;
         int fieldIndex = 0;
 
-        UtlString headerFieldName(name ? name : "");
-        if(name)
-        {
-           headerFieldName.toUpper();
-        }
+        // Header names are kept upper case, so compare ignoring case
+        // rather than building an upper case copy of name to look up.
+        size_t nameLength = name ? strlen(name) : 0;
 
         // For each name value:
         while(fieldIndex <= index)
@@ -2157,8 +2091,12 @@ NameValuePair* HttpMessage::getHeaderField(int index, const char* name) const
                 // Go to the next header field
                 if(name)
                 {
-
-                   headerField = (NameValuePair*) iterator.findNext(&headerFieldName);
+                   while((headerField = (NameValuePair*) iterator()) &&
+                         !(headerField->length() == nameLength &&
+                           UtlByteScan::equalsIgnoreCase(headerField->data(), name,
+                                                         nameLength)))
+                   {
+                   }
                 }
 
                 else
@@ -2187,7 +2125,8 @@ const char* HttpMessage::getHeaderValue(int index, const char* name) const
 void HttpMessage::setHeaderValue(const char* name, const char* newValue, int index)
 {
  
-    mHeaderCacheClean = FALSE;
+    // Change the header in headers of this message only
+    changeNameValues();
         NameValuePair* headerField = getHeaderField(index, name);
 
         if(headerField)
@@ -2203,9 +2142,9 @@ void HttpMessage::setHeaderValue(const char* name, const char* newValue, int ind
 
 UtlBoolean HttpMessage::removeHeader(const char* name, int index)
 {
-   mHeaderCacheClean = FALSE;
+   UtlDList& headers = changeNameValues();
    UtlBoolean foundHeader = FALSE;
-   UtlDListIterator iterator((UtlDList&)mNameValues);
+   UtlDListIterator iterator(headers);
    NameValuePair* headerFieldName = NULL;
    NameValuePair* headerField = NULL;
    int fieldIndex = 0;
@@ -2245,7 +2184,7 @@ UtlBoolean HttpMessage::removeHeader(const char* name, int index)
    }
    if(headerField)
    {
-      mNameValues.removeReference(headerField);
+      headers.removeReference(headerField);
       delete headerField;
       foundHeader = TRUE;
    }
@@ -2255,36 +2194,66 @@ UtlBoolean HttpMessage::removeHeader(const char* name, int index)
 
 void HttpMessage::addHeaderField(const char* name, const char* value)
 {
-    mHeaderCacheClean = FALSE;
     NameValuePair* headerField =
         new NameValuePair(name ? name : "", value);
     headerField->toUpper();
-        mNameValues.insert(headerField);
+        changeNameValues().insert(headerField);
 }
 
 void HttpMessage::insertHeaderField(const char* name,
                                     const char* value,
                                     int index)
 {
-    mHeaderCacheClean = FALSE;
     NameValuePair* headerField =
         new NameValuePair(name ? name : "", value);
     headerField->toUpper();
-        mNameValues.insertAt(index, headerField);
+        changeNameValues().insertAt(index, headerField);
 }
 
 const HttpBody* HttpMessage::getBody() const
 {
-        return(body);
+        return(body.get());
 }
 
 void HttpMessage::setBody(HttpBody* newBody)
 {
-        if(body)
-        {
-                delete body;
-        }
-        body = newBody;
+        body.reset(newBody);
+}
+
+UtlDList& HttpMessage::changeNameValues()
+{
+   mHeaderCacheClean = FALSE;
+   if (!mpHeaders->isUnshared())
+   {
+      mpHeaders = new Headers(*mpHeaders);
+   }
+   return mpHeaders->nameValues;
+}
+
+HttpMessage::HeaderBytes::HeaderBytes()
+   : bodyLength(0)
+{
+}
+
+HttpMessage::Headers::Headers()
+   : mReferences(0)
+{
+}
+
+HttpMessage::Headers::Headers(const Headers& rHeaders)
+   : mReferences(0)
+{
+   rHeaders.nameValues.copyTo<NameValuePair>(nameValues);
+}
+
+bool HttpMessage::Headers::isUnshared()
+{
+   return __sync_add_and_fetch(&mReferences, 0) == 1;
+}
+
+HttpMessage::Headers::~Headers()
+{
+   nameValues.destroyAll();
 }
 
 UtlBoolean HttpMessage::getContentType(UtlString* contentTypeString) const
@@ -2426,201 +2395,242 @@ void HttpMessage::setLocationField(const char* locationField)
 
 std::string HttpMessage::getString(bool includeBody) const
 {
+  UtlString bodyBytes;
+  ssize_t bodyLen;
+  boost::shared_ptr<const UtlString> headerBytes = getHeaderBytes(&bodyBytes, &bodyLen, includeBody);
+
   std::string bytes;
-  bytes.reserve(1500);
-  bytes += mFirstHeaderLine.data();
-  bytes += END_OF_LINE_DELIMITER;
+  bytes.reserve(headerBytes->length() + bodyLen);
+  bytes.append(headerBytes->data(), headerBytes->length());
+  bytes.append(bodyBytes.data(), bodyLen);
 
+  return bytes;
+}
 
-  UtlDListIterator iterator((UtlDList&)mNameValues);
-  NameValuePair* headerField;
-  UtlBoolean foundContentLengthHeader = FALSE;
-  ssize_t bodyLen = 0;
-  UtlString bodyBytes;
-  if(includeBody && body)
-  {
-     body->getBytes(&bodyBytes, &bodyLen);
-  }
-
-  ssize_t oldLen = 0 ;
-  if(mHeaderCacheClean &&
-      bodyLen == (oldLen = getContentLength()))
-  {
-      oldLen = 0;
-  }
-  else
-  {
-      ((HttpMessage*)this)->mHeaderCacheClean = TRUE;
-      oldLen = 0;
-  }
-
-  UtlString name;
-  const char* value;
-  // For each name value:
-  while((headerField = (NameValuePair*) iterator()))
-  {
-    // Do not free up name and data as this are contained
-    // in the NameValuePair
-    name = *headerField;
-    cannonizeToken(name);
-    value = headerField->getValue();
-
-    // Keep track while we are looping through if we see a
-    // content-length header or not
-    if(name.compareTo(HTTP_CONTENT_LENGTH_FIELD, UtlString::ignoreCase) == 0)
-    {
-      foundContentLengthHeader = TRUE;
-      ssize_t fieldBodyLengthValue = atoi(value ? value : "");
-      if(fieldBodyLengthValue != bodyLen)
-      {
-        char bodyLengthString[40];
-        sprintf(bodyLengthString, "%zu", bodyLen);
-        headerField->setValue(bodyLengthString);
-        value = headerField->getValue();
-      }
+void HttpMessage::getBytes(UtlString* bufferString, ssize_t* length, bool includeBody) const
+{
+    UtlString bodyBytes;
+    ssize_t bodyLen = 0;
+    if(includeBody && body)
+    {
+       body->getBytes(&bodyBytes, &bodyLen);
     }
 
-    bytes += name.data();
-    bytes += HTTP_NAME_VALUE_DELIMITER;
-    bytes += " ";
-    if(value)
+    bufferString->remove(0);
+    if(isHeaderBytesCurrent(bodyLen))
     {
-      bytes += value;
+        bufferString->capacity(mpHeaderBytes->bytes.length() + bodyLen + 1);
+        bufferString->append(mpHeaderBytes->bytes);
     }
-    bytes += END_OF_LINE_DELIMITER;
- }
-
-  // Make sure the content length is set
-  if(!foundContentLengthHeader && !mUseChunkedEncoding)
-  {
+    else
+    {
+        formatHeaders(bodyLen, *bufferString, NULL);
+    }
+    bufferString->append(bodyBytes.data(), bodyLen);
 
-    bytes += HTTP_CONTENT_LENGTH_FIELD;
-    bytes += HTTP_NAME_VALUE_DELIMITER;
-    char bodyLengthString[40];
-    sprintf(bodyLengthString, " %zu", bodyLen);
-    bytes += bodyLengthString;
-    bytes += END_OF_LINE_DELIMITER;
-  }
+    *length = bufferString->length();
+}
 
-  bytes += END_OF_LINE_DELIMITER;
+boost::shared_ptr<const UtlString> HttpMessage::getHeaderBytes(UtlString* bodyBytes,
+                                                               ssize_t* bodyLength,
+                                                               bool includeBody) const
+{
+    *bodyLength = 0;
+    bodyBytes->remove(0);
+    if(includeBody && body)
+    {
+       body->getBytes(bodyBytes, bodyLength);
+    }
 
-  if(body)
-  {
-      bytes += std::string(bodyBytes.data(), bodyLen);
-  }
+    // The bytes kept by serializeHeaders() are shared as they are; if
+    // they are stale, the headers are serialized for this call only.
+    boost::shared_ptr<const HeaderBytes> headerBytes;
+    if(isHeaderBytesCurrent(*bodyLength))
+    {
+        headerBytes = mpHeaderBytes;
+    }
+    else
+    {
+        boost::shared_ptr<HeaderBytes> serialized(new HeaderBytes);
+        formatHeaders(*bodyLength, serialized->bytes, NULL);
+        serialized->bodyLength = *bodyLength;
+        headerBytes = serialized;
+    }
 
-  return bytes;
+    return boost::shared_ptr<const UtlString>(headerBytes, &headerBytes->bytes);
 }
 
+void HttpMessage::internRequestMethod()
+{
+    // The method is the first part of the line, as getRequestMethod()
+    // finds it; the protocol version that starts a response is not a
+    // method, so a response has none.
+    const char* method = mFirstHeaderLine.data();
+    while(*method == ' ')
+    {
+        method++;
+    }
+    size_t methodLength = strcspn(method, " ");
 
+    mRequestMethod = SipTokens::method(method, methodLength);
+}
 
+bool HttpMessage::isHeaderBytesCurrent(ssize_t bodyLength) const
+{
+    return mHeaderCacheClean
+       && mpHeaderBytes
+       && mpHeaderBytes->bodyLength == bodyLength;
+}
 
-void HttpMessage::getBytes(UtlString* bufferString, ssize_t* length, bool includeBody) const
+void HttpMessage::serializeHeaders()
 {
-    *length = 0;
-    UtlString name;
-    const char* value;
+    ssize_t bodyLen = body ? body->getLength() : 0;
+    if(isHeaderBytesCurrent(bodyLen))
+    {
+        return;
+    }
 
-    *bufferString = mFirstHeaderLine;
+    // Correct the Content-Length header, which is then a change like any
+    // other.  The headers are not otherwise changed, so serializing them
+    // does not copy headers that a copy of the message shares.
+    NameValuePair* contentLength = getHeaderField(0, HTTP_CONTENT_LENGTH_FIELD);
+    if(contentLength)
+    {
+        const char* value = contentLength->getValue();
+        if(atoi(value ? value : "") != bodyLen)
+        {
+            char bodyLengthString[40];
+            sprintf(bodyLengthString, "%zu", bodyLen);
+            Os::Logger::instance().log(FAC_HTTP, PRI_DEBUG,
+                          "HttpMessage::serializeHeaders content-length: %s wrong setting to: %s",
+                          value ? value : "", bodyLengthString);
+            setHeaderValue(HTTP_CONTENT_LENGTH_FIELD, bodyLengthString);
+        }
+    }
 
-    bufferString->append(END_OF_LINE_DELIMITER);
+    boost::shared_ptr<HeaderBytes> serialized(new HeaderBytes);
+    formatHeaders(bodyLen, serialized->bytes, &serialized->lines);
+    serialized->bodyLength = bodyLen;
 
-    UtlDListIterator iterator((UtlDList&)mNameValues);
-    NameValuePair* headerField;
-    UtlBoolean foundContentLengthHeader = FALSE;
-    ssize_t bodyLen = 0;
-    UtlString bodyBytes;
-    if(includeBody && body)
+    mpHeaderBytes = serialized;
+    mHeaderCacheClean = TRUE;
+}
+
+void HttpMessage::formatHeaders(ssize_t bodyLen,
+                                UtlString& bytes,
+                                std::vector<HeaderLine>* lines) const
+{
+    // The lines of the last serialization, if any, to copy from
+    static const HeaderBytes none;
+    const HeaderBytes& last = mpHeaderBytes ? *mpHeaderBytes : none;
+
+    bytes.capacity(bytes.length() + last.bytes.length() + 256);
+    if(lines)
     {
-       body->getBytes(&bodyBytes, &bodyLen);
+        lines->reserve(last.lines.size() + 4);
     }
 
-    ssize_t oldLen = 0 ;
-    if(mHeaderCacheClean &&
-        bodyLen == (oldLen = getContentLength()))
-    {
-        // We have a clean serialized cache of the first header line
-        // and headers, use it instead of serializing it
+    bytes.append(mFirstHeaderLine);
+    bytes.append(END_OF_LINE_DELIMITER);
 
-        // Check if the content length is explicitly set
-        //if(oldLen > 0 ||  // avoid getHeaderField call if content length set
-        //   getHeaderField(0, HTTP_CONTENT_LENGTH_FIELD))
-        //{
-        //    foundContentLengthHeader = TRUE;
-        //}
+    // The next line of the last serialization that a header may match.
+    // Looking a few lines beyond it skips lines of headers that were
+    // removed or changed since, like a popped Route or Max-Forwards.
+    size_t nextLine = 0;
+    static const size_t LINES_AHEAD = 4;
 
-        // dummy code to allow instrumentation and setting of break points
-        oldLen = 0;
-    }
-    else
+    UtlDListIterator iterator(const_cast<UtlDList&>(nameValues()));
+    NameValuePair* headerField;
+    UtlBoolean foundContentLengthHeader = FALSE;
+    UtlString name;
+    char bodyLengthString[40];
+    while((headerField = (NameValuePair*) iterator()))
     {
-        // we have to serialize the headers and cache the result
-        // This cast is a bit of hack for this instrumention so that
-        // the const signature does not have to change
-        ((HttpMessage*)this)->mHeaderCacheClean = TRUE;
-
-        // dummy code to allow instrumentation and setting of break points
-        oldLen = 0;
-    }
+        HeaderLine line;
+        line.offset = bytes.length();
+        const char* value = headerField->getValue();
 
-        // For each name value:
-        while((headerField = (NameValuePair*) iterator()))
-        {
-                // Do not free up name and data as this are contained
-                // in the NameValuePair
-                name = *headerField;
-                cannonizeToken(name);
-                value = headerField->getValue();
-
-        // Keep track while we are looping through if we see a
-        // content-length header or not
-        if(name.compareTo(HTTP_CONTENT_LENGTH_FIELD, UtlString::ignoreCase) == 0)
+        if(headerField->compareTo(HTTP_CONTENT_LENGTH_FIELD, UtlString::ignoreCase) == 0)
         {
+            // Keep track while we are looping through if we see a
+            // content-length header or not, and write the length of
+            // the body whatever it says.
             foundContentLengthHeader = TRUE;
-            ssize_t fieldBodyLengthValue = atoi(value ? value : "");
-            if(fieldBodyLengthValue != bodyLen)
-            {
-                char bodyLengthString[40];
-                sprintf(bodyLengthString, "%zu", bodyLen);
-                Os::Logger::instance().log(FAC_HTTP, PRI_DEBUG,
-                              "HttpMessage::getBytes content-length: %s wrong setting to: %s",
-                              value ? value : "", bodyLengthString);
-                headerField->setValue(bodyLengthString);
-                value = headerField->getValue();
-            }
+            sprintf(bodyLengthString, "%zu", bodyLen);
+            value = bodyLengthString;
         }
-
-                bufferString->append(name);
-                bufferString->append(HTTP_NAME_VALUE_DELIMITER);
-                bufferString->append(" ");
-                if(value)
+        else
+        {
+            // Copy the line of an unchanged header.
+            size_t valueLength = value ? strlen(value) : 0;
+            for(size_t l = nextLine;
+                l < last.lines.size() && l <= nextLine + LINES_AHEAD;
+                l++)
+            {
+                if(isHeaderLine(last.bytes, last.lines[l],
+                                headerField->data(), headerField->length(),
+                                value, valueLength))
                 {
-                        bufferString->append(value);
+                    bytes.append(last.bytes.data() + last.lines[l].offset,
+                                 last.lines[l].length);
+                    nextLine = l + 1;
+                    break;
                 }
-                bufferString->append(END_OF_LINE_DELIMITER);
+            }
         }
 
-        // Make sure the content length is set
-        if(!foundContentLengthHeader && !mUseChunkedEncoding)
+        if(bytes.length() == line.offset)
         {
-                UtlString ContentLen(HTTP_CONTENT_LENGTH_FIELD);
-                cannonizeToken(ContentLen);
-                bufferString->append(ContentLen);
-                bufferString->append(HTTP_NAME_VALUE_DELIMITER);
-                char bodyLengthString[40];
-                sprintf(bodyLengthString, " %zu", bodyLen);
-                bufferString->append(bodyLengthString);
-                bufferString->append(END_OF_LINE_DELIMITER);
+            // Do not free up name and data as this are contained
+            // in the NameValuePair
+            name = *headerField;
+            cannonizeToken(name);
+            bytes.append(name);
+            bytes.append(HTTP_NAME_VALUE_DELIMITER);
+            bytes.append(" ");
+            if(value)
+            {
+                bytes.append(value);
+            }
+            bytes.append(END_OF_LINE_DELIMITER);
         }
 
-        bufferString->append(END_OF_LINE_DELIMITER);
-
-        if(body)
+        if(lines)
         {
-                bufferString->append(bodyBytes.data(), bodyLen);
+            line.length = bytes.length() - line.offset;
+            lines->push_back(line);
         }
+    }
+
+    // Make sure the content length is set
+    if(!foundContentLengthHeader && !mUseChunkedEncoding)
+    {
+        UtlString ContentLen(HTTP_CONTENT_LENGTH_FIELD);
+        cannonizeToken(ContentLen);
+        bytes.append(ContentLen);
+        bytes.append(HTTP_NAME_VALUE_DELIMITER);
+        sprintf(bodyLengthString, " %zu", bodyLen);
+        bytes.append(bodyLengthString);
+        bytes.append(END_OF_LINE_DELIMITER);
+    }
+
+    bytes.append(END_OF_LINE_DELIMITER);
+}
 
-        *length = bufferString->length();
+bool HttpMessage::isHeaderLine(const UtlString& serialized, const HeaderLine& line,
+                               const char* name, size_t nameLength,
+                               const char* value, size_t valueLength)
+{
+    // A header serializes to its name with the case made canonical, ": ",
+    // its value and the end of line; names that differ only in case have
+    // the same canonical form.
+    const char* bytes = serialized.data() + line.offset;
+    return line.length == nameLength + 2 + valueLength + 2
+       && strncasecmp(bytes, name, nameLength) == 0
+       && bytes[nameLength] == HTTP_NAME_VALUE_DELIMITER
+       && bytes[nameLength + 1] == ' '
+       && (valueLength == 0 || memcmp(bytes + nameLength + 2, value, valueLength) == 0)
+       && memcmp(bytes + nameLength + 2 + valueLength, END_OF_LINE_DELIMITER, 2) == 0;
 }
 
 // Get a malloc'ed string containing the text of the message.
@@ -3586,9 +3596,10 @@ UtlBoolean HttpMessage::verifyMd5Authorization(const char* userPasswordDigest,
                                                const char* nonceCount,
                                                const char* qop,
                                                const char* thisMessageMethod,
-                                               const char* thisMessageUri) const
+                                               const char* thisMessageUri,
+                                               enum HttpEndpointEnum authEntity) const
 {
-    UtlBoolean allowed;
+    UtlBoolean allowed = FALSE;
     UtlString uri;
     UtlString method;
     UtlString referenceHash;
@@ -3624,14 +3635,25 @@ UtlBoolean HttpMessage::verifyMd5Authorization(const char* userPasswordDigest,
                    &referenceHash);
 
     // Get the digest hash contained in the message for comparison
-    allowed = getDigestAuthorizationData(NULL,  // user - not used here
-                                         NULL,  // realm - not used here
-                                         NULL,  // Nonce - not used here
-                                         NULL,  // Opaque - not used here
-                                         &msgDigestHash);
-    if (allowed)
-    {
-        allowed = (referenceHash.compareTo(msgDigestHash) == 0);
+    int authIndex = 0;
+    while(getDigestAuthorizationData(NULL,  // user - not used here
+                                     NULL,  // realm - not used here
+                                     NULL,  // Nonce - not used here
+                                     NULL,  // Opaque - not used here
+                                     &msgDigestHash,
+                                     NULL,  // uri - not used here
+                                     NULL,  // cnonce - not used here
+                                     NULL,  // nonceCount - not used here
+                                     NULL,  // qop - not used here
+                                     authEntity,
+                                     authIndex))
+    {
+        if((referenceHash.compareTo(msgDigestHash) == 0))
+        {
+            allowed = TRUE;
+            break;
+        }
+        authIndex++;
     }
 
 #ifdef TEST
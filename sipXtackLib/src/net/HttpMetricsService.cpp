@@ -0,0 +1,63 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+
+// APPLICATION INCLUDES
+#include "net/HttpMetricsService.h"
+#include "net/HttpMessage.h"
+#include "net/HttpRequestContext.h"
+#include "utl/UtlMetrics.h"
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STATIC VARIABLE INITIALIZATIONS
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ CREATORS ================================== */
+
+HttpMetricsService::HttpMetricsService()
+{
+}
+
+HttpMetricsService::~HttpMetricsService()
+{
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+void HttpMetricsService::processRequest(const HttpRequestContext& requestContext,
+                                        const HttpMessage& request,
+                                        HttpMessage*& response)
+{
+   UtlString method;
+   request.getRequestMethod(&method);
+
+   response = new HttpMessage();
+   if (method.compareTo(HTTP_GET_METHOD) == 0)
+   {
+      UtlString body;
+      UtlMetrics::instance().exportText(body);
+
+      response->setResponseFirstHeaderLine(HTTP_PROTOCOL_VERSION_1_1,
+                                           HTTP_OK_CODE,
+                                           HTTP_OK_TEXT);
+      response->setBody(new HttpBody(body.data(), body.length()));
+      response->setContentType(UtlMetrics::CONTENT_TYPE);
+      response->setContentLength(body.length());
+   }
+   else
+   {
+      response->setResponseFirstHeaderLine(HTTP_PROTOCOL_VERSION_1_1,
+                                           HTTP_UNSUPPORTED_METHOD_CODE,
+                                           HTTP_UNSUPPORTED_METHOD_TEXT);
+      response->setContentLength(0);
+   }
+}
@@ -27,6 +27,19 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include "os/OsDefs.h"
 #include "os/OsLogger.h"
 
@@ -34,6 +47,10 @@
 #include <os/OsServerSocket.h>
 #include <os/OsConnectionSocket.h>
 #include <os/OsConfigDb.h>
+#ifdef HAVE_SSL
+#include <os/OsSSLServerSocket.h>
+#endif
+#include <utl/UtlBlockingQueue.h>
 #include <utl/UtlVoidPtr.h>
 #include <net/HttpMessage.h>
 #include <net/HttpServer.h>
@@ -51,7 +68,23 @@
 // EXTERNAL VARIABLES
 // CONSTANTS
 
+#define MAX_REQUEST_HEADER_BYTES   65536
+#define MAX_REQUEST_CONTENT_LENGTH 24000000 // the default limit of HttpMessage::read
+#define READ_BUFFER_SIZE           16384
+#define EPOLL_MAX_EVENTS           256
+#define EPOLL_WAIT_MSECS           1000
+
+#define HTTP_LENGTH_REQUIRED_CODE  411
+#define HTTP_LENGTH_REQUIRED_TEXT  "Length Required"
+#define HTTP_TOO_LARGE_CODE        413
+#define HTTP_TOO_LARGE_TEXT        "Request Entity Too Large"
+
 const int HttpServer::MAX_PERSISTENT_HTTP_CONNECTIONS = 5; ///< this should be a parameter
+const int HttpServer::DEFAULT_HANDLER_THREADS = 8;
+const int HttpServer::MAX_QUEUED_REQUESTS = 1024;
+const int HttpServer::MAX_CONNECTIONS = 4096;
+const size_t HttpServer::MAX_REQUEST_BYTES = MAX_REQUEST_HEADER_BYTES + MAX_REQUEST_CONTENT_LENGTH;
+const int HttpServer::IDLE_CONNECTION_SECS = 300;
 
 #ifdef _VXWORKS
 #   define O_BINARY 0
@@ -61,6 +94,103 @@ const int HttpServer::MAX_PERSISTENT_HTTP_CONNECTIONS = 5; ///< this should be a
 
 // STATIC VARIABLE INITIALIZATIONS
 
+/// The epoll event loop that HttpServer::run uses on a plain TCP socket.
+/**
+ * The loop thread owns the connections: it accepts them, reads requests
+ * into a buffer until one is complete, and writes responses.  A complete
+ * request is queued for the handler threads, which call processRequestIpAddr
+ * and processRequest and hand the serialized response back through mDone,
+ * waking the loop with the server's eventfd.
+ *
+ * A connection has at most one request with the handlers, and the next
+ * request is not taken from its buffer until the response to the last one
+ * has been written, so pipelined requests are answered in order and a
+ * client that does not read its responses stops being read.
+ */
+class HttpServer::EventLoop
+{
+public:
+
+   EventLoop(HttpServer& server);
+
+   ~EventLoop();
+
+   /// Run until the server shuts down or its socket fails.
+   void run();
+
+private:
+
+   struct Connection
+   {
+      Connection(int fd, const char* localIp, const char* remoteIp);
+      ~Connection();
+
+      OsConnectionSocket* socket;    ///< owns the descriptor; for the HttpRequestContext
+      int                 fd;
+      UtlString           remoteIp;
+      UtlString           input;     ///< bytes read and not yet taken as a request
+      UtlString           output;    ///< response bytes not yet written
+      size_t              written;   ///< bytes of output written
+      HttpMessage*        request;   ///< the request with the handlers
+      UtlString           response;  ///< the handlers' serialized response
+      bool                keepAlive; ///< of the request with the handlers
+      bool                busy;      ///< a request is with the handlers
+      bool                inputClosed;     ///< the peer has shut down its side
+      bool                closeAfterWrite; ///< close once output has been written
+      bool                dropped;   ///< removed from epoll; delete when not busy
+      uint32_t            events;    ///< registered with epoll
+      time_t              lastActive;
+   };
+
+   typedef std::map<int, Connection*> Connections;
+
+   /// Accept connections until none are waiting.
+   void accept();
+
+   /// Read what the socket has.
+   void read(Connection* connection);
+
+   /// Write, dispatch and close as far as the connection allows.
+   void advance(Connection* connection);
+
+   /// Write as much output as the socket takes; false if the socket failed.
+   bool flush(Connection* connection);
+
+   /// Take the next complete request from the input; false if there is none.
+   bool dispatch(Connection* connection);
+
+   /// Queue an error response, closing the connection after it if close is set.
+   void reject(Connection* connection, int code, const char* text, bool close);
+
+   /// Set the events the connection waits for.
+   void watch(Connection* connection, uint32_t events);
+
+   /// Stop watching the connection; it is deleted once no request is with the handlers.
+   void drop(Connection* connection);
+
+   /// Close the connection and forget it.
+   void destroy(Connection* connection);
+
+   /// Pass completed responses to their connections.
+   void finishDone();
+
+   /// Close connections that have been idle too long.
+   void closeIdle(time_t now);
+
+   /// Body of a handler thread.
+   void handle();
+
+   HttpServer& mServer;
+   int mEpollFd;
+   int mListenFd;
+   Connections mConnections;
+   UtlBlockingQueue<Connection*> mRequests;
+   std::vector<boost::thread*> mHandlers;
+   boost::mutex mDoneLock;
+   std::vector<Connection*> mDone;   ///< guarded by mDoneLock
+   time_t mLastIdleCheck;
+};
+
 #ifdef TEST_UPLOAD_FILE_DEBUG
 void incrementalCheckSum(unsigned int* checkSum, const char* buffer, ssize_t bufferLength)
 {
@@ -87,7 +217,11 @@ HttpServer::HttpServer(OsServerSocket *pSocket,
    mpValidIpAddressDB(validIpAddressDB),
    mbPersistentConnection(bPersistentConnection),
    mHttpConnections(0),
-   mpHttpConnectionList(new UtlSList)
+   mpHttpConnectionList(new UtlSList),
+   mWakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+   mMaxConnections(MAX_CONNECTIONS),
+   mMaxQueuedRequests(MAX_QUEUED_REQUESTS),
+   mMaxRequestBytes(MAX_REQUEST_BYTES)
 {
    if(mpValidIpAddressDB)
    {
@@ -147,9 +281,27 @@ HttpServer::~HttpServer()
         mpServerSocket->close();
     }
 
+    // Wake the event loop so it sees the socket is closed
+    requestShutdown();
+    if (mWakeFd >= 0)
+    {
+        uint64_t one = 1;
+        if (::write(mWakeFd, &one, sizeof(one)) < 0)
+        {
+            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                                       "HttpServer::~ wake failed: %s", strerror(errno));
+        }
+    }
+
     // Wait until run exits before clobbering members
     waitUntilShutDown();
 
+    if (mWakeFd >= 0)
+    {
+        ::close(mWakeFd);
+        mWakeFd = -1;
+    }
+
     /// mpServerSocket is not deleted - the caller of the constructor owns it
 
     if(mpValidIpAddressDB)
@@ -213,13 +365,37 @@ UtlBoolean HttpServer::isSocketOk() const
 
 int HttpServer::run(void* runArg)
 {
-    OsConnectionSocket* requestSocket = NULL;
-
     if (!mpServerSocket->isOk())
     {
         Os::Logger::instance().log( FAC_SIP, PRI_ERR, "HttpServer: port not ok" );
         httpStatus = OS_PORT_IN_USE;
     }
+#ifdef HAVE_SSL
+    else if (dynamic_cast<OsSSLServerSocket*>(mpServerSocket))
+    {
+        // the TLS handshake is done by a blocking accept
+        runConnectionTasks();
+    }
+#endif
+    else
+    {
+        EventLoop eventLoop(*this);
+        eventLoop.run();
+    }
+
+    if ( !isShuttingDown() )
+    {
+       Os::Logger::instance().log( FAC_SIP, PRI_ERR, "HttpServer: exit due to port failure" );
+    }
+
+    httpStatus = OS_TASK_NOT_STARTED;
+
+    return(TRUE);
+}
+
+void HttpServer::runConnectionTasks()
+{
+    OsConnectionSocket* requestSocket = NULL;
 
     while(!isShuttingDown() && mpServerSocket->isOk())
     {
@@ -326,15 +502,6 @@ int HttpServer::run(void* runArg)
            httpStatus = OS_PORT_IN_USE;
         }
     } // while (!isShuttingDown && mpServerSocket->isOk())
-
-    if ( !isShuttingDown() )
-    {
-       Os::Logger::instance().log( FAC_SIP, PRI_ERR, "HttpServer: exit due to port failure" );
-    }
-
-    httpStatus = OS_TASK_NOT_STARTED;
-
-    return(TRUE);
 }
 
 UtlBoolean HttpServer::processRequestIpAddr(const UtlString& remoteIp,
@@ -765,5 +932,606 @@ UtlBoolean HttpServer::mapUri(UtlHashMap& uriMaps, const char* uri, UtlString& m
 }
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 
+/* ============================ EventLoop ================================= */
+
+// Length of the value of a header line if it is the named header, or -1.
+static ssize_t headerValue(const char* line, const char* end, const char* name,
+                           const char*& value)
+{
+   size_t nameLength = strlen(name);
+   if (   (size_t) (end - line) > nameLength
+       && strncasecmp(line, name, nameLength) == 0
+       && line[nameLength] == ':')
+   {
+      value = line + nameLength + 1;
+      while (value < end && (*value == ' ' || *value == '\t'))
+      {
+         value++;
+      }
+      return end - value;
+   }
+   return -1;
+}
+
+// Does the comma separated header value contain the token, ignoring case?
+static bool hasToken(const char* value, const char* token)
+{
+   size_t tokenLength = strlen(token);
+   for (const char* p = value; p && *p; p++)
+   {
+      if (   strncasecmp(p, token, tokenLength) == 0
+          && (p == value || p[-1] == ',' || p[-1] == ' ' || p[-1] == '\t')
+          && (p[tokenLength] == '\0' || p[tokenLength] == ','
+              || p[tokenLength] == ' ' || p[tokenLength] == '\t'))
+      {
+         return true;
+      }
+   }
+   return false;
+}
+
+// Whether the client wants the connection kept open after the response.
+static bool isKeepAlive(const HttpMessage& request)
+{
+   UtlString protocol;
+   request.getRequestProtocol(&protocol);
+   const char* connection = request.getHeaderValue(0, "Connection");
+
+   return (  protocol.compareTo("HTTP/1.0", UtlString::ignoreCase) == 0
+           ? hasToken(connection, "keep-alive")
+           : !hasToken(connection, "close"));
+}
+
+HttpServer::EventLoop::Connection::Connection(int descriptor,
+                                              const char* localIp,
+                                              const char* remote) :
+   socket(new OsConnectionSocket(localIp, descriptor)),
+   fd(descriptor),
+   remoteIp(remote),
+   written(0),
+   request(NULL),
+   keepAlive(false),
+   busy(false),
+   inputClosed(false),
+   closeAfterWrite(false),
+   dropped(false),
+   events(0),
+   lastActive(time(NULL))
+{
+}
+
+HttpServer::EventLoop::Connection::~Connection()
+{
+   delete request;
+   delete socket; // closes fd
+}
+
+HttpServer::EventLoop::EventLoop(HttpServer& server) :
+   mServer(server),
+   mEpollFd(epoll_create1(EPOLL_CLOEXEC)),
+   mListenFd(server.mpServerSocket->getSocketDescriptor()),
+   mRequests(server.mMaxQueuedRequests),
+   mLastIdleCheck(time(NULL))
+{
+   // accept() is called until it would block
+   fcntl(mListenFd, F_SETFL, fcntl(mListenFd, F_GETFL) | O_NONBLOCK);
+
+   struct epoll_event event;
+   memset(&event, 0, sizeof(event));
+   event.events = EPOLLIN;
+   event.data.fd = mListenFd;
+   if (mEpollFd < 0 || epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mListenFd, &event) < 0)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
+                                 "HttpServer::EventLoop epoll setup failed: %s",
+                                 strerror(errno));
+   }
+   event.data.fd = server.mWakeFd;
+   epoll_ctl(mEpollFd, EPOLL_CTL_ADD, server.mWakeFd, &event);
+
+   // Requests to a server without persistent connections were always
+   // processed one at a time, so keep it that way.
+   int handlers = server.mbPersistentConnection ? DEFAULT_HANDLER_THREADS : 1;
+   for (int i = 0; i < handlers; i++)
+   {
+      mHandlers.push_back(new boost::thread(boost::bind(&EventLoop::handle, this)));
+   }
+
+   Os::Logger::instance().log(FAC_SIP, PRI_INFO,
+                              "HttpServer::EventLoop port %d with %d handler threads",
+                              server.mpServerSocket->getLocalHostPort(), handlers);
+}
+
+HttpServer::EventLoop::~EventLoop()
+{
+   // one terminate per handler, as each wakes one blocked dequeue
+   for (size_t i = 0; i < mHandlers.size(); i++)
+   {
+      mRequests.terminate();
+   }
+   for (size_t i = 0; i < mHandlers.size(); i++)
+   {
+      mHandlers[i]->join();
+      delete mHandlers[i];
+   }
+
+   // no handler holds a connection now
+   for (Connections::iterator it = mConnections.begin(); it != mConnections.end(); it++)
+   {
+      delete it->second;
+   }
+   mConnections.clear();
+
+   if (mEpollFd >= 0)
+   {
+      ::close(mEpollFd);
+   }
+}
+
+void HttpServer::EventLoop::run()
+{
+   struct epoll_event events[EPOLL_MAX_EVENTS];
+
+   while (!mServer.isShuttingDown() && mServer.mpServerSocket->isOk())
+   {
+      int count = epoll_wait(mEpollFd, events, EPOLL_MAX_EVENTS, EPOLL_WAIT_MSECS);
+      if (count < 0 && errno != EINTR)
+      {
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                    "HttpServer::EventLoop::run epoll_wait failed: %s",
+                                    strerror(errno));
+         break;
+      }
+
+      for (int i = 0; i < count; i++)
+      {
+         int fd = events[i].data.fd;
+         if (fd == mListenFd)
+         {
+            accept();
+         }
+         else if (fd == mServer.mWakeFd)
+         {
+            uint64_t wakes;
+            while (::read(fd, &wakes, sizeof(wakes)) > 0)
+            {
+            }
+         }
+         else
+         {
+            Connections::iterator it = mConnections.find(fd);
+            if (it != mConnections.end())
+            {
+               Connection* connection = it->second;
+               if (events[i].events & (EPOLLERR | EPOLLHUP))
+               {
+                  drop(connection);
+               }
+               else if (events[i].events & EPOLLIN)
+               {
+                  read(connection);
+               }
+               advance(connection);
+            }
+         }
+      }
+
+      finishDone();
+
+      time_t now = time(NULL);
+      if (now - mLastIdleCheck >= 10)
+      {
+         mLastIdleCheck = now;
+         closeIdle(now);
+      }
+   }
+}
+
+void HttpServer::EventLoop::accept()
+{
+   while (true)
+   {
+      struct sockaddr_in address;
+      socklen_t addressLength = sizeof(address);
+      int fd = ::accept(mListenFd, (struct sockaddr*) &address, &addressLength);
+      if (fd < 0)
+      {
+         if (errno == EINTR || errno == ECONNABORTED)
+         {
+            continue;
+         }
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+         {
+            Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                       "HttpServer::EventLoop::accept failed: %s",
+                                       strerror(errno));
+         }
+         break;
+      }
+
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      int noDelay = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+      Connection* connection =
+         new Connection(fd, mServer.mpServerSocket->getLocalIp().data(),
+                        inet_ntoa(address.sin_addr));
+      mConnections[fd] = connection;
+
+      // errors and hangups are reported even when no events are asked for
+      struct epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.data.fd = fd;
+      epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event);
+
+      if (mConnections.size() > (size_t) mServer.mMaxConnections)
+      {
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                    "HttpServer::EventLoop::accept exceeded connection limit (%d):"
+                                    " sending 503 to %s",
+                                    mServer.mMaxConnections, connection->remoteIp.data());
+         reject(connection, HTTP_OUT_OF_RESOURCES_CODE, HTTP_OUT_OF_RESOURCES_TEXT, true);
+         connection->inputClosed = true;
+      }
+      advance(connection);
+   }
+}
+
+void HttpServer::EventLoop::read(Connection* connection)
+{
+   char buffer[READ_BUFFER_SIZE];
+   while (true)
+   {
+      // Leave in the socket what would make the input longer than a request
+      // may be; dispatch takes a request from the input or answers 413.
+      size_t length = connection->input.length();
+      if (length >= mServer.mMaxRequestBytes)
+      {
+         break;
+      }
+      size_t room = mServer.mMaxRequestBytes - length;
+
+      ssize_t bytes = ::read(connection->fd, buffer,
+                             room < sizeof(buffer) ? room : sizeof(buffer));
+      if (bytes > 0)
+      {
+         connection->input.append(buffer, bytes);
+         connection->lastActive = time(NULL);
+      }
+      else if (bytes == 0)
+      {
+         connection->inputClosed = true;
+         break;
+      }
+      else
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+         {
+            drop(connection);
+         }
+         break;
+      }
+   }
+}
+
+void HttpServer::EventLoop::advance(Connection* connection)
+{
+   while (true)
+   {
+      if (connection->dropped)
+      {
+         if (!connection->busy)
+         {
+            destroy(connection);
+         }
+         return;
+      }
+
+      if (!flush(connection))
+      {
+         drop(connection);
+      }
+      else if (connection->written < connection->output.length())
+      {
+         watch(connection, EPOLLOUT);
+         return;
+      }
+      else if (connection->closeAfterWrite)
+      {
+         drop(connection);
+      }
+      else if (connection->busy)
+      {
+         watch(connection, 0);
+         return;
+      }
+      else if (!dispatch(connection))
+      {
+         if (connection->inputClosed)
+         {
+            drop(connection);
+         }
+         else
+         {
+            watch(connection, EPOLLIN);
+            return;
+         }
+      }
+   }
+}
+
+bool HttpServer::EventLoop::flush(Connection* connection)
+{
+   while (connection->written < connection->output.length())
+   {
+      ssize_t bytes = ::send(connection->fd,
+                             connection->output.data() + connection->written,
+                             connection->output.length() - connection->written,
+                             MSG_NOSIGNAL);
+      if (bytes > 0)
+      {
+         connection->written += bytes;
+      }
+      else if (bytes < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      else
+      {
+         return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+      }
+   }
+
+   connection->output.remove(0);
+   connection->written = 0;
+   return true;
+}
+
+bool HttpServer::EventLoop::dispatch(Connection* connection)
+{
+   UtlString& input = connection->input;
+
+   // blank lines before a request line are ignored (RFC 2616 section 4.1)
+   size_t blank = 0;
+   while (blank < input.length() && (input(blank) == '\r' || input(blank) == '\n'))
+   {
+      blank++;
+   }
+   if (blank > 0)
+   {
+      input.remove(0, blank);
+   }
+   if (input.isNull())
+   {
+      return false;
+   }
+
+   // the headers end at the first blank line
+   const char* bytes = input.data();
+   size_t headerLength = 0;
+   for (const char* eol = strchr(bytes, '\n'); eol; eol = strchr(eol + 1, '\n'))
+   {
+      if (eol[1] == '\n')
+      {
+         headerLength = eol + 2 - bytes;
+         break;
+      }
+      if (eol[1] == '\r' && eol[2] == '\n')
+      {
+         headerLength = eol + 3 - bytes;
+         break;
+      }
+   }
+   if (headerLength == 0)
+   {
+      if (   input.length() > MAX_REQUEST_HEADER_BYTES
+          || input.length() >= mServer.mMaxRequestBytes)
+      {
+         reject(connection, HTTP_TOO_LARGE_CODE, HTTP_TOO_LARGE_TEXT, true);
+         return true;
+      }
+      return false;
+   }
+
+   // Only Content-Length and Transfer-Encoding are needed to find the end
+   // of the request; HttpMessage parses the rest once it is all here.
+   long contentLength = 0;
+   bool chunked = false;
+   const char* line = strchr(bytes, '\n') + 1;
+   while (line < bytes + headerLength)
+   {
+      const char* end = strchr(line, '\n');
+      const char* valueEnd = end > line && end[-1] == '\r' ? end - 1 : end;
+      const char* value;
+      ssize_t valueLength;
+      if ((valueLength = headerValue(line, valueEnd, HTTP_CONTENT_LENGTH_FIELD, value)) >= 0)
+      {
+         contentLength = strtol(value, NULL, 10);
+      }
+      else if ((valueLength = headerValue(line, valueEnd, "Transfer-Encoding", value)) >= 0)
+      {
+         chunked = strncasecmp(value, "identity", valueLength) != 0;
+      }
+      line = end + 1;
+   }
+
+   if (chunked)
+   {
+      reject(connection, HTTP_LENGTH_REQUIRED_CODE, HTTP_LENGTH_REQUIRED_TEXT, true);
+      return true;
+   }
+   if (   contentLength < 0
+       || contentLength > MAX_REQUEST_CONTENT_LENGTH
+       || headerLength + contentLength > mServer.mMaxRequestBytes)
+   {
+      reject(connection, HTTP_TOO_LARGE_CODE, HTTP_TOO_LARGE_TEXT, true);
+      return true;
+   }
+
+   size_t requestLength = headerLength + contentLength;
+   if (input.length() < requestLength)
+   {
+      return false;
+   }
+
+   connection->request = new HttpMessage(bytes, requestLength);
+   input.remove(0, requestLength);
+   connection->keepAlive = mServer.mbPersistentConnection && isKeepAlive(*connection->request);
+   connection->busy = true;
+
+   if (!mRequests.enqueue(connection))
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                 "HttpServer::EventLoop::dispatch exceeded queued request limit (%d):"
+                                 " sending 503 to %s",
+                                 mServer.mMaxQueuedRequests, connection->remoteIp.data());
+      connection->busy = false;
+      delete connection->request;
+      connection->request = NULL;
+      reject(connection, HTTP_OUT_OF_RESOURCES_CODE, HTTP_OUT_OF_RESOURCES_TEXT,
+             !connection->keepAlive);
+   }
+   return true;
+}
+
+void HttpServer::EventLoop::reject(Connection* connection, int code, const char* text,
+                                   bool close)
+{
+   HttpMessage response;
+   response.setResponseFirstHeaderLine(HTTP_PROTOCOL_VERSION, code, text);
+   response.setHeaderValue("Connection", close ? "close" : "Keep-Alive");
+   response.setContentLength(0);
+
+   UtlString bytes;
+   ssize_t length;
+   response.getBytes(&bytes, &length);
+   connection->output.append(bytes);
+   if (close)
+   {
+      connection->closeAfterWrite = true;
+   }
+}
+
+void HttpServer::EventLoop::watch(Connection* connection, uint32_t events)
+{
+   if (events != connection->events)
+   {
+      struct epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events = events;
+      event.data.fd = connection->fd;
+      epoll_ctl(mEpollFd, EPOLL_CTL_MOD, connection->fd, &event);
+      connection->events = events;
+   }
+}
+
+void HttpServer::EventLoop::drop(Connection* connection)
+{
+   if (!connection->dropped)
+   {
+      connection->dropped = true;
+      epoll_ctl(mEpollFd, EPOLL_CTL_DEL, connection->fd, NULL);
+   }
+}
+
+void HttpServer::EventLoop::destroy(Connection* connection)
+{
+   drop(connection);
+   mConnections.erase(connection->fd);
+   delete connection;
+}
+
+void HttpServer::EventLoop::finishDone()
+{
+   std::vector<Connection*> done;
+   {
+      boost::lock_guard<boost::mutex> lock(mDoneLock);
+      done.swap(mDone);
+   }
+
+   for (size_t i = 0; i < done.size(); i++)
+   {
+      Connection* connection = done[i];
+      connection->busy = false;
+      connection->output.append(connection->response);
+      connection->response.remove(0);
+      connection->lastActive = time(NULL);
+      if (!connection->keepAlive)
+      {
+         connection->closeAfterWrite = true;
+      }
+      advance(connection);
+   }
+}
+
+void HttpServer::EventLoop::closeIdle(time_t now)
+{
+   std::vector<Connection*> idle;
+   for (Connections::iterator it = mConnections.begin(); it != mConnections.end(); it++)
+   {
+      if (!it->second->busy && now - it->second->lastActive > IDLE_CONNECTION_SECS)
+      {
+         idle.push_back(it->second);
+      }
+   }
+   for (size_t i = 0; i < idle.size(); i++)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                                 "HttpServer::EventLoop closing idle connection from %s",
+                                 idle[i]->remoteIp.data());
+      destroy(idle[i]);
+   }
+}
+
+void HttpServer::EventLoop::handle()
+{
+   Connection* connection;
+   while (mRequests.dequeue(connection))
+   {
+      HttpMessage* response = NULL;
+
+      // If request from Valid IP Address
+      if (mServer.processRequestIpAddr(connection->remoteIp, *connection->request, response))
+      {
+         // If the request is authorized
+         mServer.processRequest(*connection->request, response, connection->socket);
+      }
+
+      if (!response)
+      {
+         // The connection threads wrote nothing here and left the client
+         // waiting; a keep-alive client needs a response to move on.
+         response = new HttpMessage();
+         response->setResponseFirstHeaderLine(HTTP_PROTOCOL_VERSION,
+                                              HTTP_SERVER_ERROR_CODE,
+                                              HTTP_SERVER_ERROR_TEXT);
+         response->setContentLength(0);
+      }
+      response->setHeaderValue("Connection", connection->keepAlive ? "Keep-Alive" : "close");
+
+      ssize_t length;
+      response->getBytes(&connection->response, &length);
+      delete response;
+      delete connection->request;
+      connection->request = NULL;
+
+      {
+         boost::lock_guard<boost::mutex> lock(mDoneLock);
+         mDone.push_back(connection);
+      }
+      uint64_t one = 1;
+      if (::write(mServer.mWakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+      {
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                    "HttpServer::EventLoop::handle wake failed: %s",
+                                    strerror(errno));
+      }
+   }
+}
 
 /* ============================ FUNCTIONS ================================= */
@@ -14,6 +14,7 @@
 // APPLICATION INCLUDES
 #include <net/NameValueTokenizer.h>
 #include <os/OsLogger.h>
+#include <utl/UtlByteScan.h>
 
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
@@ -51,15 +52,13 @@ NameValueTokenizer::~NameValueTokenizer()
 
 ssize_t NameValueTokenizer::findNextLineTerminator(const char* text, ssize_t length, ssize_t* nextLineIndex)
 {
-    ssize_t byteIndex = 0;
     ssize_t terminatorIndex = -1;
     *nextLineIndex = -1;
-    //char textChar;
 
-    while(byteIndex < length)
+    if(length > 0)
     {
-        //textChar = *text;
-        if(text[byteIndex] == NEWLINE || text[byteIndex] == CARRIAGE_RETURN)
+        ssize_t byteIndex = UtlByteScan::findLineBreak(text, length);
+        if(byteIndex < length)
         {
             terminatorIndex = byteIndex;
             // Check for NL after CR
@@ -72,10 +71,7 @@ ssize_t NameValueTokenizer::findNextLineTerminator(const char* text, ssize_t len
             {
                 *nextLineIndex = terminatorIndex + 1;
             }
-            break;
         }
-        //text++;
-        byteIndex++;
     }
 
     return(terminatorIndex);
@@ -147,10 +143,21 @@ UtlBoolean NameValueTokenizer::getSubField(const char* textField,
     ssize_t subFieldI = -1;
     ssize_t subFieldBegin = 0;
     ssize_t separatorIndex = -1;
-    size_t numSeparators = strlen(subFieldSeparators);
+
+    // The separators, and the NUL that also ends the text field, so that
+    // the scan can skip straight to the next of any of them.
+    UtlByteScan::ByteSet separators(subFieldSeparators);
+    separators.add('\0');
 
     for(ssize_t charIndex = 0; subFieldI < subFieldIndex; charIndex++)
     {
+        if(textFieldLength >= 0 && !validateChars && charIndex < textFieldLength)
+        {
+            charIndex += UtlByteScan::findAnyOf(&textField[charIndex],
+                                                textFieldLength - charIndex,
+                                                separators);
+        }
+
         if((textFieldLength >= 0 &&
         charIndex >= textFieldLength) ||
         textField[charIndex] == '\0')
@@ -170,16 +177,7 @@ UtlBoolean NameValueTokenizer::getSubField(const char* textField,
         }
 
         // If we found a separator character
-             // 1 separator check it directly, it is much faster
-        else if((numSeparators == 1 &&
-             subFieldSeparators[0] == textField[charIndex]) ||
-            // 2 separator characters, check both:
-            (numSeparators == 2 &&
-             (subFieldSeparators[0] == textField[charIndex] ||
-              subFieldSeparators[1] == textField[charIndex])) ||
-            // 3 or more separator characters, do it the slow way:
-            (numSeparators > 2 &&
-             strchr(subFieldSeparators, textField[charIndex])))
+        else if(separators.contains(textField[charIndex]))
         {
         subFieldBegin = separatorIndex + 1;
         separatorIndex = charIndex;
@@ -289,12 +287,10 @@ UtlBoolean NameValueTokenizer::getNextPair(char separator, UtlString* name,
    if(lineLength > 0)
    {
       // Find the name value delimiter
-      ssize_t nameEnd = 0;
-      while(nameEnd < lineLength &&
-            textPtr[bytesConsumed + nameEnd] != separator)
-      {
-         nameEnd++;
-      }
+      const char* separatorPtr =
+         (const char*) memchr(&textPtr[bytesConsumed], separator, lineLength);
+      ssize_t nameEnd =
+         separatorPtr ? separatorPtr - &textPtr[bytesConsumed] : lineLength;
 
       if(nameEnd > 0)
       {
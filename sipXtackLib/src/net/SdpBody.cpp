@@ -2377,9 +2377,14 @@ void SdpBody::getBytes(const char** bytes, ssize_t* length) const
    // This version of getBytes exists so that a caller who is
    // calling this method through an HttpBody will get the right
    // thing - we fill in the mBody string and then return that.
+   // mBody is only written when it is stale, as copies of a message
+   // share its body and may read it from other threads.
    UtlString tempBody;
    getBytes( &tempBody, length );
-   ((SdpBody*)this)->mBody = tempBody.data();
+   if (mBody.compareTo(tempBody) != 0)
+   {
+      ((SdpBody*)this)->mBody = tempBody.data();
+   }
    *bytes = mBody.data();
 }
 
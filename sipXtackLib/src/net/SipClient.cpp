@@ -854,9 +854,7 @@ int SipClient::run(void* runArg)
 
             // Log the message at DEBUG level.
             // Only bother processing if the logs are enabled
-            if (   mpSipUserAgent->isMessageLoggingEnabled()
-                   || Os::Logger::instance().willLog(FAC_SIP_INCOMING, PRI_DEBUG)
-               )
+            if (Os::Logger::instance().willLog(FAC_SIP_INCOMING, PRI_DEBUG))
             {
                UtlString logMessage;
                logMessage.append("Read keepalive message:\n");
@@ -944,9 +942,14 @@ int SipClient::run(void* runArg)
             // clean up its data, and extract any needed source address.
             if (preprocessMessage(*msg, readBuffer, res))
             {
-              // Dispatch the message.
-              // dispatch() takes ownership of *msg.
-              mpSipUserAgent->dispatch(msg);
+              // Dispatch the message, unless the steering passes it to
+              // the worker process that owns its transaction.
+              // dispatch() and the steering take ownership of *msg.
+              SipUserAgent* pUserAgent = dynamic_cast<SipUserAgent* >(mpSipUserAgent);
+              if (!(pUserAgent && pUserAgent->steering() && pUserAgent->steering()(msg)))
+              {
+                mpSipUserAgent->dispatch(msg);
+              }
             }
             else
             {
@@ -1307,11 +1310,20 @@ bool SipClient::preprocessMessage(SipMessage& msg,
    int fromPort;
    msg.getSendAddress(&fromIpAddress, &fromPort);
 
+   // Keep the raw message in the SipUserAgent's message log.
+   if (mpSipUserAgent->isMessageLoggingEnabled())
+   {
+      mpSipUserAgent->recordMessage(SipMessageRecorder::INCOMING, mSocketType,
+                                    mLocalHostAddress,
+                                    portIsValid(mLocalHostPort) ? mLocalHostPort : defaultPort(),
+                                    fromIpAddress,
+                                    portIsValid(fromPort) ? fromPort : defaultPort(),
+                                    msgText.data(), msgLength);
+   }
+
    // Log the message.
    // Only bother processing if the logs are enabled
-   if (   mpSipUserAgent->isMessageLoggingEnabled()
-          || Os::Logger::instance().willLog(FAC_SIP_INCOMING, PRI_INFO)
-      )
+   if (Os::Logger::instance().willLog(FAC_SIP_INCOMING, PRI_INFO))
    {
       UtlString logMessage;
       logMessage.append("Read SIP message:\n");
@@ -1333,8 +1345,6 @@ bool SipClient::preprocessMessage(SipMessage& msg,
       logMessage.append(messageString);
       logMessage.append("====================END====================\n");
 
-      // Send the message to the SipUserAgent for its internal log.
-      mpSipUserAgent->logMessage(logMessage.data(), logMessage.length());
       // Write the message to the syslog.
       Os::Logger::instance().log(FAC_SIP_INCOMING, PRI_INFO, "%s", logMessage.data());
    }
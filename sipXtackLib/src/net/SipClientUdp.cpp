@@ -79,17 +79,21 @@ void SipClientUdp::sendMessage(const SipMessage& message,
                                const char* address,
                                int port)
 {
-   UtlString buffer;
-   ssize_t bufferLen;
+   UtlString body;
+   ssize_t bodyLen;
    ssize_t bytesWritten;
 
-   message.getBytes(&buffer, &bufferLen);
+   // Write the headers the message keeps serialized and the body as one
+   // datagram, without joining them first.
+   boost::shared_ptr<const UtlString> headers = message.getHeaderBytes(&body, &bodyLen);
+   ssize_t bufferLen = headers->length() + bodyLen;
 
    // port will not be PORT_NONE, because it would have been replaced by
    // the default port in ::sendTo().
    bytesWritten =
       (dynamic_cast <OsDatagramSocket*> (mClientSocket))->
-      write(buffer.data(), bufferLen, address, port);
+      write(headers->data(), headers->length(), body.data(), bodyLen,
+            address, port);
 
    if (bufferLen == bytesWritten)
    {
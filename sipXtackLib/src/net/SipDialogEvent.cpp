@@ -14,11 +14,15 @@
 #include <os/OsLogger.h>
 #include <utl/UtlDListIterator.h>
 #include <utl/XmlContent.h>
-#include <xmlparser/tinyxml.h>
+#include <xmlparser/XmlPullParser.h>
+#include <xmlparser/XmlWriter.h>
 
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
 // CONSTANTS
+// Typical rendered sizes, used to size the body buffer in buildBody()
+#define DIALOG_INFO_SIZE_ESTIMATE 256
+#define DIALOG_SIZE_ESTIMATE 512
 
 // STATIC VARIABLE INITIALIZATIONS
 const UtlContainableType Dialog::TYPE = "Dialog";
@@ -108,180 +112,109 @@ void Dialog::setIdentifier()
 void Dialog::getBytes(UtlString& b, ssize_t& l)
 {
    b.remove(0);
-   b.append(BEGIN_DIALOG);
-   UtlString singleLine;
-   singleLine = DOUBLE_QUOTE;
-   XmlEscape(singleLine, mId);
-   singleLine += DOUBLE_QUOTE;
-   b += singleLine;
+   appendBytes(b);
+   l = b.length();
+}
+
+// Append a <local> or <remote> element.
+static void appendParticipant(XmlWriter<UtlString>& writer,
+                              const char* name,
+                              const UtlString& identity,
+                              const UtlString& display,
+                              const UtlString& target,
+                              const UtlDList& parameters)
+{
+   writer.startTag(name).closeTag().raw("\n");
+
+   if (!identity.isNull())
+   {
+      writer.startTag("identity");
+      if (!display.isNull())
+      {
+         UtlString displayName = display;
+         NameValueTokenizer::frontBackTrim(&displayName, "\"");
+         writer.attribute("display", displayName.data(), displayName.length());
+      }
+      writer.closeTag()
+         .text(identity.data(), identity.length())
+         .raw(END_IDENTITY);
+   }
+
+   if (!target.isNull() && target.compareTo("sip:") != 0)
+   {
+      writer.startTag("target")
+         .attribute("uri", target.data(), target.length())
+         .raw(END_LINE);
+
+      // add optional parameters
+      UtlDListIterator iterator(parameters);
+      NameValuePairInsensitive* nvp;
+      while ((nvp = (NameValuePairInsensitive*) iterator()))
+      {
+         const char* value = nvp->getValue();
+         writer.startTag("param")
+            .attribute("pname", nvp->data(), nvp->length())
+            .attribute("pval", value ? value : "")
+            .emptyTag()
+            .raw("\n");
+      }
+
+      writer.raw(END_TARGET);
+   }
+
+   writer.endTag(name).raw("\n");
+}
+
+void Dialog::appendBytes(UtlString& b)
+{
+   XmlWriter<UtlString> writer(b);
+
+   writer.raw("<dialog").attribute("id", mId.data(), mId.length());
    if (!mCallId.isNull())
    {
-      b.append(CALL_ID_EQUAL);
-      singleLine = DOUBLE_QUOTE;
-      XmlEscape(singleLine, mCallId);
-      singleLine += DOUBLE_QUOTE;
-      b += singleLine;
+      writer.attribute("call-id", mCallId.data(), mCallId.length());
    }
 
+   // mLocalTag, mRemoteTag and mDirection are tokens
    if (!mLocalTag.isNull())
    {
-      b.append(LOCAL_TAG_EQUAL);
-      // mLocalTag is a token
-      singleLine = DOUBLE_QUOTE + mLocalTag + DOUBLE_QUOTE;
-      b += singleLine;
+      writer.raw(LOCAL_TAG_EQUAL DOUBLE_QUOTE).raw(mLocalTag.data(), mLocalTag.length()).raw(DOUBLE_QUOTE);
    }
-
    if (!mRemoteTag.isNull())
    {
-      b.append(REMOTE_TAG_EQUAL);
-      // mRemoteTag is a token
-      singleLine = DOUBLE_QUOTE + mRemoteTag + DOUBLE_QUOTE;
-      b += singleLine;
+      writer.raw(REMOTE_TAG_EQUAL DOUBLE_QUOTE).raw(mRemoteTag.data(), mRemoteTag.length()).raw(DOUBLE_QUOTE);
    }
-
    if (!mDirection.isNull())
    {
-      b.append(DIRECTION_EQUAL);
-      // mDirection is a token
-      singleLine = DOUBLE_QUOTE + mDirection + DOUBLE_QUOTE;
-      b += singleLine;
+      writer.raw(DIRECTION_EQUAL DOUBLE_QUOTE).raw(mDirection.data(), mDirection.length()).raw(DOUBLE_QUOTE);
    }
-   b.append(END_LINE);
+   writer.raw(END_LINE);
 
-   // State element
-   b.append(BEGIN_STATE);
+   // State element; mEvent, mCode and mState are tokens
+   writer.raw(BEGIN_STATE);
    if (!mEvent.isNull())
    {
-      b.append(EVENT_EQUAL);
-      // mEvent is a token
-      singleLine = DOUBLE_QUOTE + mEvent + DOUBLE_QUOTE;
-      b += singleLine;
+      writer.raw(EVENT_EQUAL DOUBLE_QUOTE).raw(mEvent.data(), mEvent.length()).raw(DOUBLE_QUOTE);
    }
-
    if (!mCode.isNull())
    {
-      b.append(CODE_EQUAL);
-      // mCode is a token
-      singleLine = DOUBLE_QUOTE + mCode + DOUBLE_QUOTE;
-      b += singleLine;
+      writer.raw(CODE_EQUAL DOUBLE_QUOTE).raw(mCode.data(), mCode.length()).raw(DOUBLE_QUOTE);
    }
-
-   // End of state element
-   singleLine = END_BRACKET + mState + END_STATE;
-   b += singleLine;
+   writer.raw(END_BRACKET).raw(mState.data(), mState.length()).raw(END_STATE);
 
    // Duration element
    if (mDuration !=0)
    {
-      b += BEGIN_DURATION;
+      b.append(BEGIN_DURATION);
       b.appendNumber((Int64) OsDateTime::getSecsSinceEpoch() - mDuration);
-      b += END_DURATION;
+      b.append(END_DURATION);
    }
 
-   // Local element
-   b.append(BEGIN_LOCAL);
-   if (!mLocalIdentity.isNull())
-   {
-      b.append(BEGIN_IDENTITY);
-      if (!mLocalDisplay.isNull())
-      {
-         UtlString displayName = mLocalDisplay;
-         NameValueTokenizer::frontBackTrim(&displayName, "\"");
-         b.append(DISPLAY_EQUAL);
-         singleLine = DOUBLE_QUOTE;
-         XmlEscape(singleLine, displayName);
-         singleLine += DOUBLE_QUOTE;
-         b += singleLine;
-      }
-
-      singleLine = END_BRACKET;
-      XmlEscape(singleLine, mLocalIdentity);
-      singleLine += END_IDENTITY;
-      b += singleLine;
-   }
-
-   if (!mLocalTarget.isNull() && mLocalTarget.compareTo("sip:") != 0)
-   {
-      singleLine = BEGIN_TARGET;
-      XmlEscape(singleLine, mLocalTarget);
-      singleLine += DOUBLE_QUOTE END_LINE;
-      b += singleLine;
-      // add optional parameters
-      UtlDListIterator* iterator = getLocalParameterIterator();
-      NameValuePairInsensitive* nvp;
-      while ((nvp = (NameValuePairInsensitive*) (*iterator)()))
-      {
-         singleLine = BEGIN_DIALOG_PARAM;
-         singleLine += PNAME;
-         XmlEscape(singleLine, nvp->data());
-         singleLine += PVALUE;
-         XmlEscape(singleLine, nvp->getValue());
-         singleLine += END_DIALOG_PARAM;
-         b += singleLine;
-      }
-      delete iterator;
-
-      singleLine = END_TARGET;
-      b += singleLine;
-   }
-
-   // End of local element
-   b.append(END_LOCAL);
-
-   // Remote element
-   b.append(BEGIN_REMOTE);
-   if (!mRemoteIdentity.isNull())
-   {
-      b.append(BEGIN_IDENTITY);
-      if (!mRemoteDisplay.isNull())
-      {
-         UtlString displayName = mRemoteDisplay;
-         NameValueTokenizer::frontBackTrim(&displayName, "\"");
-         b.append(DISPLAY_EQUAL);
-         singleLine = DOUBLE_QUOTE;
-         XmlEscape(singleLine, displayName);
-         singleLine += DOUBLE_QUOTE;
-         b += singleLine;
-      }
-
-      singleLine = END_BRACKET;
-      XmlEscape(singleLine, mRemoteIdentity);
-      singleLine += END_IDENTITY;
-      b += singleLine;
-   }
-
-   if (!mRemoteTarget.isNull() && mRemoteTarget.compareTo("sip:") != 0)
-   {
-      singleLine = BEGIN_TARGET;
-      XmlEscape(singleLine, mRemoteTarget);
-      singleLine += DOUBLE_QUOTE END_LINE;
-      b += singleLine;
-      // add optional parameters
-      UtlDListIterator* iterator = getRemoteParameterIterator();
-      NameValuePairInsensitive* nvp;
-      while ((nvp = (NameValuePairInsensitive*) (*iterator)()))
-      {
-         singleLine = BEGIN_DIALOG_PARAM;
-         singleLine += PNAME;
-         XmlEscape(singleLine, nvp->data());
-         singleLine += PVALUE;
-         XmlEscape(singleLine, nvp->getValue());
-         singleLine += END_DIALOG_PARAM;
-         b += singleLine;
-      }
-      delete iterator;
-
-      singleLine = END_TARGET;
-      b += singleLine;
-   }
-
-   // End of remote element
-   b.append(END_REMOTE);
+   appendParticipant(writer, "local", mLocalIdentity, mLocalDisplay, mLocalTarget, mLocalParameters);
+   appendParticipant(writer, "remote", mRemoteIdentity, mRemoteDisplay, mRemoteTarget, mRemoteParameters);
 
    // End of dialog element
-   b.append(END_DIALOG);
-
-   l = b.length();
+   writer.raw(END_DIALOG);
 }
 
 void Dialog::getDialog(UtlString& dialogId,
@@ -635,170 +568,271 @@ SipDialogEvent::~SipDialogEvent()
 
 /* ============================ MANIPULATORS ============================== */
 
-void SipDialogEvent::parseBody(const char* bodyBytes)
+// Get the decoded value of an attribute of the current element, or "" if it is absent.
+static void getAttribute(const XmlPullParser& parser, const char* name, UtlString& value)
 {
-   bool foundDialogs = false;
-
-   if(bodyBytes)
+   XmlPullParser::Slice slice;
+   value.remove(0);
+   if (parser.getAttribute(name, slice))
    {
-      Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, "SipDialogEvent::parseBody incoming package = %s\n",
-                    bodyBytes);
+      slice.decodeTo(value);
+   }
+}
 
-      TiXmlDocument doc("dialogEvent.xml");
+// Parse the <target> element the parser is positioned on, including its <param> children.
+static bool parseTarget(XmlPullParser& parser, Dialog* pDialog, bool local)
+{
+   UtlString target;
+   getAttribute(parser, "uri", target);
+   if (local)
+   {
+      pDialog->setLocalTarget(target);
+   }
+   else
+   {
+      pDialog->setRemoteTarget(target);
+   }
 
-      doc.Parse(bodyBytes);
-      if (!doc.Error())
+   size_t depth = parser.getDepth();
+   for (XmlPullParser::Event event = parser.next(); ; event = parser.next())
+   {
+      if (event == XmlPullParser::START_ELEMENT)
       {
-         TiXmlNode * rootNode = doc.FirstChild ("dialog-info");
-
-         TiXmlElement* ucElement = 0;
-
-         if (rootNode != NULL)
+         if (parser.getDepth() == depth + 1 && parser.getName().equals("param"))
          {
-            ucElement = rootNode->ToElement();
-
-            if (ucElement)
+            UtlString pname, pvalue;
+            getAttribute(parser, "pname", pname);
+            getAttribute(parser, "pval", pvalue);
+            NameValuePairInsensitive* nvp = new NameValuePairInsensitive(pname, pvalue);
+            if (local)
+            {
+               pDialog->addLocalParameter(nvp);
+            }
+            else
             {
-               mVersion = atoi(ucElement->Attribute("version"));
-               mDialogState = ucElement->Attribute("state");
-               mEntity = ucElement->Attribute("entity");
+               pDialog->addRemoteParameter(nvp);
             }
+         }
+         if (!parser.skipElement())
+         {
+            return false;
+         }
+      }
+      else if (event == XmlPullParser::END_ELEMENT)
+      {
+         return true;
+      }
+      else if (event == XmlPullParser::ERROR || event == XmlPullParser::END_DOCUMENT)
+      {
+         return false;
+      }
+   }
+}
 
-            // Parse each dialog
-            for (TiXmlNode *groupNode = rootNode->FirstChild("dialog");
-                 groupNode;
-                 groupNode = groupNode->NextSibling("dialog"))
+// Parse the <local> or <remote> element the parser is positioned on.
+static bool parseParticipant(XmlPullParser& parser, Dialog* pDialog, bool local)
+{
+   size_t depth = parser.getDepth();
+   for (XmlPullParser::Event event = parser.next(); ; event = parser.next())
+   {
+      if (event == XmlPullParser::START_ELEMENT)
+      {
+         bool ok;
+         if (parser.getDepth() == depth + 1 && parser.getName().equals("identity"))
+         {
+            UtlString identity, display;
+            getAttribute(parser, "display", display);
+            ok = parser.readText(identity);
+            if (local)
+            {
+               pDialog->setLocalIdentity(identity, display);
+            }
+            else
             {
-               UtlString dialogId, callId, localTag, remoteTag, direction;
+               pDialog->setRemoteIdentity(identity, display);
+            }
+         }
+         else if (parser.getDepth() == depth + 1 && parser.getName().equals("target"))
+         {
+            ok = parseTarget(parser, pDialog, local);
+         }
+         else
+         {
+            ok = parser.skipElement();
+         }
 
-               foundDialogs = true;
+         if (!ok)
+         {
+            return false;
+         }
+      }
+      else if (event == XmlPullParser::END_ELEMENT)
+      {
+         return true;
+      }
+      else if (event == XmlPullParser::ERROR || event == XmlPullParser::END_DOCUMENT)
+      {
+         return false;
+      }
+   }
+}
 
-               // Get the attributes in dialog
-               ucElement = groupNode->ToElement();
-               if (ucElement)
-               {
-                  dialogId = ucElement->Attribute("id");
-                  callId = ucElement->Attribute("call-id");
-                  localTag = ucElement->Attribute("local-tag");
-                  remoteTag = ucElement->Attribute("remote-tag");
-                  direction = ucElement->Attribute("direction");
-               }
+// Parse the <dialog> element the parser is positioned on.
+// Returns NULL if the document is malformed.
+static Dialog* parseDialog(XmlPullParser& parser)
+{
+   UtlString dialogId, callId, localTag, remoteTag, direction;
+   getAttribute(parser, "id", dialogId);
+   getAttribute(parser, "call-id", callId);
+   getAttribute(parser, "local-tag", localTag);
+   getAttribute(parser, "remote-tag", remoteTag);
+   getAttribute(parser, "direction", direction);
+
+   Dialog* pDialog = new Dialog(dialogId, callId, localTag, remoteTag, direction);
+   pDialog->setDuration(0);
+
+   size_t depth = parser.getDepth();
+   for (XmlPullParser::Event event = parser.next(); ; event = parser.next())
+   {
+      if (event == XmlPullParser::START_ELEMENT)
+      {
+         bool ok;
+         const XmlPullParser::Slice& name = parser.getName();
+         if (parser.getDepth() != depth + 1)
+         {
+            ok = parser.skipElement();
+         }
+         else if (name.equals("state"))
+         {
+            UtlString state, stateEvent, code;
+            getAttribute(parser, "event", stateEvent);
+            getAttribute(parser, "code", code);
+            ok = parser.readText(state);
+            pDialog->setState(state, stateEvent, code);
+         }
+         else if (name.equals("duration"))
+         {
+            UtlString duration;
+            ok = parser.readText(duration);
+            pDialog->setDuration((unsigned long)atoi(duration.data()));
+         }
+         else if (name.equals("local"))
+         {
+            ok = parseParticipant(parser, pDialog, true);
+         }
+         else if (name.equals("remote"))
+         {
+            ok = parseParticipant(parser, pDialog, false);
+         }
+         else
+         {
+            ok = parser.skipElement();
+         }
 
-               Dialog* pDialog = new Dialog(dialogId, callId, localTag, remoteTag, direction);
+         if (!ok)
+         {
+            break;
+         }
+      }
+      else if (event == XmlPullParser::END_ELEMENT)
+      {
+         return pDialog;
+      }
+      else if (event == XmlPullParser::ERROR || event == XmlPullParser::END_DOCUMENT)
+      {
+         break;
+      }
+   }
 
-               // Get the state element
-               UtlString state, event, code;
-               state = (groupNode->FirstChild("state"))->FirstChild()->Value();
+   delete pDialog;
+   return NULL;
+}
 
-               ucElement = groupNode->FirstChild("state")->ToElement();
-               if (ucElement)
-               {
-                  event = ucElement->Attribute("event");
-                  code = ucElement->Attribute("code");
-                  pDialog->setState(state, event, code);
-               }
+void SipDialogEvent::parseBody(const char* bodyBytes)
+{
+   if(bodyBytes)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, "SipDialogEvent::parseBody incoming package = %s\n",
+                    bodyBytes);
 
-               // Get the duration element
-               UtlString duration;
-               TiXmlNode *subNode = groupNode->FirstChild("duration");
-               if (subNode)
-               {
-                  duration = subNode->FirstChild()->Value();
-                  pDialog->setDuration((unsigned long)atoi(duration.data()));
-               }
-               else
-               {
-                  pDialog->setDuration(0);
-               }
+      XmlPullParser parser(bodyBytes, strlen(bodyBytes));
+      XmlPullParser::Event event;
 
-               // Get the local element
-               UtlString identity, display, target;
-               subNode = groupNode->FirstChild("local");
-               if (subNode)
-               {
-                  TiXmlNode *subNode1 = subNode->FirstChild("identity");
-                  if (subNode1)
-                  {
-                     identity = subNode1->FirstChild()->Value();
-                     ucElement = subNode1->ToElement();
-                     if (ucElement)
-                     {
-                        display = ucElement->Attribute("display");
-                        pDialog->setLocalIdentity(identity, display);
-                     }
-                  }
+      // Skip the XML declaration and any comments in front of the root element
+      do
+      {
+         event = parser.next();
+      } while (event == XmlPullParser::PROCESSING_INSTRUCTION || event == XmlPullParser::COMMENT);
 
-                  subNode1 = subNode->FirstChild("target");
-                  ucElement = subNode1->ToElement();
-                  if (ucElement)
+      if (event == XmlPullParser::START_ELEMENT && parser.getName().equals("dialog-info"))
+      {
+         UtlString version, dialogState, entity;
+         getAttribute(parser, "version", version);
+         getAttribute(parser, "state", dialogState);
+         getAttribute(parser, "entity", entity);
+
+         // Collect the dialogs first, so that a malformed body leaves no partial state
+         UtlSList dialogs;
+         for (event = parser.next();
+              event != XmlPullParser::END_ELEMENT && event != XmlPullParser::ERROR;
+              event = parser.next())
+         {
+            if (event == XmlPullParser::START_ELEMENT)
+            {
+               if (parser.getName().equals("dialog"))
+               {
+                  Dialog* pDialog = parseDialog(parser);
+                  if (pDialog)
                   {
-                     target = ucElement->Attribute("uri");
-                     pDialog->setLocalTarget(target);
-
-                     // parse optional param elements
-                     for (TiXmlNode *paramNode = 0;
-                       (paramNode = subNode1->IterateChildren("param", paramNode)); )
-                     {
-                        TiXmlElement *paramElement = paramNode->ToElement();
-                        const char* pname = paramElement->Attribute("pname");
-                        const char* pvalue = paramElement->Attribute("pval");
-                        pDialog->addLocalParameter(new NameValuePairInsensitive(pname, pvalue));
-                     }
-
+                     dialogs.append(pDialog);
                   }
                }
-
-               // Get the remote element
-               subNode = groupNode->FirstChild("remote");
-               if (subNode)
+               else
                {
-                  TiXmlNode *subNode1 = subNode->FirstChild("identity");
-                  if (subNode1)
-                  {
-                     identity = subNode1->FirstChild()->Value();
-                     ucElement = subNode1->ToElement();
-                     if (ucElement)
-                     {
-                        display = ucElement->Attribute("display");
-                        pDialog->setRemoteIdentity(identity, display);
-                     }
-                  }
-
-                  subNode1 = subNode->FirstChild("target");
-                  ucElement = subNode1->ToElement();
-                  if (ucElement)
-                  {
-                     target = ucElement->Attribute("uri");
-                     pDialog->setRemoteTarget(target);
-
-                     // parse optional param elements
-                     for (TiXmlNode *paramNode = 0;
-                       (paramNode = subNode1->IterateChildren("param", paramNode)); )
-                     {
-                        TiXmlElement *paramElement = paramNode->ToElement();
-                        const char* pname = paramElement->Attribute("pname");
-                        const char* pvalue = paramElement->Attribute("pval");
-                        pDialog->addRemoteParameter(new NameValuePairInsensitive(pname, pvalue));
-                     }
-                  }
+                  parser.skipElement();
                }
-
-               // Insert it into the list
-               insertDialog(pDialog);
-            }
-            if (foundDialogs == false)
-            {
-               Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, "SipDialogEvent::parseBody no dialogs found");
             }
          }
+
+         // Check the rest of the document
+         while (event != XmlPullParser::END_DOCUMENT && event != XmlPullParser::ERROR)
+         {
+            event = parser.next();
+         }
+
+         if (event == XmlPullParser::ERROR)
+         {
+            dialogs.destroyAll();
+            Os::Logger::instance().log(FAC_SIP, PRI_ERR, "SipDialogEvent::parseBody xml parsing error: %s",
+                          parser.getError());
+         }
          else
          {
-            Os::Logger::instance().log(FAC_SIP, PRI_ERR, "SipDialogEvent::parseBody <dialog-info> not found");
+            mVersion = atoi(version.data());
+            mDialogState = dialogState;
+            mEntity = entity;
+
+            if (dialogs.isEmpty())
+            {
+               Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, "SipDialogEvent::parseBody no dialogs found");
+            }
+
+            // Insert them into the list
+            Dialog* pDialog;
+            while ((pDialog = dynamic_cast<Dialog*>(dialogs.get())))
+            {
+               insertDialog(pDialog);
+            }
          }
       }
+      else if (event == XmlPullParser::ERROR)
+      {
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR, "SipDialogEvent::parseBody xml parsing error: %s",
+                       parser.getError());
+      }
       else
       {
-         Os::Logger::instance().log(FAC_SIP, PRI_ERR, "SipDialogEvent::parseBody xml parsing error");
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR, "SipDialogEvent::parseBody <dialog-info> not found");
       }
    }
 }
@@ -984,56 +1018,50 @@ UtlSListIterator* SipDialogEvent::getDialogIterator()
 void SipDialogEvent::buildBody(int* version) const
 {
    UtlString dialogEvent;
-   UtlString singleLine;
+   XmlWriter<UtlString> writer(dialogEvent);
+
+   // Take the lock (we will be modifying the state even though 'this'
+   // is read-only).
+   (const_cast <SipDialogEvent*> (this))->mLock.acquire();
+
+   // Size the body for the dialogs up front so it is built in one buffer.
+   dialogEvent.capacity(DIALOG_INFO_SIZE_ESTIMATE + mDialogs.entries() * DIALOG_SIZE_ESTIMATE);
 
    // Construct the xml document of dialog event
-   dialogEvent = UtlString(XML_VERSION_1_0);
+   writer.raw(XML_VERSION_1_0);
 
    // Dialog Information Structure
-   dialogEvent.append(BEGIN_DIALOG_INFO);
+   writer.raw(BEGIN_DIALOG_INFO);
 
    if (version)
    {
       // Generate the body with the recorded version.
-      char buffer[20];
-      sprintf(buffer, "%d", mVersion);
-      dialogEvent.append(VERSION_EQUAL);
-      singleLine = DOUBLE_QUOTE + UtlString(buffer) + DOUBLE_QUOTE;
-      dialogEvent += singleLine;
+      dialogEvent.append(VERSION_EQUAL DOUBLE_QUOTE);
+      dialogEvent.appendNumber(mVersion);
+      dialogEvent.append(DOUBLE_QUOTE);
       // Return the XML version.
       *version = mVersion;
    }
    else
    {
       // Generate the body with the substitution placeholder.
-      dialogEvent.append(VERSION_EQUAL
-                         DOUBLE_QUOTE VERSION_PLACEHOLDER DOUBLE_QUOTE);
+      writer.raw(VERSION_EQUAL
+                 DOUBLE_QUOTE VERSION_PLACEHOLDER DOUBLE_QUOTE);
    }
 
-   dialogEvent.append(STATE_EQUAL);
-   singleLine = DOUBLE_QUOTE + mDialogState + DOUBLE_QUOTE;
-   dialogEvent += singleLine;
-
-   dialogEvent.append(ENTITY_EQUAL);
-   singleLine = DOUBLE_QUOTE;
-   XmlEscape(singleLine, mEntity);
-   singleLine += DOUBLE_QUOTE;
-   dialogEvent += singleLine;
-   dialogEvent.append(END_LINE);
-
-   // Take the lock (we will be modifying the state even though 'this'
-   // is read-only).
-   (const_cast <SipDialogEvent*> (this))->mLock.acquire();
+   // mDialogState is a token
+   writer.raw(STATE_EQUAL DOUBLE_QUOTE)
+      .raw(mDialogState.data(), mDialogState.length())
+      .raw(DOUBLE_QUOTE);
+   writer.attribute("entity", mEntity.data(), mEntity.length());
+   writer.raw(END_LINE);
 
    // Dialog elements
    UtlSListIterator dialogIterator(mDialogs);
    Dialog* pDialog;
    while ((pDialog = (Dialog *) dialogIterator()))
    {
-      UtlString b;
-      ssize_t l;
-      pDialog->getBytes(b, l);
-      dialogEvent.append(b);
+      pDialog->appendBytes(dialogEvent);
    }
 
    // End of dialog-info element
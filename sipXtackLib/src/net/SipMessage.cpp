@@ -26,6 +26,7 @@
 #include <net/MimeBodyPart.h>
 #include <net/NameValueTokenizer.h>
 #include <net/SipMessage.h>
+#include <net/SipTokens.h>
 #include <net/SipUserAgent.h>
 #include <net/SmimeBody.h>
 #include <net/Url.h>
@@ -41,7 +42,6 @@ const UtlContainableType SipMessage::TYPE = "SipMessage";
 #define MAXIMUM_INTEGER_STRING_LENGTH 20
 
 // STATIC VARIABLES
-SipMessage::SipMessageFieldProps SipMessage::sSipMessageFieldProps;
 
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 
@@ -125,17 +125,20 @@ UtlContainableType SipMessage::getContainableType(void) const
 UtlBoolean SipMessage::getShortName(const char* longFieldName,
                        UtlString* shortFieldName)
 {
-   NameValuePair longNV(longFieldName);
    UtlBoolean nameFound = FALSE;
 
    shortFieldName->remove(0);
 
-   NameValuePair* shortNV =
-      dynamic_cast <NameValuePair*> (sSipMessageFieldProps.mLongFieldNames.find(&longNV));
-   if(shortNV)
+   // Only a long name has a compact form.
+   if(longFieldName && longFieldName[0] && longFieldName[1])
    {
-      shortFieldName->append(shortNV->getValue());
-      nameFound = TRUE;
+      const char* shortName =
+         SipTokens::headerCompactName(SipTokens::header(longFieldName));
+      if(shortName)
+      {
+         shortFieldName->append(shortName);
+         nameFound = TRUE;
+      }
    }
    return(nameFound);
 }
@@ -150,13 +153,10 @@ UtlBoolean SipMessage::getLongName(const char* shortFieldName,
     if(shortFieldName && shortFieldName[0] &&
         shortFieldName[1] == '\0')
     {
-        UtlString shortNV(shortFieldName);
-
-       NameValuePair* longNV =
-          dynamic_cast <NameValuePair*> (sSipMessageFieldProps.mShortFieldNames.find(&shortNV));
-       if(longNV)
+       SipTokens::Header header = SipTokens::header(shortFieldName, 1);
+       if(header != SipTokens::HEADER_UNKNOWN)
        {
-          *longFieldName = longNV->getValue();
+          *longFieldName = SipTokens::headerName(header);
           nameFound = TRUE;
        }
         // Optimization in favor of utility
@@ -174,27 +174,28 @@ void SipMessage::replaceShortFieldNames()
    UtlString longName;
    size_t position;
 
+   // The headers are only copied, if shared, when one has a short name.
    for ( position= 0;
-         (nvPair = dynamic_cast<NameValuePair*>(mNameValues.at(position)));
+         (nvPair = dynamic_cast<NameValuePair*>(nameValues().at(position)));
          position++
         )
    {
       if(getLongName(nvPair->data(), &longName))
       {
          // There is a long form for this name, so replace it.
-         mHeaderCacheClean = FALSE;
+         UtlDList& headers = changeNameValues();
          NameValuePair* modified;
 
          /*
           * NOTE: the header name is the containable key, so we must remove the
-          *       NameValuePair from the mNameValues list and then reinsert the
+          *       NameValuePair from the header list and then reinsert the
           *       modified version; you are not allowed to modify key values while
           *       an object is in a container.
           */
-         modified = dynamic_cast<NameValuePair*>(mNameValues.removeAt(position));
-         nvPair->remove(0);
-         nvPair->append(longName);
-         mNameValues.insertAt(position, modified);
+         modified = dynamic_cast<NameValuePair*>(headers.removeAt(position));
+         modified->remove(0);
+         modified->append(longName);
+         headers.insertAt(position, modified);
       }
    }
 }
@@ -615,7 +616,9 @@ const SdpBody* SipMessage::getSdpBody(const char* derPkcs12,
             pkcs12SymmetricKey &&
             contentType.compareTo(smimeType))
     {
-        SmimeBody* smimeBody = (SmimeBody*) getBody();
+        // Decrypt a copy: the body is not changed once attached, as
+        // copies of the message on other threads may share it.
+        SmimeBody* smimeBody = ((const SmimeBody*) getBody())->copy();
 
         // Try to decrypt if it has not already been decrypted
         if(! smimeBody->isDecrypted())
@@ -640,6 +643,7 @@ const SdpBody* SipMessage::getSdpBody(const char* derPkcs12,
         {
             Os::Logger::instance().log(FAC_SIP, PRI_WARNING, "Could not decrypt S/MIME body");
         }
+        delete smimeBody;
     }
 
     // Else if this is a multipart MIME body see
@@ -667,7 +671,8 @@ const SdpBody* SipMessage::getSdpBody(const char* derPkcs12,
                         derPkcs12Length > 0 &&
                         pkcs12SymmetricKey)
                 {
-                    SmimeBody* smimeBody = (SmimeBody*) bodyPart;
+                    // Decrypt a copy, as the body may be shared
+                    SmimeBody* smimeBody = ((const SmimeBody*) bodyPart)->copy();
 
                     // Try to decrypt if it has not already been decrypted
                     if(! smimeBody->isDecrypted())
@@ -686,13 +691,17 @@ const SdpBody* SipMessage::getSdpBody(const char* derPkcs12,
                         if(strcmp(decryptedHttpBody->getContentType(), sdpType) == 0)
                         {
                             body = convertToSdpBody(decryptedHttpBody);
-                            break;
                         }
                     }
                     else
                     {
                         Os::Logger::instance().log(FAC_SIP, PRI_WARNING, "Could not decrypt S/MIME body");
                     }
+                    delete smimeBody;
+                    if(body)
+                    {
+                        break;
+                    }
                 }
                 partIndex++ ;
             }
@@ -1459,6 +1468,59 @@ UtlBoolean SipMessage::verifyMd5Authorization(const char* userId,
     UtlString uriString;
     UtlString method;
 
+    getAuthorizationMethodAndUri(uri, uriString, method);
+
+#ifdef TEST
+    Os::Logger::instance().log(FAC_SIP,PRI_DEBUG,
+                  "SipMessage::verifyMd5Authorization - "
+                  "userId='%s', password='%s', nonce='%s', "
+                  "realm='%s', cnonce='%s', nonceCount='%s', "
+                  "qop='%s', uri='%s', method='%s'",
+                  userId, password, nonce,realm, cnonce,
+                  nonceCount, qop,uriString.data(), method.data());
+#endif
+
+    UtlBoolean isAllowed = FALSE;
+    isAllowed = HttpMessage::verifyMd5Authorization(userId,
+                                                    password,
+                                                    nonce,
+                                                    realm,
+                                                    cnonce,
+                                                    nonceCount,
+                                                    qop,
+                                                    method.data(),
+                                                    uriString.data(),
+                                                    authEntity);
+    return isAllowed;
+}
+
+UtlBoolean SipMessage::verifyMd5Authorization(const char* userPasswordDigest,
+                                              const char* nonce,
+                                              const char* cnonce,
+                                              const char* nonceCount,
+                                              const char* qop,
+                                              const char* uri,
+                                              enum HttpEndpointEnum authEntity) const
+{
+    UtlString uriString;
+    UtlString method;
+
+    getAuthorizationMethodAndUri(uri, uriString, method);
+
+    return HttpMessage::verifyMd5Authorization(userPasswordDigest,
+                                               nonce,
+                                               cnonce,
+                                               nonceCount,
+                                               qop,
+                                               method.data(),
+                                               uriString.data(),
+                                               authEntity);
+}
+
+void SipMessage::getAuthorizationMethodAndUri(const char* uri,
+                                              UtlString& uriString,
+                                              UtlString& method) const
+{
     if(isResponse())
     {
         int seqNum;
@@ -1491,29 +1553,6 @@ UtlBoolean SipMessage::verifyMd5Authorization(const char* userId,
        }
        getRequestMethod(&method);
     }
-
-#ifdef TEST
-    Os::Logger::instance().log(FAC_SIP,PRI_DEBUG,
-                  "SipMessage::verifyMd5Authorization - "
-                  "userId='%s', password='%s', nonce='%s', "
-                  "realm='%s', cnonce='%s', nonceCount='%s', "
-                  "qop='%s', uri='%s', method='%s'",
-                  userId, password, nonce,realm, cnonce,
-                  nonceCount, qop,uriString.data(), method.data());
-#endif
-
-    UtlBoolean isAllowed = FALSE;
-    isAllowed = HttpMessage::verifyMd5Authorization(userId,
-                                                    password,
-                                                    nonce,
-                                                    realm,
-                                                    cnonce,
-                                                    nonceCount,
-                                                    qop,
-                                                    method.data(),
-                                                    uriString.data(),
-                                                    authEntity);
-    return isAllowed;
 }
 
 HttpMessage::AuthQopValues SipMessage::verifyQopConsistency(const char* cnonce,
@@ -2303,16 +2342,16 @@ void SipMessage::addVia(const char* domainName,
 
 void SipMessage::addViaField(const char* viaField, UtlBoolean afterOtherVias)
 {
-    mHeaderCacheClean = FALSE;
+    UtlDList& headers = changeNameValues();
 
    NameValuePair* nv = new NameValuePair(SIP_VIA_FIELD, viaField);
     // Look for other via fields
-    ssize_t fieldIndex = mNameValues.index(nv);
+    ssize_t fieldIndex = headers.index(nv);
 
     if(fieldIndex == UTL_NOT_FOUND)
     {
 #       ifdef TEST_PRINT
-        UtlDListIterator iterator(mNameValues);
+        UtlDListIterator iterator(headers);
 
         //remove whole line
         NameValuePair* nv = NULL;
@@ -2323,15 +2362,13 @@ void SipMessage::addViaField(const char* viaField, UtlBoolean afterOtherVias)
 #       endif
     }
 
-    mHeaderCacheClean = FALSE;
-
     if(fieldIndex == UTL_NOT_FOUND || !afterOtherVias)
     {
-      mNameValues.insert(nv);
+      headers.insert(nv);
     }
     else
     {
-        mNameValues.insertAt(fieldIndex, nv);
+        headers.insertAt(fieldIndex, nv);
     }
 }
 
@@ -3185,12 +3222,10 @@ UtlBoolean SipMessage::removeTopVia()
    NameValuePair viaHeaderField(SIP_VIA_FIELD);
 
    // Remove whole line.
-   NameValuePair* nv = dynamic_cast <NameValuePair*> (mNameValues.find(&viaHeaderField));
-   if(nv)
+   if(nameValues().find(&viaHeaderField))
    {
-      mHeaderCacheClean = FALSE;
-      mNameValues.destroy(nv);
-      nv = NULL;
+      UtlDList& headers = changeNameValues();
+      headers.destroy(headers.find(&viaHeaderField));
       fieldFound = TRUE;
    }
    // Add updated line.
@@ -3512,6 +3547,11 @@ UtlBoolean SipMessage::getCSeqField(int* sequenceNum, UtlString* sequenceMethod)
    return ret;
 }
 
+SipTokens::Method SipMessage::getMethodId() const
+{
+   return mRequestMethod;
+}
+
 UtlBoolean SipMessage::getContactUri(int addressIndex, UtlString* uri) const
 {
    UtlBoolean uriFound = getContactField(addressIndex, *uri);
@@ -3812,10 +3852,9 @@ void SipMessage::addRecordRouteUri(const char* recordRouteUri)
     NameValuePair* rrHeader =
        new NameValuePair(SIP_RECORD_ROUTE_FIELD, recordRouteUriString.data());
 
-    mHeaderCacheClean = FALSE;
-
-    ssize_t firstRR = mNameValues.index(rrHeader);
-    mNameValues.insertAt(UTL_NOT_FOUND == firstRR ? 0 : firstRR, rrHeader);
+    UtlDList& headers = changeNameValues();
+    ssize_t firstRR = headers.index(rrHeader);
+    headers.insertAt(UTL_NOT_FOUND == firstRR ? 0 : firstRR, rrHeader);
 }
 
 // isClientMsgStrictRouted returns whether or not a message
@@ -5005,12 +5044,11 @@ UtlBoolean SipMessage::isRecordRouteAccepted( void ) const
       // accept a Record-Route header.  If the request
       // is not REGISTER, MESSAGE or PUBLISH, the request
       // is assumed to accept Record-Route headers.
-      UtlString method;
-      getRequestMethod(&method);
+      SipTokens::Method method = getMethodId();
 
-      if (method.compareTo(SIP_MESSAGE_METHOD)  == 0 ||
-          method.compareTo(SIP_REGISTER_METHOD) == 0 ||
-          method.compareTo(SIP_PUBLISH_METHOD)  == 0 )
+      if (method == SipTokens::METHOD_MESSAGE  ||
+          method == SipTokens::METHOD_REGISTER ||
+          method == SipTokens::METHOD_PUBLISH )
       {
          isRecordRoutable = FALSE;
       }
@@ -5024,18 +5062,12 @@ UtlBoolean SipMessage::isRecordRouteAccepted( void ) const
 
 UtlBoolean SipMessage::isUrlHeaderAllowed(const char* headerFieldName)
 {
-    UtlString name(headerFieldName);
-    name.toUpper();
-
-    return (!sSipMessageFieldProps.mDisallowedUrlHeaders.contains(&name));
+    return (!SipTokens::isUrlHeaderDisallowed(SipTokens::header(headerFieldName)));
 }
 
 UtlBoolean SipMessage::isUrlHeaderUnique(const char* headerFieldName)
 {
-    UtlString name(headerFieldName);
-    name.toUpper();
-
-    return (sSipMessageFieldProps.mUniqueUrlHeaders.contains(&name));
+    return (SipTokens::isUrlHeaderUnique(SipTokens::header(headerFieldName)));
 }
 
 //SDUA
@@ -5331,89 +5363,6 @@ UtlBoolean SipMessage::getSipETagField(UtlString& sipETagField) const
 
 /* ============================ FUNCTIONS ================================= */
 
-SipMessage::SipMessageFieldProps::SipMessageFieldProps()
-{
-   // Call the initializer functions.
-   initNames();
-   initDisallowedUrlHeaders();
-   initUniqueUrlHeaders();
-}
-
-
-SipMessage::SipMessageFieldProps::~SipMessageFieldProps()
-{
-   // free the various value mappings
-   mLongFieldNames.destroyAll();
-   mShortFieldNames.destroyAll();
-   mDisallowedUrlHeaders.destroyAll();
-   mUniqueUrlHeaders.destroyAll();
-}
-
-
-void SipMessage::SipMessageFieldProps::initNames()
-{
-   // Load the table to translate long header names to short names.
-
-   mLongFieldNames.insert(new NameValuePair(SIP_CONTENT_TYPE_FIELD, SIP_SHORT_CONTENT_TYPE_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_CONTENT_ENCODING_FIELD, SIP_SHORT_CONTENT_ENCODING_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_FROM_FIELD, SIP_SHORT_FROM_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_CALLID_FIELD, SIP_SHORT_CALLID_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_CONTACT_FIELD, SIP_SHORT_CONTACT_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_CONTENT_LENGTH_FIELD, SIP_SHORT_CONTENT_LENGTH_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_REFERRED_BY_FIELD, SIP_SHORT_REFERRED_BY_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_REFER_TO_FIELD, SIP_SHORT_REFER_TO_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_SUBJECT_FIELD, SIP_SHORT_SUBJECT_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_SUPPORTED_FIELD, SIP_SHORT_SUPPORTED_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_TO_FIELD, SIP_SHORT_TO_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_VIA_FIELD, SIP_SHORT_VIA_FIELD));
-   mLongFieldNames.insert(new NameValuePair(SIP_EVENT_FIELD, SIP_SHORT_EVENT_FIELD));
-
-   // Reverse the pairs to load the table to translate short header names to
-   // long ones.
-
-   UtlHashBagIterator iterator(mLongFieldNames);
-   NameValuePair* nvPair;
-   while ((nvPair = dynamic_cast <NameValuePair*> (iterator())))
-   {
-      mShortFieldNames.insert(new NameValuePair(nvPair->getValue(),
-                                                 nvPair->data()));
-   }
-}
-
-void SipMessage::SipMessageFieldProps::initDisallowedUrlHeaders()
-{
-   // These headers may NOT be passed through in a URL to
-   // be set in a message
-
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_FROM_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_CONTACT_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_SHORT_CONTACT_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_CONTENT_LENGTH_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_SHORT_CONTENT_LENGTH_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_CONTENT_TYPE_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_SHORT_CONTENT_TYPE_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_CONTENT_ENCODING_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_SHORT_CONTENT_ENCODING_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_CSEQ_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_RECORD_ROUTE_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_REFER_TO_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_REFERRED_BY_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_TO_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_SHORT_TO_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_USER_AGENT_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_VIA_FIELD));
-   mDisallowedUrlHeaders.insert(new UtlString(SIP_SHORT_VIA_FIELD));
-}
-
-void SipMessage::SipMessageFieldProps::initUniqueUrlHeaders()
-{
-   // These headers may occur only once in a message, so a URI header
-   // parameter overrides the existing header in the message.
-
-   mUniqueUrlHeaders.insert(new UtlString(SIP_EXPIRES_FIELD));
-   mUniqueUrlHeaders.insert(new UtlString(SIP_ROUTE_FIELD));
-}
-
 void SipMessage::normalizeProxyRoutes(const SipUserAgent* sipUA,
                                       Url& requestUri,
                                       UtlSList* removedRoutes
@@ -5603,7 +5552,7 @@ void SipMessage::addDiversionUri(const char* diversion)
 {
     // Diversion is always added on the top
     NameValuePair* dHeader = new NameValuePair(SIP_DIVERSION_FIELD, diversion);
-    mHeaderCacheClean = FALSE;
-    ssize_t first = mNameValues.index(dHeader);
-    mNameValues.insertAt(UTL_NOT_FOUND == first ? 0 : first, dHeader);
+    UtlDList& headers = changeNameValues();
+    ssize_t first = headers.index(dHeader);
+    headers.insertAt(UTL_NOT_FOUND == first ? 0 : first, dHeader);
 }
\ No newline at end of file
@@ -0,0 +1,689 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+//////
+
+// SYSTEM INCLUDES
+#include <algorithm>
+#include <map>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// APPLICATION INCLUDES
+#include <net/SipMessageRecorder.h>
+#include <net/SipMessage.h>
+#include <net/Url.h>
+#include <os/OsDateTime.h>
+#include <os/OsLock.h>
+#include <os/OsLogger.h>
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+
+// Room for an IPv6 address in text form
+#define ADDRESS_SIZE 48
+
+// pcapng block types and the link type of the interface (raw IPv4)
+#define PCAPNG_SECTION_HEADER    0x0A0D0D0A
+#define PCAPNG_INTERFACE         0x00000001
+#define PCAPNG_ENHANCED_PACKET   0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC  0x1A2B3C4D
+#define PCAPNG_OPT_COMMENT       1
+#define LINKTYPE_IPV4            228
+
+// STATIC VARIABLE INITIALIZATIONS
+
+/// What a slot holds in front of the message bytes
+struct SlotHeader
+{
+   volatile unsigned long sequence;  ///< 2n+1 while message n is written, 2n+2 after
+   long           seconds;
+   long           usecs;
+   unsigned int   length;            ///< length of the message on the wire
+   unsigned int   captured;          ///< bytes that follow the header
+   int            localPort;
+   int            remotePort;
+   signed char    transport;
+   unsigned char  direction;
+   unsigned char  failed;
+   char           localAddress[ADDRESS_SIZE];
+   char           remoteAddress[ADDRESS_SIZE];
+};
+
+/// The slots written by one thread
+struct SipMessageRecorder::Ring
+{
+   Ring(size_t slots, size_t slotBytes) :
+      mSlots(slots),
+      mSlotBytes(slotBytes),
+      // keep every header aligned
+      mSlotSize((sizeof(SlotHeader) + slotBytes + 7) & ~((size_t) 7)),
+      mBuffer(new char[slots * mSlotSize]),
+      mWritten(0),
+      mClearedAt(0),
+      mInUse(false)
+   {
+      memset(mBuffer, 0, slots * mSlotSize);
+   }
+
+   ~Ring()
+   {
+      delete [] mBuffer;
+   }
+
+   SlotHeader* slot(unsigned long n) const
+   {
+      return (SlotHeader*) (mBuffer + (n % mSlots) * mSlotSize);
+   }
+
+   static char* bytes(SlotHeader* slot)
+   {
+      return (char*) (slot + 1);
+   }
+
+   const size_t           mSlots;
+   const size_t           mSlotBytes;
+   const size_t           mSlotSize;
+   char*                  mBuffer;
+   volatile unsigned long mWritten;    ///< messages written, only the owner changes it
+   volatile unsigned long mClearedAt;  ///< messages before this one were cleared
+   volatile bool          mInUse;      ///< a thread owns this ring
+};
+
+static void copyAddress(char* to, const char* from)
+{
+   if (from)
+   {
+      strncpy(to, from, ADDRESS_SIZE - 1);
+      to[ADDRESS_SIZE - 1] = '\0';
+   }
+   else
+   {
+      to[0] = '\0';
+   }
+}
+
+static bool earlier(const SipMessageRecorder::Message* a, const SipMessageRecorder::Message* b)
+{
+   return a->time < b->time;
+}
+
+static const char* transportName(OsSocket::IpProtocolSocketType transport)
+{
+   switch (transport)
+   {
+   case OsSocket::TCP:
+      return "TCP";
+   case OsSocket::SSL_SOCKET:
+      return "TLS";
+   default:
+      return "UDP";
+   }
+}
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ CREATORS ================================== */
+
+SipMessageRecorder::SipMessageRecorder(size_t slots, size_t slotBytes) :
+   mRecording(false),
+   mSlots(slots < MIN_SLOTS ? (size_t) MIN_SLOTS : slots),
+   mSlotBytes(slotBytes),
+   mRingsLock(OsMutex::Q_FIFO)
+{
+   pthread_key_create(&mRingKey, releaseRing);
+}
+
+SipMessageRecorder::~SipMessageRecorder()
+{
+   mRecording = false;
+   pthread_key_delete(mRingKey);
+
+   OsLock lock(mRingsLock);
+   for (size_t i = 0; i < mRings.size(); i++)
+   {
+      delete mRings[i];
+   }
+   mRings.clear();
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+void SipMessageRecorder::start()
+{
+   mRecording = true;
+}
+
+void SipMessageRecorder::stop()
+{
+   mRecording = false;
+}
+
+void SipMessageRecorder::clear()
+{
+   OsLock lock(mRingsLock);
+
+   std::vector<Ring*>::iterator kept = mRings.begin();
+   for (std::vector<Ring*>::iterator it = mRings.begin(); it != mRings.end(); ++it)
+   {
+      Ring* ring = *it;
+      if (!ring->mInUse && (ring->mSlots != mSlots || ring->mSlotBytes != mSlotBytes))
+      {
+         // left by a thread that is gone, and too different to be reused
+         delete ring;
+      }
+      else
+      {
+         ring->mClearedAt = ring->mWritten;
+         *kept++ = ring;
+      }
+   }
+   mRings.erase(kept, mRings.end());
+}
+
+void SipMessageRecorder::setCapacity(size_t slots, size_t slotBytes)
+{
+   OsLock lock(mRingsLock);
+
+   mSlots = slots < MIN_SLOTS ? (size_t) MIN_SLOTS : slots;
+   mSlotBytes = slotBytes;
+}
+
+void SipMessageRecorder::record(Direction direction,
+                                OsSocket::IpProtocolSocketType transport,
+                                const char* localAddress,
+                                int localPort,
+                                const char* remoteAddress,
+                                int remotePort,
+                                const char* bytes,
+                                size_t length,
+                                bool failed)
+{
+   if (!mRecording)
+   {
+      return;
+   }
+
+   Ring* ring = threadRing();
+   unsigned long n = ring->mWritten;
+   SlotHeader* slot = ring->slot(n);
+
+   // readers discard the slot from here on
+   slot->sequence = 2 * n + 1;
+   __sync_synchronize();
+
+   OsTime now;
+   OsDateTime::getCurTime(now);
+   slot->seconds = now.seconds();
+   slot->usecs = now.usecs();
+   slot->length = length;
+   slot->captured = std::min(length, ring->mSlotBytes);
+   slot->localPort = localPort;
+   slot->remotePort = remotePort;
+   slot->transport = transport;
+   slot->direction = direction;
+   slot->failed = failed;
+   copyAddress(slot->localAddress, localAddress);
+   copyAddress(slot->remoteAddress, remoteAddress);
+   memcpy(Ring::bytes(slot), bytes, slot->captured);
+
+   __sync_synchronize();
+   slot->sequence = 2 * n + 2;
+   ring->mWritten = n + 1;
+}
+
+void SipMessageRecorder::recordNote(const char* text, size_t length)
+{
+   record(OUTGOING, OsSocket::UNKNOWN, NULL, PORT_NONE, NULL, PORT_NONE, text, length);
+}
+
+/* ============================ ACCESSORS ================================= */
+
+void SipMessageRecorder::getMessages(std::vector<Message*>& messages) const
+{
+   OsLock lock(mRingsLock);
+
+   for (size_t r = 0; r < mRings.size(); r++)
+   {
+      Ring* ring = mRings[r];
+      unsigned long written = ring->mWritten;
+      unsigned long first = ring->mClearedAt;
+      if (written > ring->mSlots && written - ring->mSlots > first)
+      {
+         first = written - ring->mSlots;
+      }
+      __sync_synchronize();
+
+      for (unsigned long n = first; n < written; n++)
+      {
+         SlotHeader* slot = ring->slot(n);
+         unsigned long sequence = slot->sequence;
+         if (sequence != 2 * n + 2)
+         {
+            continue;   // already being reused
+         }
+         __sync_synchronize();
+
+         SlotHeader header;
+         memcpy(&header, (const void*) slot, sizeof(header));
+         header.localAddress[ADDRESS_SIZE - 1] = '\0';
+         header.remoteAddress[ADDRESS_SIZE - 1] = '\0';
+
+         Message* message = new Message;
+         message->bytes.append(Ring::bytes(slot),
+                               std::min((size_t) header.captured, ring->mSlotBytes));
+
+         __sync_synchronize();
+         if (slot->sequence != sequence)
+         {
+            delete message;   // overwritten while it was copied
+            continue;
+         }
+
+         message->time = OsTime(header.seconds, header.usecs);
+         message->direction = (Direction) header.direction;
+         message->failed = header.failed;
+         message->transport = (OsSocket::IpProtocolSocketType) header.transport;
+         message->localAddress = header.localAddress;
+         message->localPort = header.localPort;
+         message->remoteAddress = header.remoteAddress;
+         message->remotePort = header.remotePort;
+         message->length = header.length;
+         messages.push_back(message);
+      }
+   }
+
+   std::stable_sort(messages.begin(), messages.end(), earlier);
+}
+
+/// Append a value in host byte order, as pcapng wants
+template <class T> static void appendRaw(UtlString& data, T value)
+{
+   data.append((const char*) &value, sizeof(value));
+}
+
+static void appendPcapngBlock(UtlString& data, uint32_t type, const UtlString& body)
+{
+   size_t padding = (4 - body.length() % 4) % 4;
+   uint32_t total = 12 + body.length() + padding;
+
+   appendRaw(data, type);
+   appendRaw(data, total);
+   data.append(body);
+   data.append("\0\0\0", padding);
+   appendRaw(data, total);
+}
+
+static uint32_t ipv4Address(const UtlString& address)
+{
+   struct in_addr parsed;
+   return inet_aton(address.data(), &parsed) ? parsed.s_addr : 0;
+}
+
+static uint16_t ipChecksum(const unsigned char* header, size_t length)
+{
+   uint32_t sum = 0;
+   for (size_t i = 0; i + 1 < length; i += 2)
+   {
+      sum += (header[i] << 8) | header[i + 1];
+   }
+   while (sum >> 16)
+   {
+      sum = (sum & 0xffff) + (sum >> 16);
+   }
+   return htons(~sum & 0xffff);
+}
+
+void SipMessageRecorder::exportPcapng(UtlString& data) const
+{
+   std::vector<Message*> messages;
+   getMessages(messages);
+
+   UtlString body;
+   appendRaw(body, (uint32_t) PCAPNG_BYTE_ORDER_MAGIC);
+   appendRaw(body, (uint16_t) 1);   // version 1.0
+   appendRaw(body, (uint16_t) 0);
+   appendRaw(body, (int64_t) -1);   // section length not given
+   appendPcapngBlock(data, PCAPNG_SECTION_HEADER, body);
+
+   body.remove(0);
+   appendRaw(body, (uint16_t) LINKTYPE_IPV4);
+   appendRaw(body, (uint16_t) 0);
+   appendRaw(body, (uint32_t) 0);   // no snap length
+   appendPcapngBlock(data, PCAPNG_INTERFACE, body);
+
+   // next TCP sequence number of each direction of each connection
+   std::map<std::string, uint32_t> tcpSequence;
+
+   for (size_t i = 0; i < messages.size(); i++)
+   {
+      Message* message = messages[i];
+      if (message->transport == OsSocket::UNKNOWN)
+      {
+         continue;
+      }
+
+      bool incoming = message->direction == INCOMING;
+      const UtlString& source = incoming ? message->remoteAddress : message->localAddress;
+      const UtlString& destination = incoming ? message->localAddress : message->remoteAddress;
+      uint16_t sourcePort = incoming ? message->remotePort : message->localPort;
+      uint16_t destinationPort = incoming ? message->localPort : message->remotePort;
+      bool udp = message->transport == OsSocket::UDP || message->transport == OsSocket::MULTICAST;
+
+      unsigned char ip[20];
+      unsigned char transport[20];
+      size_t transportLength = udp ? 8 : 20;
+      size_t packetLength = sizeof(ip) + transportLength + message->length;
+
+      memset(ip, 0, sizeof(ip));
+      ip[0] = 0x45;                     // IPv4, 5 word header
+      *(uint16_t*) &ip[2] = htons(std::min(packetLength, (size_t) 0xffff));
+      ip[6] = 0x40;                     // don't fragment
+      ip[8] = 64;                       // TTL
+      ip[9] = udp ? IPPROTO_UDP : IPPROTO_TCP;
+      *(uint32_t*) &ip[12] = ipv4Address(source);
+      *(uint32_t*) &ip[16] = ipv4Address(destination);
+      *(uint16_t*) &ip[10] = ipChecksum(ip, sizeof(ip));
+
+      // checksums of UDP and TCP are left 0
+      memset(transport, 0, sizeof(transport));
+      *(uint16_t*) &transport[0] = htons(sourcePort);
+      *(uint16_t*) &transport[2] = htons(destinationPort);
+      if (udp)
+      {
+         *(uint16_t*) &transport[4] = htons(std::min(transportLength + message->length,
+                                                     (size_t) 0xffff));
+      }
+      else
+      {
+         char flow[2 * ADDRESS_SIZE + 32];
+         snprintf(flow, sizeof(flow), "%s:%d>%s:%d",
+                  source.data(), sourcePort, destination.data(), destinationPort);
+         uint32_t& sequence = tcpSequence[flow];
+
+         *(uint32_t*) &transport[4] = htonl(sequence);
+         transport[12] = 5 << 4;        // 5 word header
+         transport[13] = 0x18;          // PSH ACK
+         *(uint16_t*) &transport[14] = htons(0xffff);
+         sequence += message->length;
+      }
+
+      uint64_t timestamp = (uint64_t) message->time.seconds() * 1000000 + message->time.usecs();
+      uint32_t captured = sizeof(ip) + transportLength + message->bytes.length();
+
+      body.remove(0);
+      appendRaw(body, (uint32_t) 0);   // interface
+      appendRaw(body, (uint32_t) (timestamp >> 32));
+      appendRaw(body, (uint32_t) (timestamp & 0xffffffff));
+      appendRaw(body, captured);
+      appendRaw(body, (uint32_t) packetLength);
+      body.append((const char*) ip, sizeof(ip));
+      body.append((const char*) transport, transportLength);
+      body.append(message->bytes);
+      body.append("\0\0\0", (4 - captured % 4) % 4);
+      if (message->failed)
+      {
+         static const char comment[] = "send failed";
+         appendRaw(body, (uint16_t) PCAPNG_OPT_COMMENT);
+         appendRaw(body, (uint16_t) (sizeof(comment) - 1));
+         body.append(comment, sizeof(comment) - 1);
+         body.append("\0\0\0", (4 - (sizeof(comment) - 1) % 4) % 4);
+         appendRaw(body, (uint32_t) 0);   // end of options
+      }
+      appendPcapngBlock(data, PCAPNG_ENHANCED_PACKET, body);
+   }
+
+   for (size_t i = 0; i < messages.size(); i++)
+   {
+      delete messages[i];
+   }
+}
+
+static void appendElement(UtlString& data, const char* name, const UtlString& value)
+{
+   data.append("\t\t<");
+   data.append(name);
+   data.append(">");
+   data.append(value);
+   data.append("</");
+   data.append(name);
+   data.append(">\n");
+}
+
+void SipMessageRecorder::exportSipTrace(UtlString& data, const char* hostName) const
+{
+   std::vector<Message*> messages;
+   getMessages(messages);
+
+   data.append("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n<sipTrace>\n");
+
+   int frameId = 0;
+   for (size_t i = 0; i < messages.size(); i++)
+   {
+      Message* message = messages[i];
+      if (message->transport == OsSocket::UNKNOWN)
+      {
+         continue;
+      }
+
+      bool outgoing = message->direction == OUTGOING;
+      SipMessage sipMsg(message->bytes.data(), message->bytes.length());
+
+      UtlString localHostPort(message->localAddress);
+      localHostPort.append(":");
+      localHostPort.appendNumber(message->localPort);
+      UtlString remoteHostPort(message->remoteAddress);
+      remoteHostPort.append(":");
+      remoteHostPort.appendNumber(message->remotePort);
+
+      UtlString method;
+      UtlString responseCode;
+      UtlString responseText;
+      if (sipMsg.isResponse())
+      {
+         sipMsg.getFirstHeaderLinePart(1, &responseCode);
+         sipMsg.getFirstHeaderLinePart(2, &responseText);
+         if (message->failed)
+         {
+            responseCode.insert(0, "FAILED ");
+         }
+      }
+      else
+      {
+         sipMsg.getRequestMethod(&method);
+         if (method.compareTo(SIP_INVITE_METHOD, UtlString::ignoreCase) == 0)
+         {
+            Url to;
+            UtlString toTag;
+            sipMsg.getToUrl(to);
+            to.getFieldParameter("tag", toTag);
+            if (!toTag.isNull())
+            {
+               method = "re-INVITE";
+            }
+         }
+         if (message->failed)
+         {
+            method.insert(0, "FAILED ");
+         }
+      }
+
+      // The top Via names the other end of incoming requests
+      UtlString remoteName(remoteHostPort);
+      if (!outgoing && !sipMsg.isResponse())
+      {
+         UtlString protocol;
+         int viaPort;
+         sipMsg.getTopVia(&remoteName, &viaPort, &protocol);
+         remoteName.append(":");
+         remoteName.appendNumber(viaPort == PORT_NONE ? SIP_PORT : viaPort);
+      }
+
+      // transaction token: [C/A]cseq-number,call-id,from-tag,to-tag
+      int cseq;
+      UtlString cseqMethod;
+      sipMsg.getCSeqField(&cseq, &cseqMethod);
+      UtlString transactionId(
+         cseqMethod.compareTo(SIP_CANCEL_METHOD, UtlString::ignoreCase) == 0 ? "C" :
+         cseqMethod.compareTo(SIP_ACK_METHOD, UtlString::ignoreCase) == 0 ? "A" : "");
+      transactionId.appendNumber(cseq);
+      UtlString field;
+      sipMsg.getCallIdField(&field);
+      transactionId.append(",");
+      transactionId.append(field);
+      Url from;
+      sipMsg.getFromUrl(from);
+      from.getFieldParameter("tag", field);
+      transactionId.append(",");
+      transactionId.append(field);
+      Url to;
+      sipMsg.getToUrl(to);
+      to.getFieldParameter("tag", field);
+      transactionId.append(",");
+      transactionId.append(field);
+
+      data.append("\t<branchNode>\n\t\t<branchIdSet>\n");
+      UtlString via;
+      for (int viaIndex = 0; sipMsg.getViaFieldSubField(&via, viaIndex); viaIndex++)
+      {
+         UtlString branchId;
+         SipMessage::getViaTag(via.data(), "branch", branchId);
+         data.append("\t\t\t<branchId>");
+         data.append(branchId);
+         data.append("</branchId>\n");
+      }
+      data.append("\t\t</branchIdSet>\n");
+
+      UtlString time;
+      OsDateTime(message->time).getIsoTimeStringZus(time);
+      appendElement(data, "time", time);
+      appendElement(data, "source", outgoing ? UtlString(hostName) : remoteName);
+      appendElement(data, "destination", outgoing ? remoteName : UtlString(hostName));
+      appendElement(data, "sourceAddress", outgoing ? localHostPort : remoteHostPort);
+      appendElement(data, "destinationAddress", outgoing ? remoteHostPort : localHostPort);
+      appendElement(data, "transactionId", transactionId);
+      if (!method.isNull())
+      {
+         appendElement(data, "method", method);
+      }
+      else
+      {
+         appendElement(data, "responseCode", responseCode);
+         appendElement(data, "responseText", responseText);
+      }
+      UtlString frame;
+      frame.appendNumber(++frameId);
+      appendElement(data, "frameId", frame);
+      appendElement(data, "remoteHostPort", remoteHostPort);
+      appendElement(data, "isOutgoing", outgoing ? "true" : "false");
+      data.append("\t\t<message><![CDATA[");
+      data.append(message->bytes);
+      data.append("]]></message>\n");
+      data.append("\t</branchNode>\n");
+   }
+
+   data.append("</sipTrace>\n");
+
+   for (size_t i = 0; i < messages.size(); i++)
+   {
+      delete messages[i];
+   }
+}
+
+void SipMessageRecorder::exportText(UtlString& data) const
+{
+   std::vector<Message*> messages;
+   getMessages(messages);
+
+   for (size_t i = 0; i < messages.size(); i++)
+   {
+      Message* message = messages[i];
+      if (message->transport == OsSocket::UNKNOWN)
+      {
+         data.append(message->bytes);
+      }
+      else
+      {
+         bool outgoing = message->direction == OUTGOING;
+         if (outgoing)
+         {
+            data.append(transportName(message->transport));
+            data.append(message->failed
+                        ? " SIP User Agent failed to send message:\n"
+                        : " SIP User Agent sent message:\n");
+         }
+         else
+         {
+            data.append("Read SIP message:\n");
+         }
+         data.append("----Local Host:");
+         data.append(message->localAddress);
+         data.append("---- Port: ");
+         data.appendNumber(message->localPort);
+         data.append("----\n");
+         data.append("----Remote Host:");
+         data.append(message->remoteAddress);
+         data.append("---- Port: ");
+         data.appendNumber(message->remotePort);
+         data.append("----\n");
+         data.append(message->bytes);
+         data.append(outgoing
+                     ? "--------------------END--------------------\n"
+                     : "====================END====================\n");
+      }
+      delete message;
+   }
+}
+
+/* ============================ INQUIRY =================================== */
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+
+SipMessageRecorder::Ring* SipMessageRecorder::threadRing()
+{
+   Ring* ring = (Ring*) pthread_getspecific(mRingKey);
+   if (!ring)
+   {
+      OsLock lock(mRingsLock);
+
+      // reuse a ring left by a thread that exited
+      for (size_t i = 0; !ring && i < mRings.size(); i++)
+      {
+         if (!mRings[i]->mInUse
+             && mRings[i]->mSlots == mSlots
+             && mRings[i]->mSlotBytes == mSlotBytes)
+         {
+            ring = mRings[i];
+         }
+      }
+      if (!ring)
+      {
+         ring = new Ring(mSlots, mSlotBytes);
+         mRings.push_back(ring);
+         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                                    "SipMessageRecorder::threadRing %d rings of %d slots",
+                                    (int) mRings.size(), (int) mSlots);
+      }
+      ring->mInUse = true;
+      pthread_setspecific(mRingKey, ring);
+   }
+
+   return ring;
+}
+
+void SipMessageRecorder::releaseRing(void* ring)
+{
+   ((Ring*) ring)->mInUse = false;
+}
+
+/* ============================ FUNCTIONS ================================= */
@@ -45,6 +45,8 @@ UtlString(sipMethod ? sipMethod : "")
    mWantsIncoming = wantIncoming;
    mWantsOutGoing = wantOutGoing;
    mEventName = eventName ? eventName : "";
+   mSipMethodId = SipTokens::method(data(), length());
+   mEventPackage = SipTokens::eventPackage(mEventName.data(), mEventName.length());
 
    // Make a copy of the session
    if (pSession != NULL)
@@ -91,6 +93,11 @@ const char* SipObserverCriteria::getSipMethod() {
    return data();
 }
 
+SipTokens::Method SipObserverCriteria::getSipMethodId()
+{
+    return(mSipMethodId);
+}
+
 void* SipObserverCriteria::getObserverData()
 {
     return(mObserverData);
@@ -101,6 +108,11 @@ void SipObserverCriteria::getEventName(UtlString& eventName)
     eventName = mEventName;
 }
 
+SipTokens::EventPackage SipObserverCriteria::getEventPackage()
+{
+    return(mEventPackage);
+}
+
 SipSession* SipObserverCriteria::getSession()
 {
     return (mpSession);
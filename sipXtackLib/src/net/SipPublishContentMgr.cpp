@@ -7,6 +7,7 @@
 //////////////////////////////////////////////////////////////////////////////
 
 // SYSTEM INCLUDES
+#include <boost/bind.hpp>
 
 // APPLICATION INCLUDES
 #include <net/SipPublishContentMgr.h>
@@ -15,6 +16,7 @@
 #include <utl/UtlSList.h>
 #include <utl/UtlSListIterator.h>
 #include <utl/UtlInt.h>
+#include <utl/UtlMetrics.h>
 #include <net/HttpBody.h>
 #include <os/OsLogger.h>
 
@@ -67,6 +69,37 @@ private:
 
 };
 
+// Private class to hold a content-change callback waiting for its
+// coalescing window to pass.
+class PendingCallback : public UtlString
+{
+public:
+    PendingCallback(const UtlString& key,
+                    const char* resourceId,
+                    const char* eventTypeKey,
+                    const char* eventType,
+                    Int64 firstPublishUs,
+                    Int64 dueUs);
+
+    virtual ~PendingCallback();
+
+    // The parent UtlString is "resourceId\001eventTypeKey", which is the
+    // "key" string.
+
+    UtlString mResourceId;
+    UtlString mEventTypeKey;
+    UtlString mEventType;
+    // When the first of the publish() calls it stands for was made.
+    Int64 mFirstPublishUs;
+    // When the callback is to be called.
+    Int64 mDueUs;
+
+private:
+    //! DISALLOWED accidental copying
+    PendingCallback(const PendingCallback& rPendingCallback);
+    PendingCallback& operator=(const PendingCallback& rhs);
+};
+
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
 // CONSTANTS
@@ -99,6 +132,25 @@ PublishCallbackContainer::~PublishCallbackContainer()
 {
 }
 
+PendingCallback::PendingCallback(const UtlString& key,
+                                 const char* resourceId,
+                                 const char* eventTypeKey,
+                                 const char* eventType,
+                                 Int64 firstPublishUs,
+                                 Int64 dueUs) :
+   UtlString(key),
+   mResourceId(resourceId),
+   mEventTypeKey(eventTypeKey),
+   mEventType(eventType),
+   mFirstPublishUs(firstPublishUs),
+   mDueUs(dueUs)
+{
+}
+
+PendingCallback::~PendingCallback()
+{
+}
+
 PublishContentContainer::PublishContentContainer(UtlString key) :
    UtlString(key)
 {
@@ -139,6 +191,17 @@ void PublishContentContainer::dumpState()
 // Constructor
 SipPublishContentMgr::SipPublishContentMgr()
 : mPublishMgrMutex(OsMutex::Q_FIFO)
+, mCoalescingWindowUs(0)
+, mStopping(false)
+, mpCoalescer(NULL)
+, mNumCallbacksDelivered(0)
+, mNumPublishesCoalesced(0)
+, mTotalDelayUs(0)
+, mMaxDelayUs(0)
+, mCoalescedMetric(UtlMetrics::instance().counter("sipx_publish_coalesced_total",
+                                                  "Content changes notified together with another change to the resource"))
+, mDelayMetric(UtlMetrics::instance().histogram("sipx_publish_coalescing_delay_seconds",
+                                                "Time from a content change to its coalesced notification"))
 {
 }
 
@@ -150,6 +213,21 @@ SipPublishContentMgr::SipPublishContentMgr()
 // Destructor
 SipPublishContentMgr::~SipPublishContentMgr()
 {
+   // Stop the coalescing thread; callbacks still pending are dropped, as
+   // the observers are being shut down too.
+   if (mpCoalescer)
+   {
+      {
+         boost::lock_guard<boost::mutex> guard(mPendingMutex);
+         mStopping = true;
+      }
+      mPendingChanged.notify_all();
+      mpCoalescer->join();
+      delete mpCoalescer;
+   }
+   mPendingOrder.removeAll();
+   mPendingCallbacks.destroyAll();
+
    // Delete the stored information.
    mContentEntries.destroyAll();
    mPartialContentEntries.destroyAll();
@@ -260,18 +338,39 @@ void SipPublishContentMgr::publish(const char* resourceId,
     // Don't call the observers if noNotify is set or if this is default content.
     if (!noNotify && resourceId)
     {
-       // Call the observer for the content change, if any.
-       UtlString eventTypeString(eventType);
-       PublishCallbackContainer* callbackContainer =
-          dynamic_cast <PublishCallbackContainer*>
-          (mEventContentCallbacks.find(&eventTypeString));
-       if (callbackContainer)
+       // If coalescing, have the callback called when the window of the
+       // first change not yet notified passes, or fold this change into it.
+       UtlBoolean queued = FALSE;
+       {
+          boost::lock_guard<boost::mutex> guard(mPendingMutex);
+          if (mCoalescingWindowUs > 0)
+          {
+             PendingCallback* pending =
+                dynamic_cast <PendingCallback*> (mPendingCallbacks.find(&key));
+             if (pending)
+             {
+                mNumPublishesCoalesced++;
+                mCoalescedMetric.add();
+             }
+             else
+             {
+                Int64 now = UtlMetricHistogram::now();
+                pending = new PendingCallback(key, resourceId, eventTypeKey, eventType,
+                                              now, now + mCoalescingWindowUs);
+                mPendingCallbacks.insert(pending);
+                mPendingOrder.append(pending);
+                if (mPendingOrder.entries() == 1)
+                {
+                   mPendingChanged.notify_one();
+                }
+             }
+             queued = TRUE;
+          }
+       }
+
+       if (!queued)
        {
-          (callbackContainer->mpCallback)(callbackContainer->mpApplicationData,
-                                          resourceId,
-                                          eventTypeKey,
-                                          eventTypeString,
-                                          NULL);
+          contentChanged(resourceId, eventTypeKey, eventType, NULL);
        }
     }
 
@@ -359,6 +458,21 @@ void SipPublishContentMgr::unpublish(const char* resourceId,
     // Look up the key in the specific or default entries, as appropriate.
     if (resourceId)
     {
+       // A callback still waiting for its window is superseded by the
+       // callback below, which presents the latest content.
+       {
+          boost::lock_guard<boost::mutex> guard(mPendingMutex);
+          PendingCallback* pending =
+             dynamic_cast <PendingCallback*> (mPendingCallbacks.remove(&key));
+          if (pending)
+          {
+             mPendingOrder.removeReference(pending);
+             delete pending;
+             mNumPublishesCoalesced++;
+             mCoalescedMetric.add();
+          }
+       }
+
        PublishContentContainer* content =
           dynamic_cast <PublishContentContainer*> (mContentEntries.remove(&key));
        PublishContentContainer* partialContent =
@@ -571,6 +685,78 @@ void SipPublishContentMgr::getContentChangeObserver(const char* eventType,
 }
 
 
+// Set the window within which content changes are folded into one callback.
+void SipPublishContentMgr::setCoalescingWindow(int windowMs)
+{
+   Os::Logger::instance().log(FAC_SIP, PRI_INFO,
+                 "SipPublishContentMgr::setCoalescingWindow windowMs = %d",
+                 windowMs);
+
+   {
+      boost::lock_guard<boost::mutex> guard(mPendingMutex);
+      mCoalescingWindowUs = windowMs > 0 ? (Int64) windowMs * 1000 : 0;
+      if (mCoalescingWindowUs > 0 && !mpCoalescer)
+      {
+         mpCoalescer = new boost::thread(boost::bind(&SipPublishContentMgr::runCoalescer, this));
+      }
+   }
+   mPendingChanged.notify_all();
+
+   if (windowMs <= 0)
+   {
+      deliverCoalesced(TRUE);
+   }
+}
+
+// Deliver the callbacks whose coalescing window has passed.
+Int64 SipPublishContentMgr::deliverCoalesced(UtlBoolean force)
+{
+   Int64 next = -1;
+
+   // Hold the lock across taking and calling the callbacks, so that they
+   // are not overtaken by an unpublish() of the same resource.
+   lock();
+
+   UtlSList due;
+   {
+      boost::lock_guard<boost::mutex> guard(mPendingMutex);
+      Int64 now = UtlMetricHistogram::now();
+      PendingCallback* pending;
+      while ((pending = dynamic_cast <PendingCallback*> (mPendingOrder.first())))
+      {
+         if (!force && pending->mDueUs > now)
+         {
+            next = pending->mDueUs - now;
+            break;
+         }
+         mPendingOrder.get();
+         mPendingCallbacks.removeReference(pending);
+         due.append(pending);
+
+         Int64 delay = now - pending->mFirstPublishUs;
+         mNumCallbacksDelivered++;
+         mTotalDelayUs += delay;
+         if (delay > mMaxDelayUs)
+         {
+            mMaxDelayUs = delay;
+         }
+         mDelayMetric.tally(delay);
+      }
+   }
+
+   PendingCallback* pending;
+   while ((pending = dynamic_cast <PendingCallback*> (due.get())))
+   {
+      contentChanged(pending->mResourceId, pending->mEventTypeKey,
+                     pending->mEventType, NULL);
+      delete pending;
+   }
+
+   unlock();
+
+   return next;
+}
+
 /* ============================ ACCESSORS ================================= */
 
 UtlBoolean SipPublishContentMgr::getContent(const char* resourceId,
@@ -857,6 +1043,18 @@ void SipPublishContentMgr::getStats(int& numDefaultContent,
     unlock();
 }
 
+void SipPublishContentMgr::getCoalescingStats(int& numCallbacksDelivered,
+                                              int& numPublishesCoalesced,
+                                              Int64& meanDelayUs,
+                                              Int64& maxDelayUs)
+{
+    boost::lock_guard<boost::mutex> guard(mPendingMutex);
+    numCallbacksDelivered = mNumCallbacksDelivered;
+    numPublishesCoalesced = mNumPublishesCoalesced;
+    meanDelayUs = mNumCallbacksDelivered > 0 ? mTotalDelayUs / mNumCallbacksDelivered : 0;
+    maxDelayUs = mMaxDelayUs;
+}
+
 void SipPublishContentMgr::getPublished(const char* resourceId,
                                         const char* eventTypeKey,
                                         UtlBoolean fullState,
@@ -945,6 +1143,17 @@ void SipPublishContentMgr::dumpState()
    dumpStateBag(mDefaultContentEntries, "mDefaultContentEntries");
    dumpStateBag(mDefaultPartialContentEntries, "mDefaultPartialContentEntries");
 
+   int numCallbacksDelivered, numPublishesCoalesced;
+   Int64 meanDelayUs, maxDelayUs;
+   getCoalescingStats(numCallbacksDelivered, numPublishesCoalesced,
+                      meanDelayUs, maxDelayUs);
+   Os::Logger::instance().log(FAC_RLS, PRI_INFO,
+                 "\t      coalescing window %lld us, callbacks delivered %d, "
+                 "publishes coalesced %d, mean delay %lld us, max delay %lld us",
+                 (long long) mCoalescingWindowUs,
+                 numCallbacksDelivered, numPublishesCoalesced,
+                 (long long) meanDelayUs, (long long) maxDelayUs);
+
    unlock();
 }
 
@@ -976,6 +1185,60 @@ void SipPublishContentMgr::unlock()
     mPublishMgrMutex.release();
 }
 
+// Call the observer of eventType for a change to resourceId/eventTypeKey.
+void SipPublishContentMgr::contentChanged(const char* resourceId,
+                                          const char* eventTypeKey,
+                                          const char* eventType,
+                                          const char* reason)
+{
+   UtlString eventTypeString(eventType);
+   PublishCallbackContainer* callbackContainer =
+      dynamic_cast <PublishCallbackContainer*>
+      (mEventContentCallbacks.find(&eventTypeString));
+   if (callbackContainer)
+   {
+      (callbackContainer->mpCallback)(callbackContainer->mpApplicationData,
+                                      resourceId,
+                                      eventTypeKey,
+                                      eventTypeString,
+                                      reason);
+   }
+}
+
+// Body of the thread that delivers coalesced callbacks.
+void SipPublishContentMgr::runCoalescer()
+{
+   for (;;)
+   {
+      {
+         boost::unique_lock<boost::mutex> guard(mPendingMutex);
+         while (mPendingOrder.isEmpty() && !mStopping)
+         {
+            mPendingChanged.wait(guard);
+         }
+         if (mStopping)
+         {
+            return;
+         }
+
+         // Wait for the first callback to fall due, then look again, as it
+         // may have been delivered or dropped meanwhile.
+         Int64 wait =
+            dynamic_cast <PendingCallback*> (mPendingOrder.first())->mDueUs
+            - UtlMetricHistogram::now();
+         if (wait > 0)
+         {
+            mPendingChanged.timed_wait(guard,
+                                       boost::get_system_time()
+                                       + boost::posix_time::microseconds(wait));
+            continue;
+         }
+      }
+
+      deliverCoalesced();
+   }
+}
+
 /* ============================ FUNCTIONS ================================= */
 
 // Support functions for SipPublishContentMgrDefaultConstructor.
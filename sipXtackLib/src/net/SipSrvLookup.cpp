@@ -60,6 +60,7 @@ extern "C" {
 #include "os/OsLock.h"
 #include "net/SipSrvLookup.h"
 #include "os/OsLogger.h"
+#include "utl/UtlMetrics.h"
 #include "resparse/rr.h"
 
 // The space allocated for returns from res_query.
@@ -291,9 +292,6 @@ server_t* SipSrvLookup::servers(const char* domain,
    // Initialize the list of servers.
    server_list_initialize(serverList, list_length_allocated, list_length_used);
 
-   // Seize the lock.
-   OsLock lock(sMutex);
-
    // Case 0: Eliminate contradictory combinations of service and type.
 
    // While a sip: URI can be used with a socketType of SSL_SOCKET
@@ -339,7 +337,12 @@ server_t* SipSrvLookup::servers(const char* domain,
       // Free unused server_t instances, pointer must always be reloaded in this path
       delete[] serverList;
 
-      SipSrvLookupThread** myQueryThreads = SipSrvLookupThread::getLookupThreads();
+      // Take a set of query threads, one for each sort of query, to
+      // ourselves.  There are a few sets, so the lookups of different
+      // names run at once, as when a fork resolves the next hops of its
+      // branches.  Numeric addresses, such as those of most registered
+      // contacts, do not need one.
+      SipSrvLookupThread** myQueryThreads = SipSrvLookupThread::acquireLookupThreads();
 
       // Initialize the SRV lookup thread args, and the A Record lookup thread args.
       // They are initialized separately as the A Records are only needed if SRV
@@ -359,7 +362,7 @@ server_t* SipSrvLookup::servers(const char* domain,
 
       // Case 2: SRV records exist for this domain.
       // (Only used if no port is specified in the URI.)
-      if (port <= 0 && !options[OptionCodeIgnoreSRV])
+      if (port <= 0 && !getOption(OptionCodeIgnoreSRV))
       {
          // If UDP transport is acceptable.
          if ((socketType == OsSocket::UNKNOWN ||
@@ -408,6 +411,7 @@ server_t* SipSrvLookup::servers(const char* domain,
       }
       // Finally wait for the A Record Query to finish as well
       myQueryThreads[SipSrvLookupThread::A_RECORD]->isDone();
+      SipSrvLookupThread::releaseLookupThreads(myQueryThreads);
 
       // Check if there is a need for A records.
       // (Only used for non-numeric addresses for which SRV lookup did not
@@ -439,7 +443,7 @@ server_t* SipSrvLookup::servers(const char* domain,
 
    // If testing the code, sort the list of servers into a canonical order,
    // so the pseudo-random scores we calculate for them are deterministic.
-   if (options[OptionCodeSortServers])
+   if (getOption(OptionCodeSortServers))
    {
       qsort(serverList, list_length_used, sizeof (server_t), server_compare_presort);
    }
@@ -524,6 +528,8 @@ void SipSrvLookup::setOption(OptionCode option, int value)
    OsLock lock(sMutex);
 
    options[option] = value;
+   // Publish it to getOption, which does not take the lock.
+   __sync_synchronize();
 }
 
 void SipSrvLookup::setOwnHostname(const char* hostname)
@@ -557,8 +563,8 @@ void SipSrvLookup::setDnsSrvTimeouts(int initialTimeoutInSecs, int retries)
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
 
 /*
- * Lock to protect the resolver routines, which cannot tolerate multithreaded
- * use.
+ * Lock to make changes to the settings atomic.  The lookups themselves run
+ * on the sets of SipSrvLookupThread, and use the reentrant res_n* routines.
  */
 OsMutex SipSrvLookup::sMutex(OsMutex::Q_PRIORITY |
                              OsMutex::DELETE_SAFE |
@@ -1003,14 +1009,23 @@ void SipSrvLookup::res_query_and_parse(const char* in_name,
 
       // Use res_nquery, not res_search or res_query, so defaulting rules are not
       // applied to the domain, and so that the query is thread-safe.
+      static UtlMetricHistogram& queryTime =
+         UtlMetrics::instance().histogram("sipx_dns_query_seconds",
+                                          "Time taken by DNS queries");
+      static UtlMetricCounter& queryFailures =
+         UtlMetrics::instance().counter("sipx_dns_query_failures_total",
+                                        "DNS queries that returned an error");
+      Int64 queryStart = UtlMetricHistogram::now();
       int r = res_nquery(&res, name, C_IN, type,
                          (unsigned char*) answer, sizeof (answer));
+      queryTime.tally(UtlMetricHistogram::now() - queryStart);
       // Done with res state struct, so cleanup.
       // Must close once and only once per res_ninit, after res_nquery.
       res_nclose(&res);
 
       if (r == -1)
       {
+         queryFailures.add();
          // res_query failed, return.
          Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                        "DNS query for name '%s', "
@@ -1481,10 +1496,17 @@ OsMutex SipSrvLookupThread::slookupThreadMutex(OsMutex::Q_FIFO |
                                          OsMutex::DELETE_SAFE |
                                          OsMutex::INVERSION_SAFE);
 
-/// Array holding pointers to the four individual lookup threads
-SipSrvLookupThread * SipSrvLookupThread::mLookupThreads[SipSrvLookupThread::LAST_LookupType+1];
+/// Arrays holding pointers to the four individual lookup threads of each set
+SipSrvLookupThread * SipSrvLookupThread::mLookupThreads[SipSrvLookupThread::LOOKUP_POOL_SIZE]
+                                                       [SipSrvLookupThread::LAST_LookupType+1];
+
+UtlBoolean SipSrvLookupThread::mHaveThreadsBeenInitialized[SipSrvLookupThread::LOOKUP_POOL_SIZE];
+
+UtlBoolean SipSrvLookupThread::mLookupThreadsInUse[SipSrvLookupThread::LOOKUP_POOL_SIZE];
 
-UtlBoolean SipSrvLookupThread::mHaveThreadsBeenInitialized = FALSE;
+OsCSem SipSrvLookupThread::sFreeLookupThreads(OsCSem::Q_FIFO,
+                                              SipSrvLookupThread::LOOKUP_POOL_SIZE,
+                                              SipSrvLookupThread::LOOKUP_POOL_SIZE);
 
 /// Destructor for SipSrvLookupThread
 SipSrvLookupThread::~SipSrvLookupThread()
@@ -1544,22 +1566,50 @@ UtlBoolean SipSrvLookupThread::handleMessage(OsMsg& rMsg)
    return TRUE;
 }
 
-/// Get the SRV lookup threads, initializing them if needed
-SipSrvLookupThread** SipSrvLookupThread::getLookupThreads()
+/// Take a free set of lookup threads, waiting if all are in use
+SipSrvLookupThread** SipSrvLookupThread::acquireLookupThreads()
 {
+   sFreeLookupThreads.acquire();
+
    OsLock lock(SipSrvLookupThread::slookupThreadMutex);
 
-   if (!mHaveThreadsBeenInitialized)
+   // The semaphore guarantees that a set is free.
+   int set = 0;
+   while (mLookupThreadsInUse[set])
+   {
+      set++;
+   }
+   mLookupThreadsInUse[set] = TRUE;
+
+   if (!mHaveThreadsBeenInitialized[set])
    {
       for(int x = FIRST_LookupType; x <= LAST_LookupType; x++)
       {
-         mLookupThreads[(LookupTypes) x] = new SipSrvLookupThread((LookupTypes) x);
-         mLookupThreads[(LookupTypes) x]->start();
+         mLookupThreads[set][(LookupTypes) x] = new SipSrvLookupThread((LookupTypes) x);
+         mLookupThreads[set][(LookupTypes) x]->start();
+      }
+      mHaveThreadsBeenInitialized[set] = TRUE;
+   }
+
+   return mLookupThreads[set];
+}
+
+/// Hand back a set of lookup threads taken by acquireLookupThreads()
+void SipSrvLookupThread::releaseLookupThreads(SipSrvLookupThread** lookupThreads)
+{
+   {
+      OsLock lock(SipSrvLookupThread::slookupThreadMutex);
+
+      for (int set = 0; set < LOOKUP_POOL_SIZE; set++)
+      {
+         if (mLookupThreads[set] == lookupThreads)
+         {
+            mLookupThreadsInUse[set] = FALSE;
+         }
       }
-      mHaveThreadsBeenInitialized = TRUE;
    }
 
-   return mLookupThreads;
+   sFreeLookupThreads.release();
 }
 
 /// Block until the thread has finished a query
@@ -1573,9 +1623,9 @@ void SipSrvLookupThread::isDone()
 
 /*
  * Private constructor for SipSrvLookupThread
- * Use getLookupThreads() for initializing and accessing the class members. The class
- * is restricted to 4 members by the getLookupThreads() function, and thier pointers
- * are stored in "mLookupThreads"
+ * Use acquireLookupThreads() for initializing and accessing the class members.
+ * There are LOOKUP_POOL_SIZE sets of 4 members, and their pointers are stored
+ * in "mLookupThreads"
  */
 
 SipSrvLookupThread::SipSrvLookupThread(LookupTypes lookupType) :
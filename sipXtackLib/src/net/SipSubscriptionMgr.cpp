@@ -7,11 +7,15 @@
 //////////////////////////////////////////////////////////////////////////////
 
 // SYSTEM INCLUDES
+#include <vector>
 
 // APPLICATION INCLUDES
 #include <utl/UtlString.h>
 #include <utl/UtlHashBagIterator.h>
+#include <utl/UtlSListIterator.h>
+#include <utl/UtlInt.h>
 #include <os/OsEventMsg.h>
+#include <os/OsLock.h>
 #include <os/OsLogger.h>
 #include <os/OsTimer.h>
 #include <os/OsDateTime.h>
@@ -23,6 +27,8 @@
 #include <net/NetMd5Codec.h>
 #include <net/CallId.h>
 
+class SubscriptionServerStateIndex;
+
 // Private class whose instances contain the state of a single subscription.
 class SubscriptionServerState : public UtlString
 {
@@ -56,6 +62,15 @@ public:
    /// The timer to send a resend message to the owning SipSubscribeServer.
    OsTimer mResendTimer;
 
+   /// The entry for this subscription in the resource index of its shard.
+   SubscriptionServerStateIndex* mpIndex;
+
+   /// Links of the expiry wheel slot that holds this subscription.
+   SubscriptionServerState* mpExpiryNext;
+   SubscriptionServerState* mpExpiryPrev;
+   /// The expiry wheel slot, or -1 if it is not on the wheel.
+   int mExpirySlot;
+
    //! Dump the object's internal state.
    void dumpState();
 
@@ -143,6 +158,125 @@ private:
    UtlString mHandle;
 };
 
+// Number of one-second slots in the expiry wheel of each shard.
+// Subscriptions that expire further ahead than this wait in their slot for
+// the wheel to come round again.
+#define EXPIRY_WHEEL_SLOTS 256
+
+/// The subscriptions to the resources of one shard of a SipSubscriptionMgr.
+class SipSubscriptionMgr::Shard
+{
+public:
+   Shard();
+
+   ~Shard();
+
+   /// Lock for everything in the shard.
+   OsMutex mMutex;
+
+   /// The SubscriptionServerState's, indexed by dialog handle.
+   UtlHashBag mStatesByDialogHandle;
+
+   /// Index to the states in mStatesByDialogHandle by resourceId and eventTypeKey.
+   //  Members are SubscriptionServerStateIndex's.
+   UtlHashBag mResourceIndex;
+
+   /// The subscription with dialogHandle, or NULL.
+   SubscriptionServerState* find(const UtlString& dialogHandle);
+
+   /// Add state, which takes its expiration date and resourceId from state.
+   void insert(SubscriptionServerState* state);
+
+   /// Remove state and delete it.
+   void remove(SubscriptionServerState* state);
+
+   /// Change the expiration date of state.
+   void setExpiration(SubscriptionServerState* state,
+                      unsigned long expirationDate);
+
+   /// Remove the subscriptions that expired before oldEpochTimeSeconds.
+   //  Appends their dialog handles to removed.
+   void removeExpired(unsigned long oldEpochTimeSeconds,
+                      UtlSList& removed);
+
+private:
+
+   /// Put state in the wheel slot of its expiration date.
+   void schedule(SubscriptionServerState* state);
+
+   /// Take state out of its wheel slot.
+   void unschedule(SubscriptionServerState* state);
+
+   /// Heads of the lists of subscriptions that expire in each slot.
+   //  Slot (t % EXPIRY_WHEEL_SLOTS) holds the subscriptions that expire at
+   //  second t, and those that had already expired before the last sweep
+   //  wait in the slot of mNextSweep, so that a sweep only visits the slots
+   //  of the seconds it covers instead of every subscription.
+   SubscriptionServerState* mpWheel[EXPIRY_WHEEL_SLOTS];
+
+   /// Every subscription that expired before this time has been swept.
+   unsigned long mNextSweep;
+
+   //! DISALLOWED accidental copying
+   Shard(const Shard& rShard);
+   Shard& operator=(const Shard& rhs);
+};
+
+/// What a NOTIFY for a subscription needs from its SubscriptionServerState.
+//  It is copied under the shard lock, so that the NOTIFY can be built after
+//  the lock is released.
+class NotifyTarget
+{
+public:
+   NotifyTarget(const SubscriptionServerState& state) :
+      mDialogHandle(state),
+      mResourceId(state.mResourceId),
+      mEventTypeKey(state.mEventTypeKey),
+      mAcceptHeaderValue(state.mAcceptHeaderValue),
+      mExpirationDate(state.mExpirationDate),
+      mFullContent(state.mFullContentForNextNotify)
+      {
+         if (state.mpLastSubscribeRequest)
+         {
+            state.mpLastSubscribeRequest->getEventField(mEventHeader);
+         }
+      }
+
+   /// Set the dialog information and the Event and Subscription-State headers of notify.
+   //  subscriptionStateFormat is as for createNotifiesDialogInfo().
+   //  Returns FALSE if the dialog no longer exists.
+   UtlBoolean prepare(SipDialogMgr& dialogMgr,
+                      SipMessage& notify,
+                      const char* subscriptionStateFormat,
+                      long unsigned now) const
+      {
+         if (!dialogMgr.setNextLocalTransactionInfo(notify,
+                                                    SIP_NOTIFY_METHOD,
+                                                    mDialogHandle))
+         {
+            return FALSE;
+         }
+
+         notify.setEventField(mEventHeader);
+
+         // Set the Subscription-State header.
+         char buffer[101];
+         sprintf(buffer, subscriptionStateFormat,
+                 (long) (mExpirationDate - now));
+         notify.setHeaderValue(SIP_SUBSCRIPTION_STATE_FIELD, buffer, 0);
+
+         return TRUE;
+      }
+
+   UtlString mDialogHandle;
+   UtlString mResourceId;
+   UtlString mEventTypeKey;
+   UtlString mAcceptHeaderValue;
+   UtlString mEventHeader;
+   unsigned long mExpirationDate;
+   bool mFullContent;
+};
+
 
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
@@ -184,6 +318,10 @@ SubscriptionServerState::SubscriptionServerState(const UtlString& dialogHandle,
    , mNextResendInterval(SipSubscriptionMgr::sInitialNextResendInterval)
    , mResendTimer(new ResendEventMsg(dialogHandle),
                   pResendMsgQ)
+   , mpIndex(NULL)
+   , mpExpiryNext(NULL)
+   , mpExpiryPrev(NULL)
+   , mExpirySlot(-1)
 {
 }
 
@@ -235,21 +373,158 @@ SubscriptionServerStateIndex::~SubscriptionServerStateIndex()
     // Do not delete mpState, it is freed elsewhere.
 }
 
+SipSubscriptionMgr::Shard::Shard()
+   : mMutex(OsMutex::Q_FIFO)
+   , mNextSweep(0)
+{
+   for (int i = 0; i < EXPIRY_WHEEL_SLOTS; i++)
+   {
+      mpWheel[i] = NULL;
+   }
+}
+
+SipSubscriptionMgr::Shard::~Shard()
+{
+   mResourceIndex.destroyAll();
+   mStatesByDialogHandle.destroyAll();
+}
+
+SubscriptionServerState* SipSubscriptionMgr::Shard::find(const UtlString& dialogHandle)
+{
+   return dynamic_cast <SubscriptionServerState*> (mStatesByDialogHandle.find(&dialogHandle));
+}
+
+void SipSubscriptionMgr::Shard::insert(SubscriptionServerState* state)
+{
+   state->mpIndex =
+      new SubscriptionServerStateIndex(state->mResourceId, state->mEventTypeKey, state);
+   mStatesByDialogHandle.insert(state);
+   mResourceIndex.insert(state->mpIndex);
+   schedule(state);
+}
+
+void SipSubscriptionMgr::Shard::remove(SubscriptionServerState* state)
+{
+   unschedule(state);
+   mStatesByDialogHandle.removeReference(state);
+   mResourceIndex.removeReference(state->mpIndex);
+   delete state->mpIndex;
+   delete state;
+}
+
+void SipSubscriptionMgr::Shard::setExpiration(SubscriptionServerState* state,
+                                              unsigned long expirationDate)
+{
+   unschedule(state);
+   state->mExpirationDate = expirationDate;
+   schedule(state);
+}
+
+void SipSubscriptionMgr::Shard::removeExpired(unsigned long oldEpochTimeSeconds,
+                                              UtlSList& removed)
+{
+   // Visit the slots of the seconds from mNextSweep up to oldEpochTimeSeconds,
+   // but each slot only once, and at least the slot of mNextSweep, which
+   // holds the subscriptions that were already expired when they were added.
+   unsigned long slots = 1;
+   if (oldEpochTimeSeconds > mNextSweep)
+   {
+      slots = oldEpochTimeSeconds - mNextSweep;
+      if (slots > EXPIRY_WHEEL_SLOTS)
+      {
+         slots = EXPIRY_WHEEL_SLOTS;
+      }
+   }
+
+   for (unsigned long i = 0; i < slots; i++)
+   {
+      SubscriptionServerState* next = mpWheel[(mNextSweep + i) % EXPIRY_WHEEL_SLOTS];
+      while (next)
+      {
+         SubscriptionServerState* state = next;
+         next = state->mpExpiryNext;
+
+         // Subscriptions a lap or more ahead share the slot.
+         if (state->mExpirationDate < oldEpochTimeSeconds)
+         {
+            if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
+            {
+               UtlString requestContact;
+               state->mpLastSubscribeRequest->getContactField(0, requestContact);
+               Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                             "SipSubscriptionMgr::removeOldSubscriptions delete subscription for dialog handle '%s', key '%s', contact '%s', mExpirationDate %ld",
+                             state->data(), state->mpIndex->data(),
+                             requestContact.data(), state->mExpirationDate);
+            }
+            removed.append(new UtlString(*state));
+            remove(state);
+         }
+      }
+   }
+
+   if (oldEpochTimeSeconds > mNextSweep)
+   {
+      mNextSweep = oldEpochTimeSeconds;
+   }
+}
+
+void SipSubscriptionMgr::Shard::schedule(SubscriptionServerState* state)
+{
+   unsigned long due =
+      state->mExpirationDate < mNextSweep ? mNextSweep : state->mExpirationDate;
+   int slot = due % EXPIRY_WHEEL_SLOTS;
+
+   state->mExpirySlot = slot;
+   state->mpExpiryPrev = NULL;
+   state->mpExpiryNext = mpWheel[slot];
+   if (state->mpExpiryNext)
+   {
+      state->mpExpiryNext->mpExpiryPrev = state;
+   }
+   mpWheel[slot] = state;
+}
+
+void SipSubscriptionMgr::Shard::unschedule(SubscriptionServerState* state)
+{
+   if (state->mExpirySlot >= 0)
+   {
+      if (state->mpExpiryPrev)
+      {
+         state->mpExpiryPrev->mpExpiryNext = state->mpExpiryNext;
+      }
+      else
+      {
+         mpWheel[state->mExpirySlot] = state->mpExpiryNext;
+      }
+      if (state->mpExpiryNext)
+      {
+         state->mpExpiryNext->mpExpiryPrev = state->mpExpiryPrev;
+      }
+      state->mpExpiryNext = NULL;
+      state->mpExpiryPrev = NULL;
+      state->mExpirySlot = -1;
+   }
+}
+
 // Constructor
 SipSubscriptionMgr::SipSubscriptionMgr()
    : mEstablishedDialogCount(0)
- , mSubscriptionMgrMutex(OsMutex::Q_FIFO)
  , mMinExpiration(INITIAL_MIN_EXPIRATION)
  , mDefaultExpiration(INITIAL_DEFAULT_EXPIRATION)
  , mMaxExpiration(INITIAL_MAX_EXPIRATION)
  , mpResendMsgQ(NULL)           // initially NULL, will be set by ::setResendMsgQ()
+ , mShardIndexMutex(OsMutex::Q_FIFO)
 {
+   for (size_t i = 0; i < sShardCount; i++)
+   {
+      mShards[i] = new Shard();
+   }
 }
 
 
 // Copy constructor NOT IMPLEMENTED
 SipSubscriptionMgr::SipSubscriptionMgr(const SipSubscriptionMgr& rSipSubscriptionMgr)
-: mSubscriptionMgrMutex(OsMutex::Q_FIFO)
+: mShardIndexMutex(OsMutex::Q_FIFO)
 {
 }
 
@@ -257,8 +532,11 @@ SipSubscriptionMgr::SipSubscriptionMgr(const SipSubscriptionMgr& rSipSubscriptio
 // Destructor
 SipSubscriptionMgr::~SipSubscriptionMgr()
 {
-    // Iterate through and delete all the dialogs
-    // TODO:
+   for (size_t i = 0; i < sShardCount; i++)
+   {
+      delete mShards[i];
+   }
+   mShardOfDialog.destroyAll();
 }
 
 /* ============================ MANIPULATORS ============================== */
@@ -452,10 +730,6 @@ UtlBoolean SipSubscriptionMgr::updateDialogInfo(const SipMessage& subscribeReque
             // So we do not set a timer at the end of the subscription
             state->mpExpirationTimer = NULL;
 
-            // Create the index by resourceId and eventTypeKey key
-            SubscriptionServerStateIndex* stateKey =
-               new SubscriptionServerStateIndex(resourceId, eventTypeKey, state);
-
             subscribeResponse.setResponseData(subscribeCopy,
                                               SIP_ACCEPTED_CODE,
                                               SIP_ACCEPTED_TEXT,
@@ -463,9 +737,11 @@ UtlBoolean SipSubscriptionMgr::updateDialogInfo(const SipMessage& subscribeReque
             subscribeResponse.setExpiresField(expiration);
             subscribeCopy->getDialogHandle(subscribeDialogHandle);
 
-            lock();
-            mSubscriptionStatesByDialogHandle.insert(state);
-            mSubscriptionStateResourceIndex.insert(stateKey);
+            size_t shardNumber = shardOf(resourceId);
+            Shard* shard = mShards[shardNumber];
+            shard->mMutex.acquire();
+            shard->insert(state);
+            indexDialog(subscribeDialogHandle, shardNumber);
             if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
             {
                UtlString requestContact;
@@ -473,15 +749,14 @@ UtlBoolean SipSubscriptionMgr::updateDialogInfo(const SipMessage& subscribeReque
                Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                              "SipSubscriptionMgr::updateDialogInfo insert early-dialog subscription for dialog handle '%s', key '%s', "
                              "contact '%s', mExpirationDate %ld, eventTypeKey '%s'",
-                             state->data(), stateKey->data(),
+                             state->data(), state->mpIndex->data(),
                              requestContact.data(), state->mExpirationDate, state->mEventTypeKey.data());
             }
 
             // Not safe to touch these after we unlock
-            stateKey = NULL;
             state = NULL;
             subscribeCopy = NULL;
-            unlock();
+            shard->mMutex.release();
 
             subscriptionSucceeded = TRUE;
 
@@ -510,27 +785,36 @@ UtlBoolean SipSubscriptionMgr::updateDialogInfo(const SipMessage& subscribeReque
             // Update the dialog state
             mDialogMgr.updateDialog(subscribeRequest, subscribeDialogHandle);
 
+            // Copy the SUBSCRIBE before taking the lock.
+            SipMessage* subscribeCopy = new SipMessage(subscribeRequest);
+
             // Get the subscription state and update that
             // TODO:  This assumes that no one reuses the same dialog
-            // to subscribe to more than one event type.  mSubscriptionStatesByDialogHandle
+            // to subscribe to more than one event type.  mStatesByDialogHandle
             // will need to be changed to a HashBag and we will need to
             // search through to find a matching event type
-            lock();
-            state = (SubscriptionServerState*)
-                mSubscriptionStatesByDialogHandle.find(&subscribeDialogHandle);
-            if (state)
+            Shard* shard = lockDialog(subscribeDialogHandle, state);
+            if (shard)
             {
                 // Update the expiration time.
                 long unsigned now = OsDateTime::getSecsSinceEpoch();
-                state->mExpirationDate = now + expiration;
+                shard->setExpiration(state, now + expiration);
                 // Record this SUBSCRIBE as the latest SUBSCRIBE request.
                 if(state->mpLastSubscribeRequest)
                 {
                     delete state->mpLastSubscribeRequest;
                 }
-                state->mpLastSubscribeRequest = new SipMessage(subscribeRequest);
+                state->mpLastSubscribeRequest = subscribeCopy;
+                subscribeCopy = NULL;
                 subscribeRequest.getAcceptField(state->mAcceptHeaderValue);
 
+                // Set the resource information so our caller can generate a NOTIFY.
+                resourceId = state->mResourceId;
+                eventTypeKey = state->mEventTypeKey;
+                eventType = state->mEventType;
+                state = NULL;
+                shard->mMutex.release();
+
                 // Set our Contact to the same request URI that came in
                 UtlString contact;
                 subscribeRequest.getRequestUri(&contact);
@@ -547,11 +831,6 @@ UtlBoolean SipSubscriptionMgr::updateDialogInfo(const SipMessage& subscribeReque
                 subscribeResponse.setExpiresField(expiration);
                 subscriptionSucceeded = TRUE;
                 isSubscriptionExpired = FALSE;
-
-                // Set the resource information so our caller can generate a NOTIFY.
-                resourceId = state->mResourceId;
-                eventTypeKey = state->mEventTypeKey;
-                eventType = state->mEventType;
             }
 
             // No state, but SUBSCRIBE had a to-tag.
@@ -562,7 +841,7 @@ UtlBoolean SipSubscriptionMgr::updateDialogInfo(const SipMessage& subscribeReque
                                                  SIP_BAD_SUBSCRIPTION_CODE,
                                                  SIP_BAD_SUBSCRIPTION_TEXT);
             }
-            unlock();
+            delete subscribeCopy;
         }
 
         // Expiration too small
@@ -677,30 +956,27 @@ UtlBoolean SipSubscriptionMgr::insertDialogInfo(const SipMessage& subscribeReque
         // So we do not set a timer at the end of the subscription
         state->mpExpirationTimer = NULL;
 
-        // Create the index by resourceId and eventTypeKey key
-        SubscriptionServerStateIndex* stateKey =
-           new SubscriptionServerStateIndex(resourceId, eventTypeKey, state);
-
         subscribeCopy->getDialogHandle(subscribeDialogHandle);
 
-        lock();
-        mSubscriptionStatesByDialogHandle.insert(state);
-        mSubscriptionStateResourceIndex.insert(stateKey);
+        size_t shardNumber = shardOf(resourceId);
+        Shard* shard = mShards[shardNumber];
+        shard->mMutex.acquire();
+        shard->insert(state);
+        indexDialog(subscribeDialogHandle, shardNumber);
         if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
         {
            UtlString requestContact;
            subscribeRequest.getContactField(0, requestContact);
            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                          "SipSubscriptionMgr::insertDialogInfo insert early-dialog subscription for dialog handle '%s', key '%s', contact '%s', mExpirationDate %ld",
-                         state->data(), stateKey->data(),
+                         state->data(), state->mpIndex->data(),
                          requestContact.data(), state->mExpirationDate);
         }
 
         // Not safe to touch these after we unlock
-        stateKey = NULL;
         state = NULL;
         subscribeCopy = NULL;
-        unlock();
+        shard->mMutex.release();
 
         subscriptionSucceeded = TRUE;
     }
@@ -713,13 +989,11 @@ UtlBoolean SipSubscriptionMgr::insertDialogInfo(const SipMessage& subscribeReque
 
         // Get the subscription state and update that
         // TODO:  This assumes that no one reuses the same dialog
-        // to subscribe to more than one event type.  mSubscriptionStatesByDialogHandle
+        // to subscribe to more than one event type.  mStatesByDialogHandle
         // will need to be changed to a HashBag and we will need to
         // search through to find a matching event type
-        lock();
-        state = (SubscriptionServerState*)
-            mSubscriptionStatesByDialogHandle.find(&dialogHandle);
-        if (state)
+        Shard* shard = lockDialog(dialogHandle, state);
+        if (shard)
         {
            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                          "SipSubscriptionMgr::insertDialogInfo "
@@ -728,7 +1002,7 @@ UtlBoolean SipSubscriptionMgr::insertDialogInfo(const SipMessage& subscribeReque
             // Set the recorded CSeq of the last NOTIFY.
             mDialogMgr.setNextLocalCseq(dialogHandle, notifyCSeq);
 
-            state->mExpirationDate = expires;
+            shard->setExpiration(state, expires);
             state->mDialogVer = version;
             if(state->mpLastSubscribeRequest)
             {
@@ -748,6 +1022,8 @@ UtlBoolean SipSubscriptionMgr::insertDialogInfo(const SipMessage& subscribeReque
 
             subscriptionSucceeded = TRUE;
             subscribeDialogHandle = dialogHandle;
+            state = NULL;
+            shard->mMutex.release();
         }
 
         // No state, but SUBSCRIBE had a to-tag.
@@ -779,24 +1055,24 @@ UtlBoolean SipSubscriptionMgr::insertDialogInfo(const SipMessage& subscribeReque
             // So we do not set a timer at the end of the subscription
             state->mpExpirationTimer = NULL;
 
-            // Create the index by resourceId and eventTypeKey key
-            SubscriptionServerStateIndex* stateKey =
-               new SubscriptionServerStateIndex(resourceId, eventTypeKey, state);
-            mSubscriptionStatesByDialogHandle.insert(state);
-            mSubscriptionStateResourceIndex.insert(stateKey);
+            size_t shardNumber = shardOf(resourceId);
+            shard = mShards[shardNumber];
+            shard->mMutex.acquire();
+            shard->insert(state);
+            indexDialog(dialogHandle, shardNumber);
             if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
             {
                UtlString requestContact;
                subscribeRequest.getContactField(0, requestContact);
                Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                      "SipSubscriptionMgr::insertDialogInfo insert subscription for key '%s', contact '%s', mExpirationDate %ld",
-                     stateKey->data(), requestContact.data(), state->mExpirationDate);
+                     state->mpIndex->data(), requestContact.data(), state->mExpirationDate);
             }
 
             // Not safe to touch these after we unlock
-            stateKey = NULL;
             state = NULL;
             subscribeCopy = NULL;
+            shard->mMutex.release();
 
             // Set the contact to the same request URI that came in
             UtlString contact;
@@ -809,7 +1085,6 @@ UtlBoolean SipSubscriptionMgr::insertDialogInfo(const SipMessage& subscribeReque
 
             subscriptionSucceeded = TRUE;
         }
-        unlock();
     }
 
     Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
@@ -834,58 +1109,46 @@ UtlBoolean SipSubscriptionMgr::getNotifyDialogInfo(const UtlString& subscribeDia
                                                    bool* fullContent)
 {
     UtlBoolean notifyInfoSet = FALSE;
-    lock();
-    SubscriptionServerState* state =
-       dynamic_cast <SubscriptionServerState*>
-       (mSubscriptionStatesByDialogHandle.find(&subscribeDialogHandle));
+    SubscriptionServerState* state;
+    Shard* shard = lockDialog(subscribeDialogHandle, state);
 
-    if (state)
+    if (shard)
     {
-        notifyInfoSet = mDialogMgr.setNextLocalTransactionInfo(notifyRequest,
-                                                               SIP_NOTIFY_METHOD,
-                                                               subscribeDialogHandle);
+        NotifyTarget target(*state);
 
-        // Set the event header, if we know what it is.
-        if (state->mpLastSubscribeRequest)
+        // Return information about the subscription.
+        if (eventType)
         {
-            UtlString eventHeader;
-            state->mpLastSubscribeRequest->getEventField(eventHeader);
-            notifyRequest.setEventField(eventHeader);
+           *eventType = state->mEventType;
         }
+        shard->mMutex.release();
 
-        // Set the Subscription-State header.
-        long expires =
-           state->mExpirationDate - OsDateTime::getSecsSinceEpoch();
-        char buffer[101];
-        sprintf(buffer,
-                // The caller does not know the expiration time.
-                // If expires <=0, terminate for time-out.
-                // Otherwise, use the format given by the caller.
-                (expires > 0 ? subscriptionStateFormat : "terminated;reason=timeout"),
-                expires);
-        notifyRequest.setHeaderValue(SIP_SUBSCRIPTION_STATE_FIELD, buffer, 0);
-
-        // Return information about the subscription.
         if (resourceId)
         {
-           *resourceId = state->mResourceId;
+           *resourceId = target.mResourceId;
         }
         if (eventTypeKey)
         {
-           *eventTypeKey = state->mEventTypeKey;
-        }
-        if (eventType)
-        {
-           *eventType = state->mEventType;
+           *eventTypeKey = target.mEventTypeKey;
         }
         if (acceptHeaderValue)
         {
-           *acceptHeaderValue = state->mAcceptHeaderValue;
+           *acceptHeaderValue = target.mAcceptHeaderValue;
         }
         if (fullContent)
         {
-           *fullContent = state->mFullContentForNextNotify;
+           *fullContent = target.mFullContent;
         }
+
+        // The caller does not know the expiration time.
+        // If it has passed, terminate for time-out.
+        // Otherwise, use the format given by the caller.
+        long unsigned now = OsDateTime::getSecsSinceEpoch();
+        notifyInfoSet = target.prepare(mDialogMgr, notifyRequest,
+                                       (target.mExpirationDate > now ?
+                                        subscriptionStateFormat :
+                                        "terminated;reason=timeout"),
+                                       now);
     }
     else
     {
@@ -894,8 +1157,6 @@ UtlBoolean SipSubscriptionMgr::getNotifyDialogInfo(const UtlString& subscribeDia
                      subscribeDialogHandle.data());
     }
 
-    unlock();
-
     return(notifyInfoSet);
 }
 
@@ -909,51 +1170,25 @@ void SipSubscriptionMgr::createNotifiesDialogInfo(const char* resourceId,
                                                   bool*& fullContentArray,
                                                   SipMessage*& notifyArray)
 {
-   UtlString contentKey(resourceId);
+   UtlString resource(resourceId);
+   UtlString contentKey(resource);
    contentKey.append(CONTENT_KEY_SEPARATOR);
    contentKey.append(eventTypeKey);
+   Shard* shard = mShards[shardOf(resource)];
 
-   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                 "SipSubscriptionMgr::createNotifiesDialogInfo try to find contentKey '%s' in mSubscriptionStateResourceIndex (%zu entries)",
-                 contentKey.data(), mSubscriptionStateResourceIndex.entries());
-
-   lock();
-
-#if 0 // Enable for very detailed logging of searching for the NOTIFY info.
-   if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
-   {
-      UtlHashBagIterator iterator(mSubscriptionStateResourceIndex);
-      UtlString* contentTypeIndex;
-      while ((contentTypeIndex = dynamic_cast <SubscriptionServerStateIndex*> (iterator())))
-      {
-         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                       "SipSubscriptionMgr::createNotifiesDialogInfo element '%s'",
-                       contentTypeIndex->data());
-      }
-   }
-#endif // 0
-
-   // Select the desired subset of the subscriptions, or all of them.
-   UtlHashBagIterator iterator(mSubscriptionStateResourceIndex,
-                               &contentKey);
-   int count = 0;
-   int index = 0;
-   acceptHeaderValuesArray = NULL;
-   notifyArray = NULL;
-   fullContentArray = NULL;
+   long unsigned now = OsDateTime::getSecsSinceEpoch();
+   std::vector<NotifyTarget> targets;
 
-   while (iterator())
-   {
-      count++;
-   }
+   // Only copy what the NOTIFYs need under the lock, and build them after.
+   shard->mMutex.acquire();
 
-   SubscriptionServerStateIndex* subscriptionIndex = NULL;
-   acceptHeaderValuesArray = new UtlString[count];
-   notifyArray = new SipMessage[count];
-   fullContentArray = new bool[count];
-   iterator.reset();
-   long unsigned now = OsDateTime::getSecsSinceEpoch();
+   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                 "SipSubscriptionMgr::createNotifiesDialogInfo try to find contentKey '%s' in mResourceIndex (%zu entries)",
+                 contentKey.data(), shard->mResourceIndex.entries());
 
+   // Select the desired subset of the subscriptions.
+   UtlHashBagIterator iterator(shard->mResourceIndex, &contentKey);
+   SubscriptionServerStateIndex* subscriptionIndex;
    while ((subscriptionIndex =
            dynamic_cast <SubscriptionServerStateIndex*> (iterator())))
    {
@@ -961,62 +1196,38 @@ void SipSubscriptionMgr::createNotifiesDialogInfo(const char* resourceId,
                     "SipSubscriptionMgr::createNotifiesDialogInfo now %ld, mExpirationDate %ld",
                     now, subscriptionIndex->mpState->mExpirationDate);
 
-      // Should not happen, the container is supposed to be locked
-      if (index >= count)
-      {
-         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                       "SipSubscriptionMgr::createNotifiesDialogInfo iterator elements count changed from: %d to %d while locked",
-                       count, index);
-      }
-      // Should not happen, the index should be created and
-      // deleted with the state
-      else if (subscriptionIndex->mpState == NULL)
+      // If not expired yet
+      if (subscriptionIndex->mpState->mExpirationDate >= now)
       {
-         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                       "SipSubscriptionMgr::createNotifiesDialogInfo SubscriptionServerStateIndex with NULL mpState");
+         targets.push_back(NotifyTarget(*subscriptionIndex->mpState));
       }
+   }
 
-      // If not expired yet
-      else if (subscriptionIndex->mpState->mExpirationDate >= now)
-      {
-         // Get the accept value.
-         acceptHeaderValuesArray[index] =
-            subscriptionIndex->mpState->mAcceptHeaderValue;
-         // Get the full-content value.
-         fullContentArray[index] =
-            subscriptionIndex->mpState->mFullContentForNextNotify;
-         // Create the NOTIFY message.
-         mDialogMgr.setNextLocalTransactionInfo(notifyArray[index],
-                                                SIP_NOTIFY_METHOD,
-                                                // This is a SubscriptionServerState,
-                                                // whose superclass UtlString contains
-                                                // the dialog handle for the subscription.
-                                                static_cast <const UtlString> (*(subscriptionIndex->mpState)));
-
-         // Set the event header, if we know what it is.
-         UtlString eventHeader;
-         if(subscriptionIndex->mpState->mpLastSubscribeRequest)
-         {
-            subscriptionIndex->mpState->mpLastSubscribeRequest->getEventField(eventHeader);
-         }
-         notifyArray[index].setEventField(eventHeader);
+   shard->mMutex.release();
 
-         // Set the Subscription-State header.
-         char buffer[101];
-         sprintf(buffer, subscriptionStateFormat,
-                 (long) (subscriptionIndex->mpState->mExpirationDate - now));
-         notifyArray[index].setHeaderValue(SIP_SUBSCRIPTION_STATE_FIELD,
-                                           buffer, 0);
+   acceptHeaderValuesArray = new UtlString[targets.size()];
+   notifyArray = new SipMessage[targets.size()];
+   fullContentArray = new bool[targets.size()];
+   int index = 0;
+
+   for (size_t i = 0; i < targets.size(); i++)
+   {
+      // Skip subscriptions that ended since they were selected.
+      if (targets[i].prepare(mDialogMgr, notifyArray[index],
+                             subscriptionStateFormat, now))
+      {
+         acceptHeaderValuesArray[index] = targets[i].mAcceptHeaderValue;
+         fullContentArray[index] = targets[i].mFullContent;
          Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                        "SipSubscriptionMgr::createNotifiesDialogInfo index %d, mAcceptHeaderValue '%s', getEventField '%s'",
                        index, acceptHeaderValuesArray[index].data(),
-                       eventHeader.data());
+                       targets[i].mEventHeader.data());
 
          if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
          {
             UtlString s;
-            ssize_t i;
-            notifyArray[index].getBytes(&s, &i);
+            ssize_t l;
+            notifyArray[index].getBytes(&s, &l);
             Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                           "SipSubscriptionMgr::createNotifiesDialogInfo notifyArray[%d] = '%s'",
                           index, s.data());
@@ -1026,8 +1237,6 @@ void SipSubscriptionMgr::createNotifiesDialogInfo(const char* resourceId,
       }
    }
 
-   unlock();
-
    numNotifiesCreated = index;
 
    return;
@@ -1042,128 +1251,74 @@ void SipSubscriptionMgr::createNotifiesDialogInfoEvent(const UtlString& eventTyp
                                                        UtlString*& eventTypeKeyArray,
                                                        bool*& fullContentArray)
 {
-   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                 "SipSubscriptionMgr::createNotifiesDialogInfoEvent mSubscriptionStateResourceIndex (%zu entries)",
-                 mSubscriptionStateResourceIndex.entries());
-
-   lock();
+   long unsigned now = OsDateTime::getSecsSinceEpoch();
+   std::vector<NotifyTarget> targets;
 
-#if 0 // Enable for very detailed logging of searching for the NOTIFY info.
-   if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
+   // Select the subscriptions with the right eventType from each shard in
+   // turn, holding only that shard's lock.
+   for (size_t i = 0; i < sShardCount; i++)
    {
-      UtlHashBagIterator iterator(mSubscriptionStateResourceIndex);
-      UtlString* contentTypeIndex;
-      while ((contentTypeIndex = dynamic_cast <SubscriptionServerStateIndex*> (iterator())))
-      {
-         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                       "SipSubscriptionMgr::createNotifiesDialogInfoEvent element '%s'",
-                       contentTypeIndex->data());
-      }
-   }
-#endif // 0
+      Shard* shard = mShards[i];
+      shard->mMutex.acquire();
 
-   // Select the desired subset of the subscriptions, or all of them.
-   UtlHashBagIterator iterator(mSubscriptionStatesByDialogHandle);
-   int count = 0;
-   int index = 0;
-   acceptHeaderValuesArray = NULL;
-   notifyArray = NULL;
-   resourceIdArray = NULL;
-   eventTypeKeyArray = NULL;
-   fullContentArray = NULL;
-
-   SubscriptionServerState* subscription = NULL;
-   while ((subscription =
-           dynamic_cast <SubscriptionServerState*> (iterator())))
-   {
-      // Select subscriptions with the right eventType.
-      if (subscription->mEventType.compareTo(eventType) == 0)
+      UtlHashBagIterator iterator(shard->mStatesByDialogHandle);
+      SubscriptionServerState* subscription;
+      while ((subscription =
+              dynamic_cast <SubscriptionServerState*> (iterator())))
       {
-         count++;
+         if (subscription->mEventType.compareTo(eventType) == 0)
+         {
+            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                          "SipSubscriptionMgr::createNotifiesDialogInfoEvent now %ld, mExpirationDate %ld",
+                          now, subscription->mExpirationDate);
+
+            // If not expired yet
+            if (subscription->mExpirationDate >= now)
+            {
+               targets.push_back(NotifyTarget(*subscription));
+            }
+         }
       }
-   }
 
-   acceptHeaderValuesArray = new UtlString[count];
-   notifyArray = new SipMessage[count];
-   resourceIdArray = new UtlString[count];
-   eventTypeKeyArray = new UtlString[count];
-   fullContentArray = new bool[count];
+      shard->mMutex.release();
+   }
 
-   iterator.reset();
-   long unsigned now = OsDateTime::getSecsSinceEpoch();
+   acceptHeaderValuesArray = new UtlString[targets.size()];
+   notifyArray = new SipMessage[targets.size()];
+   resourceIdArray = new UtlString[targets.size()];
+   eventTypeKeyArray = new UtlString[targets.size()];
+   fullContentArray = new bool[targets.size()];
+   int index = 0;
 
-   while ((subscription =
-           dynamic_cast <SubscriptionServerState*> (iterator())))
+   for (size_t i = 0; i < targets.size(); i++)
    {
-      // Select subscriptions with the right eventType.
-      if (subscription->mEventType.compareTo(eventType) == 0)
+      // Skip subscriptions that ended since they were selected.
+      if (targets[i].prepare(mDialogMgr, notifyArray[index],
+                             subscriptionStateFormat, now))
       {
+         acceptHeaderValuesArray[index] = targets[i].mAcceptHeaderValue;
+         fullContentArray[index] = targets[i].mFullContent;
+         resourceIdArray[index] = targets[i].mResourceId;
+         eventTypeKeyArray[index] = targets[i].mEventTypeKey;
          Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                       "SipSubscriptionMgr::createNotifiesDialogInfoEvent now %ld, mExpirationDate %ld",
-                       now, subscription->mExpirationDate);
-         
-         // Should not happen, the container is supposed to be locked
-         if (index >= count)
-         {
-            Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                          "SipSubscriptionMgr::createNotifiesDialogInfoEvent iterator elements count changed from: %d to %d while locked",
-                          count, index);
-         }
-         // If not expired yet
-         else if (subscription->mExpirationDate >= now)
+                       "SipSubscriptionMgr::createNotifiesDialogInfoEvent index %d, mAcceptHeaderValue '%s', getEventField '%s'",
+                       index, acceptHeaderValuesArray[index].data(),
+                       targets[i].mEventHeader.data());
+
+         if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
          {
-            // Get the accept value.
-            acceptHeaderValuesArray[index] = subscription->mAcceptHeaderValue;
-            // Get the full-content value.
-            fullContentArray[index] = subscription->mFullContentForNextNotify;
-            // Create the NOTIFY message.
-            mDialogMgr.setNextLocalTransactionInfo(notifyArray[index],
-                                                   SIP_NOTIFY_METHOD,
-                                                   // This is a SubscriptionServerState,
-                                                   // whose superclass UtlString contains
-                                                   // the dialog handle for the subscription.
-                                                   static_cast <const UtlString> (*(subscription)));
-            
-            // Set the event header, if we know what it is.
-            UtlString eventHeader;
-            if (subscription->mpLastSubscribeRequest)
-            {
-               subscription->mpLastSubscribeRequest->getEventField(eventHeader);
-            }
-            notifyArray[index].setEventField(eventHeader);
-            
-            // Set the Subscription-State header.
-            char buffer[101];
-            sprintf(buffer, subscriptionStateFormat,
-                    (long) (subscription->mExpirationDate - now));
-            notifyArray[index].setHeaderValue(SIP_SUBSCRIPTION_STATE_FIELD,
-                                              buffer, 0);
+            UtlString s;
+            ssize_t l;
+            notifyArray[index].getBytes(&s, &l);
             Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                          "SipSubscriptionMgr::createNotifiesDialogInfoEvent index %d, mAcceptHeaderValue '%s', getEventField '%s'",
-                          index, acceptHeaderValuesArray[index].data(),
-                          eventHeader.data());
-            
-            // Set the resourceId, eventTypeKey, and eventType.
-            resourceIdArray[index] = subscription->mResourceId;
-            eventTypeKeyArray[index] = subscription->mEventTypeKey;
-
-            if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
-            {
-               UtlString s;
-               ssize_t i;
-               notifyArray[index].getBytes(&s, &i);
-               Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                             "SipSubscriptionMgr::createNotifiesDialogInfoEvent notifyArray[%d] = '%s'",
-                             index, s.data());
-            }
-            
-            index++;
+                          "SipSubscriptionMgr::createNotifiesDialogInfoEvent notifyArray[%d] = '%s'",
+                          index, s.data());
          }
+
+         index++;
       }
    }
 
-   unlock();
-
    numNotifiesCreated = index;
 
    return;
@@ -1178,62 +1333,36 @@ UtlBoolean SipSubscriptionMgr::endSubscription(const UtlString& dialogHandle,
 
     UtlBoolean subscriptionFound = FALSE;
 
-    lock();
-    SubscriptionServerState* state =
-       dynamic_cast <SubscriptionServerState*>
-       (mSubscriptionStatesByDialogHandle.find(&dialogHandle));
-    
-    if (state)
+    SubscriptionServerState* state;
+    Shard* shard = lockDialog(dialogHandle, state);
+    if (shard)
     {
-        SubscriptionServerStateIndex* stateIndex = NULL;
-        UtlString contentKey(state->mResourceId);
-        contentKey.append(CONTENT_KEY_SEPARATOR);
-        contentKey.append(state->mEventTypeKey);
-        UtlHashBagIterator iterator(mSubscriptionStateResourceIndex, &contentKey);
-        while((stateIndex =
-               dynamic_cast <SubscriptionServerStateIndex*> (iterator())))
+        if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
         {
-            if(stateIndex->mpState == state)
-            {
-                mSubscriptionStatesByDialogHandle.removeReference(state);
-                mSubscriptionStateResourceIndex.removeReference(stateIndex);
-                if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
-                {
-                    UtlString requestContact;
-                    state->mpLastSubscribeRequest->getContactField(0, requestContact);
-                    Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                                 "SipSubscriptionMgr::endSubscription Delete subscription for dialog handle '%s', key '%s', contact '%s', mExpirationDate %ld",
-                                 state->data(), stateIndex->data(),
-                                 requestContact.data(), state->mExpirationDate);
-                }
-
-                delete state;
-                delete stateIndex;
-                subscriptionFound = TRUE;
-
-                break;
-            }
+            UtlString requestContact;
+            state->mpLastSubscribeRequest->getContactField(0, requestContact);
+            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                         "SipSubscriptionMgr::endSubscription Delete subscription for dialog handle '%s', key '%s', contact '%s', mExpirationDate %ld",
+                         state->data(), state->mpIndex->data(),
+                         requestContact.data(), state->mExpirationDate);
         }
 
-        // Could not find the state index that corresponds to the state
-        // Should not happen, there should always be one of each
-        if (!subscriptionFound)
-        {
-            Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                "SipSubscriptionMgr::endSubscription Could not find subscription in mSubscriptionStateResourceIndex for content key '%s', dialog handle '%s'",
-                          contentKey.data(),
-                          dialogHandle.data());
-        }
+        UtlSList removed;
+        removed.append(new UtlString(dialogHandle));
+        shard->remove(state);
+        unindexDialogs(removed);
+        shard->mMutex.release();
+        removed.destroyAll();
+
+        subscriptionFound = TRUE;
     }
     else
     {
        Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                     "SipSubscriptionMgr::endSubscription Could not find subscription in mSubscriptionStatesByDialogHandle for dialog handle '%s'",
+                     "SipSubscriptionMgr::endSubscription Could not find subscription for dialog handle '%s'",
                      dialogHandle.data());
     }
 
-    unlock();
-
     // Remove the dialog
     mDialogMgr.deleteDialog(dialogHandle);
 
@@ -1242,61 +1371,30 @@ UtlBoolean SipSubscriptionMgr::endSubscription(const UtlString& dialogHandle,
 
 void SipSubscriptionMgr::removeOldSubscriptions(long unsigned oldEpochTimeSeconds)
 {
-    lock();
-    UtlHashBagIterator iterator(mSubscriptionStateResourceIndex);
-    SubscriptionServerStateIndex* stateIndex = NULL;
-    while((stateIndex =
-           dynamic_cast <SubscriptionServerStateIndex*> (iterator())))
+    // Each shard only visits the expiry wheel slots of the seconds since its
+    // last sweep, rather than every subscription.
+    for (size_t i = 0; i < sShardCount; i++)
     {
-        if(stateIndex->mpState)
-        {
-            if(stateIndex->mpState->mExpirationDate < oldEpochTimeSeconds)
-            {
-                if (Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
-                {
-                   UtlString requestContact;
-                   stateIndex->mpState->mpLastSubscribeRequest->
-                      getContactField(0, requestContact);
-                   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                                 "SipSubscriptionMgr::removeOldSubscriptions delete subscription for dialog handle '%s', key '%s', contact '%s', mExpirationDate %ld",
-                                 stateIndex->mpState->data(),
-                                 stateIndex->data(), requestContact.data(),
-                                 stateIndex->mpState->mExpirationDate);
-                }
-                mDialogMgr.deleteDialog(*(stateIndex->mpState));
-                mSubscriptionStatesByDialogHandle.removeReference(stateIndex->mpState);
-                delete stateIndex->mpState;
-                stateIndex->mpState = NULL;
-                mSubscriptionStateResourceIndex.removeReference(stateIndex);
-                delete stateIndex;
-            }
-        }
-        else
-        {
-            Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                "SipSubscriptionMgr::removeOldSubscriptions SubscriptionServerStateIndex with NULL mpState, deleting");
-            mSubscriptionStateResourceIndex.removeReference(stateIndex);
-            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                          "SipSubscriptionMgr::removeOldSubscriptions delete subscription for key '%s'",
-                          stateIndex->data());
-            delete stateIndex;
-        }
-    }
+        Shard* shard = mShards[i];
+        UtlSList removed;
 
-    unlock();
+        shard->mMutex.acquire();
+        shard->removeExpired(oldEpochTimeSeconds, removed);
+        unindexDialogs(removed);
+        shard->mMutex.release();
+
+        deleteDialogs(removed);
+    }
 }
 
 // Tell that a new NOTIFY has been generated and sent for a subscription.
 void SipSubscriptionMgr::newNotify(const UtlString& dialogHandle)
 {
-   lock();
-
    // Search for the subscription.
-   SubscriptionServerState* state =
-      dynamic_cast <SubscriptionServerState*>
-      (mSubscriptionStatesByDialogHandle.find(&dialogHandle));
-    
-   if (state)
+   SubscriptionServerState* state;
+   Shard* shard = lockDialog(dialogHandle, state);
+
+   if (shard)
    {
       // Set its resend interval to the minimum.
       state->mNextResendInterval = sInitialNextResendInterval;
@@ -1304,27 +1402,24 @@ void SipSubscriptionMgr::newNotify(const UtlString& dialogHandle)
       Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                     "SipSubscriptionMgr::newNotify setting timer for dialog '%s' to %d seconds",
                     dialogHandle.data(), state->mNextResendInterval);
+
+      shard->mMutex.release();
    }
    else
    {
       Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
-                    "SipSubscriptionMgr::newNotify Could not find subscription in mSubscriptionStatesByDialogHandle for dialog handle '%s'",
+                    "SipSubscriptionMgr::newNotify Could not find subscription for dialog handle '%s'",
                     dialogHandle.data());
    }
-
-   unlock();
 }
 
 // Start the resend timer for a dialog, unless it is set to fire sooner.
 void SipSubscriptionMgr::startResendTimer(const UtlString& dialogHandle)
 {
-   lock();
+   SubscriptionServerState* state;
+   Shard* shard = lockDialog(dialogHandle, state);
 
-   SubscriptionServerState* state =
-      dynamic_cast <SubscriptionServerState*>
-      (mSubscriptionStatesByDialogHandle.find(&dialogHandle));
-    
-   if (state)
+   if (shard)
    {
       // Set the "send full content in next NOTIFY" bit.
       state->mFullContentForNextNotify = true;
@@ -1378,28 +1473,25 @@ void SipSubscriptionMgr::startResendTimer(const UtlString& dialogHandle)
                        "because interval (%d) exceeds maximum (%d)",
                        dialogHandle.data(), interval, sMaxNextResendInterval);
       }
+
+      shard->mMutex.release();
    }
    else
    {
       Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
-                    "SipSubscriptionMgr::startResendTimer Could not find subscription in mSubscriptionStatesByDialogHandle for dialog handle '%s'",
+                    "SipSubscriptionMgr::startResendTimer Could not find subscription for dialog handle '%s'",
                     dialogHandle.data());
    }
-
-   unlock();
 }
 
 // Note that a NOTIFY for this subscription has received a success response.
 void SipSubscriptionMgr::successResponse(const UtlString& dialogHandle)
 {
-   lock();
-
    // Search for the subscription.
-   SubscriptionServerState* state =
-      dynamic_cast <SubscriptionServerState*>
-      (mSubscriptionStatesByDialogHandle.find(&dialogHandle));
-    
-   if (state)
+   SubscriptionServerState* state;
+   Shard* shard = lockDialog(dialogHandle, state);
+
+   if (shard)
    {
       // Clear the "send full content in next NOTIFY" bit.
       state->mFullContentForNextNotify = false;
@@ -1407,15 +1499,15 @@ void SipSubscriptionMgr::successResponse(const UtlString& dialogHandle)
       Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                     "SipSubscriptionMgr::successResponse clearing full-content flag of dialog '%s'",
                     dialogHandle.data());
+
+      shard->mMutex.release();
    }
    else
    {
       Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
-                    "SipSubscriptionMgr::successResponse Could not find subscription in mSubscriptionStatesByDialogHandle for dialog handle '%s'",
+                    "SipSubscriptionMgr::successResponse Could not find subscription for dialog handle '%s'",
                     dialogHandle.data());
    }
-
-   unlock();
 }
 
 // Get pointer to the dialog handle of a resend message.
@@ -1449,8 +1541,6 @@ void SipSubscriptionMgr::updateNotifyVersion(SipContentVersionCallback setConten
                                              int& version,
                                              UtlString& eventTypeKey)
 {
-   lock();
-
    UtlString dialogHandle;
    notifyRequest.getDialogHandleReverse(dialogHandle);
 
@@ -1463,11 +1553,9 @@ void SipSubscriptionMgr::updateNotifyVersion(SipContentVersionCallback setConten
    // the default values set above.
    if (!dialogHandle.isNull())
    {
-      state =
-         dynamic_cast <SubscriptionServerState*>
-         (mSubscriptionStatesByDialogHandle.find(&dialogHandle));
+      Shard* shard = lockDialog(dialogHandle, state);
 
-      if (state != NULL)
+      if (shard)
       {
          // Increment the saved "last XML version number".
          // Keep that value for insertion into the XML.
@@ -1478,6 +1566,8 @@ void SipSubscriptionMgr::updateNotifyVersion(SipContentVersionCallback setConten
                        "SipSubscriptionMgr::updateNotifyVersion "
                        "dialogHandle = '%s', new mDialogVer = %d, eventTypeKey = '%s'",
                        dialogHandle.data(), state->mDialogVer, eventTypeKey.data());
+
+         shard->mMutex.release();
       }
       else
       {
@@ -1487,12 +1577,11 @@ void SipSubscriptionMgr::updateNotifyVersion(SipContentVersionCallback setConten
    }
 
    // Call the application "string variable replacement" callback routine.
+   // The version is already taken, so this needs no lock.
    if (setContentInfo != NULL)
    {
       setContentInfo(notifyRequest, version);
    }
-
-   unlock();
 }
 
 // Set the minimum, default, and maximum subscription times that will be granted.
@@ -1557,14 +1646,13 @@ UtlBoolean SipSubscriptionMgr::dialogExists(UtlString& dialogHandle)
 {
     UtlBoolean subscriptionFound = FALSE;
 
-    lock();
-    SubscriptionServerState* state = (SubscriptionServerState*)
-        mSubscriptionStatesByDialogHandle.find(&dialogHandle);
-    if(state)
+    SubscriptionServerState* state;
+    Shard* shard = lockDialog(dialogHandle, state);
+    if(shard)
     {
         subscriptionFound = TRUE;
+        shard->mMutex.release();
     }
-    unlock();
 
     return(subscriptionFound);
 }
@@ -1573,10 +1661,9 @@ UtlBoolean SipSubscriptionMgr::isExpired(UtlString& dialogHandle)
 {
     UtlBoolean subscriptionExpired = TRUE;
 
-    lock();
-    SubscriptionServerState* state = (SubscriptionServerState*)
-        mSubscriptionStatesByDialogHandle.find(&dialogHandle);
-    if(state)
+    SubscriptionServerState* state;
+    Shard* shard = lockDialog(dialogHandle, state);
+    if(shard)
     {
         long unsigned now = OsDateTime::getSecsSinceEpoch();
 
@@ -1584,8 +1671,8 @@ UtlBoolean SipSubscriptionMgr::isExpired(UtlString& dialogHandle)
         {
             subscriptionExpired = FALSE;
         }
+        shard->mMutex.release();
     }
-    unlock();
 
     return(subscriptionExpired);
 }
@@ -1605,22 +1692,23 @@ int SipSubscriptionMgr::getNextAllowedVersion(const UtlString& resourceId)
 // Dump the object's internal state.
 void SipSubscriptionMgr::dumpState()
 {
-   lock();
-
    // indented 4
 
    Os::Logger::instance().log(FAC_SIP, PRI_INFO,
                  "\t    SipSubscriptionMgr %p",
                  this);
 
-   UtlHashBagIterator itor(mSubscriptionStatesByDialogHandle);
-   SubscriptionServerState* ss;
-   while ((ss = dynamic_cast <SubscriptionServerState*> (itor())))
+   for (size_t i = 0; i < sShardCount; i++)
    {
-      ss->dumpState();
-   }
+      OsLock lock(mShards[i]->mMutex);
 
-   unlock();
+      UtlHashBagIterator itor(mShards[i]->mStatesByDialogHandle);
+      SubscriptionServerState* ss;
+      while ((ss = dynamic_cast <SubscriptionServerState*> (itor())))
+      {
+         ss->dumpState();
+      }
+   }
 }
 
 /* //////////////////////////// PROTECTED ///////////////////////////////// */
@@ -1628,14 +1716,75 @@ void SipSubscriptionMgr::dumpState()
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
 
 
-void SipSubscriptionMgr::lock()
+// The number of the shard holding the subscriptions to resourceId.
+size_t SipSubscriptionMgr::shardOf(const UtlString& resourceId)
+{
+   return resourceId.hash() % sShardCount;
+}
+
+// Find the subscription with dialogHandle, and lock its shard.
+SipSubscriptionMgr::Shard* SipSubscriptionMgr::lockDialog(const UtlString& dialogHandle,
+                                                          SubscriptionServerState*& state)
+{
+   Shard* shard = NULL;
+   state = NULL;
+
+   mShardIndexMutex.acquire();
+   UtlInt* shardNumber =
+      dynamic_cast <UtlInt*> (mShardOfDialog.findValue(&dialogHandle));
+   if (shardNumber)
+   {
+      shard = mShards[shardNumber->getValue()];
+   }
+   mShardIndexMutex.release();
+
+   if (shard)
+   {
+      // The subscription may have ended since it was looked up.
+      shard->mMutex.acquire();
+      state = shard->find(dialogHandle);
+      if (!state)
+      {
+         shard->mMutex.release();
+         shard = NULL;
+      }
+   }
+
+   return shard;
+}
+
+// Record the shard of the subscription with dialogHandle.
+void SipSubscriptionMgr::indexDialog(const UtlString& dialogHandle, size_t shardNumber)
 {
-    mSubscriptionMgrMutex.acquire();
+   OsLock lock(mShardIndexMutex);
+
+   mShardOfDialog.destroy(&dialogHandle);
+   mShardOfDialog.insertKeyAndValue(new UtlString(dialogHandle),
+                                    new UtlInt(shardNumber));
 }
 
-void SipSubscriptionMgr::unlock()
+// Forget the shards of the subscriptions with the handles in dialogHandles.
+void SipSubscriptionMgr::unindexDialogs(const UtlSList& dialogHandles)
 {
-    mSubscriptionMgrMutex.release();
+   OsLock lock(mShardIndexMutex);
+
+   UtlSListIterator iterator(dialogHandles);
+   UtlString* dialogHandle;
+   while ((dialogHandle = dynamic_cast <UtlString*> (iterator())))
+   {
+      mShardOfDialog.destroy(dialogHandle);
+   }
+}
+
+// Delete the dialogs with the handles in dialogHandles.
+void SipSubscriptionMgr::deleteDialogs(UtlSList& dialogHandles)
+{
+   UtlString* dialogHandle;
+   while ((dialogHandle = dynamic_cast <UtlString*> (dialogHandles.get())))
+   {
+      mDialogMgr.deleteDialog(*dialogHandle);
+      delete dialogHandle;
+   }
 }
 
 /* ============================ FUNCTIONS ================================= */
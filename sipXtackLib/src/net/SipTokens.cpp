@@ -0,0 +1,337 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+//////
+
+// SYSTEM INCLUDES
+#include <string.h>
+
+// APPLICATION INCLUDES
+#include <net/SipTokens.h>
+#include <utl/UtlByteScan.h>
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+
+// Properties of a header name.
+enum
+{
+   URL_DISALLOWED = 1,  ///< may not be set by a URI header parameter
+   URL_UNIQUE = 2       ///< occurs once, so a URI header parameter replaces it
+};
+
+// STRUCTS
+
+struct TokenName
+{
+   const char* name;
+   size_t length;
+};
+
+struct HeaderName
+{
+   const char* name;
+   size_t length;
+   const char* compactName;
+   int flags;
+};
+
+// STATIC VARIABLE INITIALIZATIONS
+
+#define TOKEN(name) { name, sizeof(name) - 1 }
+
+static const TokenName sMethods[SipTokens::METHOD_COUNT] =
+{
+   TOKEN(""),
+   TOKEN("ACK"),
+   TOKEN("BYE"),
+   TOKEN("CANCEL"),
+   TOKEN("INFO"),
+   TOKEN("INVITE"),
+   TOKEN("MESSAGE"),
+   TOKEN("NOTIFY"),
+   TOKEN("OPTIONS"),
+   TOKEN("PRACK"),
+   TOKEN("PUBLISH"),
+   TOKEN("REFER"),
+   TOKEN("REGISTER"),
+   TOKEN("SUBSCRIBE"),
+   TOKEN("UPDATE"),
+};
+
+#define HEADER(name, compactName, flags) { name, sizeof(name) - 1, compactName, flags }
+
+static const HeaderName sHeaders[SipTokens::HEADER_COUNT] =
+{
+   HEADER("", NULL, 0),
+   HEADER("ACCEPT", NULL, 0),
+   HEADER("ACCEPT-ENCODING", NULL, 0),
+   HEADER("ACCEPT-LANGUAGE", NULL, 0),
+   HEADER("ALLOW", NULL, 0),
+   HEADER("ALLOW-EVENTS", NULL, 0),
+   HEADER("AUTHORIZATION", NULL, 0),
+   HEADER("CALL-ID", "I", 0),
+   HEADER("CONTACT", "M", URL_DISALLOWED),
+   HEADER("CONTENT-DISPOSITION", NULL, 0),
+   HEADER("CONTENT-ENCODING", "E", URL_DISALLOWED),
+   HEADER("CONTENT-LENGTH", "L", URL_DISALLOWED),
+   HEADER("CONTENT-TYPE", "C", URL_DISALLOWED),
+   HEADER("CSEQ", NULL, URL_DISALLOWED),
+   HEADER("DATE", NULL, 0),
+   HEADER("DIVERSION", NULL, 0),
+   HEADER("EVENT", "O", 0),
+   HEADER("EXPIRES", NULL, URL_UNIQUE),
+   HEADER("FROM", "F", URL_DISALLOWED),
+   HEADER("MAX-FORWARDS", NULL, 0),
+   HEADER("MIN-EXPIRES", NULL, 0),
+   HEADER("PATH", NULL, 0),
+   HEADER("PROXY-AUTHENTICATE", NULL, 0),
+   HEADER("PROXY-AUTHORIZATION", NULL, 0),
+   HEADER("PROXY-REQUIRE", NULL, 0),
+   HEADER("RACK", NULL, 0),
+   HEADER("REASON", NULL, 0),
+   HEADER("RECORD-ROUTE", NULL, URL_DISALLOWED),
+   HEADER("REFER-TO", "R", URL_DISALLOWED),
+   HEADER("REFERRED-BY", "B", URL_DISALLOWED),
+   HEADER("REPLACES", NULL, 0),
+   HEADER("REQUIRE", NULL, 0),
+   HEADER("RETRY-AFTER", NULL, 0),
+   HEADER("ROUTE", NULL, URL_UNIQUE),
+   HEADER("RSEQ", NULL, 0),
+   HEADER("SERVER", NULL, 0),
+   HEADER("SESSION-EXPIRES", NULL, 0),
+   HEADER("SIP-ETAG", NULL, 0),
+   HEADER("SIP-IF-MATCH", NULL, 0),
+   HEADER("SUBJECT", "S", 0),
+   HEADER("SUBSCRIPTION-STATE", NULL, 0),
+   HEADER("SUPPORTED", "K", 0),
+   HEADER("TO", "T", URL_DISALLOWED),
+   HEADER("UNSUPPORTED", NULL, 0),
+   HEADER("USER-AGENT", NULL, URL_DISALLOWED),
+   HEADER("VIA", "V", URL_DISALLOWED),
+   HEADER("WARNING", NULL, 0),
+   HEADER("WWW-AUTHENTICATE", NULL, 0),
+};
+
+static const TokenName sEventPackages[SipTokens::EVENT_COUNT] =
+{
+   TOKEN(""),
+   TOKEN("as-feature-event"),
+   TOKEN("check-sync"),
+   TOKEN("conference"),
+   TOKEN("dialog"),
+   TOKEN("line-seize"),
+   TOKEN("message-summary"),
+   TOKEN("presence"),
+   TOKEN("presence.winfo"),
+   TOKEN("refer"),
+   TOKEN("reg"),
+   TOKEN("simple-message-summary"),
+   TOKEN("sip-config"),
+   TOKEN("ua-profile"),
+};
+
+/*
+ * The slot tables map tokenHash() of a name to the identifier of the only
+ * well-known name that can have that hash, or to 0.  They were computed
+ * from the names above; SipTokensTest checks that every name is found in
+ * its slot, so a name that is added to a table and collides with another
+ * fails the test rather than going unnoticed.  In that case the
+ * multipliers in tokenHash() must be chosen again so that no two names of
+ * any table share a slot, and the tables computed again.
+ */
+
+static const unsigned char sHeaderSlots[256] =
+{
+    0,  0,  0, 43,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 34,  0,
+    0,  0,  0, 23,  0,  0, 44, 24, 18,  0,  0,  0,  0, 31, 21,  0,
+    0,  0,  0, 17,  0,  0,  0,  0,  0,  0,  0, 15,  0,  0,  0, 33,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  4,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 11,  0,  0,  0,  0,  0,
+    0,  2, 27,  0,  0,  0,  0,  0,  0,  0,  0,  0, 42,  0,  0,  0,
+    0,  0, 26,  0, 28,  0,  0,  0,  0, 39,  0,  0,  0,  0,  0,  0,
+    0,  0, 10,  0, 19,  7,  0,  0,  0,  0,  0,  0, 38,  0,  0,  0,
+    0,  8,  0,  3,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0, 45,  0,  0,  0,  0,  0,  0,  0,  0, 25,  0,  0,  0, 37,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 35,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0, 22,  0,  0,  0,  0,  0, 47, 20,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1, 29,  0,  0,  0,  0,
+   14,  0, 13, 32, 40,  0,  0,  0,  5,  0,  0,  0,  0,  0,  0,  0,
+    0,  6, 30,  9,  0, 36,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   12,  0,  0,  0,  0,  0,  0, 46,  0,  0,  0,  0,  0, 41,  0, 16,
+};
+
+static const unsigned char sMethodSlots[64] =
+{
+    0,  0,  0,  0,  0,  0,  0, 11,  0,  0,  0,  0, 12,  0,  0, 13,
+    0,  0,  5,  0,  0,  0,  4,  0,  0,  1,  0,  0,  0,  0,  0,  0,
+    0,  9,  0,  0,  0,  0,  0,  0,  0,  2,  3,  0,  0,  0,  0,  0,
+    7,  0,  0,  0,  0,  6, 14,  0,  0, 10,  0,  8,  0,  0,  0,  0,
+};
+
+static const unsigned char sEventPackageSlots[64] =
+{
+    0,  0,  0,  0, 12,  0,  2,  9,  0,  6,  0,  0,  0, 10,  0,  0,
+    7,  0,  0,  0,  0,  0,  0,  0,  0,  0,  3,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  4,  0, 13,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  1,  0, 11,  0,  8,  0,  5,  0,  0,  0,
+};
+
+// The compact header names, by letter.
+static const unsigned char sCompactHeaders[26] =
+{
+   0,                                   // a
+   SipTokens::HEADER_REFERRED_BY,       // b
+   SipTokens::HEADER_CONTENT_TYPE,      // c
+   0,                                   // d
+   SipTokens::HEADER_CONTENT_ENCODING,  // e
+   SipTokens::HEADER_FROM,              // f
+   0, 0,                                // g h
+   SipTokens::HEADER_CALL_ID,           // i
+   0,                                   // j
+   SipTokens::HEADER_SUPPORTED,         // k
+   SipTokens::HEADER_CONTENT_LENGTH,    // l
+   SipTokens::HEADER_CONTACT,           // m
+   0,                                   // n
+   SipTokens::HEADER_EVENT,             // o
+   0, 0,                                // p q
+   SipTokens::HEADER_REFER_TO,          // r
+   SipTokens::HEADER_SUBJECT,           // s
+   SipTokens::HEADER_TO,                // t
+   0,                                   // u
+   SipTokens::HEADER_VIA,               // v
+   0, 0, 0, 0                           // w x y z
+};
+
+// Hash a name of at least two bytes, ignoring the case of its letters.
+static inline unsigned int tokenHash(const char* name, size_t length)
+{
+   // Setting the 0x20 bit folds the case of letters; it also maps some
+   // other bytes onto each other, which only costs a failed comparison.
+   const unsigned char* u = (const unsigned char*) name;
+   return (  length
+           + 4 * (u[0] | 0x20)
+           + 2 * (u[1] | 0x20)
+           + 10 * ((u[length - 1] | 0x20) + (u[length / 2] | 0x20)));
+}
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ ACCESSORS ================================= */
+
+SipTokens::Method SipTokens::method(const char* name, size_t length)
+{
+   Method method = METHOD_UNKNOWN;
+
+   if (length >= 2)
+   {
+      Method slot = (Method) sMethodSlots[tokenHash(name, length) & 63];
+      if (   sMethods[slot].length == length
+          && memcmp(sMethods[slot].name, name, length) == 0)
+      {
+         method = slot;
+      }
+   }
+
+   return method;
+}
+
+SipTokens::Method SipTokens::method(const char* name)
+{
+   return name ? method(name, strlen(name)) : METHOD_UNKNOWN;
+}
+
+const char* SipTokens::methodName(Method method)
+{
+   return sMethods[method].name;
+}
+
+SipTokens::Header SipTokens::header(const char* name, size_t length)
+{
+   Header header = HEADER_UNKNOWN;
+
+   if (length == 1)
+   {
+      unsigned char letter = name[0] | 0x20;
+      if (letter >= 'a' && letter <= 'z')
+      {
+         header = (Header) sCompactHeaders[letter - 'a'];
+      }
+   }
+   else if (length >= 2)
+   {
+      Header slot = (Header) sHeaderSlots[tokenHash(name, length) & 255];
+      if (   sHeaders[slot].length == length
+          && UtlByteScan::equalsIgnoreCase(sHeaders[slot].name, name, length))
+      {
+         header = slot;
+      }
+   }
+
+   return header;
+}
+
+SipTokens::Header SipTokens::header(const char* name)
+{
+   return name ? header(name, strlen(name)) : HEADER_UNKNOWN;
+}
+
+const char* SipTokens::headerName(Header header)
+{
+   return sHeaders[header].name;
+}
+
+const char* SipTokens::headerCompactName(Header header)
+{
+   return sHeaders[header].compactName;
+}
+
+SipTokens::EventPackage SipTokens::eventPackage(const char* name, size_t length)
+{
+   EventPackage package = EVENT_UNKNOWN;
+
+   if (length >= 2)
+   {
+      EventPackage slot = (EventPackage) sEventPackageSlots[tokenHash(name, length) & 63];
+      if (   sEventPackages[slot].length == length
+          && UtlByteScan::equalsIgnoreCase(sEventPackages[slot].name, name, length))
+      {
+         package = slot;
+      }
+   }
+
+   return package;
+}
+
+SipTokens::EventPackage SipTokens::eventPackage(const char* name)
+{
+   return name ? eventPackage(name, strlen(name)) : EVENT_UNKNOWN;
+}
+
+const char* SipTokens::eventPackageName(EventPackage package)
+{
+   return sEventPackages[package].name;
+}
+
+/* ============================ INQUIRY =================================== */
+
+bool SipTokens::isUrlHeaderDisallowed(Header header)
+{
+   return sHeaders[header].flags & URL_DISALLOWED;
+}
+
+bool SipTokens::isUrlHeaderUnique(Header header)
+{
+   return sHeaders[header].flags & URL_UNIQUE;
+}
+
+/* //////////////////////////// PROTECTED ///////////////////////////////// */
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+
+/* ============================ FUNCTIONS ================================= */
@@ -13,6 +13,9 @@
 // SYSTEM INCLUDES
 #include <stdlib.h>
 #include <assert.h>
+#include <vector>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 
 // APPLICATION INCLUDES
 #include <os/OsDateTime.h>
@@ -26,6 +29,8 @@
 #include <net/SipMessageEvent.h>
 #include <net/NetMd5Codec.h>
 #include <net/SipTransactionList.h>
+#include <net/SipSrvLookup.h>
+#include <utl/UtlMetrics.h>
 
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
@@ -47,6 +52,171 @@ static int SIP_TCP_RESEND_TIMES = 4;          // Maximum number of times to send
 
 
 
+// Time from the start of a fork to the send of the request of its last branch.
+static UtlMetricHistogram& forkTime()
+{
+   static UtlMetricHistogram& histogram =
+      UtlMetrics::instance().histogram("sipx_sip_fork_seconds",
+                                       "Time to start the branches of a fork of equal q-value");
+   return histogram;
+}
+
+SipTransaction::ForkBatch::ForkBatch() :
+   mNextName(0)
+{
+}
+
+SipTransaction::ForkBatch::~ForkBatch()
+{
+   for (size_t i = 0; i < mLookups.size(); i++)
+   {
+      delete[] mLookups[i].destinations;
+   }
+}
+
+void SipTransaction::ForkBatch::defer(SipTransaction* child,
+                                      const UtlString& scheme,
+                                      OsSocket::IpProtocolSocketType msgSizeProtocol)
+{
+   Lookup lookup;
+   lookup.child = child;
+   lookup.scheme = scheme;
+   lookup.msgSizeProtocol = msgSizeProtocol;
+   lookup.destinations = NULL;
+   lookup.sameAs = mLookups.size();
+   mLookups.push_back(lookup);
+}
+
+UtlBoolean SipTransaction::ForkBatch::isDeferred(const SipTransaction* child) const
+{
+   return !mLookups.empty() && mLookups.back().child == child;
+}
+
+UtlBoolean SipTransaction::ForkBatch::isEmpty() const
+{
+   return mLookups.empty();
+}
+
+UtlBoolean SipTransaction::ForkBatch::start(SipUserAgent& userAgent,
+                                            SipTransactionList& transactionList)
+{
+   // Branches to the same next hop, such as the registrations of a shared
+   // line behind one edge proxy, share the result of one lookup.
+   std::vector<size_t> names;
+   for (size_t i = 0; i < mLookups.size(); i++)
+   {
+      Lookup& lookup = mLookups[i];
+      for (size_t j = 0; j < i && lookup.sameAs == i; j++)
+      {
+         if (mLookups[j].sameAs == j && isSameLookup(lookup, mLookups[j]))
+         {
+            lookup.sameAs = j;
+         }
+      }
+      if (lookup.sameAs == i)
+      {
+         // Numeric addresses are resolved without asking DNS.
+         if (OsSocket::isIp4Address(lookup.child->mSendToAddress.data()))
+         {
+            lookup.destinations =
+               lookup.child->lookUpDnsDestinations(lookup.scheme, lookup.msgSizeProtocol);
+         }
+         else
+         {
+            names.push_back(i);
+         }
+      }
+   }
+
+   lookUpNames(names);
+
+   for (size_t i = 0; i < mLookups.size(); i++)
+   {
+      Lookup& lookup = mLookups[i];
+      if (lookup.sameAs != i && mLookups[lookup.sameAs].destinations)
+      {
+         lookup.destinations = copyDestinations(mLookups[lookup.sameAs].destinations);
+      }
+   }
+
+   UtlBoolean started = FALSE;
+   for (size_t i = 0; i < mLookups.size(); i++)
+   {
+      // The child owns its destinations from now on.
+      server_t* destinations = mLookups[i].destinations;
+      mLookups[i].destinations = NULL;
+
+      if (mLookups[i].child->resumeDnsSrvChildren(userAgent, transactionList, destinations))
+      {
+         started = TRUE;
+      }
+   }
+
+#  ifdef LOG_FORKING
+   Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                 "SipTransaction::ForkBatch::start %d children started: %s",
+                 (int) mLookups.size(), started ? "True" : "False");
+#  endif
+   return started;
+}
+
+void SipTransaction::ForkBatch::lookUpNames(const std::vector<size_t>& names)
+{
+   // SipSrvLookup runs up to LOOKUP_POOL_SIZE name lookups at once, so more
+   // threads than that would only wait for one of its sets of query threads.
+   size_t threads = names.size() < (size_t) SipSrvLookupThread::LOOKUP_POOL_SIZE
+                    ? names.size() : (size_t) SipSrvLookupThread::LOOKUP_POOL_SIZE;
+
+   mNextName = 0;
+   boost::thread_group lookupThreads;
+   for (size_t t = 1; t < threads; t++)
+   {
+      lookupThreads.create_thread(boost::bind(&ForkBatch::lookUpNextNames, this,
+                                              boost::cref(names)));
+   }
+   // This thread looks up names too, and does them all if there is one.
+   lookUpNextNames(names);
+   lookupThreads.join_all();
+}
+
+void SipTransaction::ForkBatch::lookUpNextNames(const std::vector<size_t>& names)
+{
+   size_t next;
+   while ((next = __sync_fetch_and_add(&mNextName, 1)) < names.size())
+   {
+      // Each lookup is written by one thread, and read after join_all().
+      Lookup& lookup = mLookups[names[next]];
+      lookup.destinations =
+         lookup.child->lookUpDnsDestinations(lookup.scheme, lookup.msgSizeProtocol);
+   }
+}
+
+bool SipTransaction::ForkBatch::isSameLookup(const Lookup& a, const Lookup& b)
+{
+   return    a.child->mSendToAddress.compareTo(b.child->mSendToAddress, UtlString::ignoreCase) == 0
+          && a.child->mSendToPort == b.child->mSendToPort
+          && a.child->mSendToProtocol == b.child->mSendToProtocol
+          && a.scheme == b.scheme
+          && a.msgSizeProtocol == b.msgSizeProtocol;
+}
+
+server_t* SipTransaction::ForkBatch::copyDestinations(server_t* destinations)
+{
+   // Copy the terminating entry too.
+   int count = 0;
+   while (destinations[count].isValidServerT())
+   {
+      count++;
+   }
+
+   server_t* copy = new server_t[count + 1];
+   for (int i = 0; i <= count; i++)
+   {
+      copy[i] = destinations[i];
+   }
+   return copy;
+}
+
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 UtlBoolean SipTransaction::enableTcpResend = FALSE;
 UtlBoolean SipTransaction::SendTryingForNist = TRUE;
@@ -65,6 +235,7 @@ SipTransaction::SipTransaction(SipMessage* initialMsg,
    , mSendToPort(PORT_NONE)
    , mSendToProtocol(OsSocket::UNKNOWN)
    , mpDnsDestinations(NULL)
+   , mpForkBatch(NULL)
    , mpRequest(NULL)
    , mpLastProvisionalResponse(NULL)
    , mpLastFinalResponse(NULL)
@@ -2772,259 +2943,285 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
               }   
             }
 
-            
-            mpDnsDestinations = SipSrvLookup::servers(mSendToAddress.data(),
-                                                      scheme.data(), 
-                                                      mSendToProtocol,
-                                                      mSendToPort,
-                                                      msgSizeProtocol);
-            
-            if(scheme == "sips" && (!mpDnsDestinations || !mpDnsDestinations[0].isValidServerT()))
+            if (mpForkBatch)
             {
-              Os::Logger::instance().log(FAC_SIP, PRI_ERR,
-                          "SipTransaction::recurseDnsSrvChildren"
-                          " TLS is not set for host %", mSendToAddress.data());
-
-              //
-              // if DNS/SRV lookup of a sips uri failed, default scheme to sip
-              //
-              scheme = "sip";
-              mpDnsDestinations = SipSrvLookup::servers(mSendToAddress.data(),
-                                                      scheme.data(),
-                                                      mSendToProtocol,
-                                                      mSendToPort,
-                                                      msgSizeProtocol);
+                // The parent looks up the destinations of all the branches it
+                // forks together, and then resumes this one.
+                mpForkBatch->defer(this, scheme, msgSizeProtocol);
+                return TRUE;
             }
 
-            // HACK:
-            // Add a via to this request so when we set a timer it is
-            // identified (by branchId) which transaction it is related to
-            if(mpRequest)
-            {
-                // This via should never see the light of day
-                // (or rather the bits of the network).
-                mpRequest->addVia("127.0.0.1",
-                                  9999,
-                                  "UNKNOWN",
-                                  mpBranchId->data());
-            }
+            mpDnsDestinations = lookUpDnsDestinations(scheme, msgSizeProtocol);
+            createDnsSrvChildren(userAgent, transactionList);
+        }
+    }
 
-            // Save a pointer to this transaction in the stored
-            // request in this transaction so that it is carried into
-            // the requests that are attached to the timer events.
-            // Then when the timer events are being processed, it will
-            // be quicker to find the relevant transaction.
+    return pursueDnsSrvChildren(userAgent, transactionList);
+}
 
-            mpRequest->setTransaction(this);
+server_t* SipTransaction::lookUpDnsDestinations(const UtlString& scheme,
+                                                OsSocket::IpProtocolSocketType msgSizeProtocol)
+{
+    server_t* destinations = SipSrvLookup::servers(mSendToAddress.data(),
+                                                   scheme.data(),
+                                                   mSendToProtocol,
+                                                   mSendToPort,
+                                                   msgSizeProtocol);
 
-            if(mpDnsDestinations && mpDnsDestinations[0].isValidServerT())
-            {
-              // Set the transaction expires timeout(s) for the DNS parent (this transaction)
+    if(scheme == "sips" && (!destinations || !destinations[0].isValidServerT()))
+    {
+      Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                  "SipTransaction::lookUpDnsDestinations"
+                  " TLS is not set for host %s", mSendToAddress.data());
+
+      //
+      // if DNS/SRV lookup of a sips uri failed, default scheme to sip
+      //
+      delete[] destinations;
+      destinations = SipSrvLookup::servers(mSendToAddress.data(),
+                                           "sip",
+                                           mSendToProtocol,
+                                           mSendToPort,
+                                           msgSizeProtocol);
+    }
 
-              // We will set one timer (with TRANSACTION_EXPIRATION
-              // event) for the ordinary "transaction expiration" timer.
-              // If this is an INVITE, we will set another timer (with
-              // TRANSACTION_EXPIRATION_TIMER_C event) for the "Timer C"
-              // timer.  Since "Timer C" can be extended by receiving
-              // 101-199 responses, we need to handle its events separately.
+    return destinations;
+}
 
+void SipTransaction::createDnsSrvChildren(SipUserAgent& userAgent,
+                                          SipTransactionList& transactionList)
+{
+    // HACK:
+    // Add a via to this request so when we set a timer it is
+    // identified (by branchId) which transaction it is related to
+    if(mpRequest)
+    {
+        // This via should never see the light of day
+        // (or rather the bits of the network).
+        mpRequest->addVia("127.0.0.1",
+                          9999,
+                          "UNKNOWN",
+                          mpBranchId->data());
+    }
 
-              bool isInvite = mRequestMethod.compareTo(SIP_INVITE_METHOD) == 0;
+    // Save a pointer to this transaction in the stored
+    // request in this transaction so that it is carried into
+    // the requests that are attached to the timer events.
+    // Then when the timer events are being processed, it will
+    // be quicker to find the relevant transaction.
 
-              // If request is INVITE, start Timer C.
-              if (isInvite)
-              {
-                 // Make copy of the request for the timer event.
-                 SipMessageEvent* expiresEvent =
-                    new SipMessageEvent(new SipMessage(*mpRequest),
-                                        SipMessageEvent::TRANSACTION_EXPIRATION_TIMER_C);
-                 OsMsgQ* incomingQ = userAgent.getMessageQueue();
-                 OsTimer* expiresTimer = new OsTimer(incomingQ, expiresEvent);
-                 mTimers.append(expiresTimer);
-
-                 // Timer C is always userAgent.getDefaultExpiresSeconds().
-                 int expireSeconds = userAgent.getDefaultExpiresSeconds();
-                 OsTime expiresTime(expireSeconds, 0);
-
-                 // Get everything set up before starting the timer.
-                 expiresTimer->oneshotAfter(expiresTime);
-
-  #ifdef TEST_PRINT
-                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                               "SipTransaction::recurseDnsSrvChildren "
-                               "added Timer C timer %p to timer list, expire time = %d secs",
-                               expiresTimer, expireSeconds);
-  #endif
+    mpRequest->setTransaction(this);
 
-                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                               "SipTransaction::recurseDnsSrvChildren"
-                               "Timer C transaction %p setting timeout %d secs.",
-                               this, expireSeconds
-                 );
-              }
+    if(mpDnsDestinations && mpDnsDestinations[0].isValidServerT())
+    {
+      // Set the transaction expires timeout(s) for the DNS parent (this transaction)
 
-              // All requests may have a expiration timer.
-
-              // Basic expiration time is provided by the Expires header, if any.
-              // Note that "Expires: 0" is legitimate and causes the transaction
-              // to time out immediately.
-              int expireSeconds = mExpires;
-              // If no Expires, and this is a serial child, use
-              // userAgent.getDefaultSerialExpiresSeconds().
-              if (   expireSeconds < 0
-                  && mpParentTransaction
-                  && mpParentTransaction->isChildSerial())
-              {
-                 expireSeconds = userAgent.getDefaultSerialExpiresSeconds();
-              }
-              // If not an INVITE transaction (and so does not have Timer C),
-              // limit the expiration to userAgent.getSipStateTransactionTimeout()/1000.
-              if (!isInvite)
-              {
-                 int maxExpires = userAgent.getSipStateTransactionTimeout()/1000;
-                 if (expireSeconds < 0 || expireSeconds > maxExpires)
-                 {
-                    expireSeconds = maxExpires;
-                 }
-              }
+      // We will set one timer (with TRANSACTION_EXPIRATION
+      // event) for the ordinary "transaction expiration" timer.
+      // If this is an INVITE, we will set another timer (with
+      // TRANSACTION_EXPIRATION_TIMER_C event) for the "Timer C"
+      // timer.  Since "Timer C" can be extended by receiving
+      // 101-199 responses, we need to handle its events separately.
 
-              // If this results in an expiration time to be enforced, start
-              // a timer.
-              if (expireSeconds >= 0)
-              {
-                 // Make copy of the request for the timer event.
-                 SipMessageEvent* expiresEvent =
-                    new SipMessageEvent(new SipMessage(*mpRequest),
-                                        SipMessageEvent::TRANSACTION_EXPIRATION);
-                 OsMsgQ* incomingQ = userAgent.getMessageQueue();
-                 OsTimer* expiresTimer = new OsTimer(incomingQ, expiresEvent);
-                 mTimers.append(expiresTimer);
-                 OsTime expiresTime(expireSeconds, 0);
-
-                 // Get everything set up before starting the timer.
-                 expiresTimer->oneshotAfter(expiresTime);
-
-  #ifdef TEST_PRINT
-                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                               "SipTransaction::recurseDnsSrvChildren "
-                               "added Expire timer %p to timer list, expire time = %d secs",
-                               expiresTimer, expireSeconds);
-  #endif
 
-                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                               "SipTransaction::recurseDnsSrvChildren"
-                               "Expire transaction %p setting timeout %d secs.",
-                               this, expireSeconds
-                 );
-              }
-            }
-            else
-            {
-              //
-              // We did not get any DNS records.  Expire this transaction immediately
-              //
-              // Make copy of the request for the timer event.
-              SipMessageEvent* expiresEvent =
-                 new SipMessageEvent(new SipMessage(*mpRequest),
-                                     SipMessageEvent::TRANSACTION_EXPIRATION);
-              OsMsgQ* incomingQ = userAgent.getMessageQueue();
-              OsTimer* expiresTimer = new OsTimer(incomingQ, expiresEvent);
-              mTimers.append(expiresTimer);
-              OsTime expiresTime(10); // will fire after 10 ms
-
-              // Get everything set up before starting the timer.
-              expiresTimer->oneshotAfter(expiresTime);
-            }
-            
-            if(mpDnsDestinations && mpDnsDestinations[0].isValidServerT())   // leave redundant check at least for now
-            {
-                int numSrvRecords = 0;
-                int maxSrvRecords = userAgent.getMaxSrvRecords();
+      bool isInvite = mRequestMethod.compareTo(SIP_INVITE_METHOD) == 0;
 
-                // Create child transactions for each SRV record
-                // up to the maximum
-                while(numSrvRecords < maxSrvRecords &&
-                    mpDnsDestinations[numSrvRecords].isValidServerT())
-                {
-                    // will not be a server transaction
-                    SipTransaction* childTransaction =
-                        new SipTransaction(mpRequest,
-                                           TRUE, // outgoing
-                                           mIsUaTransaction,
-                                           (  mpParentTransaction
-                                            ? mpParentTransaction->mpBranchId
-                                            : NULL )
-                                           ); // same as parent
+      // If request is INVITE, start Timer C.
+      if (isInvite)
+      {
+         // Make copy of the request for the timer event.
+         SipMessageEvent* expiresEvent =
+            new SipMessageEvent(new SipMessage(*mpRequest),
+                                SipMessageEvent::TRANSACTION_EXPIRATION_TIMER_C);
+         OsMsgQ* incomingQ = userAgent.getMessageQueue();
+         OsTimer* expiresTimer = new OsTimer(incomingQ, expiresEvent);
+         mTimers.append(expiresTimer);
 
-                    mpDnsDestinations[numSrvRecords].
-                       getIpAddressFromServerT(childTransaction->mSendToAddress);
+         // Timer C is always userAgent.getDefaultExpiresSeconds().
+         int expireSeconds = userAgent.getDefaultExpiresSeconds();
+         OsTime expiresTime(expireSeconds, 0);
 
-                    childTransaction->mSendToPort =
-                        mpDnsDestinations[numSrvRecords].getPortFromServerT();
+         // Get everything set up before starting the timer.
+         expiresTimer->oneshotAfter(expiresTime);
 
-                    childTransaction->mSendToProtocol =
-                        mpDnsDestinations[numSrvRecords].getProtocolFromServerT();
+#ifdef TEST_PRINT
+         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                       "SipTransaction::createDnsSrvChildren "
+                       "added Timer C timer %p to timer list, expire time = %d secs",
+                       expiresTimer, expireSeconds);
+#endif
 
-#                   ifdef ROUTE_DEBUG
-                         {
-                            UtlString protoString;
-                            SipMessage::convertProtocolEnumToString(childTransaction->mSendToProtocol,
-                                                                    protoString);
-                            Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                                          "SipTransaction::recurseDnsSrvChildren "
-                                          "new DNS SRV child %s:%d via '%s'",
-                                          childTransaction->mSendToAddress.data(),
-                                          childTransaction->mSendToPort,
-                                          protoString.data());
-                         }
-#                   endif
+         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
+                       "SipTransaction::createDnsSrvChildren"
+                       "Timer C transaction %p setting timeout %d secs.",
+                       this, expireSeconds
+         );
+      }
 
-                    // Do not create child for unsupported protocol types
-                    if(childTransaction->mSendToProtocol == OsSocket::UNKNOWN)
-                    {
-                        maxSrvRecords++;
-                        delete childTransaction;
-                        childTransaction = NULL;
-                    }
-                    else
-                    {
-                        // Set the q values of the child based upon the parent
-                        // As DNS SRV is recursed serially the Q values are decremented
-                        // by a factor of the record index
-                        childTransaction->mQvalue = mQvalue - numSrvRecords * 0.0001;
+      // All requests may have a expiration timer.
+
+      // Basic expiration time is provided by the Expires header, if any.
+      // Note that "Expires: 0" is legitimate and causes the transaction
+      // to time out immediately.
+      int expireSeconds = mExpires;
+      // If no Expires, and this is a serial child, use
+      // userAgent.getDefaultSerialExpiresSeconds().
+      if (   expireSeconds < 0
+          && mpParentTransaction
+          && mpParentTransaction->isChildSerial())
+      {
+         expireSeconds = userAgent.getDefaultSerialExpiresSeconds();
+      }
+      // If not an INVITE transaction (and so does not have Timer C),
+      // limit the expiration to userAgent.getSipStateTransactionTimeout()/1000.
+      if (!isInvite)
+      {
+         int maxExpires = userAgent.getSipStateTransactionTimeout()/1000;
+         if (expireSeconds < 0 || expireSeconds > maxExpires)
+         {
+            expireSeconds = maxExpires;
+         }
+      }
 
-                        // Inherit the expiration from the parent
-                        childTransaction->mExpires = mExpires;
+      // If this results in an expiration time to be enforced, start
+      // a timer.
+      if (expireSeconds >= 0)
+      {
+         // Make copy of the request for the timer event.
+         SipMessageEvent* expiresEvent =
+            new SipMessageEvent(new SipMessage(*mpRequest),
+                                SipMessageEvent::TRANSACTION_EXPIRATION);
+         OsMsgQ* incomingQ = userAgent.getMessageQueue();
+         OsTimer* expiresTimer = new OsTimer(incomingQ, expiresEvent);
+         mTimers.append(expiresTimer);
+         OsTime expiresTime(expireSeconds, 0);
+
+         // Get everything set up before starting the timer.
+         expiresTimer->oneshotAfter(expiresTime);
 
-                        // Mark this as a DNS child
-                        childTransaction->mIsDnsSrvChild = TRUE;
+#ifdef TEST_PRINT
+         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                       "SipTransaction::createDnsSrvChildren "
+                       "added Expire timer %p to timer list, expire time = %d secs",
+                       expiresTimer, expireSeconds);
+#endif
 
-                        childTransaction->mIsBusy = mIsBusy;
+         Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
+                       "SipTransaction::createDnsSrvChildren"
+                       "Expire transaction %p setting timeout %d secs.",
+                       this, expireSeconds
+         );
+      }
+    }
+    else
+    {
+      //
+      // We did not get any DNS records.  Expire this transaction immediately
+      //
+      // Make copy of the request for the timer event.
+      SipMessageEvent* expiresEvent =
+         new SipMessageEvent(new SipMessage(*mpRequest),
+                             SipMessageEvent::TRANSACTION_EXPIRATION);
+      OsMsgQ* incomingQ = userAgent.getMessageQueue();
+      OsTimer* expiresTimer = new OsTimer(incomingQ, expiresEvent);
+      mTimers.append(expiresTimer);
+      OsTime expiresTime(10); // will fire after 10 ms
+
+      // Get everything set up before starting the timer.
+      expiresTimer->oneshotAfter(expiresTime);
+    }
+    
+    if(mpDnsDestinations && mpDnsDestinations[0].isValidServerT())   // leave redundant check at least for now
+    {
+        int numSrvRecords = 0;
+        int maxSrvRecords = userAgent.getMaxSrvRecords();
+
+        // Create child transactions for each SRV record
+        // up to the maximum
+        while(numSrvRecords < maxSrvRecords &&
+            mpDnsDestinations[numSrvRecords].isValidServerT())
+        {
+            // will not be a server transaction
+            SipTransaction* childTransaction =
+                new SipTransaction(mpRequest,
+                                   TRUE, // outgoing
+                                   mIsUaTransaction,
+                                   (  mpParentTransaction
+                                    ? mpParentTransaction->mpBranchId
+                                    : NULL )
+                                   ); // same as parent
 
-                        // Add it to the list
-                        transactionList.addTransaction(childTransaction);
+            mpDnsDestinations[numSrvRecords].
+               getIpAddressFromServerT(childTransaction->mSendToAddress);
 
-                        // Link it in to this parent
-                        linkChild(*childTransaction);
-                    }
+            childTransaction->mSendToPort =
+                mpDnsDestinations[numSrvRecords].getPortFromServerT();
+
+            childTransaction->mSendToProtocol =
+                mpDnsDestinations[numSrvRecords].getProtocolFromServerT();
+
+#                   ifdef ROUTE_DEBUG
+                 {
+                    UtlString protoString;
+                    SipMessage::convertProtocolEnumToString(childTransaction->mSendToProtocol,
+                                                            protoString);
+                    Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                                  "SipTransaction::createDnsSrvChildren "
+                                  "new DNS SRV child %s:%d via '%s'",
+                                  childTransaction->mSendToAddress.data(),
+                                  childTransaction->mSendToPort,
+                                  protoString.data());
+                 }
+#                   endif
 
-                    numSrvRecords++;
-                }   // end create SRV child transactions
-            }   // end valid SRV records
-            // We got no useful DNS records back
+            // Do not create child for unsupported protocol types
+            if(childTransaction->mSendToProtocol == OsSocket::UNKNOWN)
+            {
+                maxSrvRecords++;
+                delete childTransaction;
+                childTransaction = NULL;
+            }
             else
             {
-                UtlString protoString;
-                SipMessage::convertProtocolEnumToString(mSendToProtocol, protoString);
+                // Set the q values of the child based upon the parent
+                // As DNS SRV is recursed serially the Q values are decremented
+                // by a factor of the record index
+                childTransaction->mQvalue = mQvalue - numSrvRecords * 0.0001;
 
-                Os::Logger::instance().log(FAC_SIP, PRI_WARNING, 
-                              "SipTransaction::recurseDnsSrvChildren "
-                              "no valid DNS records found for sendTo sip:'%s':%d proto = '%s'",
-                              mSendToAddress.data(), mSendToPort, protoString.data());
+                // Inherit the expiration from the parent
+                childTransaction->mExpires = mExpires;
+
+                // Mark this as a DNS child
+                childTransaction->mIsDnsSrvChild = TRUE;
+
+                childTransaction->mIsBusy = mIsBusy;
+
+                // Add it to the list
+                transactionList.addTransaction(childTransaction);
+
+                // Link it in to this parent
+                linkChild(*childTransaction);
             }
-        }
+
+            numSrvRecords++;
+        }   // end create SRV child transactions
+    }   // end valid SRV records
+    // We got no useful DNS records back
+    else
+    {
+        UtlString protoString;
+        SipMessage::convertProtocolEnumToString(mSendToProtocol, protoString);
+
+        Os::Logger::instance().log(FAC_SIP, PRI_WARNING, 
+                      "SipTransaction::createDnsSrvChildren "
+                      "no valid DNS records found for sendTo sip:'%s':%d proto = '%s'",
+                      mSendToAddress.data(), mSendToPort, protoString.data());
     }
+}
 
+UtlBoolean SipTransaction::pursueDnsSrvChildren(SipUserAgent& userAgent,
+                                                SipTransactionList& transactionList)
+{
     UtlBoolean childRecursed = FALSE;
     UtlBoolean childRecursing = FALSE;
     if(!mIsServerTransaction &&
@@ -3054,7 +3251,7 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
 
 #               ifdef LOG_FORKING
                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                              "SipTransaction::recurseDnsSrvChildren "
+                              "SipTransaction::pursueDnsSrvChildren "
                               "%p sending child transaction request %s:%d protocol: %d",
                               this,
                               childTransaction->mSendToAddress.data(),
@@ -3081,7 +3278,7 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
                 childRecursing = TRUE;
 #               ifdef LOG_FORKING
                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                              "SipTransaction::recurseDnsSrvChildren "
+                              "SipTransaction::pursueDnsSrvChildren "
                               "%p still pursing", this);
 #               endif
             }
@@ -3101,7 +3298,7 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
             {
 #               ifdef LOG_FORKING
                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                              "SipTransaction::recurseDnsSrvChildren "
+                              "SipTransaction::pursueDnsSrvChildren "
                               "%p transaction not recursed state: %s", this,
                               stateString(childTransaction->mTransactionState));
 #               endif
@@ -3111,7 +3308,7 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
     else
     {
        Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
-                     "SipTransaction::recurseDnsSrvChildren "
+                     "SipTransaction::pursueDnsSrvChildren "
                      "Returning false:  "
                      "%p isrecursing %s "
                      "mIsServerTransaction = %d, "
@@ -3131,7 +3328,7 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
         mIsRecursing = TRUE;
     }
     Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                  "SipTransaction::recurseDnsSrvChildren "
+                  "SipTransaction::pursueDnsSrvChildren "
                   "%p isrecursing %s"
                   "mIsServerTransaction = %d, "
                   "mIsDnsSrvChild = %d, mpDnsDestinations = %p, "
@@ -3146,6 +3343,15 @@ UtlBoolean SipTransaction::recurseDnsSrvChildren(SipUserAgent& userAgent,
     return(childRecursed);
 }
 
+UtlBoolean SipTransaction::resumeDnsSrvChildren(SipUserAgent& userAgent,
+                                                SipTransactionList& transactionList,
+                                                server_t* destinations)
+{
+    mpDnsDestinations = destinations;
+    createDnsSrvChildren(userAgent, transactionList);
+    return pursueDnsSrvChildren(userAgent, transactionList);
+}
+
 UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
                                            SipTransactionList& transactionList)
 {
@@ -3352,6 +3558,44 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
             children.destroyAll(); // release the urls for the forks
         }   // end processing contacts   
 
+        childRecursed = startForkedChildren(userAgent, transactionList, responseCode);
+    }
+
+    if (childRecursed)
+    {     
+        mIsRecursing = TRUE;
+    }
+    Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
+                  "SipTransaction::recurseChildren "
+                  "%p isrecursing %s"
+                  "mIsServerTransaction = %d, "
+                  "mIsDnsSrvChild = %d, mpDnsDestinations = %p, "
+                  "mpDnsDestinations[0].isValidServerT() = %d, ",
+                  this, mIsRecursing ? "True" : "False",
+                  mIsServerTransaction, mIsDnsSrvChild,
+                  mpDnsDestinations,
+                  // Only examine mpDnsDestinations[0] if mpDnsDestinations != NULL.
+                  mpDnsDestinations ? mpDnsDestinations[0].isValidServerT() : 0);
+    return(childRecursed);
+}
+
+UtlBoolean SipTransaction::startForkedChildren(SipUserAgent& userAgent,
+                                               SipTransactionList& transactionList,
+                                               int responseCode)
+{
+    UtlBoolean childRecursed = FALSE;
+    UtlBoolean deferredAny = TRUE;
+    SipTransaction* childTransaction = NULL;
+    Int64 startTime = UtlMetricHistogram::now();
+
+    // The children of one Q value are started together: each prepares its
+    // request, the DNS lookups they need are done as one batch, and then
+    // the requests are sent back to back.  If none of them could be sent,
+    // the children of the next Q value are tried.
+    while(!childRecursed && deferredAny)
+    {
+        ForkBatch forkBatch;
+
         double nextQvalue = -1.0;
         int numRecursed = 0;
         UtlSListIterator iterator(mChildTransactions);
@@ -3372,7 +3616,7 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
 
 #               ifdef LOG_FORKING
                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                              "SipTransaction::recurseChildren"
+                              "SipTransaction::startForkedChildren"
                               " %p qDelta: %f qDeltaSquare: %f mQvalue: %f",
                               this, qDelta, qDeltaSquare, childTransaction->mQvalue);
 #               endif
@@ -3384,7 +3628,7 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
 
 #                   ifdef LOG_FORKING
                     Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                                  "SipTransaction::recurseChildren"
+                                  "SipTransaction::startForkedChildren"
                                   " %p should recurse child: %p q: %f",
                                   this, childTransaction, childTransaction->mQvalue);
 #                   endif
@@ -3431,19 +3675,24 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
 
 #                   ifdef LOG_FORKING
                     Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                                  "SipTransaction::recurseChildren"
+                                  "SipTransaction::startForkedChildren"
                                   " %p sending child transaction request", this);
 #                   endif
-                    // Start the transaction by sending its request
-                    if(childTransaction->handleOutgoing(recursedRequest,
-                                                        userAgent,
-                                                        transactionList,
-                                                        MESSAGE_REQUEST))
+                    // Start the transaction by sending its request, or
+                    // by deferring its DNS lookup to forkBatch
+                    childTransaction->mpForkBatch = &forkBatch;
+                    UtlBoolean started = childTransaction->handleOutgoing(recursedRequest,
+                                                                          userAgent,
+                                                                          transactionList,
+                                                                          MESSAGE_REQUEST);
+                    childTransaction->mpForkBatch = NULL;
+                    if(started)
                     {
-
                         numRecursed++;
-                        // Recursing is TRUE
-                        childRecursed = TRUE; // Recursion disabled
+                        if(!forkBatch.isDeferred(childTransaction))
+                        {
+                            childRecursed = TRUE;
+                        }
                     }
                 }   // end sending recursed request
 
@@ -3451,7 +3700,7 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
                 {
 #                   ifdef LOG_FORKING
                     Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                                  "SipTransaction::recurseChildren"
+                                  "SipTransaction::startForkedChildren"
                                   " %p nextQvalue: %f qDeltaSquare: %f", this,
                                   nextQvalue, qDeltaSquare);
 #                   endif
@@ -3467,7 +3716,7 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
                 nextQvalue = childTransaction->mQvalue;
 #               ifdef LOG_FORKING
                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                              "SipTransaction::recurseChildren"
+                              "SipTransaction::startForkedChildren"
                               " %p still pursing", this);
 #               endif
             }
@@ -3476,7 +3725,7 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
             {
 #               ifdef LOG_FORKING
                 Os::Logger::instance().log(FAC_SIP, PRI_DEBUG, 
-                              "SipTransaction::recurseChildren"
+                              "SipTransaction::startForkedChildren"
                               " %p transaction not recursed state: %s",
                               this, stateString(childTransaction->mTransactionState));
 #               endif
@@ -3490,23 +3739,19 @@ UtlBoolean SipTransaction::recurseChildren(SipUserAgent& userAgent,
                     break;
             }
         }
+
+        deferredAny = !forkBatch.isEmpty();
+        if(forkBatch.start(userAgent, transactionList))
+        {
+            childRecursed = TRUE;
+        }
     }
 
-    if (childRecursed)
-    {     
-        mIsRecursing = TRUE;
+    if(childRecursed)
+    {
+        forkTime().tally(UtlMetricHistogram::now() - startTime);
     }
-    Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
-                  "SipTransaction::recurseChildren "
-                  "%p isrecursing %s"
-                  "mIsServerTransaction = %d, "
-                  "mIsDnsSrvChild = %d, mpDnsDestinations = %p, "
-                  "mpDnsDestinations[0].isValidServerT() = %d, ",
-                  this, mIsRecursing ? "True" : "False",
-                  mIsServerTransaction, mIsDnsSrvChild,
-                  mpDnsDestinations,
-                  // Only examine mpDnsDestinations[0] if mpDnsDestinations != NULL.
-                  mpDnsDestinations ? mpDnsDestinations[0].isValidServerT() : 0);
+
     return(childRecursed);
 }
 
@@ -4780,7 +5025,10 @@ void SipTransaction::cancel(SipUserAgent& userAgent,
 void SipTransaction::cancelChildren(SipUserAgent& userAgent,
                                     SipTransactionList& transactionList)
 {
-    // Cancel all the child transactions
+    // Cancel all the child transactions, as one batch
+    SipUserAgent::CancelBatch* pBatch = new SipUserAgent::CancelBatch();
+    pBatch->transactions.reserve(mChildTransactions.entries());
+
     UtlSListIterator iterator(mChildTransactions);
     SipTransaction* childTransaction = NULL;
     while ((childTransaction = (SipTransaction*) iterator()))
@@ -4799,9 +5047,14 @@ void SipTransaction::cancelChildren(SipUserAgent& userAgent,
        //
        // childTransaction->cancel(userAgent,
        //                         transactionList);
-       
-       userAgent.enqueueCancelMessage(childTransaction);
+
+       SipUserAgent::TransactionInfo info;
+       info.ptr = childTransaction;
+       childTransaction->buildHash(FALSE, info.hash);
+       pBatch->transactions.push_back(info);
     }
+
+    userAgent.enqueueCancelMessages(pBatch);
 }
 
 void SipTransaction::unlinkChild(SipTransaction* pChild)
@@ -15,6 +15,7 @@
 // APPLICATION INCLUDES
 #include <utl/UtlString.h>
 #include <utl/UtlHashBagIterator.h>
+#include <utl/UtlMetrics.h>
 
 #include <net/SipTransactionList.h>
 #include <net/SipTransaction.h>
@@ -37,6 +38,23 @@
 
 // STATIC VARIABLE INITIALIZATIONS
 
+// Transactions in all lists, and the number ever added.
+static UtlMetricGauge& transactionCount()
+{
+   static UtlMetricGauge& gauge =
+      UtlMetrics::instance().gauge("sipx_sip_transactions",
+                                   "SIP transactions in all transaction lists");
+   return gauge;
+}
+
+static UtlMetricCounter& transactionsAdded()
+{
+   static UtlMetricCounter& counter =
+      UtlMetrics::instance().counter("sipx_sip_transactions_added_total",
+                                     "SIP transactions added to transaction lists");
+   return counter;
+}
+
 /* //////////////////////////// PUBLIC //////////////////////////////////// */
 
 /* ============================ CREATORS ================================== */
@@ -64,6 +82,7 @@ mListMutex(OsMutex::Q_FIFO)
 SipTransactionList::~SipTransactionList()
 {
     abortGarbageCollection();
+    transactionCount().add(-(Int64) mTransactions.entries());
     mTransactions.destroyAll();
 }
 
@@ -85,6 +104,8 @@ void SipTransactionList::addTransaction(SipTransaction* transaction,
     if(lockList) lock();
 
     mTransactions.insert(transaction);
+    transactionCount().add(1);
+    transactionsAdded().add();
 
     if(lockList) unlock();
 }
@@ -462,7 +483,10 @@ void SipTransactionList::removeOldTransactions(long oldTransaction,
 
        for(std::vector<SipTransaction*>::iterator iter = transactionsToBeDeleted.begin(); iter != transactionsToBeDeleted.end(); iter++)
        {
-         mTransactions.removeReference(*iter);
+         if (mTransactions.removeReference(*iter))
+         {
+            transactionCount().add(-1);
+         }
           delete *iter;
        }
 
@@ -22,6 +22,7 @@
 #endif
 
 #include <utl/UtlHashBagIterator.h>
+#include <utl/UtlSListIterator.h>
 #include <utl/UtlSortedListIterator.h>
 #include <net/SipSrvLookup.h>
 #include <net/SipUserAgent.h>
@@ -57,6 +58,7 @@
 #include "net/HttpMessage.h"
 #include "net/SipMessage.h"
 #include "utl/UtlBlockingQueue.h"
+#include "utl/UtlMetrics.h"
 
 // EXTERNAL FUNCTIONS
 // EXTERNAL VARIABLES
@@ -67,10 +69,8 @@
 // Default value is 5 minutes.
 #define DEFAULT_TCP_SOCKET_IDLE_TIME 300
 
-#define MAXIMUM_SIP_LOG_SIZE 100000
 #define SIP_UA_LOG "sipuseragent.log"
 #define CONFIG_LOG_DIR SIPX_LOGDIR
-#define BOOL_ENABLE_MESSAGE_LOGGING TRUE
 #define MAx_CANCEL_QUEUE_SIZE 1024
 
 #ifndef  VENDOR
@@ -134,8 +134,6 @@ SipUserAgent::SipUserAgent(int sipTcpPort,
         , mSipUdpServer(NULL)
         , mSipTlsServer(NULL)
         , mSipTransactions(this)
-        , mMessageLogRMutex(OsRWMutex::Q_FIFO)
-        , mMessageLogWMutex(OsRWMutex::Q_FIFO)
         , mOutputProcessorMutex(OsRWMutex::Q_FIFO)
         , mSipInputProcessorMutex(OsRWMutex::Q_FIFO)
         , mpLineMgr(NULL)
@@ -149,6 +147,7 @@ SipUserAgent::SipUserAgent(int sipTcpPort,
         , _maxTransactionCount(0)
         , _cancelQueue(MAx_CANCEL_QUEUE_SIZE)
         , _pCancelQueueThread(0)
+        , _pCancelFollowUps(0)
 {
    Os::Logger::instance().log(FAC_SIP, PRI_DEBUG,
                  "SipUserAgent[%s]::_ sipTcpPort = %d, sipUdpPort = %d, "
@@ -221,7 +220,6 @@ SipUserAgent::SipUserAgent(int sipTcpPort,
                   "mTcpPort = %d, mUdpPort = %d, mTlsPort = %d",
                   getName().data(), mTcpPort, mUdpPort, mTlsPort);
 
-    mMaxMessageLogSize = MAXIMUM_SIP_LOG_SIZE;
     mMaxForwards = SIP_DEFAULT_MAX_FORWARDS;
 
     // Set the idle time after which unused sockets are garbage collected.
@@ -547,6 +545,10 @@ SipUserAgent::~SipUserAgent()
         mpAuthorizationPasswords = NULL;
     }
 
+    for (int method = 0; method < SipTokens::METHOD_COUNT; method++)
+    {
+       mMethodObservers[method].removeAll();
+    }
     mMessageObservers.destroyAll();
     allowedSipExtensions.destroyAll();
     requiredSipExtensions.destroyAll();
@@ -658,6 +660,10 @@ void SipUserAgent::addMessageObserver(OsMsgQ& messageQueue,
       // Add the observer and its filter criteria to the list lock scope
       OsWriteLock lock(mObserverMutex);
       mMessageObservers.insert(observer);
+      if (observer->getSipMethodId() != SipTokens::METHOD_UNKNOWN)
+      {
+         mMethodObservers[observer->getSipMethodId()].append(observer);
+      }
 
       // Allow the specified method
       if (sipMethod && *sipMethod && wantRequests)
@@ -688,6 +694,7 @@ UtlBoolean SipUserAgent::removeMessageObserver(OsMsgQ& messageQueue, void* pObse
                     (pObserverData == pObserver->getObserverData()))
             {
                 bRemovedObservers = true;
+                mMethodObservers[pObserver->getSipMethodId()].removeReference(pObserver);
                 UtlContainable* wasRemoved = mMessageObservers.removeReference(pObserver);
 
                 if(wasRemoved)
@@ -1241,6 +1248,10 @@ UtlBoolean SipUserAgent::sendUdp(SipMessage* message,
       messageStatusString.append(" of UDP message\n");
     }
 
+  // Serialize the message while this thread still owns it, so the
+  // client and the logs below share the bytes.
+  message->serializeHeaders();
+
   // Send the message
 
   // Disallow an address begining with * as it gets broadcasted on NT
@@ -1251,15 +1262,13 @@ UtlBoolean SipUserAgent::sendUdp(SipMessage* message,
   else if(*serverAddress == '\0')
     {
       // Only bother processing if the logs are enabled
-      if (    isMessageLoggingEnabled() ||
-              Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
+      if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
         {
           UtlString msgBytes;
           ssize_t msgLen;
           message->getBytes(&msgBytes, &msgLen);
           msgBytes.insert(0, "No send address\n");
           msgBytes.append("--------------------END--------------------\n");
-          logMessage(msgBytes.data(), msgBytes.length());
           Os::Logger::instance().log(FAC_SIP_OUTGOING, PRI_INFO, "%s", msgBytes.data());
         }
       sentOk = FALSE;
@@ -1304,15 +1313,23 @@ UtlBoolean SipUserAgent::sendUdp(SipMessage* message,
       message->logTimeEvent("FAILED");
     }
 
+  if (isMessageLoggingEnabled() && *serverAddress)
+    {
+      ssize_t len;
+      message->getBytes(&msgBytes, &len);
+      recordMessage(SipMessageRecorder::OUTGOING, OsSocket::UDP,
+                    mLocalHostAddress, mLocalUdpHostPort,
+                    serverAddress, !portIsValid(port) ? SIP_PORT : port,
+                    msgBytes.data(), msgBytes.length(), !sentOk);
+    }
+
   // Only bother processing if the logs are enabled
-  if (    isMessageLoggingEnabled() ||
-          Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
+  if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
     {
       ssize_t len;
       message->getBytes(&msgBytes, &len);
       msgBytes.insert(0, messageStatusString.data());
       msgBytes.append("--------------------END--------------------\n");
-      logMessage(msgBytes.data(), msgBytes.length());
       if (msgBytes.length())
       {
         Os::Logger::instance().log(FAC_SIP_OUTGOING, PRI_INFO, "%s", msgBytes.data());
@@ -1334,6 +1351,7 @@ UtlBoolean SipUserAgent::sendSymmetricUdp(SipMessage& message,
     }
 
     assert(mSipUdpServer);
+    message.serializeHeaders();
     UtlBoolean sentOk = mSipUdpServer->sendTo(message,
                                              serverAddress,
                                              port);
@@ -1344,9 +1362,19 @@ UtlBoolean SipUserAgent::sendSymmetricUdp(SipMessage& message,
     // This will also consolidate the 6(?) different places where OUTGOING
     // messages are logged.
 
+    if (isMessageLoggingEnabled())
+    {
+        UtlString msgBytes;
+        ssize_t msgLen;
+        message.getBytes(&msgBytes, &msgLen);
+        recordMessage(SipMessageRecorder::OUTGOING, OsSocket::UDP,
+                      mLocalHostAddress, mLocalUdpHostPort,
+                      serverAddress, !portIsValid(port) ? SIP_PORT : port,
+                      msgBytes.data(), msgBytes.length(), !sentOk);
+    }
+
     // Don't bother processing unless the logs are enabled
-    if (    isMessageLoggingEnabled() ||
-            Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
+    if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
     {
         UtlString msgBytes;
         ssize_t msgLen;
@@ -1388,7 +1416,6 @@ UtlBoolean SipUserAgent::sendSymmetricUdp(SipMessage& message,
             msgBytes.append("--------------------END--------------------\n");
         }
 
-        logMessage(msgBytes.data(), msgBytes.length());
         Os::Logger::instance().log(FAC_SIP_OUTGOING, PRI_INFO, "%s", msgBytes.data());
     }
 
@@ -1610,6 +1637,8 @@ UtlBoolean SipUserAgent::sendTcp(SipMessage* message,
     UtlString msgBytes;
     UtlString messageStatusString = "SipUserAgent::sendTcp ";
 
+    message->serializeHeaders();
+
     // :TODO: Note code does not agree with comment.  Which is correct?
     // Disallow an address begining with * as it gets broadcasted on Windows NT.
     if(!strchr(serverAddress,'*') && *serverAddress)
@@ -1621,13 +1650,11 @@ UtlBoolean SipUserAgent::sendTcp(SipMessage* message,
     }
     else if (*serverAddress == '\0')
     {
-       if (isMessageLoggingEnabled() ||
-           Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
+       if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
        {
           message->getBytes(&msgBytes, &len);
           msgBytes.insert(0, "No send address\n");
           msgBytes.append("--------------------END--------------------\n");
-          logMessage(msgBytes.data(), msgBytes.length());
           Os::Logger::instance().log(FAC_SIP_OUTGOING, PRI_INFO, "%s", msgBytes.data());
        }
        sendSucceeded = FALSE;
@@ -1647,9 +1674,16 @@ UtlBoolean SipUserAgent::sendTcp(SipMessage* message,
         message->logTimeEvent("FAILED");
     }
 
-    if (   isMessageLoggingEnabled()
-        || Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO)
-        )
+    if (isMessageLoggingEnabled() && *serverAddress)
+    {
+       message->getBytes(&msgBytes, &len);
+       recordMessage(SipMessageRecorder::OUTGOING, OsSocket::TCP,
+                     mLocalHostAddress, mLocalTcpHostPort,
+                     serverAddress, !portIsValid(port) ? SIP_PORT : port,
+                     msgBytes.data(), msgBytes.length(), !sendSucceeded);
+    }
+
+    if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
     {
        message->getBytes(&msgBytes, &len);
        messageStatusString.append("----Local Host:");
@@ -1668,7 +1702,6 @@ UtlBoolean SipUserAgent::sendTcp(SipMessage* message,
        msgBytes.insert(0, messageStatusString.data());
        msgBytes.append("--------------------END--------------------\n");
 
-       logMessage(msgBytes.data(), msgBytes.length());
        Os::Logger::instance().log(FAC_SIP_OUTGOING , PRI_INFO, "%s", msgBytes.data());
     }
 
@@ -1691,6 +1724,8 @@ UtlBoolean SipUserAgent::sendTls(SipMessage* message,
    UtlString msgBytes;
    UtlString messageStatusString = "SipUserAgent::sendTls ";
 
+   message->serializeHeaders();
+
    // Disallow an address begining with * as it gets broadcasted on NT
    if(!strchr(serverAddress,'*') && *serverAddress)
    {
@@ -1698,13 +1733,11 @@ UtlBoolean SipUserAgent::sendTls(SipMessage* message,
    }
    else if(*serverAddress == '\0')
    {
-      if (    isMessageLoggingEnabled() ||
-          Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
+      if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
       {
          message->getBytes(&msgBytes, &len);
          msgBytes.insert(0, "No send address\n");
          msgBytes.append("--------------------END--------------------\n");
-         logMessage(msgBytes.data(), msgBytes.length());
          Os::Logger::instance().log(FAC_SIP_OUTGOING, PRI_INFO, "%s", msgBytes.data());
       }
       sendSucceeded = FALSE;
@@ -1727,8 +1760,16 @@ UtlBoolean SipUserAgent::sendTls(SipMessage* message,
       message->logTimeEvent("FAILED");
    }
 
-   if (    isMessageLoggingEnabled() ||
-       Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
+   if (isMessageLoggingEnabled() && *serverAddress)
+   {
+      message->getBytes(&msgBytes, &len);
+      recordMessage(SipMessageRecorder::OUTGOING, OsSocket::SSL_SOCKET,
+                    mLocalHostAddress, mLocalTlsHostPort,
+                    serverAddress, !portIsValid(port) ? SIP_PORT : port,
+                    msgBytes.data(), msgBytes.length(), !sendSucceeded);
+   }
+
+   if (Os::Logger::instance().willLog(FAC_SIP_OUTGOING, PRI_INFO))
    {
       message->getBytes(&msgBytes, &len);
       messageStatusString.append("----Local Host:");
@@ -1747,7 +1788,6 @@ UtlBoolean SipUserAgent::sendTls(SipMessage* message,
       msgBytes.insert(0, messageStatusString.data());
       msgBytes.append("--------------------END--------------------\n");
 
-      logMessage(msgBytes.data(), msgBytes.length());
       Os::Logger::instance().log(FAC_SIP_OUTGOING , PRI_INFO, "%s", msgBytes.data());
    }
 
@@ -1822,8 +1862,7 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
 
    // Get the message bytes for logging before the message is
    // potentially deleted or nulled out.
-   if (   isMessageLoggingEnabled()
-       || Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG)
+   if (   Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG)
        || Os::Logger::instance().willLog(FAC_SIP, PRI_DEBUG))
    {
       message->getBytes(&msgBytes, &len);
@@ -2492,8 +2531,7 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
              if(delayedDispatchMessage)
              {
                 // Only bother processing if the logs are enabled
-                if (    isMessageLoggingEnabled() ||
-                    Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG))
+                if (Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG))
                 {
                    UtlString delayMsgString;
                    ssize_t delayMsgLen;
@@ -2502,7 +2540,6 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
                    delayMsgString.insert(0, "SIP User agent delayed dispatch message:\n");
                    delayMsgString.append("++++++++++++++++++++END++++++++++++++++++++\n");
 
-                   logMessage(delayMsgString.data(), delayMsgString.length());
                    Os::Logger::instance().log(FAC_SIP_INCOMING_PARSED, PRI_DEBUG,"%s",
                                  delayMsgString.data());
                 }
@@ -2541,14 +2578,11 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
    eventTimes.addEvent("queuing");
 #endif
 
-   if (    isMessageLoggingEnabled()
-       || Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG)
-       )
+   if (Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG))
    {
       msgBytes.insert(0, messageStatusString.data());
       msgBytes.append("++++++++++++++++++++END++++++++++++++++++++\n");
 
-      logMessage(msgBytes.data(), msgBytes.length());
       Os::Logger::instance().log(FAC_SIP_INCOMING_PARSED, PRI_DEBUG, "%s", msgBytes.data());
    }
 
@@ -2564,9 +2598,7 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
 
    if(delayedDispatchMessage)
    {
-      if (   isMessageLoggingEnabled()
-          || Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG)
-          )
+      if (Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG))
       {
          UtlString delayMsgString;
          ssize_t delayMsgLen;
@@ -2575,7 +2607,6 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
          delayMsgString.insert(0, "SIP User agent delayed dispatch message:\n");
          delayMsgString.append("++++++++++++++++++++END++++++++++++++++++++\n");
 
-         logMessage(delayMsgString.data(), delayMsgString.length());
          Os::Logger::instance().log(FAC_SIP_INCOMING_PARSED, PRI_DEBUG, "%s",
                        delayMsgString.data());
       }
@@ -2605,10 +2636,8 @@ void SipUserAgent::dispatch(SipMessage* message, int messageType)
 void SipUserAgent::queueMessageToObservers(SipMessage* message,
                                            int messageType)
 {
-   UtlString callId;
-   message->getCallIdField(&callId);
    UtlString method;
-   message->getRequestMethod(&method);
+   SipTokens::Method methodId;
 
    // Create a new message event
    SipMessageEvent event(message);
@@ -2621,18 +2650,29 @@ void SipUserAgent::queueMessageToObservers(SipMessage* message,
    {
       int cseq;
       message->getCSeqField(&cseq, &method);
+      methodId = SipTokens::method(method.data(), method.length());
+   }
+   else
+   {
+      methodId = message->getMethodId();
+      if (methodId == SipTokens::METHOD_UNKNOWN)
+      {
+         // Observers of an extension method are found by its name.
+         message->getRequestMethod(&method);
+      }
    }
 
-   queueMessageToInterestedObservers(event, method);
+   queueMessageToInterestedObservers(event, method, methodId);
    // send it to those with no method descrimination as well
-   queueMessageToInterestedObservers(event, "");
+   queueMessageToInterestedObservers(event, "", SipTokens::METHOD_UNKNOWN);
 
    // Do not explicitly delete 'message', as it gets deleted when 'event'
    // is deleted at the end of this scope.
 }
 
 void SipUserAgent::queueMessageToInterestedObservers(SipMessageEvent& event,
-                                                     const UtlString& method)
+                                                     const UtlString& method,
+                                                     SipTokens::Method methodId)
 {
    const SipMessage* message;
    if((message = event.getMessage()))
@@ -2640,7 +2680,13 @@ void SipUserAgent::queueMessageToInterestedObservers(SipMessageEvent& event,
       // Find all of the observers which are interested in
       // this method and post the message
       UtlString messageEventName;
-      message->getEventFieldParts(&messageEventName); // no parameters
+      SipTokens::EventPackage messageEventPackage = SipTokens::EVENT_UNKNOWN;
+      if (! message->isResponse()) // events apply only to requests
+      {
+         message->getEventFieldParts(&messageEventName); // no parameters
+         messageEventPackage = SipTokens::eventPackage(messageEventName.data(),
+                                                       messageEventName.length());
+      }
 
       // do these constructors before taking the lock
       UtlString observerMatchingMethod(method);
@@ -2648,112 +2694,143 @@ void SipUserAgent::queueMessageToInterestedObservers(SipMessageEvent& event,
       // lock the message observer list
       OsReadLock lock(mObserverMutex);
 
-      UtlHashBagIterator observerIterator(mMessageObservers, &observerMatchingMethod);
       SipObserverCriteria* observerCriteria;
-      while ((observerCriteria = (SipObserverCriteria*) observerIterator()))
+      if (methodId != SipTokens::METHOD_UNKNOWN)
       {
-         // Check message direction and type
-         if (   (  message->isResponse() && observerCriteria->wantsResponses())
-             || (! message->isResponse() && observerCriteria->wantsRequests())
-             )
+         // The observers of a well-known method are indexed by it.
+         UtlSListIterator observerIterator(mMethodObservers[methodId]);
+         while ((observerCriteria = (SipObserverCriteria*) observerIterator()))
          {
-            // Decide if the event filter applies
-            bool useEventFilter = false;
-            bool matchedEvent = false;
-            if (! message->isResponse()) // events apply only to requests
-            {
-               UtlString criteriaEventName;
-               observerCriteria->getEventName(criteriaEventName);
+            queueMessageToObserver(event, observerCriteria, methodId,
+                                   messageEventName, messageEventPackage);
+         }
+      }
+      else
+      {
+         UtlHashBagIterator observerIterator(mMessageObservers, &observerMatchingMethod);
+         while ((observerCriteria = (SipObserverCriteria*) observerIterator()))
+         {
+            queueMessageToObserver(event, observerCriteria, methodId,
+                                   messageEventName, messageEventPackage);
+         }
+      }
+   }
+   else
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_CRIT, "queueMessageToInterestedObservers - no message");
+   }
+}
 
-               useEventFilter = ! criteriaEventName.isNull();
-               if (useEventFilter)
-               {
-                  // see if the event type matches
-                  matchedEvent = (   (   method.compareTo(SIP_SUBSCRIBE_METHOD,
-                                                          UtlString::ignoreCase)
-                                      == 0
-                                      || method.compareTo(SIP_NOTIFY_METHOD,
-                                                          UtlString::ignoreCase)
-                                      == 0
-                                      )
-                                  && 0==messageEventName.compareTo(criteriaEventName,
-                                                                   UtlString::ignoreCase
-                                                                   )
-                                  );
-               }
-            } // else - this is a response - event filter is not applicable
+void SipUserAgent::queueMessageToObserver(SipMessageEvent& event,
+                                          SipObserverCriteria* observerCriteria,
+                                          SipTokens::Method methodId,
+                                          const UtlString& messageEventName,
+                                          SipTokens::EventPackage messageEventPackage)
+{
+   const SipMessage* message = event.getMessage();
 
-            // Check to see if the session criteria matters
-            SipSession* pCriteriaSession = observerCriteria->getSession();
-            bool useSessionFilter = (NULL != pCriteriaSession);
-            UtlBoolean matchedSession = FALSE;
-            if (useSessionFilter)
-            {
-               // it matters; see if it matches
-               matchedSession = pCriteriaSession->isSameSession((SipMessage&) *message);
-            }
+   // Check message direction and type
+   if (   (  message->isResponse() && observerCriteria->wantsResponses())
+       || (! message->isResponse() && observerCriteria->wantsRequests())
+       )
+   {
+      // Decide if the event filter applies
+      bool useEventFilter = false;
+      bool matchedEvent = false;
+      if (! message->isResponse()) // events apply only to requests
+      {
+         // A well-known event package is compared by its interned value,
+         // any other by name.
+         SipTokens::EventPackage criteriaEventPackage = observerCriteria->getEventPackage();
+         UtlString criteriaEventName;
+         if (criteriaEventPackage == SipTokens::EVENT_UNKNOWN)
+         {
+            observerCriteria->getEventName(criteriaEventName);
+         }
 
-            // We have a message type (req|rsp) the observer wants - apply filters
-            if (   (! useSessionFilter || matchedSession)
-                && (! useEventFilter   || matchedEvent)
-                )
-            {
-               // This event is interesting, so send it up...
-               OsMsgQ* observerQueue = observerCriteria->getObserverQueue();
-               void* observerData = observerCriteria->getObserverData();
+         useEventFilter = (   criteriaEventPackage != SipTokens::EVENT_UNKNOWN
+                           || ! criteriaEventName.isNull());
+         if (useEventFilter)
+         {
+            // see if the event type matches
+            matchedEvent = (   (   methodId == SipTokens::METHOD_SUBSCRIBE
+                                || methodId == SipTokens::METHOD_NOTIFY
+                                )
+                            && (criteriaEventPackage != SipTokens::EVENT_UNKNOWN
+                                ? criteriaEventPackage == messageEventPackage
+                                : 0==messageEventName.compareTo(criteriaEventName,
+                                                                UtlString::ignoreCase
+                                                                )
+                                )
+                            );
+         }
+      } // else - this is a response - event filter is not applicable
+
+      // Check to see if the session criteria matters
+      SipSession* pCriteriaSession = observerCriteria->getSession();
+      bool useSessionFilter = (NULL != pCriteriaSession);
+      UtlBoolean matchedSession = FALSE;
+      if (useSessionFilter)
+      {
+         // it matters; see if it matches
+         matchedSession = pCriteriaSession->isSameSession((SipMessage&) *message);
+      }
 
-               // Cheat a little and set the observer data to be passed back
-               ((SipMessage*) message)->setResponseListenerData(observerData);
+      // We have a message type (req|rsp) the observer wants - apply filters
+      if (   (! useSessionFilter || matchedSession)
+          && (! useEventFilter   || matchedEvent)
+          )
+      {
+         // This event is interesting, so send it up...
+         OsMsgQ* observerQueue = observerCriteria->getObserverQueue();
+         void* observerData = observerCriteria->getObserverData();
 
-               // Put the message in the observer's queue
-               OsStatus r = observerQueue->send(event, OsTime::NO_WAIT);
-               if (r != OS_SUCCESS)
-               {
-                  int numMsgs = observerQueue->numMsgs();
-                  int maxMsgs = observerQueue->maxMsgs();
-                  Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
-                                "SipUserAgent::queueMessageToInterestedObservers "
-                                "send failed with status %d "
-                                "(numMsgs = %d, maxMsgs = %d)",
-                                r, numMsgs, maxMsgs);
-                  Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
-                                "SipUserAgent::queueMessageToInterestedObservers "
-                                "send failed to queue named '%s'",
-                                observerQueue->getName()->data());
-                  UtlString eventName;
-                  observerCriteria->getEventName(eventName);
-                  Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
-                                "SipUserAgent::queueMessageToInterestedObservers "
-                                "observerQueue %p, observerData %p, SIP method '%s', "
-                                "wantsRequests %d, wantsResponses %d, wantsIncoming %d, "
-                                "wantsOutGoing %d, eventName '%s', SipSession %p",
-                                observerCriteria->getObserverQueue(),
-                                observerCriteria->getObserverData(),
-                                observerCriteria->getSipMethod(),
-                                observerCriteria->wantsRequests(),
-                                observerCriteria->wantsResponses(),
-                                observerCriteria->wantsIncoming(),
-                                observerCriteria->wantsOutGoing(),
-                                eventName.data(),
-                                observerCriteria->getSession());
-                  UtlString messageContent;
-                  ssize_t messageLength;
-                  message->getBytes(&messageContent, &messageLength);
-                  Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
-                                "SipUserAgent::queueMessageToInterestedObservers failed message is: %s",
-                                messageContent.data());
-               }
-            }
-         }
-         else
+         // Cheat a little and set the observer data to be passed back
+         ((SipMessage*) message)->setResponseListenerData(observerData);
+
+         // Put the message in the observer's queue
+         OsStatus r = observerQueue->send(event, OsTime::NO_WAIT);
+         if (r != OS_SUCCESS)
          {
-            // either direction or req/rsp not a match
+            int numMsgs = observerQueue->numMsgs();
+            int maxMsgs = observerQueue->maxMsgs();
+            Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
+                          "SipUserAgent::queueMessageToInterestedObservers "
+                          "send failed with status %d "
+                          "(numMsgs = %d, maxMsgs = %d)",
+                          r, numMsgs, maxMsgs);
+            Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
+                          "SipUserAgent::queueMessageToInterestedObservers "
+                          "send failed to queue named '%s'",
+                          observerQueue->getName()->data());
+            UtlString eventName;
+            observerCriteria->getEventName(eventName);
+            Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
+                          "SipUserAgent::queueMessageToInterestedObservers "
+                          "observerQueue %p, observerData %p, SIP method '%s', "
+                          "wantsRequests %d, wantsResponses %d, wantsIncoming %d, "
+                          "wantsOutGoing %d, eventName '%s', SipSession %p",
+                          observerCriteria->getObserverQueue(),
+                          observerCriteria->getObserverData(),
+                          observerCriteria->getSipMethod(),
+                          observerCriteria->wantsRequests(),
+                          observerCriteria->wantsResponses(),
+                          observerCriteria->wantsIncoming(),
+                          observerCriteria->wantsOutGoing(),
+                          eventName.data(),
+                          observerCriteria->getSession());
+            UtlString messageContent;
+            ssize_t messageLength;
+            message->getBytes(&messageContent, &messageLength);
+            Os::Logger::instance().log(FAC_SIP, PRI_CRIT,
+                          "SipUserAgent::queueMessageToInterestedObservers failed message is: %s",
+                          messageContent.data());
          }
-      } // while observers
+      }
    }
    else
    {
-      Os::Logger::instance().log(FAC_SIP, PRI_CRIT, "queueMessageToInterestedObservers - no message");
+      // either direction or req/rsp not a match
    }
 }
 
@@ -2944,8 +3021,7 @@ void SipUserAgent::handleThreadedMessage(OsMsg* pMsg)
                   if(delayedDispatchMessage)
                   {
                      // Only bother processing if the logs are enabled
-                     if (    isMessageLoggingEnabled() ||
-                         Os::Logger::instance().willLog(FAC_SIP_INCOMING, PRI_DEBUG))
+                     if (Os::Logger::instance().willLog(FAC_SIP_INCOMING, PRI_DEBUG))
                      {
                         UtlString delayMsgString;
                         ssize_t delayMsgLen;
@@ -2954,7 +3030,6 @@ void SipUserAgent::handleThreadedMessage(OsMsg* pMsg)
                         delayMsgString.insert(0, "SIP User agent delayed dispatch message:\n");
                         delayMsgString.append("++++++++++++++++++++END++++++++++++++++++++\n");
 
-                        logMessage(delayMsgString.data(), delayMsgString.length());
                         Os::Logger::instance().log(FAC_SIP_INCOMING_PARSED, PRI_DEBUG,"%s",
                                       delayMsgString.data());
                      }
@@ -3083,8 +3158,7 @@ void SipUserAgent::handleThreadedMessage(OsMsg* pMsg)
                   if(delayedDispatchMessage)
                   {
                      // Only bother processing if the logs are enabled
-                     if (    isMessageLoggingEnabled() ||
-                         Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG))
+                     if (Os::Logger::instance().willLog(FAC_SIP_INCOMING_PARSED, PRI_DEBUG))
                      {
                         UtlString delayMsgString;
                         ssize_t delayMsgLen;
@@ -3093,7 +3167,6 @@ void SipUserAgent::handleThreadedMessage(OsMsg* pMsg)
                         delayMsgString.insert(0, "SIP User agent delayed dispatch message:\n");
                         delayMsgString.append("++++++++++++++++++++END++++++++++++++++++++\n");
 
-                        logMessage(delayMsgString.data(), delayMsgString.length());
                         Os::Logger::instance().log(FAC_SIP_INCOMING_PARSED, PRI_DEBUG,"%s",
                                       delayMsgString.data());
                      }
@@ -3856,53 +3929,57 @@ void SipUserAgent::printStatus()
 
 void SipUserAgent::startMessageLog(int newMaximumLogSize)
 {
-    if(newMaximumLogSize > 0) mMaxMessageLogSize = newMaximumLogSize;
-    if(newMaximumLogSize == -1) mMaxMessageLogSize = -1;
-    mMessageLogEnabled = TRUE;
-
+    if (newMaximumLogSize > 0)
     {
-                OsWriteLock Writelock(mMessageLogWMutex);
-                OsReadLock ReadLock(mMessageLogRMutex);
-                if(mMaxMessageLogSize > 0)
-                        mMessageLog.capacity(mMaxMessageLogSize);
-        }
+       mMessageRecorder.setCapacity(newMaximumLogSize / SipMessageRecorder::DEFAULT_SLOT_BYTES);
+    }
+    else if (newMaximumLogSize == -1)
+    {
+       mMessageRecorder.setCapacity(SipMessageRecorder::DEFAULT_SLOTS);
+    }
+    mMessageRecorder.start();
 }
 
 void SipUserAgent::stopMessageLog()
 {
-    mMessageLogEnabled = FALSE;
+    mMessageRecorder.stop();
 }
 
 void SipUserAgent::clearMessageLog()
 {
-        OsWriteLock Writelock(mMessageLogWMutex);
-        OsReadLock Readlock(mMessageLogRMutex);
-        mMessageLog.remove(0);
+    mMessageRecorder.clear();
 }
 
 void SipUserAgent::logMessage(const char* message, int messageLength)
 {
-    if(mMessageLogEnabled)
-    {
-       {// lock scope
-          OsWriteLock Writelock(mMessageLogWMutex);
-          // Do not allow the log go grow beyond the maximum
-          if(mMaxMessageLogSize > 0 &&
-             ((((int)mMessageLog.length()) + messageLength) > mMaxMessageLogSize))
-          {
-             mMessageLog.remove(0,
-                                mMessageLog.length() + messageLength - mMaxMessageLogSize);
-          }
+    mMessageRecorder.recordNote(message, messageLength);
+}
 
-          mMessageLog.append(message, messageLength);
-       }//lock scope
-    }
+void SipUserAgent::recordMessage(SipMessageRecorder::Direction direction,
+                                 OsSocket::IpProtocolSocketType transport,
+                                 const char* localAddress,
+                                 int localPort,
+                                 const char* remoteAddress,
+                                 int remotePort,
+                                 const char* bytes,
+                                 size_t length,
+                                 bool failed)
+{
+    mMessageRecorder.record(direction, transport,
+                            localAddress, localPort,
+                            remoteAddress, remotePort,
+                            bytes, length, failed);
 }
 
 void SipUserAgent::getMessageLog(UtlString& logData)
 {
-        OsReadLock Readlock(mMessageLogRMutex);
-        logData = mMessageLog;
+    logData.remove(0);
+    mMessageRecorder.exportText(logData);
+}
+
+const SipMessageRecorder& SipUserAgent::getMessageRecorder() const
+{
+    return mMessageRecorder;
 }
 
 void SipUserAgent::allowExtension(const char* extension)
@@ -4077,7 +4154,7 @@ void SipUserAgent::whichExtensionsNotAllowed(const SipMessage* message,
 
 UtlBoolean SipUserAgent::isMessageLoggingEnabled()
 {
-    return(BOOL_ENABLE_MESSAGE_LOGGING);
+    return mMessageRecorder.isRecording();
 }
 
 UtlBoolean SipUserAgent::isForkingEnabled()
@@ -4379,15 +4456,59 @@ void SipUserAgent::onFinalResponse(SipTransaction* pTransaction, const SipMessag
 }
 
 
+// Time from queuing a batch of transactions to cancel to the end of its cancels.
+static UtlMetricHistogram& cancelTime()
+{
+  static UtlMetricHistogram& histogram =
+    UtlMetrics::instance().histogram("sipx_sip_cancel_seconds",
+                                     "Time to cancel a batch of transactions and their children");
+  return histogram;
+}
+
 void SipUserAgent::enqueueCancelMessage(SipTransaction* pTransaction)
 {
-  TransactionInfo* pTransactionInfo = new TransactionInfo();
-  pTransactionInfo->ptr = pTransaction;
-  pTransaction->buildHash(FALSE, pTransactionInfo->hash);
-  
-  OS_LOG_INFO(FAC_SIP, "SipUserAgent::enqueueCancelMessage - " << pTransactionInfo->hash.data());
-  
-  _cancelQueue.enqueue(pTransactionInfo);
+  CancelBatch* pBatch = new CancelBatch();
+  pBatch->transactions.resize(1);
+  pBatch->transactions[0].ptr = pTransaction;
+  pTransaction->buildHash(FALSE, pBatch->transactions[0].hash);
+
+  enqueueCancelMessages(pBatch);
+}
+
+void SipUserAgent::enqueueCancelMessages(CancelBatch* pBatch)
+{
+  if (pBatch->transactions.empty())
+  {
+    delete pBatch;
+    return;
+  }
+
+  //
+  // Canceling a transaction cancels its children.  When that happens on the
+  // cancel thread, the children are canceled along with the batch being
+  // processed instead of going round the queue again.
+  //
+  if (_pCancelQueueThread
+      && boost::this_thread::get_id() == _pCancelQueueThread->get_id()
+      && _pCancelFollowUps)
+  {
+    _pCancelFollowUps->transactions.insert(_pCancelFollowUps->transactions.end(),
+                                           pBatch->transactions.begin(),
+                                           pBatch->transactions.end());
+    delete pBatch;
+    return;
+  }
+
+  OS_LOG_INFO(FAC_SIP, "SipUserAgent::enqueueCancelMessages - "
+    << pBatch->transactions.size() << " transactions, first " << pBatch->transactions[0].hash.data());
+
+  pBatch->queuedTime = UtlMetricHistogram::now();
+  if (!_cancelQueue.enqueue(pBatch))
+  {
+    OS_LOG_ERROR(FAC_SIP, "SipUserAgent::enqueueCancelMessages - queue is full, dropping "
+      << pBatch->transactions.size() << " transactions");
+    delete pBatch;
+  }
 }
 
 void SipUserAgent::handleCancelQueue()
@@ -4399,45 +4520,66 @@ void SipUserAgent::handleCancelQueue()
     // We are all good.  Dispatch this message
     //
    
-    TransactionInfo* pTransactionInfo = 0;
-    if (!_cancelQueue.dequeue(pTransactionInfo))
+    CancelBatch* pBatch = 0;
+    if (!_cancelQueue.dequeue(pBatch))
     {
       OS_LOG_NOTICE(FAC_SIP, "SipUserAgent::handleCancelQueue - Exiting");
       break;
     }
     
-    if (!pTransactionInfo)
+    if (!pBatch)
     {
-      OS_LOG_NOTICE(FAC_SIP, "SipUserAgent::handleCancelQueue - Got NULL transaction info");
+      OS_LOG_NOTICE(FAC_SIP, "SipUserAgent::handleCancelQueue - Got NULL transaction batch");
       continue;
     }
-    
-    if (!pTransactionInfo->ptr)
-    {
-      OS_LOG_NOTICE(FAC_SIP, "SipUserAgent::handleCancelQueue - Got NULL transaction pointer");
-      continue;
-    }
-    
-    OS_LOG_INFO(FAC_SIP, "SipUserAgent::handleCancelQueue - processing " << pTransactionInfo->hash.data());
-    
+
     //
-    // lock the transaction
+    // Cancel the transactions of the batch, then the children they cancel,
+    // and so on down the transaction tree, so that all the CANCELs go out
+    // back to back.  Only one transaction is locked at a time.
     //
-    if (mSipTransactions.waitUntilAvailable(pTransactionInfo->ptr, pTransactionInfo->hash))
+    CancelBatch followUps;
+    _pCancelFollowUps = &followUps;
+
+    std::vector<TransactionInfo> transactions;
+    transactions.swap(pBatch->transactions);
+    while (!transactions.empty())
     {
-      //
-      // Cancel the child transaction
-      //
-      pTransactionInfo->ptr->cancel(*this, mSipTransactions);
+      for (std::vector<TransactionInfo>::iterator iter = transactions.begin();
+           iter != transactions.end(); iter++)
+      {
+        if (!iter->ptr)
+        {
+          OS_LOG_NOTICE(FAC_SIP, "SipUserAgent::handleCancelQueue - Got NULL transaction pointer");
+          continue;
+        }
 
+        OS_LOG_INFO(FAC_SIP, "SipUserAgent::handleCancelQueue - processing " << iter->hash.data());
+
+        //
+        // lock the transaction
+        //
+        if (mSipTransactions.waitUntilAvailable(iter->ptr, iter->hash))
+        {
+          //
+          // Cancel the child transaction
+          //
+          iter->ptr->cancel(*this, mSipTransactions);
+
+          //
+          // Unlock the transaction before we go
+          //
+          mSipTransactions.markAvailable(*(iter->ptr));
+        }
+      }
 
-      //
-      // Unlock the transaction before we go
-      //
-      mSipTransactions.markAvailable(*(pTransactionInfo->ptr));
+      transactions.clear();
+      transactions.swap(followUps.transactions);
     }
 
-    delete pTransactionInfo;
+    _pCancelFollowUps = 0;
+    cancelTime().tally(UtlMetricHistogram::now() - pBatch->queuedTime);
+    delete pBatch;
   }
   
   OS_LOG_NOTICE(FAC_SIP, "SipUserAgent::handleCancelQueue - TERMINATED");
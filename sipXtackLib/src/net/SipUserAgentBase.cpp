@@ -58,6 +58,18 @@ void SipUserAgentBase::addConfigChangeConsumer(OsMsgQ& messageQueue)
 
 /* ============================ ACCESSORS ================================= */
 
+void SipUserAgentBase::recordMessage(SipMessageRecorder::Direction direction,
+                                     OsSocket::IpProtocolSocketType transport,
+                                     const char* localAddress,
+                                     int localPort,
+                                     const char* remoteAddress,
+                                     int remotePort,
+                                     const char* bytes,
+                                     size_t length,
+                                     bool failed)
+{
+}
+
 void SipUserAgentBase::getContactUri(UtlString* contactUri)
 {
     contactUri->remove(0);
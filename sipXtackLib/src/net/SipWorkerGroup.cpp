@@ -0,0 +1,473 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+//////
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// APPLICATION INCLUDES
+#include "net/SipWorkerGroup.h"
+#include "net/SipMessage.h"
+#include "net/SipUserAgent.h"
+#include "os/OsDateTime.h"
+#include "os/OsLogger.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+
+// The largest message relayed; a larger one is handled where it was read.
+static const size_t MAX_RELAYED_BYTES = 65536;
+
+// Room for a textual IPv6 address.
+static const size_t ADDRESS_BYTES = 46;
+
+// STATIC VARIABLE INITIALIZATIONS
+// STRUCTS
+
+// What a relayed message is sent with, followed by the message itself.
+struct RelayHeader
+{
+   int32_t protocol;
+   int32_t sendPort;
+   int32_t interfacePort;
+   int32_t transportTime;
+   char sendAddress[ADDRESS_BYTES];
+   char interfaceAddress[ADDRESS_BYTES];
+};
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ CREATORS ================================== */
+
+SipWorkerGroup::SipWorkerGroup(unsigned int workers,
+                               unsigned int claimSeconds,
+                               unsigned int tableSlots) :
+   mWorkers(workers < 1 ? 1 : workers > MAX_WORKERS ? MAX_WORKERS : workers),
+   mWorker(0),
+   mClaimSeconds(claimSeconds),
+   mSlotMask(0),
+   mpSlots(NULL),
+   mTableBytes(0),
+   mpUserAgent(NULL),
+   mpRelayThread(NULL),
+   mStopping(false)
+{
+   // Round the table up to a power of two so a hash is masked into it.
+   uint64_t slots = 1;
+   while (slots < tableSlots)
+   {
+      slots <<= 1;
+   }
+   mSlotMask = slots - 1;
+   mTableBytes = slots * sizeof(Slot);
+
+   // Anonymous shared memory is zero filled, which is every slot unused,
+   // and is shared with the processes forked later.
+   void* table = mmap(NULL, mTableBytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (table == MAP_FAILED)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                 "SipWorkerGroup::SipWorkerGroup "
+                                 "mapping %lu bytes failed, errno = %d",
+                                 (unsigned long) mTableBytes, errno);
+      mTableBytes = 0;
+   }
+   else
+   {
+      mpSlots = static_cast<Slot*>(table);
+   }
+
+   for (unsigned int i = 0; i < mWorkers; i++)
+   {
+      int fds[2] = { -1, -1 };
+      if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0)
+      {
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                    "SipWorkerGroup::SipWorkerGroup "
+                                    "socketpair for worker %u failed, errno = %d",
+                                    i, errno);
+      }
+      else
+      {
+         // Let a burst of relayed messages queue rather than be handled
+         // by the wrong worker.
+         int bufferBytes = 4 * 1024 * 1024;
+         setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+         setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+      }
+      mReceiveFds.push_back(fds[0]);
+      mSendFds.push_back(fds[1]);
+   }
+
+   setWorker(0);
+
+   Os::Logger::instance().log(FAC_SIP, PRI_INFO,
+                              "SipWorkerGroup::SipWorkerGroup %u workers, "
+                              "%lu table slots, claims held %u s",
+                              mWorkers, (unsigned long) slots, mClaimSeconds);
+}
+
+SipWorkerGroup::~SipWorkerGroup()
+{
+   stop();
+
+   for (size_t i = 0; i < mReceiveFds.size(); i++)
+   {
+      if (mReceiveFds[i] >= 0)
+      {
+         close(mReceiveFds[i]);
+      }
+      if (mSendFds[i] >= 0)
+      {
+         close(mSendFds[i]);
+      }
+   }
+
+   if (mpSlots)
+   {
+      munmap(mpSlots, mTableBytes);
+   }
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+unsigned int SipWorkerGroup::fork()
+{
+   pid_t parent = getpid();
+
+   for (unsigned int i = 1; i < mWorkers; i++)
+   {
+      pid_t pid = ::fork();
+      if (pid == 0)
+      {
+         // Do not outlive the parent, which is what the service scripts watch.
+         prctl(PR_SET_PDEATHSIG, SIGTERM);
+         if (getppid() != parent)
+         {
+            _exit(0);
+         }
+
+         mChildren.clear();
+         setWorker(i);
+         return i;
+      }
+      else if (pid < 0)
+      {
+         // No transaction is ever claimed for a worker that does not run,
+         // so nothing is relayed to it.
+         Os::Logger::instance().log(FAC_SIP, PRI_ERR,
+                                    "SipWorkerGroup::fork "
+                                    "forking worker %u failed, errno = %d",
+                                    i, errno);
+      }
+      else
+      {
+         mChildren.push_back(pid);
+      }
+   }
+
+   Os::Logger::instance().log(FAC_SIP, PRI_NOTICE,
+                              "SipWorkerGroup::fork started %lu of %u workers",
+                              (unsigned long) mChildren.size() + 1, mWorkers);
+   return mWorker;
+}
+
+void SipWorkerGroup::stopWorkers()
+{
+   for (size_t i = 0; i < mChildren.size(); i++)
+   {
+      kill(mChildren[i], SIGTERM);
+   }
+   for (size_t i = 0; i < mChildren.size(); i++)
+   {
+      int status;
+      waitpid(mChildren[i], &status, 0);
+   }
+   mChildren.clear();
+}
+
+void SipWorkerGroup::start(SipUserAgent& userAgent)
+{
+   mpUserAgent = &userAgent;
+   mStopping = false;
+   userAgent.setSteering(boost::bind(&SipWorkerGroup::steer, this, _1));
+   mpRelayThread = new boost::thread(boost::bind(&SipWorkerGroup::run, this));
+}
+
+void SipWorkerGroup::stop()
+{
+   if (mpRelayThread)
+   {
+      mpUserAgent->setSteering(SipUserAgent::DispatchEvaluator());
+      mStopping = true;
+      mpRelayThread->join();
+      delete mpRelayThread;
+      mpRelayThread = NULL;
+   }
+}
+
+bool SipWorkerGroup::steer(SipMessage* message)
+{
+   int owner = getOwner(*message);
+
+   if (message->isResponse())
+   {
+      // Only the worker that sent the request has its client transaction.
+      if (owner < 0 || (unsigned int) owner == mWorker)
+      {
+         return false;
+      }
+   }
+   else if (message->getSendProtocol() != OsSocket::UDP)
+   {
+      // The answer must go back on this connection, so this worker takes
+      // the transaction over from whichever had it.
+      if ((unsigned int) owner != mWorker && !claim(*message, mWorker))
+      {
+         mpClaimFailures->add();
+      }
+      return false;
+   }
+   else if (owner < 0 || (unsigned int) owner == mWorker)
+   {
+      if (owner < 0 && !claim(*message, mWorker))
+      {
+         mpClaimFailures->add();
+      }
+      return false;
+   }
+
+   if (!relay(*message, owner))
+   {
+      return false;
+   }
+
+   mpRelayed->add();
+   delete message;
+   return true;
+}
+
+bool SipWorkerGroup::claim(const SipMessage& message, unsigned int worker)
+{
+   if (!mpSlots)
+   {
+      return false;
+   }
+
+   uint64_t key = keyOf(message);
+   uint32_t now = OsDateTime::getSecsSinceEpoch();
+
+   for (unsigned int probe = 0; probe < PROBES; probe++)
+   {
+      Slot& slot = mpSlots[(key + probe) & mSlotMask];
+      uint64_t current = slot.key;
+
+      // Take the slot of this transaction, or one that is unused or whose
+      // claim has run out; another worker may take the latter first.
+      if (current == key
+          || ((current == 0 || slot.expires < now)
+              && __sync_bool_compare_and_swap(&slot.key, current, key)))
+      {
+         slot.worker = worker;
+         __sync_synchronize();
+         slot.expires = now + mClaimSeconds;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+SipMessage* SipWorkerGroup::receive(int timeoutMs)
+{
+   int fd = mReceiveFds[mWorker];
+   if (fd < 0)
+   {
+      return NULL;
+   }
+
+   struct pollfd ready;
+   ready.fd = fd;
+   ready.events = POLLIN;
+   ready.revents = 0;
+   if (poll(&ready, 1, timeoutMs) <= 0)
+   {
+      return NULL;
+   }
+
+   char buffer[sizeof(RelayHeader) + MAX_RELAYED_BYTES];
+   ssize_t length = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+   if (length < (ssize_t) sizeof(RelayHeader))
+   {
+      return NULL;
+   }
+
+   RelayHeader header;
+   memcpy(&header, buffer, sizeof(header));
+   header.sendAddress[ADDRESS_BYTES - 1] = '\0';
+   header.interfaceAddress[ADDRESS_BYTES - 1] = '\0';
+
+   // Restore what SipClient set when the message was read.
+   SipMessage* message = new SipMessage(buffer + sizeof(RelayHeader),
+                                        length - sizeof(RelayHeader));
+   message->setSendProtocol((OsSocket::IpProtocolSocketType) header.protocol);
+   message->setSendAddress(header.sendAddress, header.sendPort);
+   message->setInterfaceIpPort(header.interfaceAddress, header.interfacePort);
+   message->setTransportTime(header.transportTime);
+
+   return message;
+}
+
+void SipWorkerGroup::setWorker(unsigned int worker)
+{
+   mWorker = worker;
+
+   UtlString number;
+   number.appendNumber((int) worker);
+   UtlString label = UtlMetrics::label("worker", number.data());
+   UtlMetrics& metrics = UtlMetrics::instance();
+   mpRelayed = &metrics.counter("sipx_worker_relayed_total",
+                                "Messages passed to the worker that owns their transaction",
+                                label.data());
+   mpClaimFailures = &metrics.counter("sipx_worker_claim_failures_total",
+                                      "Transactions not recorded as the affinity table was full",
+                                      label.data());
+}
+
+/* ============================ ACCESSORS ================================= */
+
+int SipWorkerGroup::getOwner(const SipMessage& message) const
+{
+   if (!mpSlots)
+   {
+      return -1;
+   }
+
+   uint64_t key = keyOf(message);
+   uint32_t now = OsDateTime::getSecsSinceEpoch();
+
+   for (unsigned int probe = 0; probe < PROBES; probe++)
+   {
+      const Slot& slot = mpSlots[(key + probe) & mSlotMask];
+      if (slot.key == key && slot.expires >= now)
+      {
+         __sync_synchronize();
+         return slot.worker < mWorkers ? (int) slot.worker : -1;
+      }
+   }
+
+   return -1;
+}
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+
+uint64_t SipWorkerGroup::keyOf(const SipMessage& message)
+{
+   UtlString callId;
+   message.getCallIdField(&callId);
+   int sequence;
+   message.getCSeqField(&sequence, NULL);
+
+   // FNV-1a of the Call-ID, then of the CSeq number, which is the same in
+   // the requests and responses of a transaction and in its CANCEL and ACK.
+   uint64_t hash = 14695981039346656037ULL;
+   for (size_t i = 0; i < callId.length(); i++)
+   {
+      hash ^= (unsigned char) callId(i);
+      hash *= 1099511628211ULL;
+   }
+   for (int i = 0; i < 4; i++)
+   {
+      hash ^= (sequence >> (8 * i)) & 0xff;
+      hash *= 1099511628211ULL;
+   }
+
+   return hash ? hash : 1;
+}
+
+bool SipWorkerGroup::relay(const SipMessage& message, unsigned int worker)
+{
+   int fd = worker < mSendFds.size() ? mSendFds[worker] : -1;
+   if (fd < 0)
+   {
+      return false;
+   }
+
+   UtlString bytes;
+   ssize_t length;
+   message.getBytes(&bytes, &length);
+   if ((size_t) length > MAX_RELAYED_BYTES)
+   {
+      return false;
+   }
+
+   RelayHeader header;
+   memset(&header, 0, sizeof(header));
+   UtlString sendAddress;
+   int sendPort;
+   message.getSendAddress(&sendAddress, &sendPort);
+   header.protocol = message.getSendProtocol();
+   header.sendPort = sendPort;
+   header.interfacePort = message.getInterfacePort();
+   header.transportTime = message.getTransportTime();
+   strncpy(header.sendAddress, sendAddress.data(), ADDRESS_BYTES - 1);
+   strncpy(header.interfaceAddress, message.getInterfaceIp().data(), ADDRESS_BYTES - 1);
+
+   struct iovec parts[2];
+   parts[0].iov_base = &header;
+   parts[0].iov_len = sizeof(header);
+   parts[1].iov_base = const_cast<char*>(bytes.data());
+   parts[1].iov_len = length;
+
+   struct msghdr datagram;
+   memset(&datagram, 0, sizeof(datagram));
+   datagram.msg_iov = parts;
+   datagram.msg_iovlen = 2;
+
+   // Never wait for a worker that is behind: handling the message here is
+   // better than stalling this worker's reader.
+   if (sendmsg(fd, &datagram, MSG_DONTWAIT) < 0)
+   {
+      Os::Logger::instance().log(FAC_SIP, PRI_WARNING,
+                                 "SipWorkerGroup::relay "
+                                 "worker %u did not take a message, errno = %d",
+                                 worker, errno);
+      return false;
+   }
+
+   return true;
+}
+
+void SipWorkerGroup::run()
+{
+   while (!mStopping)
+   {
+      SipMessage* message = receive(500);
+      if (message)
+      {
+         // dispatch() skips the steering, so a message is relayed at most once.
+         mpUserAgent->dispatch(message);
+      }
+   }
+}
+
+/* ============================ FUNCTIONS ================================= */
@@ -553,6 +553,438 @@ UtlSList* XmlRpcBody::parseArray(TiXmlNode* arrayNode, ///< pointer to the <arra
    return pList;
 }
 
+// Explain that a value is nested more than MAX_VALUE_NESTING_DEPTH deep.
+static void nestingTooDeep(const char* method, UtlString& errorTxt)
+{
+   char errMsg[200];
+   sprintf(errMsg, "parameter nesting depth exceeds maximum allowed (%d)",
+           MAX_VALUE_NESTING_DEPTH);
+   errorTxt.append(errMsg);
+   Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::%s %s",
+                 method, errMsg
+                 );
+}
+
+// Explain that the document ended or was malformed; always returns false.
+static bool illFormed(XmlPullParser& parser, UtlString& errorTxt)
+{
+   errorTxt.append("ill-formed XML");
+   if (parser.getEvent() == XmlPullParser::ERROR)
+   {
+      errorTxt.append(": ");
+      errorTxt.append(parser.getError());
+   }
+   return false;
+}
+
+/*
+ * The streamed parsers follow the DOM ones above: the first element of a
+ * kind is used and any others are skipped, and the text of an element is
+ * entity decoded and whitespace condensed the way TinyXML does by default.
+ */
+UtlContainable* XmlRpcBody::parseValue(XmlPullParser& parser, ///< on the <value> start tag
+                                       int nestDepth,         ///< current level of recursion
+                                       UtlString& errorTxt    ///< explanation of parse error if any
+                                       )
+{
+   UtlContainable* value = NULL;
+   if (++nestDepth <= MAX_VALUE_NESTING_DEPTH)
+   {
+      size_t depth = parser.getDepth();
+      bool valueIsOk = true;
+      bool typed = false;
+      bool done = false;
+      UtlString untypedText;
+
+      while (valueIsOk && !done)
+      {
+         switch (parser.next())
+         {
+         case XmlPullParser::START_ELEMENT:
+            if (typed)
+            {
+               valueIsOk = parser.skipElement() || illFormed(parser, errorTxt);
+            }
+            else
+            {
+               typed = true;
+               const XmlPullParser::Slice& type = parser.getName();
+               if (type.equals("struct"))
+               {
+                  if (!(value = parseStruct(parser, nestDepth, errorTxt)))
+                  {
+                     Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseValue"
+                                   " error parsing 'struct' content");
+                     errorTxt.append(" in 'struct' element");
+                     valueIsOk = false;
+                  }
+               }
+               else if (type.equals("array"))
+               {
+                  if (!(value = parseArray(parser, nestDepth, errorTxt)))
+                  {
+                     Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseValue"
+                                   " error parsing 'array' content");
+                     valueIsOk = false;
+                  }
+               }
+               else
+               {
+                  UtlString typeName;
+                  type.appendTo(typeName);
+                  // Note: In the string case, we allow a null string
+                  bool mayBeEmpty = typeName.compareTo("i4") != 0
+                                    && typeName.compareTo("int") != 0
+                                    && typeName.compareTo("i8") != 0
+                                    && typeName.compareTo("boolean") != 0
+                                    && typeName.compareTo("dateTime.iso8601") != 0;
+                  UtlString paramValue;
+                  if (!parser.readText(paramValue))
+                  {
+                     valueIsOk = illFormed(parser, errorTxt);
+                  }
+                  else if (paramValue.isNull() && !mayBeEmpty)
+                  {
+                     Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseValue"
+                                   " '%s' element is empty", typeName.data());
+                     errorTxt.append("'");
+                     errorTxt.append(typeName);
+                     errorTxt.append("' element is empty");
+                     valueIsOk = false;
+                  }
+                  else if (typeName.compareTo("i4") == 0)
+                  {
+                     value = new UtlInt(atoi(paramValue));
+                  }
+                  else if (typeName.compareTo("int") == 0)
+                  {
+                     value = new UtlInt(atol(paramValue));
+                  }
+                  else if (typeName.compareTo("i8") == 0)
+                  {
+                     value = new UtlLongLongInt(strtoll(paramValue, 0, 0));
+                  }
+                  else if (typeName.compareTo("boolean") == 0)
+                  {
+                     value = new UtlBool((atoi(paramValue)==1));
+                  }
+                  else
+                  {
+                     // string, dateTime.iso8601 (need to change to UtlDateTime),
+                     // and types this parser does not know
+                     value = new UtlString(paramValue);
+                  }
+               }
+            }
+            break;
+
+         case XmlPullParser::TEXT:
+            // Default case for string
+            if (!typed && !parser.getText().isBlank())
+            {
+               if (!untypedText.isNull())
+               {
+                  untypedText.append(' ');
+               }
+               if (parser.isCData())
+               {
+                  parser.getText().appendTo(untypedText);
+               }
+               else
+               {
+                  parser.getText().decodeTo(untypedText, true);
+               }
+            }
+            break;
+
+         case XmlPullParser::END_ELEMENT:
+            done = parser.getDepth() == depth;
+            break;
+
+         case XmlPullParser::END_DOCUMENT:
+         case XmlPullParser::ERROR:
+            valueIsOk = illFormed(parser, errorTxt);
+            break;
+
+         default:
+            break;
+         }
+      }
+
+      if (!valueIsOk)
+      {
+         deallocateValue(value);
+      }
+      else if (!typed)
+      {
+         value = new UtlString(untypedText);
+      }
+   }
+   else
+   {
+      nestingTooDeep("parseValue", errorTxt);
+   }
+
+   return value;
+}
+
+
+UtlHashMap* XmlRpcBody::parseStruct(XmlPullParser& parser, ///< on the <struct> start tag
+                                    int nestDepth,         ///< current level of recursion
+                                    UtlString& errorTxt    ///< explanation of parse error if any
+                                    )
+{
+   UtlHashMap* returnedStruct = NULL;
+
+   if (++nestDepth <= MAX_VALUE_NESTING_DEPTH)
+   {
+      returnedStruct = new UtlHashMap();
+      size_t depth = parser.getDepth();
+      bool structIsOk = true;
+      bool done = false;
+
+      while (structIsOk && !done)
+      {
+         switch (parser.next())
+         {
+         case XmlPullParser::START_ELEMENT:
+            if (parser.getName().equals("member"))
+            {
+               size_t memberDepth = parser.getDepth();
+               bool memberDone = false;
+               bool hasName = false;
+               UtlString name;
+               UtlContainable* value = NULL;
+               bool hasValue = false;
+
+               while (structIsOk && !memberDone)
+               {
+                  switch (parser.next())
+                  {
+                  case XmlPullParser::START_ELEMENT:
+                     if (!hasName && parser.getName().equals("name"))
+                     {
+                        hasName = true;
+                        structIsOk = parser.readText(name) || illFormed(parser, errorTxt);
+                     }
+                     else if (!hasValue && parser.getName().equals("value"))
+                     {
+                        hasValue = true;
+                        if (!(value = parseValue(parser, nestDepth, errorTxt)))
+                        {
+                           Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseStruct"
+                                         " error parsing member/value"
+                                         );
+                           errorTxt.append(" in member '");
+                           errorTxt.append(name);
+                           errorTxt.append("'");
+                           structIsOk = false;
+                        }
+                     }
+                     else
+                     {
+                        structIsOk = parser.skipElement() || illFormed(parser, errorTxt);
+                     }
+                     break;
+
+                  case XmlPullParser::END_ELEMENT:
+                     memberDone = parser.getDepth() == memberDepth;
+                     break;
+
+                  case XmlPullParser::END_DOCUMENT:
+                  case XmlPullParser::ERROR:
+                     structIsOk = illFormed(parser, errorTxt);
+                     break;
+
+                  default:
+                     break;
+                  }
+               }
+
+               if (structIsOk)
+               {
+                  if (!hasName)
+                  {
+                     Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseStruct"
+                                   " 'member' element does not have a 'name' child"
+                                   );
+                     errorTxt.append("'member' element does not have a 'name' child");
+                     structIsOk = false;
+                  }
+                  else if (name.isNull())
+                  {
+                     Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseStruct"
+                                   " 'name' element is empty"
+                                   );
+                     errorTxt.append( "'name' element is empty");
+                     structIsOk = false;
+                  }
+                  else if (!hasValue)
+                  {
+                     Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseStruct"
+                                   " 'member' element does not have a 'value' child"
+                                   );
+                     errorTxt.append(" 'member' element name '");
+                     errorTxt.append(name);
+                     errorTxt.append("' does not have a value");
+                     structIsOk = false;
+                  }
+                  else
+                  {
+                     returnedStruct->insertKeyAndValue(new UtlString(name), value);
+                     value = NULL;
+                  }
+               }
+               deallocateValue(value);
+            }
+            else
+            {
+               structIsOk = parser.skipElement() || illFormed(parser, errorTxt);
+            }
+            break;
+
+         case XmlPullParser::END_ELEMENT:
+            done = parser.getDepth() == depth;
+            break;
+
+         case XmlPullParser::END_DOCUMENT:
+         case XmlPullParser::ERROR:
+            structIsOk = illFormed(parser, errorTxt);
+            break;
+
+         default:
+            break;
+         }
+      }
+
+      if (!structIsOk)
+      {
+         deallocateContainedValues(returnedStruct);
+         delete returnedStruct;
+         returnedStruct = NULL;
+      }
+   }
+   else
+   {
+      nestingTooDeep("parseStruct", errorTxt);
+   }
+
+   return returnedStruct;
+}
+
+UtlSList* XmlRpcBody::parseArray(XmlPullParser& parser, ///< on the <array> start tag
+                                 int nestDepth,         ///< current level of recursion
+                                 UtlString& errorTxt    ///< explanation of parse error if any
+                                 )
+{
+   UtlSList* pList = NULL;
+   if (++nestDepth <= MAX_VALUE_NESTING_DEPTH)
+   {
+      pList = new UtlSList();
+      size_t depth = parser.getDepth();
+      bool arrayIsOk = true;
+      bool hasData = false;
+      bool done = false;
+
+      while (arrayIsOk && !done)
+      {
+         switch (parser.next())
+         {
+         case XmlPullParser::START_ELEMENT:
+            if (!hasData && parser.getName().equals("data"))
+            {
+               hasData = true;
+               size_t dataDepth = parser.getDepth();
+               bool dataDone = false;
+               int index = 0;
+
+               while (arrayIsOk && !dataDone)
+               {
+                  switch (parser.next())
+                  {
+                  case XmlPullParser::START_ELEMENT:
+                     if (parser.getName().equals("value"))
+                     {
+                        UtlContainable* value;
+                        if ((value = parseValue(parser, nestDepth, errorTxt)))
+                        {
+                           pList->append(value);
+                           index++;
+                        }
+                        else
+                        {
+                           char errMsg[200];
+                           sprintf(errMsg, " in value %d of array", index);
+                           Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseArray %s",
+                                         errMsg
+                                         );
+                           errorTxt.append(errMsg);
+                           arrayIsOk = false;
+                        }
+                     }
+                     else
+                     {
+                        arrayIsOk = parser.skipElement() || illFormed(parser, errorTxt);
+                     }
+                     break;
+
+                  case XmlPullParser::END_ELEMENT:
+                     dataDone = parser.getDepth() == dataDepth;
+                     break;
+
+                  case XmlPullParser::END_DOCUMENT:
+                  case XmlPullParser::ERROR:
+                     arrayIsOk = illFormed(parser, errorTxt);
+                     break;
+
+                  default:
+                     break;
+                  }
+               }
+            }
+            else
+            {
+               arrayIsOk = parser.skipElement() || illFormed(parser, errorTxt);
+            }
+            break;
+
+         case XmlPullParser::END_ELEMENT:
+            done = parser.getDepth() == depth;
+            break;
+
+         case XmlPullParser::END_DOCUMENT:
+         case XmlPullParser::ERROR:
+            arrayIsOk = illFormed(parser, errorTxt);
+            break;
+
+         default:
+            break;
+         }
+      }
+
+      if (arrayIsOk && !hasData)
+      {
+         Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR, "XmlRpcBody::parseArray"
+                       " 'array' element does not have 'data' child");
+         errorTxt.append("'array' element does not have 'data' child");
+         arrayIsOk = false;
+      }
+
+      if (!arrayIsOk)
+      {
+         deallocateContainedValues(pList);
+         delete pList;
+         pList = NULL;
+      }
+   }
+   else
+   {
+      nestingTooDeep("parseArray", errorTxt);
+   }
+
+   return pList;
+}
+
 /*
  * Note: The deallocateValue method deletes the value (UtlContainable)
  *       object passed to it, and sets the pointer to the object back to NULL, after
@@ -194,18 +194,21 @@ void XmlRpcDispatch::processRequest(const HttpRequestContext& requestContext,
    UtlSList params;
 
    UtlString logString;
-   if (bodyString.length() > XmlRpcBody::MAX_LOG)
+   if (Os::Logger::instance().willLog(FAC_XMLRPC, PRI_DEBUG))
    {
-      logString.append(bodyString, 0, XmlRpcBody::MAX_LOG);
-      logString.append("\n...");
-   }
-   else
-   {
-      logString = bodyString;
+      if (bodyString.length() > XmlRpcBody::MAX_LOG)
+      {
+         logString.append(bodyString, 0, XmlRpcBody::MAX_LOG);
+         logString.append("\n...");
+      }
+      else
+      {
+         logString = bodyString;
+      }
+      Os::Logger::instance().log(FAC_XMLRPC, PRI_DEBUG,
+                    "XmlRpcDispatch::processRequest requestBody = \n%s",
+                    logString.data());
    }
-   Os::Logger::instance().log(FAC_XMLRPC, PRI_DEBUG,
-                 "XmlRpcDispatch::processRequest requestBody = \n%s",
-                 logString.data());
 
    if (parseXmlRpcRequest(bodyString, methodContainer, params, responseBody))
    {
@@ -260,23 +263,26 @@ void XmlRpcDispatch::processRequest(const HttpRequestContext& requestContext,
    // Send the response back
    responseBody.getBody()->getBytes(&bodyString, &bodyLength);
 
-   logString.remove(0);
-   if (bodyString.length() > XmlRpcBody::MAX_LOG)
+   if (Os::Logger::instance().willLog(FAC_XMLRPC, PRI_INFO))
    {
-      logString.append(bodyString, 0, XmlRpcBody::MAX_LOG);
-      logString.append("\n...");
-   }
-   else
-   {
-      logString = bodyString;
-   }
+      logString.remove(0);
+      if (bodyString.length() > XmlRpcBody::MAX_LOG)
+      {
+         logString.append(bodyString, 0, XmlRpcBody::MAX_LOG);
+         logString.append("\n...");
+      }
+      else
+      {
+         logString = bodyString;
+      }
 
-   Os::Logger::instance().log(FAC_XMLRPC, PRI_INFO,
-                 "XmlRpcDispatch::processRequest method '%s' response status=%s\n%s",
-                 methodName.data(),
-                 XmlRpcMethod::ExecutionStatusString(status),
-                 logString.data()
-                 );
+      Os::Logger::instance().log(FAC_XMLRPC, PRI_INFO,
+                    "XmlRpcDispatch::processRequest method '%s' response status=%s\n%s",
+                    methodName.data(),
+                    XmlRpcMethod::ExecutionStatusString(status),
+                    logString.data()
+                    );
+   }
 
    response->setBody(new HttpBody(bodyString.data(), bodyLength));
    response->setContentType(CONTENT_TYPE_TEXT_XML);
@@ -332,142 +338,200 @@ bool XmlRpcDispatch::parseXmlRpcRequest(const UtlString& requestContent,
                                         UtlSList& params,
                                         XmlRpcResponse& response)
 {
-   bool result = false;
-
-   // Parse the XML-RPC response
-   TiXmlDocument doc("XmlRpcRequest.xml");
-
-   doc.Parse(requestContent);
-   if (!doc.Error())
+   // Positive request example
+   //
+   // <methodCall>
+   //   <methodName>examples.getStateName</methodName>
+   //   <params>
+   //     <param>
+   //       <value><i4>41</i4></value>
+   //     </param>
+   //   </params>
+   // </methodCall>
+   //
+   // The request is parsed as it is read rather than into a DOM, so the
+   // checks below are made in document order: an unregistered method is
+   // reported without parsing its params, and the document is only known
+   // to be well formed once the whole of it has been read.
+
+   XmlPullParser parser(requestContent.data(), requestContent.length());
+   methodContainer = NULL;
+
+   bool hasMethodCall = false;
+   bool hasMethodName = false;
+   bool hasParams = false;
+   UtlString methodCall;
+   UtlString faultMsg;
+   int faultCode = 0;
+
+   XmlPullParser::Event event;
+   while (   faultCode == 0
+          && (event = parser.next()) != XmlPullParser::END_DOCUMENT
+          && event != XmlPullParser::ERROR)
    {
-      TiXmlNode* rootNode = doc.FirstChild ("methodCall");
+      if (event != XmlPullParser::START_ELEMENT)
+      {
+         continue; // comments, processing instructions, text between elements
+      }
 
-      if (rootNode != NULL)
+      if (parser.getDepth() == 1)
       {
-         // Positive response example
-         //
-         // <methodCall>
-         //   <methodName>examples.getStateName</methodName>
-         //   <params>
-         //     <param>
-         //       <value><i4>41</i4></value>
-         //     </param>
-         //   </params>
-         // </methodCall>
-
-         TiXmlNode* methodNode = rootNode->FirstChild("methodName");
-
-         if (methodNode)
+         if (parser.getName().equals("methodCall"))
+         {
+            hasMethodCall = true;
+         }
+         else
+         {
+            parser.skipElement();
+         }
+      }
+      else if (parser.getDepth() > 2)
+      {
+         parser.skipElement();
+      }
+      else if (!hasMethodName && parser.getName().equals("methodName"))
+      {
+         hasMethodName = true;
+         if (parser.readText(methodCall))
          {
             // Check whether the method exists or not. If not, send back a fault response
-            UtlString methodCall = methodNode->FirstChild()->Value();
             methodContainer = (XmlRpcMethodContainer*) mMethods.findValue(&methodCall);
-            if (methodContainer)
+            if (!methodContainer)
             {
-               /*
-                * Since params are optional,
-                * assume all is well until proven otherwise now
-                */
-               result = true;
-               TiXmlNode* paramsNode = rootNode->FirstChild("params");
-
-               if (paramsNode)
+               Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
+                             "XmlRpcDispatch::parseXmlRpcRequest no method '%s' registered",
+                             methodCall.data());
+               response.setMethod(methodCall);
+               faultCode = UNREGISTERED_METHOD_FAULT_CODE;
+               faultMsg = UNREGISTERED_METHOD_FAULT_STRING;
+            }
+         }
+      }
+      else if (!hasParams && parser.getName().equals("params"))
+      {
+         hasParams = true;
+         size_t paramsDepth = parser.getDepth();
+         int index = 0;
+         while (   faultCode == 0
+                && parser.next() != XmlPullParser::END_DOCUMENT
+                && parser.getEvent() != XmlPullParser::ERROR
+                && !(   parser.getEvent() == XmlPullParser::END_ELEMENT
+                     && parser.getDepth() == paramsDepth))
+         {
+            if (parser.getEvent() != XmlPullParser::START_ELEMENT)
+            {
+               continue;
+            }
+            if (!parser.getName().equals("param"))
+            {
+               parser.skipElement();
+               continue;
+            }
+
+            size_t paramDepth = parser.getDepth();
+            bool hasValue = false;
+            while (   faultCode == 0
+                   && parser.next() != XmlPullParser::END_DOCUMENT
+                   && parser.getEvent() != XmlPullParser::ERROR
+                   && !(   parser.getEvent() == XmlPullParser::END_ELEMENT
+                        && parser.getDepth() == paramDepth))
+            {
+               if (parser.getEvent() != XmlPullParser::START_ELEMENT)
                {
-                  int index = 0;
-                  for (TiXmlNode* paramNode = paramsNode->FirstChild("param");
-                       result /* stop if any error */ && paramNode /* or no more param nodes */;
-                       paramNode = paramNode->NextSibling("param"))
-                  {
-                     TiXmlNode* subNode = paramNode->FirstChild("value");
-
-                     if (subNode)
-                     {
-                        UtlString parseErrorMsg;
-                        UtlContainable* param = XmlRpcBody::parseValue(subNode, 0, parseErrorMsg);
-                        if (param)
-                        {
-                           params.append(param);
-                           index++;
-                        }
-                        else
-                        {
-                           char errorLoc[200];
-                           sprintf(errorLoc," in param %d",
-                                   index);
-                           Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
-                                         "XmlRpcDispatch::parseXmlRpcRequest"
-                                         " invalid <value> contents %s of %s",
-                                         errorLoc, requestContent.data());
-                           parseErrorMsg.append(errorLoc);
-                           response.setFault(EMPTY_PARAM_VALUE_FAULT_CODE,
-                                             parseErrorMsg.data());
-                           result=false;
-                        }
-                     }
-                     else
-                     {
-                        char errorLoc[200];
-                        sprintf(errorLoc,"no <value> element in param %d.",
-                                index);
-                        Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
-                                      "XmlRpcDispatch::parseXmlRpcRequest %s of: %s",
-                                      errorLoc, requestContent.data());
-                        response.setFault(EMPTY_PARAM_VALUE_FAULT_CODE,
-                                          errorLoc);
-                        result=false;
-                     }
-                  }
+                  continue;
                }
-               else
+               if (hasValue || !parser.getName().equals("value"))
                {
+                  parser.skipElement();
+                  continue;
+               }
+
+               hasValue = true;
+               UtlString parseErrorMsg;
+               UtlContainable* param = XmlRpcBody::parseValue(parser, 0, parseErrorMsg);
+               if (param)
+               {
+                  params.append(param);
+                  index++;
+               }
+               else if (parser.getEvent() != XmlPullParser::ERROR)
+               {
+                  char errorLoc[200];
+                  sprintf(errorLoc," in param %d",
+                          index);
                   Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
-                                "XmlRpcDispatch::parseXmlRpcRequest no <params> element found");
-                  response.setMethod(methodCall);
-                  response.setFault(ILL_FORMED_CONTENTS_FAULT_CODE, "no <params> element");
-                  result = false;
+                                "XmlRpcDispatch::parseXmlRpcRequest"
+                                " invalid <value> contents %s of %s",
+                                errorLoc, requestContent.data());
+                  parseErrorMsg.append(errorLoc);
+                  faultCode = EMPTY_PARAM_VALUE_FAULT_CODE;
+                  faultMsg = parseErrorMsg;
                }
             }
-            else
+
+            if (faultCode == 0 && !hasValue && parser.getEvent() == XmlPullParser::END_ELEMENT)
             {
+               char errorLoc[200];
+               sprintf(errorLoc,"no <value> element in param %d.",
+                       index);
                Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
-                             "XmlRpcDispatch::parseXmlRpcRequest no method '%s' registered",
-                             methodCall.data());
-               response.setMethod(methodCall);
-               response.setFault(UNREGISTERED_METHOD_FAULT_CODE, UNREGISTERED_METHOD_FAULT_STRING);
-               result = false;
+                             "XmlRpcDispatch::parseXmlRpcRequest %s of: %s",
+                             errorLoc, requestContent.data());
+               faultCode = EMPTY_PARAM_VALUE_FAULT_CODE;
+               faultMsg = errorLoc;
             }
          }
-         else
-         {
-            UtlString faultMsg(INVALID_ELEMENT_FAULT_STRING);
-            faultMsg.append("methodName not found");
-            Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
-                          "XmlRpcDispatch::parseXmlRpcRequest %s", faultMsg.data());
-            response.setFault(INVALID_ELEMENT, faultMsg.data());
-            result = false;
-         }
       }
       else
       {
-         UtlString faultMsg(INVALID_ELEMENT_FAULT_STRING);
+         parser.skipElement();
+      }
+   }
+
+   if (faultCode == 0)
+   {
+      if (parser.getEvent() == XmlPullParser::ERROR)
+      {
+         Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
+                       "XmlRpcDispatch::parseXmlRpcRequest"
+                       " ill-formed XML contents in %s. Parsing error = %s",
+                       requestContent.data(), parser.getError());
+         faultCode = ILL_FORMED_CONTENTS_FAULT_CODE;
+         faultMsg = ILL_FORMED_CONTENTS_FAULT_STRING;
+      }
+      else if (!hasMethodCall)
+      {
+         faultMsg = INVALID_ELEMENT_FAULT_STRING;
          faultMsg.append("methodCall not found");
          Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
                        "XmlRpcDispatch::parseXmlRpcRequest %s", faultMsg.data());
-         response.setFault(INVALID_ELEMENT, faultMsg.data());
-         result = false;
+         faultCode = INVALID_ELEMENT;
+      }
+      else if (!hasMethodName)
+      {
+         faultMsg = INVALID_ELEMENT_FAULT_STRING;
+         faultMsg.append("methodName not found");
+         Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
+                       "XmlRpcDispatch::parseXmlRpcRequest %s", faultMsg.data());
+         faultCode = INVALID_ELEMENT;
+      }
+      else if (!hasParams)
+      {
+         Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
+                       "XmlRpcDispatch::parseXmlRpcRequest no <params> element found");
+         response.setMethod(methodCall);
+         faultCode = ILL_FORMED_CONTENTS_FAULT_CODE;
+         faultMsg = "no <params> element";
       }
    }
-   else
+
+   if (faultCode != 0)
    {
-      Os::Logger::instance().log(FAC_XMLRPC, PRI_ERR,
-                    "XmlRpcDispatch::parseXmlRpcRequest"
-                    " ill-formed XML contents in %s. Parsing error = %s",
-                     requestContent.data(), doc.ErrorDesc());
-      response.setFault(ILL_FORMED_CONTENTS_FAULT_CODE, ILL_FORMED_CONTENTS_FAULT_STRING);
-      result = false;
+      response.setFault(faultCode, faultMsg.data());
+      XmlRpcBody::deallocateContainedValues(&params);
    }
 
-   return result;
+   return faultCode == 0;
 }
 
 /* //////////////////////////// PRIVATE /////////////////////////////////// */
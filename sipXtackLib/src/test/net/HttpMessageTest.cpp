@@ -12,6 +12,8 @@
 #include <sipxunit/TestUtilities.h>
 
 #include <os/OsDefs.h>
+#include <os/OsConnectionSocket.h>
+#include <os/OsServerSocket.h>
 #include <net/HttpMessage.h>
 #include <net/SdpBody.h>
 
@@ -30,6 +32,8 @@ class HttpMessageTest : public CppUnit::TestCase
     CPPUNIT_TEST(testEscape);
     CPPUNIT_TEST(testGetAuthenticateField);
     CPPUNIT_TEST(testGetAcceptField);
+    CPPUNIT_TEST(testFindHeaderEnd);
+    CPPUNIT_TEST(testReadStream);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -658,6 +662,78 @@ public:
          ASSERT_STR_EQUAL("foo, bar,baz", v.data());
       }
 
+   void testFindHeaderEnd()
+      {
+         const char* message =
+            "SIP/2.0 200 OK\r\n"
+            "Via: SIP/2.0/TCP 10.139.33.244;branch=z9hG4bKac1198312375\r\n"
+            "Content-Length: 4\r\n"
+            "\r\n"
+            "body";
+         ssize_t headerEnd = strlen(message) - 4;
+
+         CPPUNIT_ASSERT_EQUAL(headerEnd, HttpMessage::findHeaderEnd(message, strlen(message)));
+         CPPUNIT_ASSERT_EQUAL(HTTP_NOT_FOUND, HttpMessage::findHeaderEnd(message, headerEnd - 2));
+
+         // As read from a stream, a few bytes at a time; the CR of the
+         // blank line alone does not end the headers.
+         ssize_t lineStart = 0;
+         ssize_t length;
+         for (length = 0; length < headerEnd - 1; length += 3)
+         {
+            CPPUNIT_ASSERT_EQUAL(HTTP_NOT_FOUND,
+                                 HttpMessage::findHeaderEnd(message, length, lineStart));
+         }
+         CPPUNIT_ASSERT_EQUAL(HTTP_NOT_FOUND,
+                              HttpMessage::findHeaderEnd(message, headerEnd - 1, lineStart));
+         CPPUNIT_ASSERT_EQUAL(headerEnd,
+                              HttpMessage::findHeaderEnd(message, headerEnd, lineStart));
+
+         // Header names are matched ignoring case.
+         HttpMessage m(message, strlen(message));
+         ASSERT_STR_EQUAL("4", m.getHeaderValue(0, "content-length"));
+         ASSERT_STR_EQUAL("4", m.getHeaderValue(0, "Content-Length"));
+         CPPUNIT_ASSERT(m.getHeaderValue(0, "Content-Lengt") == NULL);
+      }
+
+   void testReadStream()
+      {
+         const char* message =
+            "SIP/2.0 200 OK\r\n"
+            "Via: SIP/2.0/TCP 10.139.33.244;branch=z9hG4bKac1198312375\r\n"
+            "Content-Length: 4\r\n"
+            "\r\n"
+            "body";
+         ssize_t messageLength = strlen(message);
+         ssize_t headerEnd = messageLength - 4;
+
+         // Read sizes that end the first read on the CR of the blank line,
+         // and that take the message a few bytes at a time.
+         ssize_t bufferSizes[] = { headerEnd - 1, 7 };
+         for (size_t i = 0; i < sizeof (bufferSizes) / sizeof (bufferSizes[0]); i++)
+         {
+            OsServerSocket server(1, PORT_DEFAULT, "127.0.0.1");
+            OsConnectionSocket client(server.getLocalHostPort(), "127.0.0.1");
+            OsConnectionSocket* stream = server.accept();
+            CPPUNIT_ASSERT(stream);
+            CPPUNIT_ASSERT_EQUAL((int) messageLength, client.write(message, messageLength));
+
+            HttpMessage m;
+            UtlString buffer;
+            CPPUNIT_ASSERT_EQUAL((int) messageLength, m.read(stream, bufferSizes[i], &buffer));
+            ASSERT_STR_EQUAL("4", m.getHeaderValue(0, HTTP_CONTENT_LENGTH_FIELD));
+
+            UtlString body;
+            ssize_t length;
+            CPPUNIT_ASSERT(m.getBody());
+            m.getBody()->getBytes(&body, &length);
+            ASSERT_STR_EQUAL("body", body.data());
+
+            stream->close();
+            delete stream;
+         }
+      }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(HttpMessageTest);
@@ -0,0 +1,294 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Rate of XML-RPC requests an HttpServer answers on keep-alive connections.
+//
+// CLIENTS clients (1000 by default) connect to an XmlRpcDispatch on the
+// loopback interface and keep their connections open while each of them
+// makes REQUESTS calls (100 by default) of a method that echoes its string
+// parameter.  The clients are driven from one thread with epoll, so the
+// test measures the server rather than the clients.  It runs twice:
+//
+//    keepalive  each client sends a request when it has the last response
+//    pipelined  each client sends PIPELINE requests without waiting
+//
+//    HttpServerPerformance [clients] [requests]
+//
+// The open file limit (ulimit -n) must allow two descriptors per client.
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// APPLICATION INCLUDES
+#include "net/HttpServer.h"
+#include "net/XmlRpcDispatch.h"
+#include "net/XmlRpcMethod.h"
+#include "net/XmlRpcResponse.h"
+#include "os/OsDateTime.h"
+#include "os/OsServerSocket.h"
+#include "os/OsTask.h"
+#include "os/OsTime.h"
+#include "utl/UtlSList.h"
+#include "utl/UtlString.h"
+
+// CONSTANTS
+#define DEFAULT_CLIENTS  1000
+#define DEFAULT_REQUESTS 100
+#define PIPELINE         4
+#define LISTEN_QUEUE     1024
+#define WAIT_MSECS       30000
+
+class Echo : public XmlRpcMethod
+{
+public:
+
+   static XmlRpcMethod* get()
+   {
+      return new Echo();
+   }
+
+   virtual ~Echo()
+   {
+   }
+
+   bool execute(const HttpRequestContext& context,
+                UtlSList& params,
+                void* userData,
+                XmlRpcResponse& response,
+                XmlRpcMethod::ExecutionStatus& status)
+   {
+      UtlString* text = dynamic_cast<UtlString*>(params.at(0));
+      UtlString responseText(text ? text->data() : "");
+      response.setResponse(&responseText);
+      status = XmlRpcMethod::OK;
+      return true;
+   }
+
+private:
+
+   Echo()
+   {
+   }
+};
+
+struct Client
+{
+   int fd;
+   int sent;       ///< requests written completely
+   size_t written; ///< bytes of the current request written
+   int answered;   ///< responses read
+   UtlString input;
+};
+
+static UtlString gRequest;
+
+// Remove complete responses from the front of input, returning how many there were.
+static int takeResponses(UtlString& input)
+{
+   int responses = 0;
+   ssize_t headerEnd;
+   while ((headerEnd = input.index("\r\n\r\n")) != UTL_NOT_FOUND)
+   {
+      ssize_t lengthField = input.index("Content-Length:", 0, UtlString::ignoreCase);
+      size_t contentLength =
+         lengthField != UTL_NOT_FOUND && lengthField < headerEnd
+         ? atoi(input.data() + lengthField + strlen("Content-Length:"))
+         : 0;
+      size_t responseLength = headerEnd + 4 + contentLength;
+      if (input.length() < responseLength)
+      {
+         break;
+      }
+      input.remove(0, responseLength);
+      responses++;
+   }
+   return responses;
+}
+
+// Write requests until the client has PIPELINE (or depth) outstanding; false on error.
+static bool sendRequests(Client& client, int depth, int requests)
+{
+   while (client.sent < requests && client.sent - client.answered < depth)
+   {
+      ssize_t bytes = send(client.fd, gRequest.data() + client.written,
+                           gRequest.length() - client.written, MSG_NOSIGNAL);
+      if (bytes < 0)
+      {
+         return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      client.written += bytes;
+      if (client.written == gRequest.length())
+      {
+         client.written = 0;
+         client.sent++;
+      }
+   }
+   return true;
+}
+
+static void run(const char* name, int port, int clients, int requests, int depth)
+{
+   int epollFd = epoll_create1(0);
+   Client* client = new Client[clients];
+
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port = htons(port);
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   OsTime start;
+   OsDateTime::getCurTimeSinceBoot(start);
+
+   int open = 0;
+   for (int c = 0; c < clients; c++)
+   {
+      client[c].fd = socket(AF_INET, SOCK_STREAM, 0);
+      client[c].sent = 0;
+      client[c].written = 0;
+      client[c].answered = 0;
+      fcntl(client[c].fd, F_SETFL, O_NONBLOCK);
+      if (   connect(client[c].fd, (struct sockaddr*) &address, sizeof(address)) < 0
+          && errno != EINPROGRESS)
+      {
+         fprintf(stderr, "client %d: connect failed: %s\n", c, strerror(errno));
+         close(client[c].fd);
+         client[c].fd = -1;
+         continue;
+      }
+
+      struct epoll_event event;
+      event.events = EPOLLIN | EPOLLOUT;
+      event.data.u32 = c;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, client[c].fd, &event);
+      open++;
+   }
+
+   int answered = 0;
+   int failed = clients - open;
+   struct epoll_event events[256];
+   while (open > 0)
+   {
+      int count = epoll_wait(epollFd, events, 256, WAIT_MSECS);
+      if (count == 0)
+      {
+         fprintf(stderr, "no response in %d ms with %d clients open\n", WAIT_MSECS, open);
+         break;
+      }
+
+      for (int i = 0; i < count; i++)
+      {
+         Client& c = client[events[i].data.u32];
+         bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP));
+
+         if (ok && (events[i].events & EPOLLIN))
+         {
+            char buffer[16384];
+            ssize_t bytes;
+            while ((bytes = read(c.fd, buffer, sizeof(buffer))) > 0)
+            {
+               c.input.append(buffer, bytes);
+            }
+            ok = bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            int responses = takeResponses(c.input);
+            c.answered += responses;
+            answered += responses;
+         }
+
+         if (ok && c.answered < requests)
+         {
+            ok = sendRequests(c, depth, requests);
+
+            // only wait to write while a request is partly written
+            struct epoll_event event;
+            event.events = EPOLLIN | (c.written > 0 ? EPOLLOUT : 0);
+            event.data.u32 = events[i].data.u32;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &event);
+         }
+
+         if (!ok || c.answered >= requests)
+         {
+            if (!ok)
+            {
+               failed++;
+            }
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, c.fd, NULL);
+            close(c.fd);
+            c.fd = -1;
+            open--;
+         }
+      }
+   }
+
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+
+   printf("%-10s %5d clients %8d requests %8.3f s %10.0f requests/s %5d failed\n",
+          name, clients, answered, seconds,
+          seconds > 0 ? answered / seconds : 0.0, failed);
+
+   for (int c = 0; c < clients; c++)
+   {
+      if (client[c].fd >= 0)
+      {
+         close(client[c].fd);
+      }
+   }
+   delete [] client;
+   close(epollFd);
+}
+
+int main(int argc, char* argv[])
+{
+   int clients = argc > 1 ? atoi(argv[1]) : DEFAULT_CLIENTS;
+   int requests = argc > 2 ? atoi(argv[2]) : DEFAULT_REQUESTS;
+
+   OsServerSocket* serverSocket = new OsServerSocket(LISTEN_QUEUE, PORT_DEFAULT, "127.0.0.1");
+   HttpServer* server = new HttpServer(serverSocket, NULL, true);
+   XmlRpcDispatch* dispatch = new XmlRpcDispatch(server, "/RPC2");
+   dispatch->addMethod("echo", Echo::get);
+   server->start();
+
+   const char* body =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<methodCall>\n"
+      "<methodName>echo</methodName>\n"
+      "<params>\n"
+      "<param><value><string>HttpServerPerformance</string></value></param>\n"
+      "</params>\n"
+      "</methodCall>\n";
+   gRequest = "POST /RPC2 HTTP/1.1\r\n"
+              "Host: 127.0.0.1\r\n"
+              "Content-Type: text/xml\r\n"
+              "Content-Length: ";
+   gRequest.appendNumber((int) strlen(body));
+   gRequest.append("\r\n\r\n");
+   gRequest.append(body);
+
+   int port = serverSocket->getLocalHostPort();
+   run("keepalive", port, clients, requests, 1);
+   run("pipelined", port, clients, requests, PIPELINE);
+
+   server->requestShutdown();
+   delete server;
+   delete dispatch;
+   delete serverSocket;
+
+   return 0;
+}
@@ -11,10 +11,27 @@
 #include <cppunit/TestCase.h>
 #include "sipxunit/TestUtilities.h"
 
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "os/OsBSem.h"
 #include "os/OsDefs.h"
+#include "os/OsLock.h"
+#include "os/OsMutex.h"
+#include "os/OsServerSocket.h"
+#include "os/OsTask.h"
+#include "net/HttpBody.h"
+#include "net/HttpMessage.h"
 #include "net/HttpServer.h"
 #include "net/HttpService.h"
 
+#define LOOP_WAIT_SECS       5
+#define LOOP_SETTLE_MSECS    500
+#define LARGE_RESPONSE_BYTES (8 * 1024 * 1024)
+
 class TestHttpService : public HttpService
 {
    void processRequest(const HttpRequestContext& requestContext,
@@ -26,6 +43,168 @@ class TestHttpService : public HttpService
       }
 };
 
+/// Answers each request with its URI, or with LARGE_RESPONSE_BYTES for /loop/large;
+/// /loop/block waits for release().
+class LoopTestService : public HttpService
+{
+public:
+
+   LoopTestService() :
+      mEntered(OsBSem::Q_PRIORITY, OsBSem::EMPTY),
+      mRelease(OsBSem::Q_PRIORITY, OsBSem::EMPTY),
+      mMutex(OsMutex::Q_FIFO),
+      mCalls(0)
+      {
+      }
+
+   void processRequest(const HttpRequestContext& requestContext,
+                       const HttpMessage& request,
+                       HttpMessage*& response
+                       )
+      {
+         UtlString uri;
+         request.getRequestUri(&uri);
+         {
+            OsLock lock(mMutex);
+            mCalls++;
+         }
+
+         if (uri.compareTo("/loop/block") == 0)
+         {
+            mEntered.release();
+            mRelease.acquire();
+         }
+
+         UtlString body;
+         if (uri.compareTo("/loop/large") == 0)
+         {
+            for (int i = 0; i < LARGE_RESPONSE_BYTES; i++)
+            {
+               body.append((char) ('a' + i % 26));
+            }
+         }
+         else
+         {
+            body = uri;
+         }
+
+         response = new HttpMessage();
+         response->setResponseFirstHeaderLine(HTTP_PROTOCOL_VERSION_1_1,
+                                              HTTP_OK_CODE, HTTP_OK_TEXT);
+         response->setBody(new HttpBody(body.data(), body.length()));
+         response->setContentLength(body.length());
+      }
+
+   /// Wait until a /loop/block request is being processed.
+   bool waitForBlocked()
+      {
+         return mEntered.acquire(OsTime(LOOP_WAIT_SECS, 0)) == OS_SUCCESS;
+      }
+
+   /// Let the /loop/block request finish.
+   void release()
+      {
+         mRelease.release();
+      }
+
+   int calls()
+      {
+         OsLock lock(mMutex);
+         return mCalls;
+      }
+
+private:
+   OsBSem  mEntered;
+   OsBSem  mRelease;
+   OsMutex mMutex;
+   int     mCalls;
+};
+
+// A blocking loopback connection to port whose reads time out.
+static int connectTo(int port, int receiveBuffer = 0)
+{
+   int fd = socket(AF_INET, SOCK_STREAM, 0);
+   struct timeval timeout = { LOOP_WAIT_SECS, 0 };
+   setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+   if (receiveBuffer)
+   {
+      setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof(receiveBuffer));
+   }
+
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port = htons(port);
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   CPPUNIT_ASSERT(connect(fd, (struct sockaddr*) &address, sizeof(address)) == 0);
+   return fd;
+}
+
+static void sendAll(int fd, const char* bytes, size_t length)
+{
+   while (length > 0)
+   {
+      ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+      CPPUNIT_ASSERT(sent > 0);
+      bytes += sent;
+      length -= sent;
+   }
+}
+
+static void sendAll(int fd, const char* bytes)
+{
+   sendAll(fd, bytes, strlen(bytes));
+}
+
+// Take the next response on fd from input, reading as needed; false at end of input.
+static bool readResponse(int fd, UtlString& input, HttpMessage& response)
+{
+   while (true)
+   {
+      ssize_t headerEnd = input.index("\r\n\r\n");
+      if (headerEnd != UTL_NOT_FOUND)
+      {
+         ssize_t lengthField = input.index("Content-Length:", 0, UtlString::ignoreCase);
+         size_t contentLength =
+            lengthField != UTL_NOT_FOUND && lengthField < headerEnd
+            ? atoi(input.data() + lengthField + strlen("Content-Length:"))
+            : 0;
+         size_t responseLength = headerEnd + 4 + contentLength;
+         if (input.length() >= responseLength)
+         {
+            response = HttpMessage(input.data(), responseLength);
+            input.remove(0, responseLength);
+            return true;
+         }
+      }
+
+      char buffer[16384];
+      ssize_t bytes = recv(fd, buffer, sizeof(buffer), 0);
+      if (bytes <= 0)
+      {
+         return false;
+      }
+      input.append(buffer, bytes);
+   }
+}
+
+static UtlString bodyOf(const HttpMessage& response)
+{
+   UtlString body;
+   ssize_t length;
+   if (response.getBody())
+   {
+      response.getBody()->getBytes(&body, &length);
+   }
+   return body;
+}
+
+// Whether the server has closed fd, rather than the read timing out.
+static bool isClosed(int fd)
+{
+   char buffer[1];
+   return recv(fd, buffer, sizeof(buffer), 0) == 0;
+}
 
 /**
  * Unit tests for HttpServer methods
@@ -40,7 +219,13 @@ class HttpServerTest : public CppUnit::TestCase
    CPPUNIT_TEST(testMapUriEndSep);
    CPPUNIT_TEST(testMapUriToNull);
    CPPUNIT_TEST(testFindHttpService);
-   
+   CPPUNIT_TEST(testLoopPartialSend);
+   CPPUNIT_TEST(testLoopPipelined);
+   CPPUNIT_TEST(testLoopPeerCloseMidRequest);
+   CPPUNIT_TEST(testLoopRequestTooLarge);
+   CPPUNIT_TEST(testLoopConnectionLimit);
+   CPPUNIT_TEST(testLoopQueueLimit);
+
    CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -205,6 +390,223 @@ public:
          CPPUNIT_ASSERT(httpServer.findHttpService("/one/two_extra", foundService));
          CPPUNIT_ASSERT(&testServiceOne == foundService);
       } 
+
+   // A response larger than the socket takes is finished when the client reads,
+   // and the request pipelined behind it is answered after it.
+   void testLoopPartialSend()
+      {
+         OsServerSocket serverSocket(64, PORT_DEFAULT, "127.0.0.1");
+         LoopTestService service;
+         HttpServer server(&serverSocket, NULL, true);
+         server.addHttpService("/loop", &service);
+         server.start();
+
+         int fd = connectTo(serverSocket.getLocalHostPort(), 4096);
+         sendAll(fd,
+                 "GET /loop/large HTTP/1.1\r\n\r\n"
+                 "GET /loop/after HTTP/1.1\r\n\r\n");
+
+         // let the server fill the socket and wait for it to drain
+         OsTask::delay(LOOP_SETTLE_MSECS);
+
+         UtlString input;
+         HttpMessage response;
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         CPPUNIT_ASSERT_EQUAL(HTTP_OK_CODE, response.getResponseStatusCode());
+         UtlString body(bodyOf(response));
+         CPPUNIT_ASSERT_EQUAL((size_t) LARGE_RESPONSE_BYTES, body.length());
+         CPPUNIT_ASSERT_EQUAL('a', body(0));
+         CPPUNIT_ASSERT_EQUAL((char) ('a' + (LARGE_RESPONSE_BYTES - 1) % 26),
+                              body(LARGE_RESPONSE_BYTES - 1));
+
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         ASSERT_STR_EQUAL("/loop/after", bodyOf(response).data());
+
+         close(fd);
+      }
+
+   // Requests sent together are answered in order, and the connection
+   // is closed after the one that asks for it.
+   void testLoopPipelined()
+      {
+         OsServerSocket serverSocket(64, PORT_DEFAULT, "127.0.0.1");
+         LoopTestService service;
+         HttpServer server(&serverSocket, NULL, true);
+         server.addHttpService("/loop", &service);
+         server.start();
+
+         int fd = connectTo(serverSocket.getLocalHostPort());
+         sendAll(fd,
+                 "GET /loop/1 HTTP/1.1\r\n\r\n"
+                 "\r\n"
+                 "POST /loop/2 HTTP/1.1\r\nContent-Length: 4\r\n\r\nbody"
+                 "GET /loop/3 HTTP/1.1\r\nConnection: close\r\n\r\n");
+
+         UtlString input;
+         HttpMessage response;
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         ASSERT_STR_EQUAL("/loop/1", bodyOf(response).data());
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         ASSERT_STR_EQUAL("/loop/2", bodyOf(response).data());
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         ASSERT_STR_EQUAL("/loop/3", bodyOf(response).data());
+         ASSERT_STR_EQUAL("close", response.getHeaderValue(0, "Connection"));
+
+         CPPUNIT_ASSERT(input.isNull());
+         CPPUNIT_ASSERT(isClosed(fd));
+         CPPUNIT_ASSERT_EQUAL(3, service.calls());
+
+         close(fd);
+      }
+
+   // A client that shuts down in the middle of a request is closed without
+   // a response, and the server goes on serving others.
+   void testLoopPeerCloseMidRequest()
+      {
+         OsServerSocket serverSocket(64, PORT_DEFAULT, "127.0.0.1");
+         LoopTestService service;
+         HttpServer server(&serverSocket, NULL, true);
+         server.addHttpService("/loop", &service);
+         server.start();
+
+         int fd = connectTo(serverSocket.getLocalHostPort());
+         sendAll(fd, "POST /loop/partial HTTP/1.1\r\nContent-Length: 100\r\n\r\nabc");
+         shutdown(fd, SHUT_WR);
+         CPPUNIT_ASSERT(isClosed(fd));
+         close(fd);
+
+         fd = connectTo(serverSocket.getLocalHostPort());
+         sendAll(fd, "GET /loop/next HTTP/1.1\r\n\r\n");
+         UtlString input;
+         HttpMessage response;
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         ASSERT_STR_EQUAL("/loop/next", bodyOf(response).data());
+         CPPUNIT_ASSERT_EQUAL(1, service.calls());
+
+         close(fd);
+      }
+
+   // A request longer than the limit is answered 413 and the rest of it is not read.
+   void testLoopRequestTooLarge()
+      {
+         OsServerSocket serverSocket(64, PORT_DEFAULT, "127.0.0.1");
+         LoopTestService service;
+         HttpServer server(&serverSocket, NULL, true);
+         server.mMaxRequestBytes = 4096;
+         server.addHttpService("/loop", &service);
+         server.start();
+
+         // a Content-Length over the limit
+         int fd = connectTo(serverSocket.getLocalHostPort());
+         sendAll(fd, "POST /loop/big HTTP/1.1\r\nContent-Length: 100000\r\n\r\n");
+         UtlString input;
+         HttpMessage response;
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         CPPUNIT_ASSERT_EQUAL(413, response.getResponseStatusCode());
+         CPPUNIT_ASSERT(isClosed(fd));
+         close(fd);
+
+         // headers that do not end within the limit
+         fd = connectTo(serverSocket.getLocalHostPort());
+         UtlString request("GET /loop/big HTTP/1.1\r\nX-Padding: ");
+         while (request.length() < server.mMaxRequestBytes)
+         {
+            request.append('x');
+         }
+         sendAll(fd, request.data(), request.length());
+         input.remove(0);
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         CPPUNIT_ASSERT_EQUAL(413, response.getResponseStatusCode());
+         CPPUNIT_ASSERT(isClosed(fd));
+         close(fd);
+
+         CPPUNIT_ASSERT_EQUAL(0, service.calls());
+      }
+
+   // A connection over the limit is answered 503 and closed.
+   void testLoopConnectionLimit()
+      {
+         OsServerSocket serverSocket(64, PORT_DEFAULT, "127.0.0.1");
+         LoopTestService service;
+         HttpServer server(&serverSocket, NULL, true);
+         server.mMaxConnections = 1;
+         server.addHttpService("/loop", &service);
+         server.start();
+
+         int fd = connectTo(serverSocket.getLocalHostPort());
+         sendAll(fd, "GET /loop/1 HTTP/1.1\r\n\r\n");
+         UtlString input;
+         HttpMessage response;
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         CPPUNIT_ASSERT_EQUAL(HTTP_OK_CODE, response.getResponseStatusCode());
+
+         int overFd = connectTo(serverSocket.getLocalHostPort());
+         UtlString overInput;
+         CPPUNIT_ASSERT(readResponse(overFd, overInput, response));
+         CPPUNIT_ASSERT_EQUAL(HTTP_OUT_OF_RESOURCES_CODE, response.getResponseStatusCode());
+         CPPUNIT_ASSERT(isClosed(overFd));
+         close(overFd);
+
+         // the first connection is still served
+         sendAll(fd, "GET /loop/2 HTTP/1.1\r\n\r\n");
+         CPPUNIT_ASSERT(readResponse(fd, input, response));
+         ASSERT_STR_EQUAL("/loop/2", bodyOf(response).data());
+         close(fd);
+      }
+
+   // Requests beyond those the handler queue holds are answered 503.
+   void testLoopQueueLimit()
+      {
+         OsServerSocket serverSocket(64, PORT_DEFAULT, "127.0.0.1");
+         LoopTestService service;
+         // one handler thread
+         HttpServer server(&serverSocket, NULL, false);
+         server.mMaxQueuedRequests = 1;
+         server.addHttpService("/loop", &service);
+         server.start();
+
+         int blockedFd = connectTo(serverSocket.getLocalHostPort());
+         sendAll(blockedFd, "GET /loop/block HTTP/1.1\r\n\r\n");
+         CPPUNIT_ASSERT(service.waitForBlocked());
+
+         const int waiting = 4;
+         int fd[waiting];
+         for (int i = 0; i < waiting; i++)
+         {
+            fd[i] = connectTo(serverSocket.getLocalHostPort());
+            sendAll(fd[i], "GET /loop/queued HTTP/1.1\r\n\r\n");
+         }
+         OsTask::delay(LOOP_SETTLE_MSECS);
+         service.release();
+
+         UtlString input;
+         HttpMessage response;
+         CPPUNIT_ASSERT(readResponse(blockedFd, input, response));
+         ASSERT_STR_EQUAL("/loop/block", bodyOf(response).data());
+         close(blockedFd);
+
+         int served = 0;
+         int rejected = 0;
+         for (int i = 0; i < waiting; i++)
+         {
+            input.remove(0);
+            CPPUNIT_ASSERT(readResponse(fd[i], input, response));
+            if (response.getResponseStatusCode() == HTTP_OUT_OF_RESOURCES_CODE)
+            {
+               rejected++;
+            }
+            else
+            {
+               ASSERT_STR_EQUAL("/loop/queued", bodyOf(response).data());
+               served++;
+            }
+            CPPUNIT_ASSERT(isClosed(fd[i]));
+            close(fd[i]);
+         }
+         CPPUNIT_ASSERT(rejected > 0);
+         CPPUNIT_ASSERT(served > 0);
+         CPPUNIT_ASSERT_EQUAL(1 + served, service.calls());
+      }
 };
 
 
@@ -0,0 +1,488 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Time a SipUserAgent takes to fork an INVITE to FORKS contacts (50 by
+// default) of equal q-value, and to cancel the other branches when one
+// of them answers.
+//
+// For each of CALLS calls (20 by default) the user agent sends an INVITE
+// to a socket of this program on the loopback interface, which redirects
+// it with a 302 listing FORKS contacts at the same socket.  The time from
+// the send of the 302 to the receipt of the last branch INVITE is the
+// time to the last branch sent.  Every branch is answered with a 180, then
+// one with a 200; the time from the send of the 200 to the receipt of the
+// last CANCEL of the other branches is the CANCEL completion time.
+//
+// If NAMES is given, the contacts name NAMES hosts (host-0.fork.test and
+// so on) instead of 127.0.0.1, and the user agent looks them up at a
+// nameserver in this program that answers each A query with 127.0.0.1
+// after DNS_MSECS (20 by default), as a resolver a network round trip
+// away would.
+//
+//    SipForkPerformance [forks] [calls] [names] [dns-msecs]
+//
+// The figures include the loopback round trips, which are small next to
+// the time spent in the transaction layer.
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// APPLICATION INCLUDES
+#include "net/SipMessage.h"
+#include "net/SipSrvLookup.h"
+#include "net/SipUserAgent.h"
+#include "net/Url.h"
+#include "os/OsTask.h"
+#include "os/OsTime.h"
+#include "utl/UtlMetrics.h"
+#include "utl/UtlString.h"
+
+// CONSTANTS
+#define DEFAULT_FORKS    50
+#define DEFAULT_CALLS    20
+#define DEFAULT_DNS_MSECS 20
+#define WAIT_MSECS       2000
+#define SETTLE_MSECS     100
+#define BRANCH_USER      "branch-"
+
+// Microseconds on the monotonic clock.
+static double now()
+{
+   return (double) UtlMetricHistogram::now();
+}
+
+// A loopback UDP socket on a port chosen by the kernel.
+static int bindLoopback(int& port)
+{
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0)
+   {
+      fprintf(stderr, "binding failed: %s\n", strerror(errno));
+      exit(1);
+   }
+   socklen_t length = sizeof(address);
+   getsockname(fd, (struct sockaddr*) &address, &length);
+   port = ntohs(address.sin_port);
+
+   // Room for the bursts of branches.
+   int size = 4 * 1024 * 1024;
+   setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+   return fd;
+}
+
+// A loopback UDP port that nothing is bound to.
+static int freePort()
+{
+   int port;
+   close(bindLoopback(port));
+   return port;
+}
+
+// The nameserver: every A query on dnsFd is answered with 127.0.0.1
+// dnsMsecs after it arrives.  Other queries get an empty answer.
+static int dnsFd;
+static int dnsMsecs;
+
+struct DnsReply
+{
+   double due;
+   struct sockaddr_in to;
+   unsigned char bytes[512];
+   int length;
+};
+
+static bool dnsReply(const unsigned char* query, int length, DnsReply& reply)
+{
+   // Skip the name of the one question, then its type and class.
+   int end = 12;
+   while (end < length && query[end] != 0)
+   {
+      end += query[end] + 1;
+   }
+   end += 5;
+   if (end > length || end + 16 > (int) sizeof(reply.bytes))
+   {
+      return false;
+   }
+   bool isA = query[end - 4] == 0 && query[end - 3] == 1;
+
+   memcpy(reply.bytes, query, end);
+   reply.bytes[2] = 0x80 | (query[2] & 0x01);   // a response, recursion desired as asked
+   reply.bytes[3] = 0x80;                       // recursion available, no error
+   reply.bytes[4] = 0; reply.bytes[5] = 1;      // one question
+   reply.bytes[6] = 0; reply.bytes[7] = isA ? 1 : 0;
+   memset(reply.bytes + 8, 0, 4);               // no authority or additional records
+   reply.length = end;
+   if (isA)
+   {
+      static const unsigned char answer[16] =
+         { 0xc0, 0x0c,  0, 1,  0, 1,  0, 0, 0, 0,  0, 4,  127, 0, 0, 1 };
+      memcpy(reply.bytes + end, answer, sizeof(answer));
+      reply.length += sizeof(answer);
+   }
+   return true;
+}
+
+static void* answerQueries(void*)
+{
+   std::vector<DnsReply> pending;
+   for (;;)
+   {
+      int timeout = -1;
+      double time = now();
+      for (size_t i = 0; i < pending.size(); i++)
+      {
+         int wait = pending[i].due > time ? (int) ((pending[i].due - time) / 1000.0) + 1 : 0;
+         if (timeout < 0 || wait < timeout)
+         {
+            timeout = wait;
+         }
+      }
+
+      struct pollfd ready;
+      ready.fd = dnsFd;
+      ready.events = POLLIN;
+      ready.revents = 0;
+      if (poll(&ready, 1, timeout) > 0)
+      {
+         unsigned char query[512];
+         DnsReply reply;
+         socklen_t fromLength = sizeof(reply.to);
+         ssize_t length = recvfrom(dnsFd, query, sizeof(query), 0,
+                                   (struct sockaddr*) &reply.to, &fromLength);
+         if (length > 0 && dnsReply(query, length, reply))
+         {
+            reply.due = now() + dnsMsecs * 1000.0;
+            pending.push_back(reply);
+         }
+      }
+
+      time = now();
+      for (size_t i = 0; i < pending.size(); )
+      {
+         if (pending[i].due <= time)
+         {
+            sendto(dnsFd, pending[i].bytes, pending[i].length, 0,
+                   (struct sockaddr*) &pending[i].to, sizeof(pending[i].to));
+            pending.erase(pending.begin() + i);
+         }
+         else
+         {
+            i++;
+         }
+      }
+   }
+   return NULL;
+}
+
+// Wait up to msecs for a message on fd, and return it or NULL.
+static SipMessage* receive(int fd, int msecs)
+{
+   struct pollfd ready;
+   ready.fd = fd;
+   ready.events = POLLIN;
+   ready.revents = 0;
+   if (poll(&ready, 1, msecs) <= 0)
+   {
+      return NULL;
+   }
+
+   char buffer[16384];
+   ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+   if (length <= 0)
+   {
+      return NULL;
+   }
+   return new SipMessage(buffer, length);
+}
+
+static void sendTo(int fd, int port, const SipMessage& message)
+{
+   UtlString bytes;
+   ssize_t length;
+   message.getBytes(&bytes, &length);
+
+   struct sockaddr_in to;
+   memset(&to, 0, sizeof(to));
+   to.sin_family = AF_INET;
+   to.sin_port = htons(port);
+   to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   sendto(fd, bytes.data(), length, 0, (struct sockaddr*) &to, sizeof(to));
+}
+
+static void respond(int fd, int port, const SipMessage& request, int code, const char* text)
+{
+   SipMessage response;
+   response.setResponseData(&request, code, text);
+   if (code > SIP_TRYING_CODE)
+   {
+      response.setToFieldTag("fork");
+   }
+   sendTo(fd, port, response);
+}
+
+// The branch index of a request to a redirected contact, or -1.
+static int branchOf(const SipMessage& request)
+{
+   UtlString uri;
+   request.getRequestUri(&uri);
+   Url url(uri, TRUE);
+   UtlString user;
+   url.getUserId(user);
+   if (user.index(BRANCH_USER) != 0)
+   {
+      return -1;
+   }
+   return atoi(user.data() + strlen(BRANCH_USER));
+}
+
+// Drop whatever is still arriving, e.g. ACKs and retransmissions.
+static void drain(int fd)
+{
+   SipMessage* message;
+   while ((message = receive(fd, SETTLE_MSECS)))
+   {
+      delete message;
+   }
+}
+
+struct Call
+{
+   double forkMsecs;    // from the 302 to the last branch INVITE
+   double cancelMsecs;  // from the 200 to the last CANCEL
+   bool completed;
+};
+
+static Call call(SipUserAgent& userAgent, int fd, int port, int uaPort,
+                 int forks, int names, int n)
+{
+   Call result = { 0.0, 0.0, false };
+
+   UtlString target("sip:fork@127.0.0.1:");
+   target.appendNumber(port);
+   UtlString callId("fork-");
+   callId.appendNumber(n);
+
+   SipMessage invite;
+   invite.setRequestData(SIP_INVITE_METHOD, target, "<sip:caller@127.0.0.1>;tag=c",
+                         target, callId);
+   userAgent.send(invite);
+
+   // Redirect the INVITE to the branches.
+   SipMessage* request = NULL;
+   while ((request = receive(fd, WAIT_MSECS)))
+   {
+      UtlString method;
+      request->getRequestMethod(&method);
+      if (!request->isResponse() && method.compareTo(SIP_INVITE_METHOD) == 0)
+      {
+         break;
+      }
+      delete request;
+   }
+   if (!request)
+   {
+      fprintf(stderr, "call %d: no INVITE\n", n);
+      return result;
+   }
+
+   SipMessage redirect;
+   redirect.setResponseData(request, SIP_TEMPORARY_MOVE_CODE, SIP_TEMPORARY_MOVE_TEXT);
+   redirect.setToFieldTag("redirect");
+   for (int i = 0; i < forks; i++)
+   {
+      UtlString contact("<sip:" BRANCH_USER);
+      contact.appendNumber(i);
+      if (names > 0)
+      {
+         contact.append("@host-");
+         contact.appendNumber(i % names);
+         contact.append(".fork.test:");
+      }
+      else
+      {
+         contact.append("@127.0.0.1:");
+      }
+      contact.appendNumber(port);
+      contact.append(">");
+      redirect.addHeaderField(SIP_CONTACT_FIELD, contact);
+   }
+   delete request;
+
+   double start = now();
+   sendTo(fd, uaPort, redirect);
+
+   std::vector<SipMessage*> branches(forks, (SipMessage*) NULL);
+   int received = 0;
+   double last = start;
+   SipMessage* message;
+   while (received < forks && (message = receive(fd, WAIT_MSECS)))
+   {
+      UtlString method;
+      message->getRequestMethod(&method);
+      int branch = message->isResponse() ? -1 : branchOf(*message);
+      if (   method.compareTo(SIP_INVITE_METHOD) == 0
+          && branch >= 0 && branch < forks
+          && !branches[branch])
+      {
+         last = now();
+         branches[branch] = message;
+         received++;
+      }
+      else
+      {
+         delete message;
+      }
+   }
+   result.forkMsecs = (last - start) / 1000.0;
+
+   if (received == forks)
+   {
+      for (int i = 0; i < forks; i++)
+      {
+         respond(fd, uaPort, *branches[i], SIP_RINGING_CODE, SIP_RINGING_TEXT);
+      }
+      // Let the 180s be processed, so that every branch can be canceled.
+      OsTask::delay(SETTLE_MSECS);
+
+      start = now();
+      respond(fd, uaPort, *branches[0], SIP_OK_CODE, SIP_OK_TEXT);
+
+      std::vector<bool> canceled(forks, false);
+      int cancels = 0;
+      last = start;
+      while (cancels < forks - 1 && (message = receive(fd, WAIT_MSECS)))
+      {
+         UtlString method;
+         message->getRequestMethod(&method);
+         int branch = message->isResponse() ? -1 : branchOf(*message);
+         if (   method.compareTo(SIP_CANCEL_METHOD) == 0
+             && branch > 0 && branch < forks)
+         {
+            respond(fd, uaPort, *message, SIP_OK_CODE, SIP_OK_TEXT);
+            if (!canceled[branch])
+            {
+               last = now();
+               canceled[branch] = true;
+               cancels++;
+            }
+         }
+         delete message;
+      }
+      result.cancelMsecs = (last - start) / 1000.0;
+      result.completed = cancels == forks - 1;
+
+      for (int i = 1; i < forks; i++)
+      {
+         respond(fd, uaPort, *branches[i], SIP_REQUEST_TERMINATED_CODE, SIP_REQUEST_TERMINATED_TEXT);
+      }
+   }
+   else
+   {
+      fprintf(stderr, "call %d: %d of %d branches\n", n, received, forks);
+   }
+
+   for (int i = 0; i < forks; i++)
+   {
+      delete branches[i];
+   }
+   drain(fd);
+   return result;
+}
+
+static void report(const char* name, std::vector<double>& msecs)
+{
+   if (msecs.empty())
+   {
+      printf("%-26s no calls completed\n", name);
+      return;
+   }
+   std::sort(msecs.begin(), msecs.end());
+   printf("%-26s median %8.3f ms  p90 %8.3f ms  max %8.3f ms\n",
+          name,
+          msecs[msecs.size() / 2],
+          msecs[(msecs.size() * 9) / 10],
+          msecs.back());
+}
+
+int main(int argc, char* argv[])
+{
+   int forks = argc > 1 ? atoi(argv[1]) : DEFAULT_FORKS;
+   int calls = argc > 2 ? atoi(argv[2]) : DEFAULT_CALLS;
+   int names = argc > 3 ? atoi(argv[3]) : 0;
+   dnsMsecs = argc > 4 ? atoi(argv[4]) : DEFAULT_DNS_MSECS;
+   if (forks < 2)
+   {
+      forks = 2;
+   }
+
+   int port;
+   int fd = bindLoopback(port);
+   int uaPort = freePort();
+
+   if (names > 0)
+   {
+      int dnsPort;
+      dnsFd = bindLoopback(dnsPort);
+      SipSrvLookup::set_nameserver_address("127.0.0.1", dnsPort);
+      pthread_t nameserver;
+      pthread_create(&nameserver, NULL, answerQueries, NULL);
+   }
+
+   SipUserAgent userAgent(PORT_NONE, uaPort, PORT_NONE,
+                          "127.0.0.1", NULL, "127.0.0.1");
+   userAgent.start();
+
+   std::vector<double> forkMsecs;
+   std::vector<double> cancelMsecs;
+   int failed = 0;
+   for (int n = 0; n < calls; n++)
+   {
+      Call result = call(userAgent, fd, port, uaPort, forks, names, n);
+      if (result.completed)
+      {
+         forkMsecs.push_back(result.forkMsecs);
+         cancelMsecs.push_back(result.cancelMsecs);
+      }
+      else
+      {
+         failed++;
+      }
+   }
+
+   if (names > 0)
+   {
+      printf("%d calls forked to %d contacts on %d names (%d ms DNS), %d failed\n",
+             calls, forks, names, dnsMsecs, failed);
+   }
+   else
+   {
+      printf("%d calls forked to %d contacts, %d failed\n", calls, forks, failed);
+   }
+   report("time to last branch sent", forkMsecs);
+   report("CANCEL completion", cancelMsecs);
+
+   userAgent.shutdown(TRUE);
+   close(fd);
+   return 0;
+}
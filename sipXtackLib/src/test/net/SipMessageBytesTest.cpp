@@ -0,0 +1,219 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <string.h>
+#include <boost/shared_ptr.hpp>
+
+#include <net/HttpBody.h>
+#include <net/SipMessage.h>
+#include <utl/UtlString.h>
+
+static const char* gInvite =
+   "INVITE sip:user@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-1\r\n"
+   "Route: <sip:10.0.0.2;lr>, <sip:10.0.0.3;lr>\r\n"
+   "Max-Forwards: 70\r\n"
+   "To: <sip:user@example.com>\r\n"
+   "From: <sip:caller@example.com>;tag=1\r\n"
+   "Call-Id: bytes-test-1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "CONTACT: <sip:caller@10.1.1.1>\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+/**
+ * Unit tests for the serialization SipMessage keeps between changes.
+ */
+class SipMessageBytesTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipMessageBytesTest);
+
+   CPPUNIT_TEST(testUnchanged);
+   CPPUNIT_TEST(testProxyEdits);
+   CPPUNIT_TEST(testBodyLength);
+   CPPUNIT_TEST(testHeaderBytes);
+   CPPUNIT_TEST(testCopy);
+   CPPUNIT_TEST(testSerializeHeaders);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   // What bytes serialize to when nothing of them was serialized before.
+   static UtlString reserialized(const UtlString& bytes)
+   {
+      SipMessage parsed(bytes.data(), bytes.length());
+      parsed.serializeHeaders();
+      UtlString again;
+      ssize_t length;
+      parsed.getBytes(&again, &length);
+      return again;
+   }
+
+   void testUnchanged()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      UtlString first;
+      ssize_t length;
+      message.getBytes(&first, &length);
+      UtlString stale(first);
+      message.serializeHeaders();
+      message.getBytes(&first, &length);
+      ASSERT_STR_EQUAL(stale.data(), first.data());
+      CPPUNIT_ASSERT_EQUAL((ssize_t) first.length(), length);
+      CPPUNIT_ASSERT(first.index("Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-1\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(first.index("Contact: <sip:caller@10.1.1.1>\r\n") != UTL_NOT_FOUND);
+
+      UtlString second;
+      message.getBytes(&second, &length);
+      ASSERT_STR_EQUAL(first.data(), second.data());
+      ASSERT_STR_EQUAL(first.data(), reserialized(first).data());
+   }
+
+   void testProxyEdits()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      UtlString bytes;
+      ssize_t length;
+      message.serializeHeaders();
+
+      // what a proxy does to a request it forwards
+      UtlString route;
+      CPPUNIT_ASSERT(message.removeRouteUri(0, &route));
+      message.decrementMaxForwards();
+      message.addRecordRouteUri("<sip:10.0.0.2;lr>");
+      message.addViaField("SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK-2");
+      message.serializeHeaders();
+      message.getBytes(&bytes, &length);
+
+      ASSERT_STR_EQUAL(bytes.data(), reserialized(bytes).data());
+      CPPUNIT_ASSERT(bytes.index("Route: <sip:10.0.0.3;lr>\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(bytes.index("10.0.0.2;lr>, ") == UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(bytes.index("Max-Forwards: 69\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(bytes.index("Record-Route: <sip:10.0.0.2;lr>\r\n") != UTL_NOT_FOUND);
+      ssize_t pushedVia = bytes.index("Via: SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK-2\r\n");
+      ssize_t receivedVia = bytes.index("Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-1\r\n");
+      CPPUNIT_ASSERT(pushedVia != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(receivedVia != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(pushedVia < receivedVia);
+      CPPUNIT_ASSERT(bytes.index("Call-Id: bytes-test-1\r\n") != UTL_NOT_FOUND);
+
+      // and what it does to one more hop
+      message.removeTopVia();
+      message.setMaxForwards(10);
+      message.serializeHeaders();
+      message.getBytes(&bytes, &length);
+      ASSERT_STR_EQUAL(bytes.data(), reserialized(bytes).data());
+      CPPUNIT_ASSERT(bytes.index("z9hG4bK-2") == UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(bytes.index("Max-Forwards: 10\r\n") != UTL_NOT_FOUND);
+   }
+
+   void testBodyLength()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      UtlString bytes;
+      ssize_t length;
+      message.getBytes(&bytes, &length);
+      CPPUNIT_ASSERT(bytes.index("Content-Length: 0\r\n") != UTL_NOT_FOUND);
+
+      message.serializeHeaders();
+      message.setBody(new HttpBody("v=0\r\n", 5, "application/sdp"));
+      message.getBytes(&bytes, &length);
+      CPPUNIT_ASSERT(bytes.index("Content-Length: 5\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT_EQUAL(0, message.getContentLength());
+
+      // serializeHeaders() corrects the header as well
+      message.serializeHeaders();
+      CPPUNIT_ASSERT_EQUAL(5, message.getContentLength());
+      message.getBytes(&bytes, &length);
+      CPPUNIT_ASSERT(bytes.index("Content-Length: 5\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT_EQUAL((ssize_t) bytes.index("\r\n\r\nv=0\r\n") + 4, length - 5);
+
+      // a body of another length changes the Content-Length the cache has
+      HttpBody* body = new HttpBody("v=0\r\no=-\r\n", 10, "application/sdp");
+      message.setBody(body);
+      message.getBytes(&bytes, &length);
+      CPPUNIT_ASSERT(bytes.index("Content-Length: 10\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(bytes.index("Content-Length: 5\r\n") == UTL_NOT_FOUND);
+   }
+
+   void testHeaderBytes()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      message.setBody(new HttpBody("v=0\r\n", 5, "application/sdp"));
+
+      UtlString body;
+      ssize_t bodyLength;
+      UtlString joined(*message.getHeaderBytes(&body, &bodyLength));
+      CPPUNIT_ASSERT_EQUAL((ssize_t) 5, bodyLength);
+      joined.append(body.data(), bodyLength);
+
+      UtlString bytes;
+      ssize_t length;
+      message.getBytes(&bytes, &length);
+      ASSERT_STR_EQUAL(bytes.data(), joined.data());
+
+      boost::shared_ptr<const UtlString> headers = message.getHeaderBytes(&body, &bodyLength);
+      CPPUNIT_ASSERT(headers->length() >= 4);
+      ASSERT_STR_EQUAL("\r\n\r\n", headers->data() + headers->length() - 4);
+   }
+
+   void testCopy()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      UtlString bytes;
+      ssize_t length;
+      message.serializeHeaders();
+
+      SipMessage copy(message);
+      copy.decrementMaxForwards();
+      copy.serializeHeaders();
+      UtlString copied;
+      copy.getBytes(&copied, &length);
+      CPPUNIT_ASSERT(copied.index("Max-Forwards: 69\r\n") != UTL_NOT_FOUND);
+
+      message.getBytes(&bytes, &length);
+      CPPUNIT_ASSERT(bytes.index("Max-Forwards: 70\r\n") != UTL_NOT_FOUND);
+   }
+
+   // Until serializeHeaders() keeps a serialization, each reader gets one
+   // of its own; after it, readers and copies share it, and what they got
+   // is not changed by later edits.
+   void testSerializeHeaders()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      UtlString body;
+      ssize_t bodyLength;
+
+      boost::shared_ptr<const UtlString> first = message.getHeaderBytes(&body, &bodyLength);
+      boost::shared_ptr<const UtlString> second = message.getHeaderBytes(&body, &bodyLength);
+      CPPUNIT_ASSERT(first.get() != second.get());
+      ASSERT_STR_EQUAL(first->data(), second->data());
+
+      message.serializeHeaders();
+      first = message.getHeaderBytes(&body, &bodyLength);
+      second = message.getHeaderBytes(&body, &bodyLength);
+      CPPUNIT_ASSERT(first.get() == second.get());
+
+      SipMessage copy(message);
+      CPPUNIT_ASSERT(copy.getHeaderBytes(&body, &bodyLength).get() == first.get());
+
+      message.setMaxForwards(5);
+      CPPUNIT_ASSERT(message.getHeaderBytes(&body, &bodyLength)->index("Max-Forwards: 5\r\n") != UTL_NOT_FOUND);
+      message.serializeHeaders();
+      CPPUNIT_ASSERT(message.getHeaderBytes(&body, &bodyLength)->index("Max-Forwards: 5\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(first->index("Max-Forwards: 70\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(copy.getHeaderBytes(&body, &bodyLength).get() == first.get());
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipMessageBytesTest);
@@ -0,0 +1,186 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Allocations, bytes allocated and time per INVITE on the proxy path,
+// where the message is copied from task to task.
+//
+// Each step runs MESSAGES times (100000 by default) on an INVITE of about
+// 1000 bytes with an SDP body, after it is parsed and logged:
+//
+//    copy      one copy of the message, read and deleted
+//    proxy     what the proxy does to it: SipRouter copies the request
+//              to schedule it, edits the copy and sends it; the send
+//              serializes it and copies it into a SipClientSendMsg, which
+//              the queue copies again, and the CSE observer copies what is
+//              sent; the copy sent is written from the serialization
+//
+// The bytes allocated are the bytes copied into the copies and the
+// serialization, as a copy allocates what it copies.
+//
+//    SipMessageCopyPerformance [messages]
+
+// SYSTEM INCLUDES
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// APPLICATION INCLUDES
+#include "net/SipMessage.h"
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+
+// CONSTANTS
+#define DEFAULT_MESSAGES 100000
+
+static size_t gAllocations = 0;
+static size_t gBytesAllocated = 0;
+
+void* operator new(size_t size)
+{
+   gAllocations++;
+   gBytesAllocated += size;
+   void* p = malloc(size ? size : 1);
+   if (!p)
+   {
+      throw std::bad_alloc();
+   }
+   return p;
+}
+
+void operator delete(void* p) throw()
+{
+   free(p);
+}
+
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete[](void* p) throw()
+{
+   free(p);
+}
+
+static const char* gMessage =
+   "INVITE sip:200@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-3e4d6f2a;rport=5060\r\n"
+   "Route: <sip:10.1.1.2:5060;lr>, <sip:10.1.1.3:5060;lr>\r\n"
+   "From: \"100\" <sip:100@example.com>;tag=2bd1b4c1a4\r\n"
+   "To: <sip:200@example.com>\r\n"
+   "Call-Id: 8f3a6f0c-1c4e8a93@10.1.1.1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "Max-Forwards: 70\r\n"
+   "Contact: <sip:100@10.1.1.1:5060>\r\n"
+   "Allow: INVITE, ACK, CANCEL, BYE, REFER, OPTIONS, NOTIFY\r\n"
+   "Supported: replaces, timer\r\n"
+   "Session-Expires: 1800\r\n"
+   "User-Agent: SipMessageCopyPerformance\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 282\r\n"
+   "\r\n"
+   "v=0\r\n"
+   "o=100 1234567890 1234567890 IN IP4 10.1.1.1\r\n"
+   "s=call\r\n"
+   "c=IN IP4 10.1.1.1\r\n"
+   "t=0 0\r\n"
+   "m=audio 10000 RTP/AVP 0 8 18 101\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n"
+   "a=rtpmap:8 PCMA/8000\r\n"
+   "a=rtpmap:18 G729/8000\r\n"
+   "a=fmtp:18 annexb=no\r\n"
+   "a=rtpmap:101 telephone-event/8000\r\n"
+   "a=fmtp:101 0-15\r\n"
+   "a=ptime:20\r\n"
+   "a=sendrecv\r\n";
+
+struct Cost
+{
+   size_t allocations;
+   size_t bytes;
+   OsTime start;
+
+   void begin()
+   {
+      allocations = gAllocations;
+      bytes = gBytesAllocated;
+      OsDateTime::getCurTimeSinceBoot(start);
+   }
+};
+
+static void report(const char* step, int messages, const Cost& cost)
+{
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - cost.start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+
+   printf("%-6s %8.1f allocations/message %10.0f bytes/message %8.3f us/message\n",
+          step,
+          (double) (gAllocations - cost.allocations) / messages,
+          (double) (gBytesAllocated - cost.bytes) / messages,
+          1000000.0 * seconds / messages);
+}
+
+int main(int argc, char* argv[])
+{
+   int messages = argc > 1 ? atoi(argv[1]) : DEFAULT_MESSAGES;
+   size_t length = strlen(gMessage);
+   UtlString bytes;
+   ssize_t bytesLength;
+   UtlString callId;
+   Cost cost;
+
+   printf("%d messages of %zu bytes\n", messages, length);
+
+   // As received: parsed and logged.
+   SipMessage received(gMessage, length);
+   received.serializeHeaders();
+   received.getBytes(&bytes, &bytesLength);
+
+   cost.begin();
+   for (int m = 0; m < messages; m++)
+   {
+      SipMessage* copy = new SipMessage(received);
+      copy->getCallIdField(&callId);
+      delete copy;
+   }
+   report("copy", messages, cost);
+
+   cost.begin();
+   for (int m = 0; m < messages; m++)
+   {
+      // SipRouter schedules a copy of the request.
+      SipMessage* request = new SipMessage(received);
+
+      UtlString route;
+      request->removeRouteUri(0, &route);
+      request->decrementMaxForwards();
+      request->addRecordRouteUri("<sip:10.1.1.2:5060;lr>");
+      request->addViaField("SIP/2.0/UDP 10.1.1.2:5060;branch=z9hG4bK-XX-0040Nd2D8NNT7q9JtAuwdm");
+      request->serializeHeaders();
+
+      // SipClientSendMsg copies it, the queue copies that, and the
+      // observer of the messages sent copies it again.
+      SipMessage* sendMsg = new SipMessage(*request);
+      SipMessage* queued = new SipMessage(*sendMsg);
+      delete sendMsg;
+      SipMessage* observed = new SipMessage(*queued);
+
+      queued->getBytes(&bytes, &bytesLength);
+
+      delete observed;
+      delete queued;
+      delete request;
+   }
+   report("proxy", messages, cost);
+
+   return 0;
+}
@@ -0,0 +1,227 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <string.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <net/HttpBody.h>
+#include <net/SipMessage.h>
+#include <utl/UtlString.h>
+
+static const char* gInvite =
+   "INVITE sip:user@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-1\r\n"
+   "Route: <sip:10.0.0.2;lr>\r\n"
+   "Max-Forwards: 70\r\n"
+   "To: <sip:user@example.com>\r\n"
+   "From: <sip:caller@example.com>;tag=1\r\n"
+   "Call-Id: copy-test-1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 10\r\n"
+   "\r\n"
+   "v=0\r\no=-\r\n";
+
+/**
+ * Unit tests for the headers and body that copies of a SipMessage share.
+ */
+class SipMessageCopyTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipMessageCopyTest);
+
+   CPPUNIT_TEST(testCopyIsEqual);
+   CPPUNIT_TEST(testChangeCopy);
+   CPPUNIT_TEST(testChangeOriginal);
+   CPPUNIT_TEST(testBodyShared);
+   CPPUNIT_TEST(testAssignment);
+   CPPUNIT_TEST(testOriginalDeleted);
+   CPPUNIT_TEST(testSerializeShared);
+   CPPUNIT_TEST(testCopiesOnThreads);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   static UtlString bytesOf(const SipMessage& message)
+   {
+      UtlString bytes;
+      ssize_t length;
+      message.getBytes(&bytes, &length);
+      return bytes;
+   }
+
+   static int maxForwardsOf(const SipMessage& message)
+   {
+      int maxForwards = -1;
+      message.getMaxForwards(maxForwards);
+      return maxForwards;
+   }
+
+   void testCopyIsEqual()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      SipMessage copy(message);
+      ASSERT_STR_EQUAL(bytesOf(message).data(), bytesOf(copy).data());
+
+      // and so is a copy of a message serialized before
+      SipMessage copyOfSerialized(message);
+      ASSERT_STR_EQUAL(bytesOf(message).data(), bytesOf(copyOfSerialized).data());
+   }
+
+   void testChangeCopy()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      UtlString before(bytesOf(message));
+
+      SipMessage copy(message);
+      UtlString route;
+      CPPUNIT_ASSERT(copy.removeRouteUri(0, &route));
+      copy.decrementMaxForwards();
+      copy.addRecordRouteUri("<sip:10.0.0.2;lr>");
+      copy.addViaField("SIP/2.0/UDP 10.0.0.2:5060;branch=z9hG4bK-2");
+      copy.removeTopVia();
+      copy.setHeaderValue("X-Copy", "1");
+
+      UtlString copied(bytesOf(copy));
+      CPPUNIT_ASSERT(copied.index("Max-Forwards: 69\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(copied.index("Record-Route: <sip:10.0.0.2;lr>\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(copied.index("X-Copy: 1\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(copied.index("\r\nRoute:") == UTL_NOT_FOUND);
+
+      ASSERT_STR_EQUAL(before.data(), bytesOf(message).data());
+      CPPUNIT_ASSERT_EQUAL(70, maxForwardsOf(message));
+      CPPUNIT_ASSERT(!message.getHeaderValue(0, "X-Copy"));
+   }
+
+   void testChangeOriginal()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      SipMessage copy(message);
+      UtlString before(bytesOf(copy));
+
+      message.removeHeader(SIP_CALLID_FIELD, 0);
+      message.setFirstHeaderLine("BYE sip:user@example.com SIP/2.0");
+      CPPUNIT_ASSERT(bytesOf(message).index("Call-Id:") == UTL_NOT_FOUND);
+
+      ASSERT_STR_EQUAL(before.data(), bytesOf(copy).data());
+      UtlString callId;
+      copy.getCallIdField(&callId);
+      ASSERT_STR_EQUAL("copy-test-1", callId.data());
+   }
+
+   void testBodyShared()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      SipMessage copy(message);
+      CPPUNIT_ASSERT(message.getBody());
+      CPPUNIT_ASSERT(message.getBody() == copy.getBody());
+
+      copy.setBody(new HttpBody("v=0\r\n", 5, "application/sdp"));
+      CPPUNIT_ASSERT(bytesOf(copy).index("Content-Length: 5\r\n") != UTL_NOT_FOUND);
+
+      UtlString bytes(bytesOf(message));
+      CPPUNIT_ASSERT(bytes.index("Content-Length: 10\r\n") != UTL_NOT_FOUND);
+      CPPUNIT_ASSERT(bytes.index("\r\n\r\nv=0\r\no=-\r\n") != UTL_NOT_FOUND);
+   }
+
+   void testAssignment()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      SipMessage assigned;
+      assigned = message;
+      ASSERT_STR_EQUAL(bytesOf(message).data(), bytesOf(assigned).data());
+
+      assigned.decrementMaxForwards();
+      CPPUNIT_ASSERT_EQUAL(69, maxForwardsOf(assigned));
+      CPPUNIT_ASSERT_EQUAL(70, maxForwardsOf(message));
+
+      assigned = assigned;
+      CPPUNIT_ASSERT_EQUAL(69, maxForwardsOf(assigned));
+   }
+
+   void testOriginalDeleted()
+   {
+      SipMessage* message = new SipMessage(gInvite, strlen(gInvite));
+      UtlString before(bytesOf(*message));
+      SipMessage copy(*message);
+      delete message;
+
+      ASSERT_STR_EQUAL(before.data(), bytesOf(copy).data());
+      copy.decrementMaxForwards();
+      CPPUNIT_ASSERT(bytesOf(copy).index("Max-Forwards: 69\r\n") != UTL_NOT_FOUND);
+   }
+
+   // Serializing a message is not a change: the headers stay shared.
+   void testSerializeShared()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      SipMessage copy(message);
+      CPPUNIT_ASSERT(message.getHeaderValue(0, SIP_CALLID_FIELD)
+                     == copy.getHeaderValue(0, SIP_CALLID_FIELD));
+
+      message.serializeHeaders();
+      copy.serializeHeaders();
+      CPPUNIT_ASSERT(message.getHeaderValue(0, SIP_CALLID_FIELD)
+                     == copy.getHeaderValue(0, SIP_CALLID_FIELD));
+
+      copy.decrementMaxForwards();
+      CPPUNIT_ASSERT(message.getHeaderValue(0, SIP_CALLID_FIELD)
+                     != copy.getHeaderValue(0, SIP_CALLID_FIELD));
+   }
+
+   // Copy, change and serialize copies of one message on threads at once,
+   // as the transaction, the clients and the trace do.
+   static void changeCopies(const SipMessage* original, int thread, int* failures)
+   {
+      for (int i = 0; i < 2000; i++)
+      {
+         SipMessage copy(*original);
+         SipMessage* copyOfCopy = new SipMessage(copy);
+         copy.setMaxForwards(thread);
+         copy.serializeHeaders();
+         UtlString expected("Max-Forwards: ");
+         expected.appendNumber(thread);
+         expected.append("\r\n");
+         if (bytesOf(copy).index(expected) == UTL_NOT_FOUND
+             || maxForwardsOf(*copyOfCopy) != 70
+             || bytesOf(*copyOfCopy).index("Max-Forwards: 70\r\n") == UTL_NOT_FOUND)
+         {
+            (*failures)++;
+         }
+         delete copyOfCopy;
+      }
+   }
+
+   void testCopiesOnThreads()
+   {
+      SipMessage message(gInvite, strlen(gInvite));
+      message.serializeHeaders();
+
+      static const int THREADS = 4;
+      int failures[THREADS] = { 0 };
+      boost::thread_group threads;
+      for (int t = 0; t < THREADS; t++)
+      {
+         threads.create_thread(boost::bind(&changeCopies, &message, t + 1, &failures[t]));
+      }
+      threads.join_all();
+
+      for (int t = 0; t < THREADS; t++)
+      {
+         CPPUNIT_ASSERT_EQUAL(0, failures[t]);
+      }
+      CPPUNIT_ASSERT_EQUAL(70, maxForwardsOf(message));
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipMessageCopyTest);
@@ -0,0 +1,151 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Cost per message of what a proxy does to the SIP messages it forwards.
+//
+// Each step runs MESSAGES times (100000 by default) on an INVITE of about
+// 700 bytes:
+//
+//    parse     SipMessage from the bytes read, as SipClient does
+//    serialize serializeHeaders and getBytes of a message just parsed:
+//              every header is formatted
+//    edit      what the proxy changes: pop a Route, decrement Max-Forwards,
+//              add a Record-Route and push a Via
+//    splice    serializeHeaders and getBytes after the edits, of a message
+//              serialized before them: only the edited headers are formatted
+//    cached    getBytes of a message that did not change since the last one
+//    forward   all of it on a copy, as the proxy forwards one, serialized
+//              once by SipUserAgent and read three times: for the log, to
+//              check its size and to send it
+//
+//    SipMessageForwardPerformance [messages]
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// APPLICATION INCLUDES
+#include "net/SipMessage.h"
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+
+// CONSTANTS
+#define DEFAULT_MESSAGES 100000
+
+static const char* gMessage =
+   "INVITE sip:200@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-3e4d6f2a;rport=5060\r\n"
+   "Route: <sip:10.1.1.2:5060;lr>, <sip:10.1.1.3:5060;lr>\r\n"
+   "From: \"100\" <sip:100@example.com>;tag=2bd1b4c1a4\r\n"
+   "To: <sip:200@example.com>\r\n"
+   "Call-Id: 8f3a6f0c-1c4e8a93@10.1.1.1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "Max-Forwards: 70\r\n"
+   "Contact: <sip:100@10.1.1.1:5060>\r\n"
+   "Allow: INVITE, ACK, CANCEL, BYE, REFER, OPTIONS, NOTIFY\r\n"
+   "Supported: replaces, timer\r\n"
+   "Session-Expires: 1800\r\n"
+   "User-Agent: SipMessageForwardPerformance\r\n"
+   "Accept: application/sdp\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+static void edit(SipMessage& message)
+{
+   UtlString route;
+   message.removeRouteUri(0, &route);
+   message.decrementMaxForwards();
+   message.addRecordRouteUri("<sip:10.1.1.2:5060;lr>");
+   message.addViaField("SIP/2.0/UDP 10.1.1.2:5060;branch=z9hG4bK-XX-0040Nd2D8NNT7q9JtAuwdm");
+}
+
+static double since(const OsTime& start)
+{
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   return elapsed.seconds() + elapsed.usecs() / 1000000.0;
+}
+
+static void report(const char* step, int messages, double seconds)
+{
+   printf("%-10s %8.3f us/message %10.0f messages/s\n",
+          step, 1000000.0 * seconds / messages,
+          seconds > 0 ? messages / seconds : 0.0);
+}
+
+int main(int argc, char* argv[])
+{
+   int messages = argc > 1 ? atoi(argv[1]) : DEFAULT_MESSAGES;
+   size_t length = strlen(gMessage);
+   UtlString bytes;
+   ssize_t bytesLength;
+   OsTime start;
+
+   printf("%d messages of %zu bytes\n", messages, length);
+
+   OsDateTime::getCurTimeSinceBoot(start);
+   for (int m = 0; m < messages; m++)
+   {
+      SipMessage message(gMessage, length);
+   }
+   double parse = since(start);
+   report("parse", messages, parse);
+
+   double serialize = 0;
+   double editing = 0;
+   double splice = 0;
+   double cached = 0;
+   for (int m = 0; m < messages; m++)
+   {
+      SipMessage message(gMessage, length);
+
+      OsDateTime::getCurTimeSinceBoot(start);
+      message.serializeHeaders();
+      message.getBytes(&bytes, &bytesLength);
+      serialize += since(start);
+
+      OsDateTime::getCurTimeSinceBoot(start);
+      edit(message);
+      editing += since(start);
+
+      OsDateTime::getCurTimeSinceBoot(start);
+      message.serializeHeaders();
+      message.getBytes(&bytes, &bytesLength);
+      splice += since(start);
+
+      OsDateTime::getCurTimeSinceBoot(start);
+      message.getBytes(&bytes, &bytesLength);
+      cached += since(start);
+   }
+   report("serialize", messages, serialize);
+   report("edit", messages, editing);
+   report("splice", messages, splice);
+   report("cached", messages, cached);
+
+   OsDateTime::getCurTimeSinceBoot(start);
+   for (int m = 0; m < messages; m++)
+   {
+      SipMessage received(gMessage, length);
+      received.serializeHeaders();
+      received.getBytes(&bytes, &bytesLength);   // logged as it is read
+      SipMessage forwarded(received);
+      edit(forwarded);
+      forwarded.serializeHeaders();
+      for (int serialized = 0; serialized < 3; serialized++)
+      {
+         forwarded.getBytes(&bytes, &bytesLength);
+      }
+   }
+   report("forward", messages, since(start));
+
+   return 0;
+}
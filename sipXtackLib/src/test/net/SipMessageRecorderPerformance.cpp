@@ -0,0 +1,169 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Cost of the SIP message log per message, with 1 to THREADS threads.
+//
+// Each thread stands in for a SipClient or the SipUserAgent and logs
+// MESSAGES messages (100000 by default) of about 600 bytes, three ways:
+//
+//    off      SipMessageRecorder::record on a recorder that is stopped
+//    recorder SipMessageRecorder::record
+//    text     what SipUserAgent::logMessage used to do: format the
+//             message as text under one lock, append it to a UtlString
+//             and cut the front off when it is over its maximum size
+//
+//    SipMessageRecorderPerformance [threads] [messages]
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// APPLICATION INCLUDES
+#include "net/SipMessageRecorder.h"
+#include "os/OsDateTime.h"
+#include "os/OsLock.h"
+#include "os/OsMutex.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+
+// CONSTANTS
+#define DEFAULT_THREADS  8
+#define DEFAULT_MESSAGES 100000
+#define MAXIMUM_TEXT_LOG (5 * 1024 * 1024)
+
+enum Method
+{
+   OFF,
+   RECORDER,
+   TEXT
+};
+
+static const char* gMessage =
+   "INVITE sip:200@example.com SIP/2.0\r\n"
+   "Record-Route: <sip:10.1.1.2:5060;lr>\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.2:5060;branch=z9hG4bK-XX-0040Nd2D8NNT7q9JtAuwdm+Vhw\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-3e4d6f2a;rport=5060\r\n"
+   "From: \"100\" <sip:100@example.com>;tag=2bd1b4c1a4\r\n"
+   "To: <sip:200@example.com>\r\n"
+   "Call-Id: 8f3a6f0c-1c4e8a93@10.1.1.1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "Max-Forwards: 19\r\n"
+   "Contact: <sip:100@10.1.1.1:5060>\r\n"
+   "Allow: INVITE, ACK, CANCEL, BYE, REFER, OPTIONS, NOTIFY\r\n"
+   "Supported: replaces\r\n"
+   "User-Agent: SipMessageRecorderPerformance\r\n"
+   "Content-Type: application/sdp\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+static SipMessageRecorder gRecorder;
+static SipMessageRecorder gStoppedRecorder;
+static OsMutex gTextLock(OsMutex::Q_FIFO);
+static UtlString gTextLog;
+static Method gMethod;
+static int gMessages;
+
+static void logText(const char* bytes, size_t length)
+{
+   UtlString text;
+   text.append("UDP SIP User Agent sent message:\n");
+   text.append("----Local Host:10.1.1.2---- Port: ");
+   text.appendNumber(5060);
+   text.append("----\n");
+   text.append("----Remote Host:10.1.1.3---- Port: ");
+   text.appendNumber(5060);
+   text.append("----\n");
+   text.append(bytes, length);
+   text.append("--------------------END--------------------\n");
+
+   OsLock lock(gTextLock);
+   gTextLog.append(text);
+   if (gTextLog.length() > MAXIMUM_TEXT_LOG)
+   {
+      gTextLog.remove(0, gTextLog.length() - MAXIMUM_TEXT_LOG);
+   }
+}
+
+static void* logThread(void*)
+{
+   size_t length = strlen(gMessage);
+   for (int i = 0; i < gMessages; i++)
+   {
+      switch (gMethod)
+      {
+      case OFF:
+         gStoppedRecorder.record(SipMessageRecorder::OUTGOING, OsSocket::UDP,
+                                 "10.1.1.2", 5060, "10.1.1.3", 5060,
+                                 gMessage, length);
+         break;
+
+      case RECORDER:
+         gRecorder.record(SipMessageRecorder::OUTGOING, OsSocket::UDP,
+                          "10.1.1.2", 5060, "10.1.1.3", 5060,
+                          gMessage, length);
+         break;
+
+      case TEXT:
+         logText(gMessage, length);
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+static void run(const char* name, Method method, int threads)
+{
+   gMethod = method;
+   gRecorder.clear();
+   gTextLog.remove(0);
+
+   pthread_t* thread = new pthread_t[threads];
+   OsTime start;
+   OsDateTime::getCurTimeSinceBoot(start);
+
+   for (int t = 0; t < threads; t++)
+   {
+      pthread_create(&thread[t], NULL, logThread, NULL);
+   }
+   for (int t = 0; t < threads; t++)
+   {
+      pthread_join(thread[t], NULL);
+   }
+
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+   int messages = threads * gMessages;
+
+   printf("%-8s %2d threads %9d messages %8.3f s %8.0f ns/message %12.0f messages/s\n",
+          name, threads, messages, seconds,
+          messages > 0 ? seconds * 1e9 / messages : 0.0,
+          seconds > 0 ? messages / seconds : 0.0);
+   delete [] thread;
+}
+
+int main(int argc, char* argv[])
+{
+   int threads = argc > 1 ? atoi(argv[1]) : DEFAULT_THREADS;
+   gMessages = argc > 2 ? atoi(argv[2]) : DEFAULT_MESSAGES;
+
+   gRecorder.start();
+
+   for (int t = 1; t <= threads; t *= 2)
+   {
+      run("off", OFF, t);
+      run("recorder", RECORDER, t);
+      run("text", TEXT, t);
+   }
+
+   return 0;
+}
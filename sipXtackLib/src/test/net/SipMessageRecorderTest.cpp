@@ -0,0 +1,233 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <net/SipMessageRecorder.h>
+#include <utl/UtlString.h>
+
+static const char* gRequest =
+   "OPTIONS sip:user@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5060;branch=z9hG4bK-1\r\n"
+   "To: <sip:user@example.com>\r\n"
+   "From: <sip:caller@example.com>;tag=1\r\n"
+   "Call-Id: recorder-test-1\r\n"
+   "Cseq: 1 OPTIONS\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+/**
+ * Unit tests for SipMessageRecorder.
+ */
+class SipMessageRecorderTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipMessageRecorderTest);
+
+   CPPUNIT_TEST(testNotRecording);
+   CPPUNIT_TEST(testRecord);
+   CPPUNIT_TEST(testWrapAround);
+   CPPUNIT_TEST(testTruncate);
+   CPPUNIT_TEST(testClear);
+   CPPUNIT_TEST(testExportText);
+   CPPUNIT_TEST(testExportPcapng);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   void record(SipMessageRecorder& recorder, const char* bytes,
+               SipMessageRecorder::Direction direction = SipMessageRecorder::INCOMING)
+   {
+      recorder.record(direction, OsSocket::UDP,
+                      "10.1.1.2", 5060, "10.1.1.1", 5070,
+                      bytes, strlen(bytes));
+   }
+
+   void getMessages(SipMessageRecorder& recorder, std::vector<SipMessageRecorder::Message*>& messages)
+   {
+      messages.clear();
+      recorder.getMessages(messages);
+   }
+
+   void deleteMessages(std::vector<SipMessageRecorder::Message*>& messages)
+   {
+      for (size_t i = 0; i < messages.size(); i++)
+      {
+         delete messages[i];
+      }
+      messages.clear();
+   }
+
+   void testNotRecording()
+   {
+      SipMessageRecorder recorder;
+      record(recorder, gRequest);
+
+      std::vector<SipMessageRecorder::Message*> messages;
+      getMessages(recorder, messages);
+      CPPUNIT_ASSERT(!recorder.isRecording());
+      CPPUNIT_ASSERT_EQUAL((size_t) 0, messages.size());
+   }
+
+   void testRecord()
+   {
+      SipMessageRecorder recorder;
+      recorder.start();
+      record(recorder, gRequest);
+      record(recorder, "second", SipMessageRecorder::OUTGOING);
+      recorder.stop();
+      record(recorder, "not recorded");
+
+      std::vector<SipMessageRecorder::Message*> messages;
+      getMessages(recorder, messages);
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, messages.size());
+
+      SipMessageRecorder::Message* message = messages[0];
+      ASSERT_STR_EQUAL(gRequest, message->bytes.data());
+      CPPUNIT_ASSERT_EQUAL(strlen(gRequest), message->length);
+      CPPUNIT_ASSERT_EQUAL(SipMessageRecorder::INCOMING, message->direction);
+      CPPUNIT_ASSERT_EQUAL(OsSocket::UDP, message->transport);
+      ASSERT_STR_EQUAL("10.1.1.2", message->localAddress.data());
+      CPPUNIT_ASSERT_EQUAL(5060, message->localPort);
+      ASSERT_STR_EQUAL("10.1.1.1", message->remoteAddress.data());
+      CPPUNIT_ASSERT_EQUAL(5070, message->remotePort);
+      CPPUNIT_ASSERT(!message->failed);
+
+      ASSERT_STR_EQUAL("second", messages[1]->bytes.data());
+      CPPUNIT_ASSERT_EQUAL(SipMessageRecorder::OUTGOING, messages[1]->direction);
+
+      deleteMessages(messages);
+   }
+
+   void testWrapAround()
+   {
+      SipMessageRecorder recorder(SipMessageRecorder::MIN_SLOTS);
+      recorder.start();
+
+      char text[16];
+      for (int i = 0; i < 3 * SipMessageRecorder::MIN_SLOTS; i++)
+      {
+         snprintf(text, sizeof(text), "message %d", i);
+         record(recorder, text);
+      }
+
+      // only the newest messages are kept, oldest first
+      std::vector<SipMessageRecorder::Message*> messages;
+      getMessages(recorder, messages);
+      CPPUNIT_ASSERT_EQUAL((size_t) SipMessageRecorder::MIN_SLOTS, messages.size());
+      for (int i = 0; i < SipMessageRecorder::MIN_SLOTS; i++)
+      {
+         snprintf(text, sizeof(text), "message %d", 2 * SipMessageRecorder::MIN_SLOTS + i);
+         ASSERT_STR_EQUAL(text, messages[i]->bytes.data());
+      }
+
+      deleteMessages(messages);
+   }
+
+   void testTruncate()
+   {
+      SipMessageRecorder recorder(SipMessageRecorder::MIN_SLOTS, 10);
+      recorder.start();
+      record(recorder, gRequest);
+
+      std::vector<SipMessageRecorder::Message*> messages;
+      getMessages(recorder, messages);
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, messages.size());
+      ASSERT_STR_EQUAL("OPTIONS si", messages[0]->bytes.data());
+      CPPUNIT_ASSERT_EQUAL(strlen(gRequest), messages[0]->length);
+
+      deleteMessages(messages);
+   }
+
+   void testClear()
+   {
+      SipMessageRecorder recorder;
+      recorder.start();
+      record(recorder, "before");
+      recorder.clear();
+      record(recorder, "after");
+
+      std::vector<SipMessageRecorder::Message*> messages;
+      getMessages(recorder, messages);
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, messages.size());
+      ASSERT_STR_EQUAL("after", messages[0]->bytes.data());
+
+      deleteMessages(messages);
+   }
+
+   void testExportText()
+   {
+      SipMessageRecorder recorder;
+      recorder.start();
+      record(recorder, "INCOMING\n");
+      recorder.record(SipMessageRecorder::OUTGOING, OsSocket::TCP,
+                      "10.1.1.2", 5060, "10.1.1.3", 5060,
+                      "OUTGOING\n", 9, true);
+      recorder.recordNote("note\n", 5);
+
+      UtlString text;
+      recorder.exportText(text);
+      ASSERT_STR_EQUAL("Read SIP message:\n"
+                       "----Local Host:10.1.1.2---- Port: 5060----\n"
+                       "----Remote Host:10.1.1.1---- Port: 5070----\n"
+                       "INCOMING\n"
+                       "====================END====================\n"
+                       "TCP SIP User Agent failed to send message:\n"
+                       "----Local Host:10.1.1.2---- Port: 5060----\n"
+                       "----Remote Host:10.1.1.3---- Port: 5060----\n"
+                       "OUTGOING\n"
+                       "--------------------END--------------------\n"
+                       "note\n",
+                       text.data());
+   }
+
+   void testExportPcapng()
+   {
+      SipMessageRecorder recorder;
+      recorder.start();
+      record(recorder, gRequest);
+      recorder.recordNote("note\n", 5);
+
+      UtlString data;
+      recorder.exportPcapng(data);
+
+      // section header, interface description and one packet; notes are left out
+      int blocks = 0;
+      uint32_t packetType = 0;
+      size_t offset = 0;
+      while (offset + 8 <= data.length())
+      {
+         uint32_t type;
+         uint32_t length;
+         memcpy(&type, data.data() + offset, sizeof(type));
+         memcpy(&length, data.data() + offset + 4, sizeof(length));
+         CPPUNIT_ASSERT(length >= 12 && length % 4 == 0);
+         if (blocks == 0)
+         {
+            CPPUNIT_ASSERT_EQUAL((uint32_t) 0x0A0D0D0A, type);
+         }
+         packetType = type;
+         offset += length;
+         blocks++;
+      }
+      CPPUNIT_ASSERT_EQUAL(data.length(), offset);
+      CPPUNIT_ASSERT_EQUAL(3, blocks);
+      CPPUNIT_ASSERT_EQUAL((uint32_t) 6, packetType);
+
+      // the SIP message follows the made up IPv4 and UDP headers
+      CPPUNIT_ASSERT(data.index(gRequest) != UTL_NOT_FOUND);
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipMessageRecorderTest);
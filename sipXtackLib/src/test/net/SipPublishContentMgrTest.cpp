@@ -25,6 +25,7 @@ static UtlString mResourceId;
 static UtlString mEventTypeKey;
 static UtlString mEventType;
 static UtlString mReason;
+static int mCallbacks;
 
 void static contentChangeCallback(void* applicationData,
                                   const char* resourceId,
@@ -37,6 +38,7 @@ void static contentChangeCallback(void* applicationData,
    mEventTypeKey = eventTypeKey;
    mEventType = eventType;
    mReason = reason;
+   mCallbacks++;
 }
 
 /* The default content constructor used by the testDefaultConstructor test. */
@@ -116,6 +118,7 @@ class SipPublishContentMgrTest : public CppUnit::TestCase
    CPPUNIT_TEST(testPublishContent);
    CPPUNIT_TEST(testGetContent);
    CPPUNIT_TEST(testContentChangeObserver);
+   CPPUNIT_TEST(testCoalescing);
    CPPUNIT_TEST(testGetContentAccept);
    CPPUNIT_TEST(testGetContentAcceptMultipartRelated);
    CPPUNIT_TEST_SUITE_END();
@@ -583,6 +586,67 @@ public:
          ASSERT_STR_EQUAL_MESSAGE("incorrect event type", eventType, mEventType.data());
       }
 
+   void testCoalescing()
+      {
+         const char *resourceId = TEST_RESOURCE_ID;
+         const char *otherResourceId = "sip:other@example.com";
+         const char *eventType = "dialog";
+         const void* appData = "testCoalescing";
+
+         SipPublishContentMgr publisher;
+
+         publisher.setContentChangeObserver(eventType,
+                                            contentChangeCallback,
+                                            (void *)appData);
+         // Long enough that the coalescing thread does not deliver during the test.
+         publisher.setCoalescingWindow(60000);
+
+         mCallbacks = 0;
+         mResourceId = "";
+         for (int i = 0; i < 3; i++)
+         {
+            HttpBody *body = new HttpBody("content", 7, "text/plain");
+            publisher.publish(resourceId, eventType, eventType, 1, &body);
+         }
+         HttpBody *body = new HttpBody("content", 7, "text/plain");
+         publisher.publish(otherResourceId, eventType, eventType, 1, &body);
+
+         CPPUNIT_ASSERT_EQUAL_MESSAGE("callback called within the window",
+                                      0, mCallbacks);
+         CPPUNIT_ASSERT_MESSAGE("callback due before the window passes",
+                                publisher.deliverCoalesced() > 0);
+         CPPUNIT_ASSERT_EQUAL(0, mCallbacks);
+
+         // One callback per resource, in the order first changed.
+         CPPUNIT_ASSERT_EQUAL((Int64) -1, publisher.deliverCoalesced(TRUE));
+         CPPUNIT_ASSERT_EQUAL(2, mCallbacks);
+         CPPUNIT_ASSERT_MESSAGE("bad app data pointer", appData == mAppData);
+         ASSERT_STR_EQUAL_MESSAGE("incorrect resource Id", otherResourceId, mResourceId.data());
+
+         int numCallbacksDelivered, numPublishesCoalesced;
+         Int64 meanDelayUs, maxDelayUs;
+         publisher.getCoalescingStats(numCallbacksDelivered, numPublishesCoalesced,
+                                      meanDelayUs, maxDelayUs);
+         CPPUNIT_ASSERT_EQUAL(2, numCallbacksDelivered);
+         CPPUNIT_ASSERT_EQUAL(2, numPublishesCoalesced);
+         CPPUNIT_ASSERT(meanDelayUs <= maxDelayUs);
+
+         // Unpublishing drops the pending callback and notifies at once.
+         body = new HttpBody("content", 7, "text/plain");
+         publisher.publish(resourceId, eventType, eventType, 1, &body);
+         CPPUNIT_ASSERT_EQUAL(2, mCallbacks);
+         publisher.unpublish(resourceId, eventType, eventType, "test");
+         CPPUNIT_ASSERT_EQUAL(3, mCallbacks);
+         CPPUNIT_ASSERT_EQUAL((Int64) -1, publisher.deliverCoalesced(TRUE));
+         CPPUNIT_ASSERT_EQUAL(3, mCallbacks);
+
+         // Without a window the callback is called by publish().
+         publisher.setCoalescingWindow(0);
+         body = new HttpBody("content", 7, "text/plain");
+         publisher.publish(resourceId, eventType, eventType, 1, &body);
+         CPPUNIT_ASSERT_EQUAL(4, mCallbacks);
+      }
+
    void testGetContentAccept()
       {
          SipPublishContentMgr publisher;
@@ -50,10 +50,38 @@ class SipSrvLookupTest : public CppUnit::TestCase
 {
    CPPUNIT_TEST_SUITE(SipSrvLookupTest);
    CPPUNIT_TEST(lookup);
+   CPPUNIT_TEST(lookupThreadPool);
    CPPUNIT_TEST_SUITE_END();
 
 public:
 
+   // Each name lookup running at once has a set of query threads to itself,
+   // and a set handed back is taken by the next lookup.
+   void lookupThreadPool()
+   {
+      SipSrvLookupThread** sets[SipSrvLookupThread::LOOKUP_POOL_SIZE];
+      for (int i = 0; i < SipSrvLookupThread::LOOKUP_POOL_SIZE; i++)
+      {
+         sets[i] = SipSrvLookupThread::acquireLookupThreads();
+         for (int j = 0; j < i; j++)
+         {
+            CPPUNIT_ASSERT(sets[i] != sets[j]);
+            CPPUNIT_ASSERT(sets[i][SipSrvLookupThread::A_RECORD] !=
+                           sets[j][SipSrvLookupThread::A_RECORD]);
+         }
+      }
+
+      SipSrvLookupThread** released = sets[1];
+      SipSrvLookupThread::releaseLookupThreads(released);
+      sets[1] = SipSrvLookupThread::acquireLookupThreads();
+      CPPUNIT_ASSERT(sets[1] == released);
+
+      for (int i = 0; i < SipSrvLookupThread::LOOKUP_POOL_SIZE; i++)
+      {
+         SipSrvLookupThread::releaseLookupThreads(sets[i]);
+      }
+   }
+
    void lookup()
    {
 #ifdef NAMED_PROGRAM
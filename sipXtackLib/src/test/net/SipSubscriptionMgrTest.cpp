@@ -27,6 +27,9 @@ class SipSubscriptionMgrTest : public CppUnit::TestCase
 {
       CPPUNIT_TEST_SUITE(SipSubscriptionMgrTest);
       CPPUNIT_TEST(subscriptionTest);
+      CPPUNIT_TEST(expiryTest);
+      CPPUNIT_TEST(expiryRefreshTest);
+      CPPUNIT_TEST(firstSweepTest);
       CPPUNIT_TEST_SUITE_END();
 
       public:
@@ -280,6 +283,203 @@ Voice-Message: 0/0 (0/0)\r\n";
 
       }
 
+   // Send subscription by user to sip:resource@example.com that expires at
+   // expires, in the dialog with toTag, or a new dialog if toTag is empty.
+   void subscribe(SipSubscriptionMgr& subMgr,
+                  const char* user,
+                  const char* resource,
+                  const char* toTag,
+                  int cseq,
+                  long expires,
+                  UtlString& dialogHandle,
+                  UtlBoolean& isNew)
+   {
+      char subscribe[1024];
+      snprintf(subscribe, sizeof (subscribe),
+               "SUBSCRIBE sip:%s@example.com SIP/2.0\r\n"
+               "From: <sip:%s@example.com>;tag=%s-tag\r\n"
+               "To: <sip:%s@example.com>%s%s\r\n"
+               "Call-Id: %s-%s\r\n"
+               "Cseq: %d SUBSCRIBE\r\n"
+               "Contact: sip:%s@10.1.2.3\r\n"
+               "Event: dialog\r\n"
+               "Expires: 3600\r\n"
+               "Via: SIP/2.0/UDP 10.1.2.3;branch=z9hG4bK%s%s%d\r\n"
+               "Content-Length: 0\r\n"
+               "\r\n",
+               resource, user, user, resource,
+               toTag[0] ? ";tag=" : "", toTag,
+               user, resource, cseq, user, user, resource, cseq);
+      SipMessage request(subscribe);
+
+      UtlString resourceId("sip:");
+      resourceId.append(resource);
+      resourceId.append("@example.com");
+      CPPUNIT_ASSERT(subMgr.insertDialogInfo(request, resourceId, "dialog", "dialog",
+                                             expires, cseq, 0, dialogHandle, isNew));
+   }
+
+   // Insert a subscription by user to sip:resource@example.com that expires at expires.
+   void insertSubscription(SipSubscriptionMgr& subMgr,
+                           const char* user,
+                           const char* resource,
+                           long expires,
+                           UtlString& dialogHandle)
+   {
+      UtlBoolean isNew;
+      subscribe(subMgr, user, resource, "", 1, expires, dialogHandle, isNew);
+      CPPUNIT_ASSERT(isNew);
+   }
+
+   // Refresh the subscription of insertSubscription with dialogHandle, so
+   // that it expires at expires.
+   void refreshSubscription(SipSubscriptionMgr& subMgr,
+                            const char* user,
+                            const char* resource,
+                            long expires,
+                            const UtlString& dialogHandle)
+   {
+      UtlString callId, fromTag, toTag;
+      SipDialog::parseHandle(dialogHandle, callId, fromTag, toTag);
+
+      UtlString refreshedHandle;
+      UtlBoolean isNew;
+      subscribe(subMgr, user, resource, toTag, 2, expires, refreshedHandle, isNew);
+      CPPUNIT_ASSERT(!isNew);
+   }
+
+   void expiryTest()
+   {
+      OsMsgQ msgQ("SipSubscriptionMgrTest::expiryTest::msgQ");
+      SipSubscriptionMgr subMgr;
+      subMgr.initialize(&msgQ);
+      SipDialogMgr* dialogMgr = subMgr.getDialogMgr();
+
+      long now = OsDateTime::getSecsSinceEpoch();
+
+      // Subscriptions to different resources, so that they fall in
+      // different shards, and one expiring a lap of the expiry wheel later.
+      UtlString soonHandle, laterHandle, muchLaterHandle;
+      insertSubscription(subMgr, "100", "200", now + 10, soonHandle);
+      insertSubscription(subMgr, "101", "201", now + 100, laterHandle);
+      insertSubscription(subMgr, "102", "200", now + 10 + 256, muchLaterHandle);
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 3);
+
+      subMgr.removeOldSubscriptions(now);
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 3);
+
+      // One that had already expired when it was added is still swept,
+      // even by an earlier time than the last sweep.
+      UtlString expiredHandle;
+      insertSubscription(subMgr, "103", "202", now - 5, expiredHandle);
+      CPPUNIT_ASSERT(subMgr.dialogExists(expiredHandle));
+      subMgr.removeOldSubscriptions(now - 1);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(expiredHandle));
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 3);
+
+      subMgr.removeOldSubscriptions(now + 11);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(soonHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(laterHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(muchLaterHandle));
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 2);
+
+      // Resource 200 still has its other subscription.
+      int numNotifiesCreated;
+      UtlString* acceptHeaderValuesArray;
+      SipMessage* notifyArray;
+      bool* fullContentArray;
+      subMgr.createNotifiesDialogInfo("sip:200@example.com", "dialog",
+                                      "active;expires=%ld",
+                                      numNotifiesCreated,
+                                      acceptHeaderValuesArray,
+                                      fullContentArray,
+                                      notifyArray);
+      CPPUNIT_ASSERT(numNotifiesCreated == 1);
+      delete[] acceptHeaderValuesArray;
+      delete[] notifyArray;
+      delete[] fullContentArray;
+
+      subMgr.removeOldSubscriptions(now + 101);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(laterHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(muchLaterHandle));
+
+      subMgr.removeOldSubscriptions(now + 10 + 257);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(muchLaterHandle));
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 0);
+   }
+
+   // A refresh moves a subscription to the slot of its new expiration date.
+   void expiryRefreshTest()
+   {
+      OsMsgQ msgQ("SipSubscriptionMgrTest::expiryRefreshTest::msgQ");
+      SipSubscriptionMgr subMgr;
+      subMgr.initialize(&msgQ);
+      SipDialogMgr* dialogMgr = subMgr.getDialogMgr();
+
+      long now = OsDateTime::getSecsSinceEpoch();
+      subMgr.removeOldSubscriptions(now);
+
+      UtlString extendedHandle, shortenedHandle, lappedHandle;
+      insertSubscription(subMgr, "110", "210", now + 10, extendedHandle);
+      insertSubscription(subMgr, "111", "210", now + 100, shortenedHandle);
+      insertSubscription(subMgr, "112", "210", now + 20, lappedHandle);
+
+      refreshSubscription(subMgr, "110", "210", now + 50, extendedHandle);
+      refreshSubscription(subMgr, "111", "210", now + 5, shortenedHandle);
+      refreshSubscription(subMgr, "112", "210", now + 20 + 256, lappedHandle);
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 3);
+
+      subMgr.removeOldSubscriptions(now + 6);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(shortenedHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(extendedHandle));
+
+      subMgr.removeOldSubscriptions(now + 21);
+      CPPUNIT_ASSERT(subMgr.dialogExists(extendedHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(lappedHandle));
+
+      subMgr.removeOldSubscriptions(now + 51);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(extendedHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(lappedHandle));
+
+      // Refreshed to a date that is already past, it waits in the slot of
+      // the next sweep.
+      refreshSubscription(subMgr, "112", "210", now + 30, lappedHandle);
+      CPPUNIT_ASSERT(subMgr.dialogExists(lappedHandle));
+      subMgr.removeOldSubscriptions(now + 52);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(lappedHandle));
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 0);
+   }
+
+   // The first sweep of a manager covers the whole wheel.
+   void firstSweepTest()
+   {
+      OsMsgQ msgQ("SipSubscriptionMgrTest::firstSweepTest::msgQ");
+      SipSubscriptionMgr subMgr;
+      subMgr.initialize(&msgQ);
+      SipDialogMgr* dialogMgr = subMgr.getDialogMgr();
+
+      long now = OsDateTime::getSecsSinceEpoch();
+
+      UtlString pastHandle, soonHandle, laterHandle;
+      insertSubscription(subMgr, "120", "220", now - 300, pastHandle);
+      insertSubscription(subMgr, "121", "220", now + 10, soonHandle);
+      insertSubscription(subMgr, "122", "220", now + 300, laterHandle);
+
+      subMgr.removeOldSubscriptions(now);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(pastHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(soonHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(laterHandle));
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 2);
+
+      subMgr.removeOldSubscriptions(now + 11);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(soonHandle));
+      CPPUNIT_ASSERT(subMgr.dialogExists(laterHandle));
+
+      subMgr.removeOldSubscriptions(now + 301);
+      CPPUNIT_ASSERT(!subMgr.dialogExists(laterHandle));
+      CPPUNIT_ASSERT(dialogMgr->countDialogs() == 0);
+   }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(SipSubscriptionMgrTest);
@@ -0,0 +1,171 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <string.h>
+
+#include <net/SipMessage.h>
+#include <net/SipTokens.h>
+#include <utl/UtlString.h>
+
+/**
+ * Unit tests for the interned SIP tokens.
+ */
+class SipTokensTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipTokensTest);
+
+   CPPUNIT_TEST(testTablesRoundTrip);
+   CPPUNIT_TEST(testMethods);
+   CPPUNIT_TEST(testHeaders);
+   CPPUNIT_TEST(testEventPackages);
+   CPPUNIT_TEST(testMessageMethod);
+   CPPUNIT_TEST(testFieldNames);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   // Every name is found in its slot, whatever its case where case is
+   // ignored; this fails if a name added to a table collides with another.
+   void testTablesRoundTrip()
+   {
+      for (int m = SipTokens::METHOD_UNKNOWN + 1; m < SipTokens::METHOD_COUNT; m++)
+      {
+         SipTokens::Method method = (SipTokens::Method) m;
+         CPPUNIT_ASSERT_EQUAL(method, SipTokens::method(SipTokens::methodName(method)));
+      }
+
+      for (int h = SipTokens::HEADER_UNKNOWN + 1; h < SipTokens::HEADER_COUNT; h++)
+      {
+         SipTokens::Header header = (SipTokens::Header) h;
+         UtlString name(SipTokens::headerName(header));
+         CPPUNIT_ASSERT_EQUAL(header, SipTokens::header(name.data()));
+         name.toLower();
+         CPPUNIT_ASSERT_EQUAL(header, SipTokens::header(name.data()));
+
+         const char* compactName = SipTokens::headerCompactName(header);
+         if (compactName)
+         {
+            CPPUNIT_ASSERT_EQUAL(header, SipTokens::header(compactName));
+         }
+      }
+
+      for (int e = SipTokens::EVENT_UNKNOWN + 1; e < SipTokens::EVENT_COUNT; e++)
+      {
+         SipTokens::EventPackage package = (SipTokens::EventPackage) e;
+         UtlString name(SipTokens::eventPackageName(package));
+         CPPUNIT_ASSERT_EQUAL(package, SipTokens::eventPackage(name.data()));
+         name.toUpper();
+         CPPUNIT_ASSERT_EQUAL(package, SipTokens::eventPackage(name.data()));
+      }
+   }
+
+   void testMethods()
+   {
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_INVITE, SipTokens::method(SIP_INVITE_METHOD));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_SUBSCRIBE, SipTokens::method("SUBSCRIBE xyz", 9));
+
+      // Methods are case-sensitive.
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, SipTokens::method("invite"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, SipTokens::method("INVITES"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, SipTokens::method("FOO"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, SipTokens::method("A"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, SipTokens::method(""));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, SipTokens::method((const char*) NULL));
+      ASSERT_STR_EQUAL("", SipTokens::methodName(SipTokens::METHOD_UNKNOWN));
+   }
+
+   void testHeaders()
+   {
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_CALL_ID, SipTokens::header("Call-ID"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_CALL_ID, SipTokens::header("i"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_VIA, SipTokens::header("V"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_UNKNOWN, SipTokens::header("X-Unknown"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_UNKNOWN, SipTokens::header("Q"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_UNKNOWN, SipTokens::header("-"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::HEADER_UNKNOWN, SipTokens::header(""));
+
+      ASSERT_STR_EQUAL(SIP_CONTENT_LENGTH_FIELD,
+                       SipTokens::headerName(SipTokens::HEADER_CONTENT_LENGTH));
+      ASSERT_STR_EQUAL(SIP_SHORT_CONTENT_LENGTH_FIELD,
+                       SipTokens::headerCompactName(SipTokens::HEADER_CONTENT_LENGTH));
+      CPPUNIT_ASSERT(NULL == SipTokens::headerCompactName(SipTokens::HEADER_CSEQ));
+
+      CPPUNIT_ASSERT(SipTokens::isUrlHeaderDisallowed(SipTokens::HEADER_VIA));
+      CPPUNIT_ASSERT(!SipTokens::isUrlHeaderDisallowed(SipTokens::HEADER_EXPIRES));
+      CPPUNIT_ASSERT(!SipTokens::isUrlHeaderDisallowed(SipTokens::HEADER_UNKNOWN));
+      CPPUNIT_ASSERT(SipTokens::isUrlHeaderUnique(SipTokens::HEADER_EXPIRES));
+      CPPUNIT_ASSERT(!SipTokens::isUrlHeaderUnique(SipTokens::HEADER_VIA));
+   }
+
+   void testEventPackages()
+   {
+      CPPUNIT_ASSERT_EQUAL(SipTokens::EVENT_DIALOG, SipTokens::eventPackage("dialog"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::EVENT_DIALOG, SipTokens::eventPackage("dialog;sla", 6));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::EVENT_MESSAGE_SUMMARY,
+                           SipTokens::eventPackage(SIP_EVENT_MESSAGE_SUMMARY));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::EVENT_UNKNOWN, SipTokens::eventPackage("dialog;sla"));
+      CPPUNIT_ASSERT_EQUAL(SipTokens::EVENT_UNKNOWN, SipTokens::eventPackage("x-private"));
+   }
+
+   // SipMessage records the method of a request when its first line is set.
+   void testMessageMethod()
+   {
+      const char* invite =
+         "INVITE sip:user@example.com SIP/2.0\r\n"
+         "Call-Id: tokens-test\r\n"
+         "Cseq: 1 INVITE\r\n"
+         "Content-Length: 0\r\n"
+         "\r\n";
+      SipMessage request(invite);
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_INVITE, request.getMethodId());
+
+      SipMessage copy(request);
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_INVITE, copy.getMethodId());
+
+      copy.setFirstHeaderLine("NOTIFY sip:user@example.com SIP/2.0");
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_NOTIFY, copy.getMethodId());
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_INVITE, request.getMethodId());
+
+      request = copy;
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_NOTIFY, request.getMethodId());
+
+      SipMessage response;
+      response.setResponseFirstHeaderLine(SIP_PROTOCOL_VERSION, 200, "OK");
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, response.getMethodId());
+
+      SipMessage extension("FOO sip:user@example.com SIP/2.0\r\n\r\n");
+      CPPUNIT_ASSERT_EQUAL(SipTokens::METHOD_UNKNOWN, extension.getMethodId());
+   }
+
+   void testFieldNames()
+   {
+      UtlString name;
+      CPPUNIT_ASSERT(SipMessage::getShortName(SIP_CONTACT_FIELD, &name));
+      ASSERT_STR_EQUAL(SIP_SHORT_CONTACT_FIELD, name.data());
+      CPPUNIT_ASSERT(!SipMessage::getShortName(SIP_CSEQ_FIELD, &name));
+      CPPUNIT_ASSERT(name.isNull());
+
+      CPPUNIT_ASSERT(SipMessage::getLongName(SIP_SHORT_EVENT_FIELD, &name));
+      ASSERT_STR_EQUAL(SIP_EVENT_FIELD, name.data());
+      CPPUNIT_ASSERT(!SipMessage::getLongName(SIP_EVENT_FIELD, &name));
+
+      CPPUNIT_ASSERT(!SipMessage::isUrlHeaderAllowed("Contact"));
+      CPPUNIT_ASSERT(!SipMessage::isUrlHeaderAllowed("f"));
+      CPPUNIT_ASSERT(SipMessage::isUrlHeaderAllowed("Subject"));
+      CPPUNIT_ASSERT(SipMessage::isUrlHeaderAllowed("X-Private"));
+      CPPUNIT_ASSERT(SipMessage::isUrlHeaderUnique("expires"));
+      CPPUNIT_ASSERT(!SipMessage::isUrlHeaderUnique("Subject"));
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipTokensTest);
@@ -0,0 +1,458 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <net/SipMessage.h>
+#include <net/SipSrvLookup.h>
+#include <net/SipTransaction.h>
+#include <net/SipUserAgent.h>
+#include <net/Url.h>
+#include <utl/UtlString.h>
+
+#define WAIT_MSECS    2000
+#define SETTLE_MSECS  200
+
+// A loopback UDP socket on a port chosen by the kernel.
+static int bindLoopback(int& port)
+{
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   bind(fd, (struct sockaddr*) &address, sizeof(address));
+   socklen_t length = sizeof(address);
+   getsockname(fd, (struct sockaddr*) &address, &length);
+   port = ntohs(address.sin_port);
+   return fd;
+}
+
+// A loopback UDP port that nothing is bound to.
+static int freePort()
+{
+   int port;
+   close(bindLoopback(port));
+   return port;
+}
+
+// Wait up to msecs for a message on fd, and return it or NULL.
+static SipMessage* receive(int fd, int msecs)
+{
+   struct pollfd ready;
+   ready.fd = fd;
+   ready.events = POLLIN;
+   ready.revents = 0;
+   if (poll(&ready, 1, msecs) <= 0)
+   {
+      return NULL;
+   }
+
+   char buffer[16384];
+   ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+   if (length <= 0)
+   {
+      return NULL;
+   }
+   return new SipMessage(buffer, length);
+}
+
+static void sendTo(int fd, int port, const SipMessage& message)
+{
+   UtlString bytes;
+   ssize_t length;
+   message.getBytes(&bytes, &length);
+
+   struct sockaddr_in to;
+   memset(&to, 0, sizeof(to));
+   to.sin_family = AF_INET;
+   to.sin_port = htons(port);
+   to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   sendto(fd, bytes.data(), length, 0, (struct sockaddr*) &to, sizeof(to));
+}
+
+// Wait up to msecs for an INVITE on fd whose request URI has user, and return it or NULL.
+static SipMessage* receiveInvite(int fd, const char* user, int msecs)
+{
+   SipMessage* message;
+   while ((message = receive(fd, msecs)))
+   {
+      UtlString method;
+      message->getRequestMethod(&method);
+      if (!message->isResponse() && method.compareTo(SIP_INVITE_METHOD) == 0)
+      {
+         UtlString uri;
+         message->getRequestUri(&uri);
+         Url url(uri, TRUE);
+         UtlString userId;
+         url.getUserId(userId);
+         if (userId.compareTo(user) == 0)
+         {
+            return message;
+         }
+      }
+      delete message;
+   }
+   return NULL;
+}
+
+// Drop whatever is still arriving, e.g. ACKs and retransmissions.
+static void drain(int fd)
+{
+   SipMessage* message;
+   while ((message = receive(fd, SETTLE_MSECS)))
+   {
+      delete message;
+   }
+}
+
+// A batch of count transactions to cancel, told apart by their hashes.
+static SipUserAgent::CancelBatch* batchOf(int count, const char* name)
+{
+   SipUserAgent::CancelBatch* batch = new SipUserAgent::CancelBatch();
+   batch->transactions.resize(count);
+   for (int i = 0; i < count; i++)
+   {
+      batch->transactions[i].hash = name;
+      batch->transactions[i].hash.appendNumber(i);
+      batch->transactions[i].ptr = NULL;
+   }
+   return batch;
+}
+
+// Queue a batch on a thread that waits for started to be unlocked first.
+static void enqueueWhenStarted(SipUserAgent* userAgent,
+                               SipUserAgent::CancelBatch* batch,
+                               boost::mutex* started)
+{
+   boost::mutex::scoped_lock lock(*started);
+   userAgent->enqueueCancelMessages(batch);
+}
+
+/**
+ * Unit tests for forking by SipTransaction and the cancel queue of SipUserAgent.
+ */
+class SipTransactionTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipTransactionTest);
+
+   CPPUNIT_TEST(testSameLookup);
+   CPPUNIT_TEST(testCopyDestinations);
+   CPPUNIT_TEST(testNextQvalueWhenDeferredBranchesFail);
+   CPPUNIT_TEST(testNoNextQvalueWhenOneBranchStarts);
+   CPPUNIT_TEST(testCancelFollowUps);
+   CPPUNIT_TEST(testCancelQueueFull);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   typedef SipTransaction::ForkBatch::Lookup Lookup;
+
+   Lookup lookupOf(SipTransaction& child, const char* address, int port,
+                   OsSocket::IpProtocolSocketType protocol, const char* scheme)
+   {
+      child.mSendToAddress = address;
+      child.mSendToPort = port;
+      child.mSendToProtocol = protocol;
+
+      Lookup lookup;
+      lookup.child = &child;
+      lookup.scheme = scheme;
+      lookup.msgSizeProtocol = OsSocket::UDP;
+      lookup.destinations = NULL;
+      lookup.sameAs = 0;
+      return lookup;
+   }
+
+   // Branches to the same next hop share one lookup; any difference in the
+   // address, port, transport or scheme needs a lookup of its own.
+   void testSameLookup()
+   {
+      SipTransaction first;
+      SipTransaction second;
+      Lookup a = lookupOf(first, "edge.example.com", 5060, OsSocket::UDP, "sip");
+
+      Lookup b = lookupOf(second, "EDGE.example.com", 5060, OsSocket::UDP, "sip");
+      CPPUNIT_ASSERT(SipTransaction::ForkBatch::isSameLookup(a, b));
+      CPPUNIT_ASSERT(SipTransaction::ForkBatch::isSameLookup(b, a));
+
+      b = lookupOf(second, "other.example.com", 5060, OsSocket::UDP, "sip");
+      CPPUNIT_ASSERT(!SipTransaction::ForkBatch::isSameLookup(a, b));
+
+      b = lookupOf(second, "edge.example.com", 5070, OsSocket::UDP, "sip");
+      CPPUNIT_ASSERT(!SipTransaction::ForkBatch::isSameLookup(a, b));
+
+      b = lookupOf(second, "edge.example.com", 5060, OsSocket::TCP, "sip");
+      CPPUNIT_ASSERT(!SipTransaction::ForkBatch::isSameLookup(a, b));
+
+      b = lookupOf(second, "edge.example.com", 5060, OsSocket::UDP, "sips");
+      CPPUNIT_ASSERT(!SipTransaction::ForkBatch::isSameLookup(a, b));
+
+      b = lookupOf(second, "edge.example.com", 5060, OsSocket::UDP, "sip");
+      b.msgSizeProtocol = OsSocket::TCP;
+      CPPUNIT_ASSERT(!SipTransaction::ForkBatch::isSameLookup(a, b));
+   }
+
+   // A shared list of destinations is copied with its terminator, and owns its host names.
+   void testCopyDestinations()
+   {
+      server_t* destinations =
+         SipSrvLookup::servers("127.0.0.1", "sip", OsSocket::UDP, 5070);
+      CPPUNIT_ASSERT(destinations[0].isValidServerT());
+      CPPUNIT_ASSERT(!destinations[1].isValidServerT());
+
+      server_t* copy = SipTransaction::ForkBatch::copyDestinations(destinations);
+      CPPUNIT_ASSERT(copy[0].isValidServerT());
+      CPPUNIT_ASSERT(!copy[1].isValidServerT());
+      CPPUNIT_ASSERT(copy[0].host != destinations[0].host);
+      ASSERT_STR_EQUAL(destinations[0].host, copy[0].host);
+      CPPUNIT_ASSERT_EQUAL(5070, copy[0].getPortFromServerT());
+      CPPUNIT_ASSERT_EQUAL(OsSocket::UDP, copy[0].getProtocolFromServerT());
+
+      // Each branch deletes its own list.
+      delete[] destinations;
+      ASSERT_STR_EQUAL("127.0.0.1", copy[0].host);
+      delete[] copy;
+
+      // A list with no destinations copies to just the terminator.
+      destinations = SipSrvLookup::servers("[::1]", "sip", OsSocket::UDP, 5070);
+      CPPUNIT_ASSERT(!destinations[0].isValidServerT());
+      copy = SipTransaction::ForkBatch::copyDestinations(destinations);
+      CPPUNIT_ASSERT(!copy[0].isValidServerT());
+      delete[] destinations;
+      delete[] copy;
+   }
+
+   // Send an INVITE from userAgent to fd, and redirect it to contacts.
+   void redirect(SipUserAgent& userAgent, int fd, int port, int uaPort,
+                 const char* callId, const std::vector<UtlString>& contacts)
+   {
+      UtlString target("sip:fork@127.0.0.1:");
+      target.appendNumber(port);
+
+      SipMessage invite;
+      invite.setRequestData(SIP_INVITE_METHOD, target, "<sip:caller@127.0.0.1>;tag=c",
+                            target, callId);
+      CPPUNIT_ASSERT(userAgent.send(invite));
+
+      SipMessage* request = receiveInvite(fd, "fork", WAIT_MSECS);
+      CPPUNIT_ASSERT(request);
+
+      SipMessage response;
+      response.setResponseData(request, SIP_TEMPORARY_MOVE_CODE, SIP_TEMPORARY_MOVE_TEXT);
+      response.setToFieldTag("redirect");
+      for (size_t i = 0; i < contacts.size(); i++)
+      {
+         response.addHeaderField(SIP_CONTACT_FIELD, contacts[i]);
+      }
+      delete request;
+
+      sendTo(fd, uaPort, response);
+   }
+
+   // Answer the INVITE of a branch with a failure, so that the call ends.
+   void decline(int fd, int uaPort, SipMessage* request)
+   {
+      SipMessage response;
+      response.setResponseData(request, SIP_BUSY_CODE, SIP_BUSY_TEXT);
+      response.setToFieldTag("branch");
+      sendTo(fd, uaPort, response);
+      delete request;
+   }
+
+   UtlString contactAt(const char* user, const char* host, int port, const char* q)
+   {
+      UtlString contact("<sip:");
+      contact.append(user);
+      contact.append("@");
+      contact.append(host);
+      if (port != PORT_NONE)
+      {
+         contact.append(":");
+         contact.appendNumber(port);
+      }
+      contact.append(">;q=");
+      contact.append(q);
+      return contact;
+   }
+
+   // The lookups of IPv6 literals find no destinations, so every branch of
+   // the highest q-value fails in its ForkBatch, and the next q-value is tried.
+   void testNextQvalueWhenDeferredBranchesFail()
+   {
+      int port;
+      int fd = bindLoopback(port);
+      int uaPort = freePort();
+
+      SipUserAgent userAgent(PORT_NONE, uaPort, PORT_NONE,
+                             "127.0.0.1", NULL, "127.0.0.1");
+      userAgent.start();
+
+      std::vector<UtlString> contacts;
+      contacts.push_back(contactAt("first", "[::1]", PORT_NONE, "1.0"));
+      contacts.push_back(contactAt("second", "[::2]", PORT_NONE, "1.0"));
+      contacts.push_back(contactAt("fallback", "127.0.0.1", port, "0.5"));
+      redirect(userAgent, fd, port, uaPort, "fork-fail", contacts);
+
+      SipMessage* request = receiveInvite(fd, "fallback", WAIT_MSECS);
+      CPPUNIT_ASSERT_MESSAGE("the branch of the next q-value was not started", request);
+      decline(fd, uaPort, request);
+
+      drain(fd);
+      userAgent.shutdown(TRUE);
+      close(fd);
+   }
+
+   // A branch of the highest q-value that can be sent keeps the next q-value waiting.
+   void testNoNextQvalueWhenOneBranchStarts()
+   {
+      int port;
+      int fd = bindLoopback(port);
+      int uaPort = freePort();
+
+      SipUserAgent userAgent(PORT_NONE, uaPort, PORT_NONE,
+                             "127.0.0.1", NULL, "127.0.0.1");
+      userAgent.start();
+
+      std::vector<UtlString> contacts;
+      contacts.push_back(contactAt("first", "[::1]", PORT_NONE, "1.0"));
+      contacts.push_back(contactAt("second", "127.0.0.1", port, "1.0"));
+      contacts.push_back(contactAt("fallback", "127.0.0.1", port, "0.5"));
+      redirect(userAgent, fd, port, uaPort, "fork-one", contacts);
+
+      SipMessage* request = receiveInvite(fd, "second", WAIT_MSECS);
+      CPPUNIT_ASSERT_MESSAGE("the branch that can be sent was not started", request);
+
+      SipMessage* fallback = receiveInvite(fd, "fallback", SETTLE_MSECS);
+      CPPUNIT_ASSERT_MESSAGE("the branch of the next q-value was started too", !fallback);
+
+      // Ringing keeps the branch from timing out while the test checks.
+      SipMessage ringing;
+      ringing.setResponseData(request, SIP_RINGING_CODE, SIP_RINGING_TEXT);
+      ringing.setToFieldTag("branch");
+      sendTo(fd, uaPort, ringing);
+      decline(fd, uaPort, request);
+
+      drain(fd);
+      userAgent.shutdown(TRUE);
+      close(fd);
+   }
+
+   // Stop the cancel thread of userAgent, so that its queue only fills.
+   void stopCancelThread(SipUserAgent& userAgent)
+   {
+      userAgent._cancelQueue.terminate();
+      userAgent._pCancelQueueThread->join();
+      delete userAgent._pCancelQueueThread;
+      userAgent._pCancelQueueThread = NULL;
+   }
+
+   // Cancels queued on the cancel thread while it processes a batch, such
+   // as those of the DNS children of a canceled transaction, join that batch.
+   void testCancelFollowUps()
+   {
+      SipUserAgent userAgent(PORT_NONE, freePort(), PORT_NONE,
+                             "127.0.0.1", NULL, "127.0.0.1");
+      stopCancelThread(userAgent);
+
+      SipUserAgent::CancelBatch followUps;
+      userAgent._pCancelFollowUps = &followUps;
+
+      // Another thread queues its batch.
+      SipUserAgent::CancelBatch* queued = batchOf(2, "queued-");
+      userAgent.enqueueCancelMessages(queued);
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, userAgent._cancelQueue.size());
+      CPPUNIT_ASSERT(followUps.transactions.empty());
+
+      // The cancel thread appends its batch to the follow-ups.
+      boost::mutex started;
+      {
+         boost::mutex::scoped_lock lock(started);
+         userAgent._pCancelQueueThread =
+            new boost::thread(boost::bind(&enqueueWhenStarted,
+                                          &userAgent, batchOf(3, "child-"), &started));
+      }
+      userAgent._pCancelQueueThread->join();
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 1, userAgent._cancelQueue.size());
+      CPPUNIT_ASSERT_EQUAL((size_t) 3, followUps.transactions.size());
+      ASSERT_STR_EQUAL("child-0", followUps.transactions[0].hash.data());
+      ASSERT_STR_EQUAL("child-2", followUps.transactions[2].hash.data());
+
+      // Outside the processing of a batch, the cancel thread queues too.
+      userAgent._pCancelFollowUps = NULL;
+      delete userAgent._pCancelQueueThread;
+      SipUserAgent::CancelBatch* later = batchOf(1, "later-");
+      {
+         boost::mutex::scoped_lock lock(started);
+         userAgent._pCancelQueueThread =
+            new boost::thread(boost::bind(&enqueueWhenStarted,
+                                          &userAgent, later, &started));
+      }
+      userAgent._pCancelQueueThread->join();
+      delete userAgent._pCancelQueueThread;
+      userAgent._pCancelQueueThread = NULL;
+
+      CPPUNIT_ASSERT_EQUAL((size_t) 2, userAgent._cancelQueue.size());
+      CPPUNIT_ASSERT_EQUAL((size_t) 3, followUps.transactions.size());
+
+      userAgent._cancelQueue.clear();
+      delete queued;
+      delete later;
+   }
+
+   // A batch that finds the queue full is dropped, and so is an empty one.
+   void testCancelQueueFull()
+   {
+      SipUserAgent userAgent(PORT_NONE, freePort(), PORT_NONE,
+                             "127.0.0.1", NULL, "127.0.0.1");
+      stopCancelThread(userAgent);
+
+      userAgent.enqueueCancelMessages(new SipUserAgent::CancelBatch());
+      CPPUNIT_ASSERT_EQUAL((size_t) 0, userAgent._cancelQueue.size());
+
+      std::vector<SipUserAgent::CancelBatch*> queued;
+      for (;;)
+      {
+         SipUserAgent::CancelBatch* batch = batchOf(1, "queued-");
+         userAgent.enqueueCancelMessages(batch);
+         if (userAgent._cancelQueue.size() == queued.size())
+         {
+            // Dropped, and deleted by the user agent.
+            break;
+         }
+         queued.push_back(batch);
+         CPPUNIT_ASSERT(queued.size() < 100000);
+      }
+      CPPUNIT_ASSERT(!queued.empty());
+
+      userAgent.enqueueCancelMessages(batchOf(2, "dropped-"));
+      CPPUNIT_ASSERT_EQUAL(queued.size(), userAgent._cancelQueue.size());
+
+      userAgent._cancelQueue.clear();
+      for (size_t i = 0; i < queued.size(); i++)
+      {
+         delete queued[i];
+      }
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipTransactionTest);
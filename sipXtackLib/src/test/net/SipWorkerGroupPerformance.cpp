@@ -0,0 +1,322 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+// Rate of SIP messages answered by 1 to MAX_WORKERS worker processes that
+// share a UDP port on the loopback interface through SO_REUSEPORT.
+//
+// Each worker reads the datagrams the kernel gives it, parses them, steers
+// them with a SipWorkerGroup, and answers the ones it keeps, as well as the
+// ones other workers relay to it, with a 200 OK built from the request.
+// GENERATORS threads (16) in the parent drive TRANSACTIONS transactions
+// (20000 by default) between them.  Each transaction is an INVITE sent
+// from one port and a CANCEL of it sent from another, so the CANCEL often
+// reaches a worker other than the INVITE and has to be relayed; the share
+// of the messages relayed is shown next to the rate.
+//
+//    SipWorkerGroupPerformance [transactions] [max workers]
+//
+// The rate can only grow with the workers while there are idle CPUs for
+// them, so compare runs with the number of CPUs (nproc) in mind.
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// APPLICATION INCLUDES
+#include "net/SipMessage.h"
+#include "net/SipWorkerGroup.h"
+#include "os/OsDateTime.h"
+#include "os/OsTime.h"
+#include "utl/UtlString.h"
+
+// CONSTANTS
+#define DEFAULT_TRANSACTIONS 20000
+#define DEFAULT_MAX_WORKERS  16
+#define GENERATORS           16
+#define POLL_MSECS           100
+#define WAIT_MSECS           2000
+#define RELAYED_HEADER       "X-Relayed"
+
+static volatile bool gStopping = false;
+
+// Answer message on fd, and delete it.
+static void answer(int fd, SipMessage* message, bool relayed)
+{
+   SipMessage response;
+   response.setResponseData(message, 200, "OK");
+   if (relayed)
+   {
+      response.addHeaderField(RELAYED_HEADER, "1");
+   }
+
+   UtlString address;
+   int port;
+   message->getSendAddress(&address, &port);
+   delete message;
+
+   UtlString bytes;
+   ssize_t length;
+   response.getBytes(&bytes, &length);
+
+   struct sockaddr_in to;
+   memset(&to, 0, sizeof(to));
+   to.sin_family = AF_INET;
+   to.sin_port = htons(port);
+   inet_pton(AF_INET, address.data(), &to.sin_addr);
+   sendto(fd, bytes.data(), length, 0, (struct sockaddr*) &to, sizeof(to));
+}
+
+// Answer the messages other workers relay to this one.
+static void serveRelayed(SipWorkerGroup* group, int fd)
+{
+   while (!gStopping)
+   {
+      SipMessage* message = group->receive(POLL_MSECS);
+      if (message)
+      {
+         answer(fd, message, true);
+      }
+   }
+}
+
+// Answer or relay the messages read from fd.
+static void serve(SipWorkerGroup* group, int fd)
+{
+   struct pollfd ready;
+   ready.fd = fd;
+   ready.events = POLLIN;
+
+   while (!gStopping)
+   {
+      ready.revents = 0;
+      if (poll(&ready, 1, POLL_MSECS) <= 0)
+      {
+         continue;
+      }
+
+      char buffer[4096];
+      struct sockaddr_in from;
+      socklen_t fromLength = sizeof(from);
+      ssize_t length = recvfrom(fd, buffer, sizeof(buffer), 0,
+                                (struct sockaddr*) &from, &fromLength);
+      if (length <= 0)
+      {
+         continue;
+      }
+
+      char address[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &from.sin_addr, address, sizeof(address));
+      SipMessage* message = new SipMessage(buffer, length);
+      message->setSendProtocol(OsSocket::UDP);
+      message->setSendAddress(address, ntohs(from.sin_port));
+      message->setInterfaceIpPort("127.0.0.1", 0);
+
+      if (!group->steer(message))
+      {
+         answer(fd, message, false);
+      }
+   }
+}
+
+// A UDP socket on port of the loopback interface, shared with the other workers.
+static int bindShared(int port)
+{
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+   int on = 1;
+   setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_port = htons(port);
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0)
+   {
+      fprintf(stderr, "binding port %d failed: %s\n", port, strerror(errno));
+      exit(1);
+   }
+   return fd;
+}
+
+// A loopback UDP port that nothing is bound to.
+static int freePort()
+{
+   int fd = socket(AF_INET, SOCK_DGRAM, 0);
+   struct sockaddr_in address;
+   memset(&address, 0, sizeof(address));
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   bind(fd, (struct sockaddr*) &address, sizeof(address));
+   socklen_t length = sizeof(address);
+   getsockname(fd, (struct sockaddr*) &address, &length);
+   close(fd);
+   return ntohs(address.sin_port);
+}
+
+struct Counts
+{
+   int answered;
+   int relayed;
+   int failed;
+};
+
+// Send one request from fd to port and wait for its response.
+static bool exchange(int fd, int port, const char* method,
+                     const UtlString& callId, Counts& counts)
+{
+   UtlString request(method);
+   request.append(" sip:user@127.0.0.1 SIP/2.0\r\n"
+                  "Via: SIP/2.0/UDP 127.0.0.1;branch=z9hG4bK-");
+   request.append(callId);
+   request.append("\r\n"
+                  "To: <sip:user@127.0.0.1>\r\n"
+                  "From: <sip:caller@127.0.0.1>;tag=1\r\n"
+                  "Call-Id: ");
+   request.append(callId);
+   request.append("\r\n"
+                  "Cseq: 1 ");
+   request.append(method);
+   request.append("\r\n"
+                  "Max-Forwards: 70\r\n"
+                  "Content-Length: 0\r\n"
+                  "\r\n");
+
+   struct sockaddr_in to;
+   memset(&to, 0, sizeof(to));
+   to.sin_family = AF_INET;
+   to.sin_port = htons(port);
+   to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   sendto(fd, request.data(), request.length(), 0, (struct sockaddr*) &to, sizeof(to));
+
+   struct pollfd ready;
+   ready.fd = fd;
+   ready.events = POLLIN;
+   ready.revents = 0;
+   char buffer[4096];
+   ssize_t length;
+   if (   poll(&ready, 1, WAIT_MSECS) <= 0
+       || (length = recv(fd, buffer, sizeof(buffer) - 1, 0)) <= 0)
+   {
+      counts.failed++;
+      return false;
+   }
+   buffer[length] = '\0';
+
+   counts.answered++;
+   if (strstr(buffer, RELAYED_HEADER))
+   {
+      counts.relayed++;
+   }
+   return true;
+}
+
+// Run transactions transactions against port from a pair of ports.
+static void generate(int generator, int port, int transactions, Counts* counts)
+{
+   int inviteFd = socket(AF_INET, SOCK_DGRAM, 0);
+   int cancelFd = socket(AF_INET, SOCK_DGRAM, 0);
+
+   for (int t = 0; t < transactions; t++)
+   {
+      UtlString callId("perf-");
+      callId.appendNumber(generator);
+      callId.append("-");
+      callId.appendNumber(t);
+
+      if (exchange(inviteFd, port, "INVITE", callId, *counts))
+      {
+         exchange(cancelFd, port, "CANCEL", callId, *counts);
+      }
+   }
+
+   close(inviteFd);
+   close(cancelFd);
+}
+
+static void run(int workers, int transactions)
+{
+   int port = freePort();
+   SipWorkerGroup group(workers);
+   unsigned int worker = group.fork();
+
+   int fd = bindShared(port);
+   boost::thread relayed(boost::bind(serveRelayed, &group, fd));
+   if (worker > 0)
+   {
+      // Killed by stopWorkers() in the parent.
+      serve(&group, fd);
+      _exit(0);
+   }
+   boost::thread served(boost::bind(serve, &group, fd));
+
+   // Let the workers bind before the load starts.
+   usleep(200000);
+
+   OsTime start;
+   OsDateTime::getCurTimeSinceBoot(start);
+
+   Counts counts[GENERATORS];
+   boost::thread* generators[GENERATORS];
+   for (int g = 0; g < GENERATORS; g++)
+   {
+      memset(&counts[g], 0, sizeof(counts[g]));
+      generators[g] = new boost::thread(boost::bind(generate, g, port,
+                                                    transactions / GENERATORS,
+                                                    &counts[g]));
+   }
+   Counts total = { 0, 0, 0 };
+   for (int g = 0; g < GENERATORS; g++)
+   {
+      generators[g]->join();
+      delete generators[g];
+      total.answered += counts[g].answered;
+      total.relayed += counts[g].relayed;
+      total.failed += counts[g].failed;
+   }
+
+   OsTime end;
+   OsDateTime::getCurTimeSinceBoot(end);
+   OsTime elapsed = end - start;
+   double seconds = elapsed.seconds() + elapsed.usecs() / 1000000.0;
+
+   printf("%3d workers %8d messages %8.3f s %10.0f messages/s %5.1f%% relayed %5d failed\n",
+          workers, total.answered, seconds,
+          seconds > 0 ? total.answered / seconds : 0.0,
+          total.answered > 0 ? 100.0 * total.relayed / total.answered : 0.0,
+          total.failed);
+
+   gStopping = true;
+   served.join();
+   relayed.join();
+   gStopping = false;
+   group.stopWorkers();
+   close(fd);
+}
+
+int main(int argc, char* argv[])
+{
+   int transactions = argc > 1 ? atoi(argv[1]) : DEFAULT_TRANSACTIONS;
+   int maxWorkers = argc > 2 ? atoi(argv[2]) : DEFAULT_MAX_WORKERS;
+
+   printf("%d transactions, %ld CPUs\n", transactions, sysconf(_SC_NPROCESSORS_ONLN));
+   for (int workers = 1; workers <= maxWorkers; workers *= 2)
+   {
+      run(workers, transactions);
+   }
+
+   return 0;
+}
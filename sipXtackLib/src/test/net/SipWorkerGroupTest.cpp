@@ -0,0 +1,176 @@
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+//////////////////////////////////////////////////////////////////////////////
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <sipxunit/TestUtilities.h>
+
+#include <string.h>
+
+#include <net/SipMessage.h>
+#include <net/SipWorkerGroup.h>
+#include <utl/UtlString.h>
+
+static const char* gRequest =
+   "INVITE sip:user@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5070;branch=z9hG4bK-1\r\n"
+   "To: <sip:user@example.com>\r\n"
+   "From: <sip:caller@example.com>;tag=1\r\n"
+   "Call-Id: worker-test-1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+static const char* gResponse =
+   "SIP/2.0 180 Ringing\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5070;branch=z9hG4bK-1\r\n"
+   "To: <sip:user@example.com>;tag=2\r\n"
+   "From: <sip:caller@example.com>;tag=1\r\n"
+   "Call-Id: worker-test-1\r\n"
+   "Cseq: 1 INVITE\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+static const char* gNextRequest =
+   "BYE sip:user@example.com SIP/2.0\r\n"
+   "Via: SIP/2.0/UDP 10.1.1.1:5070;branch=z9hG4bK-2\r\n"
+   "To: <sip:user@example.com>;tag=2\r\n"
+   "From: <sip:caller@example.com>;tag=1\r\n"
+   "Call-Id: worker-test-1\r\n"
+   "Cseq: 2 BYE\r\n"
+   "Content-Length: 0\r\n"
+   "\r\n";
+
+/**
+ * Unit tests for SipWorkerGroup, with its workers played by one process.
+ */
+class SipWorkerGroupTest : public CppUnit::TestCase
+{
+   CPPUNIT_TEST_SUITE(SipWorkerGroupTest);
+
+   CPPUNIT_TEST(testClaim);
+   CPPUNIT_TEST(testRelayUdpRequest);
+   CPPUNIT_TEST(testClaimUnownedRequest);
+   CPPUNIT_TEST(testTcpRequestNotRelayed);
+   CPPUNIT_TEST(testRelayResponse);
+   CPPUNIT_TEST(testUnownedResponse);
+
+   CPPUNIT_TEST_SUITE_END();
+
+public:
+
+   static SipMessage* message(const char* text, OsSocket::IpProtocolSocketType protocol)
+   {
+      SipMessage* pMessage = new SipMessage(text, strlen(text));
+      pMessage->setSendProtocol(protocol);
+      pMessage->setSendAddress("10.1.1.1", 5070);
+      pMessage->setInterfaceIpPort("10.1.1.2", 5060);
+      return pMessage;
+   }
+
+   void testClaim()
+   {
+      SipWorkerGroup group(2, 60, 1024);
+      SipMessage request(gRequest, strlen(gRequest));
+      SipMessage response(gResponse, strlen(gResponse));
+      SipMessage nextRequest(gNextRequest, strlen(gNextRequest));
+
+      CPPUNIT_ASSERT_EQUAL(-1, group.getOwner(request));
+      CPPUNIT_ASSERT(group.claim(request, 1));
+      CPPUNIT_ASSERT_EQUAL(1, group.getOwner(request));
+      CPPUNIT_ASSERT_EQUAL(1, group.getOwner(response));
+      CPPUNIT_ASSERT_EQUAL(-1, group.getOwner(nextRequest));
+
+      CPPUNIT_ASSERT(group.claim(response, 0));
+      CPPUNIT_ASSERT_EQUAL(0, group.getOwner(request));
+   }
+
+   void testRelayUdpRequest()
+   {
+      SipWorkerGroup group(2, 60, 1024);
+      SipMessage* pRetransmission = message(gRequest, OsSocket::UDP);
+      CPPUNIT_ASSERT(group.claim(*pRetransmission, 1));
+
+      // steer() deletes what it relays
+      CPPUNIT_ASSERT(group.steer(pRetransmission));
+
+      group.setWorker(1);
+      SipMessage* pRelayed = group.receive(1000);
+      CPPUNIT_ASSERT(pRelayed);
+
+      UtlString callId;
+      pRelayed->getCallIdField(&callId);
+      ASSERT_STR_EQUAL("worker-test-1", callId.data());
+      UtlString address;
+      int port;
+      pRelayed->getSendAddress(&address, &port);
+      ASSERT_STR_EQUAL("10.1.1.1", address.data());
+      CPPUNIT_ASSERT_EQUAL(5070, port);
+      CPPUNIT_ASSERT_EQUAL(OsSocket::UDP, pRelayed->getSendProtocol());
+      ASSERT_STR_EQUAL("10.1.1.2", pRelayed->getInterfaceIp().data());
+      CPPUNIT_ASSERT_EQUAL(5060, pRelayed->getInterfacePort());
+
+      // the owner keeps what it reads
+      CPPUNIT_ASSERT(!group.steer(pRelayed));
+      delete pRelayed;
+
+      CPPUNIT_ASSERT(!group.receive(0));
+   }
+
+   void testClaimUnownedRequest()
+   {
+      SipWorkerGroup group(2, 60, 1024);
+      SipMessage* pRequest = message(gRequest, OsSocket::UDP);
+
+      CPPUNIT_ASSERT(!group.steer(pRequest));
+      CPPUNIT_ASSERT_EQUAL(0, group.getOwner(*pRequest));
+      delete pRequest;
+   }
+
+   void testTcpRequestNotRelayed()
+   {
+      SipWorkerGroup group(2, 60, 1024);
+      SipMessage* pRequest = message(gRequest, OsSocket::TCP);
+      CPPUNIT_ASSERT(group.claim(*pRequest, 1));
+
+      CPPUNIT_ASSERT(!group.steer(pRequest));
+      CPPUNIT_ASSERT_EQUAL(0, group.getOwner(*pRequest));
+      delete pRequest;
+
+      group.setWorker(1);
+      CPPUNIT_ASSERT(!group.receive(0));
+   }
+
+   void testRelayResponse()
+   {
+      SipWorkerGroup group(2, 60, 1024);
+      SipMessage request(gRequest, strlen(gRequest));
+      CPPUNIT_ASSERT(group.claim(request, 1));
+
+      CPPUNIT_ASSERT(group.steer(message(gResponse, OsSocket::TCP)));
+
+      group.setWorker(1);
+      SipMessage* pRelayed = group.receive(1000);
+      CPPUNIT_ASSERT(pRelayed);
+      CPPUNIT_ASSERT(pRelayed->isResponse());
+      CPPUNIT_ASSERT_EQUAL(OsSocket::TCP, pRelayed->getSendProtocol());
+      delete pRelayed;
+   }
+
+   void testUnownedResponse()
+   {
+      SipWorkerGroup group(2, 60, 1024);
+      SipMessage* pResponse = message(gResponse, OsSocket::UDP);
+
+      CPPUNIT_ASSERT(!group.steer(pResponse));
+      CPPUNIT_ASSERT_EQUAL(-1, group.getOwner(*pResponse));
+      delete pResponse;
+   }
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SipWorkerGroupTest);
@@ -165,6 +165,8 @@ class XmlRpcTest : public CppUnit::TestCase
    CPPUNIT_TEST(testXmlRpcResponseSetting);
    CPPUNIT_TEST(testIllFormattedXmlRpcRequest);
    CPPUNIT_TEST(testXmlRpcEmptyArrayParse);
+   CPPUNIT_TEST(testXmlRpcStreamedParse);
+   CPPUNIT_TEST(testXmlRpcMalformedDocument);
    CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -761,6 +763,89 @@ public:
          CPPUNIT_ASSERT(arrayParam->isEmpty());
       }
 
+   void testXmlRpcStreamedParse()
+      {
+         // comments, entities, CDATA and untyped values between the elements
+         const char *ref =
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<!-- request -->\n"
+            "<methodCall>\n"
+            "<methodName> getStatus </methodName>\n"
+            "<params>\n"
+            "<param><value><string>a &amp; b</string></value></param>\n"
+            "<param><value><string><![CDATA[<c>]]></string></value></param>\n"
+            "<param><!-- untyped --><value>plain</value></param>\n"
+            "<param><value><array><data>\n"
+            "<value><struct>\n"
+            "<member><name>n</name><!-- x --><value><i4>7</i4></value></member>\n"
+            "</struct></value>\n"
+            "</data></array></value></param>\n"
+            "</params>\n"
+            "</methodCall>\n"
+            ;
+
+         XmlRpcDispatch dispatch(8200, false, "/RPC2");
+
+         dispatch.addMethod("getStatus", AddExtension::get);
+
+         UtlString requestContent(ref);
+         XmlRpcResponse response;
+         XmlRpcMethodContainer* method;
+         UtlSList params;
+
+         bool result = dispatch.parseXmlRpcRequest(requestContent, method, params, response);
+         CPPUNIT_ASSERT(result == true);
+         CPPUNIT_ASSERT(method != NULL);
+         CPPUNIT_ASSERT_EQUAL((size_t) 4, params.entries());
+
+         ASSERT_STR_EQUAL("a & b", ((UtlString*) params.at(0))->data());
+         ASSERT_STR_EQUAL("<c>", ((UtlString*) params.at(1))->data());
+         ASSERT_STR_EQUAL("plain", ((UtlString*) params.at(2))->data());
+
+         UtlSList* arrayParam;
+         CPPUNIT_ASSERT(arrayParam = dynamic_cast<UtlSList*>(params.at(3)));
+         UtlHashMap* structValue;
+         CPPUNIT_ASSERT(structValue = dynamic_cast<UtlHashMap*>(arrayParam->at(0)));
+         UtlString memberName("n");
+         UtlInt* memberValue;
+         CPPUNIT_ASSERT(memberValue = dynamic_cast<UtlInt*>(structValue->findValue(&memberName)));
+         CPPUNIT_ASSERT_EQUAL((intptr_t) 7, memberValue->getValue());
+
+         XmlRpcBody::deallocateContainedValues(&params);
+      }
+
+   void testXmlRpcMalformedDocument()
+      {
+         // the params are fine, but the document is not
+         const char *ref =
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<methodCall>\n"
+            "<methodName>getStatus</methodName>\n"
+            "<params>\n"
+            "<param><value><int>1</int></value></param>\n"
+            "</params>\n"
+            "</methodCall>\n"
+            "<methodCall>\n"
+            ;
+
+         XmlRpcDispatch dispatch(8200, false, "/RPC2");
+
+         dispatch.addMethod("getStatus", AddExtension::get);
+
+         UtlString requestContent(ref);
+         XmlRpcResponse response;
+         XmlRpcMethodContainer* method;
+         UtlSList params;
+
+         bool result = dispatch.parseXmlRpcRequest(requestContent, method, params, response);
+         CPPUNIT_ASSERT(result == false);
+         CPPUNIT_ASSERT(params.isEmpty());
+
+         UtlString body;
+         ssize_t length;
+         response.getBody()->getBytes(&body, &length);
+         CPPUNIT_ASSERT(body.index("<int>-1</int>") != UTL_NOT_FOUND);
+      }
 
 };
 
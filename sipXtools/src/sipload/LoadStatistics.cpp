@@ -0,0 +1,189 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <algorithm>
+
+// APPLICATION INCLUDES
+#include <os/OsDateTime.h>
+#include <os/OsLock.h>
+#include <os/OsTime.h>
+#include "LoadStatistics.h"
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STATIC VARIABLE INITIALIZATIONS
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ CREATORS ================================== */
+
+LoadStatistics::LoadStatistics() :
+   mLock(OsMutex::Q_FIFO),
+   mStarted(0),
+   mSucceeded(0),
+   mFailed(0),
+   mTimedOut(0),
+   mRetransmissions(0),
+   mElapsedUsecs(0)
+{
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+void LoadStatistics::scenarioStarted()
+{
+   OsLock lock(mLock);
+   mStarted++;
+}
+
+void LoadStatistics::scenarioEnded(bool succeeded)
+{
+   OsLock lock(mLock);
+   if (succeeded)
+   {
+      mSucceeded++;
+   }
+   else
+   {
+      mFailed++;
+   }
+}
+
+void LoadStatistics::scenariosTimedOut(int count)
+{
+   OsLock lock(mLock);
+   mTimedOut += count;
+}
+
+void LoadStatistics::retransmitted()
+{
+   OsLock lock(mLock);
+   mRetransmissions++;
+}
+
+void LoadStatistics::stepEnded(const char* step, int responseCode, long long usecs)
+{
+   OsLock lock(mLock);
+   Step& stepStatistics = mSteps[step];
+   stepStatistics.mUsecs.push_back(usecs);
+   stepStatistics.mResponses[responseCode]++;
+}
+
+void LoadStatistics::setElapsed(long long usecs)
+{
+   OsLock lock(mLock);
+   mElapsedUsecs = usecs;
+}
+
+/* ============================ ACCESSORS ================================= */
+
+long long LoadStatistics::now()
+{
+   OsTime time;
+   OsDateTime::getCurTimeSinceBoot(time);
+   return time.seconds() * 1000000LL + time.usecs();
+}
+
+void LoadStatistics::writeJson(FILE* out,
+                               const char* scenario,
+                               const char* transport,
+                               double targetRate) const
+{
+   OsLock lock(mLock);
+
+   double elapsed = mElapsedUsecs / 1000000.0;
+   long ended = mSucceeded + mFailed;
+
+   fprintf(out,
+           "{\n"
+           "  \"scenario\": \"%s\",\n"
+           "  \"transport\": \"%s\",\n"
+           "  \"target_rate\": %.1f,\n"
+           "  \"elapsed_s\": %.3f,\n"
+           "  \"started\": %ld,\n"
+           "  \"succeeded\": %ld,\n"
+           "  \"failed\": %ld,\n"
+           "  \"timed_out\": %ld,\n"
+           "  \"throughput_per_s\": %.1f,\n"
+           "  \"retransmissions\": %ld,\n"
+           "  \"steps\": {",
+           scenario, transport, targetRate, elapsed,
+           mStarted, mSucceeded, mFailed, mTimedOut,
+           elapsed > 0 ? ended / elapsed : 0.0,
+           mRetransmissions);
+
+   for (std::map<std::string, Step>::const_iterator step = mSteps.begin();
+        step != mSteps.end();
+        step++)
+   {
+      std::vector<long long> sorted(step->second.mUsecs);
+      std::sort(sorted.begin(), sorted.end());
+
+      long long total = 0;
+      for (size_t i = 0; i < sorted.size(); i++)
+      {
+         total += sorted[i];
+      }
+
+      fprintf(out,
+              "%s\n"
+              "    \"%s\": {\n"
+              "      \"count\": %zu,\n"
+              "      \"mean_ms\": %.3f,\n"
+              "      \"p50_ms\": %.3f,\n"
+              "      \"p90_ms\": %.3f,\n"
+              "      \"p99_ms\": %.3f,\n"
+              "      \"max_ms\": %.3f,\n"
+              "      \"responses\": {",
+              step == mSteps.begin() ? "" : ",",
+              step->first.c_str(),
+              sorted.size(),
+              sorted.empty() ? 0.0 : total / 1000.0 / sorted.size(),
+              percentileMs(sorted, 0.50),
+              percentileMs(sorted, 0.90),
+              percentileMs(sorted, 0.99),
+              percentileMs(sorted, 1.0));
+
+      for (std::map<int, long>::const_iterator response = step->second.mResponses.begin();
+           response != step->second.mResponses.end();
+           response++)
+      {
+         fprintf(out, "%s\"%d\": %ld",
+                 response == step->second.mResponses.begin() ? "" : ", ",
+                 response->first, response->second);
+      }
+      fprintf(out, "}\n    }");
+   }
+
+   fprintf(out, "\n  }\n}\n");
+}
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+
+// Nearest rank: the smallest latency that at least fraction of them are at or below.
+double LoadStatistics::percentileMs(const std::vector<long long>& sorted, double fraction)
+{
+   if (sorted.empty())
+   {
+      return 0.0;
+   }
+
+   size_t rank = (size_t) (fraction * sorted.size() + 0.999999);
+   if (rank < 1)
+   {
+      rank = 1;
+   }
+   if (rank > sorted.size())
+   {
+      rank = sorted.size();
+   }
+   return sorted[rank - 1] / 1000.0;
+}
@@ -0,0 +1,105 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _LoadStatistics_h_
+#define _LoadStatistics_h_
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include <os/OsMutex.h>
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// What a load run measured: scenarios run, latencies and retransmissions.
+/**
+ * Latencies are kept per step of a scenario, named by the request whose
+ * final response ends the step ("INVITE", "BYE", ...), so that the
+ * percentiles of each step can be written when the run is over.
+ * All methods may be called from any thread.
+ */
+class LoadStatistics
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+public:
+
+/* ============================ CREATORS ================================== */
+
+   LoadStatistics();
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// A scenario was started.
+   void scenarioStarted();
+
+   /// A scenario ended, successfully or not.
+   void scenarioEnded(bool succeeded);
+
+   /// Scenarios were still running when the run ended.
+   void scenariosTimedOut(int count);
+
+   /// A request or response was sent again.
+   void retransmitted();
+
+   /// The final response to a step came after usecs.
+   void stepEnded(const char* step, int responseCode, long long usecs);
+
+   /// The time from the first scenario started to the last one ended.
+   void setElapsed(long long usecs);
+
+/* ============================ ACCESSORS ================================= */
+
+   /// Microseconds since boot, to time steps with.
+   static long long now();
+
+   /// Write the statistics as a JSON object.
+   void writeJson(FILE* out,
+                  const char* scenario,
+                  const char* transport,
+                  double targetRate) const;
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+private:
+
+   struct Step
+   {
+      std::vector<long long> mUsecs;
+      std::map<int, long> mResponses; // count of each final response code
+   };
+
+   /// The latency below which fraction of the sorted latencies are.
+   static double percentileMs(const std::vector<long long>& sorted, double fraction);
+
+   mutable OsMutex mLock;
+   long mStarted;
+   long mSucceeded;
+   long mFailed;
+   long mTimedOut;
+   long mRetransmissions;
+   long long mElapsedUsecs;
+   std::map<std::string, Step> mSteps;
+
+   LoadStatistics(const LoadStatistics&);
+   LoadStatistics& operator=(const LoadStatistics&);
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _LoadStatistics_h_
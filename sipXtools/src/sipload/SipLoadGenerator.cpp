@@ -0,0 +1,500 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// APPLICATION INCLUDES
+#include <os/OsLock.h>
+#include <os/OsTask.h>
+#include <net/HttpBody.h>
+#include <net/SdpBody.h>
+#include <net/SipDialogEvent.h>
+#include <net/SipMessageEvent.h>
+#include <net/SipUserAgent.h>
+#include "SipLoadGenerator.h"
+
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+
+// Seconds a REGISTER or SUBSCRIBE asks for.
+#define LOAD_EXPIRES 3600
+
+// The offer of each INVITE, so that it is as big as a real one.
+static const char* sOffer =
+   "v=0\r\n"
+   "o=sipload 1 1 IN IP4 127.0.0.1\r\n"
+   "s=sipload\r\n"
+   "c=IN IP4 127.0.0.1\r\n"
+   "t=0 0\r\n"
+   "m=audio 10000 RTP/AVP 0 8 101\r\n"
+   "a=rtpmap:0 PCMU/8000\r\n"
+   "a=rtpmap:8 PCMA/8000\r\n"
+   "a=rtpmap:101 telephone-event/8000\r\n"
+   "a=fmtp:101 0-15\r\n"
+   "a=sendrecv\r\n";
+
+// The dialog state each NOTIFY reports.
+static const char* sDialogInfo =
+   "<?xml version=\"1.0\"?>\r\n"
+   "<dialog-info xmlns=\"urn:ietf:params:xml:ns:dialog-info\" "
+   "version=\"0\" state=\"full\" entity=\"sip:sipload\"/>\r\n";
+
+// STATIC VARIABLE INITIALIZATIONS
+
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+
+/* ============================ CREATORS ================================== */
+
+LoadOptions::LoadOptions() :
+   mScenario(OPTIONS),
+   mTransport("udp"),
+   mLocalAddress("127.0.0.1"),
+   mLocalPort(5090),
+   mRate(100.0),
+   mDuration(10),
+   mUsers(1000),
+   mTimeout(32)
+{
+}
+
+const char* LoadOptions::scenarioName(Scenario scenario)
+{
+   switch (scenario)
+   {
+   case REGISTER:
+      return "register";
+   case INVITE:
+      return "invite";
+   case SUBSCRIBE:
+      return "subscribe";
+   case OPTIONS:
+      return "options";
+   }
+   return "unknown";
+}
+
+SipLoadGenerator::SipLoadGenerator(SipUserAgent& userAgent,
+                                   const LoadOptions& options,
+                                   LoadStatistics& statistics) :
+   OsServerTask("SipLoadGenerator-%d"),
+   mUserAgent(userAgent),
+   mOptions(options),
+   mStatistics(statistics),
+   mCallsLock(OsMutex::Q_FIFO),
+   mLastEnd(0)
+{
+   if (!mOptions.mTarget.isNull())
+   {
+      mRoute.append("<sip:");
+      mRoute.append(mOptions.mTarget);
+      mRoute.append(";lr");
+      if (mOptions.mTransport.compareTo("udp") != 0)
+      {
+         mRoute.append(";transport=");
+         mRoute.append(mOptions.mTransport);
+      }
+      mRoute.append(">");
+   }
+
+   mUserAgent.addMessageObserver(*getMessageQueue(),
+                                 NULL,  // all methods
+                                 TRUE,  // requests
+                                 TRUE,  // responses
+                                 TRUE,  // incoming
+                                 FALSE  // outgoing
+      );
+}
+
+SipLoadGenerator::~SipLoadGenerator()
+{
+   mUserAgent.removeMessageObserver(*getMessageQueue());
+   waitUntilShutDown();
+}
+
+/* ============================ MANIPULATORS ============================== */
+
+void SipLoadGenerator::generate()
+{
+   int scenarios = (int) (mOptions.mRate * mOptions.mDuration);
+   long long start = LoadStatistics::now();
+
+   for (int number = 0; number < scenarios; )
+   {
+      // Start each scenario when it is due; when behind, catch up at once.
+      long long due = start + (long long) (number * 1000000.0 / mOptions.mRate);
+      long long now = LoadStatistics::now();
+      if (now < due)
+      {
+         OsTask::delay((int) ((due - now + 999) / 1000));
+      }
+      else
+      {
+         startScenario(number++);
+      }
+   }
+
+   // Wait for the scenarios still running.
+   long long deadline = LoadStatistics::now() + mOptions.mTimeout * 1000000LL;
+   while (true)
+   {
+      {
+         OsLock lock(mCallsLock);
+         if (mCalls.empty() || LoadStatistics::now() >= deadline)
+         {
+            long long end = mCalls.empty() && mLastEnd ? mLastEnd : LoadStatistics::now();
+            mStatistics.scenariosTimedOut(mCalls.size());
+            mCalls.clear();
+            mStatistics.setElapsed(end - start);
+            break;
+         }
+      }
+      OsTask::delay(10);
+   }
+}
+
+UtlBoolean SipLoadGenerator::handleMessage(OsMsg& message)
+{
+   if (message.getMsgType() != OsMsg::PHONE_APP)
+   {
+      return FALSE;
+   }
+
+   SipMessageEvent& event = dynamic_cast<SipMessageEvent&>(message);
+   const SipMessage* sipMessage = event.getMessage();
+   if (!sipMessage)
+   {
+      return TRUE;
+   }
+
+   if (event.getMessageStatus() == SipMessageEvent::TRANSPORT_ERROR)
+   {
+      // The request could not be sent, or was not answered.
+      UtlString callId;
+      sipMessage->getCallIdField(&callId);
+
+      OsLock lock(mCallsLock);
+      Calls::iterator call = mCalls.find(callId.data());
+      if (call != mCalls.end())
+      {
+         endScenario(call, false);
+      }
+   }
+   else if (sipMessage->isResponse())
+   {
+      handleResponse(*sipMessage);
+   }
+   else
+   {
+      handleRequest(*sipMessage);
+   }
+
+   return TRUE;
+}
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+
+void SipLoadGenerator::startScenario(int number)
+{
+   char buffer[100];
+
+   snprintf(buffer, sizeof(buffer), "load%d", number % mOptions.mUsers);
+   UtlString user(buffer);
+
+   snprintf(buffer, sizeof(buffer), "sipload-%d-%d@%s",
+            getpid(), number, mOptions.mLocalAddress.data());
+   UtlString callId(buffer);
+
+   UtlString aor("sip:");
+   aor.append(user);
+   aor.append("@");
+   aor.append(mOptions.mDomain);
+   aor = nameAddr(aor);
+
+   UtlString from(aor);
+   snprintf(buffer, sizeof(buffer), ";tag=%x", number);
+   from.append(buffer);
+
+   UtlString localContact;
+   contact(localContact, user);
+   localContact = nameAddr(localContact);
+
+   UtlString domainUri("sip:");
+   domainUri.append(mOptions.mDomain);
+
+   // Requests for the called user are addressed to the generator itself.
+   UtlString calleeUri;
+   contact(calleeUri, "callee");
+
+   SipMessage request;
+   const char* step = NULL;
+   switch (mOptions.mScenario)
+   {
+   case LoadOptions::REGISTER:
+      request.setRegisterData(from, aor, domainUri, localContact,
+                              callId, 1, LOAD_EXPIRES);
+      step = SIP_REGISTER_METHOD;
+      break;
+
+   case LoadOptions::INVITE:
+      request.setRequestData(SIP_INVITE_METHOD, calleeUri, from, nameAddr(calleeUri),
+                             callId, 1, localContact);
+      request.setBody(new HttpBody(sOffer, strlen(sOffer), SDP_CONTENT_TYPE));
+      request.setContentType(SDP_CONTENT_TYPE);
+      request.setContentLength(strlen(sOffer));
+      step = SIP_INVITE_METHOD;
+      break;
+
+   case LoadOptions::SUBSCRIBE:
+      request.setSubscribeData(calleeUri, from, nameAddr(calleeUri), callId, 1,
+                               DIALOG_EVENT_TYPE, DIALOG_EVENT_CONTENT_TYPE,
+                               NULL, localContact, NULL, LOAD_EXPIRES);
+      step = SIP_SUBSCRIBE_METHOD;
+      break;
+
+   case LoadOptions::OPTIONS:
+      request.setRequestData(SIP_OPTIONS_METHOD, domainUri, from, nameAddr(domainUri),
+                             callId, 1, localContact);
+      step = SIP_OPTIONS_METHOD;
+      break;
+   }
+
+   if (!mRoute.isNull())
+   {
+      request.addRouteUri(mRoute);
+   }
+
+   long long now = LoadStatistics::now();
+   {
+      OsLock lock(mCallsLock);
+      Call& call = mCalls[callId.data()];
+      call.mStep = step;
+      call.mStepStart = now;
+      call.mStart = now;
+      call.mRequest = request;
+      call.mSubscribed = false;
+      call.mNotified = false;
+   }
+   mStatistics.scenarioStarted();
+
+   if (!mUserAgent.send(request))
+   {
+      OsLock lock(mCallsLock);
+      Calls::iterator call = mCalls.find(callId.data());
+      if (call != mCalls.end())
+      {
+         endScenario(call, false);
+      }
+   }
+}
+
+void SipLoadGenerator::handleResponse(const SipMessage& response)
+{
+   int code = response.getResponseStatusCode();
+   if (code < SIP_2XX_CLASS_CODE)
+   {
+      return;
+   }
+
+   UtlString callId;
+   response.getCallIdField(&callId);
+   int cseq;
+   UtlString method;
+   response.getCSeqField(&cseq, &method);
+
+   OsLock lock(mCallsLock);
+   Calls::iterator found = mCalls.find(callId.data());
+   if (found == mCalls.end() || method.compareTo(found->second.mStep) != 0)
+   {
+      // a retransmission, or the end of a scenario that timed out
+      return;
+   }
+   Call& call = found->second;
+
+   endStep(call, code);
+   if (code >= SIP_3XX_CLASS_CODE)
+   {
+      endScenario(found, false);
+      return;
+   }
+
+   if (method.compareTo(SIP_INVITE_METHOD) == 0)
+   {
+      // The call is up: ACK it and hang up.
+      UtlString localContact;
+      call.mRequest.getContactField(0, localContact);
+
+      SipMessage ack;
+      ack.setAckData(&response, &call.mRequest, localContact);
+      mUserAgent.send(ack);
+
+      UtlString remoteContact;
+      response.getContactUri(0, &remoteContact);
+      UtlString route;
+      response.buildRouteField(&route);
+
+      SipMessage bye;
+      bye.setByeData(&response, remoteContact, TRUE, 2,
+                     route.isNull() ? NULL : route.data(), NULL, localContact);
+
+      call.mStep = SIP_BYE_METHOD;
+      call.mStepStart = LoadStatistics::now();
+      if (!mUserAgent.send(bye))
+      {
+         endScenario(found, false);
+      }
+   }
+   else if (method.compareTo(SIP_SUBSCRIBE_METHOD) == 0)
+   {
+      // The NOTIFY may come before the response to the SUBSCRIBE.
+      call.mSubscribed = true;
+      if (call.mNotified)
+      {
+         endScenario(found, true);
+      }
+   }
+   else
+   {
+      endScenario(found, true);
+   }
+}
+
+void SipLoadGenerator::handleRequest(const SipMessage& request)
+{
+   UtlString method;
+   request.getRequestMethod(&method);
+
+   if (method.compareTo(SIP_INVITE_METHOD) == 0)
+   {
+      respond(request, SIP_OK_CODE, SIP_OK_TEXT);
+   }
+   else if (method.compareTo(SIP_BYE_METHOD) == 0)
+   {
+      respond(request, SIP_OK_CODE, SIP_OK_TEXT);
+   }
+   else if (method.compareTo(SIP_SUBSCRIBE_METHOD) == 0)
+   {
+      UtlString tag = respond(request, SIP_ACCEPTED_CODE, SIP_ACCEPTED_TEXT);
+
+      SipMessage notify;
+      notify.setNotifyData(&request, 1, NULL, "active;expires=3600", DIALOG_EVENT_TYPE);
+      notify.setFromFieldTag(tag);
+      notify.setBody(new HttpBody(sDialogInfo, strlen(sDialogInfo),
+                                  DIALOG_EVENT_CONTENT_TYPE));
+      notify.setContentType(DIALOG_EVENT_CONTENT_TYPE);
+      notify.setContentLength(strlen(sDialogInfo));
+      mUserAgent.send(notify);
+   }
+   else if (method.compareTo(SIP_NOTIFY_METHOD) == 0)
+   {
+      respond(request, SIP_OK_CODE, SIP_OK_TEXT);
+
+      UtlString callId;
+      request.getCallIdField(&callId);
+
+      OsLock lock(mCallsLock);
+      Calls::iterator found = mCalls.find(callId.data());
+      if (found != mCalls.end() && !found->second.mNotified)
+      {
+         Call& call = found->second;
+         call.mNotified = true;
+         mStatistics.stepEnded(SIP_NOTIFY_METHOD, SIP_OK_CODE,
+                               LoadStatistics::now() - call.mStart);
+         if (call.mSubscribed)
+         {
+            endScenario(found, true);
+         }
+      }
+   }
+   // ACK needs no answer; the user agent answers other methods itself.
+}
+
+UtlString SipLoadGenerator::respond(const SipMessage& request, int code, const char* text)
+{
+   UtlString localContact;
+   contact(localContact, "callee");
+   localContact = nameAddr(localContact);
+
+   SipMessage response;
+   response.setResponseData(&request, code, text, localContact);
+
+   // Requests that start a dialog get a To tag.
+   UtlString tag;
+   Url to;
+   request.getToUrl(to);
+   to.getFieldParameter("tag", tag);
+   if (tag.isNull())
+   {
+      UtlString callId;
+      request.getCallIdField(&callId);
+      tag.appendNumber((int) callId.hash(), "%x");
+      response.setToFieldTag(tag);
+   }
+
+   mUserAgent.send(response);
+   return tag;
+}
+
+void SipLoadGenerator::endStep(Call& call, int responseCode)
+{
+   mStatistics.stepEnded(call.mStep, responseCode,
+                         LoadStatistics::now() - call.mStepStart);
+}
+
+void SipLoadGenerator::endScenario(Calls::iterator call, bool succeeded)
+{
+   mStatistics.scenarioEnded(succeeded);
+   mCalls.erase(call);
+   mLastEnd = LoadStatistics::now();
+}
+
+void SipLoadGenerator::contact(UtlString& uri, const char* user) const
+{
+   bool tls = mOptions.mTransport.compareTo("tls") == 0;
+
+   uri = "sip:";
+   uri.append(user);
+   uri.append("@");
+   uri.append(mOptions.mLocalAddress);
+   uri.append(":");
+   uri.appendNumber(tls ? mOptions.mLocalPort + 1 : mOptions.mLocalPort);
+   if (mOptions.mTransport.compareTo("udp") != 0)
+   {
+      uri.append(";transport=");
+      uri.append(mOptions.mTransport);
+   }
+}
+
+UtlString SipLoadGenerator::nameAddr(const UtlString& uri)
+{
+   UtlString field("<");
+   field.append(uri);
+   field.append(">");
+   return field;
+}
+
+RetransmissionCounter::RetransmissionCounter(LoadStatistics& statistics) :
+   SipOutputProcessor(0),
+   mStatistics(statistics)
+{
+}
+
+void RetransmissionCounter::handleOutputMessage(SipMessage& message,
+                                                const char* address,
+                                                int port)
+{
+   // The transaction counts each send after the message is sent.
+   if (message.getTimesSent() > 0)
+   {
+      mStatistics.retransmitted();
+   }
+}
@@ -0,0 +1,161 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _SipLoadGenerator_h_
+#define _SipLoadGenerator_h_
+
+// SYSTEM INCLUDES
+#include <map>
+#include <string>
+
+// APPLICATION INCLUDES
+#include <os/OsMutex.h>
+#include <os/OsServerTask.h>
+#include <net/SipMessage.h>
+#include <net/SipOutputProcessor.h>
+#include <utl/UtlString.h>
+#include "LoadStatistics.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+class SipUserAgent;
+
+/// What to run, at what rate and against what.
+struct LoadOptions
+{
+   enum Scenario
+   {
+      REGISTER,    ///< REGISTER a contact for each user
+      INVITE,      ///< INVITE, 200, ACK, BYE, 200
+      SUBSCRIBE,   ///< SUBSCRIBE to the dialog event (BLF), 202, NOTIFY, 200
+      OPTIONS      ///< OPTIONS keepalive
+   };
+
+   Scenario mScenario;
+   UtlString mTransport;      ///< "udp", "tcp" or "tls"
+   UtlString mTarget;         ///< host:port every request is routed to first
+   UtlString mDomain;         ///< domain of the users
+   UtlString mLocalAddress;   ///< address the generator listens on
+   int mLocalPort;            ///< port the generator listens on (TLS uses the next one)
+   double mRate;              ///< scenarios started per second
+   int mDuration;             ///< seconds to start scenarios for
+   int mUsers;                ///< distinct users the scenarios cycle through
+   int mTimeout;              ///< seconds to wait for the last scenarios to end
+
+   LoadOptions();
+
+   static const char* scenarioName(Scenario scenario);
+};
+
+/// Runs SIP scenarios at a target rate and measures them.
+/**
+ * The generator is both ends of each scenario: it sends the requests
+ * through the target (a proxy, or a registrar for REGISTER), and the
+ * requests the target forwards come back to it, addressed to its own
+ * port, where it answers them as the called user agent would.  That way
+ * a single process measures what the target under test adds.
+ *
+ * Scenarios are started from the thread that calls generate(); messages
+ * received are handled on the generator's own task.
+ */
+class SipLoadGenerator : public OsServerTask
+{
+/* //////////////////////////// PUBLIC //////////////////////////////////// */
+public:
+
+/* ============================ CREATORS ================================== */
+
+   SipLoadGenerator(SipUserAgent& userAgent,
+                    const LoadOptions& options,
+                    LoadStatistics& statistics);
+
+   virtual ~SipLoadGenerator();
+
+/* ============================ MANIPULATORS ============================== */
+
+   /// Start scenarios at the target rate for the duration, then wait for them to end.
+   void generate();
+
+   virtual UtlBoolean handleMessage(OsMsg& message);
+
+/* //////////////////////////// PRIVATE /////////////////////////////////// */
+private:
+
+   /// A scenario in progress, by its Call-Id.
+   struct Call
+   {
+      const char* mStep;        ///< the request whose final response is awaited
+      long long mStepStart;     ///< when that request was sent
+      long long mStart;         ///< when the scenario started
+      SipMessage mRequest;      ///< the first request, to build the rest from
+      bool mSubscribed;         ///< SUBSCRIBE got its 2xx
+      bool mNotified;           ///< NOTIFY came
+   };
+   typedef std::map<std::string, Call> Calls;
+
+   /// Build and send the first request of scenario number.
+   void startScenario(int number);
+
+   void handleResponse(const SipMessage& response);
+
+   void handleRequest(const SipMessage& request);
+
+   /// Answer a request as the called user agent; returns the To tag.
+   UtlString respond(const SipMessage& request, int code, const char* text);
+
+   /// Record the end of the current step of call.
+   void endStep(Call& call, int responseCode);
+
+   /// Forget the scenario of call, which has ended.
+   void endScenario(Calls::iterator call, bool succeeded);
+
+   /// The contact URI of user at the generator.
+   void contact(UtlString& uri, const char* user) const;
+
+   /// uri in angle brackets, as header fields need it.
+   static UtlString nameAddr(const UtlString& uri);
+
+   SipUserAgent& mUserAgent;
+   const LoadOptions& mOptions;
+   LoadStatistics& mStatistics;
+
+   UtlString mRoute;            ///< the Route to the target
+   OsMutex mCallsLock;          ///< guards mCalls and mLastEnd
+   Calls mCalls;
+   long long mLastEnd;          ///< when the last scenario ended
+
+   SipLoadGenerator(const SipLoadGenerator&);
+   SipLoadGenerator& operator=(const SipLoadGenerator&);
+};
+
+/// Counts the requests and responses that the user agent sends again.
+class RetransmissionCounter : public SipOutputProcessor
+{
+public:
+
+   RetransmissionCounter(LoadStatistics& statistics);
+
+   virtual void handleOutputMessage(SipMessage& message,
+                                    const char* address,
+                                    int port);
+
+private:
+
+   LoadStatistics& mStatistics;
+};
+
+/* ============================ INLINE METHODS ============================ */
+
+#endif  // _SipLoadGenerator_h_
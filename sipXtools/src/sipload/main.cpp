@@ -0,0 +1,208 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// sipx-sipload: run SIP scenarios at a target rate against a proxy or
+// registrar and write what was measured as JSON.
+
+// SYSTEM INCLUDES
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// APPLICATION INCLUDES
+#include <os/OsDefs.h>
+#include <net/SipUserAgent.h>
+#include "LoadStatistics.h"
+#include "SipLoadGenerator.h"
+
+// CONSTANTS
+static const char* sUsage =
+   "Usage: %s --scenario register|invite|subscribe|options [options]\n"
+   "\n"
+   "  --target host:port     where every request is routed first\n"
+   "  --domain name          domain of the users (default: the target host)\n"
+   "  --transport udp|tcp|tls\n"
+   "                         transport to the target (default: udp)\n"
+   "  --rate n               scenarios started per second (default: 100)\n"
+   "  --duration seconds     how long to start scenarios for (default: 10)\n"
+   "  --users n              distinct users to cycle through (default: 1000)\n"
+   "  --local-address addr   address to listen on (default: 127.0.0.1)\n"
+   "  --local-port port      port to listen on; TLS uses the next one\n"
+   "                         (default: 5090)\n"
+   "  --timeout seconds      how long to wait for the last scenarios\n"
+   "                         (default: 32)\n"
+   "  --output file          where to write the JSON (default: stdout)\n"
+   "\n"
+   "Scenarios:\n"
+   "  register   REGISTER a contact for each user\n"
+   "  invite     INVITE, 200, ACK, BYE, 200 to a callee the generator plays\n"
+   "  subscribe  SUBSCRIBE to the dialog event, 202, NOTIFY, 200\n"
+   "  options    OPTIONS keepalive\n";
+
+static void usage(const char* name)
+{
+   fprintf(stderr, sUsage, name);
+   exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+   LoadOptions options;
+   bool scenarioSet = false;
+   const char* output = NULL;
+
+   for (int i = 1; i < argc; i++)
+   {
+      const char* option = argv[i];
+      if (i + 1 >= argc)
+      {
+         usage(argv[0]);
+      }
+      const char* value = argv[++i];
+
+      if (strcmp(option, "--scenario") == 0)
+      {
+         scenarioSet = true;
+         if (strcmp(value, "register") == 0)
+         {
+            options.mScenario = LoadOptions::REGISTER;
+         }
+         else if (strcmp(value, "invite") == 0)
+         {
+            options.mScenario = LoadOptions::INVITE;
+         }
+         else if (strcmp(value, "subscribe") == 0)
+         {
+            options.mScenario = LoadOptions::SUBSCRIBE;
+         }
+         else if (strcmp(value, "options") == 0)
+         {
+            options.mScenario = LoadOptions::OPTIONS;
+         }
+         else
+         {
+            usage(argv[0]);
+         }
+      }
+      else if (strcmp(option, "--target") == 0)
+      {
+         options.mTarget = value;
+      }
+      else if (strcmp(option, "--domain") == 0)
+      {
+         options.mDomain = value;
+      }
+      else if (strcmp(option, "--transport") == 0)
+      {
+         options.mTransport = value;
+         if (   options.mTransport.compareTo("udp") != 0
+             && options.mTransport.compareTo("tcp") != 0
+             && options.mTransport.compareTo("tls") != 0)
+         {
+            usage(argv[0]);
+         }
+      }
+      else if (strcmp(option, "--rate") == 0)
+      {
+         options.mRate = atof(value);
+      }
+      else if (strcmp(option, "--duration") == 0)
+      {
+         options.mDuration = atoi(value);
+      }
+      else if (strcmp(option, "--users") == 0)
+      {
+         options.mUsers = atoi(value);
+      }
+      else if (strcmp(option, "--local-address") == 0)
+      {
+         options.mLocalAddress = value;
+      }
+      else if (strcmp(option, "--local-port") == 0)
+      {
+         options.mLocalPort = atoi(value);
+      }
+      else if (strcmp(option, "--timeout") == 0)
+      {
+         options.mTimeout = atoi(value);
+      }
+      else if (strcmp(option, "--output") == 0)
+      {
+         output = value;
+      }
+      else
+      {
+         usage(argv[0]);
+      }
+   }
+
+   if (   !scenarioSet
+       || options.mRate <= 0
+       || options.mDuration <= 0
+       || options.mUsers <= 0
+       || options.mLocalPort <= 0)
+   {
+      usage(argv[0]);
+   }
+
+   if (options.mDomain.isNull())
+   {
+      // The host of the target, or the generator itself.
+      options.mDomain = options.mTarget.isNull() ? options.mLocalAddress : options.mTarget;
+      ssize_t colon = options.mDomain.index(':');
+      if (colon != UTL_NOT_FOUND)
+      {
+         options.mDomain.remove(colon);
+      }
+   }
+
+   FILE* out = stdout;
+   if (output && !(out = fopen(output, "w")))
+   {
+      fprintf(stderr, "%s: cannot write '%s'\n", argv[0], output);
+      return 1;
+   }
+
+   LoadStatistics statistics;
+   bool tls = options.mTransport.compareTo("tls") == 0;
+   SipUserAgent* userAgent =
+      new SipUserAgent(options.mLocalPort,                        // TCP
+                       options.mLocalPort,                        // UDP
+                       tls ? options.mLocalPort + 1 : PORT_NONE,  // TLS
+                       options.mLocalAddress);
+   userAgent->allowMethod(SIP_BYE_METHOD);
+   userAgent->allowMethod(SIP_SUBSCRIBE_METHOD);
+   userAgent->allowMethod(SIP_NOTIFY_METHOD);
+
+   RetransmissionCounter retransmissions(statistics);
+   userAgent->addSipOutputProcessor(&retransmissions);
+   userAgent->start();
+
+   {
+      SipLoadGenerator generator(*userAgent, options, statistics);
+      generator.start();
+      generator.generate();
+      generator.requestShutdown();
+   }
+
+   userAgent->removeSipOutputProcessor(&retransmissions);
+   userAgent->shutdown(TRUE);
+   delete userAgent;
+
+   statistics.writeJson(out,
+                        LoadOptions::scenarioName(options.mScenario),
+                        options.mTransport,
+                        options.mRate);
+   if (out != stdout)
+   {
+      fclose(out);
+   }
+
+   return 0;
+}
@@ -0,0 +1,433 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+// APPLICATION INCLUDES
+#include "CallIdIndex.h"
+#include "ChunkScanner.h"
+
+// CONSTANTS
+static const char INDEX_MAGIC[8] = { 'S', '2', 'S', 'T', 'I', 'D', 'X', '1' };
+
+struct CallIdIndex::Header
+{
+   char mMagic[8];
+   uint64_t mLogSize;
+   int64_t mLogModificationTime;
+   uint64_t mEntryCount;
+};
+
+// FNV-1a
+static uint64_t hashOf(const char* data, size_t length)
+{
+   uint64_t hash = 14695981039346656037ULL;
+   for (size_t i = 0; i < length; i++)
+   {
+      hash ^= (unsigned char) data[i];
+      hash *= 1099511628211ULL;
+   }
+   return hash;
+}
+
+static bool entryLess(const CallIdIndex::Entry& a, const CallIdIndex::Entry& b)
+{
+   if (a.mHash != b.mHash)
+   {
+      return a.mHash < b.mHash;
+   }
+   if (a.mKind != b.mKind)
+   {
+      return a.mKind < b.mKind;
+   }
+   return a.mOffset < b.mOffset;
+}
+
+// Whether the header at p, just after an escaped line break, is named
+// name or shortName; returns where its value starts.
+static const char* headerValue(const char* p, const char* end,
+                               const char* name, const char* shortName)
+{
+   const char* names[] = { name, shortName };
+   for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+   {
+      size_t nameLength = strlen(names[i]);
+      if ((size_t) (end - p) > nameLength && strncasecmp(p, names[i], nameLength) == 0)
+      {
+         const char* q = p + nameLength;
+         while (q < end && (*q == ' ' || *q == '\t'))
+         {
+            q++;
+         }
+         if (q < end && *q == ':')
+         {
+            q++;
+            while (q < end && (*q == ' ' || *q == '\t'))
+            {
+               q++;
+            }
+            return q;
+         }
+      }
+   }
+   return NULL;
+}
+
+// The next header line of the escaped message at p: its start, after "\n".
+static const char* nextHeaderLine(const char* p, const char* end)
+{
+   while ((p = static_cast<const char*>(memchr(p, '\\', end - p))) && p + 1 < end)
+   {
+      if (p[1] == 'n')
+      {
+         return p + 2;
+      }
+      // Skip what is escaped, which may be a backslash.
+      p += 2;
+   }
+   return NULL;
+}
+
+// The end of a header value: the escape that ends its line, or the quote
+// that ends the message.
+static const char* valueEnd(const char* p, const char* end)
+{
+   while (p < end && *p != '\\' && *p != '"')
+   {
+      p++;
+   }
+   return p;
+}
+
+CallIdIndex::CallIdIndex() :
+   mpEntries(NULL),
+   mEntryCount(0)
+{
+}
+
+CallIdIndex::~CallIdIndex()
+{
+}
+
+UtlString CallIdIndex::indexPath(const UtlString& logPath)
+{
+   UtlString path(logPath);
+   path.append(".callid-index");
+   return path;
+}
+
+bool CallIdIndex::isMessageLine(const char* line, size_t length)
+{
+   // "time":event count:FACILITY:...
+   const char* end = line + length;
+   const char* p = line;
+   if (p < end && *p == '"')
+   {
+      p = static_cast<const char*>(memchr(p + 1, '"', end - p - 1));
+      if (!p)
+      {
+         return false;
+      }
+      p++;
+   }
+   for (int field = 0; field < 2; field++)
+   {
+      p = static_cast<const char*>(memchr(p, ':', end - p));
+      if (!p)
+      {
+         return false;
+      }
+      p++;
+   }
+   return ((size_t) (end - p) > 9 &&
+           (strncmp(p, "INCOMING:", 9) == 0 || strncmp(p, "OUTGOING:", 9) == 0));
+}
+
+bool CallIdIndex::getCallId(const char* line, size_t length, UtlString& callId)
+{
+   const char* end = line + length;
+   const char* p = line;
+   while ((p = nextHeaderLine(p, end)))
+   {
+      const char* value = headerValue(p, end, "Call-ID", "i");
+      if (value)
+      {
+         const char* valueStop = valueEnd(value, end);
+         while (valueStop > value && (valueStop[-1] == ' ' || valueStop[-1] == '\t'))
+         {
+            valueStop--;
+         }
+         callId.remove(0);
+         callId.append(value, valueStop - value);
+         return !callId.isNull();
+      }
+   }
+   return false;
+}
+
+void CallIdIndex::getBranches(const char* line, size_t length, std::vector<UtlString>& branches)
+{
+   static const char BRANCH[] = ";branch=";
+   static const size_t BRANCH_LENGTH = sizeof(BRANCH) - 1;
+
+   const char* end = line + length;
+   const char* p = line;
+   while ((p = nextHeaderLine(p, end)))
+   {
+      const char* value = headerValue(p, end, "Via", "v");
+      if (!value)
+      {
+         continue;
+      }
+
+      // A Via header may carry several comma-separated Vias.
+      const char* valueStop = valueEnd(value, end);
+      for (const char* q = value; q + BRANCH_LENGTH <= valueStop; q++)
+      {
+         if (*q == ';' && strncasecmp(q, BRANCH, BRANCH_LENGTH) == 0)
+         {
+            const char* branch = q + BRANCH_LENGTH;
+            const char* branchEnd = branch;
+            while (branchEnd < valueStop && !strchr(";, \t>", *branchEnd))
+            {
+               branchEnd++;
+            }
+            if (branchEnd > branch)
+            {
+               branches.push_back(UtlString(branch, branchEnd - branch));
+            }
+            q = branchEnd - 1;
+         }
+      }
+      p = valueStop;
+   }
+}
+
+void CallIdIndex::indexLines(const char* data, size_t offset, size_t length, Entries& entries)
+{
+   UtlString callId;
+   std::vector<UtlString> branches;
+
+   const char* p = data + offset;
+   const char* end = p + length;
+   while (p < end)
+   {
+      const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+      if (!lineEnd)
+      {
+         lineEnd = end;
+      }
+      size_t lineLength = lineEnd - p;
+
+      if (isMessageLine(p, lineLength) && getCallId(p, lineLength, callId))
+      {
+         Entry entry;
+         entry.mOffset = p - data;
+         entry.mLength = lineLength;
+
+         entry.mHash = hashOf(callId.data(), callId.length());
+         entry.mKind = CALL_ID;
+         entries.push_back(entry);
+
+         branches.clear();
+         getBranches(p, lineLength, branches);
+         entry.mKind = BRANCH;
+         for (size_t i = 0; i < branches.size(); i++)
+         {
+            entry.mHash = hashOf(branches[i].data(), branches[i].length());
+            entries.push_back(entry);
+         }
+      }
+
+      p = lineEnd + 1;
+   }
+}
+
+// Indexes the chunks of a log in parallel, gathering the entries in log order.
+class IndexScanner : public ChunkScanner
+{
+public:
+   IndexScanner(const MappedLog& log, const MappedLog::Chunks& chunks,
+                CallIdIndex::Entries& entries) :
+      ChunkScanner(log.data(), chunks),
+      mpData(log.data()),
+      mChunkEntries(chunks.size()),
+      mEntries(entries)
+   {
+   }
+
+protected:
+   void scanChunk(size_t index, const char*, size_t length)
+   {
+      CallIdIndex::indexLines(mpData, chunks()[index].mOffset, length, mChunkEntries[index]);
+   }
+
+   void chunkScanned(size_t index)
+   {
+      mEntries.insert(mEntries.end(), mChunkEntries[index].begin(), mChunkEntries[index].end());
+      CallIdIndex::Entries().swap(mChunkEntries[index]);
+   }
+
+private:
+   const char* mpData;
+   std::vector<CallIdIndex::Entries> mChunkEntries;
+   CallIdIndex::Entries& mEntries;
+};
+
+void CallIdIndex::build(const UtlString& path, const MappedLog& log, size_t chunkSize, int threads)
+{
+   mSidecar.unmap();
+   mBuilt.clear();
+
+   MappedLog::Chunks chunks;
+   MappedLog::split(log.data(), log.size(), chunkSize, chunks);
+   IndexScanner scanner(log, chunks, mBuilt);
+   scanner.scan(threads);
+
+   std::sort(mBuilt.begin(), mBuilt.end(), entryLess);
+   mpEntries = mBuilt.empty() ? NULL : &mBuilt[0];
+   mEntryCount = mBuilt.size();
+
+   if (!path.isNull() && !save(path, log))
+   {
+      fprintf(stderr, "%s: %s, the index is not kept\n", path.data(), strerror(errno));
+   }
+}
+
+bool CallIdIndex::save(const UtlString& path, const MappedLog& log) const
+{
+   // Write a temporary file and rename it, so that a reader never sees a
+   // partial index.
+   UtlString temporaryPath(path);
+   temporaryPath.append(".tmp");
+   FILE* pFile = fopen(temporaryPath.data(), "w");
+   if (!pFile)
+   {
+      return false;
+   }
+
+   Header header;
+   memcpy(header.mMagic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+   header.mLogSize = log.size();
+   header.mLogModificationTime = log.modificationTime();
+   header.mEntryCount = mEntryCount;
+
+   bool written = (fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+                   (mEntryCount == 0 || fwrite(mpEntries, sizeof(Entry), mEntryCount, pFile) == mEntryCount));
+   written = (fclose(pFile) == 0) && written;
+   if (!written || rename(temporaryPath.data(), path.data()) != 0)
+   {
+      int error = errno;
+      unlink(temporaryPath.data());
+      errno = error;
+      return false;
+   }
+   return true;
+}
+
+bool CallIdIndex::open(const UtlString& path, const MappedLog& log)
+{
+   int fd = ::open(path.data(), O_RDONLY);
+   if (fd == -1)
+   {
+      return false;
+   }
+   bool mapped = mSidecar.map(fd);
+   close(fd);
+   if (!mapped || mSidecar.size() < sizeof(Header))
+   {
+      mSidecar.unmap();
+      return false;
+   }
+
+   const Header* pHeader = reinterpret_cast<const Header*>(mSidecar.data());
+   if (memcmp(pHeader->mMagic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+       pHeader->mLogSize != log.size() ||
+       pHeader->mLogModificationTime != (int64_t) log.modificationTime() ||
+       sizeof(Header) + pHeader->mEntryCount * sizeof(Entry) != mSidecar.size())
+   {
+      mSidecar.unmap();
+      return false;
+   }
+
+   mBuilt.clear();
+   mpEntries = reinterpret_cast<const Entry*>(mSidecar.data() + sizeof(Header));
+   mEntryCount = pHeader->mEntryCount;
+   return true;
+}
+
+void CallIdIndex::find(Kind kind, const UtlString& key, const Entry*& pBegin, const Entry*& pEnd) const
+{
+   Entry first;
+   first.mHash = hashOf(key.data(), key.length());
+   first.mKind = kind;
+   first.mOffset = 0;
+   first.mLength = 0;
+
+   const Entry* pEntries = mpEntries ? mpEntries : &first;
+   pBegin = std::lower_bound(pEntries, pEntries + mEntryCount, first, entryLess);
+   pEnd = pBegin;
+   while (pEnd < pEntries + mEntryCount && pEnd->mHash == first.mHash && pEnd->mKind == (uint32_t) kind)
+   {
+      pEnd++;
+   }
+}
+
+void CallIdIndex::findCall(const MappedLog& log, const UtlString& callId, Lines& lines) const
+{
+   const Entry* pBegin;
+   const Entry* pEnd;
+   find(CALL_ID, callId, pBegin, pEnd);
+
+   // Entries with the same hash are in log order.
+   UtlString lineCallId;
+   for (const Entry* pEntry = pBegin; pEntry < pEnd; pEntry++)
+   {
+      if (pEntry->mOffset + pEntry->mLength <= log.size() &&
+          getCallId(log.data() + pEntry->mOffset, pEntry->mLength, lineCallId) &&
+          lineCallId == callId)
+      {
+         Line line;
+         line.mOffset = pEntry->mOffset;
+         line.mLength = pEntry->mLength;
+         lines.push_back(line);
+      }
+   }
+}
+
+bool CallIdIndex::findBranch(const MappedLog& log, const UtlString& branch, UtlString& callId) const
+{
+   const Entry* pBegin;
+   const Entry* pEnd;
+   find(BRANCH, branch, pBegin, pEnd);
+
+   std::vector<UtlString> branches;
+   for (const Entry* pEntry = pBegin; pEntry < pEnd; pEntry++)
+   {
+      if (pEntry->mOffset + pEntry->mLength > log.size())
+      {
+         continue;
+      }
+      const char* line = log.data() + pEntry->mOffset;
+      branches.clear();
+      getBranches(line, pEntry->mLength, branches);
+      if (std::find(branches.begin(), branches.end(), branch) != branches.end())
+      {
+         return getCallId(line, pEntry->mLength, callId);
+      }
+   }
+   return false;
+}
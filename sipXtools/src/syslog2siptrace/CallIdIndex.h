@@ -0,0 +1,121 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _CallIdIndex_h_
+#define _CallIdIndex_h_
+
+// SYSTEM INCLUDES
+#include <stdint.h>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include <utl/UtlString.h>
+#include "MappedLog.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// Index of the SIP messages in a log by Call-ID and by Via branch.
+///
+/// The index is a table of (hash of the Call-ID or branch, line) entries
+/// sorted by hash, kept in a sidecar file next to the log (see indexPath())
+/// so that it is built once per log: a later lookup maps the sidecar and
+/// binary-searches it, then checks the few lines it points at, instead of
+/// scanning the whole log.  The sidecar records the size and modification
+/// time of the log it was built for, and is rebuilt when either changes.
+class CallIdIndex
+{
+public:
+
+   /// A message, logged on one line of the log.
+   struct Line
+   {
+      uint64_t mOffset;
+      uint32_t mLength;
+   };
+   typedef std::vector<Line> Lines;
+
+   CallIdIndex();
+
+   ~CallIdIndex();
+
+   /// Path of the sidecar index of the log at logPath.
+   static UtlString indexPath(const UtlString& logPath);
+
+   /// Use the sidecar at path, if it was built for log.
+   bool open(const UtlString& path, const MappedLog& log);
+   ///< Returns false if there is no sidecar or it is stale.
+
+   /// Index log on threads threads, and save the index to path.
+   void build(const UtlString& path, const MappedLog& log, size_t chunkSize, int threads);
+   ///< If path is empty or the sidecar can not be written, the index is
+   ///< only kept in memory.
+
+   /// The messages of the call callId in log, in log order.
+   void findCall(const MappedLog& log, const UtlString& callId, Lines& lines) const;
+
+   /// The Call-ID of the message in log whose Vias carry branch.
+   bool findBranch(const MappedLog& log, const UtlString& branch, UtlString& callId) const;
+
+   /// Number of Call-ID and branch entries.
+   size_t size() const { return mEntryCount; }
+
+   /// Whether a log line is a logged SIP message (INCOMING or OUTGOING).
+   static bool isMessageLine(const char* line, size_t length);
+
+   /// The Call-ID of the message logged on line.
+   static bool getCallId(const char* line, size_t length, UtlString& callId);
+
+   /// The branch parameters of the Vias of the message logged on line.
+   static void getBranches(const char* line, size_t length, std::vector<UtlString>& branches);
+
+   struct Entry
+   {
+      uint64_t mHash;
+      uint64_t mOffset;
+      uint32_t mLength;
+      uint32_t mKind;
+   };
+   typedef std::vector<Entry> Entries;
+
+   /// Add the entries of the messages in the lines at data to entries.
+   static void indexLines(const char* data, size_t offset, size_t length, Entries& entries);
+
+private:
+
+   struct Header;
+
+   enum Kind
+   {
+      CALL_ID = 1,
+      BRANCH = 2
+   };
+
+   /// The range of entries of kind with the hash of key.
+   void find(Kind kind, const UtlString& key, const Entry*& pBegin, const Entry*& pEnd) const;
+
+   bool save(const UtlString& path, const MappedLog& log) const;
+
+   MappedLog mSidecar;        ///< the sidecar, when opened
+   Entries mBuilt;            ///< the entries, when built
+   const Entry* mpEntries;
+   size_t mEntryCount;
+
+   // Disabled
+   CallIdIndex(const CallIdIndex&);
+   CallIdIndex& operator=(const CallIdIndex&);
+};
+
+#endif // _CallIdIndex_h_
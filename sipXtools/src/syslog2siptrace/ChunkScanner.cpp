@@ -0,0 +1,126 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <unistd.h>
+
+// APPLICATION INCLUDES
+#include <os/OsTask.h>
+#include "ChunkScanner.h"
+
+// CONSTANTS
+// Chunks each worker may have scanned ahead of the one being collected.
+static const int CHUNKS_AHEAD_PER_THREAD = 2;
+
+class ChunkScanner::Worker : public OsTask
+{
+public:
+   Worker(ChunkScanner& scanner) :
+      OsTask("ChunkScanner-%d"),
+      mScanner(scanner)
+   {
+   }
+
+   ~Worker()
+   {
+      waitUntilShutDown();
+   }
+
+   int run(void*)
+   {
+      mScanner.work();
+      return 0;
+   }
+
+private:
+   ChunkScanner& mScanner;
+};
+
+ChunkScanner::ChunkScanner(const char* data, const MappedLog::Chunks& chunks) :
+   mpData(data),
+   mChunks(chunks),
+   mNextChunk(0),
+   mpSlots(NULL)
+{
+   mScanned.reserve(mChunks.size());
+   for (size_t i = 0; i < mChunks.size(); i++)
+   {
+      mScanned.push_back(new OsBSem(OsBSem::Q_FIFO, OsBSem::EMPTY));
+   }
+}
+
+ChunkScanner::~ChunkScanner()
+{
+   for (size_t i = 0; i < mScanned.size(); i++)
+   {
+      delete mScanned[i];
+   }
+   delete mpSlots;
+}
+
+int ChunkScanner::processors()
+{
+   long count = sysconf(_SC_NPROCESSORS_ONLN);
+   return count > 0 ? (int) count : 1;
+}
+
+void ChunkScanner::scan(int threads)
+{
+   if (threads < 1)
+   {
+      threads = 1;
+   }
+   if ((size_t) threads > mChunks.size())
+   {
+      threads = mChunks.size() > 0 ? mChunks.size() : 1;
+   }
+
+   int slots = threads * CHUNKS_AHEAD_PER_THREAD;
+   delete mpSlots;
+   mpSlots = new OsCSem(OsCSem::Q_FIFO, slots, slots);
+   mNextChunk = 0;
+
+   std::vector<Worker*> workers;
+   for (int i = 0; i < threads; i++)
+   {
+      workers.push_back(new Worker(*this));
+      workers.back()->start();
+   }
+
+   for (size_t i = 0; i < mChunks.size(); i++)
+   {
+      mScanned[i]->acquire();
+      chunkScanned(i);
+      mpSlots->release();
+   }
+
+   for (size_t i = 0; i < workers.size(); i++)
+   {
+      delete workers[i];
+   }
+}
+
+void ChunkScanner::work()
+{
+   for (;;)
+   {
+      // Chunks are taken in order, so the one being collected always holds
+      // a slot and finishes.
+      mpSlots->acquire();
+      size_t index = __sync_fetch_and_add(&mNextChunk, 1);
+      if (index >= mChunks.size())
+      {
+         mpSlots->release();
+         return;
+      }
+
+      scanChunk(index, mpData + mChunks[index].mOffset, mChunks[index].mLength);
+      mScanned[index]->release();
+   }
+}
@@ -0,0 +1,81 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _ChunkScanner_h_
+#define _ChunkScanner_h_
+
+// SYSTEM INCLUDES
+#include <vector>
+
+// APPLICATION INCLUDES
+#include <os/OsBSem.h>
+#include <os/OsCSem.h>
+#include "MappedLog.h"
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// Scans the chunks of a log on several threads, and hands the results back
+/// in log order.
+///
+/// scanChunk() is called for every chunk, on one of the worker threads, and
+/// chunkScanned() is then called for each chunk in turn on the thread that
+/// called scan(), so that output stays in log order whichever thread
+/// finishes first.  Workers only run so far ahead of chunkScanned(), which
+/// bounds how much scanned output is held at once.
+class ChunkScanner
+{
+public:
+
+   ChunkScanner(const char* data, const MappedLog::Chunks& chunks);
+
+   virtual ~ChunkScanner();
+
+   /// Scan every chunk on threads threads; returns once all were collected.
+   void scan(int threads);
+
+   /// Number of processors, for the default number of threads.
+   static int processors();
+
+protected:
+
+   /// Scan chunk index, whose lines start at pData.  Called on a worker.
+   virtual void scanChunk(size_t index, const char* pData, size_t length) = 0;
+
+   /// Use the result of scanning chunk index.  Called in chunk order.
+   virtual void chunkScanned(size_t index) = 0;
+
+   const MappedLog::Chunks& chunks() const { return mChunks; }
+
+private:
+
+   class Worker;
+   friend class Worker;
+
+   /// Loop of a worker thread.
+   void work();
+
+   const char* mpData;
+   const MappedLog::Chunks& mChunks;
+   size_t mNextChunk;                ///< next chunk for a worker to take
+   OsCSem* mpSlots;                  ///< chunks scanned but not yet collected
+   std::vector<OsBSem*> mScanned;    ///< released once each chunk is scanned
+
+   // Disabled
+   ChunkScanner(const ChunkScanner&);
+   ChunkScanner& operator=(const ChunkScanner&);
+};
+
+#endif // _ChunkScanner_h_
@@ -0,0 +1,98 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// APPLICATION INCLUDES
+#include "MappedLog.h"
+
+MappedLog::MappedLog() :
+   mpData(""),
+   mSize(0),
+   mModificationTime(0)
+{
+}
+
+MappedLog::~MappedLog()
+{
+   unmap();
+}
+
+bool MappedLog::map(int fd)
+{
+   unmap();
+
+   struct stat status;
+   if (fstat(fd, &status) != 0)
+   {
+      return false;
+   }
+   if (!S_ISREG(status.st_mode))
+   {
+      errno = ENODEV;
+      return false;
+   }
+
+   mModificationTime = status.st_mtime;
+   if (status.st_size > 0)
+   {
+      void* pData = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (pData == MAP_FAILED)
+      {
+         return false;
+      }
+      // The whole file is read once, front to back.
+      madvise(pData, status.st_size, MADV_SEQUENTIAL);
+      mpData = static_cast<const char*>(pData);
+      mSize = status.st_size;
+   }
+   return true;
+}
+
+void MappedLog::unmap()
+{
+   if (mSize > 0)
+   {
+      munmap(const_cast<char*>(mpData), mSize);
+   }
+   mpData = "";
+   mSize = 0;
+   mModificationTime = 0;
+}
+
+void MappedLog::split(const char* data, size_t size, size_t chunkSize, Chunks& chunks)
+{
+   size_t offset = 0;
+   while (offset < size)
+   {
+      Chunk chunk;
+      chunk.mOffset = offset;
+
+      size_t end = offset + chunkSize;
+      if (end >= size)
+      {
+         end = size;
+      }
+      else
+      {
+         // Extend the chunk to the end of the line it stops in.
+         const char* pNewline =
+            static_cast<const char*>(memchr(data + end, '\n', size - end));
+         end = pNewline ? pNewline - data + 1 : size;
+      }
+
+      chunk.mLength = end - offset;
+      chunks.push_back(chunk);
+      offset = end;
+   }
+}
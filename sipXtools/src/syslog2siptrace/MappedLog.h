@@ -0,0 +1,78 @@
+//
+//
+// Copyright (C) 2007 Pingtel Corp., certain elements licensed under a Contributor Agreement.
+// Contributors retain copyright to elements licensed under a Contributor Agreement.
+// Licensed to the User under the LGPL license.
+//
+// $$
+////////////////////////////////////////////////////////////////////////
+
+#ifndef _MappedLog_h_
+#define _MappedLog_h_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+#include <time.h>
+#include <vector>
+
+// APPLICATION INCLUDES
+#include <utl/UtlString.h>
+
+// DEFINES
+// MACROS
+// EXTERNAL FUNCTIONS
+// EXTERNAL VARIABLES
+// CONSTANTS
+// STRUCTS
+// TYPEDEFS
+// FORWARD DECLARATIONS
+
+/// A log file, or the index of one, mmap()ed read-only.
+///
+/// Mapping a multi-GB log costs no copy, and its pages are shared by the
+/// threads that scan it.  Input that is not a regular file (stdin, a pipe)
+/// can not be mapped and is read in batches instead, see main.cpp.
+class MappedLog
+{
+public:
+
+   /// Part of a log made of whole lines.
+   struct Chunk
+   {
+      size_t mOffset;
+      size_t mLength;
+   };
+   typedef std::vector<Chunk> Chunks;
+
+   MappedLog();
+
+   ~MappedLog();
+
+   /// Map the regular file open on fd.
+   bool map(int fd);
+   ///< Returns false and sets errno if fd is not a regular file or can
+   ///< not be mapped.  Does not take over fd.
+
+   void unmap();
+
+   const char* data() const { return mpData; }
+
+   size_t size() const { return mSize; }
+
+   time_t modificationTime() const { return mModificationTime; }
+
+   /// Split data into chunks of about chunkSize bytes that end at line ends.
+   static void split(const char* data, size_t size, size_t chunkSize, Chunks& chunks);
+
+private:
+
+   const char* mpData;
+   size_t mSize;
+   time_t mModificationTime;
+
+   // Disabled
+   MappedLog(const MappedLog&);
+   MappedLog& operator=(const MappedLog&);
+};
+
+#endif // _MappedLog_h_
@@ -8,79 +8,85 @@
 // Cloned from syslogviewer
 
 #include <string>
+#include <vector>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #if defined(_WIN32)
 #   include <io.h>
-#   include <string.h>
 #elif defined(__pingtel_on_posix__)
 #   include <unistd.h>
 #endif
 
-#define BUFFER_SIZE 8192
+// Lines are converted in chunks of about this size, one chunk per thread
+// at a time, unless --chunk-size says otherwise.
+#define CHUNK_SIZE (4 * 1024 * 1024)
+// Input that is not a file is read this much at a time.
+#define READ_SIZE (64 * 1024)
 
 #include <os/OsDefs.h>
 #include <os/OsLoggerHelper.h>
 #include <net/NameValueTokenizer.h>
 #include <net/SipMessage.h>
+#include "CallIdIndex.h"
+#include "ChunkScanner.h"
+#include "MappedLog.h"
 
-void writeMessageNodesBegin(int outputFileDescriptor)
+void writeMessageNodesBegin(UtlString& output)
 {
     UtlString nodeBegin("<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n<sipTrace>\n");
-    
-    write(outputFileDescriptor, nodeBegin.data(), nodeBegin.length());
+
+    output.append(nodeBegin);
 }
 
-void writeMessageNodesEnd(int outputFileDescriptor)
+void writeMessageNodesEnd(UtlString& output)
 {
     UtlString nodeEnd("</sipTrace>\n");
-    
-    write(outputFileDescriptor, nodeEnd.data(), nodeEnd.length());
+
+    output.append(nodeEnd);
 }
 
-void writeBranchNodeBegin(int outputFileDescriptor)
+void writeBranchNodeBegin(UtlString& output)
 {
     UtlString nodeBegin("\t<branchNode>\n");
-    
-    write(outputFileDescriptor, nodeBegin.data(), nodeBegin.length());
+
+    output.append(nodeBegin);
 }
 
-void writeBranchNodeEnd(int outputFileDescriptor)
+void writeBranchNodeEnd(UtlString& output)
 {
     UtlString nodeEnd("\t</branchNode>\n");
-    
-    write(outputFileDescriptor, nodeEnd.data(), nodeEnd.length());
+
+    output.append(nodeEnd);
 }
 
-void writeBranchSetBegin(int outputFileDescriptor)
+void writeBranchSetBegin(UtlString& output)
 {
     UtlString nodeBegin("\t\t<branchIdSet>\n");
-    
-    write(outputFileDescriptor, nodeBegin.data(), nodeBegin.length());
+
+    output.append(nodeBegin);
 }
 
-void writeBranchSetEnd(int outputFileDescriptor)
+void writeBranchSetEnd(UtlString& output)
 {
     UtlString nodeEnd("\t\t</branchIdSet>\n");
-    
-    write(outputFileDescriptor, nodeEnd.data(), nodeEnd.length());
+
+    output.append(nodeEnd);
 }
 
-void writeBranchId(int outputFileDescriptor,
+void writeBranchId(UtlString& output,
                    UtlString& branchId)
 {
     NameValueTokenizer::frontBackTrim(&branchId, " \t\n\r");
-    UtlString node("\t\t\t<branchId>");
-    node.append(branchId);
-    node.append("</branchId>\n");
-
-    
-    write(outputFileDescriptor, node.data(), node.length());
+    output.append("\t\t\t<branchId>");
+    output.append(branchId);
+    output.append("</branchId>\n");
 }
 
-void writeBranchNodeData(int outputFileDescriptor,
+void writeBranchNodeData(UtlString& output,
                          UtlString& time,
                          UtlString& source,
                          UtlString& destination,
@@ -106,84 +112,81 @@ void writeBranchNodeData(int outputFileDescriptor,
     NameValueTokenizer::frontBackTrim(&responseText, " \t\n\r");
     //NameValueTokenizer::frontBackTrim(&message, " \t\n\r");
 
-    UtlString node("\t\t<time>");
-    node.append(time);
-    node.append("</time>\n");
+    output.append("\t\t<time>");
+    output.append(time);
+    output.append("</time>\n");
 
     if(!source.isNull())
     {
-        node.append("\t\t<source>");
-        node.append(source);
-        node.append("</source>\n");
+        output.append("\t\t<source>");
+        output.append(source);
+        output.append("</source>\n");
     }
 
     if(!destination.isNull())
     {
-        node.append("\t\t<destination>");
-        node.append(destination);
-        node.append("</destination>\n");
+        output.append("\t\t<destination>");
+        output.append(destination);
+        output.append("</destination>\n");
     }
 
-    node.append("\t\t<sourceAddress>");
-    node.append(sourceAddress);
-    node.append("</sourceAddress>\n");
+    output.append("\t\t<sourceAddress>");
+    output.append(sourceAddress);
+    output.append("</sourceAddress>\n");
 
-    node.append("\t\t<destinationAddress>");
-    node.append(destinationAddress);
-    node.append("</destinationAddress>\n");
+    output.append("\t\t<destinationAddress>");
+    output.append(destinationAddress);
+    output.append("</destinationAddress>\n");
 
-    node.append("\t\t<transactionId>");
-    node.append(transactionId);
-    node.append("</transactionId>\n");
+    output.append("\t\t<transactionId>");
+    output.append(transactionId);
+    output.append("</transactionId>\n");
 
     if(!method.isNull())
     {
-        node.append("\t\t<method>");
-        node.append(method);
-        node.append("</method>\n");
+        output.append("\t\t<method>");
+        output.append(method);
+        output.append("</method>\n");
     }
     else
     {
-        node.append("\t\t<responseCode>");
-        node.append(responseCode);
-        node.append("</responseCode>\n");
+        output.append("\t\t<responseCode>");
+        output.append(responseCode);
+        output.append("</responseCode>\n");
 
-        node.append("\t\t<responseText>");
-        node.append(responseText);
-        node.append("</responseText>\n");
+        output.append("\t\t<responseText>");
+        output.append(responseText);
+        output.append("</responseText>\n");
     }
 
-    node.append("\t\t<frameId>");
-    node.append(frameId);
-    node.append("</frameId>\n");
+    output.append("\t\t<frameId>");
+    output.append(frameId);
+    output.append("</frameId>\n");
 
     if (isOutgoing)
     {
-       node.append("\t\t<remoteHostPort>");
-       node.append(destinationAddress);
-       node.append("</remoteHostPort>\n");
+       output.append("\t\t<remoteHostPort>");
+       output.append(destinationAddress);
+       output.append("</remoteHostPort>\n");
 
-       node.append("\t\t<isOutgoing>");
-       node.append("true");
-       node.append("</isOutgoing>\n");
+       output.append("\t\t<isOutgoing>");
+       output.append("true");
+       output.append("</isOutgoing>\n");
     }
     else
     {
-       node.append("\t\t<remoteHostPort>");
-       node.append(sourceAddress);
-       node.append("</remoteHostPort>\n");
+       output.append("\t\t<remoteHostPort>");
+       output.append(sourceAddress);
+       output.append("</remoteHostPort>\n");
 
-       node.append("\t\t<isOutgoing>");
-       node.append("false");
-       node.append("</isOutgoing>\n");
+       output.append("\t\t<isOutgoing>");
+       output.append("false");
+       output.append("</isOutgoing>\n");
     }
 
-    node.append("\t\t<message><![CDATA[");
-    node.append(message);
-    node.append("]]></message>\n");
-
-    
-    write(outputFileDescriptor, node.data(), node.length());
+    output.append("\t\t<message><![CDATA[");
+    output.append(message);
+    output.append("]]></message>\n");
 }
 
 void getMessageData(UtlString& content,
@@ -191,7 +194,7 @@ void getMessageData(UtlString& content,
                    UtlString& date,
                    UtlString& hostname,
                    UtlString& eventCount,
-                   int outputFileDescriptor)
+                   UtlString& output)
 {
     UtlString remoteHostPort;   // remote host-port
     UtlString remoteAddress;    // remote address from "Remote Host:"
@@ -375,10 +378,10 @@ void getMessageData(UtlString& content,
         // Write all the stuff out
 
         // Write out the node container start
-        writeBranchNodeBegin(outputFileDescriptor);
+        writeBranchNodeBegin(output);
 
         // Write out the branchId container start
-        writeBranchSetBegin(outputFileDescriptor);
+        writeBranchSetBegin(output);
 
         // Write out the branchIds
         int viaIndex = 0;
@@ -388,15 +391,15 @@ void getMessageData(UtlString& content,
             SipMessage::getViaTag(topVia.data(),
                                   "branch",
                                   branchId);
-            writeBranchId(outputFileDescriptor, branchId);
+            writeBranchId(output, branchId);
             viaIndex++;
         }
 
         // Write out the branchId container finish
-        writeBranchSetEnd(outputFileDescriptor);
+        writeBranchSetEnd(output);
 
         // Write out the rest of the node data
-        writeBranchNodeData(outputFileDescriptor,
+        writeBranchNodeData(output,
                             date,
                             // source
                             isOutgoing ? hostname :
@@ -425,11 +428,11 @@ void getMessageData(UtlString& content,
                             message);
 
         // Write out the node container finish
-        writeBranchNodeEnd(outputFileDescriptor);
+        writeBranchNodeEnd(output);
     }
 }
 
-void convertToXml(UtlString& bufferString, int outputFileDescriptor)
+void convertToXml(UtlString& bufferString, UtlString& output)
 {
     UtlString date;
     UtlString eventCount;
@@ -462,7 +465,7 @@ void convertToXml(UtlString& bufferString, int outputFileDescriptor)
                        date,
                        hostname,
                        eventCount,
-                       outputFileDescriptor);
+                       output);
 
 
     }
@@ -477,21 +480,212 @@ void convertToXml(UtlString& bufferString, int outputFileDescriptor)
                        date,
                        hostname,
                        eventCount,
-                       outputFileDescriptor);
+                       output);
     }
 }
 
 
+// Which lines to convert.
+struct LineFilter
+{
+   const char* mBefore;          // inclusive time limits, NULL for none
+   const char* mAfter;
+   const UtlString* mpCallId;    // only the messages of this call, if not NULL
+};
+
+// Convert the lines at data to XML, appending it to output.
+void convertLines(const char* data, size_t length, const LineFilter& filter, UtlString& output)
+{
+   UtlString line;
+   UtlString callId;
+   const char* end = data + length;
+   while (data < end)
+   {
+      const char* lineEnd = static_cast<const char*>(memchr(data, '\n', end - data));
+      if (lineEnd == NULL)
+      {
+         lineEnd = end;
+      }
+      size_t lineLength = lineEnd - data;
+      if (lineLength > 0 && data[lineLength - 1] == '\r')
+      {
+         lineLength--;
+      }
+
+      // Only SIP messages produce XML, so other lines are not even copied.
+      if (CallIdIndex::isMessageLine(data, lineLength) &&
+          (filter.mpCallId == NULL ||
+           (CallIdIndex::getCallId(data, lineLength, callId) && callId == *filter.mpCallId)))
+      {
+         line.remove(0);
+         line.append(data, lineLength);
+
+         // Test the string to see if the timestamp is in range.
+         if ((filter.mBefore == NULL || line.compareTo(filter.mBefore) <= 0) &&
+             (filter.mAfter == NULL || line.compareTo(filter.mAfter) >= 0))
+         {
+            convertToXml(line, output);
+         }
+      }
+
+      data = lineEnd + 1;
+   }
+}
+
+bool writeAll(int fd, const char* data, size_t length)
+{
+   while (length > 0)
+   {
+      ssize_t written = write(fd, data, length);
+      if (written < 0)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+         return false;
+      }
+      data += written;
+      length -= written;
+   }
+   return true;
+}
+
+// Converts the chunks of a log in parallel, writing the XML in log order.
+class TraceScanner : public ChunkScanner
+{
+public:
+   TraceScanner(const char* data, const MappedLog::Chunks& chunks,
+                const LineFilter& filter, int outputFileDescriptor) :
+      ChunkScanner(data, chunks),
+      mFilter(filter),
+      mOutputFileDescriptor(outputFileDescriptor),
+      mOutputs(chunks.size(), (UtlString*) NULL),
+      mWriteFailed(false)
+   {
+   }
+
+   ~TraceScanner()
+   {
+      for (size_t i = 0; i < mOutputs.size(); i++)
+      {
+         delete mOutputs[i];
+      }
+   }
+
+   bool writeFailed() const { return mWriteFailed; }
+
+protected:
+   void scanChunk(size_t index, const char* data, size_t length)
+   {
+      UtlString* pOutput = new UtlString;
+      convertLines(data, length, mFilter, *pOutput);
+      mOutputs[index] = pOutput;
+   }
+
+   void chunkScanned(size_t index)
+   {
+      if (!mWriteFailed &&
+          !writeAll(mOutputFileDescriptor, mOutputs[index]->data(), mOutputs[index]->length()))
+      {
+         mWriteFailed = true;
+      }
+      delete mOutputs[index];
+      mOutputs[index] = NULL;
+   }
+
+private:
+   const LineFilter& mFilter;
+   int mOutputFileDescriptor;
+   std::vector<UtlString*> mOutputs;
+   bool mWriteFailed;
+};
+
+// Convert the lines at data on threads threads, writing the XML to ofd.
+bool convertData(const char* data, size_t length, const LineFilter& filter,
+                 size_t chunkSize, int threads, int ofd)
+{
+   MappedLog::Chunks chunks;
+   MappedLog::split(data, length, chunkSize, chunks);
+   TraceScanner scanner(data, chunks, filter, ofd);
+   scanner.scan(threads);
+   return !scanner.writeFailed();
+}
+
+// Convert input that can not be mapped (a pipe), a batch at a time.
+bool convertStream(int ifd, const LineFilter& filter, size_t chunkSize, int threads, int ofd)
+{
+   size_t batchSize = (size_t) threads * chunkSize;
+   char* inputBuffer = new char[READ_SIZE];
+   UtlString batch;
+   bool ok = true;
+   bool atEnd = false;
+
+   while (!atEnd)
+   {
+      ssize_t readLength = read(ifd, inputBuffer, READ_SIZE);
+      if (readLength > 0)
+      {
+         batch.append(inputBuffer, readLength);
+      }
+      else if (readLength < 0 && errno == EINTR)
+      {
+         continue;
+      }
+      else
+      {
+         if (readLength < 0)
+         {
+            fprintf(stderr, "read: %s\n", strerror(errno));
+            ok = false;
+         }
+         atEnd = true;
+      }
+
+      if (batch.length() >= batchSize || atEnd)
+      {
+         // Convert the whole lines, and keep the start of the last one for
+         // the next batch; at the end, there is no more to wait for.
+         size_t length = batch.length();
+         if (!atEnd)
+         {
+            const char* data = batch.data();
+            while (length > 0 && data[length - 1] != '\n')
+            {
+               length--;
+            }
+         }
+         ok = convertData(batch.data(), length, filter, chunkSize, threads, ofd) && ok;
+         batch.remove(0, length);
+      }
+   }
+
+   delete[] inputBuffer;
+   return ok;
+}
+
+
 int main(int argc, char * argv[])
 {
    int i;
    // Input file descriptor.  Default is stdin.
    int ifd = 0;
+   // Input file name, which the Call-ID index is kept beside.
+   UtlString inputPath;
    // Output file descriptor.  Default is stdout.
    int ofd = 1;
    // Time limit strings.  Both tests are inclusive.  NULL means no test.
    char* before_test_string = NULL;
    char* after_test_string = NULL;
+   // Only the messages of one call, given by its Call-ID or a Via branch.
+   UtlString callId;
+   UtlString branch;
+   // Threads converting the log.
+   int threads = ChunkScanner::processors();
+   // Size of the chunks the threads take.
+   size_t chunkSize = CHUNK_SIZE;
+   bool useIndex = true;
+   bool indexOnly = false;
 
    // Parse the arguments.
    for(i = 1; i < argc; i++)
@@ -499,8 +693,19 @@ int main(int argc, char * argv[])
       if(!strcmp(argv[i], "-h"))
       {
          // If an argument is -h, print the usage message and exit.
-         fprintf(stderr, "Usage:\n\t%s [-h] [if=input] [of=output]\n",
-                 argv[0]);
+         fprintf(stderr,
+                 "Usage:\n\t%s [-h] [if=input] [of=output] [--before=time] [--after=time]\n"
+                 "\t\t[--call-id=call-id | --branch=branch-id] [--threads=N] [--chunk-size=bytes]\n"
+                 "\t\t[--no-index | --index]\n"
+                 "\n"
+                 "\t--call-id, --branch  only convert the messages of one call; for a log\n"
+                 "\t                     file, an index of its calls is kept in\n"
+                 "\t                     input.callid-index so that later queries are fast\n"
+                 "\t--threads            threads converting the log (default %d)\n"
+                 "\t--chunk-size         bytes of the log a thread takes at a time (default %d)\n"
+                 "\t--no-index           neither use nor write the index\n"
+                 "\t--index              only build (or refresh) the index of input\n",
+                 argv[0], threads, CHUNK_SIZE);
          return 0;
       }
       else if(!strncmp(argv[i], "if=", 3))
@@ -512,15 +717,16 @@ int main(int argc, char * argv[])
             fprintf(stderr, "%s: %s\n", &argv[i][3], strerror(errno));
             return 1;
          }
+         inputPath = &argv[i][3];
       }
       else if(!strncmp(argv[i], "of=", 3))
       {
          // of= designates the output file.
 #ifdef _WIN32
-         ofd = open(&argv[i][3], O_BINARY | O_WRONLY | O_CREAT, 0644);
+         ofd = open(&argv[i][3], O_BINARY | O_WRONLY | O_CREAT | O_TRUNC, 0644);
 #else
          /* No such thing as a "binary" file on POSIX */
-         ofd = open(&argv[i][3], O_WRONLY | O_CREAT, 0644);
+         ofd = open(&argv[i][3], O_WRONLY | O_CREAT | O_TRUNC, 0644);
 #endif
          if(ofd == -1)
          {
@@ -555,6 +761,41 @@ int main(int argc, char * argv[])
             after_test_string = t;
          }
       }
+      else if(!strncmp(argv[i], "--call-id=", 10))
+      {
+         callId = argv[i] + 10;
+      }
+      else if(!strncmp(argv[i], "--branch=", 9))
+      {
+         branch = argv[i] + 9;
+      }
+      else if(!strncmp(argv[i], "--threads=", 10))
+      {
+         threads = atoi(argv[i] + 10);
+         if (threads < 1)
+         {
+            fprintf(stderr, "Invalid option: %s\n", argv[i]);
+            return 1;
+         }
+      }
+      else if(!strncmp(argv[i], "--chunk-size=", 13))
+      {
+         int size = atoi(argv[i] + 13);
+         if (size < 1)
+         {
+            fprintf(stderr, "Invalid option: %s\n", argv[i]);
+            return 1;
+         }
+         chunkSize = size;
+      }
+      else if(!strcmp(argv[i], "--no-index"))
+      {
+         useIndex = false;
+      }
+      else if(!strcmp(argv[i], "--index"))
+      {
+         indexOnly = true;
+      }
       else
       {
          // All other options are errors.
@@ -563,59 +804,88 @@ int main(int argc, char * argv[])
       }
    }
 
-   writeMessageNodesBegin(ofd);
+   LineFilter filter;
+   filter.mBefore = before_test_string;
+   filter.mAfter = after_test_string;
+   filter.mpCallId = NULL;
 
-   char inputBuffer[BUFFER_SIZE + 1];
-   UtlString bufferString;
-   ssize_t lineLen;
-   ssize_t nextLineStart;
+   MappedLog log;
+   bool mapped = log.map(ifd);
+   bool query = !callId.isNull() || !branch.isNull();
 
-   do
+   if (indexOnly && (!mapped || inputPath.isNull()))
+   {
+      fprintf(stderr, "--index needs if= naming a log file\n");
+      return 1;
+   }
+   if (!branch.isNull() && !mapped)
    {
-      i = read(ifd, inputBuffer, BUFFER_SIZE);
+      fprintf(stderr, "--branch needs if= naming a log file\n");
+      return 1;
+   }
 
-      if(i > 0)
+   // Look a call up through the index of the log.
+   CallIdIndex index;
+   CallIdIndex::Lines lines;
+   if (indexOnly || (query && mapped))
+   {
+      UtlString indexPath;
+      if (useIndex && !inputPath.isNull())
+      {
+         indexPath = CallIdIndex::indexPath(inputPath);
+      }
+      if (indexOnly || indexPath.isNull() || !index.open(indexPath, log))
       {
-         inputBuffer[i] = '\0';
-         bufferString.append(inputBuffer);
+         index.build(indexPath, log, chunkSize, threads);
+      }
+      if (indexOnly)
+      {
+         return 0;
       }
 
-      do
+      if (!branch.isNull() && !index.findBranch(log, branch, callId))
       {
-         lineLen =
-            NameValueTokenizer::findNextLineTerminator(bufferString.data(),
-                                                       bufferString.length(),
-                                                       &nextLineStart);
+         fprintf(stderr, "No message with branch %s\n", branch.data());
+      }
+      if (!callId.isNull())
+      {
+         index.findCall(log, callId, lines);
+      }
+   }
 
-         // If a new line was found
-         if(nextLineStart > 0)
-         {
-            UtlString line;
-            line.append(bufferString, lineLen);
-            bufferString.remove(0, nextLineStart);
+   UtlString output;
+   writeMessageNodesBegin(output);
+   bool ok = writeAll(ofd, output.data(), output.length());
 
-            // Test the string to see if the timestamp is in range.
-            if ((before_test_string == NULL || line.compareTo(before_test_string) <= 0) &&
-                (after_test_string == NULL || line.compareTo(after_test_string) >= 0))
-            {
-               // Write the line as XML.
-               convertToXml(line, ofd);
-            }
-         }
+   if (query && mapped)
+   {
+      output.remove(0);
+      for (CallIdIndex::Lines::const_iterator line = lines.begin(); line != lines.end(); line++)
+      {
+         convertLines(log.data() + line->mOffset, line->mLength, filter, output);
       }
-      while(nextLineStart > 0);
-   } while(i && i != -1);
-
-   // Last line without a newline
-   if ((before_test_string == NULL || bufferString.compareTo(before_test_string) <= 0) &&
-       (after_test_string == NULL || bufferString.compareTo(after_test_string) >= 0))
+      ok = writeAll(ofd, output.data(), output.length()) && ok;
+   }
+   else
    {
-      convertToXml(bufferString, ofd);
+      if (query)
+      {
+         filter.mpCallId = &callId;
+      }
+      ok = (mapped ?
+            convertData(log.data(), log.size(), filter, chunkSize, threads, ofd) :
+            convertStream(ifd, filter, chunkSize, threads, ofd)) && ok;
    }
 
-   writeMessageNodesEnd(ofd);
+   output.remove(0);
+   writeMessageNodesEnd(output);
+   ok = writeAll(ofd, output.data(), output.length()) && ok;
 
-   close(ofd);
+   if (!ok || close(ofd) != 0)
+   {
+      fprintf(stderr, "Writing the trace failed: %s\n", strerror(errno));
+      return 1;
+   }
 
    return 0;
 }